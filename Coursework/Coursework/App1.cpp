@@ -3,6 +3,7 @@
 #include "App1.h"
 
 #include <limits>
+#include <chrono>
 
 #include "imGUI/imgui_internal.h"
 #include "ImSlider2D.h"
@@ -13,6 +14,20 @@
 #include "MathUtils.h"
 
 static void OptionButton(const char *label, bool &enabled);
+// Corners of the -1 to 1 cube transformed by matrix, indexed like OcclusionCuller::addBox
+static void getCubeCorners(const XMFLOAT4X4 &matrix, vec3f corners[8]);
+
+// == RENDER TEXTURE ALLOCATOR =============================================================================
+
+void *RenderTextureAllocator::createTexture(const FrameGraphTextureDesc &desc) {
+	return new RenderTexture(device, desc.width, desc.height, 0.1f, 100.f);
+}
+
+void RenderTextureAllocator::releaseTexture(void *texture) {
+	delete (RenderTexture *)texture;
+}
+
+// == APP ==================================================================================================
 
 void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeight, Input *in, bool VSYNC, bool FULL_SCREEN) {
 	// Call super/parent init function (required!)
@@ -21,79 +36,221 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	Device *device = renderer->getDevice();
 	DeviceContext *ctx = renderer->getDeviceContext();
 
+	// this thread becomes the main thread of the jobs, the only one that uses the device
+	jobSystem.init();
+
+	shaderLibrary.init(device);
+	d3dBackend.init(device, ctx);
+	stateCache.setBackend(&d3dBackend);
+	// before any shader is created, they register their constant buffers
+	constantAllocator.init(&stateCache);
+
+	commandLists.init(device, &d3dBackend);
+	recorder.init(&commandLists);
+	// the framework only has setters for its states, they are read back from the context
+	renderer->setWireframeMode(true);
+	ctx->RSGetState(&rasterStates[1]);
+	renderer->setWireframeMode(false);
+	ctx->RSGetState(&rasterStates[0]);
+	renderer->setZBuffer(true);
+	ctx->OMGetDepthStencilState(&depthState, nullptr);
+
 	// == Initalise scene variables =======================================================================
-	
+	// the steps that only read files or work on the cpu run on the workers, the ones that
+	// create device objects run here as their inputs become ready. They aren't batched
+	// at the end: importing the tree is the longest step, and the other device objects
+	// are created here while it runs. Everything they use lives until execute() returns
+	using Affinity = StartupGraph::Affinity;
+	using TaskId = StartupGraph::TaskId;
+	startup.clear();
+
 	// -- Texture Manager ---------------------------------------------------------------------------------
 	tmanager.init(device, ctx);
 
 	// -- Shader ------------------------------------------------------------------------------------------
-	shader         = new DefaultShader(device, hwnd, true);
-	treeShader     = new TreeShader(device, hwnd);
-	textureShader  = new TextureShader(device, hwnd);
-	monolithShader = new MonolithShader(device, hwnd);
-	groundShader   = new GroundShader(device, hwnd);
-
-	// -- Render Target -----------------------------------------------------------------------------------
-	renderTarget = new RenderTexture(device, screenWidth, screenHeight, 0.1f, 100.f);
+	// maps the bytecode of every shader, the shaders are then created from memory
+	TaskId shaderFiles = startup.add("read shader files", Affinity::Any, []() {
+		shaderLibrary.prefetch("shaders", &jobSystem);
+		// only mapped, the variants are created when the quality is changed
+		shaderLibrary.openArchive("shaders/permutations.pak");
+	});
+
+	TaskId shaders = startup.add("create shaders", Affinity::Main, [this, device, hwnd]() {
+		shader         = new DefaultShader(device, hwnd, true);
+		treeShader     = new TreeShader(device, hwnd);
+		textureShader  = new TextureShader(device, hwnd);
+		monolithShader = new MonolithShader(device, hwnd);
+		groundShader   = new GroundShader(device, hwnd);
+	});
+	startup.dependsOn(shaders, shaderFiles);
+
+	// -- Frame graph -------------------------------------------------------------------------------------
+	targetAllocator.init(device);
+	frameGraph.setAllocator(&targetAllocator);
+	sceneDesc.width  = screenWidth;
+	sceneDesc.height = screenHeight;
 
 	// -- Sky ---------------------------------------------------------------------------------------------
-	sky.init(device, ctx, hwnd, &tmanager, &lights[DIR_LIGHT]);
+	TaskId skyTask = startup.add("sky", Affinity::Main, [this, device, ctx, hwnd]() {
+		sky.init(device, ctx, hwnd, &tmanager, &lights[DIR_LIGHT]);
+	});
+	startup.dependsOn(skyTask, shaderFiles);
 
 	// -- Bloom -------------------------------------------------------------------------------------------
-	bloom.init(device, ctx, screenWidth, screenHeight, hwnd);
+	TaskId bloomTask = startup.add("bloom", Affinity::Main, [this, device, ctx, screenWidth, screenHeight, hwnd]() {
+		bloom.init(device, ctx, screenWidth, screenHeight, hwnd);
+	});
+	startup.dependsOn(bloomTask, shaderFiles);
 	
+	// -- Wind --------------------------------------------------------------------------------------------
+	TaskId windTask = startup.add("wind", Affinity::Main, [this, device]() {
+		wind.init(device);
+	});
+	startup.dependsOn(windTask, shaderFiles);
+
 	// -- Ground ------------------------------------------------------------------------------------------
-	ground.init(renderer, hwnd, tmanager);
+	TaskId groundTask = startup.add("ground", Affinity::Main, [this, hwnd]() {
+		ground.init(renderer, hwnd, tmanager);
+		ground.setWindField(wind.getTexture(), wind.getWorldSize());
+	});
+	startup.dependsOn(groundTask, shaderFiles);
+	startup.dependsOn(groundTask, windTask);
+
+	// -- Occlusion culling -------------------------------------------------------------------------------
+	startup.add("occlusion culler", Affinity::Any, [this]() {
+		occlusion.init(OcclusionCuller::Desc());
+	});
 
 	// -- Models ------------------------------------------------------------------------------------------
 	MModelLoader mloader;
 	mloader.init(device, &tmanager);
 
-	treeModel = mloader.load("res/tree.gltf");
-	if (!treeModel) err("Couldn't load tree model");
-
-	monolith.moveFromMesh(new CubeMesh(device, ctx));
-	mainOrthoMesh.moveFromMesh(new OrthoMesh(device, ctx, screenWidth, screenHeight));
+	treeLodDesc.lodCount = MAX_TREE_LODS;
+	mloader.setLodChain(treeLodDesc);
+	// the impostor is baked from the cpu copy
+	mloader.setKeepCpuData(true);
+
+	bool treeImported = false;
+	TaskId treeImport = startup.add("import tree model", Affinity::Any, [&mloader, &treeImported]() {
+		treeImported = mloader.import("res/tree.gltf");
+	});
+
+	TaskId treeUpload = startup.add("upload tree model", Affinity::Main, [this, &mloader, &treeImported]() {
+		if (treeImported) treeModel = mloader.upload();
+		if (!treeModel) err("Couldn't load tree model");
+	});
+	startup.dependsOn(treeUpload, treeImport);
+
+	TaskId impostorTask = startup.add("bake impostor", Affinity::Main, [this, device, ctx, hwnd]() {
+		if (treeModel) treeImpostor.init(device, ctx, hwnd, *treeModel, tmanager);
+	});
+	startup.dependsOn(impostorTask, treeUpload);
+	startup.dependsOn(impostorTask, shaderFiles);
+
+	startup.add("meshes", Affinity::Main, [this, device, ctx, screenWidth, screenHeight]() {
+		monolith.moveFromMesh(new CubeMesh(device, ctx));
+		mainOrthoMesh.moveFromMesh(new OrthoMesh(device, ctx, screenWidth, screenHeight));
+	});
 
 	// -- Lights ------------------------------------------------------------------------------------------
-	lights[SPOT_LIGHT].setDiffuseColour(1.0f, 1.0f, 1.0f, 1.0f);
-	lights[SPOT_LIGHT].setAmbientColour(0.f, 0.f, 0.f, 1.f);
-	lights[SPOT_LIGHT].setDirection(0.f, -1.f, 0.f);
-	lights[SPOT_LIGHT].setPosition(50.f, 6.f, 50.f);
-	lights[SPOT_LIGHT].setSpecularColour(1.f, 1.f, 1.f, 1.f);
-	lights[SPOT_LIGHT].setSpecularPower(12.f);
-	lights[SPOT_LIGHT].setSpotCutoff(spotCutoff * isTorchOn);
-
-	lights[POINT_LIGHT].setDiffuseColour(monolithColor.x, monolithColor.y, monolithColor.z, 1.0f);
-	lights[POINT_LIGHT].setAmbientColour(0.f, 0.f, 0.f, 1.f);
-	lights[POINT_LIGHT].setDirection(0.f, 0.f, 1.f);
-	lights[POINT_LIGHT].setPosition(0.f, 6.f, 0.f);
-	lights[POINT_LIGHT].setSpecularColour(monolithColor.x, monolithColor.y, monolithColor.z, 1.f);
-	lights[POINT_LIGHT].setSpecularPower(128.f);
-	lights[POINT_LIGHT].setLightStrength(9);
-
-	ground.setWindOrigin(lights[POINT_LIGHT].getPosition());
+	TaskId lightsTask = startup.add("lights", Affinity::Main, [this]() {
+		lights[SPOT_LIGHT].setDiffuseColour(1.0f, 1.0f, 1.0f, 1.0f);
+		lights[SPOT_LIGHT].setAmbientColour(0.f, 0.f, 0.f, 1.f);
+		lights[SPOT_LIGHT].setDirection(0.f, -1.f, 0.f);
+		lights[SPOT_LIGHT].setPosition(50.f, 6.f, 50.f);
+		lights[SPOT_LIGHT].setSpecularColour(1.f, 1.f, 1.f, 1.f);
+		lights[SPOT_LIGHT].setSpecularPower(12.f);
+		lights[SPOT_LIGHT].setSpotCutoff(spotCutoff * isTorchOn);
+
+		lights[POINT_LIGHT].setDiffuseColour(monolithColor.x, monolithColor.y, monolithColor.z, 1.0f);
+		lights[POINT_LIGHT].setAmbientColour(0.f, 0.f, 0.f, 1.f);
+		lights[POINT_LIGHT].setDirection(0.f, 0.f, 1.f);
+		lights[POINT_LIGHT].setPosition(0.f, 6.f, 0.f);
+		lights[POINT_LIGHT].setSpecularColour(monolithColor.x, monolithColor.y, monolithColor.z, 1.f);
+		lights[POINT_LIGHT].setSpecularPower(128.f);
+		lights[POINT_LIGHT].setLightStrength(9);
+
+		ground.setWindOrigin(lights[POINT_LIGHT].getPosition());
+		wind.setSource(lights[POINT_LIGHT].getPosition());
+	});
+	// the sky sets up the directional light
+	startup.dependsOn(lightsTask, skyTask);
+	startup.dependsOn(lightsTask, groundTask);
 
 	// -- Shadows -----------------------------------------------------------------------------------------
-	int shadowMapSize = 2048;
-	spotShadowMap = new ShadowMap(device, shadowMapSize, shadowMapSize);
-	pointShadowMap.init(device, shadowMapSize * 2, shadowMapSize * 2);
+	startup.add("shadow maps", Affinity::Main, [this, device, ctx, hwnd]() {
+		int shadowMapSize = 2048;
+		spotShadowMap = new ShadowMap(device, shadowMapSize, shadowMapSize);
+		pointShadowMap.init(device, shadowMapSize * 2, shadowMapSize * 2);
+		spotStaticDepth.init(device, spotShadowMap->getDepthMapDSV());
+		sunShadowMap.init(device, shadowMapSize);
+		cascadeDesc.resolution = shadowMapSize;
+		cascadeDesc.count = CASCADED_SIZE;
+		DefaultShader::setSunShadow(&sunShadowMap);
+
+		// the moments are smaller than the depth, every texel is the average of a few
+		spotMoments.init(device, ctx, hwnd, spotShadowMap->getDepthMapDSV(), shadowMapSize / 2, SPOT_SHADOW_NEAR, SPOT_SHADOW_FAR);
+		pointMoments.init(device, ctx, hwnd, pointShadowMap.getDepthDSV(), shadowMapSize / 4, POINT_SHADOW_NEAR, POINT_SHADOW_FAR);
+		DefaultShader::setShadowMoments(&spotMoments, &pointMoments);
+	});
+
+	startup.add("local lights", Affinity::Main, [this, device]() {
+		clusteredLights.init(device);
+		DefaultShader::setClusteredLights(&clusteredLights);
+	});
 
 	// -- Trees -------------------------------------------------------------------------------------------
-	readTreeData();
+	startup.add("read tree data", Affinity::Any, [this]() {
+		readTreeData();
+		// they fly around the trees
+		generateFireflies();
+	});
+
+	startup.execute(&jobSystem);
+	info(
+		"Start-up took %.1fms, %.1fms if it ran in order:\n%s",
+		startup.getStats().totalMs, startup.getStats().taskMs, startup.dump().c_str()
+	);
+
+	// -- Frame pipeline ----------------------------------------------------------------------------------
+	pipeline.init(
+		[this](u32 slot) { prepareFrame(packets[slot]); },
+		[this](u32 slot) {
+			updateTreeLods(packets[slot]);
+			updateLightClusters(packets[slot]);
+		},
+		[this](u32 slot) {
+			renderPacket = &packets[slot];
+			render();
+		}
+	);
 }
 
 App1::~App1() {
+	// the update in flight uses the tree model and the occlusion culler
+	pipeline.sync();
+
 	DELETE_IF_NOT_NULL(shader);
 	DELETE_IF_NOT_NULL(treeShader);
 	DELETE_IF_NOT_NULL(textureShader);
 	DELETE_IF_NOT_NULL(monolithShader);
 	DELETE_IF_NOT_NULL(groundShader);
-	DELETE_IF_NOT_NULL(renderTarget);
+	// the transient targets have to go before the device
+	frameGraph.setAllocator(nullptr);
+	recorder.cleanup();
+	commandLists.cleanup();
+	RELEASE_IF_NOT_NULL(rasterStates[0]);
+	RELEASE_IF_NOT_NULL(rasterStates[1]);
+	RELEASE_IF_NOT_NULL(depthState);
 	DELETE_IF_NOT_NULL(treeModel);
 	DELETE_IF_NOT_NULL(spotShadowMap);
 
 	DefaultShader::cleanupStaticShaders();
+	// the shaders that are still alive keep their own reference
+	shaderLibrary.cleanup();
+	constantAllocator.cleanup();
+	stateCache.setBackend(nullptr);
+	jobSystem.shutdown();
 
 	// Run base application deconstructor
 	BaseApplication::~BaseApplication();
@@ -104,38 +261,149 @@ bool App1::frame() {
 		return false;
 	
 	timePassed += timer->getTime();
+	stateCache.beginFrame();
+	constantAllocator.beginFrame();
+	drawQueue.beginFrame();
+	spotQueue.beginFrame();
+	pointQueue.beginFrame();
+
+	// the capture starts before the updates, as they upload the wind and the terrain
+	bool capturing = captureNextFrame;
+	if (capturing) {
+		frameCapture.clear();
+		frameCapture.setNext(&d3dBackend);
+		stateCache.setBackend(&frameCapture);
+		captureNextFrame = false;
+	}
 
-	sky.update(timer->getTime());
-	ground.update(timer->getTime());
-	updateTorchLight();
-	
-	// Render the graphics.
-	if (!render())
-		return false;
+	// updates, culls and renders the graphics
+	pipeline.frame();
+
+	if (capturing) {
+		stateCache.setBackend(&d3dBackend);
+		hasCapture = true;
+	}
 
 	return true;
 }
 
 bool App1::render() {
-	depthPass();
-	renderPass();
-	bloomPass();
-	finalPass();
+	using namespace std::chrono;
+	auto start = high_resolution_clock::now();
+	DeviceContext *ctx = renderer->getDeviceContext();
+
+	frameGraph.reset();
+
+	// the shaders read the cascades from the map, without shadows there are none
+	FramePacket &packet = *renderPacket;
+	sunShadowMap.setCascades(packet.useSunShadows ? packet.sunCascades : ShadowCascades());
+	// the passes read the lights at the same time, they are only changed here
+	float3 pointPos = lights[POINT_LIGHT].getPosition();
+	lights[POINT_LIGHT].setPosition(pointPos.x, monolithScale.y, pointPos.z);
+	lights[SPOT_LIGHT].setPosition(packet.spotLightPos.x, packet.spotLightPos.y, packet.spotLightPos.z);
+	lights[SPOT_LIGHT].setDirection(packet.spotLightDir.x, packet.spotLightDir.y, packet.spotLightDir.z);
+	lights[SPOT_LIGHT].generateViewMatrix();
+	lights[SPOT_LIGHT].generateProjectionMatrix(SPOT_SHADOW_NEAR, SPOT_SHADOW_FAR);
+	// same for the local lights, they are uploaded once for every pass
+	clusteredLights.upload(
+		XMLoadFloat4x4(&packet.viewProj),
+		packet.useClusteredLights ? &packet.lightClusters : nullptr, packet.localLights
+	);
+
+	FrameGraphResource sunShadow   = frameGraph.importTexture("sun shadow", &sunShadowMap);
+	FrameGraphResource spotShadow  = frameGraph.importTexture("spot shadow", spotShadowMap);
+	FrameGraphResource pointShadow = frameGraph.importTexture("point shadow", &pointShadowMap);
+	FrameGraphResource backBuffer  = frameGraph.importTexture("back buffer", nullptr);
+	FrameGraphResource sceneColor  = frameGraph.createTexture("scene", sceneDesc);
+	frameGraph.setOutput(backBuffer);
+
+	u32 pass = 0;
+	if (packet.useSunShadows) {
+		pass = frameGraph.addPass("sun shadow", [this]() { sunShadowPass(); });
+		frameGraph.write(pass, sunShadow);
+	}
+
+	pass = frameGraph.addPass("spot shadow", [this]() { runPass(RecordedPass::Spot, nullptr); });
+	frameGraph.write(pass, spotShadow);
+
+	pass = frameGraph.addPass("point shadow", [this]() { runPass(RecordedPass::Point, nullptr); });
+	frameGraph.write(pass, pointShadow);
+
+	// the lights that filter with EVSM read the moments instead of the depth
+	if (spotMoments.isEnabled()) {
+		FrameGraphResource moments = frameGraph.importTexture("spot moments", &spotMoments);
+		pass = frameGraph.addPass("spot moments", [this, ctx]() { spotMoments.update(ctx); });
+		frameGraph.read(pass, spotShadow);
+		frameGraph.write(pass, moments);
+		spotShadow = moments;
+	}
+
+	if (pointMoments.isEnabled()) {
+		FrameGraphResource moments = frameGraph.importTexture("point moments", &pointMoments);
+		// like the depth, they are kept while the point shadow is cached
+		if (packet.drawPointShadow) {
+			pass = frameGraph.addPass("point moments", [this, ctx]() { pointMoments.update(ctx); });
+			frameGraph.read(pass, pointShadow);
+			frameGraph.write(pass, moments);
+		}
+		pointShadow = moments;
+	}
+
+	pass = frameGraph.addPass("scene", [this, sceneColor]() {
+		renderPass(frameGraph.getTexture<RenderTexture>(sceneColor));
+	});
+	frameGraph.read(pass, sunShadow);
+	frameGraph.read(pass, spotShadow);
+	frameGraph.read(pass, pointShadow);
+	frameGraph.write(pass, sceneColor);
+
+	// the bloom passes are always added, when they're not used the graph culls them
+	mat4 world = renderer->getWorldMatrix();
+	mat4 orthoView = XMLoadFloat4x4(&packet.orthoView);
+	mat4 orthoProj = renderer->getOrthoMatrix();
+	FrameGraphResource bloomResult = bloom.addPasses(frameGraph, ctx, world, orthoView, orthoProj, sceneColor);
+	FrameGraphResource finalColor = useBloom ? bloomResult : sceneColor;
+
+	pass = frameGraph.addPass("final", [this, finalColor]() {
+		finalPass(frameGraph.getTexture<RenderTexture>(finalColor)->getShaderResourceView());
+	});
+	frameGraph.read(pass, finalColor);
+	frameGraph.write(pass, backBuffer);
+
+	frameGraph.compile();
+
+	// now that the targets exist the spot, point and camera passes are recorded on the
+	// jobs, the graph executes their lists in their place. A capture has to see every call
+	if (recordPasses && stateCache.getBackend() == &d3dBackend) {
+		const char *names[] = { "spot shadow", "point shadow", "scene" };
+		RenderTexture *target = frameGraph.getTexture<RenderTexture>(sceneColor);
+		for (u32 i = 0; i < (u32)RecordedPass::Count; ++i) {
+			passLists[i] = recorder.add(names[i], [this, i, target]() { drawPass((RecordedPass)i, target); });
+		}
+		recorder.record();
+	}
+
+	frameGraph.execute(stateCache.getBackend());
+	recorder.reset();
+
+	submitMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
 
 	return true;
 }
 
 void App1::gui() {
 	// Force turn off unnecessary shader stages.
-	renderer->getDeviceContext()->GSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->HSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->DSSetShader(NULL, NULL, 0);
+	stateCache.setGeometryShader(NULL);
+	stateCache.setHullShader(NULL);
+	stateCache.setDomainShader(NULL);
 
 	static bool showTreesOpts    = false;
 	static bool showMonolithOpts = false;
 	static bool showSkyOpts      = false;
 	static bool showGroundOpts   = false;
 	static bool showLightsOpts   = false;
+	static bool showWindOpts     = false;
+	static bool showRendererOpts = false;
 	static bool isFirst          = false;
 
 	// when debugging for some reason static bools where true at startup no matter what
@@ -146,6 +414,8 @@ void App1::gui() {
 		showSkyOpts      = false;
 		showGroundOpts   = false;
 		showLightsOpts   = false;
+		showWindOpts     = false;
+		showRendererOpts = false;
 		isFirst          = false;
 	}
 
@@ -158,13 +428,52 @@ void App1::gui() {
 	OptionButton("Show sky options", showSkyOpts);
 	OptionButton("Show ground options", showGroundOpts);
 	OptionButton("Show lights options", showLightsOpts);
+	OptionButton("Show wind options", showWindOpts);
+	OptionButton("Show renderer options", showRendererOpts);
 	
 	if (showTreesOpts) {
 		ImGui::Begin("Trees options", &showTreesOpts);
-		ImGui::SliderFloat("Wave amplitude", &treeAmplitude, 0.001f, 0.07f);
-		ImGui::SliderFloat("Wind speed", &treeSpeed, 0.0f, 10.f);
+		// the cached shadows are drawn with these
+		bool treesChanged = false;
+		treesChanged |= ImGui::SliderFloat("Wave amplitude", &treeAmplitude, 0.f, 0.02f);
+		treesChanged |= ImGui::Checkbox("Use lods", &useTreeLods);
+		treesChanged |= ImGui::SliderFloat("Lod 0 screen size", &treeLodDesc.firstScreenSize, 0.05f, 1.f);
+		if (treesChanged) {
+			treeVersion++;
+		}
+		for (u32 i = 0; i < MAX_TREE_LODS; ++i) {
+			ImGui::Text("Lod %u: %zu trees (%zu visible)", i, renderPacket->treeLods[i].size(), renderPacket->visibleTreeLods[i].size());
+		}
+		ImGui::Separator();
+		treeImpostor.gui();
+		ImGui::Separator();
+		ImGui::Checkbox("Occlusion culling", &useOcclusionCulling);
+		if (useOcclusionCulling) {
+			ImGui::Text("Rasterizer:");
+			for (u32 i = 0; i <= (u32)OcclusionCuller::getBestIsa(); ++i) {
+				OcclusionCuller::Isa isa = (OcclusionCuller::Isa)i;
+				ImGui::SameLine();
+				if (ImGui::RadioButton(OcclusionCuller::getIsaName(isa), occlusion.getIsa() == isa)) {
+					// the update of the next frame could be using the culler
+					pipeline.sync();
+					occlusion.setIsa(isa);
+				}
+			}
+			ImGui::SliderFloat("Trunk occluder distance", &trunkOccluderDistance, 0.f, 100.f);
+			ImGui::SliderFloat("Terrain occluder distance", &terrainOccluderDistance, 0.f, 1024.f);
+
+			const OcclusionCuller::Stats &stats = renderPacket->occlusionStats;
+			ImGui::Text(
+				"Occluders: %u triangles, culled %u/%u trees\nRaster: %.3fms Test: %.3fms",
+				stats.occluderTriangles, stats.culled, stats.tested, stats.rasterMs, stats.testMs
+			);
+		}
+		ImGui::Separator();
 		if (ImGui::Button("Reload tree data file")) {
+			// the update reads the trees and the fireflies
+			pipeline.sync();
 			readTreeData();
+			generateFireflies();
 		}
 		ImGui::End();
 	}
@@ -189,6 +498,14 @@ void App1::gui() {
 		ground.gui(showGroundOpts);
 	}
 
+	if (showWindOpts) {
+		wind.gui(showWindOpts);
+	}
+
+	if (showRendererOpts) {
+		rendererGui(showRendererOpts);
+	}
+
 	if (showLightsOpts) {
 		ImGui::Begin("Lights options", &showLightsOpts);
 
@@ -220,6 +537,31 @@ void App1::gui() {
 			lights[DIR_LIGHT].setSpecularPower(dirSpePow);
 		}
 
+		ImGui::Checkbox("Cascaded shadows", &useSunShadows);
+		if (useSunShadows) {
+			int cascadeCount = (int)cascadeDesc.count;
+			if (ImGui::SliderInt("Cascades", &cascadeCount, 1, CASCADED_SIZE)) {
+				cascadeDesc.count = (u32)cascadeCount;
+			}
+			ImGui::SliderFloat("Split blend (uniform - log)", &cascadeDesc.lambda, 0.f, 1.f);
+			ImGui::SliderFloat("Shadow distance", &cascadeDesc.maxDistance, 10.f, SCREEN_DEPTH);
+			ImGui::SliderFloat("Caster distance", &cascadeDesc.casterDistance, 0.f, 200.f);
+			bool tightFit = cascadeDesc.fit == ShadowCascades::Fit::Tight;
+			if (ImGui::Checkbox("Tight fit (shimmers when turning)", &tightFit)) {
+				cascadeDesc.fit = tightFit ? ShadowCascades::Fit::Tight : ShadowCascades::Fit::Sphere;
+			}
+
+			const ShadowCascades &cascades = renderPacket->sunCascades;
+			const ShadowCascades::Stats &cascadeStats = cascades.getStats();
+			for (u32 i = 0; i < cascades.getCount(); ++i) {
+				const ShadowCascades::Cascade &cascade = cascades.getCascade(i);
+				ImGui::Text(
+					"Cascade %u: %.1f-%.1fm, %.1fcm texels, %u/%u casters",
+					i, cascade.nearZ, cascade.farZ, cascade.texelSize * 100.f, cascadeStats.casters[i], cascadeStats.tested
+				);
+			}
+		}
+
 		ImGui::PopID();
 
 		// -- Spot light -----------------------------------------------------------------------
@@ -256,6 +598,9 @@ void App1::gui() {
 			lights[SPOT_LIGHT].setSpotCutoff(spotCutoff);
 		}
 
+		// the spot shadow is drawn every frame, so are its moments
+		shadowFilterGui(spotMoments);
+
 		ImGui::PopID();
 
 		// -- Point light ----------------------------------------------------------------------
@@ -297,6 +642,63 @@ void App1::gui() {
 			lights[POINT_LIGHT].setPosition(pos.x, pos.y, pos.z);
 
 			ground.setWindOrigin(pos);
+			wind.setSource(pos);
+		}
+
+		ImGui::Checkbox("Cull cube faces", &useFaceCulling);
+		if (useFaceCulling) {
+			u32 allFaces = faceStats.tested * CubeFaceCuller::FACES;
+			ImGui::Text(
+				"%u trees: %u in one face, %u culled\n%u of %u faces drawn, %.1f%% less geometry shader output",
+				faceStats.tested, faceStats.singleFace, faceStats.culled, faceStats.faces, allFaces,
+				allFaces ? 100.0 * (allFaces - faceStats.faces) / allFaces : 0.0
+			);
+		}
+
+		if (shadowFilterGui(pointMoments)) {
+			pointCache.invalidate();
+		}
+
+		ImGui::PopID();
+
+		// -- Shadow cache ---------------------------------------------------------------------
+		ImGui::PushID("Cache");
+		ImGui::NewLine();
+		ImGui::Text("Shadow cache");
+		ImGui::Separator();
+		if (ImGui::Checkbox("Cache static casters", &useShadowCache)) {
+			spotCache.invalidate();
+			pointCache.invalidate();
+		}
+		if (useShadowCache) {
+			const ShadowCache::Stats &spotStats = spotCache.getStats();
+			const ShadowCache::Stats &pointStats = pointCache.getStats();
+			ImGui::Text(
+				"Spot: drawn %u/%u frames (%s)\nPoint: drawn %u/%u frames (%s)",
+				spotStats.rebuilds, spotStats.frames, ShadowCache::getReasonName(spotCache.getReason()),
+				pointStats.rebuilds, pointStats.frames, ShadowCache::getReasonName(pointCache.getReason())
+			);
+		}
+
+		ImGui::PopID();
+
+		// -- Local lights ---------------------------------------------------------------------
+		ImGui::PushID("Local");
+		ImGui::NewLine();
+		ImGui::Text("Local lights");
+		ImGui::Separator();
+		ImGui::Checkbox("Fireflies (clustered)", &useClusteredLights);
+		if (useClusteredLights) {
+			ImGui::SliderInt("Count", &fireflyCount, 0, (int)LightClusters::MAX_LIGHTS);
+			ImGui::SliderFloat("Range", &fireflyRange, 0.5f, 10.f);
+			ImGui::SliderFloat("Brightness", &fireflyBrightness, 0.f, 4.f);
+
+			const LightClusters::Stats &clusterStats = renderPacket->lightClusters.getStats();
+			ImGui::Text(
+				"%u/%u lights visible, binned in %.3fms\n%u indices in %u/%u clusters, at most %u, %u dropped",
+				clusterStats.visible, clusterStats.lights, clusterStats.binMs, clusterStats.indices,
+				clusterStats.usedClusters, LightClusters::CLUSTER_COUNT, clusterStats.maxPerCluster, clusterStats.dropped
+			);
 		}
 
 		ImGui::PopID();
@@ -309,7 +711,61 @@ void App1::gui() {
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 }
 
-void App1::updateTorchLight() {
+void App1::prepareFrame(FramePacket &packet) {
+	sky.update(timer->getTime());
+	wind.update(renderer->getDeviceContext(), timer->getTime());
+	ground.update(renderer->getDeviceContext(), timer->getTime(), camera->getPosition());
+	camera->update();
+	updateTorchLight(packet);
+
+	mat4 proj = renderer->getProjectionMatrix();
+	packet.cameraPos = camera->getPosition();
+	XMStoreFloat4x4(&packet.view, camera->getViewMatrix());
+	XMStoreFloat4x4(&packet.projection, proj);
+	XMStoreFloat4x4(&packet.orthoView, camera->getOrthoViewMatrix());
+	XMStoreFloat4x4(&packet.viewProj, camera->getViewMatrix() * proj);
+	XMStoreFloat4x4(&packet.monolithMatrix, getMonolithMatrix());
+	packet.projScale = XMVectorGetY(proj.r[1]);
+
+	packet.useTreeLods = useTreeLods;
+	packet.useOcclusionCulling = useOcclusionCulling;
+	packet.treeLodDesc = treeLodDesc;
+	packet.trunkOccluderDistance = trunkOccluderDistance;
+	packet.terrainOccluderDistance = terrainOccluderDistance;
+	packet.useTerrainOccluders = ground.isUsingTerrain();
+	packet.impostor = treeImpostor.getClassifier();
+	packet.useFaceCulling = useFaceCulling;
+	packet.pointLightPos = lights[POINT_LIGHT].getPosition();
+
+	// the point shadow only has the trees (the ground is never drawn in it), the update
+	// only fills its lists in the frames that draw it
+	packet.useShadowCache = useShadowCache;
+	packet.drawPointShadow = true;
+	if (useShadowCache) {
+		vec3f pos = packet.pointLightPos;
+		updateLightVersion(pointLightVersion, pos, vec3f());
+		pointCache.setLight(pointLightVersion.version, pos - POINT_SHADOW_FAR, pos + POINT_SHADOW_FAR);
+		if (treeModel) {
+			pointCache.setCaster(TREE_CASTER, treeVersion, treesMin + vec3f(treeModel->boundsMin), treesMax + vec3f(treeModel->boundsMax));
+		}
+		packet.drawPointShadow = pointCache.update();
+	}
+
+	// the cascades follow the camera of this frame, the update culls the casters with them
+	packet.cameraView = ShadowCascades::makeView(&packet.view.m[0][0], &packet.projection.m[0][0]);
+	packet.useSunShadows = useSunShadows;
+	if (useSunShadows) {
+		packet.sunCascades.update(cascadeDesc, packet.cameraView, lights[DIR_LIGHT].getDirection());
+	}
+
+	packet.useClusteredLights = useClusteredLights;
+	packet.fireflyCount = (u32)max(fireflyCount, 0);
+	packet.fireflyRange = fireflyRange;
+	packet.fireflyBrightness = fireflyBrightness;
+	packet.time = timePassed;
+}
+
+void App1::updateTorchLight(FramePacket &packet) {
 	bool isPressed = input->isKeyDown('F');
 	if (isPressed && !wasPressed) {
 		lights[SPOT_LIGHT].setSpotCutoff(spotCutoff * isTorchOn);
@@ -324,89 +780,427 @@ void App1::updateTorchLight() {
 	vec3f pos = camera->getPosition();
 	pos += dir * 2;
 	pos.y -= 1.5f;
-	lights[SPOT_LIGHT].setPosition(pos.x, pos.y, pos.z);
-	lights[SPOT_LIGHT].setDirection(dir.x, dir.y, dir.z);
+	// render() moves the light, the frame being drawn still uses the torch of its own camera
+	packet.spotLightPos = pos;
+	packet.spotLightDir = dir;
+}
+
+void App1::updateTreeLods(FramePacket &packet) {
+	for (u32 i = 0; i < MAX_TREE_LODS; ++i) {
+		packet.treeLods[i].clear();
+		packet.visibleTreeLods[i].clear();
+		packet.treeLodDistances[i] = std::numeric_limits<f32>::max();
+	}
+	packet.nearTrees.clear();
+	packet.farTrees.clear();
+	packet.impostorInstances.clear();
+	for (u32 c = 0; c < CASCADED_SIZE; ++c) {
+		for (u32 i = 0; i < MAX_TREE_LODS; ++i) {
+			packet.cascadeTreeLods[c][i].clear();
+		}
+		packet.cascadeMonolith[c] = false;
+	}
+	for (u32 mask = 0; mask < CubeFaceCuller::MASKS; ++mask) {
+		for (u32 i = 0; i < MAX_TREE_LODS; ++i) {
+			packet.faceTreeLods[mask][i].clear();
+		}
+	}
+	packet.faceCuller.begin(packet.pointLightPos, POINT_SHADOW_NEAR, POINT_SHADOW_FAR);
+
+	if (packet.useSunShadows) {
+		vec3f corners[8];
+		getCubeCorners(packet.monolithMatrix, corners);
+		vec3f bmin = corners[0], bmax = corners[0];
+		for (const vec3f &corner : corners) {
+			bmin = { min(bmin.x, corner.x), min(bmin.y, corner.y), min(bmin.z, corner.z) };
+			bmax = { max(bmax.x, corner.x), max(bmax.y, corner.y), max(bmax.z, corner.z) };
+		}
+
+		u32 mask = packet.sunCascades.cull(bmin, bmax);
+		for (u32 c = 0; c < CASCADED_SIZE; ++c) {
+			packet.cascadeMonolith[c] = (mask & (1 << c)) != 0;
+		}
+	}
+
+	if (!treeModel) return;
+
+	float3 cameraPos = packet.cameraPos;
+	vec3f camPos = cameraPos;
+
+	if (packet.useOcclusionCulling) {
+		addOccluders(packet);
+	}
+
+	u32 lodCount = 1;
+	if (packet.useTreeLods) {
+		for (MMesh &mesh : treeModel->meshes) {
+			lodCount = max(lodCount, (u32)mesh.lods.size());
+		}
+		lodCount = min(lodCount, (u32)MAX_TREE_LODS);
+	}
+
+	// the lods are chosen from the camera for every pass, this way the
+	// shadows match the trees that are actually drawn
+	f32 projScale = packet.projScale;
+	// a bit of room for the wind
+	const vec3f boundsMin = vec3f(treeModel->boundsMin) - 0.5f;
+	const vec3f boundsMax = vec3f(treeModel->boundsMax) + 0.5f;
+
+	for (const TreeInstanceType &tree : treeData) {
+		vec3f pos = tree.position;
+
+		bool visible = true;
+		if (packet.useOcclusionCulling) {
+			visible = occlusion.isVisible(pos + boundsMin, pos + boundsMax);
+		}
+
+		f32 fade = 1.f;
+		ImpostorUsage usage = packet.impostor.classify(cameraPos, tree.position, fade);
+		// the lowest lod is what the far trees use in the shadows
+		u32 lod = MAX_TREE_LODS - 1;
+
+		// the far trees are only drawn as impostors
+		if (usage == ImpostorUsage::Impostor) {
+			packet.farTrees.push_back(tree);
+		}
+		else {
+			packet.nearTrees.push_back(tree);
+
+			f32 dist = (pos - camPos).mag();
+			lod = 0;
+			if (packet.useTreeLods) {
+				f32 screenSize = dist > 0.f ? treeModel->boundingRadius * projScale / dist : 1.f;
+				lod = selectLod(screenSize, packet.treeLodDesc, lodCount);
+			}
+
+			packet.treeLods[lod].push_back(tree);
+			if (visible) packet.visibleTreeLods[lod].push_back(tree);
+			packet.treeLodDistances[lod] = min(packet.treeLodDistances[lod], dist);
+		}
+
+		if (usage != ImpostorUsage::Mesh && visible) {
+			packet.impostorInstances.push_back(packet.impostor.makeInstance(cameraPos, tree.position, fade));
+		}
+
+		// the occluded trees can still cast shadows on what is visible
+		if (packet.useSunShadows) {
+			u32 mask = packet.sunCascades.cull(pos + boundsMin, pos + boundsMax);
+			for (u32 c = 0; c < CASCADED_SIZE; ++c) {
+				if (mask & (1 << c)) packet.cascadeTreeLods[c][lod].push_back(tree);
+			}
+		}
+
+		// the monolith is inside the light and doesn't cast shadows, only the trees are culled
+		if (packet.drawPointShadow && (packet.useFaceCulling || packet.useShadowCache)) {
+			u32 mask = CubeFaceCuller::ALL_FACES;
+			if (packet.useFaceCulling) {
+				mask = packet.faceCuller.cull(pos + boundsMin, pos + boundsMax);
+			}
+
+			u32 faceLod = lod;
+			if (packet.useShadowCache) {
+				faceLod = 0;
+				if (packet.useTreeLods) {
+					// the faces are 90 degrees wide, so the projection scale is 1
+					f32 dist = (pos - vec3f(packet.pointLightPos)).mag();
+					f32 screenSize = dist > 0.f ? treeModel->boundingRadius / dist : 1.f;
+					faceLod = selectLod(screenSize, packet.treeLodDesc, lodCount);
+				}
+			}
+
+			if (mask) packet.faceTreeLods[mask][faceLod].push_back(tree);
+		}
+	}
+
+	packet.occlusionStats = occlusion.getStats();
+}
+
+void App1::updateLightClusters(FramePacket &packet) {
+	packet.localLights.clear();
+	if (!packet.useClusteredLights) return;
+
+	u32 count = min(packet.fireflyCount, (u32)fireflies.size());
+	packet.localLights.resize(count);
+	for (u32 i = 0; i < count; ++i) {
+		const Firefly &firefly = fireflies[i];
+		LightClusters::Light &light = packet.localLights[i];
+		light.color = firefly.color * packet.fireflyBrightness;
+
+		if (i % LANTERN_STEP == 0) {
+			light.position = firefly.position + vec3f(0.f, 3.f, 0.f);
+			light.range = packet.fireflyRange * 3.f;
+			light.type = LightClusters::Type::Spot;
+			light.direction = { 0.f, -1.f, 0.f };
+			light.cosAngle = 0.6f;
+			continue;
+		}
+
+		// slow loops around where they were placed, blinking
+		f32 t = packet.time * 0.5f + firefly.phase;
+		light.position = firefly.position + vec3f(sinf(t) * 1.5f, sinf(t * 1.7f) * 0.5f, cosf(t * 0.8f) * 1.5f);
+		light.range = packet.fireflyRange;
+		light.color *= 0.6f + 0.4f * sinf(t * 5.f);
+	}
+
+	packet.lightClusters.build(packet.cameraView, packet.localLights.data(), count, SCREEN_DEPTH * 0.5f);
+}
+
+void App1::addOccluders(FramePacket &packet) {
+	occlusion.beginFrame(&packet.viewProj.m[0][0]);
+
+	// -- Monolith --------------------------------------------------------------------------
+	// the cube mesh goes from -1 to 1
+	vec3f corners[8];
+	getCubeCorners(packet.monolithMatrix, corners);
+	occlusion.addBox(corners);
+
+	// -- Tree trunks -----------------------------------------------------------------------
+	vec3f camPos = packet.cameraPos;
+	for (const TreeInstanceType &tree : treeData) {
+		vec3f pos = tree.position;
+		if ((pos - camPos).mag2() > pow2(packet.trunkOccluderDistance)) continue;
+
+		occlusion.addBox(
+			pos + vec3f(-trunkHalfWidth, 0.f, -trunkHalfWidth),
+			pos + vec3f(trunkHalfWidth, trunkHeight, trunkHalfWidth)
+		);
+	}
+
+	// -- Terrain ---------------------------------------------------------------------------
+	if (packet.useTerrainOccluders) {
+		ground.addOccluders(occlusion, packet.cameraPos, packet.terrainOccluderDistance);
+	}
+}
+
+mat4 App1::getMonolithMatrix() {
+	float3 pos = lights[POINT_LIGHT].getPosition();
+	pos.y = monolithScale.y;
+
+	mat4 monolightTran = XMMatrixTranslation(pos.x, pos.y, pos.z);
+	mat4 monolightScale = XMMatrixScaling(monolithScale.x, monolithScale.y, monolithScale.z);
+	mat4 monoRot = XMMatrixRotationY(degToRad(monolithAngle));
+
+	return monolightScale * monoRot * monolightTran;
 }
 
-void App1::renderScene(const mat4 &world, const mat4 &view, const mat4 &proj) {
-	float3 cameraPos = camera->getPosition();
+void App1::renderScene(DrawQueue &queue, const mat4 &world, const mat4 &view, const mat4 &proj, i32 cascade, CasterLayer layer) {
+	float3 cameraPos = renderPacket->cameraPos;
+	vec3f camPos = cameraPos;
+	// the immediate context or a command list's
+	DeviceContext *ctx = stateCache.getBackend()->getContext();
+	Device *device = renderer->getDevice();
+
+	// the depth passes have no pixel shader, keep the state together. The camera
+	// pass goes front to back so early-z can skip the hidden pixels
+	bool isDepth = DefaultShader::isDepthShader();
+	bool isOmni = DefaultShader::isOmniShader();
+	bool drawStatic = layer != CasterLayer::Dynamic;
+	bool drawDynamic = layer != CasterLayer::Static;
+	auto makeKey = [&queue, isDepth](u32 pass, const void *shader, const void *texture, f32 depth) {
+		u32 shaderId = queue.getShaderId(shader);
+		u32 textureId = queue.getTextureId(texture);
+		return isDepth ?
+			DrawKey::make(pass, shaderId, textureId, depth) :
+			DrawKey::makeFrontToBack(pass, depth, shaderId, textureId);
+	};
+
+	// the ground covers the whole screen and is mostly behind everything else
+	constexpr f32 farthest = std::numeric_limits<f32>::max();
 	
 	// -- Render trees ----------------------------------------------------------------------
-	for (MMesh &mesh : treeModel->meshes) {
+	// one draw for every lod that has any instance, the occluded trees still cast shadows
+	FramePacket &packet = *renderPacket;
+	std::vector<TreeInstanceType> *lods = isDepth || !packet.useOcclusionCulling ? packet.treeLods : packet.visibleTreeLods;
+	if (cascade >= 0) lods = packet.cascadeTreeLods[cascade];
+
+	auto drawTrees = [&](MMesh *mesh, TextureType *texture, std::vector<TreeInstanceType> *instances, u32 lod) {
 		treeShader->setShaderParameters(
-			renderer->getDeviceContext(),
+			ctx,
 			world, view, proj,
-			tmanager.getTexture(mesh.textureId),
-			mesh.diffuseColor,
+			texture,
+			mesh->diffuseColor,
 			cameraPos,
 			timePassed,
 			lights,
 			spotShadowMap, pointShadowMap,
-			lights[POINT_LIGHT].getPosition(),
-			treeAmplitude, treeSpeed
+			wind.getTexture(), wind.getWorldSize(),
+			treeAmplitude
 		);
+
 		treeShader->renderInstance(
-			renderer->getDevice(),
-			renderer->getDeviceContext(),
-			mesh,
-			treeData.data(),
-			(uint)treeData.size()
+			device, ctx,
+			*mesh,
+			instances->data(),
+			(uint)instances->size(),
+			lod
 		);
+	};
+
+	if (drawStatic) {
+		for (MMesh &mesh : treeModel->meshes) {
+			MMesh *meshPtr = &mesh;
+			TextureType *texture = tmanager.getTexture(mesh.textureId);
+
+			// the point shadow draws the trees grouped by the faces they are in, only those are rendered
+			if (isOmni && (packet.useFaceCulling || packet.useShadowCache)) {
+				for (u32 mask = 1; mask < CubeFaceCuller::MASKS; ++mask) {
+					for (u32 lod = 0; lod < MAX_TREE_LODS; ++lod) {
+						if (packet.faceTreeLods[mask][lod].empty()) continue;
+
+						std::vector<TreeInstanceType> *instances = &packet.faceTreeLods[mask][lod];
+						queue.submit(
+							makeKey(0, treeShader, texture, packet.treeLodDistances[lod]),
+							[this, &drawTrees, meshPtr, texture, instances, lod, mask]() {
+								pointShadowMap.setFaceMask(mask);
+								drawTrees(meshPtr, texture, instances, lod);
+							}
+						);
+					}
+				}
+				continue;
+			}
+
+			for (u32 lod = 0; lod < MAX_TREE_LODS; ++lod) {
+				if (lods[lod].empty()) continue;
+
+				std::vector<TreeInstanceType> *instances = &lods[lod];
+				queue.submit(
+					makeKey(0, treeShader, texture, packet.treeLodDistances[lod]),
+					[&drawTrees, meshPtr, texture, instances, lod]() { drawTrees(meshPtr, texture, instances, lod); }
+				);
+			}
+
+			// impostors don't cast shadows, use the lowest lod in the depth passes instead.
+			// The cascades already have them in their lods
+			if (isDepth && cascade < 0 && !packet.farTrees.empty()) {
+				queue.submit(
+					makeKey(0, treeShader, texture, treeImpostor.getStartDistance()),
+					[&packet, &drawTrees, meshPtr, texture]() { drawTrees(meshPtr, texture, &packet.farTrees, MAX_TREE_LODS - 1); }
+				);
+			}
+		}
+	}
+
+	if (!isDepth) {
+		queue.submit(makeKey(0, treeImpostor.getShader(), nullptr, treeImpostor.getStartDistance()), [&]() {
+			treeImpostor.render(
+				device, ctx,
+				world, view, proj,
+				cameraPos, timePassed,
+				lights,
+				spotShadowMap, pointShadowMap,
+				packet.impostorInstances
+			);
+		});
 	}
 
 	// -- Render monolith -------------------------------------------------------------------
-	if (!monolithShader->isOmniShader()) {
-		float3 pos = lights[POINT_LIGHT].getPosition();
-		pos.y = monolithScale.y;
-		lights[POINT_LIGHT].setPosition(pos.x, pos.y, pos.z);
-
-		mat4 monolightTran = XMMatrixTranslation(pos.x, pos.y, pos.z);
-		mat4 monolightScale = XMMatrixScaling(monolithScale.x, monolithScale.y, monolithScale.z);
-		mat4 monoRot = XMMatrixRotationY(degToRad(monolithAngle));
-
-		monolithShader->setShaderParameters(
-			renderer->getDeviceContext(),
-			monolightScale * (monoRot * monolightTran * world), view, proj,
-			monolithColor
-		);
-		monolithShader->render(renderer->getDeviceContext(), monolith);
+	if (drawDynamic && !DefaultShader::isOmniShader() && (cascade < 0 || packet.cascadeMonolith[cascade])) {
+		// render() put the light on top of the monolith
+		vec3f pos = lights[POINT_LIGHT].getPosition();
+
+		queue.submit(makeKey(0, monolithShader, nullptr, (pos - camPos).mag()), [&]() {
+			monolithShader->setShaderParameters(
+				ctx,
+				getMonolithMatrix() * world, view, proj,
+				monolithColor
+			);
+			monolithShader->render(ctx, monolith);
+		});
 	}
 	
 	// -- Render plane ----------------------------------------------------------------------
-	ground.renderGround(
-		renderer->getDeviceContext(),
-		view, proj, cameraPos,
-		lights, 
-		spotShadowMap, pointShadowMap
-	);
+	if (drawStatic) {
+		queue.submit(makeKey(0, ground.getGroundShader(), nullptr, farthest), [&]() {
+			ground.renderGround(
+				ctx,
+				view, proj, cameraPos,
+				lights, 
+				spotShadowMap, pointShadowMap
+			);
+		});
+	}
+
+	// -- Render grass ----------------------------------------------------------------------
+	// after the ground, as before the queue
+	if (!isDepth) {
+		queue.submit(makeKey(1, ground.getGrassShader(), nullptr, 0.f), [&]() {
+			ground.renderGrass(
+				ctx,
+				view, proj,
+				cameraPos,
+				lights,
+				spotShadowMap, pointShadowMap
+			);
+		});
+	}
+
+	// the packets reference the arguments, they have to run before returning
+	queue.flush();
 }
 
-void App1::depthPass() {
-	// Turn on depth shaders
-	treeShader->useDepthShader(true);
-	monolithShader->useDepthShader(true);
-	groundShader->useDepthShader(true);
-	ground.getGrassShader()->useDepthShader(true);
-	ground.getGroundShader()->useDepthShader(true);
-	shader->useDepthShader(true);
+void App1::sunShadowPass() {
+	DefaultShader::useDepthShader(true);
 
 	mat4 world = renderer->getWorldMatrix();
-	mat4 view, proj;
 
-	//-- Spot light --------------------------------------------------------------
-	lights[SPOT_LIGHT].generateViewMatrix();
-	lights[SPOT_LIGHT].generateProjectionMatrix(0.1f, 100.f);
-	view = lights[SPOT_LIGHT].getViewMatrix();
-	proj = lights[SPOT_LIGHT].getProjectionMatrix();
+	// every cascade only draws the casters that the update found for it
+	u32 count = min(sunShadowMap.getCascades().getCount(), CASCADED_SIZE);
+	for (u32 i = 0; i < count; ++i) {
+		sunShadowMap.bind(renderer->getDeviceContext(), i);
+		renderScene(drawQueue, world, sunShadowMap.getViewMatrix(i), sunShadowMap.getProjectionMatrix(i), (i32)i);
+	}
+
+	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+
+	DefaultShader::useDepthShader(false);
+}
+
+void App1::spotShadowPass() {
+	DefaultShader::useDepthShader(true);
+
+	mat4 world = renderer->getWorldMatrix();
+
+	// render() generated the matrices
+	constexpr f32 zFar = SPOT_SHADOW_FAR;
+	mat4 view = lights[SPOT_LIGHT].getViewMatrix();
+	mat4 proj = lights[SPOT_LIGHT].getProjectionMatrix();
 
 	// bind shadow map's render target
-	spotShadowMap->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext());
-	renderScene(world, view, proj);
+	DeviceContext *ctx = stateCache.getBackend()->getContext();
+	stateCache.unbindShaderResources();
+	spotShadowMap->BindDsvAndSetNullRenderTarget(ctx);
 
-	//-- Point light -------------------------------------------------------------
+	if (!renderPacket->useShadowCache) {
+		renderScene(spotQueue, world, view, proj);
+	}
+	else {
+		// the torch follows the camera, it can only use the cache while the camera stands still.
+		// It's checked here and not in prepareFrame as the torch could have moved since then
+		vec3f pos = lights[SPOT_LIGHT].getPosition();
+		updateLightVersion(spotLightVersion, pos, lights[SPOT_LIGHT].getDirection());
+		spotCache.setLight(spotLightVersion.version, pos - zFar, pos + zFar);
+		if (treeModel) {
+			spotCache.setCaster(TREE_CASTER, treeVersion, treesMin + vec3f(treeModel->boundsMin), treesMax + vec3f(treeModel->boundsMax));
+		}
+		spotCache.setCaster(GROUND_CASTER, ground.getVersion(), vec3f(-std::numeric_limits<f32>::max()), vec3f(std::numeric_limits<f32>::max()));
+
+		if (spotCache.update()) {
+			renderScene(spotQueue, world, view, proj, -1, CasterLayer::Static);
+			spotStaticDepth.save(ctx);
+		}
+		else {
+			spotStaticDepth.restore(ctx);
+		}
+		renderScene(spotQueue, world, view, proj, -1, CasterLayer::Dynamic);
+	}
+
+	DefaultShader::useDepthShader(false);
+}
+
+void App1::pointShadowPass() {
 	constexpr f32 aspect = 1.f;
-	constexpr f32 zNear  = 1.f;
-	constexpr f32 zFar   = 200.f;
 	constexpr vec3f lightDir[6] = {
 		{  1.f,  0.f,  0.f }, { -1.f,  0.f,  0.f }, {  0.f,  1.f,  0.f },
 		{  0.f, -1.f,  0.f }, {  0.f,  0.f,  1.f }, {  0.f,  0.f, -1.f },
@@ -416,100 +1210,105 @@ void App1::depthPass() {
 		{ 0.f,  0.f, -1.f }, { 0.f,  1.f,  0.f }, { 0.f,  1.f,  0.f },
 	};
 
-	treeShader->useOmniDepthShader(true);
-	monolithShader->useOmniDepthShader(true);
-	groundShader->useOmniDepthShader(true);
-	ground.getGrassShader()->useOmniDepthShader(true);
-	ground.getGroundShader()->useOmniDepthShader(true);
-	shader->useOmniDepthShader(true);
+	// the cube map still has the trees of the last frame that drew them
+	if (!renderPacket->drawPointShadow) return;
+	faceStats = renderPacket->faceCuller.getStats();
 
-	vec3f lightPos = lights[POINT_LIGHT].getPosition();
+	DefaultShader::useDepthShader(true);
+	DefaultShader::useOmniDepthShader(true);
+
+	mat4 world = renderer->getWorldMatrix();
+
+	// the same position the update culled the trees with
+	vec3f lightPos = renderPacket->pointLightPos;
 	for (int i = 0; i < 6; ++i) {
-		view = lookAt(lightPos, lightPos + lightDir[i], lightUp[i]);
+		mat4 view = lookAt(lightPos, lightPos + lightDir[i], lightUp[i]);
 		pointShadowMap.setViewMatrix(view, i);
 	}
 
-	proj = XMMatrixPerspectiveFovLH(degToRad(90.f), aspect, zNear, zFar);
+	mat4 proj = XMMatrixPerspectiveFovLH(degToRad(90.f), aspect, POINT_SHADOW_NEAR, POINT_SHADOW_FAR);
 
-	pointShadowMap.bind(renderer->getDeviceContext());
-	renderScene(world, XMMatrixIdentity(), proj);
+	stateCache.unbindShaderResources();
+	pointShadowMap.bind(stateCache.getBackend()->getContext());
+	// the draws that aren't culled go to every face
+	pointShadowMap.setFaceMask(CubeFaceCuller::ALL_FACES);
+	renderScene(pointQueue, world, XMMatrixIdentity(), proj);
+	pointShadowMap.setFaceMask(CubeFaceCuller::ALL_FACES);
 
-	treeShader->useOmniDepthShader(false);
-	monolithShader->useOmniDepthShader(false);
-	groundShader->useOmniDepthShader(false);
-	ground.getGrassShader()->useOmniDepthShader(false);
-	ground.getGroundShader()->useOmniDepthShader(false);
-	shader->useOmniDepthShader(false);
+	DefaultShader::useOmniDepthShader(false);
+	DefaultShader::useDepthShader(false);
+}
 
-	//----------------------------------------------------------------------------
-	renderer->setBackBufferRenderTarget();
-	renderer->resetViewport();
+void App1::renderPass(RenderTexture *target) {
+	DeviceContext *ctx = renderer->getDeviceContext();
+	renderer->setWireframeMode(wireframeToggle);
+	stateCache.unbindShaderResources();
+	target->setRenderTarget(ctx);
+	target->clearRenderTarget(ctx, 0.39f, 0.58f, 0.92f, 1.0f);
 
-	// turn off depth shaders
-	treeShader->useDepthShader(false);
-	monolithShader->useDepthShader(false);
-	groundShader->useDepthShader(false);
-	ground.getGrassShader()->useDepthShader(false);
-	ground.getGroundShader()->useDepthShader(false);
-	shader->useDepthShader(false);
+	// the sky goes first, on the immediate context, then the rest of the scene on top of it
+	sky.render(renderer, XMLoadFloat4x4(&renderPacket->view), renderPacket->cameraPos);
+	runPass(RecordedPass::Camera, target);
+
+	// everything after this is drawn on full-screen quads, finalPass turns it back on
+	renderer->setZBuffer(false);
 }
 
-void App1::renderPass() {
-	renderer->setWireframeMode(wireframeToggle);
-	renderTarget->setRenderTarget(renderer->getDeviceContext());
-	renderTarget->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
+void App1::cameraPass(RenderTexture *target) {
+	// the target already has the sky, a command list has to bind it again
+	stateCache.unbindShaderResources();
+	target->setRenderTarget(stateCache.getBackend()->getContext());
 
-	camera->update();
 	mat4 world = renderer->getWorldMatrix();
-	mat4 view  = camera->getViewMatrix();
-	mat4 proj  = renderer->getProjectionMatrix();
+	mat4 view  = XMLoadFloat4x4(&renderPacket->view);
+	mat4 proj  = XMLoadFloat4x4(&renderPacket->projection);
+	renderScene(drawQueue, world, view, proj);
+}
 
-	sky.render(renderer, camera);
-	renderScene(world, view, proj);
-	ground.renderGrass(
-		renderer->getDeviceContext(),
-		view, proj,
-		camera->getPosition(),
-		lights,
-		spotShadowMap, pointShadowMap
-	);
+void App1::drawPass(RecordedPass pass, RenderTexture *target) {
+	DeviceContext *ctx = stateCache.getBackend()->getContext();
+	ctx->RSSetState(rasterStates[pass == RecordedPass::Camera && wireframeToggle]);
+	ctx->OMSetDepthStencilState(depthState, 1);
 
-	renderer->setBackBufferRenderTarget();
-	renderer->setWireframeMode(false);
+	switch (pass) {
+		case RecordedPass::Spot:   spotShadowPass(); break;
+		case RecordedPass::Point:  pointShadowPass(); break;
+		case RecordedPass::Camera: cameraPass(target); break;
+		default: break;
+	}
 }
 
-void App1::bloomPass() {
-	mat4 world = renderer->getWorldMatrix();
-	mat4 proj = renderer->getOrthoMatrix();
-	mat4 view = camera->getOrthoViewMatrix();
-
-	renderer->setZBuffer(false);
-	bloomResult = bloom.apply(
-		renderer->getDeviceContext(),
-		world, view, proj,
-		renderTarget->getShaderResourceView()
-	);
-	renderer->setZBuffer(true);
+void App1::runPass(RecordedPass pass, RenderTexture *target) {
+	if (recorder.isRecorded()) {
+		recorder.execute(passLists[(u32)pass], d3dBackend);
+	}
+	else {
+		drawPass(pass, target);
+	}
 
+	// a command list leaves the context with the default state, and the passes leave their targets bound
 	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+	renderer->setWireframeMode(false);
+	renderer->setZBuffer(true);
 }
 
-void App1::finalPass() {
+void App1::finalPass(TextureType *texture) {
 	// Clear the scene. (default blue colour)
 	renderer->beginScene(0.39f, 0.58f, 0.92f, 1.0f);
 
 	// get the world, view, projection, and ortho matrices from the camera and Direct3D objects.
 	mat4 world = renderer->getWorldMatrix();
 	mat4 proj  = renderer->getOrthoMatrix();
-	mat4 view  = camera->getOrthoViewMatrix();
+	mat4 view  = XMLoadFloat4x4(&renderPacket->orthoView);
 
 	renderer->setZBuffer(false);
 	
-	// Render scene from renderTarget to a full-screen orthographic mesh
+	// Render the result of the graph to a full-screen orthographic mesh
 	textureShader->setShaderParameters(
 		renderer->getDeviceContext(),
 		world, view, proj,
-		bloomResult
+		texture
 	);
 	textureShader->render(renderer->getDeviceContext(), mainOrthoMesh);
 
@@ -517,58 +1316,300 @@ void App1::finalPass() {
 
 	gui();
 	renderer->endScene();
-}
-
-void App1::readTreeData() {
-	// Tries to load a tree_data file, the format is simply values divided by a white space
-	// if it can load the file for whatever reason it loads some fallback positions
-
-	treeData.clear();
-
-	std::ifstream file("res/tree_data.txt");
-	if (!file.good()) {
-		err("couldn't open tree data file");
-		treeDataFallback();
-		return;
-	}
-	
-	f32 x, y;
-	while (file >> x >> y) {
-		treeData.emplace_back(x, 0.1f, y);
-	}
-}
-
-void App1::treeDataFallback() {
-	treeData.emplace_back(-12.730f, 0.f,  47.556f);
-	treeData.emplace_back(-65.968f, 0.f, -24.806f);
-	treeData.emplace_back(-48.676f, 0.f,   8.661f);
-	treeData.emplace_back(-38.277f, 0.f,  -5.602f);
-	treeData.emplace_back( -4.338f, 0.f,  26.650f);
-	treeData.emplace_back( 20.907f, 0.f,   3.277f);
-	treeData.emplace_back( 12.519f, 0.f, -19.656f);
-	treeData.emplace_back(-22.143f, 0.f, -35.033f);
-	treeData.emplace_back( 20.597f, 0.f,  14.886f);
-	treeData.emplace_back( 38.216f, 0.f, -27.661f);
-	treeData.emplace_back(-15.243f, 0.f, -16.711f);
-	treeData.emplace_back( -6.433f, 0.f,  12.854f);
-	treeData.emplace_back( 44.561f, 0.f, -10.193f);
-	treeData.emplace_back(-46.925f, 0.f,  44.733f);
-	treeData.emplace_back( 45.502f, 0.f,  13.071f);
-	treeData.emplace_back(-55.887f, 0.f,  25.213f);
-	treeData.emplace_back(-71.223f, 0.f,  13.579f);
-	treeData.emplace_back( 30.166f, 0.f,   1.437f);
-	treeData.emplace_back(-62.261f, 0.f,  33.099f);
-	treeData.emplace_back( 37.026f, 0.f, -18.019f);
-	treeData.emplace_back(-31.492f, 0.f,   0.569f);
-	treeData.emplace_back(-30.579f, 0.f, -28.345f);
-	treeData.emplace_back( 22.880f, 0.f, -39.295f);
-	treeData.emplace_back(  6.996f, 0.f,  23.534f);
-	treeData.emplace_back(-37.478f, 0.f, -46.667f);
-	treeData.emplace_back( -2.816f, 0.f, -31.290f);
-	treeData.emplace_back( 14.724f, 0.f,  -8.805f);
-	treeData.emplace_back(-19.673f, 0.f,  15.016f);
-	treeData.emplace_back(-51.256f, 0.f, -16.995f);
-	treeData.emplace_back(-64.011f, 0.f, - 2.973f);
+}
+
+void App1::readTreeData() {
+	// Tries to load a tree_data file, the format is simply values divided by a white space
+	// if it can load the file for whatever reason it loads some fallback positions
+
+	treeData.clear();
+
+	std::ifstream file("res/tree_data.txt");
+	if (!file.good()) {
+		err("couldn't open tree data file");
+		treeDataFallback();
+	}
+	else {
+		f32 x, y;
+		while (file >> x >> y) {
+			treeData.emplace_back(x, 0.1f, y);
+		}
+	}
+
+	// the shadow caches draw the trees again
+	treesMin = treesMax = treeData.empty() ? vec3f() : vec3f(treeData[0].position);
+	for (const TreeInstanceType &tree : treeData) {
+		vec3f pos = tree.position;
+		treesMin = { min(treesMin.x, pos.x), min(treesMin.y, pos.y), min(treesMin.z, pos.z) };
+		treesMax = { max(treesMax.x, pos.x), max(treesMax.y, pos.y), max(treesMax.z, pos.z) };
+	}
+	treeVersion++;
+}
+
+void App1::updateLightVersion(LightVersion &light, const vec3f &position, const vec3f &direction) {
+	if (light.position != position || light.direction != direction) {
+		light.position = position;
+		light.direction = direction;
+		light.version++;
+	}
+}
+
+void App1::generateFireflies() {
+	u32 seed = 2468;
+	auto random = [&seed](f32 from, f32 to) {
+		seed = seed * 1664525u + 1013904223u;
+		return from + (to - from) * (f32)(seed >> 8) / (f32)(1 << 24);
+	};
+
+	// yellow-green, with a few warmer ones
+	fireflies.resize(LightClusters::MAX_LIGHTS);
+	for (Firefly &firefly : fireflies) {
+		firefly.position = vec3f(
+			random(treesMin.x - 10.f, treesMax.x + 10.f),
+			random(0.5f, 3.f),
+			random(treesMin.z - 10.f, treesMax.z + 10.f)
+		);
+		firefly.color = random(0.f, 1.f) < 0.8f ? vec3f(0.6f, 1.f, 0.2f) : vec3f(1.f, 0.6f, 0.2f);
+		firefly.phase = random(0.f, 6.2831853f);
+	}
+}
+
+void App1::treeDataFallback() {
+	treeData.emplace_back(-12.730f, 0.f,  47.556f);
+	treeData.emplace_back(-65.968f, 0.f, -24.806f);
+	treeData.emplace_back(-48.676f, 0.f,   8.661f);
+	treeData.emplace_back(-38.277f, 0.f,  -5.602f);
+	treeData.emplace_back( -4.338f, 0.f,  26.650f);
+	treeData.emplace_back( 20.907f, 0.f,   3.277f);
+	treeData.emplace_back( 12.519f, 0.f, -19.656f);
+	treeData.emplace_back(-22.143f, 0.f, -35.033f);
+	treeData.emplace_back( 20.597f, 0.f,  14.886f);
+	treeData.emplace_back( 38.216f, 0.f, -27.661f);
+	treeData.emplace_back(-15.243f, 0.f, -16.711f);
+	treeData.emplace_back( -6.433f, 0.f,  12.854f);
+	treeData.emplace_back( 44.561f, 0.f, -10.193f);
+	treeData.emplace_back(-46.925f, 0.f,  44.733f);
+	treeData.emplace_back( 45.502f, 0.f,  13.071f);
+	treeData.emplace_back(-55.887f, 0.f,  25.213f);
+	treeData.emplace_back(-71.223f, 0.f,  13.579f);
+	treeData.emplace_back( 30.166f, 0.f,   1.437f);
+	treeData.emplace_back(-62.261f, 0.f,  33.099f);
+	treeData.emplace_back( 37.026f, 0.f, -18.019f);
+	treeData.emplace_back(-31.492f, 0.f,   0.569f);
+	treeData.emplace_back(-30.579f, 0.f, -28.345f);
+	treeData.emplace_back( 22.880f, 0.f, -39.295f);
+	treeData.emplace_back(  6.996f, 0.f,  23.534f);
+	treeData.emplace_back(-37.478f, 0.f, -46.667f);
+	treeData.emplace_back( -2.816f, 0.f, -31.290f);
+	treeData.emplace_back( 14.724f, 0.f,  -8.805f);
+	treeData.emplace_back(-19.673f, 0.f,  15.016f);
+	treeData.emplace_back(-51.256f, 0.f, -16.995f);
+	treeData.emplace_back(-64.011f, 0.f, - 2.973f);
+}
+
+bool App1::shadowFilterGui(EvsmShadowMap &moments) {
+	bool changed = false;
+
+	bool useEvsm = moments.isEnabled();
+	if (ImGui::Checkbox("Filter with EVSM", &useEvsm)) {
+		moments.setFilter(useEvsm ? ShadowMoments::Filter::Evsm : ShadowMoments::Filter::Hard);
+		changed = true;
+	}
+	if (useEvsm) {
+		int radius = (int)moments.getBlurRadius();
+		if (ImGui::SliderInt("Blur radius", &radius, 0, (int)ShadowMoments::MAX_BLUR_RADIUS)) {
+			moments.setBlurRadius((u32)radius);
+			changed = true;
+		}
+		ImGui::SliderFloat("Light bleeding", &moments.getParams().lightBleeding, 0.f, 0.9f);
+		ImGui::SliderFloat("Min variance", &moments.getParams().minVariance, 0.f, 0.001f, "%.5f");
+	}
+
+	return changed;
+}
+
+void App1::rendererGui(bool &open) {
+	ImGui::Begin("Renderer options", &open);
+
+	ImGui::Text("Cpu submit: %.3fms", submitMs);
+	const StateCache::Counters &stateCalls = stateCache.getLastFrame();
+	ImGui::Text("State calls: %u issued, %u elided", stateCalls.issued, stateCalls.elided);
+
+	const ConstantAllocator::Counters &constants = constantAllocator.getLastFrame();
+	ImGui::Text("Constant blocks: %u uploaded, %u unchanged", constants.uploads, constants.skipped);
+	if (constantAllocator.isUsingRing()) {
+		ImGui::Text(
+			"Constant ring: %u written, %u reused, %.1f/%.1fKB",
+			constants.ringWrites, constants.ringReuses, constants.ringBytes / 1024.0, constantAllocator.getRingSize() / 1024.0
+		);
+	}
+	else {
+		ImGui::Text("Constant ring: not supported");
+	}
+	ImGui::Text("Constant data: %.1fKB uploaded", constants.bytesUploaded / 1024.0);
+
+	ShaderLibrary::Stats shaderStats = shaderLibrary.getStats();
+	BytecodeCache::Stats bytecodeStats = shaderLibrary.getCache().getStats();
+	ImGui::Text(
+		"Shaders: %u created, %u shared, %u files (%u duplicates), %.1fKB mapped",
+		shaderStats.created, shaderStats.shared, bytecodeStats.files, bytecodeStats.duplicates, bytecodeStats.bytes / 1024.0
+	);
+
+	// -- Shader variants -------------------------------------------------------------------
+	using Feature = ShaderPermutations::Feature;
+	ShaderPermutations::Key key = DefaultShader::getPermutation();
+	bool spotPcf  = ShaderPermutations::get(key, Feature::SpotPcf) != 0;
+	bool pointPcf = ShaderPermutations::get(key, Feature::PointPcf) != 0;
+	int pcfRadius = (int)ShaderPermutations::get(key, Feature::SpotPcfRadius);
+	const ShaderPermutations::FeatureInfo &radiusInfo = ShaderPermutations::getFeature(Feature::SpotPcfRadius);
+
+	bool keyChanged = false;
+	keyChanged |= ImGui::Checkbox("Spot PCF", &spotPcf);
+	if (spotPcf) {
+		char radiusName[16];
+		snprintf(radiusName, sizeof(radiusName), "%u texels", radiusInfo.values[pcfRadius]);
+		keyChanged |= ImGui::SliderInt("PCF radius", &pcfRadius, 0, radiusInfo.valueCount - 1, radiusName);
+	}
+	keyChanged |= ImGui::Checkbox("Point PCF", &pointPcf);
+	if (keyChanged) {
+		key = ShaderPermutations::set(key, Feature::SpotPcf, spotPcf);
+		key = ShaderPermutations::set(key, Feature::SpotPcfRadius, (u32)pcfRadius);
+		key = ShaderPermutations::set(key, Feature::PointPcf, pointPcf);
+		DefaultShader::setPermutation(key);
+	}
+
+	const ShaderArchive &archive = shaderLibrary.getArchive();
+	if (archive.isOpen()) {
+		ImGui::Text(
+			"Variant %llx: %u in the archive, %u handed out, %u missing",
+			(unsigned long long)key, archive.getCount(), shaderStats.variants, shaderStats.missingVariants
+		);
+	}
+	else {
+		ImGui::Text("No shader archive, run with -packshaders to build it");
+	}
+
+	// -- Draw queue ------------------------------------------------------------------------
+	ImGui::Separator();
+	DrawQueue *queues[] = { &drawQueue, &spotQueue, &pointQueue };
+	bool sortDraws = drawQueue.isSorting();
+	if (ImGui::Checkbox("Sort draws", &sortDraws)) {
+		for (DrawQueue *queue : queues) queue->setSorting(sortDraws);
+	}
+	DrawQueue::Stats queueStats;
+	for (const DrawQueue *queue : queues) {
+		queueStats.packets += queue->getLastFrame().packets;
+		queueStats.sortMs += queue->getLastFrame().sortMs;
+		queueStats.dispatchMs += queue->getLastFrame().dispatchMs;
+	}
+	ImGui::Text(
+		"%u packets, sort %.3fms, dispatch %.3fms",
+		queueStats.packets, queueStats.sortMs, queueStats.dispatchMs
+	);
+
+	// -- Jobs ------------------------------------------------------------------------------
+	ImGui::Separator();
+	JobSystem::Stats jobStats = jobSystem.getStats();
+	ImGui::Text(
+		"Jobs: %u threads, %llu jobs, %llu steals",
+		jobSystem.getThreadCount(), jobStats.jobs, jobStats.steals
+	);
+
+	// -- Frame pipeline --------------------------------------------------------------------
+	ImGui::Separator();
+	bool pipelined = pipeline.isPipelined();
+	if (ImGui::Checkbox("Update the next frame while rendering", &pipelined)) {
+		pipeline.setPipelined(pipelined);
+	}
+	const FramePipeline::Stats &pipelineStats = pipeline.getStats();
+	ImGui::Text(
+		"Frame: %.3fms, waited %.3fms for the update, %u frame latency",
+		pipelineStats.frameMs, pipelineStats.waitMs, pipelineStats.latency
+	);
+
+	// -- Start-up --------------------------------------------------------------------------
+	ImGui::Separator();
+	const StartupGraph::Stats &startupStats = startup.getStats();
+	ImGui::Text(
+		"Start-up: %u tasks in %.1fms, %.1fms in order",
+		startupStats.tasks, startupStats.totalMs, startupStats.taskMs
+	);
+	ImGui::Checkbox("Show start-up tasks", &showStartup);
+	if (showStartup) {
+		ImGui::TextUnformatted(startup.dump().c_str());
+	}
+
+	// -- Command lists ---------------------------------------------------------------------
+	ImGui::Separator();
+	ImGui::Checkbox("Record the spot, point and camera passes in parallel", &recordPasses);
+	if (recordPasses) {
+		const CommandRecorder::Stats &recordStats = recorder.getStats();
+		ImGui::Text(
+			"%u %s command lists: record %.3fms, execute %.3fms",
+			recordStats.lists, commandLists.supportsNativeLists() ? "native" : "emulated",
+			recordStats.recordMs, recordStats.executeMs
+		);
+	}
+
+	// -- Frame graph -----------------------------------------------------------------------
+	ImGui::Separator();
+	ImGui::Checkbox("Bloom", &useBloom);
+	const FrameGraph::Stats &graphStats = frameGraph.getStats();
+	ImGui::Text(
+		"Frame graph: %u passes, %u culled, %u transient targets in %u textures",
+		graphStats.passes, graphStats.culledPasses, graphStats.transientResources, graphStats.physicalTextures
+	);
+	ImGui::Checkbox("Show schedule", &showFrameGraph);
+	if (showFrameGraph) {
+		ImGui::TextUnformatted(frameGraph.dump().c_str());
+	}
+
+	// -- Frame capture ---------------------------------------------------------------------
+	ImGui::Separator();
+	if (ImGui::Button("Capture frame")) {
+		captureNextFrame = true;
+	}
+
+	if (hasCapture) {
+		const RecordingBackend::Stats &stats = frameCapture.getStats();
+		ImGui::Text(
+			"%u calls, %u draws, %llu primitives, %.1fKB uploaded",
+			frameCapture.getTotal(), stats.draws, stats.primitives, stats.bytesUploaded / 1024.0
+		);
+
+		// draws between the markers
+		const std::vector<RecordingBackend::Command> &commands = frameCapture.getCommands();
+		const char *pass = "update";
+		u32 passDraws = 0;
+		for (size_t i = 0; i <= commands.size(); ++i) {
+			if (i == commands.size() || commands[i].type == RenderCall::Marker) {
+				ImGui::Text("  %s: %u draws", pass, passDraws);
+				if (i < commands.size()) pass = (const char *)&frameCapture.getData()[commands[i].data];
+				passDraws = 0;
+			}
+			else if (commands[i].type >= RenderCall::Draw) {
+				passDraws++;
+			}
+		}
+
+		// replays the frame on a backend that drops everything, this is the
+		// cost of going through the commands without the driver
+		if (ImGui::Button("Benchmark replay")) {
+			using namespace std::chrono;
+			constexpr u32 count = 100;
+			RecordingBackend nullBackend(false);
+
+			auto start = high_resolution_clock::now();
+			for (u32 i = 0; i < count; ++i) {
+				frameCapture.replay(nullBackend);
+			}
+			replayMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count() / count;
+		}
+		ImGui::SameLine();
+		ImGui::Text("%.3fms per frame", replayMs);
+	}
+
+	ImGui::End();
 }
 
 static void OptionButton(const char *label, bool &enabled) {
@@ -588,3 +1629,18 @@ static void OptionButton(const char *label, bool &enabled) {
 		ImGui::PopItemFlag();
 	}
 }
+
+static void getCubeCorners(const XMFLOAT4X4 &matrix, vec3f corners[8]) {
+	mat4 transform = XMLoadFloat4x4(&matrix);
+	for (u32 i = 0; i < 8; ++i) {
+		XMVECTOR corner = XMVectorSet(
+			i & 1 ? 1.f : -1.f,
+			i & 2 ? 1.f : -1.f,
+			i & 4 ? 1.f : -1.f,
+			1.f
+		);
+		float3 transformed;
+		XMStoreFloat3(&transformed, XMVector3TransformCoord(corner, transform));
+		corners[i] = transformed;
+	}
+}
@@ -14,10 +14,40 @@
 #include "Sky.h"
 #include "Bloom.h"
 #include "Ground.h"
+#include "Wind.h"
+#include "Impostor.h"
+#include "OcclusionCuller.h"
+#include "DrawQueue.h"
+#include "FrameGraph.h"
+#include "D3D11Backend.h"
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+#include "FramePipeline.h"
+#include "StartupGraph.h"
 #include "TextureIdManager.h"
 #include "mmodel.h"
 #include "vec.h"
 #include "OmniShadowMap.h"
+#include "CascadedShadowMap.h"
+#include "ShadowCascades.h"
+#include "CubeFaceCuller.h"
+#include "ShadowCache.h"
+#include "ShadowCacheTexture.h"
+#include "LightClusters.h"
+#include "ClusteredLights.h"
+#include "ShadowMoments.h"
+#include "EvsmShadowMap.h"
+
+// Creates the transient targets of the frame graph as screen sized RenderTextures
+class RenderTextureAllocator : public FrameGraphAllocator {
+public:
+	void init(Device *dev) { device = dev; }
+	void *createTexture(const FrameGraphTextureDesc &desc) override;
+	void releaseTexture(void *texture) override;
+
+private:
+	Device *device = nullptr;
+};
 
 class App1 : public BaseApplication {
 public:
@@ -30,17 +60,52 @@ public:
 protected:
 	bool render();
 	void gui();
+	void rendererGui(bool &open);
+	// Filter options of a light, returns true if its moments have to be drawn again
+	bool shadowFilterGui(EvsmShadowMap &moments);
+
+	struct FramePacket;
 
-	void updateTorchLight();
+	void prepareFrame(FramePacket &packet);
+	void updateTorchLight(FramePacket &packet);
+	void updateTreeLods(FramePacket &packet);
+	void updateLightClusters(FramePacket &packet);
+	void addOccluders(FramePacket &packet);
+	mat4 getMonolithMatrix();
 
-	void renderScene(const mat4 &world, const mat4 &view, const mat4 &proj);
-	void depthPass();
-	void renderPass();
-	void bloomPass();
-	void finalPass();
+	// What renderScene draws: the static casters are kept in the shadow caches,
+	// the dynamic ones are drawn on top of them every frame
+	enum class CasterLayer : u8 {
+		All,
+		Static,  // trees and ground
+		Dynamic, // the monolith
+	};
+
+	// with a cascade it only draws the casters the update found for that cascade of the sun.
+	// The draws go through the thread's stateCache, queue must not be used by another thread
+	void renderScene(DrawQueue &queue, const mat4 &world, const mat4 &view, const mat4 &proj, i32 cascade = -1, CasterLayer layer = CasterLayer::All);
+	void sunShadowPass();
+	void spotShadowPass();
+	void pointShadowPass();
+	void renderPass(RenderTexture *target);
+	void cameraPass(RenderTexture *target);
+	void finalPass(TextureType *texture);
+
+	// The passes that are recorded in command lists on the job system, they only read the packet
+	enum class RecordedPass : u8 {
+		Spot,
+		Point,
+		Camera,
+		Count,
+	};
+	// Draws the pass on the context of the thread's stateCache, a command list or the immediate context
+	void drawPass(RecordedPass pass, RenderTexture *target);
+	// Executes the list of the pass, or draws it here if it wasn't recorded
+	void runPass(RecordedPass pass, RenderTexture *target);
 
 	void readTreeData();
 	void treeDataFallback();
+	void generateFireflies();
 
 private:
 	DefaultShader *shader = nullptr;
@@ -49,18 +114,55 @@ private:
 	MonolithShader *monolithShader = nullptr;
 	GroundShader *groundShader = nullptr;
 	TextureIdManager tmanager;
-	
-	RenderTexture *renderTarget = nullptr;
-	TextureType *bloomResult = nullptr;
+	// every shader binds its state through stateCache, which forwards it here
+	D3D11Backend d3dBackend;
+	// records a whole frame while still forwarding it to d3dBackend
+	RecordingBackend frameCapture;
+	bool captureNextFrame = false;
+	bool hasCapture = false;
+	f64 submitMs = 0.0; // cpu time of render()
+	f64 replayMs = 0.0;
+	// renderScene submits the draws here and flushes them sorted, the shadow
+	// passes that are recorded at the same time as the camera have their own
+	DrawQueue drawQueue;
+	DrawQueue spotQueue;
+	DrawQueue pointQueue;
+	// the spot, point and camera passes are recorded in parallel, see render()
+	D3D11CommandLists commandLists;
+	CommandRecorder recorder;
+	bool recordPasses = true;
+	u32 passLists[(u32)RecordedPass::Count] = {};
+	// the framework's states, a command list starts from the default ones
+	ID3D11RasterizerState *rasterStates[2] = {}; // solid, wireframe
+	ID3D11DepthStencilState *depthState = nullptr;
+	// kept after init() for the timings
+	StartupGraph startup;
+	bool showStartup = false;
+	// rebuilt every frame in render(), the allocator has to outlive it
+	RenderTextureAllocator targetAllocator;
+	FrameGraph frameGraph;
+	FrameGraphTextureDesc sceneDesc;
+	bool useBloom = true;
+	bool showFrameGraph = false;
+
 	MMesh mainOrthoMesh;
 
 	Sky sky;
 	Bloom bloom;
 	Ground ground;
+	Wind wind;
+	Impostor treeImpostor;
+	OcclusionCuller occlusion;
 
 	Light lights[LIGHTS_COUNT];
 	ShadowMap *spotShadowMap = nullptr;
 	OmniShadowMap pointShadowMap;
+	CascadedShadowMap sunShadowMap;
+	// range of the point shadow's projection, matches vecToDepth in utils.hlsli
+	static constexpr f32 POINT_SHADOW_NEAR = 1.f;
+	static constexpr f32 POINT_SHADOW_FAR = 200.f;
+	static constexpr f32 SPOT_SHADOW_NEAR = 0.1f;
+	static constexpr f32 SPOT_SHADOW_FAR = 100.f;
 	MModel *treeModel = nullptr;
 
 	MMesh monolith;
@@ -74,10 +176,154 @@ private:
 	bool isTorchOn = false;
 	bool wasPressed = false;
 
-	f32 treeAmplitude = 0.04f; 
-	f32 treeSpeed = 1.f;
+	f32 treeAmplitude = 0.005f;
 
 	std::vector<TreeInstanceType> treeData;
+
+	// -- Tree lods -------------------------------------------
+	static constexpr u32 MAX_TREE_LODS = 4;
+	LodChainDesc treeLodDesc;
+	bool useTreeLods = true;
+
+	// -- Occlusion culling -----------------------------------
+	// only the camera pass is culled, the shadow passes still use treeLods
+	bool useOcclusionCulling = true;
+	// trees closer than this add their trunk as an occluder
+	f32 trunkOccluderDistance = 40.f;
+	f32 terrainOccluderDistance = 256.f;
+	// box that fits inside the trunk of res/tree.gltf
+	f32 trunkHalfWidth = 0.3f;
+	f32 trunkHeight = 2.5f;
+
+	// -- Sun shadows -----------------------------------------
+	bool useSunShadows = true;
+	ShadowCascades::Desc cascadeDesc;
+
+	// -- Point shadow ----------------------------------------
+	// draws every tree only to the cube faces it is in
+	bool useFaceCulling = true;
+	// of the last frame that drew the point shadow, it could be cached
+	CubeFaceCuller::Stats faceStats;
+
+	// -- Shadow caching --------------------------------------
+	// the spot and point shadows keep the static casters between frames,
+	// they are only drawn again when they or the light change
+	bool useShadowCache = true;
+	ShadowCache spotCache;
+	ShadowCache pointCache;
+	ShadowCacheTexture spotStaticDepth;
+	// ids of the static casters in the caches
+	enum : u32 {
+		TREE_CASTER,
+		GROUND_CASTER,
+	};
+	// incremented when the trees change, their positions or what their shadows look like
+	u32 treeVersion = 0;
+	// box around the positions of the trees
+	vec3f treesMin, treesMax;
+	// the caches compare the version, it's incremented when the light moves
+	struct LightVersion {
+		vec3f position;
+		vec3f direction;
+		u32 version = 0;
+	};
+	static void updateLightVersion(LightVersion &light, const vec3f &position, const vec3f &direction);
+	LightVersion spotLightVersion;
+	LightVersion pointLightVersion;
+
+	// -- Shadow filtering ------------------------------------
+	// the spot and point lights can filter their shadows with EVSM,
+	// the moments are drawn from the depth after every shadow pass
+	EvsmShadowMap spotMoments;
+	EvsmShadowMap pointMoments;
+
+	// -- Local lights ----------------------------------------
+	// unshadowed point and spot lights, lit through clusters so there can be thousands
+	bool useClusteredLights = true;
+	i32 fireflyCount = 512;
+	f32 fireflyRange = 3.f;
+	f32 fireflyBrightness = 1.f;
+	// every LANTERN_STEP-th firefly is a lantern: a still spot light pointing down
+	static constexpr u32 LANTERN_STEP = 16;
+	struct Firefly {
+		vec3f position;
+		vec3f color;
+		f32 phase = 0.f;
+	};
+	// the update reads them, they are placed again when the trees are reloaded
+	std::vector<Firefly> fireflies;
+	ClusteredLights clusteredLights;
+
+protected:
+	// -- Frame pipeline --------------------------------------
+	// What the update stage of a frame works on. The inputs are copied on
+	// the main thread, as the update can run while the previous frame renders
+	struct FramePacket {
+		// inputs
+		// the camera the packet was prepared with, render() draws with it and not with the
+		// live camera, which is already a frame ahead when pipelined
+		float3 cameraPos;
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMFLOAT4X4 orthoView;
+		XMFLOAT4X4 viewProj;
+		// the torch follows the camera
+		float3 spotLightPos;
+		float3 spotLightDir;
+		XMFLOAT4X4 monolithMatrix;
+		f32 projScale = 1.f;
+		bool useTreeLods = true;
+		bool useOcclusionCulling = true;
+		LodChainDesc treeLodDesc;
+		f32 trunkOccluderDistance = 0.f;
+		f32 terrainOccluderDistance = 0.f;
+		bool useTerrainOccluders = false;
+		ImpostorClassifier impostor;
+		bool useSunShadows = true;
+		// fitted around this frame's camera, the update culls the casters with it
+		ShadowCascades sunCascades;
+		bool useFaceCulling = true;
+		float3 pointLightPos;
+		bool useShadowCache = true;
+		// the point shadow is only drawn when its cache is invalid
+		bool drawPointShadow = true;
+		bool useClusteredLights = true;
+		u32 fireflyCount = 0;
+		f32 fireflyRange = 0.f;
+		f32 fireflyBrightness = 0.f;
+		ShadowCascades::View cameraView;
+		f32 time = 0.f;
+
+		// outputs
+		// instances split by lod, chosen every frame using the camera
+		std::vector<TreeInstanceType> treeLods[MAX_TREE_LODS];
+		std::vector<TreeInstanceType> visibleTreeLods[MAX_TREE_LODS];
+		// distance of the closest tree of every lod, used to sort the draws
+		f32 treeLodDistances[MAX_TREE_LODS] = {};
+		// trees that still use a mesh, and the ones only drawn as impostors
+		std::vector<TreeInstanceType> nearTrees;
+		std::vector<TreeInstanceType> farTrees;
+		std::vector<ImpostorInstanceType> impostorInstances;
+		// the culler is busy with the next frame, the gui shows these
+		OcclusionCuller::Stats occlusionStats;
+		// the trees (by lod) and the monolith that cast shadows in every cascade,
+		// the far trees use the lowest lod
+		std::vector<TreeInstanceType> cascadeTreeLods[CASCADED_SIZE][MAX_TREE_LODS];
+		bool cascadeMonolith[CASCADED_SIZE] = {};
+		// the trees (by lod) of the point shadow, grouped by the cube faces they are in.
+		// When it's cached the lods are chosen from the light, as the camera can move
+		CubeFaceCuller faceCuller;
+		std::vector<TreeInstanceType> faceTreeLods[CubeFaceCuller::MASKS][MAX_TREE_LODS];
+		// the fireflies where they are this frame, binned in the camera's clusters
+		std::vector<LightClusters::Light> localLights;
+		LightClusters lightClusters;
+	};
+
+private:
+	FramePipeline pipeline;
+	FramePacket packets[FramePipeline::SLOTS];
+	// the packet render() draws, it is only read
+	FramePacket *renderPacket = nullptr;
 };
 
 #endif
\ No newline at end of file
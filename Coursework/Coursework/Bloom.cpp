@@ -2,6 +2,23 @@
 
 #include "utility.h"
 
+// Packs the taps two by two, the ones past the count are left as they were
+static void fillBlurBuffer(BlurBufferType *blurPtr, const std::vector<GaussianKernel::Tap> &taps) {
+	u32 count = min((u32)taps.size(), (u32)BLUR_MAX_TAPS);
+	for (u32 i = 0; i < count; ++i) {
+		float4 &pair = blurPtr->blurTaps[i / 2];
+		if (i % 2) {
+			pair.z = taps[i].offset;
+			pair.w = taps[i].weight;
+		}
+		else {
+			pair.x = taps[i].offset;
+			pair.y = taps[i].weight;
+		}
+	}
+	blurPtr->blurTapCount = count;
+}
+
 // == BLOOM SHADER =======================================================================================================================
 
 BloomShader::BloomShader(Device *device, HWND hwnd)
@@ -21,8 +38,8 @@ void BloomShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, con
 	matrixPtr->projection = tproj;
 	unmapBufferVS(ctx, matrixBuffer, 0);
 
-	ctx->PSSetShaderResources(0, 1, &texture);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 }
 
 void BloomShader::initShader(const wchar_t *ps) {
@@ -44,7 +61,7 @@ BlurHorShader::~BlurHorShader() {
 	RELEASE_IF_NOT_NULL(blurBuffer);
 }
 
-void BlurHorShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, f32 bloomAmount) {
+void BlurHorShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, const std::vector<GaussianKernel::Tap> &taps) {
 	// == MATRIX BUFFER =========================
 	// Transpose the matrices to prepare them for the shader.
 	mat4 tworld = XMMatrixTranspose(world);
@@ -56,13 +73,11 @@ void BlurHorShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, c
 	matrixPtr->projection = tproj;
 	unmapBufferVS(ctx, matrixBuffer, 0);
 
-	auto blurPtr = mapBuffer<BlurBufferType>(ctx, blurBuffer);
-	blurPtr->bloomAmount = bloomAmount;
-	blurPtr->padding = { 0, 0, 0 };
+	fillBlurBuffer(mapBuffer<BlurBufferType>(ctx, blurBuffer), taps);
 	unmapBufferPS(ctx, blurBuffer, 0);
 
-	ctx->PSSetShaderResources(0, 1, &texture);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 }
 
 void BlurHorShader::initShader(const wchar_t *ps) {
@@ -73,18 +88,8 @@ void BlurHorShader::initShader(const wchar_t *ps) {
 	addDynamicBuffer<BlurBufferType>(&blurBuffer);
 
 	// Don't use the default diffuse sampler as we need the
-	// texture to clamp instead of wrap
-	D3D11_SAMPLER_DESC samplerDesc{};
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// texture to clamp instead of wrap, and the taps need the bilinear filter
+	addClampSampler(&sampleState);
 }
 
 // == VERTICAL BLUR SHADER ===============================================================================================================
@@ -98,7 +103,7 @@ BlurVerShader::~BlurVerShader() {
 	RELEASE_IF_NOT_NULL(blurBuffer);
 }
 
-void BlurVerShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, f32 bloomAmount) {
+void BlurVerShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, const std::vector<GaussianKernel::Tap> &taps) {
 	// == MATRIX BUFFER =========================
 	// Transpose the matrices to prepare them for the shader.
 	mat4 tworld = XMMatrixTranspose(world);
@@ -110,13 +115,11 @@ void BlurVerShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, c
 	matrixPtr->projection = tproj;
 	unmapBufferVS(ctx, matrixBuffer, 0);
 
-	auto blurPtr = mapBuffer<BlurBufferType>(ctx, blurBuffer);
-	blurPtr->bloomAmount = bloomAmount;
-	blurPtr->padding = { 0, 0, 0 };
+	fillBlurBuffer(mapBuffer<BlurBufferType>(ctx, blurBuffer), taps);
 	unmapBufferPS(ctx, blurBuffer, 0);
 
-	ctx->PSSetShaderResources(0, 1, &texture);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 }
 
 void BlurVerShader::initShader(const wchar_t *ps) {
@@ -127,18 +130,8 @@ void BlurVerShader::initShader(const wchar_t *ps) {
 	addDynamicBuffer<BlurBufferType>(&blurBuffer);
 
 	// Don't use the default diffuse sampler as we need the
-	// texture to clamp instead of wrap
-	D3D11_SAMPLER_DESC samplerDesc{};
-	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.MipLODBias = 0.0f;
-	samplerDesc.MaxAnisotropy = 1;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	renderer->CreateSamplerState(&samplerDesc, &sampleState);
+	// texture to clamp instead of wrap, and the taps need the bilinear filter
+	addClampSampler(&sampleState);
 }
 
 // == MIX SHADER =========================================================================================================================
@@ -148,10 +141,14 @@ MixShader::MixShader(Device *device, HWND hwnd)
 	initShader(L"shaders/mix_ps.cso");
 }
 
+MixShader::~MixShader() {
+	RELEASE_IF_NOT_NULL(mixBuffer);
+}
+
 void MixShader::setShaderParameters(
 	DeviceContext *ctx, 
 	const mat4 &world, const mat4 &view, const mat4 &proj, 
-	TextureType *textureA, TextureType *textureB
+	TextureType *textureA, TextureType *textureB, f32 intensity
 ) {
 	// == MATRIX BUFFER =========================
 	// Transpose the matrices to prepare them for the shader.
@@ -164,9 +161,13 @@ void MixShader::setShaderParameters(
 	matrixPtr->projection = tproj;
 	unmapBufferVS(ctx, matrixBuffer, 0);
 
-	ctx->PSSetShaderResources(0, 1, &textureA);
-	ctx->PSSetShaderResources(1, 1, &textureB);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	auto mixPtr = mapBuffer<MixBufferType>(ctx, mixBuffer);
+	mixPtr->bloomIntensity = intensity;
+	unmapBufferPS(ctx, mixBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &textureA);
+	stateCache.setShaderResources(ShaderStage::Pixel, 1, 1, &textureB);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 }
 
 void MixShader::initShader(const wchar_t *ps) {
@@ -174,22 +175,127 @@ void MixShader::initShader(const wchar_t *ps) {
 	loadPixelShader(ps);
 
 	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
-	addDiffuseSampler();
+	addDynamicBuffer<MixBufferType>(&mixBuffer);
+	// the bloom of the chain is half the size of the scene, it can't wrap around the edges
+	addClampSampler(&sampleState);
 }
 
-// == BLOOM SHADER =======================================================================================================================
+// == BLOOM PREFILTER SHADER =============================================================================================================
 
-void Bloom::init(Device *device, DeviceContext *deviceContext, int screenWidth, int screenHeight, HWND hwnd) {
-	bloomShader    = new BloomShader(device, hwnd);
-	blurHorShader  = new BlurHorShader(device, hwnd);
-	blurVerShader  = new BlurVerShader(device, hwnd);
-	mixShader      = new MixShader(device, hwnd);
+BloomPrefilterShader::BloomPrefilterShader(Device *device, HWND hwnd)
+	: DefaultShader(device, hwnd) {
+	initShader(L"shaders/bloom_prefilter_ps.cso");
+}
+
+void BloomPrefilterShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *scene) {
+	// == MATRIX BUFFER =========================
+	auto matrixPtr = mapBuffer<MatrixBufferType>(ctx, matrixBuffer);
+	matrixPtr->world = XMMatrixTranspose(world);
+	matrixPtr->view = XMMatrixTranspose(view);
+	matrixPtr->projection = XMMatrixTranspose(proj);
+	unmapBufferVS(ctx, matrixBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &scene);
+}
+
+void BloomPrefilterShader::initShader(const wchar_t *ps) {
+	vertexShader = getBaseVertexShader(this);
+	loadPixelShader(ps);
+
+	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
+}
+
+// == BLOOM DOWN SHADER ==================================================================================================================
+
+BloomDownShader::BloomDownShader(Device *device, HWND hwnd)
+	: DefaultShader(device, hwnd) {
+	initShader(L"shaders/bloom_down_ps.cso");
+}
+
+void BloomDownShader::setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *source) {
+	// == MATRIX BUFFER =========================
+	auto matrixPtr = mapBuffer<MatrixBufferType>(ctx, matrixBuffer);
+	matrixPtr->world = XMMatrixTranspose(world);
+	matrixPtr->view = XMMatrixTranspose(view);
+	matrixPtr->projection = XMMatrixTranspose(proj);
+	unmapBufferVS(ctx, matrixBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &source);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
+}
+
+void BloomDownShader::initShader(const wchar_t *ps) {
+	vertexShader = getBaseVertexShader(this);
+	loadPixelShader(ps);
+
+	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
+	addClampSampler(&sampleState);
+}
 
-	bloomTarget   = new RenderTexture(device, screenWidth, screenHeight, 0.1f, 100.f);
-	blurHorTarget = new RenderTexture(device, screenWidth, screenHeight, 0.1f, 100.f);
-	blurVerTarget = new RenderTexture(device, screenWidth, screenHeight, 0.1f, 100.f);
-	mixTarget     = new RenderTexture(device, screenWidth, screenHeight, 0.1f, 100.f);
+// == BLOOM UP SHADER ====================================================================================================================
 
+BloomUpShader::BloomUpShader(Device *device, HWND hwnd)
+	: DefaultShader(device, hwnd) {
+	initShader(L"shaders/bloom_up_ps.cso");
+}
+
+BloomUpShader::~BloomUpShader() {
+	RELEASE_IF_NOT_NULL(upBuffer);
+}
+
+void BloomUpShader::setShaderParameters(
+	DeviceContext *ctx,
+	const mat4 &world, const mat4 &view, const mat4 &proj,
+	TextureType *lower, TextureType *down, f32 filterRadius
+) {
+	// == MATRIX BUFFER =========================
+	auto matrixPtr = mapBuffer<MatrixBufferType>(ctx, matrixBuffer);
+	matrixPtr->world = XMMatrixTranspose(world);
+	matrixPtr->view = XMMatrixTranspose(view);
+	matrixPtr->projection = XMMatrixTranspose(proj);
+	unmapBufferVS(ctx, matrixBuffer, 0);
+
+	auto upPtr = mapBuffer<BloomUpBufferType>(ctx, upBuffer);
+	upPtr->filterRadius = filterRadius;
+	unmapBufferPS(ctx, upBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &lower);
+	stateCache.setShaderResources(ShaderStage::Pixel, 1, 1, &down);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
+}
+
+void BloomUpShader::initShader(const wchar_t *ps) {
+	vertexShader = getBaseVertexShader(this);
+	loadPixelShader(ps);
+
+	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
+	addDynamicBuffer<BloomUpBufferType>(&upBuffer);
+	addClampSampler(&sampleState);
+}
+
+// == BLOOM ==============================================================================================================================
+
+void Bloom::init(Device *device, DeviceContext *deviceContext, int screenWidth, int screenHeight, HWND hwnd) {
+	bloomShader     = new BloomShader(device, hwnd);
+	blurHorShader   = new BlurHorShader(device, hwnd);
+	blurVerShader   = new BlurVerShader(device, hwnd);
+	mixShader       = new MixShader(device, hwnd);
+	prefilterShader = new BloomPrefilterShader(device, hwnd);
+	downShader      = new BloomDownShader(device, hwnd);
+	upShader        = new BloomUpShader(device, hwnd);
+
+	targetDesc.width  = screenWidth;
+	targetDesc.height = screenHeight;
+
+	GaussianKernel::getLinearTaps(blurSigma, blurTaps);
+
+	maxLevels = BloomChain::getLevelCount(screenWidth, screenHeight, BloomChain::MAX_LEVELS);
+	levels = maxLevels;
+	for (u32 i = 0; i < maxLevels; ++i) {
+		BloomChain::getLevelSize(screenWidth, screenHeight, i, levelDescs[i].width, levelDescs[i].height);
+	}
+
+	// the mesh covers the viewport, so it's the same for every level
 	mesh.moveFromMesh(new OrthoMesh(device, deviceContext, screenWidth, screenHeight));
 }
 
@@ -198,56 +304,201 @@ Bloom::~Bloom() {
 	DELETE_IF_NOT_NULL(blurHorShader);
 	DELETE_IF_NOT_NULL(blurVerShader);
 	DELETE_IF_NOT_NULL(mixShader);
-	DELETE_IF_NOT_NULL(bloomTarget);
-	DELETE_IF_NOT_NULL(blurHorTarget);
-	DELETE_IF_NOT_NULL(blurVerTarget);
-	DELETE_IF_NOT_NULL(mixTarget);
+	DELETE_IF_NOT_NULL(prefilterShader);
+	DELETE_IF_NOT_NULL(downShader);
+	DELETE_IF_NOT_NULL(upShader);
+}
+
+FrameGraphResource Bloom::addPasses(
+	FrameGraph &graph,
+	DeviceContext *ctx,
+	const mat4 &world,
+	const mat4 &view,
+	const mat4 &proj,
+	FrameGraphResource scene
+) {
+	if (useChain && levels > 0) {
+		return addChainPasses(graph, ctx, world, view, proj, scene);
+	}
+	return addSeparablePasses(graph, ctx, world, view, proj, scene);
 }
 
-TextureType *Bloom::apply(
+FrameGraphResource Bloom::addChainPasses(
+	FrameGraph &graph,
+	DeviceContext *ctx,
+	const mat4 &world,
+	const mat4 &view,
+	const mat4 &proj,
+	FrameGraphResource scene
+) {
+	const u32 count = levels;
+	FrameGraphResource down[BloomChain::MAX_LEVELS];
+	FrameGraphResource up[BloomChain::MAX_LEVELS];
+	FrameGraphResource mix = graph.createTexture("bloom mix", targetDesc);
+
+	// The bright pixels at half resolution are the first level
+	down[0] = graph.createTexture("bloom down 0", levelDescs[0]);
+	u32 pass = graph.addPass("bloom prefilter", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(down[0]));
+		prefilterShader->setShaderParameters(ctx, world, view, proj, graph.getTexture<RenderTexture>(scene)->getShaderResourceView());
+		prefilterShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, scene);
+	graph.write(pass, down[0]);
+
+	// Then every level is half of the one before
+	static const char *downNames[] = { "bloom down 0", "bloom down 1", "bloom down 2", "bloom down 3", "bloom down 4", "bloom down 5" };
+	static const char *upNames[] = { "bloom up 0", "bloom up 1", "bloom up 2", "bloom up 3", "bloom up 4", "bloom up 5" };
+	static_assert(sizeof(downNames) / sizeof(*downNames) == BloomChain::MAX_LEVELS, "every level needs a name");
+
+	for (u32 i = 1; i < count; ++i) {
+		down[i] = graph.createTexture(downNames[i], levelDescs[i]);
+		FrameGraphResource source = down[i - 1], target = down[i];
+		pass = graph.addPass(downNames[i], [=, &graph]() {
+			beginPass(ctx, graph.getTexture<RenderTexture>(target));
+			downShader->setShaderParameters(ctx, world, view, proj, graph.getTexture<RenderTexture>(source)->getShaderResourceView());
+			downShader->render(ctx, mesh);
+			endPass(ctx);
+		});
+		graph.read(pass, source);
+		graph.write(pass, target);
+	}
+
+	// On the way back every level adds the one under it, the lowest is its own upsample
+	up[count - 1] = down[count - 1];
+	for (u32 i = count - 1; i-- > 0;) {
+		up[i] = graph.createTexture(upNames[i], levelDescs[i]);
+		FrameGraphResource lower = up[i + 1], levelDown = down[i], target = up[i];
+		f32 radius = filterRadius;
+		pass = graph.addPass(upNames[i], [=, &graph]() {
+			beginPass(ctx, graph.getTexture<RenderTexture>(target));
+			upShader->setShaderParameters(
+				ctx, world, view, proj,
+				graph.getTexture<RenderTexture>(lower)->getShaderResourceView(),
+				graph.getTexture<RenderTexture>(levelDown)->getShaderResourceView(),
+				radius
+			);
+			upShader->render(ctx, mesh);
+			endPass(ctx);
+		});
+		graph.read(pass, lower);
+		graph.read(pass, levelDown);
+		graph.write(pass, target);
+	}
+
+	// Finally, the top level has the sum of every level, it's mixed with the scene as their average
+	FrameGraphResource bloom = up[0];
+	f32 intensity = bloomAmount / count;
+	pass = graph.addPass("bloom mix", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(mix));
+		mixShader->setShaderParameters(
+			ctx, world, view, proj,
+			graph.getTexture<RenderTexture>(bloom)->getShaderResourceView(),
+			graph.getTexture<RenderTexture>(scene)->getShaderResourceView(),
+			intensity
+		);
+		mixShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, bloom);
+	graph.read(pass, scene);
+	graph.write(pass, mix);
+
+	return mix;
+}
+
+FrameGraphResource Bloom::addSeparablePasses(
+	FrameGraph &graph,
 	DeviceContext *ctx, 
 	const mat4 &world, 
 	const mat4 &view, 
 	const mat4 &proj, 
-	TextureType *texture
+	FrameGraphResource scene
 ) {
-	ID3D11RenderTargetView *nullRTV = nullptr; 
-	TextureType *nullTEX = nullptr; 
-
-	// Clear all the targets
-	bloomTarget->clearRenderTarget(ctx,   0.f, 0.f, 0.f, 0.0f);
-	blurHorTarget->clearRenderTarget(ctx, 0.f, 0.f, 0.f, 0.0f);
-	blurVerTarget->clearRenderTarget(ctx, 0.f, 0.f, 0.f, 0.0f);
-	mixTarget->clearRenderTarget(ctx,     0.f, 0.f, 0.f, 0.0f);
+	FrameGraphResource bright  = graph.createTexture("bloom bright", targetDesc);
+	FrameGraphResource blurHor = graph.createTexture("bloom blur horizontal", targetDesc);
+	FrameGraphResource blurVer = graph.createTexture("bloom blur vertical", targetDesc);
+	FrameGraphResource mix     = graph.createTexture("bloom mix", targetDesc);
 
 	// First extract all the pixels over a certain brightness
-	bloomTarget->setRenderTarget(ctx);
-	bloomShader->setShaderParameters(ctx, world, view, proj, texture);
-	bloomShader->render(ctx, mesh);
-	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
+	u32 pass = graph.addPass("bloom bright", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(bright));
+		bloomShader->setShaderParameters(ctx, world, view, proj, graph.getTexture<RenderTexture>(scene)->getShaderResourceView());
+		bloomShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, scene);
+	graph.write(pass, bright);
 
 	// Then blur horizontally the texture
-	blurHorTarget->setRenderTarget(ctx);
-	blurHorShader->setShaderParameters(ctx, world, view, proj, bloomTarget->getShaderResourceView(), bloomAmount);
-	blurHorShader->render(ctx, mesh);
-	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
+	pass = graph.addPass("bloom blur horizontal", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(blurHor));
+		blurHorShader->setShaderParameters(ctx, world, view, proj, graph.getTexture<RenderTexture>(bright)->getShaderResourceView(), blurTaps);
+		blurHorShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, bright);
+	graph.write(pass, blurHor);
 
 	// Then blur vertically the texture
-	blurVerTarget->setRenderTarget(ctx);
-	blurVerShader->setShaderParameters(ctx, world, view, proj, blurHorTarget->getShaderResourceView(), bloomAmount);
-	blurVerShader->render(ctx, mesh);
-	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
+	pass = graph.addPass("bloom blur vertical", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(blurVer));
+		blurVerShader->setShaderParameters(ctx, world, view, proj, graph.getTexture<RenderTexture>(blurHor)->getShaderResourceView(), blurTaps);
+		blurVerShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, blurHor);
+	graph.write(pass, blurVer);
 
 	// Finally, mix the blurred texture with the initial texture
-	mixTarget->setRenderTarget(ctx);
-	mixShader->setShaderParameters(ctx, world, view, proj, blurVerTarget->getShaderResourceView(), texture);
-	mixShader->render(ctx, mesh);
-	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
-	ctx->PSSetShaderResources(1, 1, &nullTEX);
+	pass = graph.addPass("bloom mix", [=, &graph]() {
+		beginPass(ctx, graph.getTexture<RenderTexture>(mix));
+		mixShader->setShaderParameters(
+			ctx, world, view, proj,
+			graph.getTexture<RenderTexture>(blurVer)->getShaderResourceView(),
+			graph.getTexture<RenderTexture>(scene)->getShaderResourceView(),
+			bloomAmount
+		);
+		mixShader->render(ctx, mesh);
+		endPass(ctx);
+	});
+	graph.read(pass, blurVer);
+	graph.read(pass, scene);
+	graph.write(pass, mix);
+
+	return mix;
+}
 
-	return mixTarget->getShaderResourceView();
+void Bloom::beginPass(DeviceContext *ctx, RenderTexture *target) {
+	stateCache.unbindShaderResources();
+	target->setRenderTarget(ctx);
+	// the texture could have been used by another resource
+	target->clearRenderTarget(ctx, 0.f, 0.f, 0.f, 0.0f);
+}
+
+void Bloom::endPass(DeviceContext *ctx) {
+	ID3D11RenderTargetView *nullRTV = nullptr; 
+	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
 }
 
 void Bloom::gui() {
 	ImGui::SliderFloat("Bloom amount", &bloomAmount, 0.f, 1.f);
+	ImGui::Checkbox("Downsample chain", &useChain);
+	if (useChain && maxLevels > 0) {
+		i32 levelCount = (i32)levels;
+		if (ImGui::SliderInt("Bloom levels", &levelCount, 1, (i32)maxLevels)) {
+			levels = (u32)levelCount;
+		}
+		ImGui::SliderFloat("Bloom radius", &filterRadius, 0.5f, 3.f);
+	}
+	else if (ImGui::SliderFloat("Blur sigma", &blurSigma, 0.5f, GaussianKernel::MAX_RADIUS / 3.f)) {
+		GaussianKernel::getLinearTaps(blurSigma, blurTaps);
+	}
+
+	ImGui::Text(
+		"Fetches per pixel: chain %.1f, separable %.0f",
+		BloomChain::getChainFetches(targetDesc.width, targetDesc.height, levels),
+		BloomChain::getSeparableFetches((u32)blurTaps.size() * 2 - 1)
+	);
 }
@@ -1,11 +1,11 @@
 #pragma once
 
 #include "DefaultShader.h"
+#include "FrameGraph.h"
+#include "BloomChain.h"
+#include "GaussianKernel.h"
 
-struct BlurBufferType {
-	float bloomAmount;
-	float3 padding;
-};
+static_assert(GaussianKernel::MAX_TAPS == BLUR_MAX_TAPS, "the blur buffer has to fit the taps of GaussianKernel");
 
 /* Bloom shader takes care of selecting only the pixels that need to be
  * "bloomed". Every monolith pixel has an alpha value higher than 1.5.
@@ -20,12 +20,13 @@ private:
 	void initShader(const wchar_t *ps);
 };
 
+/* The two directions of the separable blur, the taps are from GaussianKernel::getLinearTaps */
 class BlurHorShader : public DefaultShader {
 public:
 	BlurHorShader(Device *device, HWND hwnd);
 	~BlurHorShader();
 
-	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, f32 bloomAmount);
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, const std::vector<GaussianKernel::Tap> &taps);
 
 private:
 	void initShader(const wchar_t *ps);
@@ -38,7 +39,7 @@ public:
 	BlurVerShader(Device *device, HWND hwnd);
 	~BlurVerShader();
 
-	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, f32 bloomAmount);
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture, const std::vector<GaussianKernel::Tap> &taps);
 
 private:
 	void initShader(const wchar_t *ps);
@@ -46,36 +47,99 @@ private:
 	ID3D11Buffer *blurBuffer = nullptr;
 };
 
+/* Adds the bloom (A) scaled by intensity to the scene (B) */
 class MixShader : public DefaultShader {
 public:
 	MixShader(Device *device, HWND hwnd);
+	~MixShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *textureA, TextureType *textureB, f32 intensity);
+
+private:
+	void initShader(const wchar_t *ps);
+
+	ID3D11Buffer *mixBuffer = nullptr;
+};
+
+/* The bright pixels of the scene at half resolution, see BloomChain::prefilter */
+class BloomPrefilterShader : public DefaultShader {
+public:
+	BloomPrefilterShader(Device *device, HWND hwnd);
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *scene);
+
+private:
+	void initShader(const wchar_t *ps);
+};
+
+/* One level of the chain to the next, see BloomChain::downsample */
+class BloomDownShader : public DefaultShader {
+public:
+	BloomDownShader(Device *device, HWND hwnd);
 
-	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *textureA, TextureType *textureB);
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *source);
 
 private:
 	void initShader(const wchar_t *ps);
 };
 
+/* A level plus the one under it, see BloomChain::upsample */
+class BloomUpShader : public DefaultShader {
+public:
+	BloomUpShader(Device *device, HWND hwnd);
+	~BloomUpShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *lower, TextureType *down, f32 filterRadius);
+
+private:
+	void initShader(const wchar_t *ps);
+
+	ID3D11Buffer *upBuffer = nullptr;
+};
+
+/* Adds the bloom passes to the frame graph, in one of two ways:
+ * - the chain (BloomChain): bright pixels at half resolution, downsampled
+ *   level by level and upsampled back, then mixed with the scene. Every
+ *   level is a transient texture of its own size
+ * - separable: bright pixels, horizontal blur, vertical blur and the mix,
+ *   all on screen sized textures
+ * The targets are transient textures (RenderTexture), so the graph can
+ * alias them.
+ */
 class Bloom {
 public:
 	void init(Device *device, DeviceContext *deviceContext, int screenWidth, int screenHeight, HWND hwnd);
 	~Bloom();
 
-	TextureType *apply(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *texture);
+	// Returns the resource with the scene and the bloom mixed
+	FrameGraphResource addPasses(FrameGraph &graph, DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, FrameGraphResource scene);
 	void gui();
 
 private:
-	BloomShader    *bloomShader    = nullptr;
-	BlurHorShader  *blurHorShader  = nullptr;
-	BlurVerShader  *blurVerShader  = nullptr;
-	MixShader      *mixShader      = nullptr;
-
-	RenderTexture *bloomTarget   = nullptr;
-	RenderTexture *blurHorTarget = nullptr;
-	RenderTexture *blurVerTarget = nullptr;
-	RenderTexture *mixTarget     = nullptr;
+	FrameGraphResource addChainPasses(FrameGraph &graph, DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, FrameGraphResource scene);
+	FrameGraphResource addSeparablePasses(FrameGraph &graph, DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, FrameGraphResource scene);
+	// Unbinds the textures, then binds and clears target
+	void beginPass(DeviceContext *ctx, RenderTexture *target);
+	void endPass(DeviceContext *ctx);
+
+	BloomShader          *bloomShader     = nullptr;
+	BlurHorShader        *blurHorShader   = nullptr;
+	BlurVerShader        *blurVerShader   = nullptr;
+	MixShader            *mixShader       = nullptr;
+	BloomPrefilterShader *prefilterShader = nullptr;
+	BloomDownShader      *downShader      = nullptr;
+	BloomUpShader        *upShader        = nullptr;
+
+	FrameGraphTextureDesc targetDesc;
+	FrameGraphTextureDesc levelDescs[BloomChain::MAX_LEVELS];
+	u32 maxLevels = 0;
 
 	MMesh mesh;
 
 	f32 bloomAmount = 1.f;
+	bool useChain = true;
+	u32 levels = BloomChain::MAX_LEVELS;
+	f32 filterRadius = 1.f;
+	f32 blurSigma = 8.f;
+	std::vector<GaussianKernel::Tap> blurTaps;
 };
@@ -0,0 +1,288 @@
+#include "BloomChain.h"
+
+#include <math.h>
+#include <utility>
+
+#include "MathUtils.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+	#define BLOOM_USE_SSE
+	#include <emmintrin.h>
+#endif
+
+using Image = BloomChain::Image;
+
+// == PIXEL OPS ===========================================================================================================================
+// The filters are written once on top of these, a pixel is a vec4f or a register
+
+struct ScalarOps {
+	using Pixel = vec4f;
+
+	static Pixel load(const vec4f &v) { return v; }
+	static void store(vec4f &v, const Pixel &p) { v = p; }
+	static Pixel zero() { return vec4f(); }
+	static Pixel add(const Pixel &a, const Pixel &b) { return a + b; }
+	static Pixel scale(const Pixel &a, f32 s) { return a * s; }
+	static Pixel lerp(const Pixel &a, const Pixel &b, f32 t) { return a + (b - a) * t; }
+
+	static Pixel saturate(const Pixel &p) {
+		return vec4f(clamp(p.x, 0.f, 1.f), clamp(p.y, 0.f, 1.f), clamp(p.z, 0.f, 1.f), clamp(p.w, 0.f, 1.f));
+	}
+
+	// the alpha only marks what blooms, it isn't part of the bloom
+	static Pixel threshold(const Pixel &p) {
+		return p.w > BloomChain::THRESHOLD ? vec4f(p.x, p.y, p.z, 0.f) : vec4f();
+	}
+};
+
+#ifdef BLOOM_USE_SSE
+struct SseOps {
+	using Pixel = __m128;
+
+	static Pixel load(const vec4f &v) { return _mm_loadu_ps(&v.x); }
+	static void store(vec4f &v, Pixel p) { _mm_storeu_ps(&v.x, p); }
+	static Pixel zero() { return _mm_setzero_ps(); }
+	static Pixel add(Pixel a, Pixel b) { return _mm_add_ps(a, b); }
+	static Pixel scale(Pixel a, f32 s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+	static Pixel lerp(Pixel a, Pixel b, f32 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t))); }
+
+	static Pixel saturate(Pixel p) {
+		return _mm_min_ps(_mm_max_ps(p, _mm_setzero_ps()), _mm_set1_ps(1.f));
+	}
+
+	static Pixel threshold(Pixel p) {
+		__m128 alpha = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 mask = _mm_cmpgt_ps(alpha, _mm_set1_ps(BloomChain::THRESHOLD));
+		__m128 rgb = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		return _mm_and_ps(p, _mm_and_ps(mask, rgb));
+	}
+};
+#endif
+
+// == FILTERS =============================================================================================================================
+
+template<typename Ops>
+static typename Ops::Pixel sampleImage(const Image &image, f32 u, f32 v) {
+	f32 x = u * image.width - 0.5f;
+	f32 y = v * image.height - 0.5f;
+	f32 fx = floorf(x);
+	f32 fy = floorf(y);
+	f32 tx = x - fx;
+	f32 ty = y - fy;
+
+	const i32 lastX = (i32)image.width - 1;
+	const i32 lastY = (i32)image.height - 1;
+	i32 x0 = clamp((i32)fx, 0, lastX);
+	i32 x1 = clamp((i32)fx + 1, 0, lastX);
+	i32 y0 = clamp((i32)fy, 0, lastY);
+	i32 y1 = clamp((i32)fy + 1, 0, lastY);
+
+	auto top = Ops::lerp(Ops::load(image.at(x0, y0)), Ops::load(image.at(x1, y0)), tx);
+	auto bottom = Ops::lerp(Ops::load(image.at(x0, y1)), Ops::load(image.at(x1, y1)), tx);
+	return Ops::lerp(top, bottom, ty);
+}
+
+template<typename Ops>
+static void prefilterImage(const Image &scene, Image &out) {
+	out.resize(max(scene.width / 2, 1u), max(scene.height / 2, 1u));
+	const u32 lastX = scene.width - 1;
+	const u32 lastY = scene.height - 1;
+
+	for (u32 y = 0; y < out.height; ++y) {
+		for (u32 x = 0; x < out.width; ++x) {
+			u32 x0 = min(x * 2, lastX), x1 = min(x * 2 + 1, lastX);
+			u32 y0 = min(y * 2, lastY), y1 = min(y * 2 + 1, lastY);
+			auto sum = Ops::add(
+				Ops::add(Ops::threshold(Ops::load(scene.at(x0, y0))), Ops::threshold(Ops::load(scene.at(x1, y0)))),
+				Ops::add(Ops::threshold(Ops::load(scene.at(x0, y1))), Ops::threshold(Ops::load(scene.at(x1, y1))))
+			);
+			Ops::store(out.at(x, y), Ops::scale(sum, 0.25f));
+		}
+	}
+}
+
+template<typename Ops>
+static void downsampleImage(const Image &src, Image &out) {
+	out.resize(max(src.width / 2, 1u), max(src.height / 2, 1u));
+	const f32 texelW = 1.f / src.width;
+	const f32 texelH = 1.f / src.height;
+
+	for (u32 y = 0; y < out.height; ++y) {
+		f32 v = (y + 0.5f) / out.height;
+		for (u32 x = 0; x < out.width; ++x) {
+			f32 u = (x + 0.5f) / out.width;
+			auto tap = [&](f32 dx, f32 dy) { return sampleImage<Ops>(src, u + dx * texelW, v + dy * texelH); };
+
+			// a b c
+			//  d e
+			// f g h
+			//  i j
+			// k l m
+			// the box d e i j has half of the weight, the 4 boxes of 2x2 in
+			// the corners an eighth each
+			auto inner   = Ops::add(Ops::add(tap(-1.f, -1.f), tap(1.f, -1.f)), Ops::add(tap(-1.f, 1.f), tap(1.f, 1.f)));
+			auto corners = Ops::add(Ops::add(tap(-2.f, -2.f), tap(2.f, -2.f)), Ops::add(tap(-2.f, 2.f), tap(2.f, 2.f)));
+			auto edges   = Ops::add(Ops::add(tap(0.f, -2.f), tap(-2.f, 0.f)), Ops::add(tap(2.f, 0.f), tap(0.f, 2.f)));
+			auto centre  = tap(0.f, 0.f);
+
+			auto sum = Ops::add(
+				Ops::add(Ops::scale(inner, 0.125f), Ops::scale(corners, 0.03125f)),
+				Ops::add(Ops::scale(edges, 0.0625f), Ops::scale(centre, 0.125f))
+			);
+			Ops::store(out.at(x, y), sum);
+		}
+	}
+}
+
+template<typename Ops>
+static void upsampleImage(const Image &lower, const Image &down, f32 radius, Image &out) {
+	out.resize(down.width, down.height);
+	const f32 texelW = radius / lower.width;
+	const f32 texelH = radius / lower.height;
+
+	for (u32 y = 0; y < out.height; ++y) {
+		f32 v = (y + 0.5f) / out.height;
+		for (u32 x = 0; x < out.width; ++x) {
+			f32 u = (x + 0.5f) / out.width;
+			auto tap = [&](f32 dx, f32 dy) { return sampleImage<Ops>(lower, u + dx * texelW, v + dy * texelH); };
+
+			// 1 2 1
+			// 2 4 2 / 16
+			// 1 2 1
+			auto corners = Ops::add(Ops::add(tap(-1.f, -1.f), tap(1.f, -1.f)), Ops::add(tap(-1.f, 1.f), tap(1.f, 1.f)));
+			auto edges   = Ops::add(Ops::add(tap(0.f, -1.f), tap(-1.f, 0.f)), Ops::add(tap(1.f, 0.f), tap(0.f, 1.f)));
+			auto tent = Ops::add(
+				Ops::add(Ops::scale(corners, 1.f / 16.f), Ops::scale(edges, 2.f / 16.f)),
+				Ops::scale(tap(0.f, 0.f), 4.f / 16.f)
+			);
+			Ops::store(out.at(x, y), Ops::add(Ops::load(down.at(x, y)), tent));
+		}
+	}
+}
+
+template<typename Ops>
+static void mixImage(const Image &scene, const Image &bloom, f32 intensity, Image &out) {
+	out.resize(scene.width, scene.height);
+
+	for (u32 y = 0; y < out.height; ++y) {
+		f32 v = (y + 0.5f) / out.height;
+		for (u32 x = 0; x < out.width; ++x) {
+			f32 u = (x + 0.5f) / out.width;
+			auto colour = Ops::add(Ops::load(scene.at(x, y)), Ops::scale(sampleImage<Ops>(bloom, u, v), intensity));
+			Ops::store(out.at(x, y), Ops::saturate(colour));
+		}
+	}
+}
+
+#ifdef BLOOM_USE_SSE
+	#define BLOOM_DISPATCH(function, ...) \
+		if (useSimd) function<SseOps>(__VA_ARGS__); \
+		else function<ScalarOps>(__VA_ARGS__)
+#else
+	#define BLOOM_DISPATCH(function, ...) \
+		((void)useSimd, function<ScalarOps>(__VA_ARGS__))
+#endif
+
+// == BLOOM CHAIN =========================================================================================================================
+
+u32 BloomChain::getLevelCount(u32 width, u32 height, u32 maxLevels) {
+	u32 levels = 0;
+	while (levels < min(maxLevels, (u32)MAX_LEVELS)) {
+		u32 levelWidth, levelHeight;
+		getLevelSize(width, height, levels, levelWidth, levelHeight);
+		if (levelWidth < MIN_LEVEL_SIZE || levelHeight < MIN_LEVEL_SIZE) break;
+		levels++;
+	}
+	return levels;
+}
+
+void BloomChain::getLevelSize(u32 width, u32 height, u32 level, u32 &levelWidth, u32 &levelHeight) {
+	levelWidth = max(width >> (level + 1), 1u);
+	levelHeight = max(height >> (level + 1), 1u);
+}
+
+vec4f BloomChain::sample(const Image &image, f32 u, f32 v) {
+	return sampleImage<ScalarOps>(image, u, v);
+}
+
+void BloomChain::prefilter(const Image &scene, Image &out, bool useSimd) {
+	BLOOM_DISPATCH(prefilterImage, scene, out);
+}
+
+void BloomChain::downsample(const Image &src, Image &out, bool useSimd) {
+	BLOOM_DISPATCH(downsampleImage, src, out);
+}
+
+void BloomChain::upsample(const Image &lower, const Image &down, f32 radius, Image &out, bool useSimd) {
+	BLOOM_DISPATCH(upsampleImage, lower, down, radius, out);
+}
+
+void BloomChain::mix(const Image &scene, const Image &bloom, f32 intensity, Image &out, bool useSimd) {
+	BLOOM_DISPATCH(mixImage, scene, bloom, intensity, out);
+}
+
+void BloomChain::apply(const Image &scene, const Params &params, Image &out, Image *bloom) {
+	u32 levels = getLevelCount(scene.width, scene.height, params.levels);
+	if (!levels) {
+		Image none;
+		none.resize(1, 1);
+		mix(scene, none, 0.f, out, params.useSimd);
+		if (bloom) *bloom = none;
+		return;
+	}
+
+	std::vector<Image> down(levels);
+	prefilter(scene, down[0], params.useSimd);
+	for (u32 i = 1; i < levels; ++i) {
+		downsample(down[i - 1], down[i], params.useSimd);
+	}
+
+	// the lowest level is its own upsample
+	Image up = down[levels - 1];
+	Image temp;
+	for (u32 i = levels - 1; i-- > 0;) {
+		upsample(up, down[i], params.filterRadius, temp, params.useSimd);
+		std::swap(up, temp);
+	}
+
+	mix(scene, up, params.intensity / levels, out, params.useSimd);
+	if (bloom) *bloom = std::move(up);
+}
+
+f32 BloomChain::getChainFetches(u32 width, u32 height, u32 levels) {
+	levels = getLevelCount(width, height, levels);
+	f64 fetches = 2.0 * width * height; // mix
+	for (u32 i = 0; i < levels; ++i) {
+		u32 levelWidth, levelHeight;
+		getLevelSize(width, height, i, levelWidth, levelHeight);
+		f64 pixels = (f64)levelWidth * levelHeight;
+		// prefilter or downsample, then the upsample of all but the lowest
+		fetches += pixels * (i == 0 ? 4.0 : 13.0);
+		if (i + 1 < levels) fetches += pixels * 10.0;
+	}
+	return (f32)(fetches / ((f64)width * height));
+}
+
+f32 BloomChain::getSeparableFetches(u32 blurFetches) {
+	// threshold, horizontal and vertical blur, mix
+	return 1.f + blurFetches * 2.f + 2.f;
+}
+
+void BloomChain::makeTestScene(u32 width, u32 height, Image &scene) {
+	scene.resize(width, height);
+	for (u32 y = 0; y < height; ++y) {
+		for (u32 x = 0; x < width; ++x) {
+			f32 t = (f32)y / max(height - 1, 1u);
+			scene.at(x, y) = vec4f(0.1f + 0.2f * t, 0.2f + 0.2f * t, 0.4f, 1.f);
+		}
+	}
+
+	// the monolith, in the middle so the scene is symmetric
+	u32 halfW = max(width / 16, 1u);
+	u32 halfH = max(height / 5, 1u);
+	for (u32 y = height / 2 - min(halfH, height / 2); y < height / 2 + halfH && y < height; ++y) {
+		for (u32 x = width / 2 - min(halfW, width / 2); x < width / 2 + halfW && x < width; ++x) {
+			scene.at(x, y) = vec4f(0.9f, 0.8f, 1.f, 200.f);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+#include "PostProcess.h"
+
+/* The bloom as a chain of downsamples and upsamples, the reference the
+ * bloom shaders are checked against.
+ * The bright pixels (alpha over 1.5, the monolith) are averaged 2x2 to a
+ * texture of half the screen (prefilter), then every level is half of the
+ * one before, downsampled with 13 bilinear taps (4 boxes of 2x2 and one in
+ * the middle, so it doesn't flicker when something moves by a pixel).
+ * On the way back up every level is its downsample plus the level under
+ * it filtered with a 3x3 tent, the top level ends up with the sum of the
+ * blurs of every level, and it's mixed with the scene divided by the
+ * number of levels. A level is a quarter of the pixels of the one above, so
+ * the radius doubles with each one for almost nothing.
+ * The images are float4 like the render textures, the samples are bilinear
+ * and clamped like the linear clamp sampler of the shaders, with the
+ * centre of a texel at + 0.5. The pixels are done with SSE when it's
+ * there, one pixel in a register, Params::useSimd picks the scalar path to
+ * check it against.
+ */
+class BloomChain {
+public:
+	static constexpr u32 MAX_LEVELS = 6;
+	// levels smaller than this in width or height are left out
+	static constexpr u32 MIN_LEVEL_SIZE = 4;
+	static constexpr f32 THRESHOLD = 1.5f;
+
+	using Image = PostImage;
+
+	struct Params {
+		u32 levels = MAX_LEVELS;
+		f32 filterRadius = 1.f; // of the tent, in texels of the level under
+		f32 intensity = 1.f;
+		bool useSimd = true;
+	};
+
+	// Levels of the chain for a screen, at most maxLevels
+	static u32 getLevelCount(u32 width, u32 height, u32 maxLevels);
+	// Size of a level, 0 is half the screen
+	static void getLevelSize(u32 width, u32 height, u32 level, u32 &levelWidth, u32 &levelHeight);
+
+	// Bilinear sample at uv, clamped to the edges
+	static vec4f sample(const Image &image, f32 u, f32 v);
+
+	// What bloom_prefilter_ps does: average of the 2x2 texels over the threshold
+	static void prefilter(const Image &scene, Image &out, bool useSimd = true);
+	// What bloom_down_ps does: 13 taps of src to an image of half its size
+	static void downsample(const Image &src, Image &out, bool useSimd = true);
+	// What bloom_up_ps does: down plus the tent of the level under it
+	static void upsample(const Image &lower, const Image &down, f32 radius, Image &out, bool useSimd = true);
+	// What mix_ps does: the scene plus the bloom scaled, saturated
+	static void mix(const Image &scene, const Image &bloom, f32 intensity, Image &out, bool useSimd = true);
+	// The whole chain, bloom is the top level after the upsamples (optional)
+	static void apply(const Image &scene, const Params &params, Image &out, Image *bloom = nullptr);
+
+	// Fetches per screen pixel of the chain, and of the separable blur
+	// with blurFetches in each direction
+	static f32 getChainFetches(u32 width, u32 height, u32 levels);
+	static f32 getSeparableFetches(u32 blurFetches);
+
+	// A dark gradient with a bright rectangle, like the monolith in front of the sky
+	// (PostProcess::writePfm() writes it, or the bloom, as a golden image)
+	static void makeTestScene(u32 width, u32 height, Image &scene);
+};
@@ -0,0 +1,193 @@
+#include "BytecodeCache.h"
+
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#define VC_EXTRALEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "JobSystem.h"
+#include "tracelog.h"
+
+// == BYTECODE ====================================================================================================================
+
+Bytecode::~Bytecode() {
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+// == BYTECODE CACHE ==============================================================================================================
+
+BytecodeCache::Handle BytecodeCache::load(const std::string &path) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byPath.find(path);
+		if (it != byPath.end()) {
+			stats.hits++;
+			return it->second;
+		}
+	}
+
+	// mapped outside the lock, so the prefetch jobs don't wait on each other
+	Handle bytecode = mapFile(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.misses++;
+	if (!bytecode) return nullptr;
+
+	// another thread could have loaded it in the meantime
+	auto it = byPath.find(path);
+	if (it != byPath.end()) return it->second;
+
+	auto same = byHash.find(bytecode->hash);
+	if (same != byHash.end() && same->second->size == bytecode->size && memcmp(same->second->data, bytecode->data, bytecode->size) == 0) {
+		// this mapping is dropped when bytecode goes out of scope
+		stats.duplicates++;
+		bytecode = same->second;
+	}
+	else {
+		byHash[bytecode->hash] = bytecode;
+		stats.unique++;
+		stats.bytes += bytecode->size;
+	}
+
+	byPath[path] = bytecode;
+	stats.files++;
+	return bytecode;
+}
+
+u32 BytecodeCache::prefetch(const std::string &directory, const char *extension, JobSystem *jobs) {
+	std::vector<std::string> paths;
+	size_t extLen = strlen(extension);
+	auto matches = [extension, extLen](const char *name) {
+		size_t len = strlen(name);
+		return len > extLen && strcmp(name + len - extLen, extension) == 0;
+	};
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && matches(data.cFileName)) {
+				paths.push_back(directory + "/" + data.cFileName);
+			}
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	if (DIR *dir = opendir(directory.c_str())) {
+		while (dirent *entry = readdir(dir)) {
+			if (matches(entry->d_name)) {
+				paths.push_back(directory + "/" + entry->d_name);
+			}
+		}
+		closedir(dir);
+	}
+#endif
+
+	std::vector<u8> loaded(paths.size());
+	auto loadRange = [&](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			loaded[i] = load(paths[i]) != nullptr;
+		}
+	};
+
+	if (jobs) jobs->parallelFor(0, (u32)paths.size(), 1, loadRange);
+	else      loadRange(0, (u32)paths.size());
+
+	u32 count = 0;
+	for (u8 ok : loaded) count += ok;
+	return count;
+}
+
+void BytecodeCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	byPath.clear();
+	byHash.clear();
+	stats = Stats();
+}
+
+BytecodeCache::Stats BytecodeCache::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+u64 BytecodeCache::hash(const void *data, size_t size) {
+	const u8 *bytes = (const u8 *)data;
+	u64 h = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= bytes[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+BytecodeCache::Handle BytecodeCache::mapFile(const std::string &path) {
+	std::shared_ptr<Bytecode> bytecode = std::make_shared<Bytecode>();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		err("Couldn't open shader file %s", path.c_str());
+		return nullptr;
+	}
+
+	LARGE_INTEGER size{};
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	// the mapping keeps the file open
+	CloseHandle(file);
+
+	const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		if (mapping) CloseHandle(mapping);
+		err("Couldn't map shader file %s", path.c_str());
+		return nullptr;
+	}
+
+	bytecode->data = (const u8 *)view;
+	bytecode->size = (size_t)size.QuadPart;
+	bytecode->mapping = mapping;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		err("Couldn't open shader file %s", path.c_str());
+		return nullptr;
+	}
+
+	struct stat info;
+	void *view = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	// the mapping keeps the file open
+	close(fd);
+
+	if (view == MAP_FAILED) {
+		err("Couldn't map shader file %s", path.c_str());
+		return nullptr;
+	}
+
+	bytecode->data = (const u8 *)view;
+	bytecode->size = (size_t)info.st_size;
+#endif
+
+	bytecode->hash = hash(bytecode->data, bytecode->size);
+	return bytecode;
+}
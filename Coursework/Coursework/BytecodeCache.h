@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "types.h"
+
+class JobSystem;
+
+// A compiled shader file mapped in memory, unmapped when the last handle goes
+struct Bytecode {
+	const u8 *data = nullptr;
+	size_t size = 0;
+	u64 hash = 0;
+
+	Bytecode() = default;
+	~Bytecode();
+	Bytecode(const Bytecode &) = delete;
+	Bytecode &operator=(const Bytecode &) = delete;
+
+private:
+	friend class BytecodeCache;
+	void *mapping = nullptr; // platform handle of the mapping
+};
+
+/* Maps every bytecode file once and keeps it mapped.
+ * Files are identified by their path and by the hash of their content:
+ * two paths with the same bytecode (e.g. a shader compiled twice with the
+ * same options) share the same mapping, so the shader objects built from
+ * it can be shared too.
+ * It doesn't use the device, so it can be used from any thread.
+ */
+class BytecodeCache {
+public:
+	using Handle = std::shared_ptr<const Bytecode>;
+
+	struct Stats {
+		u32 files = 0;      // paths loaded
+		u32 unique = 0;     // different contents
+		u32 duplicates = 0; // paths that ended up sharing an existing mapping
+		u32 hits = 0;
+		u32 misses = 0;     // includes the failed loads
+		size_t bytes = 0;   // mapped
+	};
+
+	// Returns nullptr if the file can't be mapped
+	Handle load(const std::string &path);
+	// Loads every file in directory ending with extension, split across the
+	// jobs if there are any. Returns how many were loaded
+	u32 prefetch(const std::string &directory, const char *extension, JobSystem *jobs);
+	// The handles that are still around keep their mapping
+	void clear();
+
+	Stats getStats();
+
+	// 64 bit FNV-1a
+	static u64 hash(const void *data, size_t size);
+
+private:
+	static Handle mapFile(const std::string &path);
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Handle> byPath;
+	std::unordered_map<u64, Handle> byHash;
+	Stats stats;
+};
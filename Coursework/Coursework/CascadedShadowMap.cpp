@@ -0,0 +1,69 @@
+#include "CascadedShadowMap.h"
+
+#include "utility.h"
+#include "StateCache.h"
+
+void CascadedShadowMap::init(Device *device, int mapSize) {
+	size = mapSize;
+
+	D3D11_TEXTURE2D_DESC texDesc{};
+	texDesc.Width = size;
+	texDesc.Height = size;
+	texDesc.ArraySize = CASCADED_SIZE;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+	texDesc.MipLevels = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	device->CreateTexture2D(&texDesc, 0, &texture);
+	assert(texture);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = texDesc.MipLevels;
+	srvDesc.Texture2DArray.ArraySize = CASCADED_SIZE;
+	device->CreateShaderResourceView(texture, &srvDesc, &textureArray);
+
+	// one view for every slice, the cascades are rendered one at a time
+	for (u32 i = 0; i < CASCADED_SIZE; ++i) {
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc{};
+		dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		device->CreateDepthStencilView(texture, &dsvDesc, &sliceDSV[i]);
+	}
+
+	viewport.Width    = (f32)size;
+	viewport.Height   = (f32)size;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+	for (u32 i = 0; i < CASCADED_SIZE; ++i) {
+		RELEASE_IF_NOT_NULL(sliceDSV[i]);
+	}
+	RELEASE_IF_NOT_NULL(textureArray);
+	RELEASE_IF_NOT_NULL(renderTarget);
+	RELEASE_IF_NOT_NULL(texture);
+}
+
+void CascadedShadowMap::bind(DeviceContext *ctx, u32 cascade) {
+	stateCache.unbindShaderResources();
+	ctx->RSSetViewports(1, &viewport);
+	ctx->OMSetRenderTargets(1, &renderTarget, sliceDSV[cascade]);
+	ctx->ClearDepthStencilView(sliceDSV[cascade], D3D11_CLEAR_DEPTH, 1.f, 0);
+}
+
+mat4 CascadedShadowMap::getViewMatrix(u32 cascade) const {
+	return XMMATRIX(cascades.getCascade(cascade).view);
+}
+
+mat4 CascadedShadowMap::getProjectionMatrix(u32 cascade) const {
+	return XMMATRIX(cascades.getCascade(cascade).proj);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+#include "ShadowCascades.h"
+
+// matches CASCADED_SIZE in utils.hlsli
+constexpr u32 CASCADED_SIZE = 3;
+static_assert(CASCADED_SIZE <= ShadowCascades::MAX_CASCADES, "more cascades than ShadowCascades can fit");
+
+/* Shadow map of the directional light, split in cascades (see
+ * ShadowCascades). Every cascade is a slice of a texture array, they
+ * are rendered one at a time with their own depth view and sampled
+ * together in the pixel shader, which picks the slice from the view
+ * depth of the pixel.
+ * The cascades of the frame are copied here before the passes, so the
+ * shaders can upload their matrices.
+ */
+class CascadedShadowMap {
+public:
+	void init(Device *device, int size);
+	~CascadedShadowMap();
+
+	// Binds the depth of a cascade as the render target and clears it
+	void bind(DeviceContext *ctx, u32 cascade);
+	TextureType *getTextureArray() { return textureArray; }
+	int getSize() const { return size; }
+
+	void setCascades(const ShadowCascades &newCascades) { cascades = newCascades; }
+	const ShadowCascades &getCascades() const { return cascades; }
+	mat4 getViewMatrix(u32 cascade) const;
+	mat4 getProjectionMatrix(u32 cascade) const;
+
+private:
+	ID3D11Texture2D *texture = nullptr;
+	TextureType *textureArray = nullptr;
+	ID3D11DepthStencilView *sliceDSV[CASCADED_SIZE] = {};
+	ID3D11RenderTargetView *renderTarget = nullptr;
+	D3D11_VIEWPORT viewport;
+	int size = 0;
+	ShadowCascades cascades;
+};
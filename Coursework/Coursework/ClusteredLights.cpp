@@ -0,0 +1,76 @@
+#include "ClusteredLights.h"
+
+#include "utility.h"
+#include "StateCache.h"
+
+static void createStructuredBuffer(Device *device, u32 stride, u32 count, ID3D11Buffer **buffer, ID3D11ShaderResourceView **view) {
+	D3D11_BUFFER_DESC bufDesc{};
+	bufDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufDesc.ByteWidth = stride * count;
+	bufDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufDesc.StructureByteStride = stride;
+	device->CreateBuffer(&bufDesc, nullptr, buffer);
+	assert(*buffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(*buffer, &srvDesc, view);
+}
+
+static void writeBuffer(RenderBackend *backend, ID3D11Buffer *buffer, const void *data, u32 size) {
+	if (!size) return;
+	void *dst = backend->mapBuffer(buffer, 0, size, MapMode::Discard);
+	if (dst) memcpy(dst, data, size);
+	backend->unmapBuffer(buffer);
+}
+
+void ClusteredLights::init(Device *device) {
+	createStructuredBuffer(device, sizeof(LightType), LightClusters::MAX_LIGHTS, &lightBuffer, &lightView);
+	createStructuredBuffer(device, sizeof(LightClusters::Cluster), LightClusters::CLUSTER_COUNT, &rangeBuffer, &rangeView);
+	createStructuredBuffer(device, sizeof(u32), LightClusters::MAX_INDICES, &indexBuffer, &indexView);
+}
+
+ClusteredLights::~ClusteredLights() {
+	RELEASE_IF_NOT_NULL(lightView);
+	RELEASE_IF_NOT_NULL(rangeView);
+	RELEASE_IF_NOT_NULL(indexView);
+	RELEASE_IF_NOT_NULL(lightBuffer);
+	RELEASE_IF_NOT_NULL(rangeBuffer);
+	RELEASE_IF_NOT_NULL(indexBuffer);
+}
+
+void ClusteredLights::upload(const mat4 &cameraViewProj, const LightClusters *lightClusters, const std::vector<LightClusters::Light> &lights) {
+	viewProj = cameraViewProj;
+	clusters = lightClusters;
+	lightCount = clusters && lightBuffer ? min((u32)lights.size(), LightClusters::MAX_LIGHTS) : 0;
+
+	// the shader doesn't read the buffers without lights
+	if (!lightCount) return;
+
+	RenderBackend *backend = stateCache.getBackend();
+	LightType *lightPtr = (LightType *)backend->mapBuffer(lightBuffer, 0, lightCount * sizeof(LightType), MapMode::Discard);
+	for (u32 i = 0; lightPtr && i < lightCount; ++i) {
+		const LightClusters::Light &light = lights[i];
+		lightPtr[i].position = light.position;
+		lightPtr[i].range = light.range;
+		lightPtr[i].color = light.color;
+		lightPtr[i].cosAngle = light.type == LightClusters::Type::Spot ? light.cosAngle : -2.f;
+		lightPtr[i].direction = light.direction.normalized();
+	}
+	backend->unmapBuffer(lightBuffer);
+
+	const std::vector<LightClusters::Cluster> &ranges = clusters->getClusters();
+	writeBuffer(backend, rangeBuffer, ranges.data(), (u32)(ranges.size() * sizeof(LightClusters::Cluster)));
+	const std::vector<u32> &indices = clusters->getIndices();
+	writeBuffer(backend, indexBuffer, indices.data(), (u32)(indices.size() * sizeof(u32)));
+}
+
+void ClusteredLights::bind() {
+	ID3D11ShaderResourceView *views[] = { lightView, rangeView, indexView };
+	stateCache.setShaderResources(ShaderStage::Pixel, 5, ARR_LEN(views), views);
+}
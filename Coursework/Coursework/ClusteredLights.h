@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "DXF.h"
+#include "types.h"
+#include "LightClusters.h"
+
+/* The gpu side of LightClusters: the lights, the range of every cluster
+ * and the index list are uploaded to structured buffers once a frame and
+ * read by getClusteredLighting() in utils.hlsli.
+ * The buffers are sized for the limits of LightClusters, so they are
+ * created once and only mapped after that. The constants the pixel shader
+ * needs to find its cluster are uploaded by DefaultShader with the other
+ * frame buffers.
+ */
+class ClusteredLights {
+public:
+	// matches ClusterLight in utils.hlsli
+	struct LightType {
+		float3 position;
+		float range;
+		float3 color;
+		float cosAngle; // -2 for point lights, every direction is inside the cone
+		float3 direction;
+		float padding = 0.f;
+	};
+
+	~ClusteredLights();
+	void init(Device *device);
+
+	// Uploads the lights binned by clusters through the state cache's backend,
+	// without clusters nothing is lit
+	void upload(const mat4 &viewProj, const LightClusters *clusters, const std::vector<LightClusters::Light> &lights);
+	// Binds the lights, ranges and indices to t5-t7 of the pixel shader
+	void bind();
+
+	const mat4 &getViewProj() const { return viewProj; }
+	const LightClusters *getClusters() const { return clusters; }
+	u32 getLightCount() const { return lightCount; }
+
+private:
+	ID3D11Buffer *lightBuffer = nullptr;
+	ID3D11Buffer *rangeBuffer = nullptr;
+	ID3D11Buffer *indexBuffer = nullptr;
+	ID3D11ShaderResourceView *lightView = nullptr;
+	ID3D11ShaderResourceView *rangeView = nullptr;
+	ID3D11ShaderResourceView *indexView = nullptr;
+
+	mat4 viewProj;
+	const LightClusters *clusters = nullptr;
+	u32 lightCount = 0;
+};
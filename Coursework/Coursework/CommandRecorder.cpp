@@ -0,0 +1,139 @@
+#include "CommandRecorder.h"
+
+#include <chrono>
+
+#include "StateCache.h"
+#include "ConstantAllocator.h"
+#include "tracelog.h"
+
+// == RECORDING COMMAND LISTS =====================================================================================================
+
+void RecordingCommandLists::prepare(u32 count) {
+	while (lists.size() < count) {
+		lists.emplace_back(new RecordingBackend());
+	}
+}
+
+RenderBackend *RecordingCommandLists::beginList(u32 index) {
+	lists[index]->clear();
+	return lists[index].get();
+}
+
+void RecordingCommandLists::executeList(u32 index, RenderBackend &immediate) {
+	lists[index]->replay(immediate);
+}
+
+// == COMMAND RECORDER ============================================================================================================
+
+CommandRecorder::~CommandRecorder() {
+	cleanup();
+}
+
+void CommandRecorder::init(CommandListBackend *lists, JobSystem *jobSystem) {
+	cleanup();
+	backend = lists;
+	jobs = jobSystem;
+}
+
+void CommandRecorder::cleanup() {
+	reset();
+	backend = nullptr;
+	jobs = nullptr;
+}
+
+u32 CommandRecorder::add(const char *name, Record record) {
+	if (recorded) {
+		warn("Command list %s added after recording, the recorded lists are dropped", name);
+		reset();
+	}
+
+	lists.push_back({ name, std::move(record) });
+	return (u32)lists.size() - 1;
+}
+
+void CommandRecorder::record() {
+	using namespace std::chrono;
+
+	if (recorded) return;
+	stats = Stats();
+	stats.lists = (u32)lists.size();
+	if (lists.empty()) return;
+
+	if (!backend || !jobs) {
+		err("Command recorder used before init");
+		lists.clear();
+		return;
+	}
+
+	auto start = high_resolution_clock::now();
+
+	backend->prepare((u32)lists.size());
+	// one list per job, so a long list doesn't hold the others back
+	jobs->parallelFor(0, (u32)lists.size(), 1, [this](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			recordList(i);
+		}
+	});
+	recorded = true;
+
+	stats.recordMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+}
+
+void CommandRecorder::execute(u32 index, RenderBackend &immediate) {
+	using namespace std::chrono;
+
+	if (!recorded || index >= (u32)lists.size()) {
+		err("Executing command list %u before recording it", index);
+		return;
+	}
+
+	auto start = high_resolution_clock::now();
+
+	backend->executeList(index, immediate);
+	// the list changed the state behind the cache's back
+	stateCache.invalidate();
+
+	stats.executeMs += duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+}
+
+void CommandRecorder::execute(RenderBackend &immediate) {
+	record();
+	if (!recorded) return;
+
+	for (u32 i = 0; i < (u32)lists.size(); ++i) {
+		execute(i, immediate);
+	}
+
+	reset();
+}
+
+void CommandRecorder::reset() {
+	lists.clear();
+	recorded = false;
+}
+
+void CommandRecorder::recordList(u32 index) {
+	List &list = lists[index];
+	RenderBackend *target = backend->beginList(index);
+	if (!target) {
+		warn("Command list %s has nowhere to record, skipping it", list.name.c_str());
+		return;
+	}
+
+	// on the main thread they belong to the immediate context, they are given back after the list
+	RenderBackend *previousBackend = stateCache.getBackend();
+	ConstantAllocator previousAllocator = std::move(constantAllocator);
+	constantAllocator = ConstantAllocator();
+
+	// a new list starts with nothing bound and no constant buffer uploaded
+	stateCache.setBackend(target);
+	constantAllocator.init(&stateCache, 0);
+
+	target->marker(list.name.c_str());
+	if (list.record) list.record();
+
+	constantAllocator.cleanup();
+	constantAllocator = std::move(previousAllocator);
+	stateCache.setBackend(previousBackend);
+	backend->endList(index);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "RenderBackend.h"
+#include "JobSystem.h"
+
+/* Where the command lists are recorded and how they are executed.
+ * beginList() and endList() are called on the thread recording the list,
+ * with a different index on every thread. executeList() is called on the
+ * main thread.
+ */
+class CommandListBackend {
+public:
+	virtual ~CommandListBackend() = default;
+
+	// Called on the main thread before recording count lists
+	virtual void prepare(u32 count) = 0;
+	// Returns nullptr if the list can't be recorded
+	virtual RenderBackend *beginList(u32 index) = 0;
+	virtual void endList(u32 index) = 0;
+	virtual void executeList(u32 index, RenderBackend &immediate) = 0;
+};
+
+// Records every list in a RecordingBackend and replays it, works without a gpu
+class RecordingCommandLists : public CommandListBackend {
+public:
+	void prepare(u32 count) override;
+	RenderBackend *beginList(u32 index) override;
+	void endList(u32) override {}
+	void executeList(u32 index, RenderBackend &immediate) override;
+
+	const RecordingBackend &getList(u32 index) const { return *lists[index]; }
+
+private:
+	std::vector<std::unique_ptr<RecordingBackend>> lists;
+};
+
+/* Records the draws of a frame as jobs, one command list for every
+ * function added, then executes the lists on the immediate backend.
+ * While a list is being recorded the thread's stateCache and
+ * constantAllocator (they are thread_local) are bound to it, so the
+ * shaders' render functions can be used as they are. The main thread
+ * records lists too while it waits, its own cache and allocator are put
+ * aside and given back after every list.
+ * Everything else the lists touch must not be shared with another list:
+ * two lists can't change the same object, and they can't use the
+ * immediate context.
+ * After executing a list the state of the immediate context is unknown,
+ * the main thread's stateCache is invalidated.
+ */
+class CommandRecorder {
+public:
+	using Record = std::function<void()>;
+
+	struct Stats {
+		u32 lists = 0;
+		f64 recordMs = 0.0;  // from the first list starting to the last one ending
+		f64 executeMs = 0.0;
+	};
+
+	~CommandRecorder();
+
+	// lists and jobs must outlive the recorder
+	void init(CommandListBackend *lists, JobSystem *jobs = &jobSystem);
+	void cleanup();
+
+	// Returns the index of the list, to execute it
+	u32 add(const char *name, Record record);
+	// Records all the lists that were added, in parallel, and waits for them
+	void record();
+	// Executes a recorded list, the lists can be executed between other work on the main thread
+	void execute(u32 index, RenderBackend &immediate);
+	// Records the lists if needed, executes them in the order they were added and removes them
+	void execute(RenderBackend &immediate);
+	// Removes the lists, the ones that weren't executed are dropped
+	void reset();
+
+	u32 getListCount() const { return (u32)lists.size(); }
+	bool isRecorded() const { return recorded; }
+	const Stats &getStats() const { return stats; }
+
+private:
+	struct List {
+		std::string name;
+		Record record;
+	};
+
+	void recordList(u32 index);
+
+	CommandListBackend *backend = nullptr;
+	JobSystem *jobs = nullptr;
+	std::vector<List> lists;
+	bool recorded = false;
+
+	Stats stats;
+};
@@ -0,0 +1,200 @@
+#include "ConstantAllocator.h"
+
+#include <string.h>
+
+#include "tracelog.h"
+
+thread_local ConstantAllocator constantAllocator;
+
+// FNV-1a on 8 bytes at a time, constant buffers are always a multiple of 16 bytes
+static u64 hashBytes(const u8 *bytes, size_t size) {
+	u64 hash = 14695981039346656037ull;
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8) {
+		u64 word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+
+	for (; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static u32 alignRange(u32 size) {
+	return (size + ConstantAllocator::RANGE_ALIGNMENT - 1) & ~(ConstantAllocator::RANGE_ALIGNMENT - 1);
+}
+
+void ConstantAllocator::init(StateCache *stateCache, u32 size) {
+	cleanup();
+	cache = stateCache;
+
+	if (!size) {
+		return;
+	}
+
+	if (cache->getBackend()->supportsConstantRanges()) {
+		createRing(size);
+	}
+	else {
+		info("Constant buffer ranges not supported, every block uses its own buffer");
+	}
+}
+
+void ConstantAllocator::cleanup() {
+	if (ring) {
+		cache->getBackend()->releaseBuffer(ring);
+		ring = nullptr;
+	}
+
+	ringSize = 0;
+	ringHead = 0;
+	ringRanges.clear();
+	blocks.clear();
+	mapped = nullptr;
+}
+
+void ConstantAllocator::beginFrame() {
+	frame++;
+	lastFrame = counters;
+	counters = Counters();
+
+	// the ring wasn't big enough last frame
+	if (ring && ringOverflowed) {
+		u32 newSize = ringSize * 2;
+		info("Constant ring is full, growing it to %u bytes", newSize);
+		cache->getBackend()->releaseBuffer(ring);
+		createRing(newSize);
+		// the new ring could have the same address as the old one
+		cache->invalidate();
+	}
+
+	ringHead = 0;
+	ringOverflowed = false;
+	ringRanges.clear();
+}
+
+void ConstantAllocator::addBlock(ID3D11Buffer *buffer, u32 size, ConstantUsage usage) {
+	Block &block = blocks[buffer];
+	block = Block();
+	block.content.resize(size);
+	block.usage = usage;
+}
+
+void *ConstantAllocator::map(ID3D11Buffer *buffer, u32 size) {
+	if (mapped) {
+		warn("Constant buffer mapped while another one is still mapped");
+	}
+
+	// buffers that weren't added are treated as draw blocks
+	Block &block = blocks[buffer];
+	if (block.content.size() < size) {
+		block.content.resize(size);
+	}
+
+	mapped = &block;
+	return block.content.data();
+}
+
+void ConstantAllocator::unmap(ID3D11Buffer *buffer, ShaderStage stage, u32 slot) {
+	auto it = blocks.find(buffer);
+	if (it == blocks.end() || &it->second != mapped) {
+		warn("Unmapping a constant buffer that wasn't mapped");
+		return;
+	}
+
+	Block &block = it->second;
+	mapped = nullptr;
+
+	u64 hash = hashBytes(block.content.data(), block.content.size());
+
+	if (block.usage == ConstantUsage::Frame && ring) {
+		RingRange range;
+		if (uploadRing(block, hash, range)) {
+			cache->setConstantBufferRange(stage, slot, ring, range.firstConstant, range.numConstants);
+			return;
+		}
+	}
+
+	if (block.uploaded && block.hash == hash) {
+		counters.skipped++;
+	}
+	else {
+		uploadBlock(buffer, block, hash);
+	}
+
+	cache->setConstantBuffers(stage, slot, 1, &buffer);
+}
+
+void ConstantAllocator::uploadBlock(ID3D11Buffer *buffer, Block &block, u64 hash) {
+	RenderBackend *backend = cache->getBackend();
+	u32 size = (u32)block.content.size();
+
+	void *dst = backend->mapBuffer(buffer, 0, size, MapMode::Discard);
+	if (!dst) return;
+	memcpy(dst, block.content.data(), size);
+	backend->unmapBuffer(buffer);
+
+	block.hash = hash;
+	block.uploaded = true;
+	counters.uploads++;
+	counters.bytesUploaded += size;
+}
+
+bool ConstantAllocator::uploadRing(const Block &block, u64 hash, RingRange &range) {
+	u32 size = (u32)block.content.size();
+
+	// same content as a block written this frame
+	auto it = ringRanges.find(hash);
+	if (it != ringRanges.end() &&
+		it->second.numConstants * 16 >= size &&
+		memcmp(&ringCopy[it->second.firstConstant * 16], block.content.data(), size) == 0
+	) {
+		range = it->second;
+		counters.ringReuses++;
+		return true;
+	}
+
+	u32 alignedSize = alignRange(size);
+	if (ringHead + alignedSize > ringSize) {
+		// discarding the ring would lose the blocks bound earlier this frame
+		if (!ringOverflowed) warn("Constant ring is full (%u bytes)", ringSize);
+		ringOverflowed = true;
+		counters.ringOverflows++;
+		return false;
+	}
+
+	RenderBackend *backend = cache->getBackend();
+	// the first write of the frame renames the buffer, the gpu can still read the old one
+	MapMode mode = ringHead == 0 ? MapMode::Discard : MapMode::NoOverwrite;
+	void *dst = backend->mapBuffer(ring, ringHead, size, mode);
+	if (!dst) return false;
+
+	memcpy(dst, block.content.data(), size);
+	backend->unmapBuffer(ring);
+	memcpy(&ringCopy[ringHead], block.content.data(), size);
+
+	range.firstConstant = ringHead / 16;
+	range.numConstants = alignedSize / 16;
+	ringRanges[hash] = range;
+
+	ringHead += alignedSize;
+	counters.ringWrites++;
+	counters.ringBytes += size;
+	counters.bytesUploaded += size;
+	return true;
+}
+
+void ConstantAllocator::createRing(u32 size) {
+	ringSize = alignRange(size);
+	ring = cache->getBackend()->createBuffer(BufferType::Constant, ringSize, nullptr, true);
+	ringCopy.assign(ringSize, 0);
+
+	if (!ring) {
+		err("Couldn't create the constant ring, every block will use its own buffer");
+		ringSize = 0;
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "StateCache.h"
+
+enum class ConstantUsage : u8 {
+	Draw,  // changes from draw to draw (world matrix, material)
+	Frame, // the same for the whole frame or pass (camera, lights, spot light matrix)
+};
+
+/* Owns the content of the shaders' constant buffers and decides when it
+ * has to be uploaded.
+ * The shaders write into a copy kept on the cpu, on unmap the content is
+ * hashed:
+ * - Draw blocks are uploaded to their own buffer only when the hash is
+ *   different from the last upload
+ * - Frame blocks are copied in a ring buffer shared by every shader, and
+ *   bound as a constant buffer range. A block with the same content as one
+ *   already in the ring this frame reuses it, so the lights are uploaded
+ *   once and not once per shader
+ * The ring is discarded at the start of every frame and then only appended
+ * to. If it fills up the remaining frame blocks fall back to their own
+ * buffer, and the ring is made bigger the next frame.
+ * Without constant buffer ranges (d3d11.0) frame blocks work like draw blocks.
+ * Everything goes through a StateCache and its backend, so it doesn't
+ * need a device.
+ * The allocators of the command list workers don't know the usage of the
+ * blocks and have no ring, they are reset for every list as a deferred
+ * context starts with the content of its dynamic buffers undefined.
+ */
+class ConstantAllocator {
+public:
+	// d3d11.1 binds ranges in multiples of 16 constants
+	static constexpr u32 RANGE_ALIGNMENT = 256;
+
+	struct Counters {
+		u32 uploads = 0;      // draw blocks written to their buffer
+		u32 skipped = 0;      // draw blocks that didn't change
+		u32 ringWrites = 0;   // frame blocks copied in the ring
+		u32 ringReuses = 0;   // frame blocks already in the ring
+		u32 ringBytes = 0;
+		u32 ringOverflows = 0;
+		u64 bytesUploaded = 0;
+	};
+
+	// The ring is created on the backend of cache (if it supports ranges),
+	// with a ringSize of 0 every block uses its own buffer
+	void init(StateCache *cache, u32 ringSize = 64 * 1024);
+	void cleanup();
+
+	// Starts a new ring and resets the counters
+	void beginFrame();
+	u64 getFrame() const { return frame; }
+
+	// Called when a constant buffer is created, forgets any old block with the same pointer
+	void addBlock(ID3D11Buffer *buffer, u32 size, ConstantUsage usage);
+	// Returns the cpu copy of the block, its old content is kept
+	void *map(ID3D11Buffer *buffer, u32 size);
+	// Uploads the block if needed and binds it to slot
+	void unmap(ID3D11Buffer *buffer, ShaderStage stage, u32 slot);
+
+	bool isUsingRing() const { return ring != nullptr; }
+	u32 getRingSize() const { return ringSize; }
+	const Counters &getCounters() const { return counters; }
+	const Counters &getLastFrame() const { return lastFrame; }
+
+private:
+	struct Block {
+		std::vector<u8> content;
+		u64 hash = 0;
+		bool uploaded = false;
+		ConstantUsage usage = ConstantUsage::Draw;
+	};
+
+	struct RingRange {
+		u32 firstConstant;
+		u32 numConstants;
+	};
+
+	void uploadBlock(ID3D11Buffer *buffer, Block &block, u64 hash);
+	// returns false if the ring is full
+	bool uploadRing(const Block &block, u64 hash, RingRange &range);
+	void createRing(u32 size);
+
+	StateCache *cache = nullptr;
+	u64 frame = 0;
+
+	std::unordered_map<ID3D11Buffer *, Block> blocks;
+	Block *mapped = nullptr;
+
+	ID3D11Buffer *ring = nullptr;
+	u32 ringSize = 0;
+	u32 ringHead = 0;
+	bool ringOverflowed = false;
+	// content hash -> range of the ring written this frame
+	std::unordered_map<u64, RingRange> ringRanges;
+	// what was written in the ring, to check that a hash match is the same content
+	std::vector<u8> ringCopy;
+
+	Counters counters;
+	Counters lastFrame;
+};
+
+// Used by every shader, App1 initialises it after the state cache.
+// Every thread has its own, like stateCache
+extern thread_local ConstantAllocator constantAllocator;
@@ -0,0 +1,84 @@
+#include "CubeFaceCuller.h"
+
+#include "MathUtils.h"
+
+static u32 countBits(u32 mask) {
+	u32 count = 0;
+	for (; mask; mask &= mask - 1) count++;
+	return count;
+}
+
+void CubeFaceCuller::begin(const vec3f &position, f32 nearPlane, f32 farPlane) {
+	lightPos = position;
+	nearZ = nearPlane;
+	farZ = farPlane;
+	stats = Stats();
+}
+
+u32 CubeFaceCuller::cull(const vec3f &bmin, const vec3f &bmax) {
+	u32 mask = getFaceMask(bmin, bmax);
+	u32 faces = countBits(mask);
+
+	stats.tested++;
+	stats.faces += faces;
+	if (faces == 0) stats.culled++;
+	if (faces == 1) stats.singleFace++;
+	return mask;
+}
+
+u32 CubeFaceCuller::getFaceMask(const vec3f &bmin, const vec3f &bmax) const {
+	vec3f lo = bmin - lightPos;
+	vec3f hi = bmax - lightPos;
+	const f32 low[3]  = { lo.x, lo.y, lo.z };
+	const f32 high[3] = { hi.x, hi.y, hi.z };
+
+	u32 mask = 0;
+	for (u32 face = 0; face < FACES; ++face) {
+		u32 axis = face / 2;
+		u32 b = (axis + 1) % 3;
+		u32 c = (axis + 2) % 3;
+
+		// distance along the face's axis, positive in front of the face
+		f32 nearest  = face & 1 ? -high[axis] : low[axis];
+		f32 farthest = face & 1 ? -low[axis] : high[axis];
+
+		if (farthest < nearZ || nearest > farZ) continue;
+
+		// inside the four planes of the pyramid: depth >= |b| and depth >= |c|,
+		// it is enough for one corner of the box to be in front of each plane
+		if (farthest - low[b] < 0.f || farthest + high[b] < 0.f) continue;
+		if (farthest - low[c] < 0.f || farthest + high[c] < 0.f) continue;
+
+		mask |= 1 << face;
+	}
+	return mask;
+}
+
+u32 CubeFaceCuller::getFaceMaskReference(const vec3f &bmin, const vec3f &bmax, u32 samples) const {
+	samples = max(samples, 2u);
+
+	u32 mask = 0;
+	for (u32 z = 0; z < samples; ++z) {
+		for (u32 y = 0; y < samples; ++y) {
+			for (u32 x = 0; x < samples; ++x) {
+				vec3f t = vec3f((f32)x, (f32)y, (f32)z) / (f32)(samples - 1);
+				vec3f p = vec3f(
+					bmin.x + (bmax.x - bmin.x) * t.x,
+					bmin.y + (bmax.y - bmin.y) * t.y,
+					bmin.z + (bmax.z - bmin.z) * t.z
+				) - lightPos;
+
+				const f32 coords[3] = { p.x, p.y, p.z };
+				u32 axis = 0;
+				for (u32 i = 1; i < 3; ++i) {
+					if (fabsf(coords[i]) > fabsf(coords[axis])) axis = i;
+				}
+
+				f32 depth = fabsf(coords[axis]);
+				if (depth < nearZ || depth > farZ) continue;
+				mask |= 1 << (axis * 2 + (coords[axis] < 0.f ? 1 : 0));
+			}
+		}
+	}
+	return mask;
+}
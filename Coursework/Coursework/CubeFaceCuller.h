@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+#include "vec.h"
+
+/* Finds which faces of a cube shadow map an object is drawn in.
+ * The omni-directional shadow map renders every triangle to the six
+ * faces in the geometry shader, an object that only covers one face
+ * still outputs six triangles for every one it has. Every face is a 90
+ * degrees frustum around the light, the culler tests the bounding box
+ * of an object against them and returns a mask with a bit for every
+ * face it touches, the geometry shader then skips the others.
+ * Faces are in the order of the cube map: +x, -x, +y, -y, +z, -z.
+ * The test only uses the planes of the frusta, so a box next to an edge
+ * can get a face it doesn't touch, but never misses one.
+ */
+class CubeFaceCuller {
+public:
+	static constexpr u32 FACES = 6;
+	static constexpr u32 ALL_FACES = (1 << FACES) - 1;
+	// every possible mask, 0 is an object that isn't in any face
+	static constexpr u32 MASKS = 1 << FACES;
+
+	struct Stats {
+		u32 tested = 0;
+		u32 culled = 0;     // in no face at all
+		u32 singleFace = 0;
+		u32 faces = 0;      // faces drawn, out of tested * FACES
+	};
+
+	// Starts a new frame with the light's position and the range of its projection, resets the stats
+	void begin(const vec3f &lightPos, f32 nearZ, f32 farZ);
+
+	// Mask of the faces a world space axis aligned box is in, and counts it
+	u32 cull(const vec3f &bmin, const vec3f &bmax);
+	// The same without counting
+	u32 getFaceMask(const vec3f &bmin, const vec3f &bmax) const;
+	// Brute force version of getFaceMask: samples points inside the box
+	// and puts each one in the face of its major axis
+	u32 getFaceMaskReference(const vec3f &bmin, const vec3f &bmax, u32 samples) const;
+
+	const Stats &getStats() const { return stats; }
+
+private:
+	vec3f lightPos;
+	f32 nearZ = 1.f;
+	f32 farZ = 200.f;
+	Stats stats;
+};
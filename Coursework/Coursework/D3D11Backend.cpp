@@ -0,0 +1,258 @@
+#include "D3D11Backend.h"
+
+#include <string.h>
+#include <d3d11_1.h>
+
+#include "utility.h"
+#include "tracelog.h"
+
+D3D11Backend::~D3D11Backend() {
+	if (ctx1) ctx1->Release();
+}
+
+void D3D11Backend::init(Device *dev, DeviceContext *context) {
+	device = dev;
+	ctx = context;
+
+	if (ctx1) {
+		ctx1->Release();
+		ctx1 = nullptr;
+	}
+
+	// both are needed to sub allocate constant buffers
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting ||
+		!options.MapNoOverwriteOnDynamicConstantBuffer
+	) {
+		info("Constant buffer ranges are not supported");
+		return;
+	}
+
+	if (FAILED(ctx->QueryInterface(__uuidof(ID3D11DeviceContext1), (void **)&ctx1))) {
+		ctx1 = nullptr;
+		info("Couldn't get a d3d11.1 device context, constant buffer ranges are disabled");
+	}
+}
+
+void D3D11Backend::setInputLayout(ID3D11InputLayout *layout) {
+	ctx->IASetInputLayout(layout);
+}
+
+void D3D11Backend::setTopology(u32 topology) {
+	ctx->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)topology);
+}
+
+void D3D11Backend::setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) {
+	ctx->IASetVertexBuffers(start, count, buffers, strides, offsets);
+}
+
+void D3D11Backend::setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) {
+	ctx->IASetIndexBuffer(buffer, (DXGI_FORMAT)format, offset);
+}
+
+void D3D11Backend::setVertexShader(ID3D11VertexShader *shader) {
+	ctx->VSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setHullShader(ID3D11HullShader *shader) {
+	ctx->HSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setDomainShader(ID3D11DomainShader *shader) {
+	ctx->DSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setGeometryShader(ID3D11GeometryShader *shader) {
+	ctx->GSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setPixelShader(ID3D11PixelShader *shader) {
+	ctx->PSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setComputeShader(ID3D11ComputeShader *shader) {
+	ctx->CSSetShader(shader, NULL, 0);
+}
+
+void D3D11Backend::setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) {
+	switch (stage) {
+	case ShaderStage::Vertex:   ctx->VSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStage::Hull:     ctx->HSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStage::Domain:   ctx->DSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStage::Geometry: ctx->GSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStage::Pixel:    ctx->PSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStage::Compute:  ctx->CSSetConstantBuffers(start, count, buffers); break;
+	}
+}
+
+void D3D11Backend::setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) {
+	switch (stage) {
+	case ShaderStage::Vertex:   ctx1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	case ShaderStage::Hull:     ctx1->HSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	case ShaderStage::Domain:   ctx1->DSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	case ShaderStage::Geometry: ctx1->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	case ShaderStage::Pixel:    ctx1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	case ShaderStage::Compute:  ctx1->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &numConstants); break;
+	}
+}
+
+void D3D11Backend::setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) {
+	switch (stage) {
+	case ShaderStage::Vertex:   ctx->VSSetShaderResources(start, count, views); break;
+	case ShaderStage::Hull:     ctx->HSSetShaderResources(start, count, views); break;
+	case ShaderStage::Domain:   ctx->DSSetShaderResources(start, count, views); break;
+	case ShaderStage::Geometry: ctx->GSSetShaderResources(start, count, views); break;
+	case ShaderStage::Pixel:    ctx->PSSetShaderResources(start, count, views); break;
+	case ShaderStage::Compute:  ctx->CSSetShaderResources(start, count, views); break;
+	}
+}
+
+void D3D11Backend::setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers) {
+	switch (stage) {
+	case ShaderStage::Vertex:   ctx->VSSetSamplers(start, count, samplers); break;
+	case ShaderStage::Hull:     ctx->HSSetSamplers(start, count, samplers); break;
+	case ShaderStage::Domain:   ctx->DSSetSamplers(start, count, samplers); break;
+	case ShaderStage::Geometry: ctx->GSSetSamplers(start, count, samplers); break;
+	case ShaderStage::Pixel:    ctx->PSSetSamplers(start, count, samplers); break;
+	case ShaderStage::Compute:  ctx->CSSetSamplers(start, count, samplers); break;
+	}
+}
+
+ID3D11Buffer *D3D11Backend::createBuffer(BufferType type, u32 size, const void *data, bool dynamic) {
+	D3D11_BUFFER_DESC desc{};
+	desc.ByteWidth = size;
+	desc.Usage = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	desc.CPUAccessFlags = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+
+	switch (type) {
+	case BufferType::Vertex:   desc.BindFlags = D3D11_BIND_VERTEX_BUFFER; break;
+	case BufferType::Index:    desc.BindFlags = D3D11_BIND_INDEX_BUFFER; break;
+	case BufferType::Constant: desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; break;
+	}
+
+	D3D11_SUBRESOURCE_DATA initData{};
+	initData.pSysMem = data;
+
+	ID3D11Buffer *buffer = nullptr;
+	if (FAILED(device->CreateBuffer(&desc, data ? &initData : nullptr, &buffer))) {
+		err("Couldn't create a buffer of %u bytes", size);
+		return nullptr;
+	}
+
+	return buffer;
+}
+
+void D3D11Backend::releaseBuffer(ID3D11Buffer *buffer) {
+	if (buffer) buffer->Release();
+}
+
+void *D3D11Backend::mapBuffer(ID3D11Buffer *buffer, u32 offset, u32 size, MapMode mode) {
+	D3D11_MAP type = mode == MapMode::NoOverwrite ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+	D3D11_MAPPED_SUBRESOURCE mapped{};
+	if (FAILED(ctx->Map(buffer, 0, type, 0, &mapped))) {
+		return nullptr;
+	}
+	return (u8 *)mapped.pData + offset;
+}
+
+void D3D11Backend::unmapBuffer(ID3D11Buffer *buffer) {
+	ctx->Unmap(buffer, 0);
+}
+
+void D3D11Backend::updateTexture(ID3D11Texture2D *texture, u32 subresource, const void *data, u32 rowPitch, u32 rows) {
+	ctx->UpdateSubresource(texture, subresource, nullptr, data, rowPitch, 0);
+}
+
+void D3D11Backend::writeTexture(ID3D11Texture2D *texture, const void *data, u32 rowSize, u32 rows) {
+	D3D11_MAPPED_SUBRESOURCE mapped{};
+	if (FAILED(ctx->Map(texture, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+		return;
+	}
+
+	// the row pitch of the mapped texture can be bigger than our rows
+	for (u32 y = 0; y < rows; ++y) {
+		memcpy((u8 *)mapped.pData + y * mapped.RowPitch, (const u8 *)data + y * rowSize, rowSize);
+	}
+
+	ctx->Unmap(texture, 0);
+}
+
+void D3D11Backend::draw(u32 vertexCount, u32 startVertex) {
+	ctx->Draw(vertexCount, startVertex);
+}
+
+void D3D11Backend::drawIndexed(u32 indexCount, u32 startIndex, i32 baseVertex) {
+	ctx->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11Backend::drawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 startIndex, i32 baseVertex) {
+	ctx->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, 0);
+}
+
+// == D3D11 COMMAND LISTS =========================================================================================================
+
+D3D11CommandLists::~D3D11CommandLists() {
+	cleanup();
+}
+
+void D3D11CommandLists::init(Device *dev, D3D11Backend *immediateBackend) {
+	cleanup();
+	device = dev;
+	immediate = immediateBackend;
+
+	D3D11_FEATURE_DATA_THREADING threading{};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading)))) {
+		nativeLists = threading.DriverCommandLists != FALSE;
+	}
+	if (!nativeLists) {
+		info("The driver doesn't support command lists, they will be emulated");
+	}
+}
+
+void D3D11CommandLists::cleanup() {
+	for (Deferred *deferred : contexts) {
+		RELEASE_IF_NOT_NULL(deferred->list);
+		RELEASE_IF_NOT_NULL(deferred->ctx);
+		delete deferred;
+	}
+	contexts.clear();
+}
+
+void D3D11CommandLists::prepare(u32 count) {
+	while (contexts.size() < count) {
+		Deferred *deferred = new Deferred();
+		if (FAILED(device->CreateDeferredContext(0, &deferred->ctx))) {
+			err("Couldn't create deferred context %zu", contexts.size());
+			delete deferred;
+			return;
+		}
+		deferred->backend.init(device, deferred->ctx);
+		contexts.push_back(deferred);
+	}
+}
+
+RenderBackend *D3D11CommandLists::beginList(u32 index) {
+	// if the context couldn't be created the list is dropped
+	if (index >= contexts.size()) return nullptr;
+	return &contexts[index]->backend;
+}
+
+void D3D11CommandLists::endList(u32 index) {
+	if (index >= contexts.size()) return;
+	Deferred *deferred = contexts[index];
+
+	RELEASE_IF_NOT_NULL(deferred->list);
+	if (FAILED(deferred->ctx->FinishCommandList(FALSE, &deferred->list))) {
+		err("Couldn't finish command list %u", index);
+		deferred->list = nullptr;
+	}
+}
+
+void D3D11CommandLists::executeList(u32 index, RenderBackend &) {
+	if (index >= contexts.size() || !contexts[index]->list) return;
+	Deferred *deferred = contexts[index];
+
+	immediate->getContext()->ExecuteCommandList(deferred->list, FALSE);
+	RELEASE_IF_NOT_NULL(deferred->list);
+}
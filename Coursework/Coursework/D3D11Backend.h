@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "RenderBackend.h"
+#include "CommandRecorder.h"
+
+struct ID3D11DeviceContext1;
+struct ID3D11CommandList;
+
+// Forwards every call to a d3d11 device context, buffers are created with the device
+class D3D11Backend : public RenderBackend {
+public:
+	~D3D11Backend();
+
+	// Also checks if the device supports d3d11.1 constant buffer ranges
+	void init(Device *dev, DeviceContext *context);
+	DeviceContext *getContext() override { return ctx; }
+
+	void setInputLayout(ID3D11InputLayout *layout) override;
+	void setTopology(u32 topology) override;
+	void setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) override;
+	void setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) override;
+
+	void setVertexShader(ID3D11VertexShader *shader) override;
+	void setHullShader(ID3D11HullShader *shader) override;
+	void setDomainShader(ID3D11DomainShader *shader) override;
+	void setGeometryShader(ID3D11GeometryShader *shader) override;
+	void setPixelShader(ID3D11PixelShader *shader) override;
+	void setComputeShader(ID3D11ComputeShader *shader) override;
+
+	void setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) override;
+	void setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) override;
+	void setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers) override;
+	void setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) override;
+	bool supportsConstantRanges() override { return ctx1 != nullptr; }
+
+	ID3D11Buffer *createBuffer(BufferType type, u32 size, const void *data, bool dynamic) override;
+	void releaseBuffer(ID3D11Buffer *buffer) override;
+	void *mapBuffer(ID3D11Buffer *buffer, u32 offset, u32 size, MapMode mode) override;
+	void unmapBuffer(ID3D11Buffer *buffer) override;
+	void updateTexture(ID3D11Texture2D *texture, u32 subresource, const void *data, u32 rowPitch, u32 rows) override;
+	void writeTexture(ID3D11Texture2D *texture, const void *data, u32 rowSize, u32 rows) override;
+
+	void draw(u32 vertexCount, u32 startVertex) override;
+	void drawIndexed(u32 indexCount, u32 startIndex, i32 baseVertex) override;
+	void drawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 startIndex, i32 baseVertex) override;
+	void marker(const char *name) override {}
+
+private:
+	Device *device = nullptr;
+	DeviceContext *ctx = nullptr;
+	// null if constant buffer ranges are not supported
+	ID3D11DeviceContext1 *ctx1 = nullptr;
+};
+
+/* Records every command list on its own deferred context, and runs them
+ * with ExecuteCommandList on the immediate context of main.
+ * The state of the immediate context is cleared after every list.
+ * Drivers without native command lists are emulated by the runtime,
+ * supportsNativeLists() tells which one it is.
+ */
+class D3D11CommandLists : public CommandListBackend {
+public:
+	~D3D11CommandLists();
+
+	void init(Device *dev, D3D11Backend *immediateBackend);
+	void cleanup();
+	bool supportsNativeLists() const { return nativeLists; }
+
+	void prepare(u32 count) override;
+	RenderBackend *beginList(u32 index) override;
+	void endList(u32 index) override;
+	void executeList(u32 index, RenderBackend &immediate) override;
+
+private:
+	struct Deferred {
+		DeviceContext *ctx = nullptr;
+		D3D11Backend backend;
+		ID3D11CommandList *list = nullptr;
+	};
+
+	Device *device = nullptr;
+	D3D11Backend *immediate = nullptr;
+	// pointers, so the backends don't move when more are added
+	std::vector<Deferred *> contexts;
+	bool nativeLists = false;
+};
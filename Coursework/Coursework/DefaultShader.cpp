@@ -1,6 +1,9 @@
 #include "DefaultShader.h"
 
+#include <algorithm>
+
 #include "utility.h"
+#include "EvsmShadowMap.h"
 
 // this values are taken from https://wiki.ogre3d.org/tiki-index.php?page=-Point+Light+Attenuation
 AttenuationFactor lightFactors[] = {
@@ -28,14 +31,36 @@ ID3D11InputLayout *DefaultShader::baseVertexLayout = nullptr;
 
 ID3D11PixelShader *DefaultShader::defaultPixelShader = nullptr;
 
+CascadedShadowMap *DefaultShader::sunShadow = nullptr;
+ClusteredLights *DefaultShader::clusteredLights = nullptr;
+EvsmShadowMap *DefaultShader::spotMoments = nullptr;
+EvsmShadowMap *DefaultShader::pointMoments = nullptr;
+
+thread_local bool DefaultShader::isDepth = false;
+thread_local bool DefaultShader::isOmni  = false;
+
+std::vector<DefaultShader *> DefaultShader::instances;
+std::mutex DefaultShader::instancesMutex;
+ShaderPermutations::Key DefaultShader::permutation = 0;
+
 DefaultShader::DefaultShader(Device *device, HWND hwnd, bool init) 
 	: BaseShader(device, hwnd) {
+	{
+		std::lock_guard<std::mutex> lock(instancesMutex);
+		instances.push_back(this);
+	}
+
 	if (init) {
 		initShader();
 	}
 }
 
 DefaultShader::~DefaultShader() {
+	{
+		std::lock_guard<std::mutex> lock(instancesMutex);
+		instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+	}
+
 	// If we're using a shared shader, don't clenup here
 	if (vertexShader == defaultVertexShader) vertexShader = nullptr;
 	if (vertexShader == baseVertexShader) vertexShader = nullptr;
@@ -53,6 +78,9 @@ DefaultShader::~DefaultShader() {
 	RELEASE_IF_NOT_NULL(lightBuffer);
 	RELEASE_IF_NOT_NULL(materialBuffer);
 	RELEASE_IF_NOT_NULL(cubemapBuffer);
+	RELEASE_IF_NOT_NULL(cascadeBuffer);
+	RELEASE_IF_NOT_NULL(clusterBuffer);
+	RELEASE_IF_NOT_NULL(shadowFilterBuffer);
 	RELEASE_IF_NOT_NULL(vertexDepthShader);
 	RELEASE_IF_NOT_NULL(omniDepthGSShader);
 }
@@ -71,6 +99,32 @@ void DefaultShader::cleanupStaticShaders() {
 	if(defaultPixelShader) defaultPixelShader->Release();
 }
 
+void DefaultShader::setPermutation(ShaderPermutations::Key key) {
+	if (key == permutation) return;
+	permutation = key;
+
+	// the shaders that use the shared default one get the new one without a reference of their own
+	ID3D11PixelShader *oldDefault = defaultPixelShader;
+	if (oldDefault) {
+		defaultPixelShader = shaderLibrary.getPixelShader(L"shaders/default_ps.cso", key);
+	}
+
+	std::lock_guard<std::mutex> lock(instancesMutex);
+	for (DefaultShader *shader : instances) {
+		if (shader->pixelShaderFile) {
+			// the library hands out the same object again if the shader has no variants
+			ID3D11PixelShader *old = shader->pixelShader;
+			shader->pixelShader = shaderLibrary.getPixelShader(shader->pixelShaderFile, key);
+			RELEASE_IF_NOT_NULL(old);
+		}
+		else if (oldDefault && shader->pixelShader == oldDefault) {
+			shader->pixelShader = defaultPixelShader;
+		}
+	}
+
+	RELEASE_IF_NOT_NULL(oldDefault);
+}
+
 void DefaultShader::setShaderParameters(
 	DeviceContext *ctx, 
 	const mat4 &world, 
@@ -113,34 +167,7 @@ void DefaultShader::setShaderParameters(
 	if (!isDepth) {
 		// == LIGHT BUFFER ===========================
 		auto lightPtr = mapBuffer<LightBufferType>(ctx, lightBuffer);
-		lightPtr->pointLightPos = lights[POINT_LIGHT].getPosition();
-		for (int i = 0; i < LIGHTS_COUNT; ++i) {
-			switch (i) {
-			case DIR_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = 0.f;
-				break;
-			case SPOT_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = lights[i].getSpotCutoff();
-				break;
-			}
-
-			auto &lightData = lightPtr->sharedLightData[i];
-			auto &factors = lightPtr->factor[i];
-			auto &factor = lightFactors[lights[i].getLightStrength()];
-
-			lightData.ambient = lights[i].getAmbientColour();
-			lightData.diffuse = lights[i].getDiffuseColour();
-			lightData.specular = lights[i].getSpecularColour();
-			float3 pos = lights[i].getPosition();
-			lightData.position = { pos.x, pos.y, pos.z, 1.f };
-
-			factors.specularPower = lights[i].getSpecularPower();
-			factors.constant = factor.constant;
-			factors.linear = factor.linear;
-			factors.quadratic = factor.quadratic;
-		}
+		fillLightBuffer(lightPtr, lights);
 		unmapBufferPS(ctx, lightBuffer, 0);
 
 
@@ -156,11 +183,14 @@ void DefaultShader::setShaderParameters(
 		TextureType *pointTexture = pointShadow.getCubemap();
 
 		// Set shader texture resource in the pixel shader.
-		ctx->PSSetShaderResources(0, 1, &texture);
-		ctx->PSSetShaderResources(1, 1, &spotTexture);
-		ctx->PSSetShaderResources(2, 1, &pointTexture);
-		ctx->PSSetSamplers(0, 1, &sampleState);
-		ctx->PSSetSamplers(1, 1, &shadowMapSampler);
+		TextureType *textures[] = { texture, spotTexture, pointTexture };
+		ID3D11SamplerState *samplers[] = { sampleState, shadowMapSampler };
+		stateCache.setShaderResources(ShaderStage::Pixel, 0, ARR_LEN(textures), textures);
+		stateCache.setSamplers(ShaderStage::Pixel, 0, ARR_LEN(samplers), samplers);
+
+		setSunShadowParameters(ctx);
+		setClusterParameters(ctx);
+		setShadowFilterParameters(ctx);
 	}
 
 	if (isOmni) {
@@ -174,6 +204,7 @@ void DefaultShader::setShaderParameters(
 		for (int i = 0; i < 6; ++i) {
 			cubePtr->cubeViewMatrix[i] = XMMatrixTranspose(pointShadow.getViewMatrix(i));
 		}
+		cubePtr->faceMask = pointShadow.getFaceMask();
 		unmapBufferGS(ctx, cubemapBuffer, 1);
 	}
 }
@@ -186,54 +217,46 @@ void DefaultShader::render(DeviceContext *ctx, MMesh &mesh) {
 	uint stride = sizeof(MMesh::PubVertexType);
 	uint offset = 0;
 
-	ctx->IASetVertexBuffers(0, 1, &vbuf, &stride, &offset);
-	ctx->IASetIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
-	ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	stateCache.setVertexBuffers(0, 1, &vbuf, &stride, &offset);
+	stateCache.setIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
+	stateCache.setTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// == RENDER =================================
 
 	// Set the vertex input layout.
-	ctx->IASetInputLayout(layout);
+	stateCache.setInputLayout(layout);
 
 	// Set the vertex and pixel shaders that will be used to render.
 	if (isDepth) {
-		ctx->VSSetShader(vertexDepthShader, NULL, 0);
-		ctx->PSSetShader(NULL, NULL, 0);
+		stateCache.setVertexShader(vertexDepthShader);
+		stateCache.setPixelShader(NULL);
 	}
 	else {
-		ctx->VSSetShader(vertexShader, NULL, 0);
-		ctx->PSSetShader(pixelShader, NULL, 0);
+		stateCache.setVertexShader(vertexShader);
+		stateCache.setPixelShader(pixelShader);
 	}
-	ctx->CSSetShader(NULL, NULL, 0);
+	stateCache.setComputeShader(NULL);
 
 	// if Hull shader is not null then set HS and DS
 	if (hullShader) {
-		ctx->HSSetShader(hullShader, NULL, 0);
-		ctx->DSSetShader(domainShader, NULL, 0);
+		stateCache.setHullShader(hullShader);
+		stateCache.setDomainShader(domainShader);
 	}
 	else {
-		ctx->HSSetShader(NULL, NULL, 0);
-		ctx->DSSetShader(NULL, NULL, 0);
+		stateCache.setHullShader(NULL);
+		stateCache.setDomainShader(NULL);
 	}
 
-	// if geometry shader is not null then set GS
-	if (geometryShader) {
-		ctx->GSSetShader(geometryShader, NULL, 0);
+	// the omni depth pass replaces the geometry shader, if there is one
+	if (isOmni) {
+		stateCache.setGeometryShader(omniDepthGSShader);
 	}
 	else {
-		ctx->GSSetShader(NULL, NULL, 0);
-	}
-
-	if (isOmni) {
-		ctx->GSSetShader(omniDepthGSShader, NULL, 0);
+		stateCache.setGeometryShader(geometryShader);
 	}
 
 	// Render the triangle.
-	ctx->DrawIndexed(mesh.getIndexCount(), 0, 0);
-	
-	// unbind shader resources
-	TextureType *nullTEX[LIGHTS_COUNT + 1] = { 0 };
-	ctx->PSSetShaderResources(0, LIGHTS_COUNT + 1, nullTEX);
+	stateCache.getBackend()->drawIndexed(mesh.getIndexCount(), 0, 0);
 }
 
 void DefaultShader::useDepthShader(bool use) {
@@ -246,11 +269,58 @@ void DefaultShader::useOmniDepthShader(bool use) {
 
 void DefaultShader::initDefaultBuffers() {
 	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
-	addDynamicBuffer<DefaultBufferType>(&defaultBuffer);
-	addDynamicBuffer<ShadowBufferType>(&shadowBuffer);
-	addDynamicBuffer<LightBufferType>(&lightBuffer);
+	addDynamicBuffer<DefaultBufferType>(&defaultBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ShadowBufferType>(&shadowBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<LightBufferType>(&lightBuffer, ConstantUsage::Frame);
 	addDynamicBuffer<MaterialBufferType>(&materialBuffer);
-	addDynamicBuffer<CubemapBufferType>(&cubemapBuffer);
+	addDynamicBuffer<CubemapBufferType>(&cubemapBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<CascadeBufferType>(&cascadeBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ClusterBufferType>(&clusterBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ShadowFilterBufferType>(&shadowFilterBuffer, ConstantUsage::Frame);
+}
+
+void DefaultShader::fillLightBuffer(LightBufferType *lightPtr, Light lights[LIGHTS_COUNT]) {
+	static LightBufferType cached;
+	static const Light *cachedLights = nullptr;
+	static u64 cachedFrame = 0;
+
+	if (cachedLights == lights && cachedFrame == constantAllocator.getFrame()) {
+		*lightPtr = cached;
+		return;
+	}
+
+	cached.pointLightPos = lights[POINT_LIGHT].getPosition();
+	for (int i = 0; i < LIGHTS_COUNT; ++i) {
+		switch (i) {
+		case DIR_LIGHT:
+			cached.dirSpotData[i].lightDir = lights[i].getDirection();
+			cached.dirSpotData[i].spotCutoff = 0.f;
+			break;
+		case SPOT_LIGHT:
+			cached.dirSpotData[i].lightDir = lights[i].getDirection();
+			cached.dirSpotData[i].spotCutoff = lights[i].getSpotCutoff();
+			break;
+		}
+
+		auto &lightData = cached.sharedLightData[i];
+		auto &factors = cached.factor[i];
+		auto &factor = lightFactors[lights[i].getLightStrength()];
+
+		lightData.ambient = lights[i].getAmbientColour();
+		lightData.diffuse = lights[i].getDiffuseColour();
+		lightData.specular = lights[i].getSpecularColour();
+		float3 pos = lights[i].getPosition();
+		lightData.position = { pos.x, pos.y, pos.z, 1.f };
+
+		factors.specularPower = lights[i].getSpecularPower();
+		factors.constant = factor.constant;
+		factors.lin = factor.linear;
+		factors.quadratic = factor.quadratic;
+	}
+
+	cachedLights = lights;
+	cachedFrame = constantAllocator.getFrame();
+	*lightPtr = cached;
 }
 
 void DefaultShader::addDiffuseSampler() {
@@ -285,6 +355,101 @@ void DefaultShader::addShadowSampler() {
 	renderer->CreateSamplerState(&samplerDesc, &shadowMapSampler);
 }
 
+void DefaultShader::setSunShadowParameters(DeviceContext *ctx) {
+	auto cascadePtr = mapBuffer<CascadeBufferType>(ctx, cascadeBuffer);
+	TextureType *sunTexture = nullptr;
+
+	// without a shadow map the count is 0, and nothing is in shadow
+	u32 count = 0;
+	if (sunShadow) {
+		const ShadowCascades &cascades = sunShadow->getCascades();
+		count = min(cascades.getCount(), CASCADED_SIZE);
+
+		f32 splits[4] = {};
+		for (u32 i = 0; i < count; ++i) {
+			cascadePtr->cascadeViewProj[i] = XMMatrixTranspose(XMMATRIX(cascades.getCascade(i).viewProj));
+			splits[i] = cascades.getSplit(i);
+		}
+		cascadePtr->cascadeSplits = { splits[0], splits[1], splits[2], splits[3] };
+		cascadePtr->cameraPos = cascades.getView().position;
+		cascadePtr->cameraForward = cascades.getView().forward;
+		sunTexture = sunShadow->getTextureArray();
+	}
+	cascadePtr->cascadeCount = (f32)count;
+	unmapBufferPS(ctx, cascadeBuffer, 3);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 4, 1, &sunTexture);
+}
+
+void DefaultShader::setClusterParameters(DeviceContext *ctx) {
+	auto clusterPtr = mapBuffer<ClusterBufferType>(ctx, clusterBuffer);
+
+	// without clusters the count is 0, and the loop is skipped
+	const LightClusters *clusters = clusteredLights ? clusteredLights->getClusters() : nullptr;
+	clusterPtr->lightCount = clusters ? clusteredLights->getLightCount() : 0;
+	if (clusters) {
+		clusterPtr->viewProj = XMMatrixTranspose(clusteredLights->getViewProj());
+		clusterPtr->cameraPos = clusters->getView().position;
+		clusterPtr->cameraForward = clusters->getView().forward;
+		clusterPtr->sliceScale = clusters->getSliceScale();
+		clusterPtr->sliceBias = clusters->getSliceBias();
+	}
+	unmapBufferPS(ctx, clusterBuffer, 4);
+
+	if (clusteredLights) {
+		clusteredLights->bind();
+	}
+}
+
+void DefaultShader::setShadowFilterParameters(DeviceContext *ctx) {
+	auto filterPtr = mapBuffer<ShadowFilterBufferType>(ctx, shadowFilterBuffer);
+	TextureType *moments[2] = {};
+	ID3D11SamplerState *momentsSampler = nullptr;
+
+	// without moments the lights use the depth
+	bool spotEvsm = spotMoments && spotMoments->isEnabled();
+	filterPtr->spotFilter = (u32)(spotEvsm ? ShadowMoments::Filter::Evsm : ShadowMoments::Filter::Hard);
+	if (spotEvsm) {
+		filterPtr->spotNearZ = spotMoments->getNearZ();
+		filterPtr->spotFarZ = spotMoments->getFarZ();
+		filterPtr->spotLightBleeding = spotMoments->getParams().lightBleeding;
+		filterPtr->spotMinVariance = spotMoments->getParams().minVariance;
+		moments[0] = spotMoments->getMoments();
+		momentsSampler = spotMoments->getSampler();
+	}
+
+	bool pointEvsm = pointMoments && pointMoments->isEnabled();
+	filterPtr->pointFilter = (u32)(pointEvsm ? ShadowMoments::Filter::Evsm : ShadowMoments::Filter::Hard);
+	if (pointEvsm) {
+		filterPtr->pointNearZ = pointMoments->getNearZ();
+		filterPtr->pointFarZ = pointMoments->getFarZ();
+		filterPtr->pointLightBleeding = pointMoments->getParams().lightBleeding;
+		filterPtr->pointMinVariance = pointMoments->getParams().minVariance;
+		moments[1] = pointMoments->getMoments();
+		momentsSampler = pointMoments->getSampler();
+	}
+	unmapBufferPS(ctx, shadowFilterBuffer, 5);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 8, ARR_LEN(moments), moments);
+	if (momentsSampler) {
+		stateCache.setSamplers(ShaderStage::Pixel, 2, 1, &momentsSampler);
+	}
+}
+
+void DefaultShader::addClampSampler(ID3D11SamplerState **sampler) {
+	D3D11_SAMPLER_DESC samplerDesc{};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.MaxAnisotropy = 1;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	renderer->CreateSamplerState(&samplerDesc, sampler);
+}
+
 ID3D11VertexShader *DefaultShader::getDefaultVertexShader(DefaultShader *ctx) {
 	assert(ctx);
 
@@ -293,23 +458,14 @@ ID3D11VertexShader *DefaultShader::getDefaultVertexShader(DefaultShader *ctx) {
 
 	// -- Load shader --------------------------------------------------------------------------------------------------------
 
-	ID3DBlob *vertexShaderBuffer = ctx->loadShader(L"shaders/default_vs.cso");
-
 	constexpr D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
-	// Create the vertex shader from the buffer.
-	ctx->renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &defaultVertexShader);
-
-	// Create the vertex input layout.
-	ctx->renderer->CreateInputLayout(polygonLayout, ARR_LEN(polygonLayout), vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &defaultVertexLayout);
-
-	// Release the vertex shader buffer and pixel shader buffer since they are no longer needed.
-	vertexShaderBuffer->Release();
-	vertexShaderBuffer = 0;
+	defaultVertexShader = shaderLibrary.getVertexShader(L"shaders/default_vs.cso");
+	defaultVertexLayout = shaderLibrary.createInputLayout(L"shaders/default_vs.cso", polygonLayout, ARR_LEN(polygonLayout));
 
 	assert(defaultVertexShader && defaultVertexLayout);
 
@@ -325,23 +481,14 @@ ID3D11VertexShader *DefaultShader::getBaseVertexShader(DefaultShader *ctx) {
 
 	// -- Load shader --------------------------------------------------------------------------------------------------------
 
-	ID3DBlob *vertexShaderBuffer = ctx->loadShader(L"shaders/base_vs.cso");
-
 	constexpr D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
-	// Create the vertex shader from the buffer.
-	ctx->renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &baseVertexShader);
-
-	// Create the vertex input layout.
-	ctx->renderer->CreateInputLayout(polygonLayout, ARR_LEN(polygonLayout), vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &baseVertexLayout);
-
-	// Release the vertex shader buffer and pixel shader buffer since they are no longer needed.
-	vertexShaderBuffer->Release();
-	vertexShaderBuffer = 0;
+	baseVertexShader = shaderLibrary.getVertexShader(L"shaders/base_vs.cso");
+	baseVertexLayout = shaderLibrary.createInputLayout(L"shaders/base_vs.cso", polygonLayout, ARR_LEN(polygonLayout));
 
 	assert(baseVertexShader && baseVertexLayout);
 
@@ -356,14 +503,7 @@ ID3D11VertexShader *DefaultShader::getDefaultDepthShader(DefaultShader *ctx) {
 
 	// -- Load shader --------------------------------------------------------------------------------------------------------
 
-	ID3DBlob *vertexShaderBuffer = ctx->loadShader(L"shaders/default_vs_depth.cso");
-
-	// Create the vertex shader from the buffer.
-	ctx->renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &defaultDepthShader);
-
-	// Release the vertex shader buffer and pixel shader buffer since they are no longer needed.
-	vertexShaderBuffer->Release();
-	vertexShaderBuffer = 0;
+	defaultDepthShader = shaderLibrary.getVertexShader(L"shaders/default_vs_depth.cso");
 
 	assert(defaultDepthShader);
 
@@ -377,12 +517,7 @@ ID3D11PixelShader *DefaultShader::getDefaultPixelShader(DefaultShader *ctx) {
 
 	// -- Load shader --------------------------------------------------------------------------------------------------------
 
-	ID3DBlob *pixelShaderBuffer = ctx->loadShader(L"shaders/default_ps.cso");
-	// Create the pixel shader from the buffer.
-	ctx->renderer->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &defaultPixelShader);
-
-	pixelShaderBuffer->Release();
-	pixelShaderBuffer = 0;
+	defaultPixelShader = shaderLibrary.getPixelShader(L"shaders/default_ps.cso", permutation);
 
 	assert(defaultPixelShader);
 	
@@ -400,16 +535,42 @@ void DefaultShader::initShader() {
 }
 
 void DefaultShader::loadDepthShader(const wchar_t *dvs) {
-	ID3DBlob *buf = loadShader(dvs);
-	// Create the depth shader from the buffer.
-	renderer->CreateVertexShader(buf->GetBufferPointer(), buf->GetBufferSize(), NULL, &vertexDepthShader);
-	buf->Release();
-	buf = nullptr;
+	vertexDepthShader = shaderLibrary.getVertexShader(dvs);
 
+	// every shader has its own reference to the same geometry shader
 	if (!omniDepthGSShader) {
-		ID3DBlob *buf = loadShader(L"shaders/omni_gs.cso");
-		renderer->CreateGeometryShader(buf->GetBufferPointer(), buf->GetBufferSize(), NULL, &omniDepthGSShader);
-		buf->Release();
-		buf = nullptr;
+		omniDepthGSShader = shaderLibrary.getGeometryShader(L"shaders/omni_gs.cso");
 	}
 }
+
+void DefaultShader::loadVertexShader(const wchar_t *vs) {
+	constexpr D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+	loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
+}
+
+void DefaultShader::loadVertexShader(const wchar_t *vs, const D3D11_INPUT_ELEMENT_DESC *layoutDesc, u32 layoutLen) {
+	vertexShader = shaderLibrary.getVertexShader(vs);
+	layout = shaderLibrary.createInputLayout(vs, layoutDesc, layoutLen);
+}
+
+void DefaultShader::loadHullShader(const wchar_t *hs) {
+	hullShader = shaderLibrary.getHullShader(hs);
+}
+
+void DefaultShader::loadDomainShader(const wchar_t *ds) {
+	domainShader = shaderLibrary.getDomainShader(ds);
+}
+
+void DefaultShader::loadGeometryShader(const wchar_t *gs) {
+	geometryShader = shaderLibrary.getGeometryShader(gs);
+}
+
+void DefaultShader::loadPixelShader(const wchar_t *ps) {
+	pixelShaderFile = ps;
+	pixelShader = shaderLibrary.getPixelShader(ps, permutation);
+}
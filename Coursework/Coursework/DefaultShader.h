@@ -4,10 +4,18 @@
 #include "types.h"
 #include "mmodel.h"
 #include "OmniShadowMap.h"
+#include "CascadedShadowMap.h"
+#include "ClusteredLights.h"
+#include "StateCache.h"
+#include "ConstantAllocator.h"
+#include "ShaderLibrary.h"
+#include "shaders/cbuffers.hlsli"
 
 using namespace std;
 using namespace DirectX;
 
+class EvsmShadowMap;
+
 struct AttenuationFactor {
 	float constant;
 	float linear;
@@ -29,6 +37,11 @@ extern AttenuationFactor lightFactors[12];
  * Every shader can also have an optional depth vertex shader.
  * This shader should do all the same vertex manipulation but 
  * skip any light calculation.
+ * The load functions hide the BaseShader ones, they get the shaders
+ * from the shaderLibrary so every bytecode file is read once and shaders
+ * with the same bytecode share the same object.
+ * The pixel shaders are loaded as the variant of the current permutation
+ * key, setPermutation() swaps them in every shader.
  */
 class DefaultShader : public BaseShader {
 protected:
@@ -43,34 +56,13 @@ protected:
 		mat4 spotLightMVP;
 	};
 
-	// All the data needed to render all the lights
-	struct LightBufferType {
-		// Data only used by the directional and the spot light
-		struct DirSpotData {
-			float3 lightDir;
-			float spotCutoff;
-		} dirSpotData[2];
-
-		// Data shared by all light types
-		struct LightData {
-			float4 ambient;
-			float4 diffuse;
-			float4 specular;
-			float4 position;
-		} sharedLightData[LIGHTS_COUNT];
-
-		// Factors for attenuation calculation, specularPower
-		// is also here as it would need to have padding otherwise
-		struct Factor {
-			float constant;
-			float linear;
-			float quadratic;
-			float specularPower;
-		} factor[LIGHTS_COUNT];
-
-		float3 pointLightPos;
-		float padding = 0.f;
-	};
+	// All the data needed to render all the lights, the fields are in cbuffers.hlsli:
+	// the data only used by the directional and the spot light, the data shared by
+	// all light types and the factors for the attenuation
+	CBUFFER_STRUCT(DirSpotData, DIR_SPOT_DATA)
+	CBUFFER_STRUCT(LightData, LIGHT_DATA)
+	CBUFFER_STRUCT(Factor, LIGHT_FACTOR)
+	CBUFFER(LightBuffer, b0, LIGHT_BUFFER)
 
 	// Material data
 	struct MaterialBufferType {
@@ -80,6 +72,44 @@ protected:
 	// Data needed for omni-directional shadow mapping
 	struct CubemapBufferType {
 		mat4 cubeViewMatrix[6];
+		u32 faceMask;
+		u32 padding[3];
+	};
+
+	// Data used to sample the sun's cascaded shadow map
+	struct CascadeBufferType {
+		mat4 cascadeViewProj[CASCADED_SIZE];
+		float4 cascadeSplits;
+		float3 cameraPos;
+		float cascadeCount;
+		float3 cameraForward;
+		float padding = 0.f;
+	};
+
+	// Data used to find the cluster of a pixel, the lights are in structured buffers
+	struct ClusterBufferType {
+		mat4 viewProj;
+		float3 cameraPos;
+		float sliceScale;
+		float3 cameraForward;
+		float sliceBias;
+		u32 lightCount;
+		u32 padding[3];
+	};
+
+	// How the spot and point lights filter their shadows, see ShadowMoments
+	struct ShadowFilterBufferType {
+		u32 spotFilter;
+		float spotNearZ;
+		float spotFarZ;
+		float spotLightBleeding;
+		u32 pointFilter;
+		float pointNearZ;
+		float pointFarZ;
+		float pointLightBleeding;
+		float spotMinVariance;
+		float pointMinVariance;
+		float padding[2];
 	};
 
 public:
@@ -91,25 +121,56 @@ public:
 
 	void render(DeviceContext *ctx, MMesh &mesh);
 
-	// Render using default depth vertex shader (disables pixel shader)
-	void useDepthShader(bool use);
-	// Render using omni depth geometry shader
-	void useOmniDepthShader(bool use);
+	// Render using default depth vertex shader (disables pixel shader).
+	// The mode is the same for every shader, but every thread has its own,
+	// so the passes recorded on other threads keep theirs
+	static void useDepthShader(bool use);
+	// Render using omni depth geometry shader, per thread like the depth shader
+	static void useOmniDepthShader(bool use);
 
 	inline ID3D11VertexShader *getDepthShader() { return vertexDepthShader; }
 	inline void setDepthShader(ID3D11VertexShader *newShader) { vertexDepthShader = newShader; }
 
-	bool isDepthShader() { return isDepth; }
-	bool isOmniShader() { return isOmni; }
+	static bool isDepthShader() { return isDepth; }
+	static bool isOmniShader() { return isOmni; }
+
+	// The sun's shadow map is the same for every shader, set once by App1
+	static void setSunShadow(CascadedShadowMap *shadowMap) { sunShadow = shadowMap; }
+	// Same for the unshadowed local lights
+	static void setClusteredLights(ClusteredLights *lights) { clusteredLights = lights; }
+	// The moments of the spot and point shadows, they're used by the lights that filter with EVSM
+	static void setShadowMoments(EvsmShadowMap *spot, EvsmShadowMap *point) { spotMoments = spot; pointMoments = point; }
+	// Swaps the pixel shader of every shader for the variant of the key (see ShaderPermutations),
+	// the shaders are changed in place so no frame can be recorded while it runs
+	static void setPermutation(ShaderPermutations::Key key);
+	static ShaderPermutations::Key getPermutation() { return permutation; }
 
 protected:
 	void initShader();
 	void loadDepthShader(const wchar_t *dvs);
+	// Uses the position, texcoord and normal layout
+	void loadVertexShader(const wchar_t *vs);
+	void loadVertexShader(const wchar_t *vs, const D3D11_INPUT_ELEMENT_DESC *layoutDesc, u32 layoutLen);
+	void loadHullShader(const wchar_t *hs);
+	void loadDomainShader(const wchar_t *ds);
+	void loadGeometryShader(const wchar_t *gs);
+	void loadPixelShader(const wchar_t *ps);
 	// Initializes default buffers
 	void initDefaultBuffers();
 	// Loads diffuse and shadow samplers
 	void addDiffuseSampler();
 	void addShadowSampler();
+	// Uploads the sun's cascades and binds its shadow map to the pixel shader
+	void setSunShadowParameters(DeviceContext *ctx);
+	// Uploads the clusters' constants and binds the local lights to the pixel shader
+	void setClusterParameters(DeviceContext *ctx);
+	// Uploads the lights' shadow filters and binds the moments of the ones that use EVSM
+	void setShadowFilterParameters(DeviceContext *ctx);
+	// Loads a linear clamped sampler, used to read data textures (heightmaps, wind field, ...)
+	void addClampSampler(ID3D11SamplerState **sampler);
+	// Fills the light buffer from the lights, it is only built once per frame
+	// as the lights don't change while the scene is being rendered
+	static void fillLightBuffer(LightBufferType *lightPtr, Light lights[LIGHTS_COUNT]);
 
 	/* default shaders that are loaded once and shared between all shaders */
 	static ID3D11VertexShader *getDefaultVertexShader(DefaultShader *ctx);
@@ -117,49 +178,46 @@ protected:
 	static ID3D11VertexShader *getDefaultDepthShader(DefaultShader *ctx);
 	static ID3D11PixelShader *getDefaultPixelShader(DefaultShader *ctx);
 
-	// Templated function to create dynamic buffer more easily using default options
+	// Templated function to create dynamic buffer more easily using default options.
+	// Frame buffers have the same content for every shader in a pass, they are shared through the constant ring
 	template<typename T>
-	void addDynamicBuffer(ID3D11Buffer **buf) {
+	void addDynamicBuffer(ID3D11Buffer **buf, ConstantUsage usage = ConstantUsage::Draw) {
 		D3D11_BUFFER_DESC bufDesc{};
 		bufDesc.Usage = D3D11_USAGE_DYNAMIC;
 		bufDesc.ByteWidth = sizeof(T);
 		bufDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		bufDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		HRESULT res = renderer->CreateBuffer(&bufDesc, NULL, buf);
-		res;
+		if (SUCCEEDED(res)) {
+			constantAllocator.addBlock(*buf, sizeof(T), usage);
+		}
 	}
 
-	// Templated buffer to easily map buffers
+	// Templated buffer to easily map buffers, returns a cpu copy which
+	// is only uploaded on unmap if it changed
 	template<typename T>
 	T *mapBuffer(DeviceContext *ctx, ID3D11Buffer *buf) {
-		D3D11_MAPPED_SUBRESOURCE mappedResource{};
-		HRESULT result = ctx->Map(buf, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		return (T *)mappedResource.pData;
+		return (T *)constantAllocator.map(buf, sizeof(T));
 	}
 
 	inline void unmapBufferVS(DeviceContext *ctx, ID3D11Buffer *buf, uint slot) {
-		ctx->Unmap(buf, 0);
-		ctx->VSSetConstantBuffers(slot, 1, &buf);
+		constantAllocator.unmap(buf, ShaderStage::Vertex, slot);
 	}
 
 	inline void unmapBufferHS(DeviceContext *ctx, ID3D11Buffer *buf, uint slot) {
-		ctx->Unmap(buf, 0);
-		ctx->HSSetConstantBuffers(slot, 1, &buf);
+		constantAllocator.unmap(buf, ShaderStage::Hull, slot);
 	}
 
 	inline void unmapBufferDS(DeviceContext *ctx, ID3D11Buffer *buf, uint slot) {
-		ctx->Unmap(buf, 0);
-		ctx->DSSetConstantBuffers(slot, 1, &buf);
+		constantAllocator.unmap(buf, ShaderStage::Domain, slot);
 	}
 
 	inline void unmapBufferGS(DeviceContext *ctx, ID3D11Buffer *buf, uint slot) {
-		ctx->Unmap(buf, 0);
-		ctx->GSSetConstantBuffers(slot, 1, &buf);
+		constantAllocator.unmap(buf, ShaderStage::Geometry, slot);
 	}
 
 	inline void unmapBufferPS(DeviceContext *ctx, ID3D11Buffer *buf, uint slot) {
-		ctx->Unmap(buf, 0);
-		ctx->PSSetConstantBuffers(slot, 1, &buf);
+		constantAllocator.unmap(buf, ShaderStage::Pixel, slot);
 	}
 
 	static ID3D11VertexShader *defaultDepthShader;
@@ -172,6 +230,16 @@ protected:
 
 	static ID3D11PixelShader *defaultPixelShader;
 
+	static CascadedShadowMap *sunShadow;
+	static ClusteredLights *clusteredLights;
+	static EvsmShadowMap *spotMoments;
+	static EvsmShadowMap *pointMoments;
+
+	// every shader, so setPermutation() can reach them. They're created on the startup threads
+	static std::vector<DefaultShader *> instances;
+	static std::mutex instancesMutex;
+	static ShaderPermutations::Key permutation;
+
 	ID3D11SamplerState *shadowMapSampler = nullptr;
 	ID3D11Buffer *matrixBuffer = nullptr;
 	ID3D11Buffer *defaultBuffer = nullptr;
@@ -179,9 +247,14 @@ protected:
 	ID3D11Buffer *lightBuffer = nullptr;
 	ID3D11Buffer *materialBuffer = nullptr;
 	ID3D11Buffer *cubemapBuffer = nullptr;
+	ID3D11Buffer *cascadeBuffer = nullptr;
+	ID3D11Buffer *clusterBuffer = nullptr;
+	ID3D11Buffer *shadowFilterBuffer = nullptr;
 
 	ID3D11VertexShader *vertexDepthShader = nullptr;
 	ID3D11GeometryShader *omniDepthGSShader = nullptr;
-	bool isDepth = false;
-	bool isOmni  = false;
+	// the file of the pixel shader, null if it's the shared default one
+	const wchar_t *pixelShaderFile = nullptr;
+	static thread_local bool isDepth;
+	static thread_local bool isOmni;
 };
@@ -0,0 +1,157 @@
+#include "DrawQueue.h"
+
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+// == DRAW KEY =================================================================================================================
+
+static u64 depthBits(f32 depth) {
+	// negative values and NaNs would sort after everything else
+	if (!(depth > 0.f)) depth = 0.f;
+	u32 bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+namespace DrawKey {
+	u64 make(u32 pass, u32 shader, u32 texture, f32 depth) {
+		return
+			((u64)(pass    & (MAX_PASSES - 1))   << 56) |
+			((u64)(shader  & (MAX_SHADERS - 1))  << 44) |
+			((u64)(texture & (MAX_TEXTURES - 1)) << 32) |
+			depthBits(depth);
+	}
+
+	u64 makeFrontToBack(u32 pass, f32 depth, u32 shader, u32 texture) {
+		return
+			((u64)(pass    & (MAX_PASSES - 1))   << 56) |
+			(depthBits(depth)                    << 24) |
+			((u64)(shader  & (MAX_SHADERS - 1))  << 12) |
+			((u64)(texture & (MAX_TEXTURES - 1)));
+	}
+
+	u32 getPass(u64 key) {
+		return (u32)(key >> 56);
+	}
+}
+
+// == DRAW QUEUE =================================================================================================================
+
+static u32 getId(std::unordered_map<const void *, u32> &ids, const void *object, u32 maxIds) {
+	if (!object) return 0;
+
+	auto it = ids.find(object);
+	if (it != ids.end()) return it->second;
+
+	u32 id = (u32)ids.size() % (maxIds - 1) + 1;
+	ids[object] = id;
+	return id;
+}
+
+u32 DrawQueue::getShaderId(const void *shader) {
+	return getId(shaderIds, shader, DrawKey::MAX_SHADERS);
+}
+
+u32 DrawQueue::getTextureId(const void *texture) {
+	return getId(textureIds, texture, DrawKey::MAX_TEXTURES);
+}
+
+void DrawQueue::submit(u64 key, std::function<void()> draw) {
+	packets.push_back({ key, std::move(draw) });
+}
+
+void DrawQueue::flush() {
+	using namespace std::chrono;
+	if (packets.empty()) return;
+
+	auto start = high_resolution_clock::now();
+
+	order.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); ++i) {
+		order[i] = { packets[i].key, (u32)i };
+	}
+	if (sorting) {
+		radixSort(order, scratch);
+	}
+
+	auto sorted = high_resolution_clock::now();
+
+	for (const SortItem &item : order) {
+		packets[item.index].draw();
+	}
+
+	auto end = high_resolution_clock::now();
+
+	stats.packets += (u32)packets.size();
+	stats.sortMs += duration<f64, std::milli>(sorted - start).count();
+	stats.dispatchMs += duration<f64, std::milli>(end - sorted).count();
+
+	clear();
+}
+
+void DrawQueue::clear() {
+	packets.clear();
+}
+
+void DrawQueue::beginFrame() {
+	lastFrame = stats;
+	stats = Stats();
+}
+
+void DrawQueue::radixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch) {
+	constexpr u32 DIGITS = 8;
+	// clearing and scanning the histograms costs more than sorting a few items
+	constexpr size_t INSERTION_SORT_MAX = 64;
+	const size_t count = items.size();
+
+	if (count <= INSERTION_SORT_MAX) {
+		for (size_t i = 1; i < count; ++i) {
+			SortItem item = items[i];
+			size_t j = i;
+			for (; j > 0 && items[j - 1].key > item.key; --j) {
+				items[j] = items[j - 1];
+			}
+			items[j] = item;
+		}
+		return;
+	}
+
+	scratch.resize(count);
+
+	// all the histograms in one go
+	u32 histograms[DIGITS][256] = {};
+	for (const SortItem &item : items) {
+		for (u32 d = 0; d < DIGITS; ++d) {
+			histograms[d][(item.key >> (d * 8)) & 0xFF]++;
+		}
+	}
+
+	SortItem *src = items.data();
+	SortItem *dst = scratch.data();
+
+	for (u32 d = 0; d < DIGITS; ++d) {
+		u32 *histogram = histograms[d];
+
+		// every key has the same byte, the order wouldn't change
+		if (histogram[(src[0].key >> (d * 8)) & 0xFF] == count) continue;
+
+		u32 offset = 0;
+		for (u32 i = 0; i < 256; ++i) {
+			u32 bucket = histogram[i];
+			histogram[i] = offset;
+			offset += bucket;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			u32 digit = (src[i].key >> (d * 8)) & 0xFF;
+			dst[histogram[digit]++] = src[i];
+		}
+
+		std::swap(src, dst);
+	}
+
+	if (src != items.data()) {
+		memcpy(items.data(), src, count * sizeof(SortItem));
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include "types.h"
+
+/* 64 bit sort keys, sorted in increasing order.
+ * make() keeps the draws with the same state together:
+ *   pass (8) | shader (12) | texture (12) | depth (32)
+ * makeFrontToBack() sorts by depth first, to get the most out of early-z,
+ * and only uses the state to break ties:
+ *   pass (8) | depth (32) | shader (12) | texture (12)
+ * Depth is the distance from the camera, as a positive float its bits
+ * sort the same as its value.
+ */
+namespace DrawKey {
+	constexpr u32 MAX_PASSES   = 1 << 8;
+	constexpr u32 MAX_SHADERS  = 1 << 12;
+	constexpr u32 MAX_TEXTURES = 1 << 12;
+
+	u64 make(u32 pass, u32 shader, u32 texture, f32 depth);
+	u64 makeFrontToBack(u32 pass, f32 depth, u32 shader, u32 texture);
+	u32 getPass(u64 key);
+}
+
+/* Collects the draws of a pass as packets with a sort key, then sorts them
+ * with a radix sort and runs them in order.
+ * A packet is a function that sets all the state it needs and draws,
+ * the state cache and the constant allocator drop what is already bound,
+ * so packets next to each other with the same shader and texture only
+ * cost the draw.
+ */
+class DrawQueue {
+public:
+	struct SortItem {
+		u64 key;
+		u32 index;
+	};
+
+	struct Stats {
+		u32 packets = 0;
+		f64 sortMs = 0.0;
+		f64 dispatchMs = 0.0;
+	};
+
+	// Small id for a shader or a texture to put in the key, 0 is nullptr.
+	// Ids wrap around after MAX_SHADERS/MAX_TEXTURES objects
+	u32 getShaderId(const void *shader);
+	u32 getTextureId(const void *texture);
+
+	void submit(u64 key, std::function<void()> draw);
+	// Sorts and runs the packets, then removes them
+	void flush();
+	void clear();
+
+	// Without sorting the packets run in the order they were submitted
+	void setSorting(bool sort) { sorting = sort; }
+	bool isSorting() const { return sorting; }
+
+	// Resets the stats, they add up over all the flushes of a frame
+	void beginFrame();
+	const Stats &getStats() const { return stats; }
+	const Stats &getLastFrame() const { return lastFrame; }
+	u32 getCount() const { return (u32)packets.size(); }
+
+	// Stable sort by key, 8 bits at a time. The bytes that are the same
+	// in every key are skipped, scratch is resized to the size of items.
+	// Short lists use an insertion sort
+	static void radixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch);
+
+private:
+	struct Packet {
+		u64 key;
+		std::function<void()> draw;
+	};
+
+	std::vector<Packet> packets;
+	std::vector<SortItem> order;
+	std::vector<SortItem> scratch;
+
+	std::unordered_map<const void *, u32> shaderIds;
+	std::unordered_map<const void *, u32> textureIds;
+
+	bool sorting = true;
+
+	Stats stats;
+	Stats lastFrame;
+};
@@ -0,0 +1,249 @@
+#include "EvsmShadowMap.h"
+
+#include "utility.h"
+
+// == MOMENTS SHADER =====================================================================================================================
+
+MomentsShader::MomentsShader(Device *device, HWND hwnd)
+	: DefaultShader(device, hwnd) {
+	initShader(L"shaders/evsm_moments_ps.cso");
+}
+
+MomentsShader::~MomentsShader() {
+	RELEASE_IF_NOT_NULL(momentsBuffer);
+}
+
+void MomentsShader::setShaderParameters(
+	DeviceContext *ctx,
+	const mat4 &world, const mat4 &view, const mat4 &proj,
+	TextureType *depthArray, f32 nearZ, f32 farZ, u32 scale, u32 slice
+) {
+	// == MATRIX BUFFER =========================
+	auto matrixPtr = mapBuffer<MatrixBufferType>(ctx, matrixBuffer);
+	matrixPtr->world = XMMatrixTranspose(world);
+	matrixPtr->view = XMMatrixTranspose(view);
+	matrixPtr->projection = XMMatrixTranspose(proj);
+	unmapBufferVS(ctx, matrixBuffer, 0);
+
+	auto momentsPtr = mapBuffer<MomentsBufferType>(ctx, momentsBuffer);
+	momentsPtr->nearZ = nearZ;
+	momentsPtr->farZ = farZ;
+	momentsPtr->scale = scale;
+	momentsPtr->slice = slice;
+	unmapBufferPS(ctx, momentsBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &depthArray);
+}
+
+void MomentsShader::initShader(const wchar_t *ps) {
+	vertexShader = getBaseVertexShader(this);
+	loadPixelShader(ps);
+
+	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
+	addDynamicBuffer<MomentsBufferType>(&momentsBuffer);
+}
+
+// == MOMENTS BLUR SHADER ================================================================================================================
+
+MomentsBlurShader::MomentsBlurShader(Device *device, HWND hwnd)
+	: DefaultShader(device, hwnd) {
+	initShader(L"shaders/evsm_blur_ps.cso");
+}
+
+MomentsBlurShader::~MomentsBlurShader() {
+	RELEASE_IF_NOT_NULL(blurBuffer);
+}
+
+void MomentsBlurShader::setShaderParameters(
+	DeviceContext *ctx,
+	const mat4 &world, const mat4 &view, const mat4 &proj,
+	TextureType *source, i32 dirX, i32 dirY, u32 radius, u32 slice
+) {
+	// == MATRIX BUFFER =========================
+	auto matrixPtr = mapBuffer<MatrixBufferType>(ctx, matrixBuffer);
+	matrixPtr->world = XMMatrixTranspose(world);
+	matrixPtr->view = XMMatrixTranspose(view);
+	matrixPtr->projection = XMMatrixTranspose(proj);
+	unmapBufferVS(ctx, matrixBuffer, 0);
+
+	auto blurPtr = mapBuffer<MomentsBlurBufferType>(ctx, blurBuffer);
+	blurPtr->direction[0] = dirX;
+	blurPtr->direction[1] = dirY;
+	blurPtr->radius = radius;
+	blurPtr->slice = slice;
+	unmapBufferPS(ctx, blurBuffer, 0);
+
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &source);
+}
+
+void MomentsBlurShader::initShader(const wchar_t *ps) {
+	vertexShader = getBaseVertexShader(this);
+	loadPixelShader(ps);
+
+	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
+	addDynamicBuffer<MomentsBlurBufferType>(&blurBuffer);
+}
+
+// == EVSM SHADOW MAP ====================================================================================================================
+
+void EvsmShadowMap::init(Device *device, DeviceContext *deviceContext, HWND hwnd, ID3D11DepthStencilView *depth, u32 momentsSize, f32 nearPlane, f32 farPlane) {
+	momentsShader = new MomentsShader(device, hwnd);
+	blurShader    = new MomentsBlurShader(device, hwnd);
+	nearZ = nearPlane;
+	farZ = farPlane;
+
+	// -- Depth -------------------------------------------------------------------------------------------
+	ID3D11Resource *resource = nullptr;
+	ID3D11Texture2D *depthTexture = nullptr;
+	depth->GetResource(&resource);
+	resource->QueryInterface(__uuidof(ID3D11Texture2D), (void **)&depthTexture);
+	resource->Release();
+	assert(depthTexture);
+
+	D3D11_TEXTURE2D_DESC depthDesc;
+	depthTexture->GetDesc(&depthDesc);
+	depthSize = depthDesc.Width;
+	slices = min(depthDesc.ArraySize, MAX_SLICES);
+	size = min(momentsSize, depthSize);
+	bool isCube = (depthDesc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+
+	// the shadow maps are typeless 24 bit depth
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = slices;
+	device->CreateShaderResourceView(depthTexture, &srvDesc, &depthView);
+	depthTexture->Release();
+
+	// -- Moments -----------------------------------------------------------------------------------------
+	// 32 bit floats, the positive warp squared goes up to exp(80)
+	D3D11_TEXTURE2D_DESC texDesc{};
+	texDesc.Width = size;
+	texDesc.Height = size;
+	texDesc.MipLevels = 0;
+	texDesc.ArraySize = slices;
+	texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS | (isCube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0);
+	device->CreateTexture2D(&texDesc, nullptr, &momentsTexture);
+	assert(momentsTexture);
+
+	srvDesc = {};
+	srvDesc.Format = texDesc.Format;
+	if (isCube) {
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = (UINT)-1;
+	}
+	else {
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = (UINT)-1;
+	}
+	device->CreateShaderResourceView(momentsTexture, &srvDesc, &momentsView);
+
+	// the first mip as an array, read by the horizontal blur
+	srvDesc = {};
+	srvDesc.Format = texDesc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = slices;
+	device->CreateShaderResourceView(momentsTexture, &srvDesc, &momentsArrayView);
+
+	// -- Temp --------------------------------------------------------------------------------------------
+	texDesc.MipLevels = 1;
+	texDesc.MiscFlags = 0;
+	device->CreateTexture2D(&texDesc, nullptr, &tempTexture);
+	assert(tempTexture);
+	device->CreateShaderResourceView(tempTexture, &srvDesc, &tempView);
+
+	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc{};
+	rtvDesc.Format = texDesc.Format;
+	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+	rtvDesc.Texture2DArray.MipSlice = 0;
+	rtvDesc.Texture2DArray.ArraySize = 1;
+	for (u32 i = 0; i < slices; ++i) {
+		rtvDesc.Texture2DArray.FirstArraySlice = i;
+		device->CreateRenderTargetView(momentsTexture, &rtvDesc, &momentsTargets[i]);
+		device->CreateRenderTargetView(tempTexture, &rtvDesc, &tempTargets[i]);
+	}
+
+	// trilinear, the mipmaps are the filtering
+	D3D11_SAMPLER_DESC samplerDesc{};
+	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MaxAnisotropy = 4;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&samplerDesc, &sampler);
+
+	// a quad that covers the map
+	mesh.moveFromMesh(new OrthoMesh(device, deviceContext, size, size));
+	projection = XMMatrixOrthographicLH((f32)size, (f32)size, -1.f, 1.f);
+
+	viewport.Width    = (f32)size;
+	viewport.Height   = (f32)size;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+}
+
+EvsmShadowMap::~EvsmShadowMap() {
+	DELETE_IF_NOT_NULL(momentsShader);
+	DELETE_IF_NOT_NULL(blurShader);
+
+	for (u32 i = 0; i < MAX_SLICES; ++i) {
+		RELEASE_IF_NOT_NULL(momentsTargets[i]);
+		RELEASE_IF_NOT_NULL(tempTargets[i]);
+	}
+	RELEASE_IF_NOT_NULL(depthView);
+	RELEASE_IF_NOT_NULL(momentsView);
+	RELEASE_IF_NOT_NULL(momentsArrayView);
+	RELEASE_IF_NOT_NULL(momentsTexture);
+	RELEASE_IF_NOT_NULL(tempView);
+	RELEASE_IF_NOT_NULL(tempTexture);
+	RELEASE_IF_NOT_NULL(sampler);
+}
+
+void EvsmShadowMap::update(DeviceContext *ctx) {
+	if (!momentsTexture) return;
+
+	mat4 identity = XMMatrixIdentity();
+	u32 scale = depthSize / size;
+
+	for (u32 slice = 0; slice < slices; ++slice) {
+		bindTarget(ctx, momentsTargets[slice]);
+		momentsShader->setShaderParameters(ctx, identity, identity, projection, depthView, nearZ, farZ, scale, slice);
+		momentsShader->render(ctx, mesh);
+
+		if (blurRadius) {
+			bindTarget(ctx, tempTargets[slice]);
+			blurShader->setShaderParameters(ctx, identity, identity, projection, momentsArrayView, 1, 0, blurRadius, slice);
+			blurShader->render(ctx, mesh);
+
+			bindTarget(ctx, momentsTargets[slice]);
+			blurShader->setShaderParameters(ctx, identity, identity, projection, tempView, 0, 1, blurRadius, slice);
+			blurShader->render(ctx, mesh);
+		}
+	}
+
+	ID3D11RenderTargetView *nullRTV = nullptr;
+	ctx->OMSetRenderTargets(1, &nullRTV, nullptr);
+	ctx->GenerateMips(momentsView);
+	// the targets and the mipmaps were set on the context behind the cache's back
+	stateCache.invalidate();
+}
+
+// -- Private ------------------------------------------------------------------
+
+void EvsmShadowMap::bindTarget(DeviceContext *ctx, ID3D11RenderTargetView *target) {
+	// the same texture could still be bound as the source of the last pass
+	stateCache.unbindShaderResources();
+	ctx->RSSetViewports(1, &viewport);
+	ctx->OMSetRenderTargets(1, &target, nullptr);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "DefaultShader.h"
+#include "ShadowMoments.h"
+
+struct MomentsBufferType {
+	float nearZ;
+	float farZ;
+	u32 scale;
+	u32 slice;
+};
+
+struct MomentsBlurBufferType {
+	i32 direction[2];
+	u32 radius;
+	u32 slice;
+};
+
+/* Converts a slice of a depth map to moments, see ShadowMoments::downsample */
+class MomentsShader : public DefaultShader {
+public:
+	MomentsShader(Device *device, HWND hwnd);
+	~MomentsShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *depthArray, f32 nearZ, f32 farZ, u32 scale, u32 slice);
+
+private:
+	void initShader(const wchar_t *ps);
+
+	ID3D11Buffer *momentsBuffer = nullptr;
+};
+
+/* One direction of the separable blur, see ShadowMoments::blur */
+class MomentsBlurShader : public DefaultShader {
+public:
+	MomentsBlurShader(Device *device, HWND hwnd);
+	~MomentsBlurShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, TextureType *source, i32 dirX, i32 dirY, u32 radius, u32 slice);
+
+private:
+	void initShader(const wchar_t *ps);
+
+	ID3D11Buffer *blurBuffer = nullptr;
+};
+
+/* The moments of a depth map drawn with a perspective projection, for
+ * the lights that filter their shadows with EVSM (see ShadowMoments).
+ * After the depth is drawn update() converts it to moments at a lower
+ * resolution, blurs them in two passes and builds the mipmaps, the
+ * shaders then sample them with a trilinear filter.
+ * A cube depth map (OmniShadowMap) gives cube moments, every face is
+ * converted and blurred on its own.
+ */
+class EvsmShadowMap {
+public:
+	// depth is the map's depth view, size the resolution of the moments
+	void init(Device *device, DeviceContext *deviceContext, HWND hwnd, ID3D11DepthStencilView *depth, u32 size, f32 nearZ, f32 farZ);
+	~EvsmShadowMap();
+
+	// Converts the depth to moments, blurs them and builds the mipmaps
+	void update(DeviceContext *ctx);
+
+	// A Texture2D, or a TextureCube for cube depth maps
+	TextureType *getMoments() { return momentsView; }
+	ID3D11SamplerState *getSampler() { return sampler; }
+	f32 getNearZ() const { return nearZ; }
+	f32 getFarZ() const { return farZ; }
+
+	void setFilter(ShadowMoments::Filter newFilter) { filter = newFilter; }
+	ShadowMoments::Filter getFilter() const { return filter; }
+	bool isEnabled() const { return filter == ShadowMoments::Filter::Evsm; }
+	ShadowMoments::Params &getParams() { return params; }
+	void setBlurRadius(u32 radius) { blurRadius = min(radius, (u32)ShadowMoments::MAX_BLUR_RADIUS); }
+	u32 getBlurRadius() const { return blurRadius; }
+
+private:
+	void bindTarget(DeviceContext *ctx, ID3D11RenderTargetView *target);
+
+	static constexpr u32 MAX_SLICES = 6;
+
+	MomentsShader *momentsShader = nullptr;
+	MomentsBlurShader *blurShader = nullptr;
+	MMesh mesh;
+	mat4 projection;
+	D3D11_VIEWPORT viewport;
+
+	// the depth map as an array, a cube map has six slices
+	TextureType *depthView = nullptr;
+	u32 depthSize = 0;
+	u32 slices = 1;
+	u32 size = 0;
+	f32 nearZ = 0.f;
+	f32 farZ = 1.f;
+
+	// moments with mipmaps, blurred through temp
+	ID3D11Texture2D *momentsTexture = nullptr;
+	TextureType *momentsView = nullptr;
+	TextureType *momentsArrayView = nullptr;
+	ID3D11RenderTargetView *momentsTargets[MAX_SLICES] = {};
+	ID3D11Texture2D *tempTexture = nullptr;
+	TextureType *tempView = nullptr;
+	ID3D11RenderTargetView *tempTargets[MAX_SLICES] = {};
+	ID3D11SamplerState *sampler = nullptr;
+
+	ShadowMoments::Filter filter = ShadowMoments::Filter::Hard;
+	ShadowMoments::Params params;
+	u32 blurRadius = 2;
+};
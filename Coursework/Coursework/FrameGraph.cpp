@@ -0,0 +1,274 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+
+#include "RenderBackend.h"
+#include "tracelog.h"
+
+FrameGraph::~FrameGraph() {
+	setAllocator(nullptr);
+}
+
+void FrameGraph::setAllocator(FrameGraphAllocator *newAllocator) {
+	for (Physical &phys : physicals) {
+		if (allocator && phys.texture) {
+			allocator->releaseTexture(phys.texture);
+		}
+	}
+	physicals.clear();
+	allocator = newAllocator;
+}
+
+void FrameGraph::reset() {
+	resources.clear();
+	passes.clear();
+	compiled = false;
+}
+
+FrameGraphResource FrameGraph::importTexture(const char *name, void *texture) {
+	Resource res;
+	res.name = name;
+	res.imported = texture;
+	res.isImported = true;
+	resources.push_back(std::move(res));
+	return (FrameGraphResource)resources.size() - 1;
+}
+
+FrameGraphResource FrameGraph::createTexture(const char *name, const FrameGraphTextureDesc &desc) {
+	Resource res;
+	res.name = name;
+	res.desc = desc;
+	resources.push_back(std::move(res));
+	return (FrameGraphResource)resources.size() - 1;
+}
+
+void FrameGraph::setOutput(FrameGraphResource resource) {
+	resources[resource].isOutput = true;
+}
+
+u32 FrameGraph::addPass(const char *name, Execute execute) {
+	Pass pass;
+	pass.name = name;
+	pass.execute = std::move(execute);
+	passes.push_back(std::move(pass));
+	compiled = false;
+	return (u32)passes.size() - 1;
+}
+
+void FrameGraph::read(u32 pass, FrameGraphResource resource) {
+	Resource &res = resources[resource];
+	// passes run in the order they are added, so the writer must come first
+	if (!res.isImported && res.writers.empty()) {
+		warn("Pass %s reads %s before anything writes it", passes[pass].name.c_str(), res.name.c_str());
+	}
+	passes[pass].reads.push_back(resource);
+	res.readers++;
+}
+
+void FrameGraph::write(u32 pass, FrameGraphResource resource) {
+	passes[pass].writes.push_back(resource);
+	resources[resource].writers.push_back(pass);
+}
+
+bool FrameGraph::compile() {
+	stats = Stats();
+	stats.passes = (u32)passes.size();
+
+	cullPasses();
+	computeLifetimes();
+	assignPhysical();
+	releaseUnused();
+
+	// physical textures are created the first time they are needed, before
+	// execute() so the passes can be recorded ahead of it
+	for (Physical &phys : physicals) {
+		if (phys.used && !phys.texture && allocator) {
+			phys.texture = allocator->createTexture(phys.desc);
+			stats.createdTextures++;
+		}
+	}
+
+	compiled = true;
+	return true;
+}
+
+void FrameGraph::execute(RenderBackend *backend) {
+	if (!compiled) {
+		err("Executing a frame graph that wasn't compiled");
+		return;
+	}
+
+	for (Pass &pass : passes) {
+		if (pass.culled) continue;
+		if (backend) backend->marker(pass.name.c_str());
+		if (pass.execute) pass.execute();
+	}
+}
+
+void *FrameGraph::getTexture(FrameGraphResource resource) {
+	const Resource &res = resources[resource];
+	if (res.isImported) return res.imported;
+	if (res.physical == FRAME_GRAPH_NONE) return nullptr;
+	return physicals[res.physical].texture;
+}
+
+std::string FrameGraph::dump() const {
+	std::string out;
+
+	auto physicalName = [this](const Resource &res) {
+		return res.isImported ? std::string("imported") : "#" + std::to_string(res.physical);
+	};
+
+	for (u32 p = 0; p < (u32)passes.size(); ++p) {
+		const Pass &pass = passes[p];
+		out += pass.name;
+		if (pass.culled) {
+			out += " (culled)\n";
+			continue;
+		}
+		out += "\n";
+
+		for (FrameGraphResource r : pass.writes) {
+			const Resource &res = resources[r];
+			if (res.firstUse == p) out += "  acquire " + res.name + " -> " + physicalName(res) + "\n";
+		}
+		for (FrameGraphResource r : pass.reads) {
+			out += "  read    " + resources[r].name + "\n";
+		}
+		for (FrameGraphResource r : pass.writes) {
+			out += "  write   " + resources[r].name + "\n";
+		}
+
+		// resources whose lifetime ends here
+		for (const Resource &res : resources) {
+			if (!res.isImported && res.lastUse == p) {
+				out += "  release " + res.name + " (" + physicalName(res) + ")\n";
+			}
+		}
+	}
+
+	return out;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+void FrameGraph::cullPasses() {
+	// a pass is needed as long as one of the resources it writes is read
+	std::vector<u32> refCounts(resources.size());
+	std::vector<FrameGraphResource> unused;
+
+	for (Pass &pass : passes) {
+		pass.refCount = (u32)pass.writes.size();
+		pass.culled = false;
+	}
+
+	for (FrameGraphResource r = 0; r < (FrameGraphResource)resources.size(); ++r) {
+		refCounts[r] = resources[r].readers + (resources[r].isOutput ? 1 : 0);
+		if (refCounts[r] == 0) unused.push_back(r);
+	}
+
+	while (!unused.empty()) {
+		FrameGraphResource r = unused.back();
+		unused.pop_back();
+
+		for (u32 writer : resources[r].writers) {
+			Pass &pass = passes[writer];
+			if (pass.refCount == 0 || --pass.refCount > 0) continue;
+
+			// nothing needs this pass, the resources it reads lose a reader
+			pass.culled = true;
+			stats.culledPasses++;
+			for (FrameGraphResource read : pass.reads) {
+				if (refCounts[read] > 0 && --refCounts[read] == 0) {
+					unused.push_back(read);
+				}
+			}
+		}
+	}
+
+	// passes that write nothing are kept, they must have some other effect
+}
+
+void FrameGraph::computeLifetimes() {
+	for (Resource &res : resources) {
+		res.firstUse = FRAME_GRAPH_NONE;
+		res.lastUse = FRAME_GRAPH_NONE;
+		res.physical = FRAME_GRAPH_NONE;
+	}
+
+	auto use = [this](FrameGraphResource r, u32 pass) {
+		Resource &res = resources[r];
+		if (res.firstUse == FRAME_GRAPH_NONE) res.firstUse = pass;
+		res.lastUse = pass;
+	};
+
+	for (u32 p = 0; p < (u32)passes.size(); ++p) {
+		if (passes[p].culled) continue;
+		for (FrameGraphResource r : passes[p].reads) use(r, p);
+		for (FrameGraphResource r : passes[p].writes) use(r, p);
+	}
+}
+
+void FrameGraph::assignPhysical() {
+	for (Physical &phys : physicals) {
+		phys.busyUntil = 0;
+		phys.used = false;
+	}
+
+	// by first use, so every resource takes a texture freed by an earlier one
+	std::vector<FrameGraphResource> order;
+	for (FrameGraphResource r = 0; r < (FrameGraphResource)resources.size(); ++r) {
+		const Resource &res = resources[r];
+		if (!res.isImported && res.firstUse != FRAME_GRAPH_NONE) {
+			order.push_back(r);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [this](FrameGraphResource a, FrameGraphResource b) {
+		return resources[a].firstUse < resources[b].firstUse;
+	});
+
+	for (FrameGraphResource r : order) {
+		Resource &res = resources[r];
+
+		u32 found = FRAME_GRAPH_NONE;
+		for (u32 i = 0; i < (u32)physicals.size(); ++i) {
+			const Physical &phys = physicals[i];
+			if (phys.desc == res.desc && phys.busyUntil <= res.firstUse) {
+				// prefer the textures that already exist
+				if (found == FRAME_GRAPH_NONE || (phys.texture && !physicals[found].texture)) {
+					found = i;
+				}
+			}
+		}
+
+		if (found == FRAME_GRAPH_NONE) {
+			Physical phys;
+			phys.desc = res.desc;
+			physicals.push_back(phys);
+			found = (u32)physicals.size() - 1;
+		}
+
+		Physical &phys = physicals[found];
+		phys.busyUntil = res.lastUse + 1;
+		if (!phys.used) stats.physicalTextures++;
+		phys.used = true;
+		res.physical = found;
+		stats.transientResources++;
+	}
+}
+
+void FrameGraph::releaseUnused() {
+	for (Physical &phys : physicals) {
+		phys.unusedFrames = phys.used ? 0 : phys.unusedFrames + 1;
+
+		if (phys.unusedFrames >= FRAMES_BEFORE_RELEASE && phys.texture) {
+			if (allocator) allocator->releaseTexture(phys.texture);
+			phys.texture = nullptr;
+		}
+	}
+
+	// only the slots at the end can be removed, the others keep their index
+	while (!physicals.empty() && !physicals.back().used && !physicals.back().texture) {
+		physicals.pop_back();
+	}
+}
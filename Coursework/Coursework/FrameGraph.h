@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "types.h"
+
+class RenderBackend;
+
+using FrameGraphResource = u32;
+static constexpr FrameGraphResource FRAME_GRAPH_NONE = 0xFFFFFFFF;
+
+// Textures with the same desc are interchangeable, and can be aliased
+struct FrameGraphTextureDesc {
+	u32 width = 0;
+	u32 height = 0;
+	u32 format = 0;
+
+	bool operator==(const FrameGraphTextureDesc &other) const {
+		return width == other.width && height == other.height && format == other.format;
+	}
+};
+
+// Creates the textures the graph asks for, the graph only uses them as opaque pointers
+class FrameGraphAllocator {
+public:
+	virtual ~FrameGraphAllocator() = default;
+	virtual void *createTexture(const FrameGraphTextureDesc &desc) = 0;
+	virtual void releaseTexture(void *texture) = 0;
+};
+
+/* Declarative description of a frame.
+ * Every frame the passes are added in the order they should run, with the
+ * resources they read and write, then compile():
+ * - culls the passes whose results are never read (directly or through
+ *   other passes) by an output
+ * - finds the first and last pass that uses every transient resource
+ * - assigns the transient resources to physical textures: resources with
+ *   the same desc whose lifetimes don't overlap share the same texture
+ * execute() then runs the passes that are left. Inside a pass getTexture()
+ * returns the physical texture of a resource.
+ * The physical textures are kept between frames, so a graph that doesn't
+ * change doesn't create anything after the first frame. Textures that are
+ * not used for a few frames are released.
+ * Imported resources (back buffer, shadow maps) are owned by the caller and
+ * are never aliased.
+ * compile() creates the textures that are missing, so the passes can be
+ * recorded on other threads before execute(). It doesn't need an
+ * allocator, so it can be tested headless.
+ */
+class FrameGraph {
+public:
+	using Execute = std::function<void()>;
+
+	// A texture is released after this many compiles without being used
+	static constexpr u32 FRAMES_BEFORE_RELEASE = 8;
+
+	struct Stats {
+		u32 passes = 0;
+		u32 culledPasses = 0;
+		u32 transientResources = 0;
+		u32 physicalTextures = 0; // used this frame
+		u32 createdTextures = 0;  // created this frame
+	};
+
+	~FrameGraph();
+
+	// Releases all the textures, the allocator must outlive the graph
+	void setAllocator(FrameGraphAllocator *newAllocator);
+	// Removes the passes and resources, keeps the physical textures
+	void reset();
+
+	FrameGraphResource importTexture(const char *name, void *texture);
+	FrameGraphResource createTexture(const char *name, const FrameGraphTextureDesc &desc);
+	// Outputs are never culled, nor the passes that contribute to them
+	void setOutput(FrameGraphResource resource);
+
+	u32 addPass(const char *name, Execute execute);
+	void read(u32 pass, FrameGraphResource resource);
+	void write(u32 pass, FrameGraphResource resource);
+
+	bool compile();
+	// Runs the passes that were not culled, names them with a marker on backend if it isn't null
+	void execute(RenderBackend *backend = nullptr);
+
+	// Physical texture of a resource, valid from compile() to the next reset()
+	void *getTexture(FrameGraphResource resource);
+	template<typename T>
+	T *getTexture(FrameGraphResource resource) { return (T *)getTexture(resource); }
+
+	bool isCulled(u32 pass) const { return passes[pass].culled; }
+	// Index of the physical texture, FRAME_GRAPH_NONE for imported resources
+	u32 getPhysicalIndex(FrameGraphResource resource) const { return resources[resource].physical; }
+	// Pass indices, FRAME_GRAPH_NONE if the resource is never used
+	u32 getFirstUse(FrameGraphResource resource) const { return resources[resource].firstUse; }
+	u32 getLastUse(FrameGraphResource resource) const { return resources[resource].lastUse; }
+
+	// Compiled schedule: every pass with the textures it acquires and releases
+	std::string dump() const;
+	const Stats &getStats() const { return stats; }
+
+private:
+	struct Resource {
+		std::string name;
+		FrameGraphTextureDesc desc;
+		void *imported = nullptr;
+		bool isImported = false;
+		bool isOutput = false;
+		std::vector<u32> writers;
+		u32 readers = 0;
+		u32 firstUse = FRAME_GRAPH_NONE;
+		u32 lastUse = FRAME_GRAPH_NONE;
+		u32 physical = FRAME_GRAPH_NONE;
+	};
+
+	struct Pass {
+		std::string name;
+		Execute execute;
+		std::vector<FrameGraphResource> reads;
+		std::vector<FrameGraphResource> writes;
+		u32 refCount = 0;
+		bool culled = false;
+	};
+
+	struct Physical {
+		FrameGraphTextureDesc desc;
+		void *texture = nullptr;
+		u32 busyUntil = 0; // last pass using it this frame, + 1
+		u32 unusedFrames = 0;
+		bool used = false;
+	};
+
+	void cullPasses();
+	void computeLifetimes();
+	void assignPhysical();
+	void releaseUnused();
+
+	FrameGraphAllocator *allocator = nullptr;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Physical> physicals;
+	bool compiled = false;
+	Stats stats;
+};
@@ -0,0 +1,83 @@
+#include "FramePipeline.h"
+
+#include <chrono>
+
+FramePipeline::~FramePipeline() {
+	sync();
+}
+
+void FramePipeline::init(Stage prepareStage, Stage updateStage, Stage renderStage, JobSystem *jobSystem) {
+	sync();
+	prepare = std::move(prepareStage);
+	update = std::move(updateStage);
+	render = std::move(renderStage);
+	jobs = jobSystem;
+	hasReady = false;
+	frameIndex = 0;
+	packetIndex = 0;
+	stats = Stats();
+}
+
+void FramePipeline::setPipelined(bool enabled) {
+	sync();
+	pipelined = enabled;
+}
+
+void FramePipeline::frame() {
+	using namespace std::chrono;
+	auto start = high_resolution_clock::now();
+
+	// the packet that is about to be prepared could still be updating
+	sync();
+	stats.waitMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+
+	if (pipelined && jobs) {
+		// the first frame has nothing older to render, the pipeline is filled
+		// with a packet updated in order first
+		if (!hasReady) {
+			u32 first = prepareNext();
+			if (update) update(first);
+			readySlot = first;
+			hasReady = true;
+		}
+
+		u32 slot = prepareNext();
+		updating = true;
+		updatingSlot = slot;
+		jobs->run([this, slot]() {
+			if (update) update(slot);
+		}, &inFlight);
+	}
+	else {
+		u32 slot = prepareNext();
+		if (update) update(slot);
+		readySlot = slot;
+		hasReady = true;
+	}
+
+	stats.latency = (u32)(frameIndex - packetFrame[readySlot]);
+	// every packet is only rendered once, a sync() in the render makes the next one ready
+	hasReady = false;
+	if (render) render(readySlot);
+
+	frameIndex++;
+	stats.frames++;
+	stats.frameMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+}
+
+void FramePipeline::sync() {
+	if (!updating) return;
+
+	// the packet can only be rendered once the update is done with it
+	jobs->wait(&inFlight);
+	readySlot = updatingSlot;
+	hasReady = true;
+	updating = false;
+}
+
+u32 FramePipeline::prepareNext() {
+	u32 slot = (u32)(packetIndex++ % SLOTS);
+	packetFrame[slot] = frameIndex;
+	if (prepare) prepare(slot);
+	return slot;
+}
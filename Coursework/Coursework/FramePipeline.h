@@ -0,0 +1,74 @@
+#pragma once
+
+#include <functional>
+
+#include "types.h"
+#include "JobSystem.h"
+
+/* Splits a frame in an update stage and a render stage that can overlap.
+ * Every frame writes one of SLOTS packets (the caller owns them, the
+ * pipeline only passes the index):
+ * - prepare(slot) runs on the main thread with nothing else in flight,
+ *   this is where the packet takes a copy of everything the update reads.
+ * - update(slot) fills the rest of the packet, it must only touch the
+ *   packet and state that nothing else changes while it runs.
+ * - render(slot) consumes a packet that has been completely updated.
+ * When pipelined the update of frame N runs as a job while frame N - 1 is
+ * rendered on the main thread, so a packet is rendered at most one frame
+ * after it was prepared. The first pipelined frame has nothing to render
+ * yet, it prepares and updates a packet in order before the one it starts,
+ * so no packet is rendered twice. When not pipelined every stage runs in
+ * order on the main thread, which gives the same results as before the
+ * split.
+ */
+class FramePipeline {
+public:
+	using Stage = std::function<void(u32 slot)>;
+
+	static constexpr u32 SLOTS = 2;
+
+	struct Stats {
+		f64 frameMs = 0.0;
+		f64 waitMs = 0.0; // main thread waiting for the update of the previous frame
+		u64 frames = 0;
+		u32 latency = 0;  // frames between preparing and rendering the last packet
+	};
+
+	~FramePipeline();
+
+	// jobs must be started, the stages are only called from frame()
+	void init(Stage prepare, Stage update, Stage render, JobSystem *jobs = &jobSystem);
+
+	// Waits for the update in flight before switching
+	void setPipelined(bool pipelined);
+	bool isPipelined() const { return pipelined; }
+
+	void frame();
+	// Waits for the update in flight, after this the state it reads can be changed
+	void sync();
+
+	const Stats &getStats() const { return stats; }
+
+private:
+	// Prepares the packet in the next slot
+	u32 prepareNext();
+
+	Stage prepare;
+	Stage update;
+	Stage render;
+	JobSystem *jobs = nullptr;
+
+	bool pipelined = true;
+	JobCounter inFlight;
+	bool updating = false;
+	u32 updatingSlot = 0;
+	// slot of the last packet that was completely updated and not rendered yet
+	u32 readySlot = 0;
+	bool hasReady = false;
+
+	u64 frameIndex = 0;
+	u64 packetIndex = 0;
+	u64 packetFrame[SLOTS] = {};
+
+	Stats stats;
+};
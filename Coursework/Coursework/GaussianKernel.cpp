@@ -0,0 +1,86 @@
+#include "GaussianKernel.h"
+
+#include <math.h>
+
+#include "MathUtils.h"
+
+u32 GaussianKernel::getRadius(f32 sigma) {
+	if (sigma <= 0.f) return 0;
+	return min((u32)ceilf(sigma * 3.f), (u32)MAX_RADIUS);
+}
+
+void GaussianKernel::getWeights(f32 sigma, std::vector<f32> &weights) {
+	u32 radius = getRadius(sigma);
+	weights.assign(radius + 1, 0.f);
+	if (!radius) {
+		weights[0] = 1.f;
+		return;
+	}
+
+	f32 total = 0.f;
+	for (u32 i = 0; i <= radius; ++i) {
+		weights[i] = expf(-(f32)(i * i) / (2.f * sigma * sigma));
+		total += i ? weights[i] * 2.f : weights[i];
+	}
+	for (f32 &weight : weights) weight /= total;
+}
+
+void GaussianKernel::getLinearTaps(const std::vector<f32> &weights, std::vector<Tap> &taps) {
+	taps.clear();
+	if (weights.empty()) return;
+
+	taps.push_back({ 0.f, weights[0] });
+	for (u32 a = 1; a < weights.size(); a += 2) {
+		u32 b = a + 1;
+		// the last texel is on its own when the radius is odd
+		if (b >= weights.size()) {
+			taps.push_back({ (f32)a, weights[a] });
+			break;
+		}
+
+		f32 weight = weights[a] + weights[b];
+		taps.push_back({ a + weights[b] / weight, weight });
+	}
+}
+
+void GaussianKernel::getLinearTaps(f32 sigma, std::vector<Tap> &taps) {
+	std::vector<f32> weights;
+	getWeights(sigma, weights);
+	getLinearTaps(weights, taps);
+}
+
+void GaussianKernel::convolve(const f32 *src, u32 count, const std::vector<f32> &weights, f32 *dst) {
+	const i32 last = (i32)count - 1;
+	const i32 radius = (i32)weights.size() - 1;
+
+	for (i32 x = 0; x <= last; ++x) {
+		f32 sum = src[x] * weights[0];
+		for (i32 i = 1; i <= radius; ++i) {
+			sum += (src[clamp(x - i, 0, last)] + src[clamp(x + i, 0, last)]) * weights[i];
+		}
+		dst[x] = sum;
+	}
+}
+
+void GaussianKernel::convolveLinear(const f32 *src, u32 count, const std::vector<Tap> &taps, f32 *dst, u32 fractionBits) {
+	const i32 last = (i32)count - 1;
+	const f32 steps = (f32)(1u << fractionBits);
+
+	// like the sampler: the two texels around the position, each one clamped
+	auto sample = [&](f32 position) {
+		f32 base = floorf(position);
+		f32 t = position - base;
+		if (fractionBits) t = roundf(t * steps) / steps;
+		f32 a = src[clamp((i32)base, 0, last)];
+		f32 b = src[clamp((i32)base + 1, 0, last)];
+		return a + (b - a) * t;
+	};
+
+	for (i32 x = 0; x <= last; ++x) {
+		f32 sum = src[x] * taps[0].weight;
+		for (u32 i = 1; i < taps.size(); ++i) {
+			sum += (sample(x - taps[i].offset) + sample(x + taps[i].offset)) * taps[i].weight;
+		}
+		dst[x] = sum;
+	}
+}
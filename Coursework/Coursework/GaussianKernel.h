@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+/* Weights of a normalized gaussian blur for any sigma, and the same
+ * kernel with linear sampling.
+ * The discrete kernel has a weight for every texel from the centre to
+ * the radius (3 sigma), the other side is the same. The bilinear filter
+ * of the sampler can read two texels with one fetch: sampled between a
+ * and b at a + w(b) / (w(a) + w(b)) it returns their weighted average,
+ * so every two texels past the centre become one tap with the sum of
+ * their weights. The kernel is then the same with about half the fetches.
+ * The taps are what the blur shaders read from their constant buffer,
+ * the offsets are in texels.
+ */
+class GaussianKernel {
+public:
+	static constexpr u32 MAX_RADIUS = 32;
+	// the centre plus the pairs of texels on one side, matches BLUR_MAX_TAPS in cbuffers.hlsli
+	static constexpr u32 MAX_TAPS = MAX_RADIUS / 2 + 1;
+
+	struct Tap {
+		f32 offset;
+		f32 weight;
+	};
+
+	// Texels on each side of the centre, 3 sigma
+	static u32 getRadius(f32 sigma);
+	// Weights from the centre to the radius, the centre plus twice the rest is 1
+	static void getWeights(f32 sigma, std::vector<f32> &weights);
+	// Folds the weights in pairs after the centre, the first tap is the centre
+	static void getLinearTaps(const std::vector<f32> &weights, std::vector<Tap> &taps);
+	static void getLinearTaps(f32 sigma, std::vector<Tap> &taps);
+
+	// One row blurred with the weights, the texels past the edges are clamped
+	static void convolve(const f32 *src, u32 count, const std::vector<f32> &weights, f32 *dst);
+	// The same with the taps read like a bilinear sampler, the fraction is
+	// rounded to fractionBits if it isn't 0 (the gpus have 8)
+	static void convolveLinear(const f32 *src, u32 count, const std::vector<Tap> &taps, f32 *dst, u32 fractionBits = 0);
+};
@@ -13,6 +13,7 @@ GrassShader::GrassShader(Device *device, HWND hwnd)
 GrassShader::~GrassShader() {
 	RELEASE_IF_NOT_NULL(grassBuffer);
 	RELEASE_IF_NOT_NULL(groundBuffer);
+	RELEASE_IF_NOT_NULL(windSampler);
 }
 
 void GrassShader::setShaderParameters(
@@ -34,10 +35,10 @@ void GrassShader::setShaderParameters(
 	// == GROUND BUFFER ==========================
 
 	auto groundPtr = mapBuffer<GroundBufferType>(ctx, groundBuffer);
-	groundPtr->cameraPos  = camPos;
-	groundPtr->cutoffDist = cutoffDist;
-	groundPtr->maxDist    = maxDist;
-	groundPtr->maxFactor  = maxFactor;
+	groundPtr->cameraPos      = camPos;
+	groundPtr->cutoffDistance = cutoffDist;
+	groundPtr->maxDist        = maxDist;
+	groundPtr->maxFactor      = maxFactor;
 	unmapBufferHS(ctx, groundBuffer, 0);
 
 	// == MATRIX BUFFER =========================
@@ -72,9 +73,8 @@ void GrassShader::setShaderParameters(
 	auto grassPtr = mapBuffer<GrassBufferType>(ctx, grassBuffer);
 	grassPtr->timePassed = windData.timePassed;
 	grassPtr->windOrigin = windData.windOrigin;
-	grassPtr->windSpeed = windData.windSpeed;
-	grassPtr->waveAmplitude = windData.waveAmplitude;
-	grassPtr->padding = { 0, 0 };
+	grassPtr->windFieldSize = windData.windFieldSize;
+	grassPtr->windStrength = windData.windStrength;
 	mat4 spotView = lights[SPOT_LIGHT].getViewMatrix();
 	mat4 spotProj = lights[SPOT_LIGHT].getProjectionMatrix();
 	grassPtr->spotLightMVP = XMMatrixTranspose(spotView * spotProj);
@@ -83,34 +83,7 @@ void GrassShader::setShaderParameters(
 	if (!isDepth) {
 		// == LIGHT BUFFER ===========================
 		auto lightPtr = mapBuffer<LightBufferType>(ctx, lightBuffer);
-		lightPtr->pointLightPos = lights[POINT_LIGHT].getPosition();
-		for (int i = 0; i < LIGHTS_COUNT; ++i) {
-			switch (i) {
-			case DIR_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = 0.f;
-				break;
-			case SPOT_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = lights[i].getSpotCutoff();
-				break;
-			}
-
-			auto &lightData = lightPtr->sharedLightData[i];
-			auto &factors = lightPtr->factor[i];
-			auto &factor = lightFactors[lights[i].getLightStrength()];
-
-			lightData.ambient = lights[i].getAmbientColour();
-			lightData.diffuse = lights[i].getDiffuseColour();
-			lightData.specular = lights[i].getSpecularColour();
-			float3 pos = lights[i].getPosition();
-			lightData.position = { pos.x, pos.y, pos.z, 1.f };
-
-			factors.specularPower = lights[i].getSpecularPower();
-			factors.constant = factor.constant;
-			factors.linear = factor.linear;
-			factors.quadratic = factor.quadratic;
-		}
+		fillLightBuffer(lightPtr, lights);
 		unmapBufferPS(ctx, lightBuffer, 0);
 
 		// == SHADER RESOURCES =======================
@@ -119,16 +92,21 @@ void GrassShader::setShaderParameters(
 		TextureType *pointTexture = pointShadow.getCubemap();
 
 		// Set shader texture resource in the pixel shader.
-		ctx->PSSetShaderResources(0, 1, &grassTexture);
-		ctx->PSSetShaderResources(1, 1, &spotTexture);
-		ctx->PSSetShaderResources(2, 1, &pointTexture);
-		ctx->PSSetSamplers(0, 1, &sampleState);
-		ctx->PSSetSamplers(1, 1, &shadowMapSampler);
+		TextureType *textures[] = { grassTexture, spotTexture, pointTexture };
+		ID3D11SamplerState *samplers[] = { sampleState, shadowMapSampler };
+		stateCache.setShaderResources(ShaderStage::Pixel, 0, ARR_LEN(textures), textures);
+		stateCache.setSamplers(ShaderStage::Pixel, 0, ARR_LEN(samplers), samplers);
+
+		setSunShadowParameters(ctx);
+		setClusterParameters(ctx);
+		setShadowFilterParameters(ctx);
 	}
 
 	// == GEOMETRY SHADER RESOURCES =============
-	ctx->GSSetShaderResources(0, 1, &grassPattern);
-	ctx->GSSetSamplers(0, 1, &sampleState);
+	TextureType *gsTextures[] = { grassPattern, windData.windField };
+	ID3D11SamplerState *gsSamplers[] = { sampleState, windSampler };
+	stateCache.setShaderResources(ShaderStage::Geometry, 0, ARR_LEN(gsTextures), gsTextures);
+	stateCache.setSamplers(ShaderStage::Geometry, 0, ARR_LEN(gsSamplers), gsSamplers);
 }
 
 void GrassShader::render(DeviceContext *ctx, MMesh &mesh) {
@@ -139,54 +117,46 @@ void GrassShader::render(DeviceContext *ctx, MMesh &mesh) {
 	uint stride = sizeof(MMesh::PubVertexType);
 	uint offset = 0;
 
-	ctx->IASetVertexBuffers(0, 1, &vbuf, &stride, &offset);
-	ctx->IASetIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
-	ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+	stateCache.setVertexBuffers(0, 1, &vbuf, &stride, &offset);
+	stateCache.setIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
+	stateCache.setTopology(D3D_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
 
 	// == RENDER =================================
 
 	// Set the vertex input layout.
-	ctx->IASetInputLayout(layout);
+	stateCache.setInputLayout(layout);
 
 	// Set the vertex and pixel shaders that will be used to render.
 	if (isDepth) {
-		ctx->VSSetShader(vertexDepthShader, NULL, 0);
-		ctx->PSSetShader(NULL, NULL, 0);
+		stateCache.setVertexShader(vertexDepthShader);
+		stateCache.setPixelShader(NULL);
 	}
 	else {
-		ctx->VSSetShader(vertexShader, NULL, 0);
-		ctx->PSSetShader(pixelShader, NULL, 0);
+		stateCache.setVertexShader(vertexShader);
+		stateCache.setPixelShader(pixelShader);
 	}
-	ctx->CSSetShader(NULL, NULL, 0);
+	stateCache.setComputeShader(NULL);
 
 	// if Hull shader is not null then set HS and DS
 	if (hullShader) {
-		ctx->HSSetShader(hullShader, NULL, 0);
-		ctx->DSSetShader(domainShader, NULL, 0);
+		stateCache.setHullShader(hullShader);
+		stateCache.setDomainShader(domainShader);
 	}
 	else {
-		ctx->HSSetShader(NULL, NULL, 0);
-		ctx->DSSetShader(NULL, NULL, 0);
+		stateCache.setHullShader(NULL);
+		stateCache.setDomainShader(NULL);
 	}
 
-	// if geometry shader is not null then set GS
-	if (geometryShader) {
-		ctx->GSSetShader(geometryShader, NULL, 0);
+	// the omni depth pass replaces the geometry shader, if there is one
+	if (isOmni) {
+		stateCache.setGeometryShader(omniDepthGSShader);
 	}
 	else {
-		ctx->GSSetShader(NULL, NULL, 0);
-	}
-
-	if (isOmni) {
-		ctx->GSSetShader(omniDepthGSShader, NULL, 0);
+		stateCache.setGeometryShader(geometryShader);
 	}
 
 	// Render the triangle.
-	ctx->DrawIndexed(mesh.getIndexCount(), 0, 0);
-
-	// unbind shader resources
-	TextureType *nullTEX[LIGHTS_COUNT + 1] = { 0 };
-	ctx->PSSetShaderResources(0, LIGHTS_COUNT + 1, nullTEX);
+	stateCache.getBackend()->drawIndexed(mesh.getIndexCount(), 0, 0);
 }
 
 void GrassShader::initShader(
@@ -204,14 +174,18 @@ void GrassShader::initShader(
 
 	loadDepthShader(vs);
 
-	addDynamicBuffer<GrassBufferType>(&grassBuffer);
-	addDynamicBuffer<GroundBufferType>(&groundBuffer);
+	addDynamicBuffer<GrassBufferType>(&grassBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<GroundBufferType>(&groundBuffer, ConstantUsage::Frame);
 	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
-	addDynamicBuffer<DefaultBufferType>(&defaultBuffer);
-	addDynamicBuffer<LightBufferType>(&lightBuffer);
+	addDynamicBuffer<DefaultBufferType>(&defaultBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<LightBufferType>(&lightBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<CascadeBufferType>(&cascadeBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ClusterBufferType>(&clusterBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ShadowFilterBufferType>(&shadowFilterBuffer, ConstantUsage::Frame);
 
 	addDiffuseSampler();
 	addShadowSampler();
+	addClampSampler(&windSampler);
 }
 
 /*
@@ -6,10 +6,14 @@
 struct WindData {
 	float timePassed;
 	float3 windOrigin;
-	float windSpeed;
-	float waveAmplitude;
+	TextureType *windField; // velocity texture from the Wind simulation
+	float windFieldSize;
+	float windStrength;
 };
 
+// Read by ground_hs.hlsl, the grass and the ground are tessellated the same way
+CBUFFER(GroundBuffer, b0, GROUND_BUFFER)
+
 /* Grass shader uses a geometry shader to create grass geometry 
  * dynamically at runtime.
  * For every triangle in a plane, it checks if it's pixel on the 
@@ -17,24 +21,10 @@ struct WindData {
  * grass is not rendered, otherwise it is.
  * The shader uses pseudo random number generation to make every
  * grass' height, rotation and color slightly randomized.
+ * The top of the grass is bent by the velocity in the wind field.
  */
 class GrassShader : public DefaultShader {
-	struct GrassBufferType {
-		float timePassed;
-		float3 windOrigin;
-		float windSpeed;
-		float waveAmplitude;
-		float2 padding;
-		mat4 spotLightMVP;
-	};
-
-	struct GroundBufferType {
-		float3 cameraPos;
-		float cutoffDist;
-		float maxDist;
-		float maxFactor;
-		float2 padding = { 0, 0 };
-	};
+	CBUFFER(GrassBuffer, b2, GRASS_BUFFER)
 
 public:
 	GrassShader(Device *device, HWND hwnd);
@@ -48,4 +38,5 @@ private:
 
 	ID3D11Buffer *grassBuffer = nullptr;
 	ID3D11Buffer *groundBuffer = nullptr;
+	ID3D11SamplerState *windSampler = nullptr;
 };
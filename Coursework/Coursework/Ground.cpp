@@ -32,10 +32,10 @@ void GroundShader::setShaderParameters(
 	// == GROUND BUFFER ==========================
 
 	auto groundPtr = mapBuffer<GroundBufferType>(ctx, groundBuffer);
-	groundPtr->cameraPos  = cameraPos;
-	groundPtr->cutoffDist = cutoffDist;
-	groundPtr->maxDist    = maxDist;
-	groundPtr->maxFactor  = maxFactor;
+	groundPtr->cameraPos      = cameraPos;
+	groundPtr->cutoffDistance = cutoffDist;
+	groundPtr->maxDist        = maxDist;
+	groundPtr->maxFactor      = maxFactor;
 	unmapBufferHS(ctx, groundBuffer, 0);
 
 	// == MATRIX BUFFER =========================
@@ -68,34 +68,7 @@ void GroundShader::setShaderParameters(
 	if (!isDepth) {
 		// == LIGHT BUFFER ===========================
 		auto lightPtr = mapBuffer<LightBufferType>(ctx, lightBuffer);
-		lightPtr->pointLightPos = lights[POINT_LIGHT].getPosition();
-		for (int i = 0; i < LIGHTS_COUNT; ++i) {
-			switch (i) {
-			case DIR_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = 0.f;
-				break;
-			case SPOT_LIGHT:
-				lightPtr->dirSpotData[i].lightDir = lights[i].getDirection();
-				lightPtr->dirSpotData[i].spotCutoff = lights[i].getSpotCutoff();
-				break;
-			}
-
-			auto &lightData = lightPtr->sharedLightData[i];
-			auto &factors = lightPtr->factor[i];
-			auto &factor = lightFactors[lights[i].getLightStrength()];
-
-			lightData.ambient = lights[i].getAmbientColour();
-			lightData.diffuse = lights[i].getDiffuseColour();
-			lightData.specular = lights[i].getSpecularColour();
-			float3 pos = lights[i].getPosition();
-			lightData.position = { pos.x, pos.y, pos.z, 1.f };
-
-			factors.specularPower = lights[i].getSpecularPower();
-			factors.constant = factor.constant;
-			factors.linear = factor.linear;
-			factors.quadratic = factor.quadratic;
-		}
+		fillLightBuffer(lightPtr, lights);
 		unmapBufferPS(ctx, lightBuffer, 0);
 
 
@@ -111,11 +84,14 @@ void GroundShader::setShaderParameters(
 		TextureType *pointTexture = pointShadow.getCubemap();
 
 		// Set shader texture resource in the pixel shader.
-		ctx->PSSetShaderResources(0, 1, &texture);
-		ctx->PSSetShaderResources(1, 1, &spotTexture);
-		ctx->PSSetShaderResources(2, 1, &pointTexture);
-		ctx->PSSetSamplers(0, 1, &sampleState);
-		ctx->PSSetSamplers(1, 1, &shadowMapSampler);
+		TextureType *textures[] = { texture, spotTexture, pointTexture };
+		ID3D11SamplerState *samplers[] = { sampleState, shadowMapSampler };
+		stateCache.setShaderResources(ShaderStage::Pixel, 0, ARR_LEN(textures), textures);
+		stateCache.setSamplers(ShaderStage::Pixel, 0, ARR_LEN(samplers), samplers);
+
+		setSunShadowParameters(ctx);
+		setClusterParameters(ctx);
+		setShadowFilterParameters(ctx);
 	}
 }
 
@@ -131,12 +107,15 @@ void GroundShader::initShader(
 	loadDomainShader(ds);
 	pixelShader = getDefaultPixelShader(this);
 
-	addDynamicBuffer<GroundBufferType>(&groundBuffer);
+	addDynamicBuffer<GroundBufferType>(&groundBuffer, ConstantUsage::Frame);
 	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
-	addDynamicBuffer<DefaultBufferType>(&defaultBuffer);
-	addDynamicBuffer<ShadowBufferType>(&shadowBuffer);
-	addDynamicBuffer<LightBufferType>(&lightBuffer);
+	addDynamicBuffer<DefaultBufferType>(&defaultBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ShadowBufferType>(&shadowBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<LightBufferType>(&lightBuffer, ConstantUsage::Frame);
 	addDynamicBuffer<MaterialBufferType>(&materialBuffer);
+	addDynamicBuffer<CascadeBufferType>(&cascadeBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ClusterBufferType>(&clusterBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<ShadowFilterBufferType>(&shadowFilterBuffer, ConstantUsage::Frame);
 	addDiffuseSampler();
 	addShadowSampler();
 }
@@ -149,50 +128,46 @@ void GroundShader::render(DeviceContext *ctx, MMesh &mesh) {
 	uint stride = sizeof(MMesh::PubVertexType);
 	uint offset = 0;
 
-	ctx->IASetVertexBuffers(0, 1, &vbuf, &stride, &offset);
-	ctx->IASetIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
-	ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+	stateCache.setVertexBuffers(0, 1, &vbuf, &stride, &offset);
+	stateCache.setIndexBuffer(ibuf, DXGI_FORMAT_R32_UINT, 0);
+	stateCache.setTopology(D3D_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
 
 	// == RENDER =================================
 
 	// Set the vertex input layout.
-	ctx->IASetInputLayout(layout);
+	stateCache.setInputLayout(layout);
 
 	// Set the vertex and pixel shaders that will be used to render.
 	if (isDepth) {
-		ctx->VSSetShader(vertexDepthShader, NULL, 0);
-		ctx->PSSetShader(NULL, NULL, 0);
+		stateCache.setVertexShader(vertexDepthShader);
+		stateCache.setPixelShader(NULL);
 	}
 	else {
-		ctx->VSSetShader(vertexShader, NULL, 0);
-		ctx->PSSetShader(pixelShader, NULL, 0);
+		stateCache.setVertexShader(vertexShader);
+		stateCache.setPixelShader(pixelShader);
 	}
-	ctx->CSSetShader(NULL, NULL, 0);
+	stateCache.setComputeShader(NULL);
 
 	// if Hull shader is not null then set HS and DS
 	if (hullShader) {
-		ctx->HSSetShader(hullShader, NULL, 0);
-		ctx->DSSetShader(domainShader, NULL, 0);
+		stateCache.setHullShader(hullShader);
+		stateCache.setDomainShader(domainShader);
 	}
 	else {
-		ctx->HSSetShader(NULL, NULL, 0);
-		ctx->DSSetShader(NULL, NULL, 0);
+		stateCache.setHullShader(NULL);
+		stateCache.setDomainShader(NULL);
 	}
 
 	// if geometry shader is not null then set GS
 	if (geometryShader) {
-		ctx->GSSetShader(geometryShader, NULL, 0);
+		stateCache.setGeometryShader(geometryShader);
 	}
 	else {
-		ctx->GSSetShader(NULL, NULL, 0);
+		stateCache.setGeometryShader(NULL);
 	}
 
 	// Render the triangle.
-	ctx->DrawIndexed(mesh.getIndexCount(), 0, 0);
-
-	// unbind shader resources
-	TextureType *nullTEX[LIGHTS_COUNT + 1] = { 0 };
-	ctx->PSSetShaderResources(0, LIGHTS_COUNT + 1, nullTEX);
+	stateCache.getBackend()->drawIndexed(mesh.getIndexCount(), 0, 0);
 }
 
 void GroundMesh::init(Device *device, DeviceContext *ctx, vec2i planeSize, vec2i planeRes) {
@@ -315,8 +290,9 @@ void GroundMesh::init(Device *device, DeviceContext *ctx, vec2i planeSize, vec2i
 void Ground::init(D3D *ctx, HWND hwnd, TextureIdManager &textureManager) {
 	windData.timePassed = 0.f;
 	windData.windOrigin = { 0.f, 0.f, 0.f };
-	windData.windSpeed = 3.f;
-	windData.waveAmplitude = 10.f;
+	windData.windField = nullptr;
+	windData.windFieldSize = 1.f;
+	windData.windStrength = 0.15f;
 
 	grassShader = new GrassShader(ctx->getDevice(), hwnd);
 	groundShader = new GroundShader(ctx->getDevice(), hwnd);
@@ -327,6 +303,7 @@ void Ground::init(D3D *ctx, HWND hwnd, TextureIdManager &textureManager) {
 	groundTextureId = tmanager->loadTexture("res/ground.jpg");
 
 	ground.init(ctx->getDevice(), ctx->getDeviceContext());
+	terrain.init(ctx->getDevice(), hwnd);
 }
 
 Ground::~Ground() {
@@ -335,8 +312,20 @@ Ground::~Ground() {
 	tmanager = nullptr;
 }
 
-void Ground::update(f32 dt) {
+void Ground::update(DeviceContext *ctx, f32 dt, const float3 &cameraPos) {
 	windData.timePassed += dt;
+
+	if (wantsTerrain != useTerrain) {
+		useTerrain = wantsTerrain;
+		version++;
+	}
+	if (useTerrain) {
+		terrain.update(ctx, cameraPos);
+	}
+}
+
+void Ground::addOccluders(OcclusionCuller &culler, const float3 &cameraPos, f32 radius) {
+	terrain.addOccluders(culler, cameraPos, radius);
 }
 
 void Ground::renderGrass(
@@ -373,6 +362,16 @@ void Ground::renderGround(
 ) {
 	if (groundShader->isOmniShader()) return;
 
+	if (useTerrain) {
+		terrain.render(
+			ctx, groundMatrix, view, proj,
+			camPos, windData.timePassed,
+			tmanager->getTexture(groundTextureId),
+			lights, spotShadow, pointShadow
+		);
+		return;
+	}
+
 	groundShader->setShaderParameters(
 		ctx, groundMatrix, view, proj,
 		tmanager->getTexture(groundTextureId),
@@ -393,8 +392,7 @@ void Ground::gui(bool &open) {
 	ImGui::Separator();
 
 	ImGui::Checkbox("Render", &shouldDrawGrass);
-	ImGui::SliderFloat("Wind speed", &windData.windSpeed, 1.f, 30.f);
-	ImGui::SliderFloat("Wind wave amplitude", &windData.waveAmplitude, 1.f, 30.f);
+	ImGui::SliderFloat("Wind strength", &windData.windStrength, 0.f, 1.f);
 
 	ImGui::Image(tmanager->getTexture(grassPatternId), { 100.f, 100.f });
 	if (ImGui::Button("Reload grass pattern texture")) {
@@ -414,9 +412,25 @@ void Ground::gui(bool &open) {
 	ImGui::SliderFloat("Max distance", &maxDistance, cutoffDistance, 500.f);
 	ImGui::SliderFloat("Max factor", &maxFactor, 1.f, 64.f);
 
+	ImGui::NewLine();
+
+	// -- Terrain options -----------------------------------------------------
+	ImGui::Text("Terrain options");
+	ImGui::Separator();
+
+	ImGui::Checkbox("Use streamed CDLOD terrain", &wantsTerrain);
+	if (useTerrain) {
+		terrain.gui();
+	}
+
 	ImGui::End();
 }
 
 void Ground::setWindOrigin(const float3 &origin) {
 	windData.windOrigin = mul(XMMatrixInverse(nullptr, groundMatrix), origin);
 }
+
+void Ground::setWindField(TextureType *field, f32 fieldSize) {
+	windData.windField = field;
+	windData.windFieldSize = fieldSize;
+}
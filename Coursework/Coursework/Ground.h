@@ -2,6 +2,7 @@
 
 #include "DefaultShader.h"
 #include "GrassShader.h"
+#include "Terrain.h"
 #include "vec.h"
 
 // Very similar to a plane, but lets you also choose the size of the plane itself without needing
@@ -23,14 +24,6 @@ public:
  * Using a cutoff distance we can ensure that the player doesn't see this changes
  */
 class GroundShader : public DefaultShader {
-	struct GroundBufferType {
-		float3 cameraPos;
-		float cutoffDist;
-		float maxDist;
-		float maxFactor;
-		float2 padding = { 0, 0 };
-	};
-
 public:
 	GroundShader(Device *device, HWND hwnd);
 	~GroundShader();
@@ -49,16 +42,27 @@ public:
 	void init(D3D *ctx, HWND hwnd, TextureIdManager &tmanager);
 	~Ground();
 
-	void update(f32 dt);
+	void update(DeviceContext *ctx, f32 dt, const float3 &cameraPos);
 	void renderGrass(DeviceContext *ctx, const mat4 &view, const mat4 &proj, const float3 &camPos, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow);
 	void renderGround(DeviceContext *ctx, const mat4 &view, const mat4 &proj, const float3 &camPos, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow);
 
 	void gui(bool &open);
+	// The flat ground never hides anything, only the terrain is an occluder. It's called
+	// by the update of the next frame, which checks isUsingTerrain() when it's prepared.
+	// The terrain is only switched in update(), the gui runs while the update job reads it
+	void addOccluders(OcclusionCuller &culler, const float3 &cameraPos, f32 radius);
+	bool isUsingTerrain() const { return useTerrain; }
 
 	GrassShader *getGrassShader() { return grassShader; }
 	GroundShader *getGroundShader() { return groundShader; }
+	TerrainShader *getTerrainShader() { return terrain.getShader(); }
+
+	// Changes when the shape of the ground changes, the shadow caches compare it.
+	// Switching to the terrain changes the low bits, its tiles the others
+	u32 getVersion() const { return (useTerrain ? terrain.getVersion() << 8 : 0) | (version & 0xFF); }
 
 	void setWindOrigin(const float3 &origin);
+	void setWindField(TextureType *field, f32 fieldSize);
 
 private:
 	GroundShader *groundShader = nullptr;
@@ -69,9 +73,15 @@ private:
 	f32 maxDistance = 220.f;
 	f32 maxFactor   = 25.f;
 	bool shouldDrawGrass = true;
+	// the grass is still generated from the flat ground mesh
+	bool useTerrain = false;
+	// set by the gui, update() switches to it
+	bool wantsTerrain = false;
+	u32 version = 0;
 
 	mat4 groundMatrix = XMMatrixIdentity();
 	GroundMesh ground;
+	Terrain terrain;
 
 	TextureIdManager *tmanager = nullptr;
 	int grassTextureId = -1;
@@ -0,0 +1,372 @@
+#include "Impostor.h"
+
+#include <string.h>
+#include <chrono>
+
+#include "utility.h"
+#include "tracelog.h"
+#include "MathUtils.h"
+
+static bool readbackTexture(Device *device, DeviceContext *ctx, TextureType *view, ImpostorImage &out);
+
+// == IMPOSTOR QUAD MESH =================================================================================================================
+
+void ImpostorQuadMesh::init(Device *device) {
+	VertexType vertices[] = {
+		{ float3(-1.f,  1.f, 0.f), float2(0.f, 0.f), float3(0.f, 0.f, -1.f) },
+		{ float3( 1.f,  1.f, 0.f), float2(1.f, 0.f), float3(0.f, 0.f, -1.f) },
+		{ float3(-1.f, -1.f, 0.f), float2(0.f, 1.f), float3(0.f, 0.f, -1.f) },
+		{ float3( 1.f, -1.f, 0.f), float2(1.f, 1.f), float3(0.f, 0.f, -1.f) },
+	};
+	ulong indices[] = { 0, 1, 2, 2, 1, 3 };
+
+	vertexCount = ARR_LEN(vertices);
+	indexCount = ARR_LEN(indices);
+
+	D3D11_BUFFER_DESC vbufDesc{}, ibufDesc{};
+	D3D11_SUBRESOURCE_DATA vData{}, iData{};
+
+	// Set up the description of the static vertex buffer
+	vbufDesc.Usage = D3D11_USAGE_DEFAULT;
+	vbufDesc.ByteWidth = sizeof(vertices);
+	vbufDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vData.pSysMem = vertices;
+	device->CreateBuffer(&vbufDesc, &vData, &vertexBuffer);
+
+	// Set up the description of the static index buffer
+	ibufDesc.Usage = D3D11_USAGE_DEFAULT;
+	ibufDesc.ByteWidth = sizeof(indices);
+	ibufDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	iData.pSysMem = indices;
+	device->CreateBuffer(&ibufDesc, &iData, &indexBuffer);
+}
+
+// == IMPOSTOR SHADER ====================================================================================================================
+
+ImpostorShader::ImpostorShader(Device *device, HWND hwnd)
+	: InstanceShader(device, hwnd) {
+	initShader(L"shaders/impostor_vs.cso", L"shaders/impostor_ps.cso");
+}
+
+ImpostorShader::~ImpostorShader() {
+	RELEASE_IF_NOT_NULL(impostorBuffer);
+	RELEASE_IF_NOT_NULL(atlasSampler);
+}
+
+void ImpostorShader::setShaderParameters(
+	DeviceContext *ctx,
+	const mat4 &world,
+	const mat4 &view,
+	const mat4 &proj,
+	TextureType *albedo,
+	TextureType *normalDepth,
+	float3 cameraPos,
+	float timePassed,
+	Light lights[LIGHTS_COUNT],
+	ShadowMap *spotShadow,
+	OmniShadowMap &pointShadow,
+	const ImpostorAtlas &atlas
+) {
+	DefaultShader::setShaderParameters(
+		ctx, world, view, proj,
+		albedo, { 1.f, 1.f, 1.f, 1.f },
+		cameraPos, timePassed,
+		lights, spotShadow, pointShadow
+	);
+
+	auto impostorPtr = mapBuffer<ImpostorBufferType>(ctx, impostorBuffer);
+	impostorPtr->center        = atlas.center;
+	impostorPtr->radius        = atlas.radius;
+	impostorPtr->framesPerSide = (float)atlas.framesPerSide;
+	impostorPtr->hemisphere    = atlas.hemisphere ? 1.f : 0.f;
+	impostorPtr->padding       = { 0, 0 };
+	unmapBufferVS(ctx, impostorBuffer, 3);
+	stateCache.setConstantBuffers(ShaderStage::Pixel, 2, 1, &impostorBuffer);
+
+	// the frames must not bleed into each other, use a clamped sampler instead of the diffuse one
+	stateCache.setShaderResources(ShaderStage::Pixel, 3, 1, &normalDepth);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &atlasSampler);
+}
+
+void ImpostorShader::initShader(const wchar_t *vs, const wchar_t *ps) {
+	loadVertexShader(vs);
+	loadPixelShader(ps);
+
+	initDefaultBuffers();
+	addDynamicBuffer<ImpostorBufferType>(&impostorBuffer);
+	addDiffuseSampler();
+	addShadowSampler();
+	addClampSampler(&atlasSampler);
+}
+
+void ImpostorShader::loadVertexShader(const wchar_t *vs) {
+	// Create the vertex input layout description.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION",       0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD",       0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",         0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "INSTANCE_POS",   0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCE_FADE",  0, DXGI_FORMAT_R32_FLOAT,       1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCE_FRAME", 0, DXGI_FORMAT_R32G32_FLOAT,    1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	DefaultShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
+}
+
+// == IMPOSTOR ===========================================================================================================================
+
+bool Impostor::init(Device *device, DeviceContext *ctx, HWND hwnd, const MModel &model, TextureIdManager &tmanager) {
+	shader = new ImpostorShader(device, hwnd);
+	quad.init(device);
+
+	if (!bake(device, ctx, model, tmanager)) {
+		err("Couldn't bake the tree impostor, far trees will use the mesh");
+		return false;
+	}
+
+	return createTexture(device, atlas.albedo, &albedoTexture, &albedoView) &&
+	       createTexture(device, atlas.normalDepth, &normalDepthTexture, &normalDepthView);
+}
+
+Impostor::~Impostor() {
+	releaseTextures();
+	DELETE_IF_NOT_NULL(shader);
+}
+
+ImpostorClassifier Impostor::getClassifier() const {
+	ImpostorClassifier classifier;
+	classifier.enabled = enabled && isReady();
+	classifier.startDistance = startDistance;
+	classifier.fadeBand = fadeBand;
+	classifier.center = atlas.center;
+	classifier.framesPerSide = atlas.framesPerSide;
+	classifier.hemisphere = atlas.hemisphere;
+	return classifier;
+}
+
+ImpostorUsage ImpostorClassifier::classify(const float3 &cameraPos, const float3 &position, f32 &fade) const {
+	fade = 1.f;
+	if (!enabled) return ImpostorUsage::Mesh;
+
+	f32 dist = (vec3f(cameraPos) - (vec3f(position) + center)).mag();
+
+	if (dist < startDistance) {
+		return ImpostorUsage::Mesh;
+	}
+
+	if (dist < startDistance + fadeBand) {
+		fade = fadeBand > 0.f ? (dist - startDistance) / fadeBand : 1.f;
+		return ImpostorUsage::Both;
+	}
+
+	return ImpostorUsage::Impostor;
+}
+
+ImpostorInstanceType ImpostorClassifier::makeInstance(const float3 &cameraPos, const float3 &position, f32 fade) const {
+	const f32 maxFrame = (f32)(framesPerSide - 1);
+	vec3f toCamera = vec3f(cameraPos) - (vec3f(position) + center);
+
+	// must match the vertex shader
+	if (hemisphere) toCamera.y = max(toCamera.y, 0.f);
+	if (toCamera.mag2() <= 0.f) toCamera = vec3f(0.f, 1.f, 0.f);
+	vec2f oct = octEncode(toCamera.normalized(), hemisphere);
+
+	ImpostorInstanceType instance;
+	instance.position = position;
+	instance.fade = fade;
+	instance.frame = float2(
+		clamp((oct.x * 0.5f + 0.5f) * maxFrame, 0.f, maxFrame),
+		clamp((oct.y * 0.5f + 0.5f) * maxFrame, 0.f, maxFrame)
+	);
+	return instance;
+}
+
+void Impostor::render(
+	Device *device, 
+	DeviceContext *ctx, 
+	const mat4 &world, 
+	const mat4 &view, 
+	const mat4 &proj, 
+	const float3 &cameraPos, 
+	f32 timePassed, 
+	Light lights[LIGHTS_COUNT], 
+	ShadowMap *spotShadow, 
+	OmniShadowMap &pointShadow, 
+	const std::vector<ImpostorInstanceType> &instances
+) {
+	lastInstances = (u32)instances.size();
+	if (instances.empty()) return;
+
+	shader->setShaderParameters(
+		ctx, world, view, proj,
+		albedoView, normalDepthView,
+		cameraPos, timePassed,
+		lights, spotShadow, pointShadow,
+		atlas
+	);
+
+	// the instances are only read
+	shader->renderInstance(device, ctx, quad, const_cast<ImpostorInstanceType *>(instances.data()), (uint)instances.size());
+}
+
+void Impostor::gui() {
+	ImGui::Checkbox("Use impostors", &enabled);
+	ImGui::SliderFloat("Impostor distance", &startDistance, 10.f, 200.f);
+	ImGui::SliderFloat("Impostor fade band", &fadeBand, 0.f, 50.f);
+	if (isReady()) {
+		ImGui::Text(
+			"Impostors: %u (%ux%u frames, baked in %.1fms)",
+			lastInstances, atlas.framesPerSide, atlas.framesPerSide, bakeMs
+		);
+		// the bake is deterministic, the files only change with the model or the settings
+		if (ImGui::Button("Save impostor atlas")) {
+			writeTga("res/tree_impostor_albedo.tga", atlas.albedo);
+			writeTga("res/tree_impostor_normal.tga", atlas.normalDepth);
+		}
+	}
+	else {
+		ImGui::Text("Impostor not baked");
+	}
+}
+
+bool Impostor::bake(Device *device, DeviceContext *ctx, const MModel &model, TextureIdManager &tmanager) {
+	std::vector<ImpostorImage> textures(model.meshes.size());
+	std::vector<ImpostorMesh> meshes;
+
+	for (size_t i = 0; i < model.meshes.size(); ++i) {
+		const MMesh &mesh = model.meshes[i];
+		if (mesh.cpuVertices.empty() || mesh.cpuIndices.empty()) {
+			err("the tree model doesn't have a cpu copy of its geometry");
+			return false;
+		}
+
+		// only the full detail mesh, the lods are appended after it
+		MeshLod full = mesh.getLod(0);
+
+		ImpostorMesh bakeMesh;
+		bakeMesh.vertices    = &mesh.cpuVertices[0].position.x;
+		bakeMesh.stride      = sizeof(MMesh::PubVertexType);
+		bakeMesh.vertexCount = (u32)mesh.cpuVertices.size();
+		bakeMesh.indices     = mesh.cpuIndices.data() + full.indexStart;
+		bakeMesh.indexCount  = full.indexCount;
+		bakeMesh.color       = mesh.textureId ? vec4f(1.f) : vec4f(mesh.diffuseColor);
+
+		if (mesh.textureId && readbackTexture(device, ctx, tmanager.getTexture(mesh.textureId), textures[i])) {
+			bakeMesh.texture = &textures[i];
+		}
+
+		meshes.push_back(bakeMesh);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool success = bakeImpostor(meshes, desc, atlas);
+	bakeMs = std::chrono::duration<f64, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (success) {
+		info("baked tree impostor in %.1fms", bakeMs);
+	}
+	return success;
+}
+
+bool Impostor::createTexture(Device *device, const ImpostorImage &image, ID3D11Texture2D **texture, TextureType **view) {
+	D3D11_TEXTURE2D_DESC texDesc{};
+	texDesc.Width = image.width;
+	texDesc.Height = image.height;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA data{};
+	data.pSysMem = image.pixels.data();
+	data.SysMemPitch = image.width * 4;
+
+	HRESULT result = device->CreateTexture2D(&texDesc, &data, texture);
+	if (FAILED(result)) {
+		err("Couldn't create impostor texture");
+		return false;
+	}
+
+	result = device->CreateShaderResourceView(*texture, nullptr, view);
+	return SUCCEEDED(result);
+}
+
+void Impostor::releaseTextures() {
+	RELEASE_IF_NOT_NULL(albedoView);
+	RELEASE_IF_NOT_NULL(albedoTexture);
+	RELEASE_IF_NOT_NULL(normalDepthView);
+	RELEASE_IF_NOT_NULL(normalDepthTexture);
+}
+
+// Copies the top mip of a texture to the cpu, only 8 bit rgba and bgra textures are supported
+static bool readbackTexture(Device *device, DeviceContext *ctx, TextureType *view, ImpostorImage &out) {
+	if (!view) return false;
+
+	ID3D11Resource *resource = nullptr;
+	ID3D11Texture2D *texture = nullptr;
+	ID3D11Texture2D *staging = nullptr;
+	D3D11_TEXTURE2D_DESC texDesc{};
+	D3D11_MAPPED_SUBRESOURCE mapped{};
+	bool swapRedBlue = false;
+	bool success = false;
+
+	view->GetResource(&resource);
+	if (!resource || FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void **)&texture))) {
+		goto error;
+	}
+
+	texture->GetDesc(&texDesc);
+	switch (texDesc.Format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		swapRedBlue = true;
+		break;
+	default:
+		warn("impostor: unsupported texture format %d, using the diffuse colour", (int)texDesc.Format);
+		goto error;
+	}
+
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Usage = D3D11_USAGE_STAGING;
+	texDesc.BindFlags = 0;
+	texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	texDesc.MiscFlags = 0;
+
+	if (FAILED(device->CreateTexture2D(&texDesc, nullptr, &staging))) {
+		goto error;
+	}
+
+	ctx->CopySubresourceRegion(staging, 0, 0, 0, 0, texture, 0, nullptr);
+
+	if (FAILED(ctx->Map(staging, 0, D3D11_MAP_READ, 0, &mapped))) {
+		goto error;
+	}
+
+	out.resize(texDesc.Width, texDesc.Height);
+	for (u32 y = 0; y < texDesc.Height; ++y) {
+		memcpy(out.at(0, y), (u8 *)mapped.pData + y * mapped.RowPitch, texDesc.Width * 4);
+		if (swapRedBlue) {
+			for (u32 x = 0; x < texDesc.Width; ++x) {
+				u8 *p = out.at(x, y);
+				u8 temp = p[0];
+				p[0] = p[2];
+				p[2] = temp;
+			}
+		}
+	}
+
+	ctx->Unmap(staging, 0);
+	success = true;
+
+error:
+	RELEASE_IF_NOT_NULL(staging);
+	RELEASE_IF_NOT_NULL(texture);
+	RELEASE_IF_NOT_NULL(resource);
+	return success;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "InstanceShader.h"
+#include "TreeShader.h"
+#include "ImpostorBaker.h"
+
+// Quad in the [-1, 1] range on the xy plane, uvs start from the top left
+class ImpostorQuadMesh : public MMesh {
+public:
+	void init(Device *device);
+};
+
+enum class ImpostorUsage {
+	Mesh,     // close, only the mesh is drawn
+	Both,     // in the fade band, the impostor is dithered in over the mesh
+	Impostor, // far, only the impostor is drawn
+};
+
+struct ImpostorInstanceType {
+	float3 position;
+	float fade;   // 0-1, dithered in the pixel shader
+	float2 frame; // continuous position in the atlas grid, the pixel shader blends the 4 closest frames
+};
+
+// Copy of the impostor settings, classifies the trees and makes their
+// instances without touching the Impostor, so it can be used off the main thread
+struct ImpostorClassifier {
+	bool enabled = false; // false also if the impostor isn't baked
+	f32 startDistance = 0.f;
+	f32 fadeBand = 0.f;
+	vec3f center;
+	u32 framesPerSide = 0;
+	bool hemisphere = true;
+
+	// fade is set for the trees that need the impostor, always Mesh when impostors are disabled
+	ImpostorUsage classify(const float3 &cameraPos, const float3 &position, f32 &fade) const;
+	ImpostorInstanceType makeInstance(const float3 &cameraPos, const float3 &position, f32 fade) const;
+};
+
+/* Renders the impostors of a model as camera facing quads in a single
+ * instanced draw call.
+ * The pixel shader blends the 4 atlas frames closest to the view
+ * direction, and uses the baked normal and depth to light the quad like
+ * the real model.
+ */
+class ImpostorShader : public InstanceShader {
+	struct ImpostorBufferType {
+		float3 center;
+		float radius;
+		float framesPerSide;
+		float hemisphere;
+		float2 padding = { 0, 0 };
+	};
+
+public:
+	ImpostorShader(Device *device, HWND hwnd);
+	~ImpostorShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &projection, TextureType *albedo, TextureType *normalDepth, float3 cameraPos, float timePassed, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow, const ImpostorAtlas &atlas);
+
+private:
+	void initShader(const wchar_t *vs, const wchar_t *ps);
+	void loadVertexShader(const wchar_t *vs);
+
+	ID3D11Buffer *impostorBuffer = nullptr;
+	ID3D11SamplerState *atlasSampler = nullptr;
+};
+
+/* Octahedral impostors for the far trees.
+ * At start up the tree model is baked on the cpu (see bakeImpostor), the
+ * gui can save the atlas to res/tree_impostor_albedo.tga and
+ * res/tree_impostor_normal.tga to look at it or diff it.
+ * Every frame the trees are classified on the cpu: the ones closer than
+ * startDistance use the mesh, the ones in the next fadeBand meters use
+ * both (the impostor is dithered in) and the others only use the impostor.
+ * The caller decides which of them are visible, makes their instances
+ * with the classifier and passes them to render().
+ * Impostors don't cast shadows, the depth passes keep drawing the far
+ * trees with the lowest lod.
+ */
+class Impostor {
+public:
+	bool init(Device *device, DeviceContext *ctx, HWND hwnd, const MModel &model, TextureIdManager &tmanager);
+	~Impostor();
+
+	ImpostorClassifier getClassifier() const;
+	void render(Device *device, DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, const float3 &cameraPos, f32 timePassed, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow, const std::vector<ImpostorInstanceType> &instances);
+	void gui();
+
+	bool isReady() const { return albedoView && normalDepthView; }
+	ImpostorShader *getShader() { return shader; }
+	f32 getStartDistance() const { return startDistance; }
+
+private:
+	bool bake(Device *device, DeviceContext *ctx, const MModel &model, TextureIdManager &tmanager);
+	bool createTexture(Device *device, const ImpostorImage &image, ID3D11Texture2D **texture, TextureType **view);
+	void releaseTextures();
+
+	ImpostorShader *shader = nullptr;
+	ImpostorQuadMesh quad;
+	ImpostorDesc desc;
+	ImpostorAtlas atlas;
+
+	ID3D11Texture2D *albedoTexture = nullptr;
+	TextureType *albedoView = nullptr;
+	ID3D11Texture2D *normalDepthTexture = nullptr;
+	TextureType *normalDepthView = nullptr;
+
+	u32 lastInstances = 0; // drawn by the last render, for the gui
+
+	bool enabled = true;
+	f32 startDistance = 60.f;
+	f32 fadeBand = 10.f;
+	f64 bakeMs = 0.0;
+};
@@ -0,0 +1,371 @@
+#include "ImpostorBaker.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <utility>
+
+#include "tracelog.h"
+#include "MathUtils.h"
+#include "utility.h"
+
+static constexpr u32 DILATE_PASSES = 4;
+
+// -- Helpers ---------------------------------------------------------------
+
+static f32 signNotZero(f32 v) {
+	return v >= 0.f ? 1.f : -1.f;
+}
+
+static u8 toUnorm(f32 v) {
+	return (u8)(clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static vec3f loadVec3(const f32 *data) {
+	return vec3f(data[0], data[1], data[2]);
+}
+
+// bilinear, wrapping
+static vec4f sampleImage(const ImpostorImage &image, f32 u, f32 v) {
+	f32 fx = u * image.width - 0.5f;
+	f32 fy = v * image.height - 0.5f;
+	f32 x0f = floorf(fx);
+	f32 y0f = floorf(fy);
+	f32 tx = fx - x0f;
+	f32 ty = fy - y0f;
+
+	i32 w = (i32)image.width;
+	i32 h = (i32)image.height;
+	i32 x0 = ((i32)x0f % w + w) % w;
+	i32 y0 = ((i32)y0f % h + h) % h;
+	i32 x1 = (x0 + 1) % w;
+	i32 y1 = (y0 + 1) % h;
+
+	const u8 *p00 = image.at(x0, y0);
+	const u8 *p10 = image.at(x1, y0);
+	const u8 *p01 = image.at(x0, y1);
+	const u8 *p11 = image.at(x1, y1);
+
+	f32 res[4];
+	for (int i = 0; i < 4; ++i) {
+		f32 top = p00[i] + (p10[i] - p00[i]) * tx;
+		f32 bottom = p01[i] + (p11[i] - p01[i]) * tx;
+		res[i] = (top + (bottom - top) * ty) / 255.f;
+	}
+	return vec4f(res[0], res[1], res[2], res[3]);
+}
+
+static f32 edge(const vec2f &a, const vec2f &b, const vec2f &p) {
+	return (p.x - a.x) * (b.y - a.y) - (p.y - a.y) * (b.x - a.x);
+}
+
+// -- Octahedral mapping ----------------------------------------------------
+
+vec2f octEncode(const vec3f &dir, bool hemisphere) {
+	f32 sum = fabsf(dir.x) + fabsf(dir.y) + fabsf(dir.z);
+	if (sum <= 0.f) return vec2f(0.f);
+	vec3f d = dir / sum;
+
+	if (hemisphere) {
+		return vec2f(d.x + d.z, d.x - d.z);
+	}
+
+	if (d.y < 0.f) {
+		return vec2f(
+			(1.f - fabsf(d.z)) * signNotZero(d.x),
+			(1.f - fabsf(d.x)) * signNotZero(d.z)
+		);
+	}
+	return vec2f(d.x, d.z);
+}
+
+vec3f octDecode(const vec2f &uv, bool hemisphere) {
+	vec3f d;
+	if (hemisphere) {
+		d.x = (uv.x + uv.y) * 0.5f;
+		d.z = (uv.x - uv.y) * 0.5f;
+		d.y = 1.f - fabsf(d.x) - fabsf(d.z);
+	}
+	else {
+		d.x = uv.x;
+		d.z = uv.y;
+		d.y = 1.f - fabsf(uv.x) - fabsf(uv.y);
+		if (d.y < 0.f) {
+			f32 x = d.x;
+			d.x = (1.f - fabsf(d.z)) * signNotZero(x);
+			d.z = (1.f - fabsf(x)) * signNotZero(d.z);
+		}
+	}
+	return d.normalized();
+}
+
+void impostorBasis(const vec3f &dir, vec3f &right, vec3f &up) {
+	// same convention as a left handed look at matrix looking along -dir
+	vec3f ref = fabsf(dir.y) > 0.999f ? vec3f(0.f, 0.f, 1.f) : vec3f(0.f, 1.f, 0.f);
+	right = cross(dir, ref).normalized();
+	up = cross(-dir, right);
+}
+
+// -- Baking ----------------------------------------------------------------
+
+struct FrameTarget {
+	u32 originX, originY, size;
+	vec3f dir, right, up;
+	std::vector<f32> depth;
+};
+
+static void rasterizeMesh(
+	const ImpostorMesh &mesh, const ImpostorDesc &desc,
+	const vec3f &center, f32 radius,
+	FrameTarget &target, ImpostorAtlas &out
+) {
+	const f32 halfSize = target.size * 0.5f;
+	const f32 cutoff = desc.alphaCutoff / 255.f;
+
+	for (u32 t = 0; t + 2 < mesh.indexCount; t += 3) {
+		vec2f screen[3];
+		vec2f uv[3];
+		vec3f normal[3];
+		f32 z[3];
+
+		bool valid = true;
+		for (int i = 0; i < 3; ++i) {
+			u32 index = mesh.indices[t + i];
+			if (index >= mesh.vertexCount) {
+				valid = false;
+				break;
+			}
+			const f32 *vertex = (const f32 *)((const u8 *)mesh.vertices + mesh.stride * index);
+			vec3f local = (loadVec3(vertex) - center) / radius;
+			screen[i] = vec2f(
+				(dot(local, target.right) + 1.f) * halfSize,
+				(1.f - dot(local, target.up)) * halfSize
+			);
+			z[i] = dot(local, target.dir);
+			uv[i] = vec2f(vertex[3], vertex[4]);
+			normal[i] = loadVec3(vertex + 5);
+		}
+		if (!valid) continue;
+
+		f32 area = edge(screen[0], screen[1], screen[2]);
+		if (fabsf(area) < 1e-8f) continue;
+		// leaves are two sided, always use the same winding
+		if (area < 0.f) {
+			std::swap(screen[1], screen[2]);
+			std::swap(uv[1], uv[2]);
+			std::swap(normal[1], normal[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		f32 minX = min(screen[0].x, min(screen[1].x, screen[2].x));
+		f32 minY = min(screen[0].y, min(screen[1].y, screen[2].y));
+		f32 maxX = max(screen[0].x, max(screen[1].x, screen[2].x));
+		f32 maxY = max(screen[0].y, max(screen[1].y, screen[2].y));
+
+		i32 x0 = max((i32)floorf(minX), 0);
+		i32 y0 = max((i32)floorf(minY), 0);
+		i32 x1 = min((i32)ceilf(maxX), (i32)target.size - 1);
+		i32 y1 = min((i32)ceilf(maxY), (i32)target.size - 1);
+
+		for (i32 y = y0; y <= y1; ++y) {
+			for (i32 x = x0; x <= x1; ++x) {
+				vec2f p(x + 0.5f, y + 0.5f);
+				f32 w0 = edge(screen[1], screen[2], p);
+				f32 w1 = edge(screen[2], screen[0], p);
+				f32 w2 = edge(screen[0], screen[1], p);
+				if (w0 < 0.f || w1 < 0.f || w2 < 0.f) continue;
+
+				w0 /= area;
+				w1 /= area;
+				w2 /= area;
+
+				f32 depth = z[0] * w0 + z[1] * w1 + z[2] * w2;
+				f32 &stored = target.depth[(size_t)y * target.size + x];
+				if (depth <= stored) continue;
+
+				vec4f color = mesh.color;
+				if (mesh.texture) {
+					vec2f texUv = uv[0] * w0 + uv[1] * w1 + uv[2] * w2;
+					vec4f texel = sampleImage(*mesh.texture, texUv.x, texUv.y);
+					color = vec4f(color.x * texel.x, color.y * texel.y, color.z * texel.z, color.w * texel.w);
+				}
+				if (color.w < cutoff) continue;
+
+				vec3f n = (normal[0] * w0 + normal[1] * w1 + normal[2] * w2).normalized();
+				if (dot(n, target.dir) < 0.f) n = -n;
+
+				stored = depth;
+
+				u8 *albedo = out.albedo.at(target.originX + x, target.originY + y);
+				albedo[0] = toUnorm(color.x);
+				albedo[1] = toUnorm(color.y);
+				albedo[2] = toUnorm(color.z);
+				albedo[3] = 255;
+
+				u8 *nd = out.normalDepth.at(target.originX + x, target.originY + y);
+				nd[0] = toUnorm(n.x * 0.5f + 0.5f);
+				nd[1] = toUnorm(n.y * 0.5f + 0.5f);
+				nd[2] = toUnorm(n.z * 0.5f + 0.5f);
+				nd[3] = toUnorm(depth * 0.5f + 0.5f);
+			}
+		}
+	}
+}
+
+// Grows the colour of the covered pixels into the empty ones, without touching the alpha
+static void dilateFrame(ImpostorAtlas &out, u32 originX, u32 originY, u32 size) {
+	std::vector<u8> covered(size * size);
+	for (u32 y = 0; y < size; ++y) {
+		for (u32 x = 0; x < size; ++x) {
+			covered[y * size + x] = out.albedo.at(originX + x, originY + y)[3] != 0;
+		}
+	}
+
+	const i32 offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	std::vector<u8> next;
+
+	for (u32 pass = 0; pass < DILATE_PASSES; ++pass) {
+		next = covered;
+		for (u32 y = 0; y < size; ++y) {
+			for (u32 x = 0; x < size; ++x) {
+				if (covered[y * size + x]) continue;
+
+				u32 albedo[3] = { 0, 0, 0 };
+				u32 normal[3] = { 0, 0, 0 };
+				u32 count = 0;
+				for (u32 i = 0; i < ARR_LEN(offsets); ++i) {
+					i32 nx = (i32)x + offsets[i][0];
+					i32 ny = (i32)y + offsets[i][1];
+					if (nx < 0 || ny < 0 || nx >= (i32)size || ny >= (i32)size) continue;
+					if (!covered[ny * size + nx]) continue;
+					const u8 *a = out.albedo.at(originX + nx, originY + ny);
+					const u8 *n = out.normalDepth.at(originX + nx, originY + ny);
+					for (int c = 0; c < 3; ++c) {
+						albedo[c] += a[c];
+						normal[c] += n[c];
+					}
+					++count;
+				}
+				if (!count) continue;
+
+				u8 *a = out.albedo.at(originX + x, originY + y);
+				u8 *n = out.normalDepth.at(originX + x, originY + y);
+				for (int c = 0; c < 3; ++c) {
+					a[c] = (u8)((albedo[c] + count / 2) / count);
+					n[c] = (u8)((normal[c] + count / 2) / count);
+				}
+				next[y * size + x] = 1;
+			}
+		}
+		covered.swap(next);
+	}
+}
+
+bool bakeImpostor(const std::vector<ImpostorMesh> &meshes, const ImpostorDesc &desc, ImpostorAtlas &out) {
+	if (desc.framesPerSide < 2 || desc.frameSize == 0) {
+		err("impostor needs at least 2 frames per side and a frame size");
+		return false;
+	}
+
+	vec3f bmin(FLT_MAX), bmax(-FLT_MAX);
+	u32 vertexCount = 0;
+	for (const ImpostorMesh &mesh : meshes) {
+		for (u32 i = 0; i < mesh.vertexCount; ++i) {
+			vec3f p = loadVec3((const f32 *)((const u8 *)mesh.vertices + mesh.stride * i));
+			bmin = vec3f(min(bmin.x, p.x), min(bmin.y, p.y), min(bmin.z, p.z));
+			bmax = vec3f(max(bmax.x, p.x), max(bmax.y, p.y), max(bmax.z, p.z));
+		}
+		vertexCount += mesh.vertexCount;
+	}
+	if (!vertexCount) {
+		err("nothing to bake in the impostor");
+		return false;
+	}
+
+	vec3f center = (bmin + bmax) * 0.5f;
+	f32 radius = 0.f;
+	for (const ImpostorMesh &mesh : meshes) {
+		for (u32 i = 0; i < mesh.vertexCount; ++i) {
+			vec3f p = loadVec3((const f32 *)((const u8 *)mesh.vertices + mesh.stride * i));
+			radius = max(radius, (p - center).mag());
+		}
+	}
+	if (radius <= 0.f) radius = 1.f;
+
+	const u32 n = desc.framesPerSide;
+	const u32 atlasSize = n * desc.frameSize;
+	out.albedo.resize(atlasSize, atlasSize);
+	out.normalDepth.resize(atlasSize, atlasSize);
+	out.center = center;
+	out.radius = radius;
+	out.framesPerSide = n;
+	out.hemisphere = desc.hemisphere;
+
+	FrameTarget target;
+	target.size = desc.frameSize;
+
+	for (u32 fy = 0; fy < n; ++fy) {
+		for (u32 fx = 0; fx < n; ++fx) {
+			vec2f oct(
+				(f32)fx / (n - 1) * 2.f - 1.f,
+				(f32)fy / (n - 1) * 2.f - 1.f
+			);
+			target.dir = octDecode(oct, desc.hemisphere);
+			impostorBasis(target.dir, target.right, target.up);
+			target.originX = fx * desc.frameSize;
+			target.originY = fy * desc.frameSize;
+			target.depth.assign((size_t)desc.frameSize * desc.frameSize, -FLT_MAX);
+
+			for (const ImpostorMesh &mesh : meshes) {
+				rasterizeMesh(mesh, desc, center, radius, target, out);
+			}
+
+			dilateFrame(out, target.originX, target.originY, desc.frameSize);
+		}
+	}
+
+	return true;
+}
+
+// -- Output ----------------------------------------------------------------
+
+bool writeTga(const char *filename, const ImpostorImage &image) {
+	if (image.width > 0xFFFF || image.height > 0xFFFF) {
+		err("image too big for a tga: %ux%u", image.width, image.height);
+		return false;
+	}
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp) {
+		err("couldn't open %s for writing", filename);
+		return false;
+	}
+
+	u8 header[18] = {};
+	header[2] = 2; // uncompressed true colour
+	header[12] = (u8)(image.width & 0xFF);
+	header[13] = (u8)(image.width >> 8);
+	header[14] = (u8)(image.height & 0xFF);
+	header[15] = (u8)(image.height >> 8);
+	header[16] = 32;   // bits per pixel
+	header[17] = 0x28; // 8 bits of alpha, top left origin
+	fwrite(header, 1, sizeof(header), fp);
+
+	std::vector<u8> row(image.width * 4);
+	for (u32 y = 0; y < image.height; ++y) {
+		for (u32 x = 0; x < image.width; ++x) {
+			const u8 *p = image.at(x, y);
+			row[x * 4 + 0] = p[2];
+			row[x * 4 + 1] = p[1];
+			row[x * 4 + 2] = p[0];
+			row[x * 4 + 3] = p[3];
+		}
+		fwrite(row.data(), 1, row.size(), fp);
+	}
+
+	bool success = !ferror(fp);
+	fclose(fp);
+	if (!success) err("couldn't write %s", filename);
+	return success;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+// 8 bit rgba image, rows from the top
+struct ImpostorImage {
+	u32 width = 0;
+	u32 height = 0;
+	std::vector<u8> pixels;
+
+	void resize(u32 w, u32 h) { width = w; height = h; pixels.assign((size_t)w * h * 4, 0); }
+	u8 *at(u32 x, u32 y) { return &pixels[((size_t)y * width + x) * 4]; }
+	const u8 *at(u32 x, u32 y) const { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+// Geometry to bake, the vertices need a float3 position, float2 uv and float3 normal in this order (like MMesh)
+struct ImpostorMesh {
+	const f32 *vertices = nullptr;
+	size_t stride = 0;
+	u32 vertexCount = 0;
+	const u32 *indices = nullptr;
+	u32 indexCount = 0;
+	const ImpostorImage *texture = nullptr; // optional
+	vec4f color = vec4f(1.f);
+};
+
+struct ImpostorDesc {
+	u32 framesPerSide = 8;   // the atlas has framesPerSide^2 views
+	u32 frameSize = 128;     // pixels per side of a single view
+	bool hemisphere = true;  // only bake the views from above the horizon
+	u8 alphaCutoff = 128;    // texels with a lower alpha are discarded
+};
+
+struct ImpostorAtlas {
+	ImpostorImage albedo;      // rgb: colour, a: coverage
+	ImpostorImage normalDepth; // rgb: world space normal, a: depth towards the viewer (0.5 is the center)
+	vec3f center;              // bounding sphere
+	f32 radius = 0.f;
+	u32 framesPerSide = 0;
+	bool hemisphere = true;
+};
+
+/* Bakes a model into an octahedral impostor atlas.
+ * Every frame of the atlas is an orthographic view of the model from a
+ * direction on the (hemi)octahedron, frame (0, 0) and (n-1, n-1) are on the
+ * corners of the octahedron. The frames are rendered with a simple software
+ * rasterizer, so baking doesn't need a device, runs on a single thread and
+ * always gives the same result for the same input.
+ * Pixels outside of the model get the colour of the closest covered pixel
+ * (a few pixels of dilation), this way bilinear filtering doesn't bring in
+ * black borders.
+ */
+bool bakeImpostor(const std::vector<ImpostorMesh> &meshes, const ImpostorDesc &desc, ImpostorAtlas &out);
+
+// Writes an uncompressed 32 bit tga
+bool writeTga(const char *filename, const ImpostorImage &image);
+
+// Maps a direction to the octahedron ([-1, 1]) and back
+vec2f octEncode(const vec3f &dir, bool hemisphere);
+vec3f octDecode(const vec2f &uv, bool hemisphere);
+// Right and up vectors of the view looking at the model from dir, shared with the impostor vertex shader
+void impostorBasis(const vec3f &dir, vec3f &right, vec3f &up);
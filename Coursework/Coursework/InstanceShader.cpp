@@ -11,7 +11,6 @@ InstanceShader::InstanceShader(Device *device, HWND hwnd, bool init)
 }
 
 InstanceShader::~InstanceShader() {
-	RELEASE_IF_NOT_NULL(instanceBuffer);
 }
 
 void InstanceShader::initShader(const wchar_t *vs, const wchar_t *dvs) {
@@ -33,25 +32,16 @@ void InstanceShader::loadVertexShader(const wchar_t *vs) {
 		{ "TEXCOORD", 1, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
 	};
 	
-	BaseShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
+	DefaultShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
 }
 
-void InstanceShader::renderInstanceInternal(Device *device, DeviceContext *ctx, MMesh &mesh, void *idata, size_t itypeSize, uint icount) {
-	// -- INIT BUFFERS --------------------------------------------------------
-	RELEASE_IF_NOT_NULL(instanceBuffer);
-	D3D11_BUFFER_DESC ibufDesc{};
-	D3D11_SUBRESOURCE_DATA instData{};
-
-	// Set up the description of the instance buffer.
-	ibufDesc.Usage = D3D11_USAGE_DEFAULT;
-	ibufDesc.ByteWidth = uint(itypeSize * icount);
-	ibufDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+void InstanceShader::renderInstanceInternal(Device *device, DeviceContext *ctx, MMesh &mesh, void *idata, size_t itypeSize, uint icount, u32 lod) {
+	RenderBackend *backend = stateCache.getBackend();
 
-	// Give the subresource structure a pointer to the instance data.
-	instData.pSysMem = idata;
+	// -- INIT BUFFERS --------------------------------------------------------
 
 	// Create the instance buffer.
-	device->CreateBuffer(&ibufDesc, &instData, &instanceBuffer);
+	ID3D11Buffer *instanceBuffer = backend->createBuffer(BufferType::Vertex, uint(itypeSize * icount), idata, false);
 
 	// -- SEND DATA -----------------------------------------------------------
 
@@ -69,52 +59,47 @@ void InstanceShader::renderInstanceInternal(Device *device, DeviceContext *ctx,
 	// Set the buffer offsets.
 	offsets[0] = offsets[1] = 0;
 
-	ctx->IASetVertexBuffers(0, 2, bufferPtr, strides, offsets);
-	ctx->IASetIndexBuffer(mesh.getIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
-	ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	stateCache.setVertexBuffers(0, 2, bufferPtr, strides, offsets);
+	stateCache.setIndexBuffer(mesh.getIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
+	stateCache.setTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// -- RENDER --------------------------------------------------------------
 
 	// Set the vertex input layout.
-	ctx->IASetInputLayout(layout);
+	stateCache.setInputLayout(layout);
 
 	// Set the vertex and pixel shaders that will be used to render.
 	if (isDepth) {
-		ctx->VSSetShader(vertexDepthShader, NULL, 0);
-		ctx->PSSetShader(NULL, NULL, 0);
+		stateCache.setVertexShader(vertexDepthShader);
+		stateCache.setPixelShader(NULL);
 	}
 	else {
-		ctx->VSSetShader(vertexShader, NULL, 0);
-		ctx->PSSetShader(pixelShader, NULL, 0);
+		stateCache.setVertexShader(vertexShader);
+		stateCache.setPixelShader(pixelShader);
 	}
-	ctx->CSSetShader(NULL, NULL, 0);
+	stateCache.setComputeShader(NULL);
 
 	// if Hull shader is not null then set HS and DS
 	if (hullShader) {
-		ctx->HSSetShader(hullShader, NULL, 0);
-		ctx->DSSetShader(domainShader, NULL, 0);
+		stateCache.setHullShader(hullShader);
+		stateCache.setDomainShader(domainShader);
 	}
 	else {
-		ctx->HSSetShader(NULL, NULL, 0);
-		ctx->DSSetShader(NULL, NULL, 0);
+		stateCache.setHullShader(NULL);
+		stateCache.setDomainShader(NULL);
 	}
 
-	// if geometry shader is not null then set GS
-	if (geometryShader) {
-		ctx->GSSetShader(geometryShader, NULL, 0);
+	// the omni depth pass replaces the geometry shader, if there is one
+	if (isOmni) {
+		stateCache.setGeometryShader(omniDepthGSShader);
 	}
 	else {
-		ctx->GSSetShader(NULL, NULL, 0);
-	}
-
-	if (isOmni) {
-		ctx->GSSetShader(omniDepthGSShader, NULL, 0);
+		stateCache.setGeometryShader(geometryShader);
 	}
 
 	// Render the triangle.
-	ctx->DrawIndexedInstanced(mesh.getIndexCount(), icount, 0, 0, 0);
+	MeshLod range = mesh.getLod(lod);
+	backend->drawIndexedInstanced(range.indexCount, icount, range.indexStart, 0);
 
-	// unbind shader resources
-	TextureType *nullTEX[LIGHTS_COUNT + 1] = { 0 };
-	ctx->PSSetShaderResources(0, LIGHTS_COUNT + 1, nullTEX);
+	backend->releaseBuffer(instanceBuffer);
 }
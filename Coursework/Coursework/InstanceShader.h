@@ -13,16 +13,17 @@ public:
 	InstanceShader(Device *device, HWND hwnd, bool init = false);
 	~InstanceShader();
 
+	// lod is clamped to the mesh's lod count, it's ignored if the mesh has no lods
 	template<typename T>
-	void renderInstance(Device *device, DeviceContext *ctx, MMesh &mesh, T *idata, uint icount) {
-		renderInstanceInternal(device, ctx, mesh, idata, sizeof(T), icount);
+	void renderInstance(Device *device, DeviceContext *ctx, MMesh &mesh, T *idata, uint icount, u32 lod = 0) {
+		renderInstanceInternal(device, ctx, mesh, idata, sizeof(T), icount, lod);
 	}
 
 protected:
 	void initShader(const wchar_t *vs, const wchar_t *dvs);
 	void loadVertexShader(const wchar_t *vs);
 
-	void renderInstanceInternal(Device *device, DeviceContext *ctx, MMesh &mesh, void *idata, size_t itypeSize, uint icount);
-
-	ID3D11Buffer *instanceBuffer = nullptr;
+	// The instance buffer only lives for the draw, the context keeps it while it's bound.
+	// This way the passes recorded on other threads can use the same shader
+	void renderInstanceInternal(Device *device, DeviceContext *ctx, MMesh &mesh, void *idata, size_t itypeSize, uint icount, u32 lod);
 };
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "JobSystem.h"
+
+#include "MathUtils.h"
+#include "tracelog.h"
+
+JobSystem jobSystem;
+
+struct Job {
+	JobSystem::Function function;
+	JobCounter *counter;
+};
+
+// Which system and worker the current thread belongs to
+struct ThreadSlot {
+	const JobSystem *system = nullptr;
+	u32 index = 0;
+};
+
+static thread_local ThreadSlot threadSlot;
+
+static constexpr u32 NOT_A_WORKER = 0xFFFFFFFF;
+
+// == DEQUE ======================================================================================================================
+
+JobSystem::Deque::Deque()
+	: buffer(DEQUE_SIZE) {
+	for (std::atomic<Job *> &slot : buffer) {
+		slot.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool JobSystem::Deque::push(Job *job) {
+	i64 b = bottom.load(std::memory_order_relaxed);
+	i64 t = top.load(std::memory_order_acquire);
+	if (b - t >= (i64)DEQUE_SIZE) return false;
+
+	buffer[b & (DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+	// the job has to be visible before the thieves can see the new bottom
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job *JobSystem::Deque::pop() {
+	i64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_seq_cst);
+	i64 t = top.load(std::memory_order_seq_cst);
+
+	if (t > b) {
+		// empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = buffer[b & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (t == b) {
+		// last job, a thief could be taking it at the same time
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job *JobSystem::Deque::steal() {
+	i64 t = top.load(std::memory_order_seq_cst);
+	i64 b = bottom.load(std::memory_order_seq_cst);
+	if (t >= b) return nullptr;
+
+	Job *job = buffer[t & (DEQUE_SIZE - 1)].load(std::memory_order_acquire);
+	// someone else took it first
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+		return nullptr;
+	}
+
+	return job;
+}
+
+// == JOB SYSTEM ==================================================================================================================
+
+JobSystem::~JobSystem() {
+	shutdown();
+}
+
+void JobSystem::init(u32 count) {
+	shutdown();
+
+	if (count == 0) count = std::thread::hardware_concurrency();
+	threadCount = max(count, 1u);
+	quit = false;
+
+	for (u32 i = 0; i < threadCount; ++i) {
+		Worker *worker = new Worker();
+		worker->seed = i * 0x9E3779B9u + 1;
+		workers.push_back(worker);
+	}
+
+	previousSystem = threadSlot.system;
+	previousIndex = threadSlot.index;
+	threadSlot.system = this;
+	threadSlot.index = 0;
+
+	for (u32 i = 1; i < threadCount; ++i) {
+		threads.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+
+	info("Job system started with %u threads", threadCount);
+}
+
+void JobSystem::shutdown() {
+	if (workers.empty()) return;
+
+	// what is left still has to run, the counters could be waited on
+	while (queued.load() > 0 || mainQueued.load() > 0) {
+		runMainJobs();
+		if (!runOne(0)) std::this_thread::yield();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+
+	for (Worker *worker : workers) {
+		delete worker;
+	}
+	workers.clear();
+	threadCount = 0;
+
+	if (threadSlot.system == this) {
+		threadSlot.system = previousSystem;
+		threadSlot.index = previousIndex;
+	}
+}
+
+void JobSystem::run(Function function, JobCounter *counter) {
+	push(newJob(std::move(function), counter));
+}
+
+void JobSystem::runAfter(JobCounter *dependency, Function function, JobCounter *counter) {
+	Job *job = newJob(std::move(function), counter);
+
+	if (dependency) {
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->value.load() > 0) {
+			dependency->continuations.push_back(job);
+			return;
+		}
+	}
+
+	push(job);
+}
+
+void JobSystem::runOnMain(Function function, JobCounter *counter) {
+	Job *job = newJob(std::move(function), counter);
+	std::lock_guard<std::mutex> lock(mainMutex);
+	mainJobs.push_back(job);
+	mainQueued++;
+}
+
+void JobSystem::wait(JobCounter *counter) {
+	u32 index = currentIndex();
+
+	while (!counter->isDone()) {
+		if (index == 0) runMainJobs();
+		if (index == NOT_A_WORKER || !runOne(index)) {
+			std::this_thread::yield();
+		}
+	}
+
+	// the last job could still be unlocking it
+	std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+void JobSystem::runMainJobs() {
+	if (mainQueued.load() == 0) return;
+	if (!isMainThread()) {
+		err("Main thread jobs can only be run on the main thread");
+		return;
+	}
+
+	std::vector<Job *> jobs;
+	{
+		std::lock_guard<std::mutex> lock(mainMutex);
+		jobs.swap(mainJobs);
+		mainQueued -= (u32)jobs.size();
+	}
+
+	for (Job *job : jobs) {
+		execute(job);
+	}
+}
+
+void JobSystem::parallelFor(u32 begin, u32 end, u32 grain, const RangeFunction &function) {
+	if (begin >= end) return;
+	grain = max(grain, 1u);
+
+	// only one range, no point in going through the deque
+	if (end - begin <= grain || workers.empty()) {
+		function(begin, end);
+		return;
+	}
+
+	JobCounter counter;
+	u32 first = begin;
+	u32 last = min(begin + grain, end);
+
+	for (u32 start = last; start < end; start += grain) {
+		u32 stop = min(start + grain, end);
+		run([&function, start, stop]() { function(start, stop); }, &counter);
+	}
+
+	// the first range runs here while the others are stolen
+	function(first, last);
+	wait(&counter);
+}
+
+bool JobSystem::isMainThread() const {
+	return threadSlot.system == this && threadSlot.index == 0;
+}
+
+JobSystem::Stats JobSystem::getStats() const {
+	Stats stats;
+	for (const Worker *worker : workers) {
+		stats.jobs   += worker->jobs.load(std::memory_order_relaxed);
+		stats.steals += worker->steals.load(std::memory_order_relaxed);
+		stats.sleeps += worker->sleeps.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+Job *JobSystem::newJob(Function function, JobCounter *counter) {
+	if (counter) counter->value++;
+	return new Job{ std::move(function), counter };
+}
+
+void JobSystem::push(Job *job) {
+	u32 index = currentIndex();
+
+	// threads that are not workers (and full deques) run the job right away
+	if (index == NOT_A_WORKER || !workers[index]->deque.push(job)) {
+		execute(job);
+		return;
+	}
+
+	queued++;
+	if (sleeping.load() > 0) {
+		// taking the lock means the sleeper is either waiting or hasn't checked queued yet
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+void JobSystem::execute(Job *job) {
+	if (job->function) job->function();
+
+	JobCounter *counter = job->counter;
+	delete job;
+	if (!counter) return;
+
+	// under the lock, so wait() can't return (and the counter be destroyed) while it's still used here
+	std::vector<Job *> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (--counter->value == 0) ready.swap(counter->continuations);
+	}
+
+	for (Job *continuation : ready) {
+		push(continuation);
+	}
+}
+
+bool JobSystem::runOne(u32 index) {
+	Job *job = find(index);
+	if (!job) return false;
+
+	queued--;
+	workers[index]->jobs.fetch_add(1, std::memory_order_relaxed);
+	execute(job);
+	return true;
+}
+
+Job *JobSystem::find(u32 index) {
+	Worker *self = workers[index];
+	if (Job *job = self->deque.pop()) return job;
+
+	// start from a random worker, so the thieves don't all go for the same one
+	self->seed = self->seed * 1664525u + 1013904223u;
+	u32 start = (self->seed >> 8) % threadCount;
+
+	for (u32 i = 0; i < threadCount; ++i) {
+		u32 victim = (start + i) % threadCount;
+		if (victim == index) continue;
+
+		if (Job *job = workers[victim]->deque.steal()) {
+			self->steals.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::workerLoop(u32 index) {
+	threadSlot.system = this;
+	threadSlot.index = index;
+
+	while (true) {
+		if (runOne(index)) continue;
+
+		// a short spin before sleeping, jobs often come in bursts
+		bool found = false;
+		for (u32 spin = 0; spin < 64 && !found; ++spin) {
+			std::this_thread::yield();
+			found = queued.load() > 0;
+		}
+		if (found) continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (quit) break;
+		sleeping++;
+		workers[index]->sleeps.fetch_add(1, std::memory_order_relaxed);
+		wake.wait(lock, [this]() { return quit || queued.load() > 0; });
+		sleeping--;
+	}
+
+	threadSlot.system = nullptr;
+}
+
+u32 JobSystem::currentIndex() const {
+	return threadSlot.system == this ? threadSlot.index : NOT_A_WORKER;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "types.h"
+
+struct Job;
+
+/* Counts the jobs that are still running, a job added with a counter
+ * increments it and decrements it when it finishes.
+ * Jobs added with runAfter() wait for the counter to reach zero.
+ * A counter must outlive the jobs that use it: it can only be destroyed
+ * after JobSystem::wait() returns.
+ */
+class JobCounter {
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter &) = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+
+	bool isDone() const { return value.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<u32> value { 0 };
+	std::mutex mutex;
+	std::vector<Job *> continuations;
+};
+
+/* Work stealing job scheduler.
+ * Every thread has its own Chase-Lev deque: the owner pushes and pops
+ * jobs at the bottom (last in first out, the data is still in its cache),
+ * the other threads steal from the top when they run out of work.
+ * The thread that calls init() is worker 0, it doesn't sleep but runs jobs
+ * while it waits for a counter.
+ * Jobs added with runOnMain() are only run by worker 0, this is where the
+ * device and the immediate context are used. They run when the main
+ * thread waits or calls runMainJobs().
+ * Workers that don't find anything to do sleep until a job is added.
+ */
+class JobSystem {
+public:
+	using Function = std::function<void()>;
+	// Called with a range [begin, end) of at most grain items
+	using RangeFunction = std::function<void(u32 begin, u32 end)>;
+
+	// Jobs a deque can hold, the jobs added when it's full run right away
+	static constexpr u32 DEQUE_SIZE = 4096;
+
+	struct Stats {
+		u64 jobs = 0;
+		u64 steals = 0;
+		u64 sleeps = 0;
+	};
+
+	JobSystem() = default;
+	~JobSystem();
+
+	// Starts threadCount - 1 workers, 0 uses one for every core
+	void init(u32 threadCount = 0);
+	// Runs the jobs that are left, then stops the workers
+	void shutdown();
+
+	void run(Function function, JobCounter *counter = nullptr);
+	// Runs function once dependency reaches zero (right away if it already has)
+	void runAfter(JobCounter *dependency, Function function, JobCounter *counter = nullptr);
+	// Runs function on the thread that called init()
+	void runOnMain(Function function, JobCounter *counter = nullptr);
+
+	// Runs other jobs until counter reaches zero
+	void wait(JobCounter *counter);
+	// Runs the main thread jobs that have been added so far, only on the main thread
+	void runMainJobs();
+
+	// Splits [begin, end) in ranges of grain items and waits for all of them
+	void parallelFor(u32 begin, u32 end, u32 grain, const RangeFunction &function);
+
+	u32 getThreadCount() const { return threadCount; }
+	bool isMainThread() const;
+	// Adds up the stats of every thread
+	Stats getStats() const;
+
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator=(const JobSystem &) = delete;
+
+private:
+	class Deque {
+	public:
+		Deque();
+		// Owner only, returns false if full
+		bool push(Job *job);
+		// Owner only
+		Job *pop();
+		// Any thread
+		Job *steal();
+
+	private:
+		std::atomic<i64> top { 0 };
+		std::atomic<i64> bottom { 0 };
+		std::vector<std::atomic<Job *>> buffer;
+	};
+
+	struct Worker {
+		Deque deque;
+		std::atomic<u64> jobs { 0 };
+		std::atomic<u64> steals { 0 };
+		std::atomic<u64> sleeps { 0 };
+		u32 seed = 0;
+	};
+
+	Job *newJob(Function function, JobCounter *counter);
+	void push(Job *job);
+	void execute(Job *job);
+	// Runs one job if it can find one, returns false otherwise
+	bool runOne(u32 index);
+	Job *find(u32 index);
+	void workerLoop(u32 index);
+	u32 currentIndex() const;
+
+	std::vector<Worker *> workers;
+	std::vector<std::thread> threads;
+	u32 threadCount = 0;
+
+	std::mutex mainMutex;
+	std::vector<Job *> mainJobs;
+	std::atomic<u32> mainQueued { 0 };
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	// jobs in the deques, can be briefly negative as it is changed after the deque
+	std::atomic<i32> queued { 0 };
+	std::atomic<u32> sleeping { 0 };
+	bool quit = false;
+
+	// the thread that called init() could already be part of another system
+	const JobSystem *previousSystem = nullptr;
+	u32 previousIndex = 0;
+};
+
+// Started by App1, used for the work that can be split across cores
+extern JobSystem jobSystem;
@@ -0,0 +1,332 @@
+#include "LightClusters.h"
+
+#include <math.h>
+#include <float.h>
+#include <chrono>
+
+#ifdef CLUSTERS_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#include "MathUtils.h"
+
+// == LIGHT CLUSTERS ==============================================================================================================
+
+void LightClusters::build(const ShadowCascades::View &camera, const Light *lights, u32 count, f32 maxDistance) {
+	using namespace std::chrono;
+	auto start = high_resolution_clock::now();
+
+	stats = Stats();
+	view = camera;
+	// the slices need some room after the first one
+	farZ = max(min(view.farZ, maxDistance), FIRST_SLICE * 2.f);
+	sliceScale = (f32)(SLICES - 1) / logf(farZ / FIRST_SLICE);
+	sliceBias = 1.f - logf(FIRST_SLICE) * sliceScale;
+	updateGrid();
+
+	pairs.clear();
+	counts.assign(CLUSTER_COUNT, 0);
+
+	stats.lights = count;
+	if (count > MAX_LIGHTS) {
+		stats.dropped += count - MAX_LIGHTS;
+		count = MAX_LIGHTS;
+	}
+
+	for (u32 i = 0; i < count; ++i) {
+		size_t before = pairs.size();
+		binLight(i, lights[i]);
+		if (pairs.size() > before) stats.visible++;
+	}
+
+	// every cluster gets a range, the lights past the limits are dropped
+	clusters.resize(CLUSTER_COUNT);
+	u32 offset = 0;
+	for (u32 c = 0; c < CLUSTER_COUNT; ++c) {
+		u32 clusterCount = min(min(counts[c], (u32)MAX_PER_CLUSTER), MAX_INDICES - offset);
+		stats.dropped += counts[c] - clusterCount;
+		stats.maxPerCluster = max(stats.maxPerCluster, clusterCount);
+		if (clusterCount) stats.usedClusters++;
+
+		clusters[c].offset = offset;
+		clusters[c].count = clusterCount;
+		offset += clusterCount;
+		counts[c] = 0;
+	}
+
+	// the pairs are in the order of the lights, so every list is sorted
+	indices.resize(offset);
+	for (const Pair &pair : pairs) {
+		const Cluster &cluster = clusters[pair.cluster];
+		u32 &filled = counts[pair.cluster];
+		if (filled < cluster.count) {
+			indices[cluster.offset + filled++] = pair.light;
+		}
+	}
+	stats.indices = offset;
+
+	stats.binMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+}
+
+i32 LightClusters::getClusterIndex(const vec3f &position) const {
+	vec3f p = toView(position);
+	if (p.z < view.nearZ || p.z >= farZ) return -1;
+
+	f32 tanX = view.tanHalfFovY * view.aspect;
+	f32 ndcX = p.x / (p.z * tanX);
+	f32 ndcY = p.y / (p.z * view.tanHalfFovY);
+	if (fabsf(ndcX) > 1.f || fabsf(ndcY) > 1.f) return -1;
+
+	i32 x = clamp((i32)floorf((ndcX + 1.f) * 0.5f * TILES_X), 0, (i32)TILES_X - 1);
+	i32 y = clamp((i32)floorf((1.f - ndcY) * 0.5f * TILES_Y), 0, (i32)TILES_Y - 1);
+	i32 z = getSlice(p.z);
+	return (z * (i32)TILES_Y + y) * (i32)TILES_X + x;
+}
+
+// -- Private ------------------------------------------------------------------
+
+void LightClusters::updateGrid() {
+	if (
+		gridTanHalfFovY == view.tanHalfFovY && gridAspect == view.aspect &&
+		gridNearZ == view.nearZ && gridFarZ == farZ
+	) {
+		return;
+	}
+
+	gridTanHalfFovY = view.tanHalfFovY;
+	gridAspect = view.aspect;
+	gridNearZ = view.nearZ;
+	gridFarZ = farZ;
+
+	for (std::vector<f32> *component : { &boxMinX, &boxMinY, &boxMinZ, &boxMaxX, &boxMaxY, &boxMaxZ, &sphereX, &sphereY, &sphereZ, &sphereRadius }) {
+		component->resize(CLUSTER_COUNT);
+	}
+
+	f32 tanX = view.tanHalfFovY * view.aspect;
+	f32 tanY = view.tanHalfFovY;
+
+	for (u32 z = 0; z < SLICES; ++z) {
+		// the inverse of getSlice(), the first slice starts at the near plane
+		f32 zNear = z == 0 ? view.nearZ : expf(((f32)z - sliceBias) / sliceScale);
+		f32 zFar = z == SLICES - 1 ? farZ : expf(((f32)z + 1.f - sliceBias) / sliceScale);
+
+		for (u32 y = 0; y < TILES_Y; ++y) {
+			// the first row is at the top of the screen
+			f32 ndcTop = 1.f - 2.f * y / TILES_Y;
+			f32 ndcBottom = 1.f - 2.f * (y + 1) / TILES_Y;
+
+			for (u32 x = 0; x < TILES_X; ++x) {
+				f32 ndcLeft = -1.f + 2.f * x / TILES_X;
+				f32 ndcRight = -1.f + 2.f * (x + 1) / TILES_X;
+
+				vec3f bmin(FLT_MAX), bmax(-FLT_MAX);
+				for (f32 depth : { zNear, zFar }) {
+					for (f32 ndcX : { ndcLeft, ndcRight }) {
+						for (f32 ndcY : { ndcTop, ndcBottom }) {
+							vec3f corner = { ndcX * tanX * depth, ndcY * tanY * depth, depth };
+							bmin = { min(bmin.x, corner.x), min(bmin.y, corner.y), min(bmin.z, corner.z) };
+							bmax = { max(bmax.x, corner.x), max(bmax.y, corner.y), max(bmax.z, corner.z) };
+						}
+					}
+				}
+
+				u32 c = (z * TILES_Y + y) * TILES_X + x;
+				boxMinX[c] = bmin.x; boxMinY[c] = bmin.y; boxMinZ[c] = bmin.z;
+				boxMaxX[c] = bmax.x; boxMaxY[c] = bmax.y; boxMaxZ[c] = bmax.z;
+
+				vec3f center = (bmin + bmax) * 0.5f;
+				sphereX[c] = center.x; sphereY[c] = center.y; sphereZ[c] = center.z;
+				sphereRadius[c] = (bmax - center).mag();
+			}
+		}
+	}
+}
+
+i32 LightClusters::getSlice(f32 depth) const {
+	if (depth < FIRST_SLICE) return 0;
+	return clamp((i32)floorf(logf(depth) * sliceScale + sliceBias), 0, (i32)SLICES - 1);
+}
+
+bool LightClusters::getBounds(const vec3f &center, f32 radius, Bounds &bounds) const {
+	f32 zMin = center.z - radius;
+	f32 zMax = center.z + radius;
+	if (zMax < view.nearZ || zMin >= farZ) return false;
+	zMin = max(zMin, view.nearZ);
+	zMax = min(zMax, farZ);
+
+	// the sphere's box projected on the screen, x / z is the most
+	// extreme at one of its corners
+	f32 tanX = view.tanHalfFovY * view.aspect;
+	f32 tanY = view.tanHalfFovY;
+	f32 ndcMinX = FLT_MAX, ndcMaxX = -FLT_MAX;
+	f32 ndcMinY = FLT_MAX, ndcMaxY = -FLT_MAX;
+	for (f32 depth : { zMin, zMax }) {
+		for (f32 sign : { -1.f, 1.f }) {
+			f32 ndcX = (center.x + sign * radius) / (depth * tanX);
+			f32 ndcY = (center.y + sign * radius) / (depth * tanY);
+			ndcMinX = min(ndcMinX, ndcX); ndcMaxX = max(ndcMaxX, ndcX);
+			ndcMinY = min(ndcMinY, ndcY); ndcMaxY = max(ndcMaxY, ndcY);
+		}
+	}
+	if (ndcMaxX < -1.f || ndcMinX > 1.f || ndcMaxY < -1.f || ndcMinY > 1.f) return false;
+
+	bounds.x0 = clamp((i32)floorf((ndcMinX + 1.f) * 0.5f * TILES_X), 0, (i32)TILES_X - 1);
+	bounds.x1 = clamp((i32)floorf((ndcMaxX + 1.f) * 0.5f * TILES_X), 0, (i32)TILES_X - 1);
+	bounds.y0 = clamp((i32)floorf((1.f - ndcMaxY) * 0.5f * TILES_Y), 0, (i32)TILES_Y - 1);
+	bounds.y1 = clamp((i32)floorf((1.f - ndcMinY) * 0.5f * TILES_Y), 0, (i32)TILES_Y - 1);
+	bounds.z0 = getSlice(zMin);
+	bounds.z1 = getSlice(zMax);
+	return true;
+}
+
+void LightClusters::binLight(u32 index, const Light &light) {
+	vec3f apex = toView(light.position);
+	vec3f center = apex;
+	f32 radius = light.range;
+	vec3f viewDir;
+
+	// the smallest sphere around the cone
+	if (light.type == Type::Spot) {
+		vec3f dir = light.direction.normalized();
+		viewDir = { dot(dir, view.right), dot(dir, view.up), dot(dir, view.forward) };
+
+		f32 cosAngle = light.cosAngle;
+		if (cosAngle > 0.70710678f) {
+			radius = light.range / (2.f * cosAngle);
+			center = apex + viewDir * radius;
+		}
+		else if (cosAngle > 0.f) {
+			radius = light.range * sqrtf(1.f - cosAngle * cosAngle);
+			center = apex + viewDir * (light.range * cosAngle);
+		}
+	}
+
+	Bounds bounds;
+	if (!getBounds(center, radius, bounds)) return;
+
+	if (useSimd) {
+		binSimd(index, center, radius, light, viewDir, bounds);
+	}
+	else {
+		binScalar(index, center, radius, light, viewDir, bounds);
+	}
+}
+
+void LightClusters::binScalar(u32 index, const vec3f &center, f32 radius, const Light &light, const vec3f &viewDir, const Bounds &bounds) {
+	bool isSpot = light.type == Type::Spot && light.cosAngle > 0.f;
+	vec3f apex = toView(light.position);
+	f32 cosAngle = light.cosAngle;
+	f32 sinAngle = sqrtf(max(1.f - cosAngle * cosAngle, 0.f));
+	f32 radius2 = radius * radius;
+
+	for (i32 z = bounds.z0; z <= bounds.z1; ++z) {
+		for (i32 y = bounds.y0; y <= bounds.y1; ++y) {
+			u32 row = (z * TILES_Y + y) * TILES_X;
+			for (i32 x = bounds.x0; x <= bounds.x1; ++x) {
+				u32 c = row + x;
+
+				// sphere against the cluster's box
+				f32 dx = max(max(boxMinX[c] - center.x, center.x - boxMaxX[c]), 0.f);
+				f32 dy = max(max(boxMinY[c] - center.y, center.y - boxMaxY[c]), 0.f);
+				f32 dz = max(max(boxMinZ[c] - center.z, center.z - boxMaxZ[c]), 0.f);
+				if (dx * dx + dy * dy + dz * dz > radius2) continue;
+
+				// cone against the cluster's sphere
+				if (isSpot) {
+					f32 vx = sphereX[c] - apex.x;
+					f32 vy = sphereY[c] - apex.y;
+					f32 vz = sphereZ[c] - apex.z;
+					f32 lenSq = vx * vx + vy * vy + vz * vz;
+					f32 along = vx * viewDir.x + vy * viewDir.y + vz * viewDir.z;
+					f32 closest = cosAngle * sqrtf(max(lenSq - along * along, 0.f)) - along * sinAngle;
+					f32 r = sphereRadius[c];
+					if (closest > r || along > r + light.range || along < -r) continue;
+				}
+
+				pairs.push_back({ c, index });
+				counts[c]++;
+			}
+		}
+	}
+}
+
+void LightClusters::binSimd(u32 index, const vec3f &center, f32 radius, const Light &light, const vec3f &viewDir, const Bounds &bounds) {
+#ifdef CLUSTERS_USE_SSE
+	bool isSpot = light.type == Type::Spot && light.cosAngle > 0.f;
+	vec3f apex = toView(light.position);
+	f32 cosAngle = light.cosAngle;
+	f32 sinAngle = sqrtf(max(1.f - cosAngle * cosAngle, 0.f));
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 cz = _mm_set1_ps(center.z);
+	const __m128 radius2 = _mm_set1_ps(radius * radius);
+	const __m128 ax = _mm_set1_ps(apex.x);
+	const __m128 ay = _mm_set1_ps(apex.y);
+	const __m128 az = _mm_set1_ps(apex.z);
+	const __m128 dirX = _mm_set1_ps(viewDir.x);
+	const __m128 dirY = _mm_set1_ps(viewDir.y);
+	const __m128 dirZ = _mm_set1_ps(viewDir.z);
+	const __m128 coneCos = _mm_set1_ps(cosAngle);
+	const __m128 coneSin = _mm_set1_ps(sinAngle);
+	const __m128 range = _mm_set1_ps(light.range);
+	const __m128i laneX = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i firstX = _mm_set1_epi32(bounds.x0 - 1);
+	const __m128i lastX = _mm_set1_epi32(bounds.x1 + 1);
+
+	i32 startX = bounds.x0 & ~3;
+	for (i32 z = bounds.z0; z <= bounds.z1; ++z) {
+		for (i32 y = bounds.y0; y <= bounds.y1; ++y) {
+			u32 row = (z * TILES_Y + y) * TILES_X;
+			for (i32 x = startX; x <= bounds.x1; x += 4) {
+				u32 c = row + x;
+
+				// only the lanes between x0 and x1
+				__m128i lane = _mm_add_epi32(_mm_set1_epi32(x), laneX);
+				__m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(lane, firstX), _mm_cmplt_epi32(lane, lastX)));
+
+				// sphere against the clusters' boxes
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinX[c]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&boxMaxX[c]))), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinY[c]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&boxMaxY[c]))), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinZ[c]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&boxMaxZ[c]))), zero);
+				__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				inside = _mm_and_ps(inside, _mm_cmple_ps(dist2, radius2));
+
+				// cone against the clusters' spheres
+				if (isSpot && _mm_movemask_ps(inside)) {
+					__m128 vx = _mm_sub_ps(_mm_loadu_ps(&sphereX[c]), ax);
+					__m128 vy = _mm_sub_ps(_mm_loadu_ps(&sphereY[c]), ay);
+					__m128 vz = _mm_sub_ps(_mm_loadu_ps(&sphereZ[c]), az);
+					__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+					__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dirX), _mm_mul_ps(vy, dirY)), _mm_mul_ps(vz, dirZ));
+					__m128 side = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lenSq, _mm_mul_ps(along, along)), zero));
+					__m128 closest = _mm_sub_ps(_mm_mul_ps(coneCos, side), _mm_mul_ps(along, coneSin));
+					__m128 r = _mm_loadu_ps(&sphereRadius[c]);
+
+					__m128 culled = _mm_or_ps(
+						_mm_or_ps(_mm_cmpgt_ps(closest, r), _mm_cmpgt_ps(along, _mm_add_ps(r, range))),
+						_mm_cmplt_ps(along, _mm_sub_ps(zero, r))
+					);
+					inside = _mm_andnot_ps(culled, inside);
+				}
+
+				u32 mask = (u32)_mm_movemask_ps(inside);
+				for (; mask; mask &= mask - 1) {
+					u32 lane = 0;
+					while (!(mask & (1u << lane))) lane++;
+					pairs.push_back({ c + lane, index });
+					counts[c + lane]++;
+				}
+			}
+		}
+	}
+#else
+	binScalar(index, center, radius, light, viewDir, bounds);
+#endif
+}
+
+vec3f LightClusters::toView(const vec3f &world) const {
+	vec3f d = world - view.position;
+	return { dot(d, view.right), dot(d, view.up), dot(d, view.forward) };
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+#include "ShadowCascades.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CLUSTERS_USE_SSE
+#endif
+
+/* Clustered light culling, for the point and spot lights that don't cast
+ * shadows (fireflies, torches, ...).
+ * The camera frustum is split in a grid of clusters (froxels): TILES_X by
+ * TILES_Y tiles on screen, and SLICES slices in depth that grow
+ * exponentially, like the perspective does. Every frame the lights are
+ * binned in the clusters they touch and every cluster gets a range in a
+ * compact list of light indices, the pixel shader finds its cluster from
+ * its position and only loops over that range.
+ * Binning works in view space: a light only tests the clusters inside its
+ * screen and depth bounds. Point lights are spheres tested against the
+ * boxes of the clusters, spot lights are cones tested against the spheres
+ * around them. With SSE2 four clusters of a row are tested at once.
+ * The first slice starts at the camera's near plane and ends at
+ * FIRST_SLICE, as nothing much is closer than that.
+ */
+class LightClusters {
+public:
+	// matches CLUSTER_* in utils.hlsli
+	static constexpr u32 TILES_X = 16;
+	static constexpr u32 TILES_Y = 9;
+	static constexpr u32 SLICES = 24;
+	static constexpr u32 CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+	static constexpr f32 FIRST_SLICE = 1.f;
+	// lights past these are dropped and counted in the stats
+	static constexpr u32 MAX_LIGHTS = 16384;
+	static constexpr u32 MAX_PER_CLUSTER = 256;
+	static constexpr u32 MAX_INDICES = 1 << 18;
+
+	static_assert(TILES_X % 4 == 0, "the rows are tested four clusters at a time");
+
+	enum class Type : u8 {
+		Point,
+		Spot,
+	};
+
+	// In world space
+	struct Light {
+		vec3f position;
+		f32 range = 1.f;
+		vec3f color;
+		Type type = Type::Point;
+		// only used by spot lights
+		vec3f direction { 0.f, -1.f, 0.f };
+		f32 cosAngle = 0.7f; // cosine of half the cone's angle
+	};
+
+	// Range of a cluster in the index list
+	struct Cluster {
+		u32 offset = 0;
+		u32 count = 0;
+	};
+
+	struct Stats {
+		u32 lights = 0;
+		u32 visible = 0;       // lights that touched at least one cluster
+		u32 indices = 0;
+		u32 usedClusters = 0;
+		u32 maxPerCluster = 0;
+		u32 dropped = 0;       // indices past MAX_PER_CLUSTER or MAX_INDICES
+		f64 binMs = 0.0;
+	};
+
+	// Bins count lights in the clusters of the camera, up to maxDistance from it
+	void build(const ShadowCascades::View &view, const Light *lights, u32 count, f32 maxDistance);
+
+	const std::vector<Cluster> &getClusters() const { return clusters; }
+	const std::vector<u32> &getIndices() const { return indices; }
+	const Stats &getStats() const { return stats; }
+	const ShadowCascades::View &getView() const { return view; }
+	f32 getFarZ() const { return farZ; }
+	// slice = log(depth) * scale + bias, the pixel shader uses the same
+	f32 getSliceScale() const { return sliceScale; }
+	f32 getSliceBias() const { return sliceBias; }
+
+	// Cluster of a world space position, -1 if it's outside of the grid
+	i32 getClusterIndex(const vec3f &position) const;
+
+	void setUseSimd(bool use) { useSimd = use; }
+	bool getUseSimd() const { return useSimd; }
+
+private:
+	struct Bounds {
+		i32 x0, x1, y0, y1, z0, z1;
+	};
+
+	// Rebuilds the clusters' boxes when the projection changes
+	void updateGrid();
+	i32 getSlice(f32 depth) const;
+	// Tiles and slices a view space sphere can touch, false if it's outside of the grid
+	bool getBounds(const vec3f &center, f32 radius, Bounds &bounds) const;
+	void binLight(u32 index, const Light &light);
+	void binScalar(u32 index, const vec3f &center, f32 radius, const Light &light, const vec3f &viewDir, const Bounds &bounds);
+	void binSimd(u32 index, const vec3f &center, f32 radius, const Light &light, const vec3f &viewDir, const Bounds &bounds);
+	vec3f toView(const vec3f &world) const;
+
+	ShadowCascades::View view;
+	f32 farZ = 0.f;
+	f32 sliceScale = 0.f;
+	f32 sliceBias = 0.f;
+	// the projection the boxes were built with
+	f32 gridTanHalfFovY = 0.f;
+	f32 gridAspect = 0.f;
+	f32 gridNearZ = 0.f;
+	f32 gridFarZ = 0.f;
+
+	// view space boxes and bounding spheres of the clusters, one array for
+	// every component so four of them can be loaded at once
+	std::vector<f32> boxMinX, boxMinY, boxMinZ;
+	std::vector<f32> boxMaxX, boxMaxY, boxMaxZ;
+	std::vector<f32> sphereX, sphereY, sphereZ, sphereRadius;
+
+	// (cluster, light) pairs found while binning, sorted into indices after
+	struct Pair {
+		u32 cluster;
+		u32 light;
+	};
+	std::vector<Pair> pairs;
+	std::vector<u32> counts;
+	std::vector<Cluster> clusters;
+	std::vector<u32> indices;
+
+	bool useSimd = true;
+	Stats stats;
+};
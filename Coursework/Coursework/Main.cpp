@@ -2,8 +2,15 @@
 #include "../DXFramework/System.h"
 #include "App1.h"
 
+#include <string.h>
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pScmdline, int iCmdshow)
 {
+	// the offline step: compiles the shader variants into their archive and quits
+	if (pScmdline && strstr(pScmdline, "-packshaders")) {
+		return ShaderLibrary::buildArchive("shaders", "shaders/permutations.pak") ? 0 : 1;
+	}
+
 	App1* app = new App1();
 	System* system;
 
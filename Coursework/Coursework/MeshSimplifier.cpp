@@ -0,0 +1,344 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "MathUtils.h"
+#include "JobSystem.h"
+
+// border edges are a lot more noticeable than a slightly wrong surface
+static constexpr f64 BORDER_WEIGHT = 10.0;
+
+struct Vec3d {
+	f64 x, y, z;
+
+	Vec3d operator+(const Vec3d &o) const { return { x + o.x, y + o.y, z + o.z }; }
+	Vec3d operator-(const Vec3d &o) const { return { x - o.x, y - o.y, z - o.z }; }
+	Vec3d operator*(f64 s) const { return { x * s, y * s, z * s }; }
+	f64 dot(const Vec3d &o) const { return x * o.x + y * o.y + z * o.z; }
+	Vec3d cross(const Vec3d &o) const { return { y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x }; }
+	f64 mag() const { return sqrt(dot(*this)); }
+};
+
+/* Symmetric 4x4 matrix of the plane equation ax + by + cz + d = 0,
+ * the error of a point is the weighted sum of the squared distances to
+ * all the accumulated planes. weight is used to get the average.
+ */
+struct Quadric {
+	f64 a2 = 0, ab = 0, ac = 0, ad = 0;
+	f64 b2 = 0, bc = 0, bd = 0;
+	f64 c2 = 0, cd = 0;
+	f64 d2 = 0;
+	f64 weight = 0;
+
+	static Quadric fromPlane(const Vec3d &n, f64 d, f64 w) {
+		Quadric q;
+		q.a2 = n.x * n.x * w; q.ab = n.x * n.y * w; q.ac = n.x * n.z * w; q.ad = n.x * d * w;
+		q.b2 = n.y * n.y * w; q.bc = n.y * n.z * w; q.bd = n.y * d * w;
+		q.c2 = n.z * n.z * w; q.cd = n.z * d * w;
+		q.d2 = d * d * w;
+		q.weight = w;
+		return q;
+	}
+
+	void add(const Quadric &o) {
+		a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+		b2 += o.b2; bc += o.bc; bd += o.bd;
+		c2 += o.c2; cd += o.cd;
+		d2 += o.d2;
+		weight += o.weight;
+	}
+
+	f64 eval(const Vec3d &p) const {
+		f64 rx = a2 * p.x + ab * p.y + ac * p.z + ad;
+		f64 ry = ab * p.x + b2 * p.y + bc * p.z + bd;
+		f64 rz = ac * p.x + bc * p.y + c2 * p.z + cd;
+		f64 r = rx * p.x + ry * p.y + rz * p.z + ad * p.x + bd * p.y + cd * p.z + d2;
+		return r > 0 ? r : 0;
+	}
+};
+
+struct Collapse {
+	u32 from, to;
+	f64 cost; // squared average distance
+};
+
+static Vec3d getPosition(const f32 *positions, size_t stride, u32 index) {
+	const f32 *p = (const f32 *)((const u8 *)positions + stride * index);
+	return { p[0], p[1], p[2] };
+}
+
+f32 simplifyMesh(
+	const f32 *positions, size_t stride, u32 vertexCount,
+	const u32 *indices, u32 indexCount,
+	u32 targetIndexCount, f32 maxError,
+	std::vector<u32> &outIndices
+) {
+	outIndices.assign(indices, indices + indexCount);
+	if (indexCount <= targetIndexCount || vertexCount == 0) return 0.f;
+
+	std::vector<Vec3d> pos(vertexCount);
+	for (u32 i = 0; i < vertexCount; ++i) {
+		pos[i] = getPosition(positions, stride, i);
+	}
+
+	// -- Find vertices that share the same position ------------------------------------------------------------------------
+
+	std::vector<u32> order(vertexCount);
+	for (u32 i = 0; i < vertexCount; ++i) order[i] = i;
+	std::sort(order.begin(), order.end(), [&pos](u32 a, u32 b) {
+		if (pos[a].x != pos[b].x) return pos[a].x < pos[b].x;
+		if (pos[a].y != pos[b].y) return pos[a].y < pos[b].y;
+		return pos[a].z < pos[b].z;
+	});
+
+	// root: first vertex with this position, locked: the position is shared by a seam
+	std::vector<u32> root(vertexCount);
+	std::vector<bool> locked(vertexCount, false);
+
+	for (u32 i = 0; i < vertexCount;) {
+		u32 j = i + 1;
+		while (j < vertexCount && pos[order[j]].x == pos[order[i]].x && pos[order[j]].y == pos[order[i]].y && pos[order[j]].z == pos[order[i]].z) {
+			++j;
+		}
+		for (u32 k = i; k < j; ++k) {
+			root[order[k]] = order[i];
+			locked[order[k]] = j - i > 1;
+		}
+		i = j;
+	}
+
+	// -- Build the quadrics ------------------------------------------------------------------------------------------------
+
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<u64> edges;
+	edges.reserve(indexCount);
+
+	for (u32 t = 0; t + 2 < indexCount; t += 3) {
+		u32 r[3] = { root[indices[t]], root[indices[t + 1]], root[indices[t + 2]] };
+
+		Vec3d n = (pos[r[1]] - pos[r[0]]).cross(pos[r[2]] - pos[r[0]]);
+		f64 len = n.mag();
+		if (len == 0.0) continue;
+
+		n = n * (1.0 / len);
+		Quadric q = Quadric::fromPlane(n, -n.dot(pos[r[0]]), len * 0.5);
+		for (u32 k = 0; k < 3; ++k) {
+			quadrics[r[k]].add(q);
+
+			u32 a = r[k], b = r[(k + 1) % 3];
+			edges.push_back(((u64)min(a, b) << 32) | max(a, b));
+		}
+	}
+
+	// Edges used by a single triangle are borders, keep them in place with
+	// a plane perpendicular to the triangle going through the edge
+	std::sort(edges.begin(), edges.end());
+
+	for (u32 t = 0; t + 2 < indexCount; t += 3) {
+		u32 r[3] = { root[indices[t]], root[indices[t + 1]], root[indices[t + 2]] };
+
+		Vec3d n = (pos[r[1]] - pos[r[0]]).cross(pos[r[2]] - pos[r[0]]);
+		f64 len = n.mag();
+		if (len == 0.0) continue;
+		n = n * (1.0 / len);
+
+		for (u32 k = 0; k < 3; ++k) {
+			u32 a = r[k], b = r[(k + 1) % 3];
+			u64 key = ((u64)min(a, b) << 32) | max(a, b);
+			auto range = std::equal_range(edges.begin(), edges.end(), key);
+			if (range.second - range.first != 1) continue;
+
+			Vec3d edge = pos[b] - pos[a];
+			f64 edgeLen = edge.mag();
+			if (edgeLen == 0.0) continue;
+
+			Vec3d borderNormal = edge.cross(n) * (1.0 / edgeLen);
+			Quadric q = Quadric::fromPlane(borderNormal, -borderNormal.dot(pos[a]), edgeLen * edgeLen * BORDER_WEIGHT);
+			quadrics[a].add(q);
+			quadrics[b].add(q);
+		}
+	}
+
+	// -- Collapse edges ----------------------------------------------------------------------------------------------------
+
+	f64 maxCost = (f64)maxError * maxError;
+	f64 reachedCost = 0.0;
+
+	std::vector<u32> &current = outIndices;
+	std::vector<u32> adjOffsets(vertexCount + 1), adjacency;
+	std::vector<u32> collapseTo(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> candidates;
+
+	while (current.size() > targetIndexCount) {
+		// -- Vertex to triangle adjacency --------------------------------------------------------------------------------------
+		std::fill(adjOffsets.begin(), adjOffsets.end(), 0);
+		for (u32 index : current) adjOffsets[index + 1]++;
+		for (u32 i = 0; i < vertexCount; ++i) adjOffsets[i + 1] += adjOffsets[i];
+
+		adjacency.resize(current.size());
+		std::vector<u32> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+		for (u32 i = 0; i < (u32)current.size(); ++i) {
+			adjacency[fill[current[i]]++] = i / 3;
+		}
+
+		// -- Candidates sorted by cost -----------------------------------------------------------------------------------------
+		candidates.clear();
+		for (u32 t = 0; t < (u32)current.size(); t += 3) {
+			for (u32 k = 0; k < 3; ++k) {
+				u32 a = current[t + k], b = current[t + (k + 1) % 3];
+
+				for (u32 dir = 0; dir < 2; ++dir) {
+					u32 from = dir ? b : a;
+					u32 to   = dir ? a : b;
+					if (locked[from] || root[from] == root[to]) continue;
+
+					Quadric q = quadrics[root[from]];
+					q.add(quadrics[root[to]]);
+					f64 cost = q.weight > 0.0 ? q.eval(pos[to]) / q.weight : 0.0;
+					if (cost <= maxCost) {
+						candidates.push_back({ from, to, cost });
+					}
+				}
+			}
+		}
+
+		if (candidates.empty()) break;
+
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) {
+			if (a.cost != b.cost) return a.cost < b.cost;
+			if (a.from != b.from) return a.from < b.from;
+			return a.to < b.to;
+		});
+
+		// every collapse removes up to two triangles
+		size_t needed = (current.size() - targetIndexCount) / 6 + 1;
+		size_t collapsed = 0;
+
+		for (u32 i = 0; i < vertexCount; ++i) collapseTo[i] = i;
+		std::fill(touched.begin(), touched.end(), false);
+
+		for (const Collapse &c : candidates) {
+			if (collapsed >= needed) break;
+			if (touched[c.from] || touched[c.to]) continue;
+
+			// don't collapse if any of the remaining triangles would flip
+			bool flips = false;
+			for (u32 a = adjOffsets[c.from]; a < adjOffsets[c.from + 1] && !flips; ++a) {
+				const u32 *tri = &current[adjacency[a] * 3];
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) continue;
+
+				Vec3d p[3], moved[3];
+				for (u32 k = 0; k < 3; ++k) {
+					p[k] = pos[tri[k]];
+					moved[k] = tri[k] == c.from ? pos[c.to] : p[k];
+				}
+
+				Vec3d before = (p[1] - p[0]).cross(p[2] - p[0]);
+				Vec3d after = (moved[1] - moved[0]).cross(moved[2] - moved[0]);
+				flips = before.dot(after) <= 0.25 * before.mag() * after.mag();
+			}
+			if (flips) continue;
+
+			collapseTo[c.from] = c.to;
+			quadrics[root[c.to]].add(quadrics[root[c.from]]);
+			reachedCost = max(reachedCost, c.cost);
+			collapsed++;
+
+			// the triangles around the removed vertex changed, don't touch them again in this pass
+			for (u32 a = adjOffsets[c.from]; a < adjOffsets[c.from + 1]; ++a) {
+				const u32 *tri = &current[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+		}
+
+		if (collapsed == 0) break;
+
+		// -- Remove the degenerate triangles -------------------------------------------------------------------------------
+		size_t write = 0;
+		for (size_t t = 0; t < current.size(); t += 3) {
+			u32 a = collapseTo[current[t]], b = collapseTo[current[t + 1]], c = collapseTo[current[t + 2]];
+			if (root[a] == root[b] || root[b] == root[c] || root[c] == root[a]) continue;
+			current[write++] = a;
+			current[write++] = b;
+			current[write++] = c;
+		}
+		current.resize(write);
+	}
+
+	return (f32)sqrt(reachedCost);
+}
+
+void buildLodChain(
+	const f32 *positions, size_t stride, u32 vertexCount,
+	const u32 *indices, u32 indexCount,
+	const LodChainDesc &desc,
+	std::vector<u32> &outIndices, std::vector<MeshLod> &outLods
+) {
+	MeshLod full;
+	full.indexStart = (u32)outIndices.size();
+	full.indexCount = indexCount;
+	outIndices.insert(outIndices.end(), indices, indices + indexCount);
+	outLods.push_back(full);
+
+	if (vertexCount == 0) return;
+
+	// the error is relative to the size of the mesh
+	Vec3d bmin = getPosition(positions, stride, 0), bmax = bmin;
+	for (u32 i = 1; i < vertexCount; ++i) {
+		Vec3d p = getPosition(positions, stride, i);
+		bmin = { min(bmin.x, p.x), min(bmin.y, p.y), min(bmin.z, p.z) };
+		bmax = { max(bmax.x, p.x), max(bmax.y, p.y), max(bmax.z, p.z) };
+	}
+	f32 maxError = desc.maxError * (f32)(bmax - bmin).mag();
+
+	if (desc.lodCount < 2) return;
+
+	// every lod starts from the full mesh (this way the errors don't pile
+	// up), so they don't depend on each other and are simplified in parallel
+	u32 simplified = desc.lodCount - 1;
+	std::vector<std::vector<u32>> lodIndices(simplified);
+	std::vector<f32> lodErrors(simplified);
+	std::vector<u32> targetCounts(simplified);
+
+	f32 target = (f32)indexCount;
+	for (u32 i = 0; i < simplified; ++i) {
+		target *= desc.reduction;
+		targetCounts[i] = (u32)target / 3 * 3;
+	}
+
+	jobSystem.parallelFor(0, simplified, 1, [&](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			lodErrors[i] = simplifyMesh(positions, stride, vertexCount, indices, indexCount, targetCounts[i], maxError, lodIndices[i]);
+		}
+	});
+
+	u32 prevCount = indexCount;
+
+	for (u32 i = 0; i < simplified; ++i) {
+		// not worth it if we couldn't remove at least 10% of the triangles
+		if (lodIndices[i].empty() || lodIndices[i].size() > prevCount * 9 / 10) break;
+
+		MeshLod lod;
+		lod.indexStart = (u32)outIndices.size();
+		lod.indexCount = (u32)lodIndices[i].size();
+		lod.error = lodErrors[i];
+		outIndices.insert(outIndices.end(), lodIndices[i].begin(), lodIndices[i].end());
+		outLods.push_back(lod);
+
+		prevCount = lod.indexCount;
+	}
+}
+
+u32 selectLod(f32 screenSize, const LodChainDesc &desc, u32 lodCount) {
+	u32 lod = 0;
+	f32 threshold = desc.firstScreenSize;
+
+	while (lod + 1 < lodCount && screenSize < threshold) {
+		lod++;
+		threshold *= 0.5f;
+	}
+
+	return lod;
+}
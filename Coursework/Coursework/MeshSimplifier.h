@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+// Range of the index buffer used by a level of detail
+struct MeshLod {
+	u32 indexStart = 0;
+	u32 indexCount = 0;
+	f32 error = 0.f; // simplification error in model units
+};
+
+struct LodChainDesc {
+	u32 lodCount        = 4;     // including the full detail mesh
+	f32 reduction       = 0.5f;  // triangles kept from one lod to the next
+	f32 maxError        = 0.05f; // max error, relative to the mesh bounding box diagonal
+	f32 firstScreenSize = 0.4f;  // lod 0 is used until the object covers less than this fraction of the screen height,
+	                             // the threshold is halved for every following lod
+};
+
+/* Quadric error metric simplifier (Garland & Heckbert).
+ * Edges are collapsed into one of their vertices, this way no new
+ * vertices are created and the same vertex buffer can be shared by all
+ * the lods, only the index buffer changes.
+ * Vertices on uv/normal seams (same position, different attributes) are
+ * never removed, borders are preserved by adding a perpendicular plane
+ * to the quadric of their edges.
+ * Returns the reached error (root mean square distance from the original
+ * planes, in model units), that is never bigger than maxError.
+ */
+f32 simplifyMesh(
+	const f32 *positions, size_t stride, u32 vertexCount,
+	const u32 *indices, u32 indexCount,
+	u32 targetIndexCount, f32 maxError,
+	std::vector<u32> &outIndices
+);
+
+// Appends every lod (starting from the full mesh) to outIndices, stops early if a lod can't be simplified further.
+// The lods are simplified in parallel on jobSystem (or on the calling thread if it isn't running)
+void buildLodChain(
+	const f32 *positions, size_t stride, u32 vertexCount,
+	const u32 *indices, u32 indexCount,
+	const LodChainDesc &desc,
+	std::vector<u32> &outIndices, std::vector<MeshLod> &outLods
+);
+
+// screenSize is the fraction of the screen height covered by the object's bounding sphere
+u32 selectLod(f32 screenSize, const LodChainDesc &desc, u32 lodCount);
@@ -0,0 +1,559 @@
+#include "OcclusionCuller.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#ifdef OCCLUSION_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// like PostProcess, on gcc and clang the functions that use AVX2 need the
+// target. No fma: a fused multiply add would round differently than the
+// other isas
+#ifdef OCCLUSION_USE_AVX2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define OCCLUSION_AVX2
+	#else
+		#define OCCLUSION_AVX2 __attribute__((target("avx2")))
+	#endif
+#else
+	#define OCCLUSION_AVX2
+#endif
+
+#include "tracelog.h"
+#include "MathUtils.h"
+#include "utility.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static f64 elapsedMs(Clock::time_point start) {
+	return std::chrono::duration<f64, std::milli>(Clock::now() - start).count();
+}
+
+static vec4f toClip(const f32 m[16], const vec3f &p) {
+	return vec4f(
+		p.x * m[0] + p.y * m[4] + p.z * m[8]  + m[12],
+		p.x * m[1] + p.y * m[5] + p.z * m[9]  + m[13],
+		p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14],
+		p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15]
+	);
+}
+
+static vec4f lerpClip(const vec4f &a, const vec4f &b, f32 t) {
+	return a + (b - a) * t;
+}
+
+static bool cpuHasAvx2() {
+#if defined(OCCLUSION_USE_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	// the os also has to save the upper half of the registers
+	if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(OCCLUSION_USE_AVX2)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+void OcclusionCuller::init(const Desc &newDesc) {
+	desc = newDesc;
+	desc.width  = max(desc.width  / TILE_SIZE, 1u) * TILE_SIZE;
+	desc.height = max(desc.height / TILE_SIZE, 1u) * TILE_SIZE;
+
+	tilesX = desc.width / TILE_SIZE;
+	tilesY = desc.height / TILE_SIZE;
+
+	depth.assign((size_t)desc.width * desc.height, 1.f);
+	tileMaxDepth.assign((size_t)tilesX * tilesY, 1.f);
+	tilesDirty = false;
+	setIsa(isa);
+}
+
+void OcclusionCuller::beginFrame(const f32 newViewProj[16]) {
+	memcpy(viewProj, newViewProj, sizeof(viewProj));
+	std::fill(depth.begin(), depth.end(), 1.f);
+	std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.f);
+	triangles.clear();
+	tilesDirty = false;
+	stats = Stats();
+}
+
+void OcclusionCuller::addOccluder(const vec3f *vertices, u32 vertexCount, const u32 *indices, u32 indexCount) {
+	auto start = Clock::now();
+
+	for (u32 i = 0; i + 2 < indexCount; i += 3) {
+		if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount) {
+			continue;
+		}
+
+		vec4f clip[3] = {
+			toClip(viewProj, vertices[indices[i]]),
+			toClip(viewProj, vertices[indices[i + 1]]),
+			toClip(viewProj, vertices[indices[i + 2]]),
+		};
+		addTriangle(clip);
+	}
+
+	tilesDirty = true;
+	stats.rasterMs += elapsedMs(start);
+}
+
+void OcclusionCuller::addBox(const vec3f corners[8]) {
+	static const u32 boxIndices[] = {
+		0, 2, 3, 0, 3, 1, // -z
+		4, 5, 7, 4, 7, 6, // +z
+		0, 4, 6, 0, 6, 2, // -x
+		1, 3, 7, 1, 7, 5, // +x
+		0, 1, 5, 0, 5, 4, // -y
+		2, 6, 7, 2, 7, 3, // +y
+	};
+	addOccluder(corners, 8, boxIndices, ARR_LEN(boxIndices));
+}
+
+void OcclusionCuller::addBox(const vec3f &bmin, const vec3f &bmax) {
+	vec3f corners[8];
+	for (u32 i = 0; i < 8; ++i) {
+		corners[i] = vec3f(
+			(i & 1) ? bmax.x : bmin.x,
+			(i & 2) ? bmax.y : bmin.y,
+			(i & 4) ? bmax.z : bmin.z
+		);
+	}
+	addBox(corners);
+}
+
+bool OcclusionCuller::isVisible(const vec3f &bmin, const vec3f &bmax) {
+	auto start = Clock::now();
+
+	if (tilesDirty) {
+		updateTiles();
+	}
+
+	ScreenRect rect;
+	bool crossesNear = false;
+	bool visible = false;
+	if (getScreenRect(bmin, bmax, rect, crossesNear)) {
+		visible = crossesNear || isRectVisible(rect);
+	}
+
+	stats.tested++;
+	stats.culled += !visible;
+	stats.testMs += elapsedMs(start);
+	return visible;
+}
+
+bool OcclusionCuller::isVisibleReference(const vec3f &bmin, const vec3f &bmax) const {
+	ScreenRect rect;
+	bool crossesNear = false;
+	if (!getScreenRect(bmin, bmax, rect, crossesNear)) return false;
+	if (crossesNear) return true;
+
+	for (i32 y = rect.minY; y <= rect.maxY; ++y) {
+		f32 py = y + 0.5f;
+		for (i32 x = rect.minX; x <= rect.maxX; ++x) {
+			f32 px = x + 0.5f;
+			f32 pixelDepth = 1.f;
+
+			for (const ScreenTriangle &tri : triangles) {
+				bool inside = true;
+				for (int e = 0; e < 3; ++e) {
+					const f32 *edge = tri.edges[e];
+					if (edge[0] * px + (edge[1] * py + edge[2]) < 0.f) {
+						inside = false;
+						break;
+					}
+				}
+				if (inside) {
+					f32 z = tri.depth[0] * px + (tri.depth[1] * py + tri.depth[2]);
+					pixelDepth = min(pixelDepth, z);
+				}
+			}
+
+			if (rect.minDepth < pixelDepth) return true;
+		}
+	}
+
+	return false;
+}
+
+void OcclusionCuller::setIsa(Isa newIsa) {
+	isa = (Isa)min((u32)newIsa, (u32)getBestIsa());
+}
+
+OcclusionCuller::Isa OcclusionCuller::getBestIsa() {
+#ifdef OCCLUSION_USE_SSE
+	static const Isa best = cpuHasAvx2() ? Isa::Avx2 : Isa::Sse;
+#else
+	static const Isa best = Isa::Scalar;
+#endif
+	return best;
+}
+
+const char *OcclusionCuller::getIsaName(Isa isa) {
+	switch (isa) {
+		case Isa::Scalar: return "scalar";
+		case Isa::Sse:    return "SSE";
+		case Isa::Avx2:   return "AVX2";
+		default:          return "?";
+	}
+}
+
+// == PRIVATE ============================================================================================================================
+
+void OcclusionCuller::addTriangle(const vec4f clip[3]) {
+	// clip against the near plane (z >= 0), this gives at most a quad
+	vec4f poly[4];
+	u32 count = 0;
+
+	for (u32 i = 0; i < 3; ++i) {
+		const vec4f &a = clip[i];
+		const vec4f &b = clip[(i + 1) % 3];
+		bool aInside = a.z >= 0.f;
+		bool bInside = b.z >= 0.f;
+
+		if (aInside) {
+			poly[count++] = a;
+		}
+		if (aInside != bInside) {
+			f32 t = a.z / (a.z - b.z);
+			poly[count++] = lerpClip(a, b, t);
+		}
+	}
+
+	for (u32 i = 1; i + 1 < count; ++i) {
+		vec4f tri[3] = { poly[0], poly[i], poly[i + 1] };
+		setupTriangle(tri);
+	}
+}
+
+void OcclusionCuller::setupTriangle(const vec4f clip[3]) {
+	vec2f screen[3];
+	f32 z[3];
+
+	for (int i = 0; i < 3; ++i) {
+		// after near clipping w can only be this small on a degenerate projection
+		if (clip[i].w <= 1e-6f) return;
+		f32 invW = 1.f / clip[i].w;
+		screen[i] = vec2f(
+			(clip[i].x * invW * 0.5f + 0.5f) * desc.width,
+			(0.5f - clip[i].y * invW * 0.5f) * desc.height
+		);
+		z[i] = clip[i].z * invW;
+	}
+
+	f32 minSx = min(screen[0].x, min(screen[1].x, screen[2].x));
+	f32 minSy = min(screen[0].y, min(screen[1].y, screen[2].y));
+	f32 maxSx = max(screen[0].x, max(screen[1].x, screen[2].x));
+	f32 maxSy = max(screen[0].y, max(screen[1].y, screen[2].y));
+
+	if (maxSx < 0.f || maxSy < 0.f || minSx >= (f32)desc.width || minSy >= (f32)desc.height) {
+		return;
+	}
+
+	f32 area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+	           (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+	if (fabsf(area) < 1e-8f) return;
+
+	// occluders are two sided, always use the same winding
+	if (area < 0.f) {
+		std::swap(screen[1], screen[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+
+	ScreenTriangle tri;
+
+	// edge i goes from vertex i + 1 to vertex i + 2, it's positive on the inside
+	for (int i = 0; i < 3; ++i) {
+		const vec2f &a = screen[(i + 1) % 3];
+		const vec2f &b = screen[(i + 2) % 3];
+		f32 ea = -(b.y - a.y);
+		f32 eb = b.x - a.x;
+		tri.edges[i][0] = ea;
+		tri.edges[i][1] = eb;
+		tri.edges[i][2] = -(ea * a.x + eb * a.y);
+	}
+
+	// z = z0 + (z1 - z0) * w1 + (z2 - z0) * w2, where w is the normalized edge function
+	f32 dz1 = (z[1] - z[0]) / area;
+	f32 dz2 = (z[2] - z[0]) / area;
+	tri.depth[0] = dz1 * tri.edges[1][0] + dz2 * tri.edges[2][0];
+	tri.depth[1] = dz1 * tri.edges[1][1] + dz2 * tri.edges[2][1];
+	tri.depth[2] = z[0] + dz1 * tri.edges[1][2] + dz2 * tri.edges[2][2];
+
+	// clamp before converting, the vertices can be very far outside of the screen
+	tri.minX = (i32)floorf(max(minSx, 0.f));
+	tri.minY = (i32)floorf(max(minSy, 0.f));
+	tri.maxX = (i32)floorf(min(maxSx, desc.width - 1.f));
+	tri.maxY = (i32)floorf(min(maxSy, desc.height - 1.f));
+
+	triangles.push_back(tri);
+	stats.occluderTriangles++;
+	rasterize(tri);
+}
+
+void OcclusionCuller::rasterize(const ScreenTriangle &tri) {
+#ifdef OCCLUSION_USE_AVX2
+	if (isa == Isa::Avx2) {
+		rasterizeAvx2(tri);
+		return;
+	}
+#endif
+#ifdef OCCLUSION_USE_SSE
+	if (isa == Isa::Sse) {
+		rasterizeSse(tri);
+		return;
+	}
+#endif
+	rasterizeScalar(tri);
+}
+
+void OcclusionCuller::rasterizeScalar(const ScreenTriangle &tri) {
+	for (i32 y = tri.minY; y <= tri.maxY; ++y) {
+		f32 py = y + 0.5f;
+		f32 row0 = tri.edges[0][1] * py + tri.edges[0][2];
+		f32 row1 = tri.edges[1][1] * py + tri.edges[1][2];
+		f32 row2 = tri.edges[2][1] * py + tri.edges[2][2];
+		f32 rowZ = tri.depth[1] * py + tri.depth[2];
+		f32 *rowDepth = depth.data() + (size_t)y * desc.width;
+
+		for (i32 x = tri.minX; x <= tri.maxX; ++x) {
+			f32 px = x + 0.5f;
+			if (tri.edges[0][0] * px + row0 < 0.f) continue;
+			if (tri.edges[1][0] * px + row1 < 0.f) continue;
+			if (tri.edges[2][0] * px + row2 < 0.f) continue;
+
+			f32 z = tri.depth[0] * px + rowZ;
+			rowDepth[x] = min(rowDepth[x], z);
+		}
+	}
+}
+
+// The simd versions go through aligned blocks of pixels, the ones out of
+// the triangle's bounds are masked so they touch the same pixels as the
+// scalar one. The width is a multiple of TILE_SIZE, a block never goes
+// past the end of a row.
+
+void OcclusionCuller::rasterizeSse(const ScreenTriangle &tri) {
+#ifdef OCCLUSION_USE_SSE
+	const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 a0 = _mm_set1_ps(tri.edges[0][0]);
+	const __m128 a1 = _mm_set1_ps(tri.edges[1][0]);
+	const __m128 a2 = _mm_set1_ps(tri.edges[2][0]);
+	const __m128 za = _mm_set1_ps(tri.depth[0]);
+	const __m128 firstX = _mm_set1_ps(tri.minX + 0.5f);
+	const __m128 lastX = _mm_set1_ps(tri.maxX + 0.5f);
+
+	i32 startX = tri.minX & ~3;
+
+	for (i32 y = tri.minY; y <= tri.maxY; ++y) {
+		f32 py = y + 0.5f;
+		__m128 row0 = _mm_set1_ps(tri.edges[0][1] * py + tri.edges[0][2]);
+		__m128 row1 = _mm_set1_ps(tri.edges[1][1] * py + tri.edges[1][2]);
+		__m128 row2 = _mm_set1_ps(tri.edges[2][1] * py + tri.edges[2][2]);
+		__m128 rowZ = _mm_set1_ps(tri.depth[1] * py + tri.depth[2]);
+		f32 *rowDepth = depth.data() + (size_t)y * desc.width;
+
+		for (i32 x = startX; x <= tri.maxX; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((f32)x), laneOffset);
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(a0, px), row0);
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(a1, px), row1);
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(a2, px), row2);
+
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero))),
+				_mm_and_ps(_mm_cmpge_ps(px, firstX), _mm_cmple_ps(px, lastX))
+			);
+			if (_mm_movemask_ps(inside) == 0) continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(za, px), rowZ);
+			__m128 old = _mm_loadu_ps(rowDepth + x);
+			__m128 closer = _mm_min_ps(old, z);
+			__m128 result = _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old));
+			_mm_storeu_ps(rowDepth + x, result);
+		}
+	}
+#else
+	rasterizeScalar(tri);
+#endif
+}
+
+OCCLUSION_AVX2 void OcclusionCuller::rasterizeAvx2(const ScreenTriangle &tri) {
+#ifdef OCCLUSION_USE_AVX2
+	const __m256 laneOffset = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 a0 = _mm256_set1_ps(tri.edges[0][0]);
+	const __m256 a1 = _mm256_set1_ps(tri.edges[1][0]);
+	const __m256 a2 = _mm256_set1_ps(tri.edges[2][0]);
+	const __m256 za = _mm256_set1_ps(tri.depth[0]);
+	const __m256 firstX = _mm256_set1_ps(tri.minX + 0.5f);
+	const __m256 lastX = _mm256_set1_ps(tri.maxX + 0.5f);
+
+	i32 startX = tri.minX & ~7;
+
+	for (i32 y = tri.minY; y <= tri.maxY; ++y) {
+		f32 py = y + 0.5f;
+		__m256 row0 = _mm256_set1_ps(tri.edges[0][1] * py + tri.edges[0][2]);
+		__m256 row1 = _mm256_set1_ps(tri.edges[1][1] * py + tri.edges[1][2]);
+		__m256 row2 = _mm256_set1_ps(tri.edges[2][1] * py + tri.edges[2][2]);
+		__m256 rowZ = _mm256_set1_ps(tri.depth[1] * py + tri.depth[2]);
+		f32 *rowDepth = depth.data() + (size_t)y * desc.width;
+
+		for (i32 x = startX; x <= tri.maxX; x += 8) {
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((f32)x), laneOffset);
+			__m256 w0 = _mm256_add_ps(_mm256_mul_ps(a0, px), row0);
+			__m256 w1 = _mm256_add_ps(_mm256_mul_ps(a1, px), row1);
+			__m256 w2 = _mm256_add_ps(_mm256_mul_ps(a2, px), row2);
+
+			__m256 inside = _mm256_and_ps(
+				_mm256_and_ps(
+					_mm256_cmp_ps(w0, zero, _CMP_GE_OQ),
+					_mm256_and_ps(_mm256_cmp_ps(w1, zero, _CMP_GE_OQ), _mm256_cmp_ps(w2, zero, _CMP_GE_OQ))
+				),
+				_mm256_and_ps(_mm256_cmp_ps(px, firstX, _CMP_GE_OQ), _mm256_cmp_ps(px, lastX, _CMP_LE_OQ))
+			);
+			if (_mm256_movemask_ps(inside) == 0) continue;
+
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(za, px), rowZ);
+			__m256 old = _mm256_loadu_ps(rowDepth + x);
+			__m256 closer = _mm256_min_ps(old, z);
+			_mm256_storeu_ps(rowDepth + x, _mm256_blendv_ps(old, closer, inside));
+		}
+	}
+#else
+	rasterizeSse(tri);
+#endif
+}
+
+void OcclusionCuller::updateTiles() {
+	for (u32 ty = 0; ty < tilesY; ++ty) {
+		for (u32 tx = 0; tx < tilesX; ++tx) {
+			const f32 *tile = depth.data() + (size_t)ty * TILE_SIZE * desc.width + tx * TILE_SIZE;
+			f32 farthest = 0.f;
+
+#ifdef OCCLUSION_USE_SSE
+			__m128 vmax = _mm_setzero_ps();
+			for (u32 y = 0; y < TILE_SIZE; ++y) {
+				const f32 *row = tile + (size_t)y * desc.width;
+				for (u32 x = 0; x < TILE_SIZE; x += 4) {
+					vmax = _mm_max_ps(vmax, _mm_loadu_ps(row + x));
+				}
+			}
+			vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+			vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+			farthest = _mm_cvtss_f32(vmax);
+#else
+			for (u32 y = 0; y < TILE_SIZE; ++y) {
+				const f32 *row = tile + (size_t)y * desc.width;
+				for (u32 x = 0; x < TILE_SIZE; ++x) {
+					farthest = max(farthest, row[x]);
+				}
+			}
+#endif
+
+			tileMaxDepth[ty * tilesX + tx] = farthest;
+		}
+	}
+
+	tilesDirty = false;
+}
+
+bool OcclusionCuller::getScreenRect(const vec3f &bmin, const vec3f &bmax, ScreenRect &rect, bool &crossesNear) const {
+	f32 minSx = FLT_MAX, minSy = FLT_MAX;
+	f32 maxSx = -FLT_MAX, maxSy = -FLT_MAX;
+	rect.minDepth = FLT_MAX;
+	crossesNear = false;
+
+	for (u32 i = 0; i < 8; ++i) {
+		vec3f corner(
+			(i & 1) ? bmax.x : bmin.x,
+			(i & 2) ? bmax.y : bmin.y,
+			(i & 4) ? bmax.z : bmin.z
+		);
+		vec4f clip = toClip(viewProj, corner);
+		if (clip.z < 0.f || clip.w <= 1e-6f) {
+			crossesNear = true;
+			return true;
+		}
+
+		f32 invW = 1.f / clip.w;
+		f32 sx = (clip.x * invW * 0.5f + 0.5f) * desc.width;
+		f32 sy = (0.5f - clip.y * invW * 0.5f) * desc.height;
+		minSx = min(minSx, sx);
+		minSy = min(minSy, sy);
+		maxSx = max(maxSx, sx);
+		maxSy = max(maxSy, sy);
+		rect.minDepth = min(rect.minDepth, clip.z * invW);
+	}
+
+	// outside of the screen or past the far plane
+	if (maxSx < 0.f || maxSy < 0.f || minSx >= (f32)desc.width || minSy >= (f32)desc.height || rect.minDepth > 1.f) {
+		return false;
+	}
+
+	// every pixel touched by the rectangle plus a one pixel border
+	rect.minX = (i32)floorf(max(minSx - 1.f, 0.f));
+	rect.minY = (i32)floorf(max(minSy - 1.f, 0.f));
+	rect.maxX = (i32)floorf(min(maxSx + 1.f, desc.width - 1.f));
+	rect.maxY = (i32)floorf(min(maxSy + 1.f, desc.height - 1.f));
+	return true;
+}
+
+bool OcclusionCuller::isRectVisible(const ScreenRect &rect) const {
+	i32 tileMinX = rect.minX / TILE_SIZE;
+	i32 tileMinY = rect.minY / TILE_SIZE;
+	i32 tileMaxX = rect.maxX / TILE_SIZE;
+	i32 tileMaxY = rect.maxY / TILE_SIZE;
+
+	for (i32 ty = tileMinY; ty <= tileMaxY; ++ty) {
+		for (i32 tx = tileMinX; tx <= tileMaxX; ++tx) {
+			// everything in the tile is closer than the object
+			if (rect.minDepth >= tileMaxDepth[ty * tilesX + tx]) continue;
+
+			i32 x0 = max(rect.minX, tx * (i32)TILE_SIZE);
+			i32 y0 = max(rect.minY, ty * (i32)TILE_SIZE);
+			i32 x1 = min(rect.maxX, (tx + 1) * (i32)TILE_SIZE - 1);
+			i32 y1 = min(rect.maxY, (ty + 1) * (i32)TILE_SIZE - 1);
+
+#ifdef OCCLUSION_USE_SSE
+			if (isa != Isa::Scalar) {
+				const __m128 laneX = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+				const __m128 minDepth = _mm_set1_ps(rect.minDepth);
+				const __m128 firstX = _mm_set1_ps((f32)x0);
+				const __m128 lastX = _mm_set1_ps((f32)x1);
+				i32 startX = x0 & ~3;
+
+				for (i32 y = y0; y <= y1; ++y) {
+					const f32 *row = depth.data() + (size_t)y * desc.width;
+					for (i32 x = startX; x <= x1; x += 4) {
+						__m128 px = _mm_add_ps(_mm_set1_ps((f32)x), laneX);
+						__m128 inRect = _mm_and_ps(_mm_cmpge_ps(px, firstX), _mm_cmple_ps(px, lastX));
+						__m128 behind = _mm_cmplt_ps(minDepth, _mm_loadu_ps(row + x));
+						if (_mm_movemask_ps(_mm_and_ps(inRect, behind))) return true;
+					}
+				}
+				continue;
+			}
+#endif
+
+			for (i32 y = y0; y <= y1; ++y) {
+				const f32 *row = depth.data() + (size_t)y * desc.width;
+				for (i32 x = x0; x <= x1; ++x) {
+					if (rect.minDepth < row[x]) return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define OCCLUSION_USE_SSE
+#endif
+
+// compiled in on x64 and picked at runtime
+#if defined(_M_X64) || defined(__x86_64__)
+#define OCCLUSION_USE_AVX2
+#endif
+
+/* Software occlusion culling.
+ * A few low poly occluders (boxes, coarse terrain) are rasterized on the
+ * cpu into a small depth buffer, eight pixels at a time with AVX2 or four
+ * with SSE2 (the best the cpu has, like PostProcess), then the
+ * screen rectangle of an object's bounding box is tested against it: the
+ * object is hidden if its nearest point is behind every pixel it covers.
+ * The depth buffer is split in TILE_SIZE^2 tiles that store their farthest
+ * depth, most hidden objects are rejected by only looking at the tiles.
+ * Like the gpu, occluders are sampled at the pixel centres, the tested
+ * rectangles are grown by one pixel to hide the error on the occluders'
+ * edges.
+ * Every isa rasterizes the same pixels with the same operations, so they
+ * give the same depth buffer and can be checked against each other.
+ * Depth is z/w of the given view projection (d3d convention, 0 is the near
+ * plane), matrices are row major and multiply row vectors like DirectXMath.
+ */
+class OcclusionCuller {
+public:
+	static constexpr u32 TILE_SIZE = 8;
+
+	enum class Isa : u8 {
+		Scalar,
+		Sse,
+		Avx2,
+		Count,
+	};
+
+	struct Desc {
+		u32 width  = 256; // multiple of TILE_SIZE
+		u32 height = 128; // multiple of TILE_SIZE
+	};
+
+	struct Stats {
+		u32 occluderTriangles = 0; // triangles that reached the rasterizer (after clipping)
+		u32 tested = 0;
+		u32 culled = 0;
+		f64 rasterMs = 0.0;
+		f64 testMs = 0.0;
+	};
+
+	void init(const Desc &desc);
+
+	// Clears the depth buffer and the stats
+	void beginFrame(const f32 viewProj[16]);
+	// World space triangles
+	void addOccluder(const vec3f *vertices, u32 vertexCount, const u32 *indices, u32 indexCount);
+	// Corners indexed by bits: x = 1, y = 2, z = 4 (0 is the min corner, 7 the max one)
+	void addBox(const vec3f corners[8]);
+	void addBox(const vec3f &bmin, const vec3f &bmax);
+
+	// Tests a world space axis aligned box, objects intersecting the near plane are always visible
+	bool isVisible(const vec3f &bmin, const vec3f &bmax);
+	// Brute force version of isVisible: for every pixel of the rectangle it goes
+	// through every occluder triangle, used to check the accuracy of the culler
+	bool isVisibleReference(const vec3f &bmin, const vec3f &bmax) const;
+
+	const std::vector<f32> &getDepth() const { return depth; }
+	const Desc &getDesc() const { return desc; }
+	const Stats &getStats() const { return stats; }
+
+	// Lowered to the best the cpu has
+	void setIsa(Isa newIsa);
+	Isa getIsa() const { return isa; }
+
+	static Isa getBestIsa();
+	static const char *getIsaName(Isa isa);
+
+private:
+	// Triangle in pixel space as three edge functions and a depth plane (a * x + b * y + c)
+	struct ScreenTriangle {
+		f32 edges[3][3];
+		f32 depth[3];
+		i32 minX, minY, maxX, maxY;
+	};
+
+	struct ScreenRect {
+		i32 minX, minY, maxX, maxY;
+		f32 minDepth;
+	};
+
+	void addTriangle(const vec4f clip[3]);
+	void setupTriangle(const vec4f clip[3]);
+	void rasterize(const ScreenTriangle &tri);
+	void rasterizeScalar(const ScreenTriangle &tri);
+	void rasterizeSse(const ScreenTriangle &tri);
+	void rasterizeAvx2(const ScreenTriangle &tri);
+	void updateTiles();
+	// returns false if the box is outside of the screen, visible is true if it crosses the near plane
+	bool getScreenRect(const vec3f &bmin, const vec3f &bmax, ScreenRect &rect, bool &crossesNear) const;
+	bool isRectVisible(const ScreenRect &rect) const;
+
+	Desc desc;
+	f32 viewProj[16] = {};
+	Isa isa = Isa::Avx2;
+	bool tilesDirty = false;
+	u32 tilesX = 0, tilesY = 0;
+
+	std::vector<f32> depth;
+	std::vector<f32> tileMaxDepth;
+	// kept for the reference test
+	std::vector<ScreenTriangle> triangles;
+
+	Stats stats;
+};
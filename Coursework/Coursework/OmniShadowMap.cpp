@@ -2,6 +2,7 @@
 
 #include "vec.h"
 #include "utility.h"
+#include "StateCache.h"
 
 void OmniShadowMap::init(Device *device, int width, int height) {
 	D3D11_TEXTURE2D_DESC texDesc{};
@@ -47,6 +48,7 @@ OmniShadowMap::~OmniShadowMap() {
 }
 
 void OmniShadowMap::bind(DeviceContext *ctx) {
+	stateCache.unbindShaderResources();
 	ctx->RSSetViewports(1, &viewport);
 	ctx->OMSetRenderTargets(1, &renderTarget, cubeDSV);
 	ctx->ClearDepthStencilView(cubeDSV, D3D11_CLEAR_DEPTH, 1.f, 0);
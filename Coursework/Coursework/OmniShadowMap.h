@@ -20,10 +20,15 @@ public:
 
 	void bind(DeviceContext *ctx);
 	TextureType *getCubemap() { return cubemap; }
+	ID3D11DepthStencilView *getDepthDSV() { return cubeDSV; }
 
 	void setViewMatrix(const mat4 &view, int index) { viewMatrices[index] = view; }
 	const mat4 &getViewMatrix(int index) { return viewMatrices[index]; }
 
+	// Faces the next draws are rendered to, a bit for every face (see CubeFaceCuller)
+	void setFaceMask(u32 mask) { faceMask = mask; }
+	u32 getFaceMask() const { return faceMask; }
+
 private:
 	ID3D11DepthStencilView *cubeDSV = nullptr;
 	TextureType *cubemap = nullptr;
@@ -32,4 +37,5 @@ private:
 	ID3D11Texture2D *depthTex = nullptr;
 	ID3D11Texture2D *cubeTexture = nullptr;
 	mat4 viewMatrices[6];
+	u32 faceMask = 0x3F;
 };
\ No newline at end of file
@@ -0,0 +1,631 @@
+#include "PostProcess.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "JobSystem.h"
+#include "GaussianKernel.h"
+#include "tracelog.h"
+#include "MathUtils.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+	#define POST_USE_SSE
+	#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled in on x64 and picked at runtime, on gcc and clang the
+// functions that use it need the target as the rest isn't built for it
+#if defined(_M_X64) || defined(__x86_64__)
+	#define POST_USE_AVX2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define POST_AVX2
+	#else
+		#define POST_AVX2 __attribute__((target("avx2,fma")))
+	#endif
+#endif
+
+#ifdef POST_USE_SSE
+	#define POST_SSE_ROW(function) function
+#else
+	#define POST_SSE_ROW(function) nullptr
+#endif
+
+#ifdef POST_USE_AVX2
+	#define POST_AVX2_ROW(function) function
+#else
+	#define POST_AVX2_ROW(function) nullptr
+#endif
+
+using Isa = PostProcess::Isa;
+
+// == ROWS ================================================================================================================================
+// Every pass is a function for a row, one for every isa
+
+using ThresholdRow = void (*)(const vec4f *src, f32 threshold, vec4f *dst, u32 count);
+using ConvolveRowH = void (*)(const vec4f *src, const f32 *weights, u32 radius, vec4f *dst, u32 width);
+using ConvolveRowV = void (*)(const PostImage &src, u32 y, const f32 *weights, u32 radius, vec4f *dst);
+using AddRow       = void (*)(const vec4f *a, f32 scaleA, const vec4f *b, vec4f *dst, u32 count);
+using TonemapRow   = void (*)(const vec4f *src, f32 exposure, u8 *dst, u32 count);
+
+static const f32 ACES_A = 2.51f;
+static const f32 ACES_B = 0.03f;
+static const f32 ACES_C = 2.43f;
+static const f32 ACES_D = 0.59f;
+static const f32 ACES_E = 0.14f;
+
+// -- Scalar ------------------------------------------------------------------------------------------------------------------------------
+
+static void thresholdRowScalar(const vec4f *src, f32 threshold, vec4f *dst, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		dst[i] = src[i].w > threshold ? src[i] : vec4f();
+	}
+}
+
+static vec4f convolvePixelH(const vec4f *src, const f32 *weights, i32 radius, i32 x, i32 last) {
+	vec4f sum = src[x] * weights[0];
+	for (i32 i = 1; i <= radius; ++i) {
+		sum += (src[clamp(x - i, 0, last)] + src[clamp(x + i, 0, last)]) * weights[i];
+	}
+	return sum;
+}
+
+static void convolveRowHScalar(const vec4f *src, const f32 *weights, u32 radius, vec4f *dst, u32 width) {
+	for (i32 x = 0; x < (i32)width; ++x) {
+		dst[x] = convolvePixelH(src, weights, (i32)radius, x, (i32)width - 1);
+	}
+}
+
+// the taps are the outer loop so the rows are read one after the other
+static void convolveRowVScalar(const PostImage &src, u32 y, const f32 *weights, u32 radius, vec4f *dst) {
+	const i32 last = (i32)src.height - 1;
+	const vec4f *centre = &src.at(0, y);
+	for (u32 x = 0; x < src.width; ++x) {
+		dst[x] = centre[x] * weights[0];
+	}
+
+	for (i32 i = 1; i <= (i32)radius; ++i) {
+		const vec4f *up = &src.at(0, clamp((i32)y - i, 0, last));
+		const vec4f *down = &src.at(0, clamp((i32)y + i, 0, last));
+		for (u32 x = 0; x < src.width; ++x) {
+			dst[x] += (up[x] + down[x]) * weights[i];
+		}
+	}
+}
+
+static void addRowScalar(const vec4f *a, f32 scaleA, const vec4f *b, vec4f *dst, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		vec4f c = a[i] * scaleA + b[i];
+		dst[i] = vec4f(clamp(c.x, 0.f, 1.f), clamp(c.y, 0.f, 1.f), clamp(c.z, 0.f, 1.f), clamp(c.w, 0.f, 1.f));
+	}
+}
+
+static f32 aces(f32 x) {
+	x = max(x, 0.f);
+	return clamp((x * (ACES_A * x + ACES_B)) / (x * (ACES_C * x + ACES_D) + ACES_E), 0.f, 1.f);
+}
+
+static u8 toByte(f32 value) {
+	return (u8)(clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+// the alpha isn't tonemapped, only saturated
+static void tonemapRowScalar(const vec4f *src, f32 exposure, u8 *dst, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = toByte(aces(src[i].x * exposure));
+		dst[i * 4 + 1] = toByte(aces(src[i].y * exposure));
+		dst[i * 4 + 2] = toByte(aces(src[i].z * exposure));
+		dst[i * 4 + 3] = toByte(src[i].w);
+	}
+}
+
+// -- SSE ---------------------------------------------------------------------------------------------------------------------------------
+// one pixel in a register
+
+#ifdef POST_USE_SSE
+static void thresholdRowSse(const vec4f *src, f32 threshold, vec4f *dst, u32 count) {
+	__m128 t = _mm_set1_ps(threshold);
+	for (u32 i = 0; i < count; ++i) {
+		__m128 p = _mm_loadu_ps(&src[i].x);
+		__m128 mask = _mm_cmpgt_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)), t);
+		_mm_storeu_ps(&dst[i].x, _mm_and_ps(p, mask));
+	}
+}
+
+static void convolveRowHSse(const vec4f *src, const f32 *weights, u32 radius, vec4f *dst, u32 width) {
+	const i32 last = (i32)width - 1;
+	const i32 r = (i32)radius;
+	for (i32 x = 0; x <= last; ++x) {
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(&src[x].x), _mm_set1_ps(weights[0]));
+		for (i32 i = 1; i <= r; ++i) {
+			__m128 pair = _mm_add_ps(_mm_loadu_ps(&src[clamp(x - i, 0, last)].x), _mm_loadu_ps(&src[clamp(x + i, 0, last)].x));
+			sum = _mm_add_ps(sum, _mm_mul_ps(pair, _mm_set1_ps(weights[i])));
+		}
+		_mm_storeu_ps(&dst[x].x, sum);
+	}
+}
+
+static void convolveRowVSse(const PostImage &src, u32 y, const f32 *weights, u32 radius, vec4f *dst) {
+	const i32 last = (i32)src.height - 1;
+	const vec4f *centre = &src.at(0, y);
+	__m128 w0 = _mm_set1_ps(weights[0]);
+	for (u32 x = 0; x < src.width; ++x) {
+		_mm_storeu_ps(&dst[x].x, _mm_mul_ps(_mm_loadu_ps(&centre[x].x), w0));
+	}
+
+	for (i32 i = 1; i <= (i32)radius; ++i) {
+		const vec4f *up = &src.at(0, clamp((i32)y - i, 0, last));
+		const vec4f *down = &src.at(0, clamp((i32)y + i, 0, last));
+		__m128 w = _mm_set1_ps(weights[i]);
+		for (u32 x = 0; x < src.width; ++x) {
+			__m128 pair = _mm_add_ps(_mm_loadu_ps(&up[x].x), _mm_loadu_ps(&down[x].x));
+			_mm_storeu_ps(&dst[x].x, _mm_add_ps(_mm_loadu_ps(&dst[x].x), _mm_mul_ps(pair, w)));
+		}
+	}
+}
+
+static void addRowSse(const vec4f *a, f32 scaleA, const vec4f *b, vec4f *dst, u32 count) {
+	__m128 scale = _mm_set1_ps(scaleA);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.f);
+	for (u32 i = 0; i < count; ++i) {
+		__m128 c = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&a[i].x), scale), _mm_loadu_ps(&b[i].x));
+		_mm_storeu_ps(&dst[i].x, _mm_min_ps(_mm_max_ps(c, zero), one));
+	}
+}
+
+static void tonemapRowSse(const vec4f *src, f32 exposure, u8 *dst, u32 count) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.f);
+	__m128 rgb = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	__m128 e = _mm_set1_ps(exposure);
+	for (u32 i = 0; i < count; ++i) {
+		__m128 p = _mm_loadu_ps(&src[i].x);
+		__m128 x = _mm_max_ps(_mm_mul_ps(p, e), zero);
+		__m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(ACES_A)), _mm_set1_ps(ACES_B)));
+		__m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(ACES_C)), _mm_set1_ps(ACES_D))), _mm_set1_ps(ACES_E));
+		__m128 c = _mm_or_ps(_mm_and_ps(rgb, _mm_div_ps(num, den)), _mm_andnot_ps(rgb, p));
+		c = _mm_min_ps(_mm_max_ps(c, zero), one);
+
+		__m128i bytes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+		bytes = _mm_packs_epi32(bytes, bytes);
+		bytes = _mm_packus_epi16(bytes, bytes);
+		i32 packed = _mm_cvtsi128_si32(bytes);
+		memcpy(dst + i * 4, &packed, 4);
+	}
+}
+#endif
+
+// -- AVX2 --------------------------------------------------------------------------------------------------------------------------------
+// two pixels in a register, the pixels left over go through the scalar path
+
+#ifdef POST_USE_AVX2
+POST_AVX2 static void thresholdRowAvx2(const vec4f *src, f32 threshold, vec4f *dst, u32 count) {
+	__m256 t = _mm256_set1_ps(threshold);
+	u32 i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m256 p = _mm256_loadu_ps(&src[i].x);
+		__m256 mask = _mm256_cmp_ps(_mm256_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)), t, _CMP_GT_OQ);
+		_mm256_storeu_ps(&dst[i].x, _mm256_and_ps(p, mask));
+	}
+	thresholdRowScalar(src + i, threshold, dst + i, count - i);
+}
+
+POST_AVX2 static void convolveRowHAvx2(const vec4f *src, const f32 *weights, u32 radius, vec4f *dst, u32 width) {
+	const i32 last = (i32)width - 1;
+	const i32 r = (i32)radius;
+	i32 x = 0;
+
+	// the pixels that reach past the edges are clamped one by one
+	for (; x < r && x <= last; ++x) {
+		dst[x] = convolvePixelH(src, weights, r, x, last);
+	}
+
+	__m256 w0 = _mm256_set1_ps(weights[0]);
+	for (; x + 1 + r <= last; x += 2) {
+		__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(&src[x].x), w0);
+		for (i32 i = 1; i <= r; ++i) {
+			__m256 pair = _mm256_add_ps(_mm256_loadu_ps(&src[x - i].x), _mm256_loadu_ps(&src[x + i].x));
+			sum = _mm256_fmadd_ps(pair, _mm256_set1_ps(weights[i]), sum);
+		}
+		_mm256_storeu_ps(&dst[x].x, sum);
+	}
+
+	for (; x <= last; ++x) {
+		dst[x] = convolvePixelH(src, weights, r, x, last);
+	}
+}
+
+POST_AVX2 static void convolveRowVAvx2(const PostImage &src, u32 y, const f32 *weights, u32 radius, vec4f *dst) {
+	const i32 last = (i32)src.height - 1;
+	const u32 floats = src.width * 4;
+	const f32 *centre = &src.at(0, y).x;
+	f32 *out = &dst[0].x;
+
+	u32 i = 0;
+	__m256 w0 = _mm256_set1_ps(weights[0]);
+	for (; i + 8 <= floats; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(centre + i), w0));
+	}
+	for (; i < floats; ++i) out[i] = centre[i] * weights[0];
+
+	for (i32 tap = 1; tap <= (i32)radius; ++tap) {
+		const f32 *up = &src.at(0, clamp((i32)y - tap, 0, last)).x;
+		const f32 *down = &src.at(0, clamp((i32)y + tap, 0, last)).x;
+		__m256 w = _mm256_set1_ps(weights[tap]);
+
+		i = 0;
+		for (; i + 8 <= floats; i += 8) {
+			__m256 pair = _mm256_add_ps(_mm256_loadu_ps(up + i), _mm256_loadu_ps(down + i));
+			_mm256_storeu_ps(out + i, _mm256_fmadd_ps(pair, w, _mm256_loadu_ps(out + i)));
+		}
+		for (; i < floats; ++i) out[i] += (up[i] + down[i]) * weights[tap];
+	}
+}
+
+POST_AVX2 static void addRowAvx2(const vec4f *a, f32 scaleA, const vec4f *b, vec4f *dst, u32 count) {
+	__m256 scale = _mm256_set1_ps(scaleA);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one = _mm256_set1_ps(1.f);
+	u32 i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m256 c = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i].x), scale, _mm256_loadu_ps(&b[i].x));
+		_mm256_storeu_ps(&dst[i].x, _mm256_min_ps(_mm256_max_ps(c, zero), one));
+	}
+	addRowScalar(a + i, scaleA, b + i, dst + i, count - i);
+}
+
+POST_AVX2 static void tonemapRowAvx2(const vec4f *src, f32 exposure, u8 *dst, u32 count) {
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one = _mm256_set1_ps(1.f);
+	__m256 e = _mm256_set1_ps(exposure);
+	u32 i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m256 p = _mm256_loadu_ps(&src[i].x);
+		__m256 x = _mm256_max_ps(_mm256_mul_ps(p, e), zero);
+		__m256 num = _mm256_mul_ps(x, _mm256_fmadd_ps(x, _mm256_set1_ps(ACES_A), _mm256_set1_ps(ACES_B)));
+		__m256 den = _mm256_fmadd_ps(x, _mm256_fmadd_ps(x, _mm256_set1_ps(ACES_C), _mm256_set1_ps(ACES_D)), _mm256_set1_ps(ACES_E));
+		// the alpha of both pixels comes from the source
+		__m256 c = _mm256_blend_ps(_mm256_div_ps(num, den), p, 0x88);
+		c = _mm256_min_ps(_mm256_max_ps(c, zero), one);
+
+		__m256i ints = _mm256_cvttps_epi32(_mm256_fmadd_ps(c, _mm256_set1_ps(255.f), _mm256_set1_ps(0.5f)));
+		__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1));
+		_mm_storel_epi64((__m128i *)(dst + i * 4), _mm_packus_epi16(words, words));
+	}
+	tonemapRowScalar(src + i, exposure, dst + i * 4, count - i);
+}
+#endif
+
+// == HELPERS =============================================================================================================================
+
+static bool cpuHasAvx2() {
+#if defined(POST_USE_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	// the os also has to save the upper half of the registers
+	if (!osxsave || !fma || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(POST_USE_AVX2)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif
+}
+
+static Isa getIsa(const PostProcess::Options &options) {
+	return (Isa)min((u32)options.isa, (u32)PostProcess::getBestIsa());
+}
+
+// The best row there is for isa, the ones that aren't compiled in are null
+template<typename Row>
+static Row pickRow(Isa isa, Row scalar, Row sse, Row avx2) {
+	if (isa >= Isa::Avx2 && avx2) return avx2;
+	if (isa >= Isa::Sse && sse) return sse;
+	return scalar;
+}
+
+// Calls function(firstRow, endRow) for every tile, on the job system if there is one
+template<typename Function>
+static void forTiles(u32 height, const PostProcess::Options &options, const Function &function) {
+	const u32 tiles = (height + PostProcess::TILE_ROWS - 1) / PostProcess::TILE_ROWS;
+	auto range = [&](u32 begin, u32 end) {
+		for (u32 tile = begin; tile < end; ++tile) {
+			u32 first = tile * PostProcess::TILE_ROWS;
+			function(first, min(first + PostProcess::TILE_ROWS, height));
+		}
+	};
+
+	if (options.jobs) options.jobs->parallelFor(0, tiles, 1, range);
+	else              range(0, tiles);
+}
+
+// Only resizes if it has to, so the destination can be one of the sources
+static void prepare(PostImage &image, u32 width, u32 height) {
+	if (image.width != width || image.height != height) image.resize(width, height);
+}
+
+// == IMAGES ==============================================================================================================================
+
+void PostImage::resize(u32 newWidth, u32 newHeight) {
+	width = newWidth;
+	height = newHeight;
+	pixels.assign((size_t)width * height, vec4f());
+}
+
+void PostImage8::resize(u32 newWidth, u32 newHeight) {
+	width = newWidth;
+	height = newHeight;
+	pixels.assign((size_t)width * height * 4, 0);
+}
+
+// == POST PROCESS ========================================================================================================================
+
+PostProcess::Isa PostProcess::getBestIsa() {
+#ifdef POST_USE_SSE
+	static const Isa best = cpuHasAvx2() ? Isa::Avx2 : Isa::Sse;
+#else
+	static const Isa best = Isa::Scalar;
+#endif
+	return best;
+}
+
+const char *PostProcess::getIsaName(Isa isa) {
+	switch (isa) {
+		case Isa::Scalar: return "scalar";
+		case Isa::Sse:    return "SSE";
+		case Isa::Avx2:   return "AVX2";
+		default:          return "?";
+	}
+}
+
+void PostProcess::threshold(const PostImage &src, f32 threshold, PostImage &dst, const Options &options) {
+	prepare(dst, src.width, src.height);
+	ThresholdRow row = pickRow<ThresholdRow>(getIsa(options), thresholdRowScalar, POST_SSE_ROW(thresholdRowSse), POST_AVX2_ROW(thresholdRowAvx2));
+
+	forTiles(src.height, options, [&](u32 first, u32 end) {
+		for (u32 y = first; y < end; ++y) {
+			row(&src.at(0, y), threshold, &dst.at(0, y), src.width);
+		}
+	});
+}
+
+void PostProcess::convolve(const PostImage &src, const std::vector<f32> &weights, PostImage &dst, const Options &options) {
+	if (weights.empty()) return;
+	const Isa isa = getIsa(options);
+	const u32 radius = (u32)weights.size() - 1;
+
+	// horizontal to temp, then vertical to dst, all the rows of temp have
+	// to be there before the vertical pass starts
+	PostImage temp;
+	temp.resize(src.width, src.height);
+	ConvolveRowH rowH = pickRow<ConvolveRowH>(isa, convolveRowHScalar, POST_SSE_ROW(convolveRowHSse), POST_AVX2_ROW(convolveRowHAvx2));
+	forTiles(src.height, options, [&](u32 first, u32 end) {
+		for (u32 y = first; y < end; ++y) {
+			rowH(&src.at(0, y), weights.data(), radius, &temp.at(0, y), src.width);
+		}
+	});
+
+	prepare(dst, src.width, src.height);
+	ConvolveRowV rowV = pickRow<ConvolveRowV>(isa, convolveRowVScalar, POST_SSE_ROW(convolveRowVSse), POST_AVX2_ROW(convolveRowVAvx2));
+	forTiles(src.height, options, [&](u32 first, u32 end) {
+		for (u32 y = first; y < end; ++y) {
+			rowV(temp, y, weights.data(), radius, &dst.at(0, y));
+		}
+	});
+}
+
+void PostProcess::add(const PostImage &a, f32 scaleA, const PostImage &b, PostImage &dst, const Options &options) {
+	if (a.width != b.width || a.height != b.height) {
+		err("can't add a %ux%u image to a %ux%u one", a.width, a.height, b.width, b.height);
+		return;
+	}
+
+	prepare(dst, a.width, a.height);
+	AddRow row = pickRow<AddRow>(getIsa(options), addRowScalar, POST_SSE_ROW(addRowSse), POST_AVX2_ROW(addRowAvx2));
+
+	forTiles(a.height, options, [&](u32 first, u32 end) {
+		for (u32 y = first; y < end; ++y) {
+			row(&a.at(0, y), scaleA, &b.at(0, y), &dst.at(0, y), a.width);
+		}
+	});
+}
+
+void PostProcess::tonemap(const PostImage &src, f32 exposure, PostImage8 &dst, const Options &options) {
+	if (dst.width != src.width || dst.height != src.height) dst.resize(src.width, src.height);
+	TonemapRow row = pickRow<TonemapRow>(getIsa(options), tonemapRowScalar, POST_SSE_ROW(tonemapRowSse), POST_AVX2_ROW(tonemapRowAvx2));
+
+	forTiles(src.height, options, [&](u32 first, u32 end) {
+		for (u32 y = first; y < end; ++y) {
+			row(&src.at(0, y), exposure, dst.at(0, y), src.width);
+		}
+	});
+}
+
+void PostProcess::toRgba8(const PostImage &src, PostImage8 &dst) {
+	dst.resize(src.width, src.height);
+	for (size_t i = 0; i < src.pixels.size(); ++i) {
+		const vec4f &p = src.pixels[i];
+		dst.pixels[i * 4 + 0] = toByte(p.x);
+		dst.pixels[i * 4 + 1] = toByte(p.y);
+		dst.pixels[i * 4 + 2] = toByte(p.z);
+		dst.pixels[i * 4 + 3] = toByte(p.w);
+	}
+}
+
+void PostProcess::toFloat(const PostImage8 &src, PostImage &dst) {
+	dst.resize(src.width, src.height);
+	for (size_t i = 0; i < dst.pixels.size(); ++i) {
+		const u8 *p = &src.pixels[i * 4];
+		dst.pixels[i] = vec4f(p[0], p[1], p[2], p[3]) / 255.f;
+	}
+}
+
+// -- Diff --------------------------------------------------------------------------------------------------------------------------------
+
+// Adds up the errors of the channels, error(pixel, channel) returns one of them
+template<typename Error>
+static PostProcess::Diff getDiff(size_t pixels, f32 tolerance, const Error &error) {
+	PostProcess::Diff diff;
+	diff.pixels = (u32)pixels;
+
+	f64 sum = 0.0, sumSq = 0.0;
+	for (size_t i = 0; i < pixels; ++i) {
+		bool different = false;
+		for (u32 c = 0; c < 4; ++c) {
+			f32 e = error(i, c);
+			diff.maxError = max(diff.maxError, e);
+			sum += e;
+			sumSq += (f64)e * e;
+			different |= e > tolerance;
+		}
+		diff.differentPixels += different ? 1 : 0;
+	}
+
+	const f64 channels = max((f64)pixels * 4.0, 1.0);
+	diff.meanError = sum / channels;
+	diff.rmse = sqrt(sumSq / channels);
+	diff.psnr = diff.rmse > 0.0 ? 20.0 * log10(1.0 / diff.rmse) : INFINITY;
+	return diff;
+}
+
+// Images of different sizes are different everywhere
+static PostProcess::Diff getSizeDiff(u32 widthA, u32 heightA, u32 widthB, u32 heightB) {
+	PostProcess::Diff diff;
+	diff.pixels = max(widthA * heightA, widthB * heightB);
+	diff.differentPixels = diff.pixels;
+	diff.maxError = INFINITY;
+	diff.meanError = diff.rmse = INFINITY;
+	return diff;
+}
+
+PostProcess::Diff PostProcess::compare(const PostImage &a, const PostImage &b, f32 tolerance) {
+	if (a.width != b.width || a.height != b.height) return getSizeDiff(a.width, a.height, b.width, b.height);
+
+	return getDiff(a.pixels.size(), tolerance, [&](size_t i, u32 c) {
+		return fabsf((&a.pixels[i].x)[c] - (&b.pixels[i].x)[c]);
+	});
+}
+
+PostProcess::Diff PostProcess::compare(const PostImage8 &a, const PostImage8 &b, u8 tolerance) {
+	if (a.width != b.width || a.height != b.height) return getSizeDiff(a.width, a.height, b.width, b.height);
+
+	// the tolerance is in the middle of two steps, so it isn't lost to rounding
+	return getDiff(a.pixels.size() / 4, (tolerance + 0.5f) / 255.f, [&](size_t i, u32 c) {
+		return fabsf((f32)a.pixels[i * 4 + c] - (f32)b.pixels[i * 4 + c]) / 255.f;
+	});
+}
+
+// -- Files -------------------------------------------------------------------------------------------------------------------------------
+
+bool PostProcess::writePfm(const PostImage &image, const std::string &path) {
+	FILE *fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		err("couldn't open %s for writing", path.c_str());
+		return false;
+	}
+
+	// rgb, little endian (negative scale), the rows go from the bottom up
+	fprintf(fp, "PF\n%u %u\n-1.0\n", image.width, image.height);
+	std::vector<f32> row(image.width * 3);
+	for (u32 y = image.height; y-- > 0;) {
+		for (u32 x = 0; x < image.width; ++x) {
+			const vec4f &p = image.at(x, y);
+			row[x * 3 + 0] = p.x;
+			row[x * 3 + 1] = p.y;
+			row[x * 3 + 2] = p.z;
+		}
+		fwrite(row.data(), sizeof(f32), row.size(), fp);
+	}
+
+	bool success = !ferror(fp);
+	fclose(fp);
+	if (!success) err("couldn't write %s", path.c_str());
+	return success;
+}
+
+bool PostProcess::readPfm(const std::string &path, PostImage &image) {
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		err("couldn't open %s", path.c_str());
+		return false;
+	}
+
+	char magic[3] = {};
+	u32 width = 0, height = 0;
+	f32 scale = 0.f;
+	// one whitespace after the scale, then the data
+	bool valid = fscanf(fp, "%2s %u %u %f", magic, &width, &height, &scale) == 4 && fgetc(fp) != EOF;
+	// only little endian colour maps, like writePfm
+	valid = valid && strcmp(magic, "PF") == 0 && scale < 0.f && width && height;
+
+	if (valid) {
+		image.resize(width, height);
+		std::vector<f32> row(width * 3);
+		for (u32 y = height; valid && y-- > 0;) {
+			valid = fread(row.data(), sizeof(f32), row.size(), fp) == row.size();
+			for (u32 x = 0; valid && x < width; ++x) {
+				image.at(x, y) = vec4f(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2], 1.f);
+			}
+		}
+	}
+
+	fclose(fp);
+	if (!valid) err("%s isn't a little endian colour pfm", path.c_str());
+	return valid;
+}
+
+bool PostProcess::writePam(const PostImage8 &image, const std::string &path) {
+	FILE *fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		err("couldn't open %s for writing", path.c_str());
+		return false;
+	}
+
+	fprintf(fp, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", image.width, image.height);
+	fwrite(image.pixels.data(), 1, image.pixels.size(), fp);
+
+	bool success = !ferror(fp);
+	fclose(fp);
+	if (!success) err("couldn't write %s", path.c_str());
+	return success;
+}
+
+bool PostProcess::readPam(const std::string &path, PostImage8 &image) {
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		err("couldn't open %s", path.c_str());
+		return false;
+	}
+
+	char token[16] = {};
+	u32 width = 0, height = 0, depth = 0, maxValue = 0;
+	bool valid = fscanf(fp, "%15s", token) == 1 && strcmp(token, "P7") == 0;
+	while (valid) {
+		valid = fscanf(fp, "%15s", token) == 1;
+		if (!valid || strcmp(token, "ENDHDR") == 0) break;
+
+		if      (strcmp(token, "WIDTH") == 0)    valid = fscanf(fp, "%u", &width) == 1;
+		else if (strcmp(token, "HEIGHT") == 0)   valid = fscanf(fp, "%u", &height) == 1;
+		else if (strcmp(token, "DEPTH") == 0)    valid = fscanf(fp, "%u", &depth) == 1;
+		else if (strcmp(token, "MAXVAL") == 0)   valid = fscanf(fp, "%u", &maxValue) == 1;
+		else if (strcmp(token, "TUPLTYPE") == 0) valid = fscanf(fp, "%15s", token) == 1;
+		else valid = false;
+	}
+	// the newline after ENDHDR, then the data
+	valid = valid && fgetc(fp) != EOF && width && height && depth == 4 && maxValue == 255;
+
+	if (valid) {
+		image.resize(width, height);
+		valid = fread(image.pixels.data(), 1, image.pixels.size(), fp) == image.pixels.size();
+	}
+
+	fclose(fp);
+	if (!valid) err("%s isn't an rgba pam", path.c_str());
+	return valid;
+}
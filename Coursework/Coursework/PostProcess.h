@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+class JobSystem;
+
+// float4 pixels, like the render textures
+struct PostImage {
+	u32 width = 0;
+	u32 height = 0;
+	std::vector<vec4f> pixels;
+
+	void resize(u32 newWidth, u32 newHeight);
+	vec4f &at(u32 x, u32 y) { return pixels[(size_t)y * width + x]; }
+	const vec4f &at(u32 x, u32 y) const { return pixels[(size_t)y * width + x]; }
+};
+
+// 8 bits per channel, rgba, like the back buffer
+struct PostImage8 {
+	u32 width = 0;
+	u32 height = 0;
+	std::vector<u8> pixels;
+
+	void resize(u32 newWidth, u32 newHeight);
+	u8 *at(u32 x, u32 y) { return &pixels[((size_t)y * width + x) * 4]; }
+	const u8 *at(u32 x, u32 y) const { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+enum class PostIsa : u8 {
+	Scalar,
+	Sse,
+	Avx2,
+	Count,
+};
+
+// Outside of PostProcess so it can be a default argument of its functions
+struct PostOptions {
+	PostIsa isa = PostIsa::Avx2; // lowered to the best the cpu has
+	JobSystem *jobs = nullptr;   // the tiles run on this thread if null
+};
+
+/* The post processing passes on the cpu, to check the shaders and the
+ * algorithms without a device:
+ * - threshold: bloom_ps, the pixels with an alpha over the threshold
+ * - convolve: blurhor_ps and blurver_ps, a separable symmetric kernel
+ *   (GaussianKernel::getWeights) with the edges clamped
+ * - add: mix_ps, a scaled plus b, saturated
+ * - tonemap: the ACES fit, to 8 bits
+ * The images are split in tiles of TILE_ROWS rows, run on the job system
+ * if there is one. Every row is done with AVX2 (two pixels in a
+ * register), SSE (one pixel) or scalar code, the best the cpu has or the
+ * one in Options, so they can be checked against each other.
+ * compare() gives the difference of two images, to check them against
+ * golden images written with writePfm() or writePam().
+ */
+class PostProcess {
+public:
+	static constexpr u32 TILE_ROWS = 16;
+
+	using Isa = PostIsa;
+	using Options = PostOptions;
+
+	// Difference of two images, the errors are per channel in [0, 1] for the 8 bit ones
+	struct Diff {
+		u32 pixels = 0;
+		u32 differentPixels = 0; // with a channel off by more than the tolerance
+		f32 maxError = 0.f;
+		f64 meanError = 0.0;
+		f64 rmse = 0.0;
+		f64 psnr = 0.0;          // dB with a peak of 1, infinite if they're the same
+	};
+
+	static Isa getBestIsa();
+	static const char *getIsaName(Isa isa);
+
+	static void threshold(const PostImage &src, f32 threshold, PostImage &dst, const Options &options = Options());
+	// weights from the centre out, the other side is the same
+	static void convolve(const PostImage &src, const std::vector<f32> &weights, PostImage &dst, const Options &options = Options());
+	// a and b have to be the same size
+	static void add(const PostImage &a, f32 scaleA, const PostImage &b, PostImage &dst, const Options &options = Options());
+	static void tonemap(const PostImage &src, f32 exposure, PostImage8 &dst, const Options &options = Options());
+
+	// Saturated and rounded
+	static void toRgba8(const PostImage &src, PostImage8 &dst);
+	static void toFloat(const PostImage8 &src, PostImage &dst);
+
+	static Diff compare(const PostImage &a, const PostImage &b, f32 tolerance);
+	static Diff compare(const PostImage8 &a, const PostImage8 &b, u8 tolerance);
+
+	// Portable float map, rgb (the alpha is dropped)
+	static bool writePfm(const PostImage &image, const std::string &path);
+	static bool readPfm(const std::string &path, PostImage &image);
+	// Portable arbitrary map, rgba
+	static bool writePam(const PostImage8 &image, const std::string &path);
+	static bool readPam(const std::string &path, PostImage8 &image);
+};
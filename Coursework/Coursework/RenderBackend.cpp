@@ -0,0 +1,385 @@
+#include "RenderBackend.h"
+
+#include <string.h>
+#include <unordered_map>
+
+#include "tracelog.h"
+
+// d3d11 topology values
+static constexpr u32 TOPOLOGY_POINTLIST     = 1;
+static constexpr u32 TOPOLOGY_LINELIST      = 2;
+static constexpr u32 TOPOLOGY_LINESTRIP     = 3;
+static constexpr u32 TOPOLOGY_TRIANGLESTRIP = 5;
+
+static u64 primitiveCount(u32 topology, u32 count) {
+	switch (topology) {
+	case TOPOLOGY_POINTLIST:     return count;
+	case TOPOLOGY_LINELIST:      return count / 2;
+	case TOPOLOGY_LINESTRIP:     return count > 1 ? count - 1 : 0;
+	case TOPOLOGY_TRIANGLESTRIP: return count > 2 ? count - 2 : 0;
+	// triangle lists and 3 control point patches
+	default:                     return count / 3;
+	}
+}
+
+// == RECORDING BACKEND =================================================================================================================
+
+void RecordingBackend::clear() {
+	commands.clear();
+	objects.clear();
+	values.clear();
+	data.clear();
+	stats = Stats();
+}
+
+u32 RecordingBackend::getTotal() const {
+	u32 total = 0;
+	for (u32 count : stats.calls) {
+		total += count;
+	}
+	return total;
+}
+
+void RecordingBackend::replay(RenderBackend &target) const {
+	// buffers created during the capture, mapped to the ones created on target
+	std::unordered_map<const void *, ID3D11Buffer *> buffers;
+
+	auto remap = [&buffers](const void *handle) {
+		auto it = buffers.find(handle);
+		return it != buffers.end() ? (const void *)it->second : handle;
+	};
+
+	std::vector<const void *> handles;
+
+	for (const Command &cmd : commands) {
+		const u8 *bytes = data.data() + cmd.data;
+
+		if (cmd.count && (cmd.type == RenderCall::VertexBuffers || cmd.type == RenderCall::ConstantBuffers)) {
+			handles.resize(cmd.count);
+			for (u32 i = 0; i < cmd.count; ++i) {
+				handles[i] = remap(objects[cmd.objects + i]);
+			}
+		}
+
+		switch (cmd.type) {
+		case RenderCall::InputLayout: target.setInputLayout((ID3D11InputLayout *)cmd.object); break;
+		case RenderCall::Topology:    target.setTopology(cmd.value); break;
+		case RenderCall::VertexBuffers:
+			target.setVertexBuffers(cmd.start, cmd.count, (ID3D11Buffer *const *)handles.data(), &values[cmd.values], &values[cmd.values + cmd.count]);
+			break;
+		case RenderCall::IndexBuffer:
+			target.setIndexBuffer((ID3D11Buffer *)remap(cmd.object), cmd.value, cmd.start);
+			break;
+		case RenderCall::Shader:
+			switch (cmd.stage) {
+			case ShaderStage::Vertex:   target.setVertexShader((ID3D11VertexShader *)cmd.object); break;
+			case ShaderStage::Hull:     target.setHullShader((ID3D11HullShader *)cmd.object); break;
+			case ShaderStage::Domain:   target.setDomainShader((ID3D11DomainShader *)cmd.object); break;
+			case ShaderStage::Geometry: target.setGeometryShader((ID3D11GeometryShader *)cmd.object); break;
+			case ShaderStage::Pixel:    target.setPixelShader((ID3D11PixelShader *)cmd.object); break;
+			case ShaderStage::Compute:  target.setComputeShader((ID3D11ComputeShader *)cmd.object); break;
+			default: break;
+			}
+			break;
+		case RenderCall::ConstantBuffers:
+			target.setConstantBuffers(cmd.stage, cmd.start, cmd.count, (ID3D11Buffer *const *)handles.data());
+			break;
+		case RenderCall::ConstantBufferRange:
+			target.setConstantBufferRange(cmd.stage, cmd.start, (ID3D11Buffer *)remap(cmd.object), cmd.value, (u32)cmd.base);
+			break;
+		case RenderCall::ShaderResources:
+			target.setShaderResources(cmd.stage, cmd.start, cmd.count, (ID3D11ShaderResourceView *const *)&objects[cmd.objects]);
+			break;
+		case RenderCall::Samplers:
+			target.setSamplers(cmd.stage, cmd.start, cmd.count, (ID3D11SamplerState *const *)&objects[cmd.objects]);
+			break;
+		case RenderCall::CreateBuffer:
+			buffers[cmd.object] = target.createBuffer((BufferType)cmd.value, cmd.size, cmd.size ? bytes : nullptr, cmd.start != 0);
+			break;
+		case RenderCall::ReleaseBuffer:
+		{
+			auto it = buffers.find(cmd.object);
+			if (it != buffers.end()) {
+				target.releaseBuffer(it->second);
+				buffers.erase(it);
+			}
+			break;
+		}
+		case RenderCall::MapBuffer:
+		{
+			ID3D11Buffer *buffer = (ID3D11Buffer *)remap(cmd.object);
+			void *dst = target.mapBuffer(buffer, cmd.start, cmd.size, (MapMode)cmd.value);
+			if (dst) memcpy(dst, bytes, cmd.size);
+			target.unmapBuffer(buffer);
+			break;
+		}
+		case RenderCall::UpdateTexture:
+			target.updateTexture((ID3D11Texture2D *)cmd.object, cmd.start, bytes, cmd.value, cmd.value ? cmd.size / cmd.value : 0);
+			break;
+		case RenderCall::WriteTexture:
+			target.writeTexture((ID3D11Texture2D *)cmd.object, bytes, cmd.value, cmd.value ? cmd.size / cmd.value : 0);
+			break;
+		case RenderCall::Draw:                 target.draw(cmd.count, cmd.start); break;
+		case RenderCall::DrawIndexed:          target.drawIndexed(cmd.count, cmd.start, cmd.base); break;
+		case RenderCall::DrawIndexedInstanced: target.drawIndexedInstanced(cmd.count, cmd.value, cmd.start, cmd.base); break;
+		case RenderCall::Marker:               target.marker((const char *)bytes); break;
+		default: break;
+		}
+	}
+
+	// the capture didn't release them, don't leak them on target
+	for (auto &pair : buffers) {
+		target.releaseBuffer(pair.second);
+	}
+}
+
+// -- State ------------------------------------------------------------------------------------------------
+
+void RecordingBackend::setInputLayout(ID3D11InputLayout *layout) {
+	add(RenderCall::InputLayout, ShaderStage::Vertex, layout);
+	if (next) next->setInputLayout(layout);
+}
+
+void RecordingBackend::setTopology(u32 newTopology) {
+	topology = newTopology;
+	add(RenderCall::Topology, ShaderStage::Vertex, nullptr).value = newTopology;
+	if (next) next->setTopology(newTopology);
+}
+
+void RecordingBackend::setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) {
+	Command &cmd = add(RenderCall::VertexBuffers, ShaderStage::Vertex, count ? buffers[0] : nullptr);
+	cmd.start = start;
+	cmd.count = count;
+	if (record) {
+		cmd.objects = addObjects((const void *const *)buffers, count);
+		cmd.values = (u32)values.size();
+		values.insert(values.end(), strides, strides + count);
+		values.insert(values.end(), offsets, offsets + count);
+	}
+	if (next) next->setVertexBuffers(start, count, buffers, strides, offsets);
+}
+
+void RecordingBackend::setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) {
+	Command &cmd = add(RenderCall::IndexBuffer, ShaderStage::Vertex, buffer);
+	cmd.value = format;
+	cmd.start = offset;
+	if (next) next->setIndexBuffer(buffer, format, offset);
+}
+
+void RecordingBackend::setVertexShader(ID3D11VertexShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Vertex, shader);
+	if (next) next->setVertexShader(shader);
+}
+
+void RecordingBackend::setHullShader(ID3D11HullShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Hull, shader);
+	if (next) next->setHullShader(shader);
+}
+
+void RecordingBackend::setDomainShader(ID3D11DomainShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Domain, shader);
+	if (next) next->setDomainShader(shader);
+}
+
+void RecordingBackend::setGeometryShader(ID3D11GeometryShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Geometry, shader);
+	if (next) next->setGeometryShader(shader);
+}
+
+void RecordingBackend::setPixelShader(ID3D11PixelShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Pixel, shader);
+	if (next) next->setPixelShader(shader);
+}
+
+void RecordingBackend::setComputeShader(ID3D11ComputeShader *shader) {
+	add(RenderCall::Shader, ShaderStage::Compute, shader);
+	if (next) next->setComputeShader(shader);
+}
+
+void RecordingBackend::setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) {
+	Command &cmd = add(RenderCall::ConstantBuffers, stage, count ? buffers[0] : nullptr);
+	cmd.start = start;
+	cmd.count = count;
+	if (record) cmd.objects = addObjects((const void *const *)buffers, count);
+	if (next) next->setConstantBuffers(stage, start, count, buffers);
+}
+
+void RecordingBackend::setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) {
+	Command &cmd = add(RenderCall::ShaderResources, stage, count ? views[0] : nullptr);
+	cmd.start = start;
+	cmd.count = count;
+	if (record) cmd.objects = addObjects((const void *const *)views, count);
+	if (next) next->setShaderResources(stage, start, count, views);
+}
+
+void RecordingBackend::setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers) {
+	Command &cmd = add(RenderCall::Samplers, stage, count ? samplers[0] : nullptr);
+	cmd.start = start;
+	cmd.count = count;
+	if (record) cmd.objects = addObjects((const void *const *)samplers, count);
+	if (next) next->setSamplers(stage, start, count, samplers);
+}
+
+void RecordingBackend::setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) {
+	Command &cmd = add(RenderCall::ConstantBufferRange, stage, buffer);
+	cmd.start = slot;
+	cmd.count = 1;
+	cmd.value = firstConstant;
+	cmd.base = (i32)numConstants;
+	if (next) next->setConstantBufferRange(stage, slot, buffer, firstConstant, numConstants);
+}
+
+bool RecordingBackend::supportsConstantRanges() {
+	return next ? next->supportsConstantRanges() : true;
+}
+
+// -- Resources --------------------------------------------------------------------------------------------
+
+ID3D11Buffer *RecordingBackend::createBuffer(BufferType type, u32 size, const void *initialData, bool dynamic) {
+	ID3D11Buffer *buffer = nullptr;
+	if (next) {
+		buffer = next->createBuffer(type, size, initialData, dynamic);
+	}
+	else {
+		buffer = (ID3D11Buffer *)nextFakeHandle++;
+	}
+
+	Command &cmd = add(RenderCall::CreateBuffer, ShaderStage::Vertex, buffer);
+	cmd.value = (u32)type;
+	cmd.start = dynamic ? 1 : 0;
+	cmd.size = initialData ? size : 0;
+	if (record && initialData) cmd.data = addData(initialData, size);
+	if (initialData) stats.bytesUploaded += size;
+
+	return buffer;
+}
+
+void RecordingBackend::releaseBuffer(ID3D11Buffer *buffer) {
+	add(RenderCall::ReleaseBuffer, ShaderStage::Vertex, buffer);
+	if (next) next->releaseBuffer(buffer);
+}
+
+void *RecordingBackend::mapBuffer(ID3D11Buffer *buffer, u32 offset, u32 size, MapMode mode) {
+	if (mapped) {
+		warn("Buffer mapped while another buffer is still mapped");
+	}
+
+	mapped = buffer;
+	mapOffset = offset;
+	mapMode = mode;
+	mapScratch.resize(size);
+	return mapScratch.data();
+}
+
+void RecordingBackend::unmapBuffer(ID3D11Buffer *buffer) {
+	if (buffer != mapped) {
+		warn("Unmapping a buffer that wasn't mapped");
+		return;
+	}
+
+	u32 size = (u32)mapScratch.size();
+	Command &cmd = add(RenderCall::MapBuffer, ShaderStage::Vertex, buffer);
+	cmd.start = mapOffset;
+	cmd.value = (u32)mapMode;
+	cmd.size = size;
+	if (record) cmd.data = addData(mapScratch.data(), size);
+	stats.bytesUploaded += size;
+
+	if (next) {
+		void *dst = next->mapBuffer(buffer, mapOffset, size, mapMode);
+		if (dst) memcpy(dst, mapScratch.data(), size);
+		next->unmapBuffer(buffer);
+	}
+
+	mapped = nullptr;
+}
+
+void RecordingBackend::updateTexture(ID3D11Texture2D *texture, u32 subresource, const void *bytes, u32 rowPitch, u32 rows) {
+	u32 size = rowPitch * rows;
+	Command &cmd = add(RenderCall::UpdateTexture, ShaderStage::Vertex, texture);
+	cmd.start = subresource;
+	cmd.value = rowPitch;
+	cmd.size = size;
+	if (record) cmd.data = addData(bytes, size);
+	stats.bytesUploaded += size;
+	if (next) next->updateTexture(texture, subresource, bytes, rowPitch, rows);
+}
+
+void RecordingBackend::writeTexture(ID3D11Texture2D *texture, const void *bytes, u32 rowSize, u32 rows) {
+	u32 size = rowSize * rows;
+	Command &cmd = add(RenderCall::WriteTexture, ShaderStage::Vertex, texture);
+	cmd.value = rowSize;
+	cmd.size = size;
+	if (record) cmd.data = addData(bytes, size);
+	stats.bytesUploaded += size;
+	if (next) next->writeTexture(texture, bytes, rowSize, rows);
+}
+
+// -- Draws ------------------------------------------------------------------------------------------------
+
+void RecordingBackend::draw(u32 vertexCount, u32 startVertex) {
+	addDraw(RenderCall::Draw, startVertex, vertexCount, 1, 0);
+	if (next) next->draw(vertexCount, startVertex);
+}
+
+void RecordingBackend::drawIndexed(u32 indexCount, u32 startIndex, i32 baseVertex) {
+	addDraw(RenderCall::DrawIndexed, startIndex, indexCount, 1, baseVertex);
+	if (next) next->drawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void RecordingBackend::drawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 startIndex, i32 baseVertex) {
+	addDraw(RenderCall::DrawIndexedInstanced, startIndex, indexCount, instanceCount, baseVertex);
+	if (next) next->drawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex);
+}
+
+void RecordingBackend::marker(const char *name) {
+	Command &cmd = add(RenderCall::Marker, ShaderStage::Vertex, nullptr);
+	if (record) {
+		cmd.size = (u32)strlen(name) + 1;
+		cmd.data = addData(name, cmd.size);
+	}
+	if (next) next->marker(name);
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+RecordingBackend::Command &RecordingBackend::add(RenderCall type, ShaderStage stage, const void *object) {
+	stats.calls[(u32)type]++;
+
+	Command cmd{};
+	cmd.type = type;
+	cmd.stage = stage;
+	cmd.object = object;
+
+	// when not recording the command is only used to fill the arguments
+	if (!record) {
+		discarded = cmd;
+		return discarded;
+	}
+
+	commands.push_back(cmd);
+	return commands.back();
+}
+
+u32 RecordingBackend::addObjects(const void *const *handles, u32 count) {
+	u32 offset = (u32)objects.size();
+	objects.insert(objects.end(), handles, handles + count);
+	return offset;
+}
+
+u32 RecordingBackend::addData(const void *bytes, u32 size) {
+	u32 offset = (u32)data.size();
+	data.insert(data.end(), (const u8 *)bytes, (const u8 *)bytes + size);
+	return offset;
+}
+
+void RecordingBackend::addDraw(RenderCall type, u32 start, u32 count, u32 instances, i32 base) {
+	Command &cmd = add(type, ShaderStage::Vertex, nullptr);
+	cmd.start = start;
+	cmd.count = count;
+	cmd.value = instances;
+	cmd.base = base;
+
+	stats.draws++;
+	stats.primitives += primitiveCount(topology, count) * instances;
+}
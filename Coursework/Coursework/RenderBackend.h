@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+// only used as opaque pointers, this way the backends can be used outside of windows
+struct ID3D11Buffer;
+struct ID3D11Texture2D;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11HullShader;
+struct ID3D11DomainShader;
+struct ID3D11GeometryShader;
+struct ID3D11PixelShader;
+struct ID3D11ComputeShader;
+struct ID3D11DeviceContext;
+
+enum class ShaderStage : u8 {
+	Vertex,
+	Hull,
+	Domain,
+	Geometry,
+	Pixel,
+	Compute,
+	Count,
+};
+
+enum class BufferType : u8 {
+	Vertex,
+	Index,
+	Constant,
+};
+
+enum class MapMode : u8 {
+	Discard,     // the whole buffer is replaced
+	NoOverwrite, // only writes parts that the gpu isn't using, the rest is kept
+};
+
+enum class RenderCall : u8 {
+	// -- State --
+	InputLayout,
+	Topology,
+	VertexBuffers,
+	IndexBuffer,
+	Shader,
+	ConstantBuffers,
+	ConstantBufferRange,
+	ShaderResources,
+	Samplers,
+	// -- Resources --
+	CreateBuffer,
+	ReleaseBuffer,
+	MapBuffer,     // recorded on unmap, with the data that was written
+	UpdateTexture,
+	WriteTexture,
+	// -- Draws --
+	Draw,
+	DrawIndexed,
+	DrawIndexedInstanced,
+	Marker,
+	Count,
+};
+
+/* The calls the renderer makes on the device context: pipeline state,
+ * the buffers and textures that change every frame, and the draws.
+ * D3D11Backend forwards them to a real context, RecordingBackend stores
+ * them in memory, so the code that sits on top (StateCache, the shaders'
+ * render functions) can be counted, profiled and replayed without a gpu.
+ * Resources that are created once at start up still use the device.
+ * Topology and index format are the d3d11 enum values.
+ */
+class RenderBackend {
+public:
+	virtual ~RenderBackend() = default;
+
+	// -- State -------------------------------------------------------------------------------------------
+
+	virtual void setInputLayout(ID3D11InputLayout *layout) = 0;
+	virtual void setTopology(u32 topology) = 0;
+	virtual void setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) = 0;
+	virtual void setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) = 0;
+
+	virtual void setVertexShader(ID3D11VertexShader *shader) = 0;
+	virtual void setHullShader(ID3D11HullShader *shader) = 0;
+	virtual void setDomainShader(ID3D11DomainShader *shader) = 0;
+	virtual void setGeometryShader(ID3D11GeometryShader *shader) = 0;
+	virtual void setPixelShader(ID3D11PixelShader *shader) = 0;
+	virtual void setComputeShader(ID3D11ComputeShader *shader) = 0;
+
+	virtual void setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) = 0;
+	virtual void setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) = 0;
+	virtual void setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers) = 0;
+	// Binds part of a constant buffer, in constants of 16 bytes, both must be multiples of 16.
+	// Only available if supportsConstantRanges() returns true
+	virtual void setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) = 0;
+	// Constant buffer ranges and NoOverwrite maps of constant buffers need d3d11.1
+	virtual bool supportsConstantRanges() = 0;
+
+	// -- Resources ---------------------------------------------------------------------------------------
+
+	// Dynamic buffers can be mapped, the others are immutable after creation
+	virtual ID3D11Buffer *createBuffer(BufferType type, u32 size, const void *data, bool dynamic) = 0;
+	virtual void releaseBuffer(ID3D11Buffer *buffer) = 0;
+	// Returns where to write size bytes at offset of a dynamic buffer, only one buffer can be mapped at a time
+	virtual void *mapBuffer(ID3D11Buffer *buffer, u32 offset, u32 size, MapMode mode) = 0;
+	virtual void unmapBuffer(ID3D11Buffer *buffer) = 0;
+	// Uploads rows * rowPitch bytes to a default usage texture
+	virtual void updateTexture(ID3D11Texture2D *texture, u32 subresource, const void *data, u32 rowPitch, u32 rows) = 0;
+	// Replaces the content of a dynamic texture, rows are tightly packed in data
+	virtual void writeTexture(ID3D11Texture2D *texture, const void *data, u32 rowSize, u32 rows) = 0;
+
+	// -- Draws -------------------------------------------------------------------------------------------
+
+	virtual void draw(u32 vertexCount, u32 startVertex) = 0;
+	virtual void drawIndexed(u32 indexCount, u32 startIndex, i32 baseVertex) = 0;
+	virtual void drawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 startIndex, i32 baseVertex) = 0;
+	// Names the commands that follow, used to find the passes in a capture
+	virtual void marker(const char *name) = 0;
+
+	// The context the calls end up on, null without a device. The render targets,
+	// clears and copies don't go through the backend yet, they are set on it directly
+	virtual ID3D11DeviceContext *getContext() { return nullptr; }
+};
+
+/* Backend that stores every call it receives in memory, with the data of
+ * the uploads, and can replay them on another backend.
+ * With record set to false it only keeps the stats, and works as a null
+ * backend. If it has a next backend every call is also forwarded to it,
+ * this way a frame of the real application can be captured.
+ * Without a next backend, created buffers are fake handles that are never
+ * dereferenced.
+ */
+class RecordingBackend : public RenderBackend {
+public:
+	/* One call, the meaning of the fields depends on the type:
+	 * - slot calls: start/count are the slots, objects the handles
+	 * - VertexBuffers: values has the strides then the offsets
+	 * - ConstantBufferRange: start is the slot, value the first constant and base the number of constants
+	 * - IndexBuffer/Topology: value is the format/topology, start the offset
+	 * - CreateBuffer: value is the type, start is 1 if dynamic, data the initial content
+	 * - MapBuffer: data is the uploaded content, start the offset and value the map mode
+	 * - WriteTexture/UpdateTexture: data is the uploaded content,
+	 *   start is the subresource and value the row pitch/size
+	 * - draws: start/count are the first and number of indices/vertices,
+	 *   value the instances and base the base vertex
+	 * - Marker: data is the name
+	 */
+	struct Command {
+		RenderCall type;
+		ShaderStage stage;
+		u32 start;
+		u32 count;
+		u32 value;
+		i32 base;
+		const void *object;
+		u32 objects; // offset in getObjects()
+		u32 values;  // offset in getValues()
+		u32 data;    // offset in getData()
+		u32 size;    // bytes in getData()
+	};
+
+	struct Stats {
+		u32 calls[(u32)RenderCall::Count] = {};
+		u32 draws = 0;
+		u64 primitives = 0;  // triangles, instances included
+		u64 bytesUploaded = 0;
+	};
+
+	RecordingBackend(bool record = true, RenderBackend *next = nullptr) : record(record), next(next) {}
+
+	// Removes the commands and resets the stats
+	void clear();
+	void setNext(RenderBackend *backend) { next = backend; }
+	void setRecord(bool shouldRecord) { record = shouldRecord; }
+
+	const std::vector<Command> &getCommands() const { return commands; }
+	const std::vector<const void *> &getObjects() const { return objects; }
+	const std::vector<u32> &getValues() const { return values; }
+	const std::vector<u8> &getData() const { return data; }
+	const Stats &getStats() const { return stats; }
+	u32 getCount(RenderCall type) const { return stats.calls[(u32)type]; }
+	u32 getTotal() const;
+
+	// Replays the recorded commands, the buffers created in the capture are
+	// created again on target (and released if the capture released them)
+	void replay(RenderBackend &target) const;
+
+	void setInputLayout(ID3D11InputLayout *layout) override;
+	void setTopology(u32 topology) override;
+	void setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) override;
+	void setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) override;
+
+	void setVertexShader(ID3D11VertexShader *shader) override;
+	void setHullShader(ID3D11HullShader *shader) override;
+	void setDomainShader(ID3D11DomainShader *shader) override;
+	void setGeometryShader(ID3D11GeometryShader *shader) override;
+	void setPixelShader(ID3D11PixelShader *shader) override;
+	void setComputeShader(ID3D11ComputeShader *shader) override;
+
+	void setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) override;
+	void setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) override;
+	void setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers) override;
+	void setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) override;
+	// Asks the next backend, always true without one
+	bool supportsConstantRanges() override;
+
+	ID3D11Buffer *createBuffer(BufferType type, u32 size, const void *data, bool dynamic) override;
+	void releaseBuffer(ID3D11Buffer *buffer) override;
+	void *mapBuffer(ID3D11Buffer *buffer, u32 offset, u32 size, MapMode mode) override;
+	void unmapBuffer(ID3D11Buffer *buffer) override;
+	void updateTexture(ID3D11Texture2D *texture, u32 subresource, const void *data, u32 rowPitch, u32 rows) override;
+	void writeTexture(ID3D11Texture2D *texture, const void *data, u32 rowSize, u32 rows) override;
+
+	void draw(u32 vertexCount, u32 startVertex) override;
+	void drawIndexed(u32 indexCount, u32 startIndex, i32 baseVertex) override;
+	void drawIndexedInstanced(u32 indexCount, u32 instanceCount, u32 startIndex, i32 baseVertex) override;
+	void marker(const char *name) override;
+	// The one of the next backend
+	ID3D11DeviceContext *getContext() override { return next ? next->getContext() : nullptr; }
+
+private:
+	Command &add(RenderCall type, ShaderStage stage, const void *object);
+	u32 addObjects(const void *const *handles, u32 count);
+	u32 addData(const void *bytes, u32 size);
+	void addDraw(RenderCall type, u32 start, u32 count, u32 instances, i32 base);
+
+	bool record;
+	RenderBackend *next;
+
+	std::vector<Command> commands;
+	std::vector<const void *> objects;
+	std::vector<u32> values;
+	std::vector<u8> data;
+	Stats stats;
+	Command discarded;
+
+	u32 topology = 0;
+	uintptr_t nextFakeHandle = 1;
+
+	// the caller writes here, the data is forwarded on unmap
+	std::vector<u8> mapScratch;
+	ID3D11Buffer *mapped = nullptr;
+	u32 mapOffset = 0;
+	MapMode mapMode = MapMode::Discard;
+};
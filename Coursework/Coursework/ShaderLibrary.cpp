@@ -0,0 +1,223 @@
+#include "ShaderLibrary.h"
+
+#include <d3dcompiler.h>
+
+#include "utility.h"
+#include "tracelog.h"
+
+ShaderLibrary shaderLibrary;
+
+template<typename T>
+static void releaseAll(std::unordered_map<u64, T *> &shaders) {
+	for (auto &pair : shaders) {
+		RELEASE_IF_NOT_NULL(pair.second);
+	}
+	shaders.clear();
+}
+
+// the shader paths are all ascii
+static std::string narrow(const wchar_t *file) {
+	std::string path;
+	for (const wchar_t *c = file; *c; ++c) {
+		path += (char)*c;
+	}
+	return path;
+}
+
+// shaders/default_ps.cso -> default_ps, the name in the archive
+static std::string getName(const wchar_t *file) {
+	std::string path = narrow(file);
+	size_t slash = path.find_last_of("/\\");
+	size_t begin = slash == std::string::npos ? 0 : slash + 1;
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || dot < begin) dot = path.size();
+	return path.substr(begin, dot - begin);
+}
+
+ShaderLibrary::~ShaderLibrary() {
+	cleanup();
+}
+
+void ShaderLibrary::init(Device *dev) {
+	device = dev;
+}
+
+void ShaderLibrary::cleanup() {
+	std::lock_guard<std::mutex> lock(mutex);
+	releaseAll(vertexShaders);
+	releaseAll(hullShaders);
+	releaseAll(domainShaders);
+	releaseAll(geometryShaders);
+	releaseAll(pixelShaders);
+	archive.close();
+	archiveFile = nullptr;
+	cache.clear();
+	stats = Stats();
+}
+
+u32 ShaderLibrary::prefetch(const char *directory, JobSystem *jobs) {
+	return cache.prefetch(directory, ".cso", jobs);
+}
+
+bool ShaderLibrary::openArchive(const char *path) {
+	BytecodeCache::Handle file = cache.load(path);
+	if (!file) return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!archive.open(file->data, file->size)) {
+		err("%s isn't a valid shader archive", path);
+		return false;
+	}
+	archiveFile = file;
+	return true;
+}
+
+bool ShaderLibrary::buildArchive(const char *directory, const char *path) {
+	auto compile = [directory](const ShaderPermutations::ShaderInfo &shader, const std::vector<ShaderPermutations::Define> &defines, std::vector<u8> &bytecode) {
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (const ShaderPermutations::Define &define : defines) {
+			macros.push_back({ define.name.c_str(), define.value.c_str() });
+		}
+		macros.push_back({ nullptr, nullptr });
+
+		std::string source = std::string(directory) + "/" + shader.name + ".hlsl";
+		std::wstring wideSource(source.begin(), source.end());
+
+		ID3DBlob *code = nullptr;
+		ID3DBlob *errors = nullptr;
+		HRESULT result = D3DCompileFromFile(
+			wideSource.c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+			"main", shader.target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors
+		);
+
+		if (errors) {
+			if (FAILED(result)) err("%s", (const char *)errors->GetBufferPointer());
+			else                warn("%s", (const char *)errors->GetBufferPointer());
+			errors->Release();
+		}
+		if (FAILED(result)) return false;
+
+		const u8 *data = (const u8 *)code->GetBufferPointer();
+		bytecode.assign(data, data + code->GetBufferSize());
+		code->Release();
+		return true;
+	};
+
+	u32 variants = 0;
+	if (!ShaderPermutations::build(path, compile, &variants)) {
+		err("Couldn't build the shader archive %s", path);
+		return false;
+	}
+	info("Packed %u shader variants into %s", variants, path);
+	return true;
+}
+
+ID3D11VertexShader *ShaderLibrary::getVertexShader(const wchar_t *file) {
+	return getShader(vertexShaders, file, [this](const u8 *data, size_t size, ID3D11VertexShader **shader) {
+		return device->CreateVertexShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11HullShader *ShaderLibrary::getHullShader(const wchar_t *file) {
+	return getShader(hullShaders, file, [this](const u8 *data, size_t size, ID3D11HullShader **shader) {
+		return device->CreateHullShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11DomainShader *ShaderLibrary::getDomainShader(const wchar_t *file) {
+	return getShader(domainShaders, file, [this](const u8 *data, size_t size, ID3D11DomainShader **shader) {
+		return device->CreateDomainShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11GeometryShader *ShaderLibrary::getGeometryShader(const wchar_t *file) {
+	return getShader(geometryShaders, file, [this](const u8 *data, size_t size, ID3D11GeometryShader **shader) {
+		return device->CreateGeometryShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11PixelShader *ShaderLibrary::getPixelShader(const wchar_t *file) {
+	return getShader(pixelShaders, file, [this](const u8 *data, size_t size, ID3D11PixelShader **shader) {
+		return device->CreatePixelShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11PixelShader *ShaderLibrary::getPixelShader(const wchar_t *file, ShaderPermutations::Key key) {
+	std::string name = getName(file);
+	const ShaderPermutations::ShaderInfo *shader = ShaderPermutations::findShader(name.c_str());
+	key = shader ? ShaderPermutations::canonical(*shader, key) : 0;
+	// the .cso is the variant without any define
+	if (!key) return getPixelShader(file);
+
+	// the archive doesn't change after it's opened, the lookup doesn't need the lock
+	ShaderArchive::Variant variant = archive.find(name.c_str(), key);
+	if (!variant.data) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.missingVariants++;
+		}
+		warn("Variant %llx of %s isn't in the shader archive", (unsigned long long)key, name.c_str());
+		return getPixelShader(file);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.variants++;
+	}
+	return getShader(pixelShaders, variant.data, variant.size, variant.hash, file, [this](const u8 *data, size_t size, ID3D11PixelShader **shader) {
+		return device->CreatePixelShader(data, size, NULL, shader);
+	});
+}
+
+ID3D11InputLayout *ShaderLibrary::createInputLayout(const wchar_t *file, const D3D11_INPUT_ELEMENT_DESC *layoutDesc, u32 layoutLen) {
+	BytecodeCache::Handle code = getBytecode(file);
+	if (!code) return nullptr;
+
+	ID3D11InputLayout *layout = nullptr;
+	if (FAILED(device->CreateInputLayout(layoutDesc, layoutLen, code->data, code->size, &layout))) {
+		err("Couldn't create the input layout of %s", narrow(file).c_str());
+	}
+	return layout;
+}
+
+BytecodeCache::Handle ShaderLibrary::getBytecode(const wchar_t *file) {
+	return cache.load(narrow(file));
+}
+
+ShaderLibrary::Stats ShaderLibrary::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+template<typename T, typename Create>
+T *ShaderLibrary::getShader(std::unordered_map<u64, T *> &shaders, const wchar_t *file, Create create) {
+	BytecodeCache::Handle code = getBytecode(file);
+	if (!code) return nullptr;
+	return getShader(shaders, code->data, code->size, code->hash, file, create);
+}
+
+template<typename T, typename Create>
+T *ShaderLibrary::getShader(std::unordered_map<u64, T *> &shaders, const u8 *data, size_t size, u64 hash, const wchar_t *file, Create create) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// the same bytecode under a different name is the same shader
+	auto it = shaders.find(hash);
+	if (it != shaders.end()) {
+		stats.shared++;
+		it->second->AddRef();
+		return it->second;
+	}
+
+	T *shader = nullptr;
+	if (FAILED(create(data, size, &shader))) {
+		err("Couldn't create shader %s", narrow(file).c_str());
+		return nullptr;
+	}
+
+	stats.created++;
+	shaders[hash] = shader;
+	shader->AddRef();
+	return shader;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <d3d11.h>
+#include <mutex>
+#include <unordered_map>
+
+#include "types.h"
+#include "BytecodeCache.h"
+#include "ShaderPermutations.h"
+
+/* Creates the shader objects from the bytecode cache, one for every
+ * different bytecode. The shaders are d3d objects, so they are already
+ * ref-counted: every get function returns a new reference that the caller
+ * releases as usual (the BaseShader destructor does it), the library keeps
+ * one more until cleanup().
+ * The device is free threaded, so the shaders can be asked for on any thread.
+ * A missing file is reported and returns nullptr.
+ * The shaders with quality switches also have variants in an archive (see
+ * ShaderPermutations), it's mapped by openArchive() and a variant is only
+ * created the first time its key is asked for. Without the archive, or
+ * without the variant, the shader falls back to its .cso.
+ */
+class ShaderLibrary {
+public:
+	struct Stats {
+		u32 created = 0;
+		u32 shared = 0; // times an existing object was handed out again
+		u32 variants = 0; // handed out from the archive
+		u32 missingVariants = 0; // asked for but not in the archive, the .cso was used
+	};
+
+	~ShaderLibrary();
+
+	void init(Device *device);
+	// Releases the library's references, the shaders still in use stay alive
+	void cleanup();
+
+	// Maps the bytecode of every shader in directory, split across the jobs
+	u32 prefetch(const char *directory, JobSystem *jobs);
+	// Maps the archive of the shader variants, false if it's missing or broken
+	bool openArchive(const char *path);
+	// Compiles every variant of the manifest from the sources in directory
+	// into the archive, it doesn't need the device
+	static bool buildArchive(const char *directory, const char *path);
+
+	ID3D11VertexShader *getVertexShader(const wchar_t *file);
+	ID3D11HullShader *getHullShader(const wchar_t *file);
+	ID3D11DomainShader *getDomainShader(const wchar_t *file);
+	ID3D11GeometryShader *getGeometryShader(const wchar_t *file);
+	ID3D11PixelShader *getPixelShader(const wchar_t *file);
+	// The variant of the shader for the key, see ShaderPermutations
+	ID3D11PixelShader *getPixelShader(const wchar_t *file, ShaderPermutations::Key key);
+	// The input layouts are created from the vertex shader's bytecode
+	ID3D11InputLayout *createInputLayout(const wchar_t *file, const D3D11_INPUT_ELEMENT_DESC *layoutDesc, u32 layoutLen);
+
+	BytecodeCache::Handle getBytecode(const wchar_t *file);
+	BytecodeCache &getCache() { return cache; }
+	const ShaderArchive &getArchive() const { return archive; }
+	Stats getStats();
+
+private:
+	template<typename T, typename Create>
+	T *getShader(std::unordered_map<u64, T *> &shaders, const wchar_t *file, Create create);
+	template<typename T, typename Create>
+	T *getShader(std::unordered_map<u64, T *> &shaders, const u8 *data, size_t size, u64 hash, const wchar_t *file, Create create);
+
+	Device *device = nullptr;
+	BytecodeCache cache;
+	BytecodeCache::Handle archiveFile;
+	ShaderArchive archive;
+
+	std::mutex mutex;
+	std::unordered_map<u64, ID3D11VertexShader *> vertexShaders;
+	std::unordered_map<u64, ID3D11HullShader *> hullShaders;
+	std::unordered_map<u64, ID3D11DomainShader *> domainShaders;
+	std::unordered_map<u64, ID3D11GeometryShader *> geometryShaders;
+	std::unordered_map<u64, ID3D11PixelShader *> pixelShaders;
+	Stats stats;
+};
+
+extern ShaderLibrary shaderLibrary;
@@ -0,0 +1,286 @@
+#include "ShaderPermutations.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "BytecodeCache.h"
+#include "tracelog.h"
+
+// the shift of every feature is the sum of the bits before it
+static const ShaderPermutations::FeatureInfo features[] = {
+	{ "Spot PCF",        "SHADOW_USE_BLUR",       0, 1, 0, {},             ShaderPermutations::Feature::Count },
+	{ "Spot PCF radius", "SHADOW_BLUR_SAMPLE",    1, 2, 4, { 2, 4, 8, 15 }, ShaderPermutations::Feature::SpotPcf },
+	{ "Point PCF",       "POINT_SHADOW_USE_BLUR", 3, 1, 0, {},             ShaderPermutations::Feature::Count },
+};
+
+static_assert(sizeof(features) / sizeof(*features) == (size_t)ShaderPermutations::Feature::Count, "every feature needs its info");
+
+#define FEATURE_BIT(f) (1u << (u32)ShaderPermutations::Feature::f)
+
+// the shaders that include the shadow functions of utils.hlsli
+static const ShaderPermutations::ShaderInfo shaders[] = {
+	{ "default_ps",  "ps_5_0", FEATURE_BIT(SpotPcf) | FEATURE_BIT(SpotPcfRadius) | FEATURE_BIT(PointPcf) },
+	{ "grass_ps",    "ps_5_0", FEATURE_BIT(SpotPcf) | FEATURE_BIT(SpotPcfRadius) | FEATURE_BIT(PointPcf) },
+	{ "impostor_ps", "ps_5_0", FEATURE_BIT(SpotPcf) | FEATURE_BIT(SpotPcfRadius) | FEATURE_BIT(PointPcf) },
+};
+
+#undef FEATURE_BIT
+
+static void write32(u8 *dst, u32 value) { memcpy(dst, &value, sizeof(value)); }
+static void write64(u8 *dst, u64 value) { memcpy(dst, &value, sizeof(value)); }
+static u32 read32(const u8 *src) { u32 value; memcpy(&value, src, sizeof(value)); return value; }
+static u64 read64(const u8 *src) { u64 value; memcpy(&value, src, sizeof(value)); return value; }
+
+static u64 hashName(const char *name) {
+	return BytecodeCache::hash(name, strlen(name));
+}
+
+// == SHADER PERMUTATIONS =========================================================================================================
+
+const ShaderPermutations::FeatureInfo &ShaderPermutations::getFeature(Feature feature) {
+	return features[(u32)feature];
+}
+
+const ShaderPermutations::ShaderInfo *ShaderPermutations::findShader(const char *name) {
+	for (const ShaderInfo &shader : shaders) {
+		if (strcmp(shader.name, name) == 0) return &shader;
+	}
+	return nullptr;
+}
+
+const ShaderPermutations::ShaderInfo *ShaderPermutations::getShaders(u32 &count) {
+	count = (u32)(sizeof(shaders) / sizeof(*shaders));
+	return shaders;
+}
+
+ShaderPermutations::Key ShaderPermutations::set(Key key, Feature feature, u32 value) {
+	const FeatureInfo &info = getFeature(feature);
+	Key mask = ((1ull << info.bits) - 1) << info.shift;
+	return (key & ~mask) | (((Key)value << info.shift) & mask);
+}
+
+u32 ShaderPermutations::get(Key key, Feature feature) {
+	const FeatureInfo &info = getFeature(feature);
+	return (u32)((key >> info.shift) & ((1ull << info.bits) - 1));
+}
+
+ShaderPermutations::Key ShaderPermutations::canonical(const ShaderInfo &shader, Key key) {
+	Key result = 0;
+	// a feature only depends on the ones before it, so they are already in result
+	for (u32 i = 0; i < (u32)Feature::Count; ++i) {
+		Feature feature = (Feature)i;
+		const FeatureInfo &info = features[i];
+		if (!(shader.features & (1u << i))) continue;
+		if (info.dependsOn != Feature::Count && !get(result, info.dependsOn)) continue;
+
+		u32 last = info.valueCount ? info.valueCount - 1u : 1u;
+		result = set(result, feature, std::min(get(key, feature), last));
+	}
+	return result;
+}
+
+std::vector<ShaderPermutations::Key> ShaderPermutations::getKeys(const ShaderInfo &shader) {
+	// every combination of the values, the ones that are the same variant collapse
+	std::vector<Feature> used;
+	for (u32 i = 0; i < (u32)Feature::Count; ++i) {
+		if (shader.features & (1u << i)) used.push_back((Feature)i);
+	}
+
+	std::vector<Key> keys;
+	std::vector<u32> values(used.size(), 0);
+	while (true) {
+		Key key = 0;
+		for (size_t i = 0; i < used.size(); ++i) {
+			key = set(key, used[i], values[i]);
+		}
+		keys.push_back(canonical(shader, key));
+
+		size_t i = 0;
+		for (; i < used.size(); ++i) {
+			const FeatureInfo &info = getFeature(used[i]);
+			u32 count = info.valueCount ? info.valueCount : 2u;
+			if (++values[i] < count) break;
+			values[i] = 0;
+		}
+		if (i == used.size()) break;
+	}
+
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	return keys;
+}
+
+std::vector<ShaderPermutations::Define> ShaderPermutations::getDefines(Key key) {
+	std::vector<Define> defines;
+	for (u32 i = 0; i < (u32)Feature::Count; ++i) {
+		Feature feature = (Feature)i;
+		const FeatureInfo &info = features[i];
+		u32 value = get(key, feature);
+		if (info.dependsOn != Feature::Count && !get(key, info.dependsOn)) continue;
+
+		if (!info.valueCount) {
+			if (value) defines.push_back({ info.define, "1" });
+		}
+		else {
+			defines.push_back({ info.define, std::to_string(info.values[std::min<u32>(value, info.valueCount - 1)]) });
+		}
+	}
+	return defines;
+}
+
+bool ShaderPermutations::build(const std::string &path, const Compile &compile, u32 *variants) {
+	ShaderArchive::Writer writer;
+	u32 compiled = 0;
+	std::vector<u8> bytecode;
+
+	for (const ShaderInfo &shader : shaders) {
+		for (Key key : getKeys(shader)) {
+			bytecode.clear();
+			if (!compile(shader, getDefines(key), bytecode) || bytecode.empty()) {
+				err("Couldn't compile variant %llx of %s", (unsigned long long)key, shader.name);
+				return false;
+			}
+			writer.add(shader.name, key, bytecode.data(), bytecode.size());
+			compiled++;
+		}
+	}
+
+	if (variants) *variants = compiled;
+	return writer.write(path);
+}
+
+// == SHADER ARCHIVE ==============================================================================================================
+
+void ShaderArchive::Writer::add(const char *shader, ShaderPermutations::Key key, const void *bytecode, size_t size) {
+	Pending variant;
+	variant.shader = hashName(shader);
+	variant.key = key;
+	variant.bytecode.assign((const u8 *)bytecode, (const u8 *)bytecode + size);
+	pending.push_back(std::move(variant));
+}
+
+std::vector<u8> ShaderArchive::Writer::finish() const {
+	// the lookups are a binary search on the table
+	std::vector<const Pending *> sorted;
+	for (const Pending &variant : pending) sorted.push_back(&variant);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Pending *a, const Pending *b) {
+		return a->shader != b->shader ? a->shader < b->shader : a->key < b->key;
+	});
+
+	// a variant added twice keeps the last one
+	std::vector<const Pending *> unique;
+	for (const Pending *variant : sorted) {
+		if (!unique.empty() && unique.back()->shader == variant->shader && unique.back()->key == variant->key) {
+			unique.back() = variant;
+		}
+		else {
+			unique.push_back(variant);
+		}
+	}
+
+	auto align = [](size_t offset) { return (offset + 15) & ~(size_t)15; };
+
+	size_t total = align(HEADER_SIZE + unique.size() * ENTRY_SIZE);
+	for (const Pending *variant : unique) {
+		total = align(total + variant->bytecode.size());
+	}
+
+	std::vector<u8> archive(total, 0);
+	write32(&archive[0], MAGIC);
+	write32(&archive[4], VERSION);
+	write32(&archive[8], (u32)unique.size());
+
+	size_t offset = align(HEADER_SIZE + unique.size() * ENTRY_SIZE);
+	for (size_t i = 0; i < unique.size(); ++i) {
+		const Pending &variant = *unique[i];
+		u8 *entry = &archive[HEADER_SIZE + i * ENTRY_SIZE];
+		write64(entry, variant.shader);
+		write64(entry + 8, variant.key);
+		write64(entry + 16, BytecodeCache::hash(variant.bytecode.data(), variant.bytecode.size()));
+		write32(entry + 24, (u32)offset);
+		write32(entry + 28, (u32)variant.bytecode.size());
+
+		memcpy(&archive[offset], variant.bytecode.data(), variant.bytecode.size());
+		offset = align(offset + variant.bytecode.size());
+	}
+
+	return archive;
+}
+
+bool ShaderArchive::Writer::write(const std::string &path) const {
+	std::vector<u8> archive = finish();
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		err("Couldn't open %s", path.c_str());
+		return false;
+	}
+
+	bool written = fwrite(archive.data(), 1, archive.size(), file) == archive.size();
+	fclose(file);
+	if (!written) err("Couldn't write %s", path.c_str());
+	return written;
+}
+
+bool ShaderArchive::open(const u8 *archive, size_t archiveSize) {
+	close();
+
+	if (!archive || archiveSize < HEADER_SIZE) return false;
+	if (read32(archive) != MAGIC || read32(archive + 4) != VERSION) return false;
+
+	u64 entries = read32(archive + 8);
+	u64 tableEnd = HEADER_SIZE + entries * ENTRY_SIZE;
+	if (tableEnd > archiveSize) return false;
+
+	// checked once here, find() then trusts the table
+	for (u64 i = 0; i < entries; ++i) {
+		const u8 *entry = archive + HEADER_SIZE + i * ENTRY_SIZE;
+		u64 offset = read32(entry + 24);
+		u64 length = read32(entry + 28);
+		if (offset < tableEnd || offset + length > archiveSize) return false;
+
+		if (i) {
+			const u8 *prev = entry - ENTRY_SIZE;
+			u64 shader = read64(entry), prevShader = read64(prev);
+			if (shader < prevShader || (shader == prevShader && read64(entry + 8) <= read64(prev + 8))) return false;
+		}
+	}
+
+	data = archive;
+	size = archiveSize;
+	count = (u32)entries;
+	return true;
+}
+
+void ShaderArchive::close() {
+	data = nullptr;
+	size = 0;
+	count = 0;
+}
+
+ShaderArchive::Variant ShaderArchive::find(const char *shader, ShaderPermutations::Key key) const {
+	Variant variant;
+	if (!data) return variant;
+
+	u64 name = hashName(shader);
+	u32 first = 0, last = count;
+	while (first < last) {
+		u32 middle = first + (last - first) / 2;
+		const u8 *entry = data + HEADER_SIZE + (size_t)middle * ENTRY_SIZE;
+		u64 entryShader = read64(entry);
+		u64 entryKey = read64(entry + 8);
+
+		if (entryShader == name && entryKey == key) {
+			variant.data = data + read32(entry + 24);
+			variant.size = read32(entry + 28);
+			variant.hash = read64(entry + 16);
+			break;
+		}
+
+		if (entryShader < name || (entryShader == name && entryKey < key)) first = middle + 1;
+		else last = middle;
+	}
+
+	return variant;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "types.h"
+
+/* The quality switches of the shaders, and the variants they're compiled to.
+ * A switch is a feature of the manifest: a toggle (a define that is there
+ * or not) or a choice between a few values of a define. Every feature has
+ * a few bits of a 64 bit key, a variant of a shader is picked by its key.
+ * Every shader in the manifest lists the features it's compiled with, the
+ * bits of the others are dropped by canonical(), so a shader doesn't get
+ * more variants for the features it doesn't care about.
+ * The key 0 is the shader compiled without any define, the .cso that
+ * Visual Studio builds. The other variants are compiled offline (run the
+ * app with -packshaders) and packed into one ShaderArchive.
+ */
+class ShaderPermutations {
+public:
+	using Key = u64;
+
+	enum class Feature : u8 {
+		SpotPcf,       // SHADOW_USE_BLUR
+		SpotPcfRadius, // SHADOW_BLUR_SAMPLE, only with SpotPcf
+		PointPcf,      // POINT_SHADOW_USE_BLUR
+		Count,
+	};
+
+	static constexpr u32 MAX_VALUES = 4;
+
+	struct FeatureInfo {
+		const char *name;
+		const char *define;
+		u8 shift;
+		u8 bits;
+		// a toggle if it has no values, the define is then left out when it's off
+		u8 valueCount;
+		u32 values[MAX_VALUES];
+		// the feature is only compiled in when this one is on
+		Feature dependsOn;
+	};
+
+	struct ShaderInfo {
+		const char *name; // file name without the extension, e.g. default_ps
+		const char *target;
+		u32 features;     // bit mask of Feature
+	};
+
+	struct Define {
+		std::string name;
+		std::string value;
+	};
+
+	// Fills the bytecode of a shader compiled with the defines, false if it failed
+	using Compile = std::function<bool(const ShaderInfo &shader, const std::vector<Define> &defines, std::vector<u8> &bytecode)>;
+
+	static const FeatureInfo &getFeature(Feature feature);
+	// nullptr if the shader has no variants
+	static const ShaderInfo *findShader(const char *name);
+	static const ShaderInfo *getShaders(u32 &count);
+
+	// value is the index of the feature's value, 0 or 1 for toggles
+	static Key set(Key key, Feature feature, u32 value);
+	static u32 get(Key key, Feature feature);
+	// Drops the features the shader doesn't use and the ones that are off
+	// because of another, every variant has one canonical key
+	static Key canonical(const ShaderInfo &shader, Key key);
+	// Every canonical key of the shader, 0 first
+	static std::vector<Key> getKeys(const ShaderInfo &shader);
+	static std::vector<Define> getDefines(Key key);
+
+	// Compiles every variant of every shader in the manifest and writes the archive
+	static bool build(const std::string &path, const Compile &compile, u32 *variants = nullptr);
+};
+
+/* One file with the bytecode of many shader variants.
+ * Little endian, the header, then the table of the variants sorted by
+ * shader and key, then the bytecode of each one aligned to 16 bytes:
+ *   header:  magic 'SPAK', version, count, reserved (u32 each)
+ *   entry:   shader (u64 FNV-1a of the name), key (u64), hash (u64 FNV-1a
+ *            of the bytecode), offset (u32 from the start of the file), size (u32)
+ * open() checks the table once, the lookups are then a binary search and
+ * the bytecode is used where it is, the file is mapped and only the pages
+ * of the variants that are asked for are read.
+ */
+class ShaderArchive {
+public:
+	static constexpr u32 MAGIC = 'S' | 'P' << 8 | 'A' << 16 | 'K' << 24;
+	static constexpr u32 VERSION = 1;
+
+	struct Variant {
+		const u8 *data = nullptr;
+		size_t size = 0;
+		u64 hash = 0;
+	};
+
+	class Writer {
+	public:
+		void add(const char *shader, ShaderPermutations::Key key, const void *data, size_t size);
+		// The archive in memory
+		std::vector<u8> finish() const;
+		bool write(const std::string &path) const;
+
+	private:
+		struct Pending {
+			u64 shader;
+			ShaderPermutations::Key key;
+			std::vector<u8> bytecode;
+		};
+		std::vector<Pending> pending;
+	};
+
+	// The data isn't copied, it has to outlive the archive. Returns false
+	// and stays closed if it isn't a valid archive
+	bool open(const u8 *data, size_t size);
+	void close();
+
+	// An empty variant if it isn't there
+	Variant find(const char *shader, ShaderPermutations::Key key) const;
+	bool isOpen() const { return data != nullptr; }
+	u32 getCount() const { return count; }
+
+private:
+	static constexpr size_t HEADER_SIZE = 16;
+	static constexpr size_t ENTRY_SIZE = 32;
+
+	const u8 *data = nullptr;
+	size_t size = 0;
+	u32 count = 0;
+};
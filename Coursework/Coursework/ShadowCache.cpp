@@ -0,0 +1,78 @@
+#include "ShadowCache.h"
+
+void ShadowCache::setLight(u32 version, const vec3f &bmin, const vec3f &bmax) {
+	if (!hasLight || version != lightVersion) {
+		if (hasLight) stats.lightChanges++;
+		request(Reason::Light);
+	}
+
+	lightVersion = version;
+	hasLight = true;
+	volumeMin = bmin;
+	volumeMax = bmax;
+}
+
+void ShadowCache::setCaster(u32 id, u32 version, const vec3f &bmin, const vec3f &bmax) {
+	if (id >= casters.size()) {
+		casters.resize(id + 1);
+	}
+
+	Caster &caster = casters[id];
+	if (caster.known && caster.version == version) return;
+
+	// it could be moving in or out of the volume, check both
+	bool inside = overlaps(bmin, bmax) || (caster.known && overlaps(caster.bmin, caster.bmax));
+	if (inside) {
+		stats.casterChanges++;
+		request(Reason::Caster);
+	}
+	else {
+		stats.ignoredChanges++;
+	}
+
+	caster.version = version;
+	caster.bmin = bmin;
+	caster.bmax = bmax;
+	caster.known = true;
+}
+
+void ShadowCache::invalidate() {
+	request(Reason::Forced);
+}
+
+bool ShadowCache::update() {
+	stats.frames++;
+	reason = pending;
+	pending = Reason::None;
+
+	if (reason == Reason::None) return false;
+	stats.rebuilds++;
+	return true;
+}
+
+const char *ShadowCache::getReasonName(Reason reason) {
+	switch (reason) {
+	case Reason::None:   return "cached";
+	case Reason::First:  return "first frame";
+	case Reason::Light:  return "light moved";
+	case Reason::Caster: return "caster changed";
+	case Reason::Forced: return "invalidated";
+	}
+	return "unknown";
+}
+
+// -- Private --------------------------------------------------------------
+
+bool ShadowCache::overlaps(const vec3f &bmin, const vec3f &bmax) const {
+	return
+		bmin.x <= volumeMax.x && bmax.x >= volumeMin.x &&
+		bmin.y <= volumeMax.y && bmax.y >= volumeMin.y &&
+		bmin.z <= volumeMax.z && bmax.z >= volumeMin.z;
+}
+
+void ShadowCache::request(Reason newReason) {
+	// keep the first reason of the frame, it's the one that is shown
+	if (pending == Reason::None) {
+		pending = newReason;
+	}
+}
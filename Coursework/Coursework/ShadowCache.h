@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+/* Decides when the static part of a shadow map has to be drawn again.
+ * Most of what casts shadows doesn't move: the static casters are drawn
+ * to a depth map that is kept between frames, and only drawn again when
+ * the light or one of them changes. The casters that can change every
+ * frame are drawn on top of it instead.
+ * Every object has a version that its owner increments when it changes,
+ * the cache remembers the versions the map was drawn with. A caster that
+ * changed only invalidates the map if its old or new bounds are inside
+ * the volume the light casts shadows in.
+ */
+class ShadowCache {
+public:
+	enum class Reason : u8 {
+		None,   // the map is still valid
+		First,  // never drawn
+		Light,  // the light moved
+		Caster, // a caster inside the light's volume changed
+		Forced, // invalidate() was called
+	};
+
+	struct Stats {
+		u32 frames = 0;
+		u32 rebuilds = 0;
+		u32 lightChanges = 0;
+		u32 casterChanges = 0;  // casters that invalidated the map
+		u32 ignoredChanges = 0; // casters that changed outside the light's volume
+	};
+
+	// Sets the light's version and the box it casts shadows in, call it before setCaster()
+	void setLight(u32 version, const vec3f &bmin, const vec3f &bmax);
+	// Sets the version and bounds of a static caster, ids are small indices chosen by the caller
+	void setCaster(u32 id, u32 version, const vec3f &bmin, const vec3f &bmax);
+	// The map is drawn again at the next update
+	void invalidate();
+
+	// Ends the frame: returns true if the static casters have to be drawn
+	// again, after this the cache considers them drawn
+	bool update();
+
+	Reason getReason() const { return reason; }
+	const Stats &getStats() const { return stats; }
+	static const char *getReasonName(Reason reason);
+
+private:
+	struct Caster {
+		u32 version = 0;
+		vec3f bmin, bmax;
+		bool known = false;
+	};
+
+	bool overlaps(const vec3f &bmin, const vec3f &bmax) const;
+	void request(Reason newReason);
+
+	std::vector<Caster> casters;
+	u32 lightVersion = 0;
+	bool hasLight = false;
+	vec3f volumeMin, volumeMax;
+	Reason pending = Reason::First;
+	Reason reason = Reason::None;
+	Stats stats;
+};
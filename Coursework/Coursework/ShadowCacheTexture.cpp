@@ -0,0 +1,33 @@
+#include "ShadowCacheTexture.h"
+
+#include "utility.h"
+
+void ShadowCacheTexture::init(Device *device, ID3D11DepthStencilView *depthView) {
+	ID3D11Resource *resource = nullptr;
+	depthView->GetResource(&resource);
+	resource->QueryInterface(__uuidof(ID3D11Texture2D), (void **)&source);
+	RELEASE_IF_NOT_NULL(resource);
+	assert(source);
+
+	D3D11_TEXTURE2D_DESC texDesc{};
+	source->GetDesc(&texDesc);
+	texDesc.BindFlags = 0;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	device->CreateTexture2D(&texDesc, 0, &copy);
+	assert(copy);
+}
+
+ShadowCacheTexture::~ShadowCacheTexture() {
+	RELEASE_IF_NOT_NULL(copy);
+	RELEASE_IF_NOT_NULL(source);
+}
+
+void ShadowCacheTexture::save(DeviceContext *ctx) {
+	ctx->CopyResource(copy, source);
+}
+
+void ShadowCacheTexture::restore(DeviceContext *ctx) {
+	ctx->CopyResource(source, copy);
+}
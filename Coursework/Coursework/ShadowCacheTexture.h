@@ -0,0 +1,25 @@
+#pragma once
+
+#include "types.h"
+
+/* Copy of the static casters of a shadow map (see ShadowCache).
+ * After the static casters are drawn the depth is saved here, the frames
+ * that can use the cache restore it and only draw the dynamic casters on
+ * top. The copy has the same description as the shadow map's texture,
+ * without any binding as it's only used by CopyResource.
+ */
+class ShadowCacheTexture {
+public:
+	// Creates a texture like the one the depth view points to
+	void init(Device *device, ID3D11DepthStencilView *depthView);
+	~ShadowCacheTexture();
+
+	// Copies the shadow map to the cache
+	void save(DeviceContext *ctx);
+	// Copies the cache back to the shadow map
+	void restore(DeviceContext *ctx);
+
+private:
+	ID3D11Texture2D *source = nullptr;
+	ID3D11Texture2D *copy = nullptr;
+};
@@ -0,0 +1,194 @@
+#include "ShadowCascades.h"
+
+#include <math.h>
+
+#include "MathUtils.h"
+
+// a is l x m, b is m x n, row major
+static void mulMatrix(const f32 a[16], const f32 b[16], f32 out[16]) {
+	for (u32 r = 0; r < 4; ++r) {
+		for (u32 c = 0; c < 4; ++c) {
+			out[r * 4 + c] =
+				a[r * 4 + 0] * b[0 * 4 + c] +
+				a[r * 4 + 1] * b[1 * 4 + c] +
+				a[r * 4 + 2] * b[2 * 4 + c] +
+				a[r * 4 + 3] * b[3 * 4 + c];
+		}
+	}
+}
+
+// == SHADOW CASCADES =============================================================================================================
+
+ShadowCascades::View ShadowCascades::makeView(const f32 view[16], const f32 proj[16]) {
+	View result;
+	// the columns of the rotation are the camera's axes
+	result.right   = { view[0], view[4], view[8] };
+	result.up      = { view[1], view[5], view[9] };
+	result.forward = { view[2], view[6], view[10] };
+
+	// the translation is -eye in view space
+	vec3f t = { view[12], view[13], view[14] };
+	result.position = -(result.right * t.x + result.up * t.y + result.forward * t.z);
+
+	result.tanHalfFovY = 1.f / proj[5];
+	result.aspect = proj[5] / proj[0];
+	result.nearZ = -proj[14] / proj[10];
+	result.farZ = proj[14] / (1.f - proj[10]);
+	return result;
+}
+
+void ShadowCascades::computeSplits(f32 nearZ, f32 farZ, u32 count, f32 lambda, f32 *splits) {
+	splits[0] = nearZ;
+	for (u32 i = 1; i < count; ++i) {
+		f32 t = (f32)i / (f32)count;
+		f32 logSplit = nearZ * powf(farZ / nearZ, t);
+		f32 uniformSplit = nearZ + (farZ - nearZ) * t;
+		splits[i] = lambda * logSplit + (1.f - lambda) * uniformSplit;
+	}
+	splits[count] = farZ;
+}
+
+void ShadowCascades::update(const Desc &desc, const View &camera, const vec3f &direction) {
+	stats = Stats();
+	view = camera;
+	count = clamp(desc.count, 1u, (u32)MAX_CASCADES);
+
+	lightDir = direction.normalized();
+	if (lightDir.mag2() == 0.f) lightDir = { 0.f, -1.f, 0.f };
+
+	// like a look-at, the up vector can't be the light's direction
+	vec3f up = fabsf(lightDir.y) > 0.99f ? vec3f(0.f, 0.f, 1.f) : vec3f(0.f, 1.f, 0.f);
+	lightZ = lightDir;
+	lightX = cross(up, lightZ).normalized();
+	lightY = cross(lightZ, lightX);
+
+	f32 farZ = min(camera.farZ, desc.maxDistance);
+	f32 splits[MAX_CASCADES + 1];
+	computeSplits(camera.nearZ, farZ, count, clamp(desc.lambda, 0.f, 1.f), splits);
+
+	for (u32 i = 0; i < count; ++i) {
+		cascades[i].nearZ = splits[i];
+		cascades[i].farZ = splits[i + 1];
+		fitCascade(cascades[i], camera, max(desc.resolution, 4u), desc.casterDistance, desc.fit);
+	}
+}
+
+u32 ShadowCascades::cull(const vec3f &bmin, const vec3f &bmax) {
+	u32 mask = getCasterMask(bmin, bmax);
+	stats.tested++;
+	for (u32 i = 0; i < count; ++i) {
+		if (mask & (1 << i)) stats.casters[i]++;
+	}
+	return mask;
+}
+
+u32 ShadowCascades::getCasterMask(const vec3f &bmin, const vec3f &bmax) const {
+	// the light space box around the world space one
+	vec3f center = toLight((bmin + bmax) * 0.5f);
+	vec3f half = (bmax - bmin) * 0.5f;
+	vec3f extent = {
+		fabsf(lightX.x) * half.x + fabsf(lightX.y) * half.y + fabsf(lightX.z) * half.z,
+		fabsf(lightY.x) * half.x + fabsf(lightY.y) * half.y + fabsf(lightY.z) * half.z,
+		fabsf(lightZ.x) * half.x + fabsf(lightZ.y) * half.y + fabsf(lightZ.z) * half.z,
+	};
+
+	u32 mask = 0;
+	for (u32 i = 0; i < count; ++i) {
+		const Cascade &c = cascades[i];
+		if (center.x + extent.x < c.boxMin.x || center.x - extent.x > c.boxMax.x) continue;
+		if (center.y + extent.y < c.boxMin.y || center.y - extent.y > c.boxMax.y) continue;
+		// what is behind the slice can't shadow it, what is before the start gets clipped
+		if (center.z + extent.z < c.boxMin.z || center.z - extent.z > c.boxMax.z) continue;
+		mask |= 1 << i;
+	}
+	return mask;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+void ShadowCascades::fitCascade(Cascade &cascade, const View &camera, u32 resolution, f32 casterDistance, Fit fit) {
+	f32 n = cascade.nearZ, f = cascade.farZ;
+
+	// the smallest sphere around a symmetric slice has its centre on the view axis,
+	// where the near and far corners are at the same distance (or on the far plane).
+	// It only depends on the fov and the split, so it is the same every frame
+	f32 k2 = pow2(camera.tanHalfFovY) * (1.f + pow2(camera.aspect));
+	f32 centerZ = min((f + n) * (1.f + k2) * 0.5f, f);
+	cascade.center = camera.position + camera.forward * centerZ;
+	cascade.radius = sqrtf(pow2(f) * k2 + pow2(f - centerZ));
+
+	vec3f center = toLight(cascade.center);
+	vec2f mid = { center.x, center.y };
+	vec2f half = { cascade.radius, cascade.radius };
+	f32 zMin = center.z - cascade.radius;
+	f32 zMax = center.z + cascade.radius;
+
+	if (fit == Fit::Tight) {
+		vec3f corners[8];
+		getSliceCorners(camera, n, f, corners);
+
+		vec3f lmin = vec3f(1e30f), lmax = vec3f(-1e30f);
+		for (const vec3f &corner : corners) {
+			vec3f p = toLight(corner);
+			lmin = { min(lmin.x, p.x), min(lmin.y, p.y), min(lmin.z, p.z) };
+			lmax = { max(lmax.x, p.x), max(lmax.y, p.y), max(lmax.z, p.z) };
+		}
+
+		// rounded up to 1/16 of the sphere, so the size only changes in steps
+		f32 step = cascade.radius / 8.f;
+		mid = { (lmin.x + lmax.x) * 0.5f, (lmin.y + lmax.y) * 0.5f };
+		half = {
+			min(ceilf((lmax.x - lmin.x) * 0.5f / step) * step, cascade.radius),
+			min(ceilf((lmax.y - lmin.y) * 0.5f / step) * step, cascade.radius),
+		};
+		zMin = lmin.z;
+		zMax = lmax.z;
+	}
+
+	// one texel of border on every side, snapping moves the centre by less than that
+	half *= (f32)resolution / (f32)(resolution - 2);
+	vec2f texel = half * 2.f / (f32)resolution;
+	mid = { floorf(mid.x / texel.x) * texel.x, floorf(mid.y / texel.y) * texel.y };
+	cascade.texelSize = max(texel.x, texel.y);
+
+	cascade.boxMin = { mid.x - half.x, mid.y - half.y, zMin - casterDistance };
+	cascade.boxMax = { mid.x + half.x, mid.y + half.y, zMax };
+
+	// the light's rotation, like a look-at without the translation
+	f32 *v = cascade.view;
+	v[0] = lightX.x; v[1] = lightY.x; v[2]  = lightZ.x; v[3]  = 0.f;
+	v[4] = lightX.y; v[5] = lightY.y; v[6]  = lightZ.y; v[7]  = 0.f;
+	v[8] = lightX.z; v[9] = lightY.z; v[10] = lightZ.z; v[11] = 0.f;
+	v[12] = 0.f;     v[13] = 0.f;     v[14] = 0.f;      v[15] = 1.f;
+
+	// XMMatrixOrthographicOffCenterLH
+	const vec3f &lo = cascade.boxMin, &hi = cascade.boxMax;
+	f32 *p = cascade.proj;
+	for (u32 i = 0; i < 16; ++i) p[i] = 0.f;
+	p[0]  = 2.f / (hi.x - lo.x);
+	p[5]  = 2.f / (hi.y - lo.y);
+	p[10] = 1.f / (hi.z - lo.z);
+	p[12] = (lo.x + hi.x) / (lo.x - hi.x);
+	p[13] = (lo.y + hi.y) / (lo.y - hi.y);
+	p[14] = lo.z / (lo.z - hi.z);
+	p[15] = 1.f;
+
+	mulMatrix(cascade.view, cascade.proj, cascade.viewProj);
+}
+
+void ShadowCascades::getSliceCorners(const View &camera, f32 nearZ, f32 farZ, vec3f corners[8]) {
+	for (u32 i = 0; i < 8; ++i) {
+		f32 z = i & 4 ? farZ : nearZ;
+		f32 h = z * camera.tanHalfFovY;
+		f32 w = h * camera.aspect;
+		corners[i] =
+			camera.position +
+			camera.forward * z +
+			camera.right * (i & 1 ? w : -w) +
+			camera.up * (i & 2 ? h : -h);
+	}
+}
+
+vec3f ShadowCascades::toLight(const vec3f &world) const {
+	return { dot(world, lightX), dot(world, lightY), dot(world, lightZ) };
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "types.h"
+#include "vec.h"
+
+/* Cascade ranges and light projections for the directional light.
+ * The camera frustum is split in count slices with the practical split
+ * scheme: every split is a blend, by lambda, of the logarithmic split
+ * (the same resolution at every depth) and the uniform one (which keeps
+ * the first cascade from being tiny).
+ * Every slice gets its own orthographic projection:
+ * - Sphere fits a sphere around the slice, its size only depends on the
+ *   camera's fov and the split, so it doesn't change when the camera turns
+ * - Tight fits the box of the slice's corners in light space, it uses the
+ *   texels better but its size changes with the camera, it is rounded up
+ *   to a few steps to limit the shimmering
+ * The light view has no translation, so light space and the texel grid
+ * don't move with the camera: the centre of the projection is snapped to
+ * a whole texel and moving the camera only slides the texels.
+ * The projection starts casterDistance before the slice, so the casters
+ * between the light and the slice are still drawn.
+ * Matrices are row major and multiply row vectors like DirectXMath.
+ */
+class ShadowCascades {
+public:
+	static constexpr u32 MAX_CASCADES = 4;
+
+	enum class Fit : u8 {
+		Sphere,
+		Tight,
+	};
+
+	struct Desc {
+		u32 count = 3;
+		u32 resolution = 2048;
+		f32 lambda = 0.8f;           // 0 uniform, 1 logarithmic
+		f32 maxDistance = 150.f;     // shadows end here, even if the camera sees further
+		f32 casterDistance = 100.f;  // how far towards the light the casters can be
+		Fit fit = Fit::Sphere;
+	};
+
+	// What the camera sees, view space distances
+	struct View {
+		vec3f position;
+		vec3f forward, right, up;
+		f32 tanHalfFovY = 1.f;
+		f32 aspect = 1.f;
+		f32 nearZ = 0.1f;
+		f32 farZ = 200.f;
+	};
+
+	struct Cascade {
+		f32 nearZ = 0.f, farZ = 0.f; // view space range of the slice
+		vec3f center;                // bounding sphere of the slice
+		f32 radius = 0.f;
+		f32 texelSize = 0.f;         // in world units
+		// light space box of the projection
+		vec3f boxMin, boxMax;
+		f32 view[16];
+		f32 proj[16];
+		f32 viewProj[16];
+	};
+
+	struct Stats {
+		u32 tested = 0;
+		u32 casters[MAX_CASCADES] = {};
+	};
+
+	// Camera basis from a view matrix, fov and planes from a perspective one
+	static View makeView(const f32 view[16], const f32 proj[16]);
+	// Writes count + 1 distances, from nearZ to farZ
+	static void computeSplits(f32 nearZ, f32 farZ, u32 count, f32 lambda, f32 *splits);
+
+	// Fits every cascade around the camera, lightDir is where the light goes towards.
+	// Resets the stats
+	void update(const Desc &desc, const View &camera, const vec3f &lightDir);
+
+	// Bitmask of the cascades an axis aligned box casts shadows in, and counts it
+	u32 cull(const vec3f &bmin, const vec3f &bmax);
+	// The same without counting
+	u32 getCasterMask(const vec3f &bmin, const vec3f &bmax) const;
+
+	u32 getCount() const { return count; }
+	const Cascade &getCascade(u32 index) const { return cascades[index]; }
+	// The far end of every cascade, in view space
+	f32 getSplit(u32 index) const { return cascades[index].farZ; }
+	const vec3f &getLightDir() const { return lightDir; }
+	// The camera of the last update, the shaders pick the cascade from its view depth
+	const View &getView() const { return view; }
+	const Stats &getStats() const { return stats; }
+
+private:
+	void fitCascade(Cascade &cascade, const View &camera, u32 resolution, f32 casterDistance, Fit fit);
+	// Corners of the slice of the camera between nearZ and farZ
+	static void getSliceCorners(const View &camera, f32 nearZ, f32 farZ, vec3f corners[8]);
+	vec3f toLight(const vec3f &world) const;
+
+	u32 count = 0;
+	Cascade cascades[MAX_CASCADES];
+	View view;
+	vec3f lightDir { 0.f, -1.f, 0.f };
+	// light space axes, the rows of the light's rotation
+	vec3f lightX { 1.f, 0.f, 0.f };
+	vec3f lightY { 0.f, 0.f, 1.f };
+	vec3f lightZ { 0.f, -1.f, 0.f };
+	Stats stats;
+};
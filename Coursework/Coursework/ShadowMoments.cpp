@@ -0,0 +1,105 @@
+#include "ShadowMoments.h"
+
+#include "MathUtils.h"
+
+f32 ShadowMoments::linearizeDepth(f32 depth, f32 nearZ, f32 farZ) {
+	// inverse of the projection's z / w
+	f32 viewZ = nearZ * farZ / (farZ - depth * (farZ - nearZ));
+	return clamp((viewZ - nearZ) / (farZ - nearZ), 0.f, 1.f);
+}
+
+vec4f ShadowMoments::encode(f32 depth) {
+	// in [-1, 1] the two warps use all of their range
+	f32 d = depth * 2.f - 1.f;
+	f32 pos = expf(POSITIVE_EXPONENT * d);
+	f32 neg = -expf(-NEGATIVE_EXPONENT * d);
+	return vec4f(pos, pos * pos, neg, neg * neg);
+}
+
+f32 ShadowMoments::chebyshev(f32 mean, f32 meanSq, f32 t, f32 minVariance) {
+	if (t <= mean) return 1.f;
+	f32 variance = max(meanSq - mean * mean, minVariance);
+	f32 d = t - mean;
+	return variance / (variance + d * d);
+}
+
+f32 ShadowMoments::visibility(const vec4f &moments, f32 depth, const Params &params) {
+	f32 d = depth * 2.f - 1.f;
+	f32 pos = expf(POSITIVE_EXPONENT * d);
+	f32 neg = -expf(-NEGATIVE_EXPONENT * d);
+
+	// the minimum variance follows the slope of the warps, or it would be
+	// too big close to the light and too small far from it
+	f32 posScale = params.minVariance * POSITIVE_EXPONENT * pos;
+	f32 negScale = params.minVariance * NEGATIVE_EXPONENT * neg;
+
+	f32 lit = min(
+		chebyshev(moments.x, moments.y, pos, posScale * posScale),
+		chebyshev(moments.z, moments.w, neg, negScale * negScale)
+	);
+
+	// the tail of the bound lights what is behind two occluders, cut it
+	if (params.lightBleeding <= 0.f) return lit;
+	return clamp((lit - params.lightBleeding) / (1.f - params.lightBleeding), 0.f, 1.f);
+}
+
+void ShadowMoments::downsample(const f32 *depth, u32 depthSize, u32 scale, f32 nearZ, f32 farZ, std::vector<vec4f> &moments) {
+	scale = max(scale, 1u);
+	u32 size = depthSize / scale;
+	moments.assign(size * size, vec4f());
+
+	for (u32 y = 0; y < size; ++y) {
+		for (u32 x = 0; x < size; ++x) {
+			vec4f sum;
+			for (u32 sy = 0; sy < scale; ++sy) {
+				for (u32 sx = 0; sx < scale; ++sx) {
+					f32 z = depth[(y * scale + sy) * depthSize + x * scale + sx];
+					sum += encode(linearizeDepth(z, nearZ, farZ));
+				}
+			}
+			moments[y * size + x] = sum / (f32)(scale * scale);
+		}
+	}
+}
+
+void ShadowMoments::blur(std::vector<vec4f> &moments, u32 size, u32 radius) {
+	radius = min(radius, (u32)MAX_BLUR_RADIUS);
+	if (!radius || !size) return;
+
+	std::vector<vec4f> temp(moments.size());
+	const i32 last = (i32)size - 1;
+	const i32 r = (i32)radius;
+
+	// horizontal to temp, then vertical back
+	for (i32 y = 0; y <= last; ++y) {
+		for (i32 x = 0; x <= last; ++x) {
+			vec4f sum;
+			for (i32 i = -r; i <= r; ++i) {
+				sum += moments[y * size + clamp(x + i, 0, last)] * getBlurWeight(i, radius);
+			}
+			temp[y * size + x] = sum;
+		}
+	}
+
+	for (i32 y = 0; y <= last; ++y) {
+		for (i32 x = 0; x <= last; ++x) {
+			vec4f sum;
+			for (i32 i = -r; i <= r; ++i) {
+				sum += temp[clamp(y + i, 0, last) * size + x] * getBlurWeight(i, radius);
+			}
+			moments[y * size + x] = sum;
+		}
+	}
+}
+
+f32 ShadowMoments::getBlurWeight(i32 offset, u32 radius) {
+	if (!radius) return offset == 0 ? 1.f : 0.f;
+
+	// the kernel ends at two standard deviations
+	f32 sigma = radius * 0.5f;
+	f32 total = 0.f;
+	for (i32 i = -(i32)radius; i <= (i32)radius; ++i) {
+		total += expf(-(f32)(i * i) / (2.f * sigma * sigma));
+	}
+	return expf(-(f32)(offset * offset) / (2.f * sigma * sigma)) / total;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+/* Exponential variance shadow maps (EVSM), the reference the shaders are
+ * checked against.
+ * Instead of the depth, every texel of the map keeps the first two
+ * moments of two warped depths: exp(c * d) and -exp(-c * d). Unlike depths,
+ * moments can be filtered like colours, so the map is blurred once when
+ * it's drawn and sampled with mipmaps, instead of doing PCF with many
+ * taps in every pixel. The visibility is the Chebyshev upper bound of the
+ * fraction of the texel's depths behind the receiver, the smaller of the
+ * two warps.
+ * The depths are linear in [0, 1], the maps are drawn with a perspective
+ * projection so they're converted with linearizeDepth() first. The maps
+ * are drawn at a lower resolution than the depth: every moments texel is
+ * the average of scale * scale depth texels.
+ */
+class ShadowMoments {
+public:
+	// matches EVSM_* in utils.hlsli, exp(2 * 40) is still a 32 bit float
+	static constexpr f32 POSITIVE_EXPONENT = 40.f;
+	static constexpr f32 NEGATIVE_EXPONENT = 5.f;
+	static constexpr u32 MAX_BLUR_RADIUS = 8;
+
+	// How a light filters its shadow, matches SHADOW_FILTER_* in utils.hlsli
+	enum class Filter : u8 {
+		Hard, // one depth tap, or PCF with SHADOW_USE_BLUR
+		Evsm,
+	};
+
+	struct Params {
+		f32 minVariance = 0.0001f;  // hides the acne on flat surfaces
+		f32 lightBleeding = 0.2f;   // the bound is cut below this, 0 keeps it
+	};
+
+	// Depth of a perspective projection, to linear in [0, 1] between the planes
+	static f32 linearizeDepth(f32 depth, f32 nearZ, f32 farZ);
+	// Moments of a linear depth: positive warp, its square, negative warp, its square
+	static vec4f encode(f32 depth);
+	// Upper bound of the fraction of the distribution at or after t
+	static f32 chebyshev(f32 mean, f32 meanSq, f32 t, f32 minVariance);
+	// Fraction of light that reaches a receiver at a linear depth, 1 is lit
+	static f32 visibility(const vec4f &moments, f32 depth, const Params &params);
+
+	// What evsm_moments_ps does: every texel is the average moments of
+	// scale * scale texels of a perspective depth map
+	static void downsample(const f32 *depth, u32 depthSize, u32 scale, f32 nearZ, f32 farZ, std::vector<vec4f> &moments);
+	// What the two evsm_blur_ps passes do, the texels past the edges are clamped
+	static void blur(std::vector<vec4f> &moments, u32 size, u32 radius);
+	// Normalized gaussian weight of an offset, the same in evsm_blur_ps
+	static f32 getBlurWeight(i32 offset, u32 radius);
+};
@@ -495,13 +495,11 @@ void Sky::update(float dt) {
 	sunlight->setDirection(dir.x, dir.y, dir.z);
 }
 
-void Sky::render(D3D *renderer, FPCamera *camera) {
+void Sky::render(D3D *renderer, const mat4 &view, const float3 &cameraPos) {
 	mat4 world = renderer->getWorldMatrix();
-	mat4 view = camera->getViewMatrix();
 	mat4 proj = renderer->getProjectionMatrix();
 
 	// put the skybox around the camera
-	float3 cameraPos = camera->getPosition();
 	world = world * XMMatrixTranslation(cameraPos.x, cameraPos.y, cameraPos.z);
 
 	skyData.lightDir = sunlight->getDirection();
@@ -550,19 +548,19 @@ void Sky::gui(bool &open) {
 }
 
 void Sky::writeToConsole() {
-	tall("struct SkyData {");
-	tall("\tfloat3 lightDir         = float3(0.f, 0.f, 0.f);");
-	tall("\tfloat  timePassed       = 0.f;");
-	tall("\tfloat4 sunCol           = float4(%.3ff, %.3ff, %.3ff, 1.0);", skyData.sunCol.x, skyData.sunCol.y, skyData.sunCol.z);
-	tall("\tfloat4 moonCol          = float4(%.3ff, %.3ff, %.3ff, 1.0);", skyData.moonCol.x, skyData.moonCol.y, skyData.moonCol.z);
-	tall("\tfloat4 dayBottomCol     = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.dayBottomCol.x, skyData.dayBottomCol.y, skyData.dayBottomCol.z);
-	tall("\tfloat4 dayTopCol        = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.dayTopCol.x, skyData.dayTopCol.y, skyData.dayTopCol.z);
-	tall("\tfloat4 nightBottomCol   = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.nightBottomCol.x, skyData.nightBottomCol.y, skyData.nightBottomCol.z);
-	tall("\tfloat4 nightTopCol      = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.nightTopCol.x, skyData.nightTopCol.y, skyData.nightTopCol.z);
-	tall("\tfloat4 sunsetCol        = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.sunsetCol.x, skyData.sunsetCol.y, skyData.sunsetCol.z);
-	tall("\tfloat  radius           = %.3ff;", skyData.radius);
-	tall("\tfloat  moonOffset       = %.3ff;", skyData.moonOffset);
-	tall("\tfloat  horizonIntensity = %.3ff;", skyData.horizonIntensity);
-	tall("\tfloat  starsExponent    = %.3ff;", skyData.starsExponent);
-	tall("};");
+	tall("SkyData::SkyData() {");
+	tall("\tlightDir         = float3(0.f, 0.f, 0.f);");
+	tall("\tskyPadding       = 0.f;");
+	tall("\tsunCol           = float4(%.3ff, %.3ff, %.3ff, 1.0);", skyData.sunCol.x, skyData.sunCol.y, skyData.sunCol.z);
+	tall("\tmoonCol          = float4(%.3ff, %.3ff, %.3ff, 1.0);", skyData.moonCol.x, skyData.moonCol.y, skyData.moonCol.z);
+	tall("\tdayBottomCol     = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.dayBottomCol.x, skyData.dayBottomCol.y, skyData.dayBottomCol.z);
+	tall("\tdayTopCol        = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.dayTopCol.x, skyData.dayTopCol.y, skyData.dayTopCol.z);
+	tall("\tnightBottomCol   = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.nightBottomCol.x, skyData.nightBottomCol.y, skyData.nightBottomCol.z);
+	tall("\tnightTopCol      = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.nightTopCol.x, skyData.nightTopCol.y, skyData.nightTopCol.z);
+	tall("\tsunsetCol        = float4(%.3ff, %.3ff, %.3ff, 1.f);", skyData.sunsetCol.x, skyData.sunsetCol.y, skyData.sunsetCol.z);
+	tall("\tradius           = %.3ff;", skyData.radius);
+	tall("\tmoonOffset       = %.3ff;", skyData.moonOffset);
+	tall("\thorizonIntensity = %.3ff;", skyData.horizonIntensity);
+	tall("\tstarsExponent    = %.3ff;", skyData.starsExponent);
+	tall("}");
 }
@@ -19,7 +19,7 @@ public:
 	~Sky();
 
 	void update(float dt);
-	void render(D3D *renderer, FPCamera *camera);
+	void render(D3D *renderer, const mat4 &view, const float3 &cameraPos);
 	void gui(bool &open);
 
 private:
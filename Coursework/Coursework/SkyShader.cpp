@@ -2,6 +2,22 @@
 
 #include "utility.h"
 
+SkyData::SkyData() {
+	lightDir         = float3(0.f, 0.f, 0.f);
+	skyPadding       = 0.f;
+	sunCol           = float4(1.000f, 0.529f, 0.000f, 1.0);
+	moonCol          = float4(1.000f, 0.862f, 0.529f, 1.0);
+	dayBottomCol     = float4(0.230f, 0.730f, 0.580f, 1.f);
+	dayTopCol        = float4(0.510f, 0.620f, 1.000f, 1.f);
+	nightBottomCol   = float4(0.043f, 0.043f, 0.200f, 1.f);
+	nightTopCol      = float4(0.086f, 0.004f, 0.004f, 1.f);
+	sunsetCol        = float4(0.775f, 0.159f, 0.000f, 1.f);
+	radius           = 0.200f;
+	moonOffset       = 0.141f;
+	horizonIntensity = 2.456f;
+	starsExponent    = 11.555f;
+}
+
 SkyShader::SkyShader(Device *device, HWND hwnd) 
 	: DefaultShader(device, hwnd) {
 	initShader(L"shaders/sky_vs.cso", L"shaders/sky_ps.cso");
@@ -44,13 +60,13 @@ void SkyShader::setShaderParameters(
 
 	// == SKY BUFFER =============================
 
-	auto skyPtr = mapBuffer<SkyData>(ctx, skyBuffer);
+	auto skyPtr = mapBuffer<SkyBufferType>(ctx, skyBuffer);
 	*skyPtr = skyData;
 	unmapBufferPS(ctx, skyBuffer, 0);
 
 	// Set shader texture resource in the pixel shader.
-	ctx->PSSetShaderResources(0, 1, &texture);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 
 }
 
@@ -59,7 +75,7 @@ void SkyShader::initShader(const wchar_t *vs, const wchar_t *ps) {
 	loadPixelShader(ps);
 
 	addDynamicBuffer<MatrixBufferType>(&matrixBuffer);
-	addDynamicBuffer<DefaultBufferType>(&defaultBuffer);
-	addDynamicBuffer<SkyData>(&skyBuffer);
+	addDynamicBuffer<DefaultBufferType>(&defaultBuffer, ConstantUsage::Frame);
+	addDynamicBuffer<SkyBufferType>(&skyBuffer, ConstantUsage::Frame);
 	addDiffuseSampler();
 }
@@ -2,20 +2,12 @@
 
 #include "DefaultShader.h"
 
-struct SkyData {
-	float3 lightDir         = float3(0.f, 0.f, 0.f);
-	float  padding          = 0.f;
-	float4 sunCol           = float4(1.000f, 0.529f, 0.000f, 1.0);
-	float4 moonCol          = float4(1.000f, 0.862f, 0.529f, 1.0);
-	float4 dayBottomCol     = float4(0.230f, 0.730f, 0.580f, 1.f);
-	float4 dayTopCol        = float4(0.510f, 0.620f, 1.000f, 1.f);
-	float4 nightBottomCol   = float4(0.043f, 0.043f, 0.200f, 1.f);
-	float4 nightTopCol      = float4(0.086f, 0.004f, 0.004f, 1.f);
-	float4 sunsetCol        = float4(0.775f, 0.159f, 0.000f, 1.f);
-	float  radius           = 0.200f;
-	float  moonOffset       = 0.141f;
-	float  horizonIntensity = 2.456f;
-	float  starsExponent    = 11.555f;
+// The fields are in cbuffers.hlsli
+CBUFFER(SkyBuffer, b0, SKY_BUFFER)
+
+// The sky buffer with the default colours, it's uploaded as it is
+struct SkyData : SkyBufferType {
+	SkyData();
 };
 
 /* Render a sky in the skybox, everthing apart from what is in
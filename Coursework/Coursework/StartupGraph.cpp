@@ -0,0 +1,147 @@
+#include "StartupGraph.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "JobSystem.h"
+#include "tracelog.h"
+
+StartupGraph::TaskId StartupGraph::add(const char *name, Affinity affinity, Function function) {
+	Task task;
+	task.name = name;
+	task.affinity = affinity;
+	task.function = std::move(function);
+	tasks.push_back(std::move(task));
+	return (TaskId)tasks.size() - 1;
+}
+
+void StartupGraph::dependsOn(TaskId task, TaskId dependency) {
+	tasks[dependency].dependents.push_back(task);
+	tasks[task].dependencies++;
+}
+
+void StartupGraph::clear() {
+	tasks.clear();
+	timings.clear();
+	stats = Stats();
+}
+
+bool StartupGraph::execute(JobSystem *jobs) {
+	using namespace std::chrono;
+
+	std::vector<TaskId> order = sortTasks();
+	if (order.empty() && !tasks.empty()) {
+		err("Start-up graph has a cycle, nothing was run");
+		return false;
+	}
+
+	timings.clear();
+	timings.resize(tasks.size());
+	stats = Stats();
+	stats.tasks = (u32)tasks.size();
+
+	auto start = high_resolution_clock::now();
+	auto since = [start]() {
+		return duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+	};
+
+	auto runTask = [this, jobs, &since](TaskId id) {
+		Timing &timing = timings[id];
+		timing.name = tasks[id].name;
+		timing.affinity = tasks[id].affinity;
+		timing.onMain = !jobs || jobs->isMainThread();
+		timing.startMs = since();
+		if (tasks[id].function) tasks[id].function();
+		timing.endMs = since();
+	};
+
+	if (!jobs) {
+		for (TaskId id : order) {
+			runTask(id);
+		}
+	}
+	else {
+		// a task is scheduled by the last of its dependencies to finish
+		std::unique_ptr<std::atomic<u32>[]> remaining(new std::atomic<u32>[tasks.size()]);
+		for (TaskId id = 0; id < (TaskId)tasks.size(); ++id) {
+			remaining[id].store(tasks[id].dependencies);
+		}
+
+		JobCounter counter;
+		std::function<void(TaskId)> schedule = [&](TaskId id) {
+			auto job = [&, id]() {
+				runTask(id);
+				// before this job ends, so the counter can't reach zero in between
+				for (TaskId dependent : tasks[id].dependents) {
+					if (--remaining[dependent] == 0) schedule(dependent);
+				}
+			};
+
+			if (tasks[id].affinity == Affinity::Main) jobs->runOnMain(job, &counter);
+			else                                      jobs->run(job, &counter);
+		};
+
+		for (TaskId id : order) {
+			if (tasks[id].dependencies == 0) schedule(id);
+		}
+
+		// the main thread runs its tasks while it waits
+		jobs->wait(&counter);
+	}
+
+	stats.totalMs = since();
+	for (const Timing &timing : timings) {
+		stats.taskMs += timing.endMs - timing.startMs;
+	}
+
+	return true;
+}
+
+std::string StartupGraph::dump() const {
+	std::vector<const Timing *> sorted;
+	for (const Timing &timing : timings) {
+		sorted.push_back(&timing);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Timing *a, const Timing *b) {
+		return a->startMs < b->startMs;
+	});
+
+	std::string out;
+	char line[256];
+	for (const Timing *timing : sorted) {
+		snprintf(
+			line, sizeof(line), "%8.2f - %8.2fms %-6s %s\n",
+			timing->startMs, timing->endMs, timing->onMain ? "main" : "worker", timing->name.c_str()
+		);
+		out += line;
+	}
+
+	return out;
+}
+
+// -- Private ----------------------------------------------------------------------------------------------
+
+std::vector<StartupGraph::TaskId> StartupGraph::sortTasks() const {
+	std::vector<u32> remaining(tasks.size());
+	std::vector<TaskId> order;
+	order.reserve(tasks.size());
+
+	for (TaskId id = 0; id < (TaskId)tasks.size(); ++id) {
+		remaining[id] = tasks[id].dependencies;
+		if (remaining[id] == 0) order.push_back(id);
+	}
+
+	// order grows while it's walked, a task is added once all its dependencies are in it
+	for (size_t i = 0; i < order.size(); ++i) {
+		for (TaskId dependent : tasks[order[i]].dependents) {
+			if (--remaining[dependent] == 0) order.push_back(dependent);
+		}
+	}
+
+	// the tasks of a cycle never get there
+	if (order.size() != tasks.size()) order.clear();
+	return order;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "types.h"
+
+class JobSystem;
+
+/* Runs the steps of the application start-up as a dependency graph.
+ * Every task says which tasks it needs and where it can run: Any tasks
+ * (file reads, decoding, importing, building meshes on the cpu) run on the
+ * workers as soon as their dependencies are done, Main tasks (everything
+ * that creates device objects or uses the immediate context) run on the
+ * main thread while it waits for the graph, in the order they become ready.
+ * Every task is timed, the timings are kept after execute().
+ * Without a job system the tasks run one after the other on the calling
+ * thread, always in the same order.
+ */
+class StartupGraph {
+public:
+	using Function = std::function<void()>;
+	using TaskId = u32;
+
+	enum class Affinity {
+		Any,
+		Main,
+	};
+
+	struct Timing {
+		std::string name;
+		Affinity affinity = Affinity::Any;
+		f64 startMs = 0.0; // from the start of execute()
+		f64 endMs = 0.0;
+		bool onMain = false;
+	};
+
+	struct Stats {
+		u32 tasks = 0;
+		f64 totalMs = 0.0;
+		f64 taskMs = 0.0; // sum of the tasks, what a serial start-up would take
+	};
+
+	TaskId add(const char *name, Affinity affinity, Function function);
+	void dependsOn(TaskId task, TaskId dependency);
+	void clear();
+
+	// Returns false (without running anything) if the dependencies have a cycle,
+	// must be called on the main thread of jobs
+	bool execute(JobSystem *jobs);
+
+	const std::vector<Timing> &getTimings() const { return timings; }
+	const Stats &getStats() const { return stats; }
+	// One line for every task, by start time
+	std::string dump() const;
+
+private:
+	struct Task {
+		std::string name;
+		Affinity affinity = Affinity::Any;
+		Function function;
+		std::vector<TaskId> dependents;
+		u32 dependencies = 0;
+	};
+
+	// Topological order, empty if there is a cycle
+	std::vector<TaskId> sortTasks() const;
+
+	std::vector<Task> tasks;
+	std::vector<Timing> timings;
+	Stats stats;
+};
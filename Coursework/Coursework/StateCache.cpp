@@ -0,0 +1,246 @@
+#include "StateCache.h"
+
+thread_local StateCache stateCache;
+
+// == SLOT CACHE =================================================================================================================
+
+template<typename T, u32 N>
+bool StateCache::SlotCache<T, N>::update(u32 start, u32 count, T *const *values, u32 &first, u32 &last) {
+	bool changed = false;
+
+	for (u32 i = 0; i < count; ++i) {
+		u32 slot = start + i;
+		u32 bit = 1u << slot;
+
+		if ((known & bit) && slots[slot] == values[i]) continue;
+
+		if (!changed) first = slot;
+		last = slot;
+		changed = true;
+
+		slots[slot] = values[i];
+		known |= bit;
+	}
+
+	return changed;
+}
+
+template<typename T>
+bool StateCache::Cached<T>::update(const T &newValue) {
+	if (known && value == newValue) return false;
+	value = newValue;
+	known = true;
+	return true;
+}
+
+// == STATE CACHE =================================================================================================================
+
+StateCache::StateCache() {
+	setBackend(nullptr);
+}
+
+void StateCache::setBackend(RenderBackend *newBackend) {
+	backend = newBackend ? newBackend : &nullBackend;
+	invalidate();
+}
+
+void StateCache::invalidate() {
+	layout.known = false;
+	topology.known = false;
+	knownVertexBuffers = 0;
+	indexBuffer.known = false;
+	indexFormat.known = false;
+	indexOffset.known = false;
+
+	for (u32 stage = 0; stage < (u32)ShaderStage::Count; ++stage) {
+		shaders[stage].known = false;
+		constantBuffers[stage].known = 0;
+		shaderResources[stage].known = 0;
+		samplers[stage].known = 0;
+	}
+}
+
+void StateCache::beginFrame() {
+	lastFrame = counters;
+	counters = Counters();
+}
+
+void StateCache::setInputLayout(ID3D11InputLayout *newLayout) {
+	if (!layout.update(newLayout)) return elided();
+	backend->setInputLayout(newLayout);
+	issued();
+}
+
+void StateCache::setTopology(u32 newTopology) {
+	if (!topology.update(newTopology)) return elided();
+	backend->setTopology(newTopology);
+	issued();
+}
+
+void StateCache::setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets) {
+	if (start + count > MAX_VERTEX_BUFFERS) {
+		backend->setVertexBuffers(start, count, buffers, strides, offsets);
+		return issued();
+	}
+
+	u32 first = 0, last = 0;
+	bool changed = false;
+
+	for (u32 i = 0; i < count; ++i) {
+		u32 slot = start + i;
+		u32 bit = 1u << slot;
+
+		if ((knownVertexBuffers & bit) &&
+			vertexBuffers[slot] == buffers[i] &&
+			vertexStrides[slot] == strides[i] &&
+			vertexOffsets[slot] == offsets[i]
+		) {
+			continue;
+		}
+
+		if (!changed) first = slot;
+		last = slot;
+		changed = true;
+
+		vertexBuffers[slot] = buffers[i];
+		vertexStrides[slot] = strides[i];
+		vertexOffsets[slot] = offsets[i];
+		knownVertexBuffers |= bit;
+	}
+
+	if (!changed) return elided();
+
+	u32 offset = first - start;
+	backend->setVertexBuffers(first, last - first + 1, buffers + offset, strides + offset, offsets + offset);
+	issued();
+}
+
+void StateCache::setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset) {
+	// not short circuited, all of them have to be updated
+	bool changed = indexBuffer.update(buffer) | indexFormat.update(format) | indexOffset.update(offset);
+	if (!changed) return elided();
+	backend->setIndexBuffer(buffer, format, offset);
+	issued();
+}
+
+void StateCache::setVertexShader(ID3D11VertexShader *shader) {
+	if (!shaders[(u32)ShaderStage::Vertex].update(shader)) return elided();
+	backend->setVertexShader(shader);
+	issued();
+}
+
+void StateCache::setHullShader(ID3D11HullShader *shader) {
+	if (!shaders[(u32)ShaderStage::Hull].update(shader)) return elided();
+	backend->setHullShader(shader);
+	issued();
+}
+
+void StateCache::setDomainShader(ID3D11DomainShader *shader) {
+	if (!shaders[(u32)ShaderStage::Domain].update(shader)) return elided();
+	backend->setDomainShader(shader);
+	issued();
+}
+
+void StateCache::setGeometryShader(ID3D11GeometryShader *shader) {
+	if (!shaders[(u32)ShaderStage::Geometry].update(shader)) return elided();
+	backend->setGeometryShader(shader);
+	issued();
+}
+
+void StateCache::setPixelShader(ID3D11PixelShader *shader) {
+	if (!shaders[(u32)ShaderStage::Pixel].update(shader)) return elided();
+	backend->setPixelShader(shader);
+	issued();
+}
+
+void StateCache::setComputeShader(ID3D11ComputeShader *shader) {
+	if (!shaders[(u32)ShaderStage::Compute].update(shader)) return elided();
+	backend->setComputeShader(shader);
+	issued();
+}
+
+void StateCache::setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers) {
+	u32 first = 0, last = 0;
+
+	if (start + count > MAX_CONSTANT_BUFFERS) {
+		backend->setConstantBuffers(stage, start, count, buffers);
+		return issued();
+	}
+
+	// slots bound to a range have to be issued again, even with the same buffer
+	SlotCache<ID3D11Buffer, MAX_CONSTANT_BUFFERS> &cache = constantBuffers[(u32)stage];
+	for (u32 slot = start; slot < start + count; ++slot) {
+		if (constantRanges[(u32)stage][slot]) {
+			cache.known &= ~(1u << slot);
+			constantRanges[(u32)stage][slot] = 0;
+		}
+	}
+
+	if (!cache.update(start, count, buffers, first, last)) return elided();
+	backend->setConstantBuffers(stage, first, last - first + 1, buffers + (first - start));
+	issued();
+}
+
+void StateCache::setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants) {
+	if (slot >= MAX_CONSTANT_BUFFERS) {
+		backend->setConstantBufferRange(stage, slot, buffer, firstConstant, numConstants);
+		return issued();
+	}
+
+	SlotCache<ID3D11Buffer, MAX_CONSTANT_BUFFERS> &cache = constantBuffers[(u32)stage];
+	u64 range = ((u64)firstConstant << 32) | numConstants;
+	u32 bit = 1u << slot;
+
+	if ((cache.known & bit) && cache.slots[slot] == buffer && constantRanges[(u32)stage][slot] == range) {
+		return elided();
+	}
+
+	cache.slots[slot] = buffer;
+	cache.known |= bit;
+	constantRanges[(u32)stage][slot] = range;
+
+	backend->setConstantBufferRange(stage, slot, buffer, firstConstant, numConstants);
+	issued();
+}
+
+void StateCache::setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views) {
+	u32 first = 0, last = 0;
+
+	if (start + count > MAX_SHADER_RESOURCES) {
+		backend->setShaderResources(stage, start, count, views);
+		return issued();
+	}
+
+	if (!shaderResources[(u32)stage].update(start, count, views, first, last)) return elided();
+	backend->setShaderResources(stage, first, last - first + 1, views + (first - start));
+	issued();
+}
+
+void StateCache::setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *newSamplers) {
+	u32 first = 0, last = 0;
+
+	if (start + count > MAX_SAMPLERS) {
+		backend->setSamplers(stage, start, count, newSamplers);
+		return issued();
+	}
+
+	if (!samplers[(u32)stage].update(start, count, newSamplers, first, last)) return elided();
+	backend->setSamplers(stage, first, last - first + 1, newSamplers + (first - start));
+	issued();
+}
+
+void StateCache::unbindShaderResources() {
+	ID3D11ShaderResourceView *nullViews[MAX_SHADER_RESOURCES] = {};
+
+	for (u32 stage = 0; stage < (u32)ShaderStage::Count; ++stage) {
+		// the slots that are bound to something, or that we don't know about
+		u32 first = 0, last = 0;
+		if (!shaderResources[stage].update(0, MAX_SHADER_RESOURCES, nullViews, first, last)) {
+			elided();
+			continue;
+		}
+
+		backend->setShaderResources((ShaderStage)stage, first, last - first + 1, nullViews);
+		issued();
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "RenderBackend.h"
+
+/* Remembers the pipeline state that was bound through it, and only
+ * forwards the calls that change something to the backend.
+ * Slot ranges are compared one slot at a time, when only some slots
+ * differ the smallest range that covers them is issued.
+ * The cache only knows about the calls that go through it: code that
+ * changes the state directly on the context must call invalidate()
+ * afterwards.
+ * Shader resources are not unbound after every draw, instead
+ * unbindShaderResources() is called before a texture is bound as a render
+ * target, this also keeps the cache in sync with d3d (which would unbind
+ * them on its own).
+ */
+class StateCache {
+public:
+	static constexpr u32 MAX_VERTEX_BUFFERS   = 4;
+	static constexpr u32 MAX_CONSTANT_BUFFERS = 8;
+	static constexpr u32 MAX_SHADER_RESOURCES = 16;
+	static constexpr u32 MAX_SAMPLERS         = 8;
+
+	struct Counters {
+		u32 issued = 0;
+		u32 elided = 0;
+	};
+
+	StateCache();
+
+	// The cache is invalidated, nullptr sets a backend that drops every call
+	void setBackend(RenderBackend *newBackend);
+	RenderBackend *getBackend() { return backend; }
+
+	// Forgets everything, the next call of every kind is issued
+	void invalidate();
+	// Saves the counters of the frame that just ended and resets them
+	void beginFrame();
+
+	void setInputLayout(ID3D11InputLayout *layout);
+	void setTopology(u32 topology);
+	void setVertexBuffers(u32 start, u32 count, ID3D11Buffer *const *buffers, const u32 *strides, const u32 *offsets);
+	void setIndexBuffer(ID3D11Buffer *buffer, u32 format, u32 offset);
+
+	void setVertexShader(ID3D11VertexShader *shader);
+	void setHullShader(ID3D11HullShader *shader);
+	void setDomainShader(ID3D11DomainShader *shader);
+	void setGeometryShader(ID3D11GeometryShader *shader);
+	void setPixelShader(ID3D11PixelShader *shader);
+	void setComputeShader(ID3D11ComputeShader *shader);
+
+	// Ranges past the MAX_* slots are always issued and not cached
+	void setConstantBuffers(ShaderStage stage, u32 start, u32 count, ID3D11Buffer *const *buffers);
+	void setShaderResources(ShaderStage stage, u32 start, u32 count, ID3D11ShaderResourceView *const *views);
+	void setSamplers(ShaderStage stage, u32 start, u32 count, ID3D11SamplerState *const *samplers);
+	// The range is part of the cached state, setConstantBuffers() binds the whole buffer
+	void setConstantBufferRange(ShaderStage stage, u32 slot, ID3D11Buffer *buffer, u32 firstConstant, u32 numConstants);
+
+	// Unbinds the shader resources of every stage, must be called before
+	// binding a texture as a render target or depth buffer
+	void unbindShaderResources();
+
+	const Counters &getCounters() const { return counters; }
+	const Counters &getLastFrame() const { return lastFrame; }
+
+private:
+	// Slots of one kind for one stage, known is a bitmask of the slots that
+	// have been set since the last invalidate
+	template<typename T, u32 N>
+	struct SlotCache {
+		T *slots[N] = {};
+		u32 known = 0;
+
+		// Writes the smallest range that changes in first/last, returns false if nothing changes
+		bool update(u32 start, u32 count, T *const *values, u32 &first, u32 &last);
+	};
+
+	// Cached single value
+	template<typename T>
+	struct Cached {
+		T value = {};
+		bool known = false;
+
+		bool update(const T &newValue);
+	};
+
+	void issued() { counters.issued++; }
+	void elided() { counters.elided++; }
+
+	RenderBackend *backend = nullptr;
+	RecordingBackend nullBackend { false };
+
+	Cached<ID3D11InputLayout *> layout;
+	Cached<u32> topology;
+	ID3D11Buffer *vertexBuffers[MAX_VERTEX_BUFFERS] = {};
+	u32 vertexStrides[MAX_VERTEX_BUFFERS] = {};
+	u32 vertexOffsets[MAX_VERTEX_BUFFERS] = {};
+	u32 knownVertexBuffers = 0;
+	Cached<ID3D11Buffer *> indexBuffer;
+	Cached<u32> indexFormat;
+	Cached<u32> indexOffset;
+
+	Cached<const void *> shaders[(u32)ShaderStage::Count];
+	SlotCache<ID3D11Buffer, MAX_CONSTANT_BUFFERS> constantBuffers[(u32)ShaderStage::Count];
+	// first constant in the high bits, number of constants in the low ones, 0 is the whole buffer
+	u64 constantRanges[(u32)ShaderStage::Count][MAX_CONSTANT_BUFFERS] = {};
+	SlotCache<ID3D11ShaderResourceView, MAX_SHADER_RESOURCES> shaderResources[(u32)ShaderStage::Count];
+	SlotCache<ID3D11SamplerState, MAX_SAMPLERS> samplers[(u32)ShaderStage::Count];
+
+	Counters counters;
+	Counters lastFrame;
+};
+
+// Used by every shader, App1 binds it to the device context.
+// Every thread has its own, CommandRecorder binds the ones of its workers
+// to the command lists they record
+extern thread_local StateCache stateCache;
@@ -0,0 +1,420 @@
+#include "Terrain.h"
+
+#include <stdio.h>
+#include <float.h>
+
+#include "utility.h"
+#include "tracelog.h"
+#include "MathUtils.h"
+
+static bool loadTileFromDisk(u32 x, u32 z, u32 resolution, std::vector<u16> &heights);
+
+// == TERRAIN PATCH MESH =================================================================================================================
+
+void TerrainPatchMesh::init(Device *device, int gridDim) {
+	std::vector<VertexType> vertices;
+	std::vector<ulong> indices;
+
+	vertexCount = (gridDim + 1) * (gridDim + 1);
+	indexCount = gridDim * gridDim * 6;
+
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	f32 step = 1.f / gridDim;
+
+	for (int z = 0; z <= gridDim; ++z) {
+		for (int x = 0; x <= gridDim; ++x) {
+			vertices.emplace_back(
+				float3(x * step, 0.f, z * step),
+				float2(x * step, z * step),
+				float3(0.f, 1.f, 0.f)
+			);
+		}
+	}
+
+	// same winding as the GroundMesh
+	for (int z = 0; z < gridDim; ++z) {
+		for (int x = 0; x < gridDim; ++x) {
+			ulong topLeft     = z * (gridDim + 1) + x;
+			ulong topRight    = topLeft + 1;
+			ulong bottomLeft  = topLeft + (gridDim + 1);
+			ulong bottomRight = bottomLeft + 1;
+
+			indices.push_back(topLeft);
+			indices.push_back(bottomRight);
+			indices.push_back(bottomLeft);
+
+			indices.push_back(topLeft);
+			indices.push_back(topRight);
+			indices.push_back(bottomRight);
+		}
+	}
+
+	D3D11_BUFFER_DESC vbufDesc{}, ibufDesc{};
+	D3D11_SUBRESOURCE_DATA vData{}, iData{};
+
+	// Set up the description of the static vertex buffer
+	vbufDesc.Usage = D3D11_USAGE_DEFAULT;
+	vbufDesc.ByteWidth = uint(sizeof(VertexType) * vertices.size());
+	vbufDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vData.pSysMem = vertices.data();
+	device->CreateBuffer(&vbufDesc, &vData, &vertexBuffer);
+
+	// Set up the description of the static index buffer
+	ibufDesc.Usage = D3D11_USAGE_DEFAULT;
+	ibufDesc.ByteWidth = uint(sizeof(ulong) * indices.size());
+	ibufDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	iData.pSysMem = indices.data();
+	device->CreateBuffer(&ibufDesc, &iData, &indexBuffer);
+}
+
+// == TERRAIN SHADER =====================================================================================================================
+
+TerrainShader::TerrainShader(Device *device, HWND hwnd)
+	: InstanceShader(device, hwnd) {
+	initShader(L"shaders/terrain_vs.cso", L"shaders/terrain_vs_depth.cso");
+}
+
+TerrainShader::~TerrainShader() {
+	RELEASE_IF_NOT_NULL(terrainBuffer);
+	RELEASE_IF_NOT_NULL(heightSampler);
+}
+
+void TerrainShader::setShaderParameters(
+	DeviceContext *ctx,
+	const mat4 &world,
+	const mat4 &view,
+	const mat4 &proj,
+	TextureType *texture,
+	float3 cameraPos,
+	float timePassed,
+	Light lights[LIGHTS_COUNT],
+	ShadowMap *spotShadow,
+	OmniShadowMap &pointShadow,
+	const TerrainQuadtree &quadtree,
+	const TerrainStreamer &streamer,
+	f32 heightScale,
+	int gridDim,
+	TextureType *heightTiles,
+	TextureType *tileSlots
+) {
+	DefaultShader::setShaderParameters(
+		ctx, world, view, proj,
+		texture, {},
+		cameraPos, timePassed,
+		lights, spotShadow, pointShadow
+	);
+
+	// == TERRAIN BUFFER ========================
+
+	const TerrainStreamer::Desc &streamDesc = streamer.getDesc();
+
+	auto terrainPtr = mapBuffer<TerrainBufferType>(ctx, terrainBuffer);
+	for (u32 i = 0; i < TerrainQuadtree::MAX_LODS; ++i) {
+		if (i < quadtree.getLodCount()) {
+			const TerrainMorphRange &range = quadtree.getMorphRange(i);
+			terrainPtr->morphRanges[i] = { range.start, range.end, 0.f, 0.f };
+		}
+		else {
+			terrainPtr->morphRanges[i] = { 0.f, 1.f, 0.f, 0.f };
+		}
+	}
+	terrainPtr->worldSize      = streamDesc.tilesPerSide * streamDesc.tileSize;
+	terrainPtr->tileSize       = streamDesc.tileSize;
+	terrainPtr->heightScale    = heightScale;
+	terrainPtr->gridDim        = (f32)gridDim;
+	terrainPtr->tilesPerSide   = streamDesc.tilesPerSide;
+	terrainPtr->tileResolution = (f32)streamDesc.tileResolution;
+	// same texture scale as the GroundMesh: one repeat every 200 units
+	terrainPtr->textureScale   = 200.f;
+	terrainPtr->padding        = 0.f;
+	unmapBufferVS(ctx, terrainBuffer, 3);
+
+	// == VERTEX SHADER RESOURCES ===============
+
+	stateCache.setShaderResources(ShaderStage::Vertex, 0, 1, &heightTiles);
+	stateCache.setShaderResources(ShaderStage::Vertex, 1, 1, &tileSlots);
+	stateCache.setSamplers(ShaderStage::Vertex, 0, 1, &heightSampler);
+}
+
+void TerrainShader::initShader(const wchar_t *vs, const wchar_t *dvs) {
+	loadVertexShader(vs);
+	loadDepthShader(dvs);
+	pixelShader = getDefaultPixelShader(this);
+
+	initDefaultBuffers();
+	addDynamicBuffer<TerrainBufferType>(&terrainBuffer, ConstantUsage::Frame);
+	addDiffuseSampler();
+	addShadowSampler();
+	addClampSampler(&heightSampler);
+}
+
+void TerrainShader::loadVertexShader(const wchar_t *vs) {
+	// Create the vertex input layout description.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "PATCH",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	DefaultShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
+}
+
+// == TERRAIN ============================================================================================================================
+
+void Terrain::init(Device *device, HWND hwnd) {
+	shader = new TerrainShader(device, hwnd);
+	mesh.init(device, gridDim);
+
+	TerrainQuadtree::Desc treeDesc;
+	treeDesc.maxHeight = heightScale;
+	quadtree.init(treeDesc);
+
+	TerrainStreamer::Desc streamDesc;
+	u32 resolution = streamDesc.tileResolution;
+	streamer.init(streamDesc, [resolution](u32 x, u32 z, std::vector<u16> &heights) {
+		return loadTileFromDisk(x, z, resolution, heights);
+	});
+
+	// -- Heightfield tiles -------------------------------------------------------------------------------------------------
+
+	D3D11_TEXTURE2D_DESC texDesc{};
+	texDesc.Width = streamDesc.tileResolution;
+	texDesc.Height = streamDesc.tileResolution;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = max(streamer.getSlotCount(), 1u);
+	texDesc.Format = DXGI_FORMAT_R16_UNORM;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&texDesc, nullptr, &heightTexture);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+	srvDesc.Format = texDesc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = texDesc.ArraySize;
+	device->CreateShaderResourceView(heightTexture, &srvDesc, &heightTiles);
+
+	// -- Tile -> slot indirection ------------------------------------------------------------------------------------------
+
+	const std::vector<u16> &slotTable = streamer.getSlotTable();
+
+	texDesc.Width = streamDesc.tilesPerSide;
+	texDesc.Height = streamDesc.tilesPerSide;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R16_UINT;
+
+	D3D11_SUBRESOURCE_DATA slotData{};
+	slotData.pSysMem = slotTable.data();
+	slotData.SysMemPitch = sizeof(u16) * streamDesc.tilesPerSide;
+	device->CreateTexture2D(&texDesc, &slotData, &slotTexture);
+
+	srvDesc.Format = texDesc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(slotTexture, &srvDesc, &tileSlots);
+
+	instances.reserve(1024);
+	occluderTiles.resize(streamer.getSlotCount());
+}
+
+Terrain::~Terrain() {
+	streamer.shutdown();
+	DELETE_IF_NOT_NULL(shader);
+	RELEASE_IF_NOT_NULL(heightTiles);
+	RELEASE_IF_NOT_NULL(heightTexture);
+	RELEASE_IF_NOT_NULL(tileSlots);
+	RELEASE_IF_NOT_NULL(slotTexture);
+}
+
+void Terrain::update(DeviceContext *ctx, const float3 &cameraPos) {
+	quadtree.select(cameraPos, patches);
+
+	instances.clear();
+	for (const TerrainPatch &patch : patches) {
+		instances.push_back({ float4(patch.origin.x, patch.origin.y, patch.size, (f32)patch.lod) });
+	}
+
+	streamer.update(cameraPos);
+	uploadTiles(ctx);
+}
+
+void Terrain::render(
+	DeviceContext *ctx,
+	const mat4 &world,
+	const mat4 &view,
+	const mat4 &proj,
+	const float3 &cameraPos,
+	f32 timePassed,
+	TextureType *texture,
+	Light lights[LIGHTS_COUNT],
+	ShadowMap *spotShadow,
+	OmniShadowMap &pointShadow
+) {
+	if (instances.empty()) return;
+
+	shader->setShaderParameters(
+		ctx, world, view, proj,
+		texture, cameraPos, timePassed,
+		lights, spotShadow, pointShadow,
+		quadtree, streamer,
+		heightScale, gridDim,
+		heightTiles, tileSlots
+	);
+
+	ID3D11Device *device = nullptr;
+	ctx->GetDevice(&device);
+	shader->renderInstance(device, ctx, mesh, instances.data(), (uint)instances.size());
+	RELEASE_IF_NOT_NULL(device);
+}
+
+void Terrain::gui() {
+	TerrainStreamer::Stats stats = streamer.getStats();
+	const TerrainStreamer::Desc &desc = streamer.getDesc();
+	f32 tileMB = (f32)desc.tileResolution * desc.tileResolution * sizeof(u16) / (1024.f * 1024.f);
+
+	ImGui::Text("Patches: %zu (lods: %u)", patches.size(), quadtree.getLodCount());
+	ImGui::Text("Resident tiles: %u/%u (%.1fMB)", stats.resident, streamer.getSlotCount(), stats.resident * tileMB);
+	ImGui::Text("Loaded: %u, missing: %u, evicted: %u, in flight: %u", stats.loaded, stats.missing, stats.evicted, stats.inFlight);
+}
+
+u32 Terrain::getVersion() const {
+	TerrainStreamer::Stats stats = streamer.getStats();
+	return stats.loaded + stats.evicted;
+}
+
+void Terrain::addOccluders(OcclusionCuller &culler, const float3 &cameraPos, f32 radius) {
+	const TerrainStreamer::Desc &desc = streamer.getDesc();
+	const f32 halfWorld = desc.tilesPerSide * desc.tileSize * 0.5f;
+	const f32 cellSize = desc.tileSize / OCCLUDER_CELLS;
+	const u32 side = OCCLUDER_CELLS + 1;
+
+	for (u16 slot = 0; slot < (u16)occluderTiles.size(); ++slot) {
+		const OccluderTile &tile = occluderTiles[slot];
+		// the slot could have been evicted
+		if (tile.heights.empty() || streamer.getSlot(tile.x, tile.z) != slot) continue;
+
+		f32 originX = tile.x * desc.tileSize - halfWorld;
+		f32 originZ = tile.z * desc.tileSize - halfWorld;
+
+		occluderVertices.clear();
+		occluderIndices.clear();
+
+		for (u32 z = 0; z < side; ++z) {
+			for (u32 x = 0; x < side; ++x) {
+				occluderVertices.emplace_back(originX + x * cellSize, tile.heights[z * side + x], originZ + z * cellSize);
+			}
+		}
+
+		for (u32 z = 0; z < OCCLUDER_CELLS; ++z) {
+			for (u32 x = 0; x < OCCLUDER_CELLS; ++x) {
+				f32 dx = originX + (x + 0.5f) * cellSize - cameraPos.x;
+				f32 dz = originZ + (z + 0.5f) * cellSize - cameraPos.z;
+				if (dx * dx + dz * dz > pow2(radius + cellSize)) continue;
+
+				u32 topLeft     = z * side + x;
+				u32 topRight    = topLeft + 1;
+				u32 bottomLeft  = topLeft + side;
+				u32 bottomRight = bottomLeft + 1;
+
+				occluderIndices.insert(occluderIndices.end(), {
+					topLeft, bottomRight, bottomLeft,
+					topLeft, topRight, bottomRight,
+				});
+			}
+		}
+
+		if (!occluderIndices.empty()) {
+			culler.addOccluder(occluderVertices.data(), (u32)occluderVertices.size(), occluderIndices.data(), (u32)occluderIndices.size());
+		}
+	}
+}
+
+void Terrain::buildOccluderTile(const TerrainTileData &tile) {
+	if (tile.slot >= occluderTiles.size()) return;
+
+	const u32 resolution = streamer.getDesc().tileResolution;
+	const f32 toHeight = heightScale / 65535.f;
+
+	// lowest sample of every cell (the cells share their border samples)
+	f32 cellMin[OCCLUDER_CELLS * OCCLUDER_CELLS];
+	for (u32 cz = 0; cz < OCCLUDER_CELLS; ++cz) {
+		for (u32 cx = 0; cx < OCCLUDER_CELLS; ++cx) {
+			u32 x0 = cx * (resolution - 1) / OCCLUDER_CELLS;
+			u32 x1 = (cx + 1) * (resolution - 1) / OCCLUDER_CELLS;
+			u32 z0 = cz * (resolution - 1) / OCCLUDER_CELLS;
+			u32 z1 = (cz + 1) * (resolution - 1) / OCCLUDER_CELLS;
+
+			u16 lowest = 0xFFFF;
+			for (u32 z = z0; z <= z1; ++z) {
+				for (u32 x = x0; x <= x1; ++x) {
+					lowest = min(lowest, tile.heights[z * resolution + x]);
+				}
+			}
+			cellMin[cz * OCCLUDER_CELLS + cx] = lowest * toHeight;
+		}
+	}
+
+	// every vertex is as low as the lowest cell around it, this way the
+	// interpolated grid never goes above the real surface
+	OccluderTile &occluder = occluderTiles[tile.slot];
+	occluder.x = tile.x;
+	occluder.z = tile.z;
+	occluder.heights.resize((OCCLUDER_CELLS + 1) * (OCCLUDER_CELLS + 1));
+
+	for (u32 z = 0; z <= OCCLUDER_CELLS; ++z) {
+		for (u32 x = 0; x <= OCCLUDER_CELLS; ++x) {
+			f32 lowest = FLT_MAX;
+			for (u32 cz = (z > 0 ? z - 1 : 0); cz <= min(z, OCCLUDER_CELLS - 1); ++cz) {
+				for (u32 cx = (x > 0 ? x - 1 : 0); cx <= min(x, OCCLUDER_CELLS - 1); ++cx) {
+					lowest = min(lowest, cellMin[cz * OCCLUDER_CELLS + cx]);
+				}
+			}
+			occluder.heights[z * (OCCLUDER_CELLS + 1) + x] = lowest;
+		}
+	}
+}
+
+void Terrain::uploadTiles(DeviceContext *ctx) {
+	loadedTiles.clear();
+	streamer.collectLoaded(loadedTiles);
+
+	if (loadedTiles.empty()) return;
+
+	RenderBackend *backend = stateCache.getBackend();
+	u32 resolution = streamer.getDesc().tileResolution;
+	u32 tilesPerSide = streamer.getDesc().tilesPerSide;
+
+	for (const TerrainTileData &tile : loadedTiles) {
+		UINT subresource = D3D11CalcSubresource(0, tile.slot, 1);
+		backend->updateTexture(heightTexture, subresource, tile.heights.data(), sizeof(u16) * resolution, resolution);
+		buildOccluderTile(tile);
+	}
+
+	// tiles could also have been evicted, upload the whole table
+	const std::vector<u16> &slotTable = streamer.getSlotTable();
+	backend->updateTexture(slotTexture, 0, slotTable.data(), sizeof(u16) * tilesPerSide, tilesPerSide);
+}
+
+static bool loadTileFromDisk(u32 x, u32 z, u32 resolution, std::vector<u16> &heights) {
+	char filename[64];
+	snprintf(filename, sizeof(filename), "res/terrain/tile_%u_%u.r16", x, z);
+
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) return false;
+
+	size_t count = (size_t)resolution * resolution;
+	heights.resize(count);
+	size_t read = fread(heights.data(), sizeof(u16), count, fp);
+	fclose(fp);
+
+	if (read != count) {
+		err("Terrain tile %s is too small: %zu/%zu", filename, read, count);
+		return false;
+	}
+
+	return true;
+}
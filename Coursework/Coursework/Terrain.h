@@ -0,0 +1,110 @@
+#pragma once
+
+#include "InstanceShader.h"
+#include "TerrainQuadtree.h"
+#include "TerrainStreamer.h"
+#include "OcclusionCuller.h"
+
+// Grid in the [0, 1] range on the xz plane, every terrain patch uses it
+class TerrainPatchMesh : public MMesh {
+public:
+	void init(Device *device, int gridDim);
+};
+
+struct TerrainInstanceType {
+	float4 patch; // xy: origin, z: size, w: lod
+};
+
+/* Renders the terrain patches selected by the quadtree in a single
+ * instanced draw call.
+ * The height is read in the vertex shader from a texture array of
+ * streamed heightfield tiles, a small indirection texture tells which
+ * slot of the array contains which tile (or if it isn't loaded, in which
+ * case the terrain is flat).
+ * Vertices close to the end of their lod range are morphed to match the
+ * next lod, this way there are no seams between the patches.
+ */
+class TerrainShader : public InstanceShader {
+	struct TerrainBufferType {
+		float4 morphRanges[TerrainQuadtree::MAX_LODS];
+		float worldSize;
+		float tileSize;
+		float heightScale;
+		float gridDim;
+		uint tilesPerSide;
+		float tileResolution;
+		float textureScale;
+		float padding = 0.f;
+	};
+
+public:
+	TerrainShader(Device *device, HWND hwnd);
+	~TerrainShader();
+
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &projection, TextureType *texture, float3 cameraPos, float timePassed, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow, const TerrainQuadtree &quadtree, const TerrainStreamer &streamer, f32 heightScale, int gridDim, TextureType *heightTiles, TextureType *tileSlots);
+
+private:
+	void initShader(const wchar_t *vs, const wchar_t *dvs);
+	void loadVertexShader(const wchar_t *vs);
+
+	ID3D11Buffer *terrainBuffer = nullptr;
+	ID3D11SamplerState *heightSampler = nullptr;
+};
+
+/* Large streamed terrain using a CDLOD quadtree.
+ * Every frame the quadtree selects the patches around the camera and
+ * the streamer loads the heightfield tiles close to it from
+ * res/terrain/tile_<x>_<z>.r16 (raw 16 bit heights, tileResolution^2).
+ * Memory usage is fixed: the tiles texture array has as many slots as
+ * the memory budget allows, and all the patches share the same mesh.
+ * Every resident tile also keeps a coarse grid of its heights on the cpu,
+ * each vertex takes the lowest height around it so the grid always stays
+ * below the real surface and can be used as an occluder.
+ */
+class Terrain {
+public:
+	void init(Device *device, HWND hwnd);
+	~Terrain();
+
+	void update(DeviceContext *ctx, const float3 &cameraPos);
+	void render(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &proj, const float3 &cameraPos, f32 timePassed, TextureType *texture, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow);
+	void gui();
+	// Changes every time a tile is loaded or evicted, the only time the shape of the terrain changes
+	u32 getVersion() const;
+	// Adds the coarse grid of the resident tiles closer than radius
+	void addOccluders(OcclusionCuller &culler, const float3 &cameraPos, f32 radius);
+
+	TerrainShader *getShader() { return shader; }
+
+private:
+	static constexpr u32 OCCLUDER_CELLS = 16; // per tile side
+
+	struct OccluderTile {
+		u32 x = 0, z = 0;
+		std::vector<f32> heights; // (OCCLUDER_CELLS + 1)^2, empty if the slot was never used
+	};
+
+	void uploadTiles(DeviceContext *ctx);
+	void buildOccluderTile(const TerrainTileData &tile);
+
+	TerrainShader *shader = nullptr;
+	TerrainPatchMesh mesh;
+	TerrainQuadtree quadtree;
+	TerrainStreamer streamer;
+
+	std::vector<TerrainPatch> patches;
+	std::vector<TerrainInstanceType> instances;
+	std::vector<TerrainTileData> loadedTiles;
+	// one for every slot
+	std::vector<OccluderTile> occluderTiles;
+	std::vector<vec3f> occluderVertices;
+	std::vector<u32> occluderIndices;
+
+	ID3D11Texture2D *heightTexture = nullptr;
+	TextureType *heightTiles = nullptr;
+	ID3D11Texture2D *slotTexture = nullptr;
+	TextureType *tileSlots = nullptr;
+
+	int gridDim = 16;
+	f32 heightScale = 100.f;
+};
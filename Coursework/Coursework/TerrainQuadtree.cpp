@@ -0,0 +1,83 @@
+#include "TerrainQuadtree.h"
+
+#include "MathUtils.h"
+
+void TerrainQuadtree::init(const Desc &newDesc) {
+	desc = newDesc;
+	if (desc.lodCount < 1) desc.lodCount = 1;
+	if (desc.lodCount > MAX_LODS) desc.lodCount = MAX_LODS;
+
+	// the root nodes need to cover the whole world, if the world is too
+	// small for this many lods just use less of them
+	while (desc.lodCount > 1 && getNodeSize(desc.lodCount - 1) > desc.worldSize) {
+		desc.lodCount--;
+	}
+
+	f32 rootSize = getNodeSize(desc.lodCount - 1);
+	rootCount = (u32)ceilf(desc.worldSize / rootSize);
+
+	f32 prevRange = 0.f;
+	for (u32 i = 0; i < desc.lodCount; ++i) {
+		ranges[i] = desc.firstRange * (f32)(1u << i);
+		morphRanges[i].end   = ranges[i];
+		morphRanges[i].start = prevRange + (ranges[i] - prevRange) * desc.morphStartRatio;
+		prevRange = ranges[i];
+	}
+}
+
+void TerrainQuadtree::select(const vec3f &cameraPos, std::vector<TerrainPatch> &outPatches) const {
+	outPatches.clear();
+
+	u32 rootLod = desc.lodCount - 1;
+	f32 rootSize = getNodeSize(rootLod);
+	vec2f worldMin = vec2f(-desc.worldSize / 2.f);
+
+	for (u32 z = 0; z < rootCount; ++z) {
+		for (u32 x = 0; x < rootCount; ++x) {
+			vec2f nodeMin = worldMin + vec2f((f32)x, (f32)z) * rootSize;
+			selectNode(nodeMin, rootLod, cameraPos, outPatches);
+		}
+	}
+}
+
+void TerrainQuadtree::setHeightBounds(f32 minHeight, f32 maxHeight) {
+	desc.minHeight = minHeight;
+	desc.maxHeight = maxHeight;
+}
+
+bool TerrainQuadtree::selectNode(const vec2f &nodeMin, u32 lod, const vec3f &cameraPos, std::vector<TerrainPatch> &outPatches) const {
+	f32 nodeSize = getNodeSize(lod);
+
+	// Root nodes are always selected as there is nothing above them that
+	// could cover them, any other node not in its range is left to the parent
+	if (lod != desc.lodCount - 1 && !isInRange(nodeMin, nodeSize, cameraPos, ranges[lod])) {
+		return false;
+	}
+
+	f32 halfSize = nodeSize / 2.f;
+
+	// Leaf nodes, or nodes where no child can be in range, are emitted whole
+	bool coverWhole = lod == 0 || !isInRange(nodeMin, nodeSize, cameraPos, ranges[lod - 1]);
+
+	for (u32 i = 0; i < 4; ++i) {
+		vec2f childMin = nodeMin + vec2f((f32)(i & 1), (f32)(i >> 1)) * halfSize;
+
+		if (coverWhole || !selectNode(childMin, lod - 1, cameraPos, outPatches)) {
+			// child not in range, cover its area at this lod
+			outPatches.push_back({ childMin, halfSize, lod });
+		}
+	}
+
+	return true;
+}
+
+bool TerrainQuadtree::isInRange(const vec2f &nodeMin, f32 nodeSize, const vec3f &cameraPos, f32 range) const {
+	// sphere vs axis aligned box, using the closest point in the box
+	vec3f closest = {
+		clamp(cameraPos.x, nodeMin.x, nodeMin.x + nodeSize),
+		clamp(cameraPos.y, desc.minHeight, desc.maxHeight),
+		clamp(cameraPos.z, nodeMin.y, nodeMin.y + nodeSize),
+	};
+
+	return (closest - cameraPos).mag2() <= pow2(range);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "vec.h"
+
+// A single patch that needs to be drawn this frame. Every patch is drawn
+// with the same grid mesh, scaled by size and moved to origin.
+struct TerrainPatch {
+	vec2f origin;
+	f32 size;
+	u32 lod;
+};
+
+// Distances used by the vertex shader to morph a lod into the next one
+struct TerrainMorphRange {
+	f32 start;
+	f32 end;
+};
+
+/* Continuous distance-dependent level of detail (CDLOD) quadtree.
+ * The world is split into a grid of root nodes, every node has four
+ * children until we get to the leaf nodes (lod 0).
+ * Every lod level has a visibility range which is double the one of
+ * the level below, when selecting we walk down the tree and stop at
+ * the first node that isn't in range of the more detailed level.
+ * Nodes are never emitted whole, they are emitted as four quarter
+ * patches: this way when only some of the children are in range we can
+ * emit the remaining quarters at the parent's lod, and every patch
+ * (whole or not) can be drawn with the same grid mesh.
+ * Near the end of each range vertices are morphed towards the next lod
+ * in the vertex shader, so there is no popping or cracks between lods.
+ * This class only does cpu work, it doesn't need a device.
+ */
+class TerrainQuadtree {
+public:
+	struct Desc {
+		f32 worldSize        = 16384.f; // size of the side of the world, centered on the origin
+		f32 leafSize         = 32.f;    // size of the side of a lod 0 node
+		u32 lodCount         = 10;
+		f32 firstRange       = 48.f;    // visibility range of lod 0, every lod doubles it
+		f32 morphStartRatio  = 0.66f;   // where morphing starts in the range [previous range, range]
+		f32 minHeight        = 0.f;
+		f32 maxHeight        = 0.f;
+	};
+
+	static constexpr u32 MAX_LODS = 16;
+
+	void init(const Desc &desc);
+
+	// Selects all the patches needed to render the terrain from cameraPos
+	void select(const vec3f &cameraPos, std::vector<TerrainPatch> &outPatches) const;
+
+	const TerrainMorphRange &getMorphRange(u32 lod) const { return morphRanges[lod]; }
+	f32 getRange(u32 lod) const { return ranges[lod]; }
+	f32 getNodeSize(u32 lod) const { return desc.leafSize * (f32)(1u << lod); }
+	u32 getLodCount() const { return desc.lodCount; }
+	const Desc &getDesc() const { return desc; }
+	void setHeightBounds(f32 minHeight, f32 maxHeight);
+
+private:
+	bool selectNode(const vec2f &nodeMin, u32 lod, const vec3f &cameraPos, std::vector<TerrainPatch> &outPatches) const;
+	bool isInRange(const vec2f &nodeMin, f32 nodeSize, const vec3f &cameraPos, f32 range) const;
+
+	Desc desc;
+	u32 rootCount = 0;
+	f32 ranges[MAX_LODS]{};
+	TerrainMorphRange morphRanges[MAX_LODS]{};
+};
@@ -0,0 +1,241 @@
+#include "TerrainStreamer.h"
+
+#include <algorithm>
+
+#include "MathUtils.h"
+
+TerrainStreamer::~TerrainStreamer() {
+	shutdown();
+}
+
+void TerrainStreamer::init(const Desc &newDesc, LoadFn newLoader) {
+	shutdown();
+
+	desc = newDesc;
+	loader = newLoader;
+
+	size_t tileBytes = (size_t)desc.tileResolution * desc.tileResolution * sizeof(u16);
+	slotCount = (u32)min(desc.memoryBudget / tileBytes, (size_t)NO_SLOT);
+
+	u32 tileCount = desc.tilesPerSide * desc.tilesPerSide;
+	tiles.assign(tileCount, Tile());
+	slotTable.assign(tileCount, (u16)NO_SLOT);
+	slotOwner.assign(slotCount, 0);
+
+	// pop_back gives the lower slots first
+	freeSlots.clear();
+	for (u32 i = slotCount; i > 0; --i) {
+		freeSlots.push_back((u16)(i - 1));
+	}
+
+	stats = Stats();
+	frame = 0;
+	quit = false;
+	worker = std::thread(&TerrainStreamer::workerLoop, this);
+}
+
+void TerrainStreamer::shutdown() {
+	if (!worker.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		pending.clear();
+	}
+	wakeWorker.notify_all();
+	worker.join();
+
+	finished.clear();
+	loading = 0;
+}
+
+void TerrainStreamer::update(const vec3f &cameraPos) {
+	++frame;
+
+	// -- Find the tiles around the camera ----------------------------------------------------------------------------------
+
+	f32 halfWorld = desc.tilesPerSide * desc.tileSize / 2.f;
+	vec2f cam = { cameraPos.x + halfWorld, cameraPos.z + halfWorld };
+
+	i32 last = (i32)desc.tilesPerSide - 1;
+	i32 minX = clamp((i32)floorf((cam.x - desc.streamRadius) / desc.tileSize), 0, last);
+	i32 maxX = clamp((i32)floorf((cam.x + desc.streamRadius) / desc.tileSize), 0, last);
+	i32 minZ = clamp((i32)floorf((cam.y - desc.streamRadius) / desc.tileSize), 0, last);
+	i32 maxZ = clamp((i32)floorf((cam.y + desc.streamRadius) / desc.tileSize), 0, last);
+
+	std::vector<std::pair<f32, u32>> byDistance;
+
+	for (i32 z = minZ; z <= maxZ; ++z) {
+		for (i32 x = minX; x <= maxX; ++x) {
+			// distance from the closest point of the tile
+			vec2f tileMin = vec2f((f32)x, (f32)z) * desc.tileSize;
+			vec2f closest = {
+				clamp(cam.x, tileMin.x, tileMin.x + desc.tileSize),
+				clamp(cam.y, tileMin.y, tileMin.y + desc.tileSize),
+			};
+			f32 dist2 = (closest - cam).mag2();
+			if (dist2 > pow2(desc.streamRadius)) continue;
+
+			u32 index = z * desc.tilesPerSide + x;
+			tiles[index].lastUsed = frame;
+			byDistance.emplace_back(dist2, index);
+		}
+	}
+
+	std::sort(byDistance.begin(), byDistance.end());
+
+	wanted.clear();
+	for (auto &tile : byDistance) {
+		wanted.push_back(tile.second);
+	}
+
+	// -- Queue the loads ---------------------------------------------------------------------------------------------------
+
+	// Only as many loads as there are slots they could go to (free, or held by
+	// a tile that isn't needed this frame), otherwise a tile that can't get a
+	// slot would be read from disk and thrown away every frame
+	u32 available = (u32)freeSlots.size();
+	for (u32 slot = 0; slot < slotCount; ++slot) {
+		const Tile &owner = tiles[slotOwner[slot]];
+		if (owner.slot == slot && owner.lastUsed < frame) available++;
+	}
+	const u32 maxInFlight = min(desc.maxInFlight, available);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Give back the tiles that the worker hasn't picked up yet, this way
+		// if the camera moved they get queued again in the new order
+		for (u32 index : pending) {
+			tiles[index].state = TileState::Unloaded;
+			stats.inFlight--;
+		}
+		pending.clear();
+
+		for (u32 index : wanted) {
+			if (stats.inFlight >= maxInFlight) break;
+
+			if (tiles[index].state == TileState::Unloaded) {
+				tiles[index].state = TileState::Queued;
+				stats.inFlight++;
+				stats.requested++;
+				pending.push_back(index);
+			}
+		}
+	}
+
+	wakeWorker.notify_one();
+}
+
+void TerrainStreamer::collectLoaded(std::vector<TerrainTileData> &outTiles) {
+	std::vector<Result> results;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		results.swap(finished);
+	}
+
+	for (Result &result : results) {
+		Tile &tile = tiles[result.index];
+		stats.inFlight--;
+
+		if (!result.found) {
+			tile.state = TileState::Missing;
+			stats.missing++;
+			continue;
+		}
+
+		u16 slot = allocSlot();
+		if (slot == NO_SLOT) {
+			// every slot went to a tile we still need since the load was queued, try again later
+			tile.state = TileState::Unloaded;
+			stats.dropped++;
+			continue;
+		}
+
+		tile.state = TileState::Resident;
+		tile.slot = slot;
+		slotOwner[slot] = result.index;
+		slotTable[result.index] = slot;
+		stats.loaded++;
+
+		outTiles.push_back({
+			result.index % desc.tilesPerSide,
+			result.index / desc.tilesPerSide,
+			slot,
+			std::move(result.heights)
+		});
+	}
+}
+
+void TerrainStreamer::waitIdle() {
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return quit || (pending.empty() && loading == 0); });
+}
+
+TerrainStreamer::Stats TerrainStreamer::getStats() const {
+	Stats result = stats;
+	result.resident = slotCount - (u32)freeSlots.size();
+	return result;
+}
+
+void TerrainStreamer::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+		wakeWorker.wait(lock, [this]() { return quit || !pending.empty(); });
+		if (quit) break;
+
+		u32 index = pending.front();
+		pending.pop_front();
+		loading++;
+
+		lock.unlock();
+
+		Result result;
+		result.index = index;
+		result.found = loader && loader(index % desc.tilesPerSide, index / desc.tilesPerSide, result.heights);
+		result.found = result.found && result.heights.size() == (size_t)desc.tileResolution * desc.tileResolution;
+
+		lock.lock();
+
+		finished.emplace_back(std::move(result));
+		loading--;
+
+		if (pending.empty() && loading == 0) {
+			idle.notify_all();
+		}
+	}
+
+	idle.notify_all();
+}
+
+u16 TerrainStreamer::allocSlot() {
+	if (!freeSlots.empty()) {
+		u16 slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	// Evict the least recently used tile that wasn't needed this frame
+	u16 oldest = NO_SLOT;
+	u64 oldestFrame = frame;
+
+	for (u32 slot = 0; slot < slotCount; ++slot) {
+		const Tile &tile = tiles[slotOwner[slot]];
+		if (tile.lastUsed < oldestFrame) {
+			oldestFrame = tile.lastUsed;
+			oldest = (u16)slot;
+		}
+	}
+
+	if (oldest != NO_SLOT) {
+		u32 owner = slotOwner[oldest];
+		tiles[owner].state = TileState::Unloaded;
+		tiles[owner].slot = NO_SLOT;
+		slotTable[owner] = NO_SLOT;
+		stats.evicted++;
+	}
+
+	return oldest;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "types.h"
+#include "vec.h"
+
+// Heightfield tile that finished loading and needs to be copied to its slot
+struct TerrainTileData {
+	u32 x, z;
+	u16 slot;
+	std::vector<u16> heights;
+};
+
+/* Streams heightfield tiles from disk on a background thread.
+ * The world is split in tilesPerSide * tilesPerSide tiles, only the ones
+ * around the camera are kept in memory. Resident tiles live in a fixed
+ * number of slots (derived from the memory budget), when we run out of
+ * slots the least recently used tile that isn't needed anymore is evicted,
+ * and no more loads are queued than there are slots they could go to.
+ * Loading is done by a user provided function so the scheduling can be
+ * tested without any files (or a device), this class never touches the gpu:
+ * the caller gets the loaded tiles from collectLoaded and uploads them.
+ * Tiles that can't be loaded are marked as missing and treated as flat.
+ */
+class TerrainStreamer {
+public:
+	struct Desc {
+		u32 tilesPerSide    = 32;
+		u32 tileResolution  = 257;              // samples per side, borders are shared with the neighbours
+		f32 tileSize        = 512.f;            // world size of a tile side
+		size_t memoryBudget = 16 * 1024 * 1024; // bytes used by the resident tiles
+		f32 streamRadius    = 1024.f;           // tiles closer than this to the camera are loaded
+		u32 maxInFlight     = 8;                // max tiles queued or loading at the same time
+	};
+
+	struct Stats {
+		u32 requested = 0; // loads queued
+		u32 loaded    = 0;
+		u32 missing   = 0;
+		u32 evicted   = 0;
+		u32 dropped   = 0; // loaded but no slot was free
+		u32 resident  = 0;
+		u32 inFlight  = 0;
+	};
+
+	// Should fill heights with tileResolution^2 values, returns false if the tile doesn't exist.
+	// Called from the streaming thread
+	using LoadFn = std::function<bool(u32 x, u32 z, std::vector<u16> &heights)>;
+
+	static constexpr u16 NO_SLOT = 0xFFFF;
+
+	TerrainStreamer() = default;
+	~TerrainStreamer();
+
+	void init(const Desc &desc, LoadFn loader);
+	void shutdown();
+
+	// Main thread: decides which tiles are needed and queues the loads, closest first
+	void update(const vec3f &cameraPos);
+	// Main thread: puts the tiles loaded since the last call in their slots
+	void collectLoaded(std::vector<TerrainTileData> &outTiles);
+	// Blocks until there is nothing queued or loading (mainly for tests and loading screens)
+	void waitIdle();
+
+	u16 getSlot(u32 x, u32 z) const { return tiles[z * desc.tilesPerSide + x].slot; }
+	// tilesPerSide^2 slot indices, NO_SLOT for tiles that aren't resident
+	const std::vector<u16> &getSlotTable() const { return slotTable; }
+	u32 getSlotCount() const { return slotCount; }
+	const Desc &getDesc() const { return desc; }
+	Stats getStats() const;
+
+	// disable copy
+	TerrainStreamer(const TerrainStreamer &other) = delete;
+	TerrainStreamer &operator=(TerrainStreamer &other) = delete;
+
+private:
+	enum class TileState : u8 {
+		Unloaded, Queued, Resident, Missing
+	};
+
+	struct Tile {
+		TileState state = TileState::Unloaded;
+		u16 slot = NO_SLOT;
+		u64 lastUsed = 0;
+	};
+
+	struct Result {
+		u32 index;
+		bool found;
+		std::vector<u16> heights;
+	};
+
+	void workerLoop();
+	u16 allocSlot();
+
+	Desc desc;
+	LoadFn loader;
+	u32 slotCount = 0;
+	u64 frame = 0;
+
+	std::vector<Tile> tiles;
+	std::vector<u16> slotTable;
+	std::vector<u32> slotOwner;
+	std::vector<u16> freeSlots;
+	std::vector<u32> wanted;
+	Stats stats;
+
+	// shared with the worker
+	std::thread worker;
+	mutable std::mutex mutex;
+	std::condition_variable wakeWorker;
+	std::condition_variable idle;
+	std::deque<u32> pending;
+	std::vector<Result> finished;
+	u32 loading = 0;
+	bool quit = false;
+};
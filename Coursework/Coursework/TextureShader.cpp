@@ -24,8 +24,8 @@ void TextureShader::setShaderParameters(
 	unmapBufferVS(ctx, matrixBuffer, 0);
 
 	// Set shader texture resource in the pixel shader.
-	ctx->PSSetShaderResources(0, 1, &texture);
-	ctx->PSSetSamplers(0, 1, &sampleState);
+	stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+	stateCache.setSamplers(ShaderStage::Pixel, 0, 1, &sampleState);
 }
 
 void TextureShader::initShader(const wchar_t *ps) {
@@ -9,6 +9,7 @@ TreeShader::TreeShader(Device *device, HWND hwnd)
 
 TreeShader::~TreeShader() {
 	RELEASE_IF_NOT_NULL(treeBuffer);
+	RELEASE_IF_NOT_NULL(windSampler);
 }
 
 void TreeShader::setShaderParameters(
@@ -23,9 +24,9 @@ void TreeShader::setShaderParameters(
 	Light lights[LIGHTS_COUNT], 
 	ShadowMap *spotShadow, 
 	OmniShadowMap &pointShadow, 
-	const float3 &windOrigin, 
-	f32 windAmplitude, 
-	f32 windSpeed
+	TextureType *windField,
+	f32 windFieldSize,
+	f32 windAmplitude
 ) {
 	DefaultShader::setShaderParameters(
 		ctx, world, view, proj,
@@ -35,10 +36,12 @@ void TreeShader::setShaderParameters(
 	);
 
 	auto treePtr = mapBuffer<TreeBufferType>(ctx, treeBuffer);
-	treePtr->windOrigin    = windOrigin;
 	treePtr->windAmplitude = windAmplitude;
-	treePtr->windSpeed     = windSpeed;
+	treePtr->windFieldSize = windFieldSize;
 	unmapBufferVS(ctx, treeBuffer, 3);
+
+	stateCache.setShaderResources(ShaderStage::Vertex, 0, 1, &windField);
+	stateCache.setSamplers(ShaderStage::Vertex, 0, 1, &windSampler);
 }
 
 void TreeShader::initShader(const wchar_t *vs, const wchar_t *dvs) {
@@ -50,6 +53,7 @@ void TreeShader::initShader(const wchar_t *vs, const wchar_t *dvs) {
 	addDynamicBuffer<TreeBufferType>(&treeBuffer);
 	addDiffuseSampler();
 	addShadowSampler();
+	addClampSampler(&windSampler);
 }
 
 void TreeShader::loadVertexShader(const wchar_t *vs) {
@@ -61,5 +65,5 @@ void TreeShader::loadVertexShader(const wchar_t *vs) {
 		{ "INSTANCE_POS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
 	};
 
-	BaseShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
+	DefaultShader::loadVertexShader(vs, polygonLayout, ARR_LEN(polygonLayout));
 }
@@ -15,26 +15,22 @@ struct TreeInstanceType {
  * buffer and fills it up with data.
  * During the vertex shader stage, it applies vertex manipulation
  * to every tree's vertex. It creates two rotation matrices (on the
- * x and z axis) based on a sin wave.
+ * x and z axis) based on the wind field velocity at the tree's position.
  * It applies this matrices to bot the position and the normal,
  * this way the shading will still be correct.
  */
 class TreeShader : public InstanceShader {
-	struct TreeBufferType {
-		float3 windOrigin;
-		float windAmplitude;
-		float windSpeed;
-		float3 padding = { 0, 0, 0 };
-	};
+	CBUFFER(TreeBuffer, b3, TREE_BUFFER)
 public:
 	TreeShader(Device *device, HWND hwnd);
 	~TreeShader();
 
-	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &projection, TextureType *texture, float4 color, float3 cameraPos, float timePassed, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow, const float3 &windOrigin, f32 windAmplitude, f32 windSpeed);
+	void setShaderParameters(DeviceContext *ctx, const mat4 &world, const mat4 &view, const mat4 &projection, TextureType *texture, float4 color, float3 cameraPos, float timePassed, Light lights[LIGHTS_COUNT], ShadowMap *spotShadow, OmniShadowMap &pointShadow, TextureType *windField, f32 windFieldSize, f32 windAmplitude);
 
 private:
 	void initShader(const wchar_t *vs, const wchar_t *dvs);
 	void loadVertexShader(const wchar_t *vs);
 
 	ID3D11Buffer *treeBuffer;
+	ID3D11SamplerState *windSampler = nullptr;
 };
\ No newline at end of file
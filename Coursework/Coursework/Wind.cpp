@@ -0,0 +1,109 @@
+#include "Wind.h"
+
+#include "utility.h"
+#include "tracelog.h"
+
+void Wind::init(Device *device) {
+	field.init(WindField::Desc());
+
+	u32 res = field.getDesc().resolution;
+	const std::vector<f32> &velocities = field.getVelocities();
+
+	D3D11_TEXTURE2D_DESC texDesc{};
+	texDesc.Width = res;
+	texDesc.Height = res;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DYNAMIC;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	D3D11_SUBRESOURCE_DATA data{};
+	data.pSysMem = velocities.data();
+	data.SysMemPitch = sizeof(f32) * 2 * res;
+
+	HRESULT result = device->CreateTexture2D(&texDesc, &data, &fieldTexture);
+	if (FAILED(result)) {
+		err("Couldn't create wind field texture");
+		return;
+	}
+
+	device->CreateShaderResourceView(fieldTexture, nullptr, &fieldView);
+	uploadedStep = field.getStepCount();
+}
+
+Wind::~Wind() {
+	field.shutdown();
+	RELEASE_IF_NOT_NULL(fieldView);
+	RELEASE_IF_NOT_NULL(fieldTexture);
+}
+
+void Wind::update(DeviceContext *ctx, f32 dt) {
+	field.update(dt);
+
+	// nothing new was published
+	if (!fieldTexture || field.getStepCount() == uploadedStep) return;
+
+	u32 res = field.getDesc().resolution;
+	const std::vector<f32> &velocities = field.getVelocities();
+
+	stateCache.getBackend()->writeTexture(fieldTexture, velocities.data(), sizeof(f32) * 2 * res, res);
+	uploadedStep = field.getStepCount();
+}
+
+void Wind::gui(bool &open) {
+	ImGui::Begin("Wind options", &open);
+
+	WindField::Params &params = field.getParams();
+
+	// -- Base wind -----------------------------------------------------------
+	ImGui::Text("Base wind");
+	ImGui::Separator();
+
+	ImGui::SliderFloat2("Direction", &params.baseWind.x, -10.f, 10.f);
+	ImGui::SliderFloat("Relax rate", &params.relaxRate, 0.f, 5.f);
+	ImGui::SliderFloat("Diffusion", &params.diffusion, 0.f, 0.25f);
+
+	ImGui::NewLine();
+
+	// -- Gusts ---------------------------------------------------------------
+	ImGui::Text("Gusts");
+	ImGui::Separator();
+
+	ImGui::SliderFloat("Gusts per second", &params.gustRate, 0.f, 5.f);
+	ImGui::SliderFloat("Gust strength", &params.gustStrength, 0.f, 30.f);
+	ImGui::SliderFloat("Gust radius", &params.gustRadius, 1.f, 100.f);
+	ImGui::SliderFloat("Monolith pulses per second", &params.sourceRate, 0.f, 5.f);
+	ImGui::SliderFloat("Monolith pulse strength", &params.sourceStrength, 0.f, 30.f);
+	ImGui::SliderFloat("Monolith pulse radius", &params.sourceRadius, 1.f, 100.f);
+
+	ImGui::NewLine();
+
+	// -- Simulation ----------------------------------------------------------
+	ImGui::Text("Simulation");
+	ImGui::Separator();
+
+	bool useSimd = field.getUseSimd();
+	if (ImGui::Checkbox("Use SIMD kernels", &useSimd)) {
+		field.setUseSimd(useSimd);
+	}
+	ImGui::Text("Steps: %llu, last step: %.3fms", (unsigned long long)field.getStepCount(), field.getLastStepMs());
+
+	if (ImGui::Button("Run benchmark (1000 steps)")) {
+		benchSimdMs   = field.benchmark(1000, true);
+		benchScalarMs = field.benchmark(1000, false);
+	}
+	if (benchSimdMs > 0.0) {
+		ImGui::Text("SIMD: %.4fms/step, scalar: %.4fms/step (x%.2f)", benchSimdMs, benchScalarMs, benchScalarMs / benchSimdMs);
+	}
+
+	ImGui::Image(fieldView, { 128.f, 128.f });
+
+	ImGui::End();
+}
+
+void Wind::setSource(const float3 &pos) {
+	field.getParams().sourcePos = { pos.x, pos.z };
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "DefaultShader.h"
+#include "WindField.h"
+
+/* Owns the wind field simulation and the texture it is published to.
+ * The texture is a resolution^2 R32G32_FLOAT velocity field covering
+ * worldSize^2 centered on the origin, both the grass and the trees sample
+ * it (one fetch) instead of computing their own wave.
+ */
+class Wind {
+public:
+	void init(Device *device);
+	~Wind();
+
+	void update(DeviceContext *ctx, f32 dt);
+	void gui(bool &open);
+
+	// the monolith emits periodic radial gusts
+	void setSource(const float3 &pos);
+
+	TextureType *getTexture() { return fieldView; }
+	f32 getWorldSize() const { return field.getDesc().worldSize; }
+	WindField &getField() { return field; }
+
+private:
+	WindField field;
+	u64 uploadedStep = (u64)-1;
+
+	ID3D11Texture2D *fieldTexture = nullptr;
+	TextureType *fieldView = nullptr;
+
+	f64 benchSimdMs = 0.0;
+	f64 benchScalarMs = 0.0;
+};
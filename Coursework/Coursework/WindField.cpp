@@ -0,0 +1,452 @@
+#include "WindField.h"
+
+#include <chrono>
+#include <math.h>
+
+#include "tracelog.h"
+#include "MathUtils.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+	#define WIND_USE_SSE
+	#include <emmintrin.h>
+#endif
+
+using Clock = std::chrono::high_resolution_clock;
+
+WindField::~WindField() {
+	shutdown();
+}
+
+void WindField::init(const Desc &newDesc, bool useThread) {
+	shutdown();
+
+	desc = newDesc;
+	threaded = useThread;
+
+	if (desc.resolution < 8 || desc.resolution % 4 != 0) {
+		u32 fixed = max((desc.resolution + 3) & ~3u, 8u);
+		warn("Wind field resolution (%u) must be a multiple of 4, using %u", desc.resolution, fixed);
+		desc.resolution = fixed;
+	}
+
+	size_t count = (size_t)desc.resolution * desc.resolution;
+	velX.assign(count, params.baseWind.x);
+	velY.assign(count, params.baseWind.y);
+	tmpX.assign(count, 0.f);
+	tmpY.assign(count, 0.f);
+
+	back.assign(count * 2, 0.f);
+	published.assign(count * 2, 0.f);
+	for (size_t i = 0; i < count; ++i) {
+		published[i * 2 + 0] = params.baseWind.x;
+		published[i * 2 + 1] = params.baseWind.y;
+	}
+
+	steps = 0;
+	rng = desc.seed ? desc.seed : 1;
+	nextGust = 0.f;
+	nextPulse = 0.f;
+	publishedSteps = 0;
+	accumulator = 0.f;
+	hasResult = false;
+
+	busy = false;
+	quit = false;
+	jobSteps = 0;
+	if (threaded) {
+		worker = std::thread(&WindField::workerLoop, this);
+	}
+}
+
+void WindField::shutdown() {
+	if (!worker.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wakeWorker.notify_all();
+	worker.join();
+
+	busy = false;
+	jobSteps = 0;
+}
+
+void WindField::update(f32 dt) {
+	accumulator += dt;
+	u32 count = (u32)(accumulator / desc.timeStep);
+	if (count > desc.maxSteps) {
+		// the frame took too long, don't try to catch up
+		count = desc.maxSteps;
+		accumulator = 0.f;
+	}
+	else {
+		accumulator -= count * desc.timeStep;
+	}
+
+	if (!threaded) {
+		if (count > 0) simulate(count, params);
+		takeResult();
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return !busy; });
+
+	takeResult();
+
+	if (count > 0) {
+		jobParams = params;
+		jobSteps = count;
+		busy = true;
+		wakeWorker.notify_one();
+	}
+}
+
+void WindField::step() {
+	waitIdle();
+	simulate(1, params);
+	takeResult();
+}
+
+f64 WindField::benchmark(u32 count, bool simd) {
+	waitIdle();
+
+	// run on the real state and put it back afterwards, this way the
+	// benchmark doesn't change the result of the simulation
+	std::vector<f32> savedX = velX, savedY = velY;
+	u64 savedSteps = steps;
+	u32 savedRng = rng;
+	f32 savedGust = nextGust, savedPulse = nextPulse;
+	bool savedSimd = useSimd;
+
+	useSimd = simd;
+
+	auto start = Clock::now();
+	for (u32 i = 0; i < count; ++i) {
+		simulateStep(params);
+	}
+	f64 ms = std::chrono::duration<f64, std::milli>(Clock::now() - start).count();
+
+	velX.swap(savedX);
+	velY.swap(savedY);
+	steps = savedSteps;
+	rng = savedRng;
+	nextGust = savedGust;
+	nextPulse = savedPulse;
+	useSimd = savedSimd;
+
+	return count ? ms / count : 0.0;
+}
+
+vec2f WindField::sample(const vec2f &worldPos) const {
+	u32 res = desc.resolution;
+	f32 cellSize = desc.worldSize / res;
+
+	// cell centers are at (i + 0.5) * cellSize
+	vec2f pos = (worldPos + desc.worldSize / 2.f) / cellSize - 0.5f;
+	pos.x = clamp(pos.x, 0.f, (f32)(res - 1) - 1e-3f);
+	pos.y = clamp(pos.y, 0.f, (f32)(res - 1) - 1e-3f);
+
+	u32 ix = (u32)pos.x, iy = (u32)pos.y;
+	f32 fx = pos.x - ix, fy = pos.y - iy;
+
+	f32 result[2];
+	for (u32 c = 0; c < 2; ++c) {
+		f32 v00 = published[((iy + 0) * res + ix + 0) * 2 + c];
+		f32 v10 = published[((iy + 0) * res + ix + 1) * 2 + c];
+		f32 v01 = published[((iy + 1) * res + ix + 0) * 2 + c];
+		f32 v11 = published[((iy + 1) * res + ix + 1) * 2 + c];
+		f32 a = v00 + (v10 - v00) * fx;
+		f32 b = v01 + (v11 - v01) * fx;
+		result[c] = a + (b - a) * fy;
+	}
+
+	return { result[0], result[1] };
+}
+
+void WindField::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+		wakeWorker.wait(lock, [this]() { return quit || jobSteps > 0; });
+		if (quit) break;
+
+		u32 count = jobSteps;
+		Params stepParams = jobParams;
+		jobSteps = 0;
+
+		lock.unlock();
+		simulate(count, stepParams);
+		lock.lock();
+
+		busy = false;
+		done.notify_all();
+	}
+}
+
+void WindField::waitIdle() {
+	if (!threaded) return;
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return !busy; });
+}
+
+void WindField::simulate(u32 count, const Params &stepParams) {
+	auto start = Clock::now();
+
+	for (u32 i = 0; i < count; ++i) {
+		simulateStep(stepParams);
+	}
+
+	stepMs = std::chrono::duration<f64, std::milli>(Clock::now() - start).count() / count;
+
+	// interleave for the texture
+	size_t cells = velX.size();
+	for (size_t i = 0; i < cells; ++i) {
+		back[i * 2 + 0] = velX[i];
+		back[i * 2 + 1] = velY[i];
+	}
+	hasResult = true;
+}
+
+void WindField::takeResult() {
+	if (!hasResult) return;
+	published.swap(back);
+	publishedSteps = steps;
+	lastStepMs = stepMs;
+	hasResult = false;
+}
+
+void WindField::simulateStep(const Params &p) {
+	f32 dt = desc.timeStep;
+	f32 cellSize = desc.worldSize / desc.resolution;
+	f32 relax = min(p.relaxRate * dt, 1.f);
+	f32 diffusion = clamp(p.diffusion, 0.f, 0.25f);
+
+	// -- Diffuse and relax towards the base wind ---------------------------------------------------------------------------
+
+	diffuseRelax(velX.data(), tmpX.data(), p.baseWind.x, diffusion, relax);
+	diffuseRelax(velY.data(), tmpY.data(), p.baseWind.y, diffusion, relax);
+
+	// -- Advect ------------------------------------------------------------------------------------------------------------
+
+	advect(tmpX.data(), tmpY.data(), velX.data(), velY.data(), dt / cellSize);
+
+	// -- Gusts -------------------------------------------------------------------------------------------------------------
+
+	nextGust -= dt;
+	while (nextGust <= 0.f) {
+		if (p.gustRate <= 0.f) {
+			nextGust = 1.f;
+			break;
+		}
+
+		vec2f center = {
+			(randomFloat() - 0.5f) * desc.worldSize,
+			(randomFloat() - 0.5f) * desc.worldSize,
+		};
+
+		// blow mostly along the base wind
+		f32 angle = atan2f(p.baseWind.y, p.baseWind.x) + (randomFloat() - 0.5f) * 1.f;
+		vec2f dir = { cosf(angle), sinf(angle) };
+		f32 strength = p.gustStrength * (0.5f + randomFloat());
+
+		addImpulse(center, dir, false, strength, p.gustRadius);
+		nextGust += (0.5f + randomFloat()) / p.gustRate;
+	}
+
+	nextPulse -= dt;
+	while (nextPulse <= 0.f) {
+		if (p.sourceRate <= 0.f) {
+			nextPulse = 1.f;
+			break;
+		}
+
+		addImpulse(p.sourcePos, vec2f(0.f), true, p.sourceStrength, p.sourceRadius);
+		nextPulse += 1.f / p.sourceRate;
+	}
+
+	steps++;
+}
+
+/* out = v + k * laplacian(v), then out += (base - out) * relax
+ * both the scalar and the sse version do exactly these operations in this
+ * order, so that the result doesn't depend on which one is used
+ */
+void WindField::diffuseRelax(const f32 *src, f32 *dst, f32 base, f32 k, f32 relax) {
+	i32 res = (i32)desc.resolution;
+
+	auto scalarCell = [&](i32 x, const f32 *row, const f32 *up, const f32 *down) {
+		f32 v = row[x];
+		f32 l = row[max(x - 1, 0)];
+		f32 r = row[min(x + 1, res - 1)];
+		f32 lap = ((l + r) + (up[x] + down[x])) - v * 4.f;
+		f32 o = v + lap * k;
+		return o + (base - o) * relax;
+	};
+
+	for (i32 y = 0; y < res; ++y) {
+		const f32 *row  = src + y * res;
+		const f32 *up   = src + max(y - 1, 0) * res;
+		const f32 *down = src + min(y + 1, res - 1) * res;
+		f32 *out = dst + y * res;
+
+		i32 x = 0;
+
+#ifdef WIND_USE_SSE
+		if (useSimd) {
+			// the first and last 4 cells need clamping, do them with the scalar path
+			for (; x < 4; ++x) out[x] = scalarCell(x, row, up, down);
+
+			__m128 vk     = _mm_set1_ps(k);
+			__m128 vrelax = _mm_set1_ps(relax);
+			__m128 vbase  = _mm_set1_ps(base);
+			__m128 four   = _mm_set1_ps(4.f);
+
+			for (; x < res - 4; x += 4) {
+				__m128 v = _mm_loadu_ps(row + x);
+				__m128 l = _mm_loadu_ps(row + x - 1);
+				__m128 r = _mm_loadu_ps(row + x + 1);
+				__m128 u = _mm_loadu_ps(up + x);
+				__m128 d = _mm_loadu_ps(down + x);
+
+				__m128 lap = _mm_sub_ps(_mm_add_ps(_mm_add_ps(l, r), _mm_add_ps(u, d)), _mm_mul_ps(v, four));
+				__m128 o = _mm_add_ps(v, _mm_mul_ps(lap, vk));
+				o = _mm_add_ps(o, _mm_mul_ps(_mm_sub_ps(vbase, o), vrelax));
+				_mm_storeu_ps(out + x, o);
+			}
+		}
+#endif
+
+		for (; x < res; ++x) out[x] = scalarCell(x, row, up, down);
+	}
+}
+
+/* Semi-lagrangian advection: every cell goes back along its velocity and
+ * takes the bilinearly interpolated value from there.
+ * Positions are clamped just below the last cell so that the bottom right
+ * corner is always in the grid and floor is the same as truncating.
+ */
+void WindField::advect(const f32 *srcX, const f32 *srcY, f32 *dstX, f32 *dstY, f32 scale) {
+	i32 res = (i32)desc.resolution;
+	f32 maxCoord = (f32)(res - 1) - 1e-3f;
+
+	auto scalarCell = [&](i32 x, i32 y) {
+		i32 i = y * res + x;
+		f32 px = clamp((f32)x - srcX[i] * scale, 0.f, maxCoord);
+		f32 py = clamp((f32)y - srcY[i] * scale, 0.f, maxCoord);
+		i32 ix = (i32)px, iy = (i32)py;
+		f32 fx = px - (f32)ix, fy = py - (f32)iy;
+
+		i32 i00 = iy * res + ix;
+		i32 i01 = i00 + res;
+
+		f32 a = srcX[i00] + (srcX[i00 + 1] - srcX[i00]) * fx;
+		f32 b = srcX[i01] + (srcX[i01 + 1] - srcX[i01]) * fx;
+		dstX[i] = a + (b - a) * fy;
+
+		a = srcY[i00] + (srcY[i00 + 1] - srcY[i00]) * fx;
+		b = srcY[i01] + (srcY[i01 + 1] - srcY[i01]) * fx;
+		dstY[i] = a + (b - a) * fy;
+	};
+
+	for (i32 y = 0; y < res; ++y) {
+		i32 x = 0;
+
+#ifdef WIND_USE_SSE
+		if (useSimd) {
+			__m128 vscale = _mm_set1_ps(scale);
+			__m128 zero   = _mm_setzero_ps();
+			__m128 vmax   = _mm_set1_ps(maxCoord);
+			__m128 vy     = _mm_set1_ps((f32)y);
+			__m128 iota   = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+
+			alignas(16) i32 idx[4], idy[4];
+			alignas(16) f32 c[4][4];
+
+			for (; x < res; x += 4) {
+				i32 i = y * res + x;
+				__m128 vx = _mm_add_ps(_mm_set1_ps((f32)x), iota);
+
+				__m128 px = _mm_sub_ps(vx, _mm_mul_ps(_mm_loadu_ps(srcX + i), vscale));
+				__m128 py = _mm_sub_ps(vy, _mm_mul_ps(_mm_loadu_ps(srcY + i), vscale));
+				px = _mm_min_ps(_mm_max_ps(px, zero), vmax);
+				py = _mm_min_ps(_mm_max_ps(py, zero), vmax);
+
+				__m128i ix = _mm_cvttps_epi32(px);
+				__m128i iy = _mm_cvttps_epi32(py);
+				__m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(ix));
+				__m128 fy = _mm_sub_ps(py, _mm_cvtepi32_ps(iy));
+
+				// gather the corners, there is no gather in sse
+				_mm_store_si128((__m128i *)idx, ix);
+				_mm_store_si128((__m128i *)idy, iy);
+
+				const f32 *srcs[2] = { srcX, srcY };
+				f32 *dsts[2] = { dstX, dstY };
+
+				for (int comp = 0; comp < 2; ++comp) {
+					const f32 *s = srcs[comp];
+					for (int lane = 0; lane < 4; ++lane) {
+						i32 i00 = idy[lane] * res + idx[lane];
+						c[0][lane] = s[i00];
+						c[1][lane] = s[i00 + 1];
+						c[2][lane] = s[i00 + res];
+						c[3][lane] = s[i00 + res + 1];
+					}
+
+					__m128 v00 = _mm_load_ps(c[0]);
+					__m128 v10 = _mm_load_ps(c[1]);
+					__m128 v01 = _mm_load_ps(c[2]);
+					__m128 v11 = _mm_load_ps(c[3]);
+
+					__m128 a = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), fx));
+					__m128 b = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), fx));
+					_mm_storeu_ps(dsts[comp] + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fy)));
+				}
+			}
+		}
+#endif
+
+		for (; x < res; ++x) scalarCell(x, y);
+	}
+}
+
+void WindField::addImpulse(const vec2f &center, const vec2f &dir, bool radial, f32 strength, f32 radius) {
+	i32 res = (i32)desc.resolution;
+	f32 cellSize = desc.worldSize / res;
+	f32 halfWorld = desc.worldSize / 2.f;
+
+	i32 minX = max((i32)floorf((center.x - radius + halfWorld) / cellSize), 0);
+	i32 maxX = min((i32)ceilf((center.x + radius + halfWorld) / cellSize), res - 1);
+	i32 minY = max((i32)floorf((center.y - radius + halfWorld) / cellSize), 0);
+	i32 maxY = min((i32)ceilf((center.y + radius + halfWorld) / cellSize), res - 1);
+
+	for (i32 y = minY; y <= maxY; ++y) {
+		for (i32 x = minX; x <= maxX; ++x) {
+			vec2f cell = { (x + 0.5f) * cellSize - halfWorld, (y + 0.5f) * cellSize - halfWorld };
+			vec2f delta = cell - center;
+			f32 t = delta.mag2() / pow2(radius);
+			if (t >= 1.f) continue;
+
+			// smooth falloff, 1 at the center and 0 at the radius
+			f32 falloff = pow2(1.f - t);
+			vec2f push = radial ? delta.normalized() : dir;
+
+			velX[y * res + x] += push.x * strength * falloff;
+			velY[y * res + x] += push.y * strength * falloff;
+		}
+	}
+}
+
+u32 WindField::nextRandom() {
+	// xorshift32
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+f32 WindField::randomFloat() {
+	return (nextRandom() >> 8) * (1.f / 16777216.f);
+}
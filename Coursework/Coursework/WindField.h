@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "types.h"
+#include "vec.h"
+
+/* Simulates a low resolution 2D wind velocity field shared by the grass
+ * and the trees.
+ * Every step the field is diffused, relaxed towards the base wind and
+ * advected by itself (semi-lagrangian), then gusts are added as impulses:
+ * random ones blowing along the base wind and periodic radial pulses from
+ * a source (the monolith).
+ * The simulation runs at a fixed time step on a worker thread, update
+ * publishes the steps finished during the last frame and kicks the next
+ * ones, so the result is one frame behind.
+ * The same seed and sequence of update calls always give the same field,
+ * the simd and scalar kernels do the same operations in the same order so
+ * they also give the same result.
+ */
+class WindField {
+public:
+	struct Desc {
+		u32 resolution = 64;         // cells per side, must be a multiple of 4
+		f32 worldSize  = 256.f;      // world size of a side, centered on the origin
+		f32 timeStep   = 1.f / 30.f; // fixed simulation step
+		u32 maxSteps   = 4;          // max steps for a single update, drops time if the frame was too long
+		u32 seed       = 0x2545F491;
+	};
+
+	// Can be changed at any time, they are copied when the next steps are kicked
+	struct Params {
+		vec2f baseWind     = { 2.f, 0.5f };
+		f32 relaxRate      = 0.5f;  // how fast the field goes back to the base wind (per second)
+		f32 diffusion      = 0.15f; // 0-0.25
+		f32 gustRate       = 0.6f;  // random gusts per second
+		f32 gustStrength   = 6.f;
+		f32 gustRadius     = 24.f;
+		vec2f sourcePos    = { 0.f, 0.f };
+		f32 sourceRate     = 0.5f;  // pulses per second
+		f32 sourceStrength = 5.f;
+		f32 sourceRadius   = 30.f;
+	};
+
+	WindField() = default;
+	~WindField();
+
+	void init(const Desc &desc, bool threaded = true);
+	void shutdown();
+
+	// Main thread: publishes the last finished steps and starts simulating dt
+	void update(f32 dt);
+	// Runs a single step on the calling thread (for tests and benchmarks)
+	void step();
+	// Times count steps on the calling thread, returns the milliseconds per step
+	f64 benchmark(u32 count, bool simd);
+
+	// resolution^2 interleaved xy velocities (world units per second), row 0 is at -worldSize/2 on z
+	const std::vector<f32> &getVelocities() const { return published; }
+	vec2f sample(const vec2f &worldPos) const;
+
+	Params &getParams() { return params; }
+	const Desc &getDesc() const { return desc; }
+	u64 getStepCount() const { return publishedSteps; }
+	f64 getLastStepMs() const { return lastStepMs; }
+
+	void setUseSimd(bool use) { useSimd = use; }
+	bool getUseSimd() const { return useSimd; }
+
+	// disable copy
+	WindField(const WindField &other) = delete;
+	WindField &operator=(WindField &other) = delete;
+
+private:
+	void workerLoop();
+	void waitIdle();
+	void simulate(u32 count, const Params &stepParams);
+	void simulateStep(const Params &p);
+	// main thread: publishes the result of the last simulate
+	void takeResult();
+
+	void diffuseRelax(const f32 *src, f32 *dst, f32 base, f32 k, f32 relax);
+	void advect(const f32 *srcX, const f32 *srcY, f32 *dstX, f32 *dstY, f32 scale);
+	void addImpulse(const vec2f &center, const vec2f &dir, bool radial, f32 strength, f32 radius);
+
+	u32 nextRandom();
+	f32 randomFloat(); // [0, 1)
+
+	Desc desc;
+	Params params;
+	std::atomic<bool> useSimd { true }; // can be toggled while the worker is running
+	bool threaded = true;
+
+	// simulation state, owned by the worker while it is busy
+	std::vector<f32> velX, velY, tmpX, tmpY;
+	std::vector<f32> back;
+	u64 steps = 0;
+	u32 rng = 0;
+	f32 nextGust = 0.f;
+	f32 nextPulse = 0.f;
+	f64 stepMs = 0.0;
+	bool hasResult = false;
+
+	// main thread
+	std::vector<f32> published;
+	u64 publishedSteps = 0;
+	f64 lastStepMs = 0.0;
+	f32 accumulator = 0.f;
+
+	// shared with the worker
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wakeWorker;
+	std::condition_variable done;
+	Params jobParams;
+	u32 jobSteps = 0;
+	bool busy = false;
+	bool quit = false;
+};
@@ -2,12 +2,17 @@
 
 #include "tracelog.h"
 #include "utility.h"
+#include "MathUtils.h"
 
+#include <float.h>
 #include <assimp/version.h>
 
 MMesh::MMesh(MMesh &&other) {
 	diffuseColor = other.diffuseColor;
 	textureId    = other.textureId;
+	lods         = std::move(other.lods);
+	cpuVertices  = std::move(other.cpuVertices);
+	cpuIndices   = std::move(other.cpuIndices);
 	indexBuffer  = other.indexBuffer;
 	indexCount   = other.indexCount;
 	vertexBuffer = other.vertexBuffer;
@@ -44,6 +49,19 @@ void MMesh::clear() {
 	vertexCount = 0;
 	diffuseColor = float4(0.f, 0.f, 0.f, 0.f);
 	textureId = 0;
+	lods.clear();
+	cpuVertices.clear();
+	cpuIndices.clear();
+}
+
+MeshLod MMesh::getLod(u32 lod) const {
+	if (lods.empty()) {
+		MeshLod full;
+		full.indexCount = indexCount;
+		return full;
+	}
+
+	return lods[min(lod, (u32)lods.size() - 1)];
 }
 
 MMesh::~MMesh() {
@@ -58,6 +76,9 @@ void MMesh::initBuffers(ID3D11Device *device) {
 
 MModel::MModel(MModel &&other) {
 	meshes = std::move(other.meshes);
+	boundingRadius = other.boundingRadius;
+	boundsMin = other.boundsMin;
+	boundsMax = other.boundsMax;
 }
 
 void MModelLoader::init(ID3D11Device *dev, TextureIdManager *textureMgr) {
@@ -66,9 +87,12 @@ void MModelLoader::init(ID3D11Device *dev, TextureIdManager *textureMgr) {
 }
 
 MModel *MModelLoader::load(const std::string &file) {
-	bool result = false;
-	MModel *resultModel = nullptr;
-	Assimp::Importer importer;
+	if (!import(file)) return nullptr;
+	return upload();
+}
+
+bool MModelLoader::import(const std::string &file) {
+	imported.clear();
 
 	scene = importer.ReadFile(
 		file,
@@ -82,15 +106,38 @@ MModel *MModelLoader::load(const std::string &file) {
 
 	if (!scene) {
 		err("Couldn't load %s: %s", file.c_str(), importer.GetErrorString());
-		goto error;
+		return false;
 	}
 
+	model.boundingRadius = 0.f;
+	model.boundsMin = float3(FLT_MAX, FLT_MAX, FLT_MAX);
+	model.boundsMax = float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 	processNode(scene->mRootNode);
 
-	resultModel = new MModel(std::move(model));
+	// no vertices
+	if (model.boundsMin.x > model.boundsMax.x) {
+		model.boundsMin = model.boundsMax = float3(0.f, 0.f, 0.f);
+	}
+
+	return true;
+}
+
+MModel *MModelLoader::upload() {
+	if (!scene) {
+		err("Uploading a model that wasn't imported");
+		return nullptr;
+	}
+
+	for (ImportedMesh &mesh : imported) {
+		model.meshes.emplace_back(uploadMesh(mesh));
+	}
 
-error:
-	return resultModel;
+	// the materials are only needed for the textures
+	imported.clear();
+	importer.FreeScene();
+	scene = nullptr;
+
+	return new MModel(std::move(model));
 }
 
 void MModelLoader::processNode(const aiNode *node) {
@@ -105,21 +152,18 @@ void MModelLoader::processNode(const aiNode *node) {
 }
 
 void MModelLoader::processMesh(const aiMesh *in_mesh) {
-	MMesh out_mesh;
+	imported.emplace_back();
+	ImportedMesh &out_mesh = imported.back();
+	std::vector<VertexType> &vertices = out_mesh.vertices;
+	std::vector<ulong> &indices = out_mesh.indices;
 
-	aiMaterial *mat = scene->mMaterials[in_mesh->mMaterialIndex];
+	out_mesh.material = scene->mMaterials[in_mesh->mMaterialIndex];
 
 	// Get diffuse color
 	aiColor3D color(0.f, 0.f, 0.f);
-	mat->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+	out_mesh.material->Get(AI_MATKEY_COLOR_DIFFUSE, color);
 	out_mesh.diffuseColor = float4(color.r, color.g, color.b, 1.f);
 
-	// Get texture, if it exists
-	int texCount = mat->GetTextureCount(aiTextureType_DIFFUSE);
-	if (texCount > 0) {
-		out_mesh.textureId = processTexture(mat);
-	}
-
 	vertices.reserve(in_mesh->mNumVertices);
 	// because we triangulate the texture, all faces are 3 sides
 	indices.reserve((size_t)in_mesh->mNumFaces * 3);
@@ -145,6 +189,12 @@ void MModelLoader::processMesh(const aiMesh *in_mesh) {
 		}
 
 		vertices.emplace_back(vert, text, norm);
+
+		f32 dist2 = vert.x * vert.x + vert.y * vert.y + vert.z * vert.z;
+		model.boundingRadius = max(model.boundingRadius, sqrtf(dist2));
+
+		model.boundsMin = float3(min(model.boundsMin.x, vert.x), min(model.boundsMin.y, vert.y), min(model.boundsMin.z, vert.z));
+		model.boundsMax = float3(max(model.boundsMax.x, vert.x), max(model.boundsMax.y, vert.y), max(model.boundsMax.z, vert.z));
 	}
 
 	for (uint i = 0; i < in_mesh->mNumFaces; ++i) {
@@ -155,6 +205,36 @@ void MModelLoader::processMesh(const aiMesh *in_mesh) {
 		}
 	}
 
+	// Append the lods after the full mesh in the same index buffer
+	if (useLods && !vertices.empty()) {
+		std::vector<u32> source(indices.begin(), indices.end());
+		std::vector<u32> chain;
+
+		buildLodChain(
+			&vertices[0].position.x, sizeof(VertexType), (u32)vertices.size(),
+			source.data(), (u32)source.size(),
+			lodDesc,
+			chain, out_mesh.lods
+		);
+
+		indices.assign(chain.begin(), chain.end());
+	}
+}
+
+MMesh MModelLoader::uploadMesh(ImportedMesh &in_mesh) {
+	MMesh out_mesh;
+	std::vector<VertexType> &vertices = in_mesh.vertices;
+	std::vector<ulong> &indices = in_mesh.indices;
+
+	out_mesh.diffuseColor = in_mesh.diffuseColor;
+	out_mesh.lods = std::move(in_mesh.lods);
+
+	// Get texture, if it exists
+	int texCount = in_mesh.material->GetTextureCount(aiTextureType_DIFFUSE);
+	if (texCount > 0) {
+		out_mesh.textureId = processTexture(in_mesh.material);
+	}
+
 	// Load buffers
 
 	D3D11_BUFFER_DESC vbufDesc{}, ibufDesc{};
@@ -182,12 +262,12 @@ void MModelLoader::processMesh(const aiMesh *in_mesh) {
 	out_mesh.setVertexBuffer(vbuf, (int)vertices.size());
 	out_mesh.setIndexBuffer(ibuf, (int)indices.size());
 
-	// push the material to the model
-	model.meshes.emplace_back(std::move(out_mesh));
+	if (keepCpuData) {
+		out_mesh.cpuVertices = vertices;
+		out_mesh.cpuIndices.assign(indices.begin(), indices.end());
+	}
 
-	// we don't need this data, clear it for the next material
-	vertices.clear();
-	indices.clear();
+	return out_mesh;
 }
 
 int MModelLoader::processTexture(const aiMaterial *mat) {
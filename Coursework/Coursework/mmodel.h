@@ -9,6 +9,7 @@
 
 #include "BaseMesh.h"
 #include "TextureIdManager.h"
+#include "MeshSimplifier.h"
 #include "types.h"
 
 /* MMesh structure, almost identical to BaseMesh but:
@@ -22,12 +23,20 @@
  *    -- shader->render(ctx, temp);
  *    -- temp.clear();
  *   clear will prevent MMesh from releasing the underlyling BaseMesh
+ * - can have a chain of lods, they all share the vertex buffer and use a
+ *   different range of the index buffer
+ * - can keep a cpu copy of its vertices and indices (e.g. to bake impostors)
  */
 struct MMesh : public BaseMesh {
 	using PubVertexType = VertexType;
 
 	float4 diffuseColor = float4(0.f, 0.f, 0.f, 0.f);
 	int textureId = 0;
+	// empty if the mesh has no lods
+	std::vector<MeshLod> lods;
+	// only filled if the loader was asked to keep them, the indices include the lods
+	std::vector<PubVertexType> cpuVertices;
+	std::vector<u32> cpuIndices;
 
 	MMesh() = default;
 	~MMesh();
@@ -57,6 +66,9 @@ struct MMesh : public BaseMesh {
 		indexCount = icount;
 	}
 
+	// returns the whole index buffer if the mesh has no lods
+	MeshLod getLod(u32 lod) const;
+
 protected:
 	void initBuffers(ID3D11Device *device) override;
 };
@@ -65,6 +77,11 @@ protected:
 // for the same reason a MMesh can't be copied
 struct MModel {
 	std::vector<MMesh> meshes;
+	// bounding sphere around the model's origin
+	f32 boundingRadius = 0.f;
+	// axis aligned box in model space
+	float3 boundsMin = { 0.f, 0.f, 0.f };
+	float3 boundsMax = { 0.f, 0.f, 0.f };
 
 	MModel() = default;
 	MModel(MModel &&other);
@@ -75,6 +92,9 @@ struct MModel {
  * - it is embedded as a png/jpg file
  * - it is embedded as bgra data
  * - it is a string of a png/jpg file
+ * Loading is split in two steps: import() only reads the file and builds
+ * the vertices and lods, so it can run on any thread, upload() creates
+ * the buffers and textures on the thread that owns the device context.
  */
 class MModelLoader {
 public:
@@ -82,19 +102,41 @@ public:
 	// Returns a pointer to a MModel structure, the pointer is allocated
 	// with new and should be deleted
 	MModel *load(const std::string &file);
+	// Same as load(), in two steps. upload() returns nullptr if import() failed
+	bool import(const std::string &file);
+	MModel *upload();
+	// Models loaded after this will have a lod chain for every mesh
+	void setLodChain(const LodChainDesc &desc) { lodDesc = desc; useLods = true; }
+	// Models loaded after this will keep a cpu copy of their vertices and indices
+	void setKeepCpuData(bool keep) { keepCpuData = keep; }
 
 private:
+	using VertexType = MMesh::PubVertexType;
+
+	// a mesh between import() and upload()
+	struct ImportedMesh {
+		std::vector<VertexType> vertices;
+		std::vector<ulong> indices;
+		std::vector<MeshLod> lods;
+		float4 diffuseColor = float4(0.f, 0.f, 0.f, 1.f);
+		const aiMaterial *material = nullptr;
+	};
+
 	void processNode(const aiNode *node);
 	void processMesh(const aiMesh *mesh);
+	MMesh uploadMesh(ImportedMesh &mesh);
 	int processTexture(const aiMaterial *mat);
 
-	using VertexType = MMesh::PubVertexType;
-
 	ID3D11Device *device = nullptr;
 	TextureIdManager *tmanager = nullptr;
+	// the scene lives until upload(), the materials point into it
+	Assimp::Importer importer;
 	const aiScene *scene = nullptr;
 
 	MModel model;
-	std::vector<VertexType> vertices;
-	std::vector<ulong> indices;
+	std::vector<ImportedMesh> imported;
+
+	bool useLods = false;
+	LodChainDesc lodDesc;
+	bool keepCpuData = false;
 };
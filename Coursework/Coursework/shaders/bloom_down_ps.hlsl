@@ -0,0 +1,39 @@
+// One level of the bloom chain to the next, half its size, see BloomChain::downsample
+Texture2D source : register(t0);
+SamplerState clampSampler : register(s0);
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+float4 main(InputType input) : SV_TARGET {
+	uint width, height;
+	source.GetDimensions(width, height);
+	float2 texel = 1.0 / float2(width, height);
+	float2 uv = input.tex;
+
+	// 13 bilinear taps:
+	// a b c
+	//  d e
+	// f g h
+	//  i j
+	// k l m
+	float4 a = source.Sample(clampSampler, uv + texel * float2(-2, -2));
+	float4 b = source.Sample(clampSampler, uv + texel * float2( 0, -2));
+	float4 c = source.Sample(clampSampler, uv + texel * float2( 2, -2));
+	float4 d = source.Sample(clampSampler, uv + texel * float2(-1, -1));
+	float4 e = source.Sample(clampSampler, uv + texel * float2( 1, -1));
+	float4 f = source.Sample(clampSampler, uv + texel * float2(-2,  0));
+	float4 g = source.Sample(clampSampler, uv);
+	float4 h = source.Sample(clampSampler, uv + texel * float2( 2,  0));
+	float4 i = source.Sample(clampSampler, uv + texel * float2(-1,  1));
+	float4 j = source.Sample(clampSampler, uv + texel * float2( 1,  1));
+	float4 k = source.Sample(clampSampler, uv + texel * float2(-2,  2));
+	float4 l = source.Sample(clampSampler, uv + texel * float2( 0,  2));
+	float4 m = source.Sample(clampSampler, uv + texel * float2( 2,  2));
+
+	// the box d e i j has half of the weight, the 4 boxes of 2x2 in the corners an eighth each
+	return (d + e + i + j) * 0.125 + (a + c + k + m) * 0.03125 + (b + f + h + l) * 0.0625 + g * 0.125;
+}
@@ -0,0 +1,26 @@
+// The bright pixels of the scene at half resolution, see BloomChain::prefilter
+Texture2D sceneTexture : register(t0);
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+// the alpha only marks what blooms (the monolith), it isn't part of the bloom
+float4 threshold(float4 colour) {
+	return colour.a > 1.5 ? float4(colour.rgb, 0.0) : 0;
+}
+
+float4 main(InputType input) : SV_TARGET {
+	// every texel is the 2x2 texels of the scene under it, each one is
+	// checked on its own so the colour around the monolith doesn't leak in
+	int2 texel = (int2)input.position.xy * 2;
+
+	float4 colour = threshold(sceneTexture.Load(int3(texel, 0)));
+	colour += threshold(sceneTexture.Load(int3(texel + int2(1, 0), 0)));
+	colour += threshold(sceneTexture.Load(int3(texel + int2(0, 1), 0)));
+	colour += threshold(sceneTexture.Load(int3(texel + int2(1, 1), 0)));
+
+	return colour * 0.25;
+}
@@ -0,0 +1,39 @@
+#include "cbuffers.hlsli"
+
+// A level of the bloom chain plus the level under it, see BloomChain::upsample
+Texture2D lower : register(t0);
+Texture2D down : register(t1);
+SamplerState clampSampler : register(s0);
+
+CBUFFER(BloomUpBuffer, b0, BLOOM_UP_BUFFER)
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+float4 main(InputType input) : SV_TARGET {
+	uint width, height;
+	lower.GetDimensions(width, height);
+	float2 texel = filterRadius / float2(width, height);
+	float2 uv = input.tex;
+
+	// 3x3 tent:
+	// 1 2 1
+	// 2 4 2 / 16
+	// 1 2 1
+	float4 corners = lower.Sample(clampSampler, uv + texel * float2(-1, -1));
+	corners += lower.Sample(clampSampler, uv + texel * float2( 1, -1));
+	corners += lower.Sample(clampSampler, uv + texel * float2(-1,  1));
+	corners += lower.Sample(clampSampler, uv + texel * float2( 1,  1));
+
+	float4 edges = lower.Sample(clampSampler, uv + texel * float2( 0, -1));
+	edges += lower.Sample(clampSampler, uv + texel * float2(-1,  0));
+	edges += lower.Sample(clampSampler, uv + texel * float2( 1,  0));
+	edges += lower.Sample(clampSampler, uv + texel * float2( 0,  1));
+
+	float4 tent = corners / 16.0 + edges * 2.0 / 16.0 + lower.Sample(clampSampler, uv) * 4.0 / 16.0;
+
+	return down.Load(int3(input.position.xy, 0)) + tent;
+}
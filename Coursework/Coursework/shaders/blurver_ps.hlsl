@@ -1,13 +1,10 @@
+#include "cbuffers.hlsli"
+
+// One direction of the gaussian, with the linear taps of GaussianKernel
 Texture2D diffTexture : register(t0);
 SamplerState diffSampler : register(s0);
 
-static const float PI = 3.14159265f;
-static const float weight[20] = { 0.0658, 0.0656, 0.0653, 0.0648, 0.0643, 0.0636, 0.0627, 0.0618, 0.0607, 0.0605, 0.0581, 0.0564, 0.0543, 0.0517, 0.0484, 0.0445, 0.0399, 0.0340, 0.0269, 0.0181 };
-
-cbuffer BlurBuffer : register(b0) {
-	float bloomAmount;
-	float3 padding;
-};
+CBUFFER(BlurBuffer, b0, BLUR_BUFFER)
 
 struct InputType {
 	float4 position : SV_POSITION;
@@ -19,17 +16,25 @@ float4 getColor(float2 uv) {
 	return diffTexture.Sample(diffSampler, uv);
 }
 
+// offset in texels and weight
+float2 getTap(uint i) {
+	float4 pair = blurTaps[i / 2];
+	return i % 2 ? pair.zw : pair.xy;
+}
+
 float4 main(InputType input) : SV_TARGET{
 	uint width, height;
 	diffTexture.GetDimensions(width, height);
 	float texelH = 1.0 / height;
 
-	float4 colour = getColor(input.tex) * weight[0];
+	float4 colour = getColor(input.tex) * getTap(0).y;
 
-	for (int i = 1; i < 20; ++i) {
-		colour += getColor(input.tex + float2(0.0, texelH * i)) * weight[i] * bloomAmount;
-		colour += getColor(input.tex - float2(0.0, texelH * i)) * weight[i] * bloomAmount;
+	// every tap is between two texels, the sampler blends them
+	for (uint i = 1; i < blurTapCount; ++i) {
+		float2 tap = getTap(i);
+		colour += getColor(input.tex + float2(0.0, texelH * tap.x)) * tap.y;
+		colour += getColor(input.tex - float2(0.0, texelH * tap.x)) * tap.y;
 	}
 
-	return saturate(colour);
+	return colour;
 }
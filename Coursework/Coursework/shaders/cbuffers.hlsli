@@ -0,0 +1,169 @@
+/* Constant buffers shared by the shaders and the C++ side.
+ * Every buffer is a list of fields, written once here. This file is
+ * included by both: CBUFFER(Name, register, LIST) is a cbuffer in HLSL and
+ * the struct NameType in C++, CBUFFER_STRUCT(Name, LIST) is a struct in
+ * both, for the arrays of structs inside a buffer.
+ * A list takes two macros, one for the fields and one for the arrays:
+ *   #define EXAMPLE_BUFFER(FIELD, ARRAY) FIELD(float3, position) ARRAY(float4, colors, 4)
+ * The types are the C++ ones, HLSL gets typedefs for the ones it doesn't have.
+ *
+ * The C++ structs static_assert the HLSL packing rules: a cbuffer is made
+ * of 16 byte registers, a field can't cross one and matrices, arrays and
+ * structs start a new one. If every field is where HLSL would put it the
+ * two layouts are the same, when they're not the build fails with the
+ * field that needs padding. The arrays have to be of whole registers
+ * (float4, mat4 or a CBUFFER_STRUCT), in HLSL every element takes one.
+ * The buffers are aligned to 16 bytes so the padding at the end is left out.
+ * The fields of all the cbuffers are global in HLSL, so the names of
+ * the paddings have to be unique.
+ */
+
+#ifndef CBUFFERS_HLSLI
+#define CBUFFERS_HLSLI
+
+// == LISTS =======================================================================================================================
+
+// -- Lights ----------------------------------------------------------------------------------------------------------------------
+// lightDir is first as only the directional and the spot light need it. Factor
+// also has specularPower, it would need padding otherwise. LIGHTS_COUNT is an
+// enum in C++ (Light.h) and a define in utils.hlsli
+
+#define DIR_SPOT_DATA(FIELD, ARRAY) \
+	FIELD(float3, lightDir) \
+	FIELD(float, spotCutoff)
+
+#define LIGHT_DATA(FIELD, ARRAY) \
+	FIELD(float4, ambient) \
+	FIELD(float4, diffuse) \
+	FIELD(float4, specular) \
+	FIELD(float4, position)
+
+// linear is a keyword in HLSL
+#define LIGHT_FACTOR(FIELD, ARRAY) \
+	FIELD(float, constant) \
+	FIELD(float, lin) \
+	FIELD(float, quadratic) \
+	FIELD(float, specularPower)
+
+#define LIGHT_BUFFER(FIELD, ARRAY) \
+	ARRAY(DirSpotData, dirSpotData, 2) \
+	ARRAY(LightData, sharedLightData, LIGHTS_COUNT) \
+	ARRAY(Factor, factor, LIGHTS_COUNT) \
+	FIELD(float3, pointLightPos)
+
+// -- Ground and grass ------------------------------------------------------------------------------------------------------------
+// read by ground_hs.hlsl, for both the ground and the grass tessellation
+
+#define GROUND_BUFFER(FIELD, ARRAY) \
+	FIELD(float3, cameraPos) \
+	FIELD(float, cutoffDistance) \
+	FIELD(float, maxDist) \
+	FIELD(float, maxFactor)
+
+// the matrix starts a new register, XMMATRIX is only aligned with the intrinsics so it's padded by hand
+#define GRASS_BUFFER(FIELD, ARRAY) \
+	FIELD(float, timePassed) \
+	FIELD(float3, windOrigin) \
+	FIELD(float, windFieldSize) \
+	FIELD(float, windStrength) \
+	FIELD(float2, grassPadding) \
+	FIELD(mat4, spotLightMVP)
+
+// -- Trees -----------------------------------------------------------------------------------------------------------------------
+
+#define TREE_BUFFER(FIELD, ARRAY) \
+	FIELD(float, windAmplitude) \
+	FIELD(float, windFieldSize)
+
+// -- Sky -------------------------------------------------------------------------------------------------------------------------
+
+#define SKY_BUFFER(FIELD, ARRAY) \
+	FIELD(float3, lightDir) \
+	FIELD(float, skyPadding) \
+	FIELD(float4, sunCol) \
+	FIELD(float4, moonCol) \
+	FIELD(float4, dayBottomCol) \
+	FIELD(float4, dayTopCol) \
+	FIELD(float4, nightBottomCol) \
+	FIELD(float4, nightTopCol) \
+	FIELD(float4, sunsetCol) \
+	FIELD(float, radius) \
+	FIELD(float, moonOffset) \
+	FIELD(float, horizonIntensity) \
+	FIELD(float, starsExponent)
+
+// -- Bloom -----------------------------------------------------------------------------------------------------------------------
+// see BloomChain
+
+// two taps in every register, offset and weight in xy and zw, see GaussianKernel
+#define BLUR_MAX_TAPS 17
+#define BLUR_BUFFER(FIELD, ARRAY) \
+	ARRAY(float4, blurTaps, (BLUR_MAX_TAPS + 1) / 2) \
+	FIELD(u32, blurTapCount)
+
+#define BLOOM_UP_BUFFER(FIELD, ARRAY) \
+	FIELD(float, filterRadius)
+
+#define MIX_BUFFER(FIELD, ARRAY) \
+	FIELD(float, bloomIntensity)
+
+// == DECLARATIONS ================================================================================================================
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+
+#include "../types.h"
+
+namespace cbuffer {
+	// A field that is where HLSL would put it
+	constexpr bool fits(size_t offset, size_t size) {
+		return size > 16 ? offset % 16 == 0 : offset % 16 + size <= 16;
+	}
+
+	// An array that is where HLSL would put it, with the same stride
+	constexpr bool fitsArray(size_t offset, size_t elementSize) {
+		return offset % 16 == 0 && elementSize % 16 == 0;
+	}
+}
+
+#define CBUFFER_DECLARE_FIELD(type, name) type name;
+#define CBUFFER_DECLARE_ARRAY(type, name, count) type name[count];
+#define CBUFFER_CHECK_FIELD(type, name) \
+	static_assert(cbuffer::fits(offsetof(Self, name), sizeof(type)), #name " crosses a 16 byte register, it needs padding before it");
+#define CBUFFER_CHECK_ARRAY(type, name, count) \
+	static_assert(cbuffer::fitsArray(offsetof(Self, name), sizeof(type)), #name " has to start a register and be made of whole registers");
+
+// the checks are in a struct of their own, the buffer has to be complete for offsetof
+#define CBUFFER(Name, reg, LIST) \
+	struct alignas(16) Name##Type { LIST(CBUFFER_DECLARE_FIELD, CBUFFER_DECLARE_ARRAY) }; \
+	struct Name##Layout { \
+		using Self = Name##Type; \
+		LIST(CBUFFER_CHECK_FIELD, CBUFFER_CHECK_ARRAY) \
+	};
+
+#define CBUFFER_STRUCT(Name, LIST) \
+	struct Name { LIST(CBUFFER_DECLARE_FIELD, CBUFFER_DECLARE_ARRAY) }; \
+	struct Name##Layout { \
+		using Self = Name; \
+		LIST(CBUFFER_CHECK_FIELD, CBUFFER_CHECK_ARRAY) \
+		static_assert(sizeof(Name) % 16 == 0, #Name " is an array element, it has to be made of whole registers"); \
+	};
+
+#else
+
+typedef matrix mat4;
+typedef uint u32;
+
+#define CBUFFER_DECLARE_FIELD(type, name) type name;
+#define CBUFFER_DECLARE_ARRAY(type, name, count) type name[count];
+
+#define CBUFFER(Name, reg, LIST) \
+	cbuffer Name : register(reg) { LIST(CBUFFER_DECLARE_FIELD, CBUFFER_DECLARE_ARRAY) };
+
+#define CBUFFER_STRUCT(Name, LIST) \
+	struct Name { LIST(CBUFFER_DECLARE_FIELD, CBUFFER_DECLARE_ARRAY) };
+
+#endif // __cplusplus
+
+#endif // CBUFFERS_HLSLI
@@ -15,6 +15,7 @@ float4 main(InputType input) : SV_TARGET{
 	
 	const float shadowMapBias = 0.005f;
 	const float pointShadowMapBias = 0.0001f;
+	const float sunShadowMapBias = 0.0005f;
 
 	float4 result = 0;
 	float shadow = 0;
@@ -28,7 +29,10 @@ float4 main(InputType input) : SV_TARGET{
 		float3 dir = normalize(-dirSpot.lightDir);
 		float4 lightColour = getLighting(dir, input.normal, light.diffuse);
 		float4 specularCol = getSpecular(dir, input.normal, input.viewVector, light.specular, factors.specularPower);
-		result = lightColour + light.ambient + specularCol;
+
+		// -- Sun shadow map --------------------------------------------------------------------
+		float lit = 1 - getSunShadow(input.worldPosition, sunShadowMapBias);
+		result = (lightColour + specularCol) * lit + light.ambient;
 	}
 
 	// Point light
@@ -67,7 +71,7 @@ float4 main(InputType input) : SV_TARGET{
 				lightColour += getLighting(lightVec, input.normal, light.diffuse);
 				lightColour += getSpecular(lightVec, input.normal, input.viewVector, light.specular, factors.specularPower);
 
-				spotShadow = getShadow(spotShadowMap, input.spotViewPos, shadowMapBias) * (attenuation * 5);
+				spotShadow = getSpotShadow(input.spotViewPos, shadowMapBias) * (attenuation * 5);
 			}
 
 			result += lightColour * attenuation;
@@ -78,6 +82,7 @@ float4 main(InputType input) : SV_TARGET{
 	}
 
 	result = saturate(result - saturate(shadow));
+	result = saturate(result + getClusteredLighting(input.worldPosition, input.normal, input.viewVector));
 	return result * textureColour;
 }
 
@@ -0,0 +1,53 @@
+// Exponential variance shadow maps, matches ShadowMoments
+#define EVSM_POSITIVE_EXPONENT 40.0
+#define EVSM_NEGATIVE_EXPONENT 5.0
+#define EVSM_MAX_BLUR_RADIUS 8
+
+// Depth of a perspective projection, to linear in [0, 1] between the planes
+float linearizeDepth(float depth, float nearZ, float farZ) {
+	float viewZ = nearZ * farZ / (farZ - depth * (farZ - nearZ));
+	return saturate((viewZ - nearZ) / (farZ - nearZ));
+}
+
+// Positive warp, its square, negative warp, its square
+float4 encodeMoments(float depth) {
+	float d = depth * 2.0 - 1.0;
+	float pos = exp(EVSM_POSITIVE_EXPONENT * d);
+	float neg = -exp(-EVSM_NEGATIVE_EXPONENT * d);
+	return float4(pos, pos * pos, neg, neg * neg);
+}
+
+float chebyshevUpperBound(float2 moments, float t, float minVariance) {
+	if (t <= moments.x) return 1.0;
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = t - moments.x;
+	return variance / (variance + d * d);
+}
+
+// Fraction of light that reaches a receiver at a linear depth, 1 is lit
+float getMomentsVisibility(float4 moments, float depth, float minVariance, float lightBleeding) {
+	float d = depth * 2.0 - 1.0;
+	float pos = exp(EVSM_POSITIVE_EXPONENT * d);
+	float neg = -exp(-EVSM_NEGATIVE_EXPONENT * d);
+
+	float2 scale = minVariance * float2(EVSM_POSITIVE_EXPONENT, EVSM_NEGATIVE_EXPONENT) * float2(pos, neg);
+	float lit = min(
+		chebyshevUpperBound(moments.xy, pos, scale.x * scale.x),
+		chebyshevUpperBound(moments.zw, neg, scale.y * scale.y)
+	);
+
+	if (lightBleeding <= 0) return lit;
+	return saturate((lit - lightBleeding) / (1.0 - lightBleeding));
+}
+
+// Normalized gaussian weight, the kernel ends at two standard deviations
+float getBlurWeight(int offset, uint radius) {
+	if (radius == 0) return offset == 0 ? 1.0 : 0.0;
+
+	float sigma = radius * 0.5;
+	float total = 0;
+	for (int i = -(int)radius; i <= (int)radius; ++i) {
+		total += exp(-(float)(i * i) / (2.0 * sigma * sigma));
+	}
+	return exp(-(float)(offset * offset) / (2.0 * sigma * sigma)) / total;
+}
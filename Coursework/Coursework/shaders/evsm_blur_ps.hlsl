@@ -0,0 +1,32 @@
+#include "evsm.hlsli"
+
+// One direction of the separable gaussian, the texels past the edges are clamped
+Texture2DArray source : register(t0);
+
+cbuffer MomentsBlurBuffer : register(b0) {
+	int2 direction;
+	uint radius;
+	uint slice;
+};
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+float4 main(InputType input) : SV_TARGET {
+	uint width, height, elements;
+	source.GetDimensions(width, height, elements);
+	int2 last = int2(width, height) - 1;
+	int2 center = (int2)input.position.xy;
+	int r = (int)min(radius, EVSM_MAX_BLUR_RADIUS);
+
+	float4 moments = 0;
+	for (int i = -r; i <= r; ++i) {
+		int2 coords = clamp(center + direction * i, 0, last);
+		moments += source.Load(int4(coords, slice, 0)) * getBlurWeight(i, r);
+	}
+
+	return moments;
+}
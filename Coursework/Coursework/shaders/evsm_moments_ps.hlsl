@@ -0,0 +1,31 @@
+#include "evsm.hlsli"
+
+// Every texel is the average moments of scale * scale texels of the depth map
+Texture2DArray<float> depthMap : register(t0);
+
+cbuffer MomentsBuffer : register(b0) {
+	float nearZ;
+	float farZ;
+	uint scale;
+	uint slice;
+};
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+float4 main(InputType input) : SV_TARGET {
+	uint2 first = (uint2)input.position.xy * scale;
+	float4 moments = 0;
+
+	for (uint y = 0; y < scale; ++y) {
+		for (uint x = 0; x < scale; ++x) {
+			float depth = depthMap.Load(int4(first + uint2(x, y), slice, 0));
+			moments += encodeMoments(linearizeDepth(depth, nearZ, farZ));
+		}
+	}
+
+	return moments / (scale * scale);
+}
@@ -1,8 +1,13 @@
 // triangle_gs
 // Geometry shader that generates a triangle for every vertex.
 
+#include "wind.hlsli"
+#include "cbuffers.hlsli"
+
 Texture2D grassBase : register(t0);
+Texture2D<float2> windField : register(t1);
 SamplerState sampler0 : register(s0);
+SamplerState windSampler : register(s1);
 
 #define MAX_WAVE 10
 
@@ -17,14 +22,7 @@ cbuffer DefaultBuffer : register(b1) {
     float padding1;
 };
 
-cbuffer GrassBuffer : register(b2) {
-    float timePassed;
-    float3 windOrigin;
-    float windSpeed;
-    float waveAmplitude;
-    float2 padding2;
-    matrix spotLightMVP;
-};
+CBUFFER(GrassBuffer, b2, GRASS_BUFFER)
 
 struct InputType {
     float4 position : POSITION;
@@ -88,17 +86,11 @@ void addGrass(InputType v1, InputType v2, inout TriangleStream<OutputType> triSt
     // like they're pointing up, this makes the grass look more full
     topLeft += tangent * rand2;
 
-    // To calculate wind direction, get the average between the two
-    // bottom points, then get its direction relative to the "wind origin"
-    // (the monolith position) and normalize it, keep distance saved as 
-    // we'll need it for wind wave calculation
-    float3 windDir = (bottomLeft.xyz + bottomRight.xyz) / 2;
-    windDir = windDir - windOrigin;
-    float dist = length(windDir);
-    windDir = normalize(windDir);
-
-    // Move the top left corner according to the wind
-    topLeft.xyz -= windDir * sin(timePassed * windSpeed + dist / waveAmplitude);
+    // Sample the wind field in the middle of the two bottom points
+    // and move the top left corner according to the wind
+    float3 grassCenter = (bottomLeft.xyz + bottomRight.xyz) / 2;
+    float2 wind = sampleWind(windField, windSampler, grassCenter.xz, windFieldSize);
+    topLeft.xz += wind * windStrength;
     
     // Use a normal vector parallel to topLeft/bottomLeft to calculate the
     // top right corner
@@ -16,6 +16,7 @@ float4 main(InputType input) : SV_TARGET {
 	if (textureColour.a < 0.5) discard;
 	
 	float shadowMapBias = 0.005f;
+	float sunShadowMapBias = 0.0005f;
 
 	float4 result = 0;
 	float shadow = 0;
@@ -29,7 +30,10 @@ float4 main(InputType input) : SV_TARGET {
 		float3 dir = normalize(-dirSpot.lightDir);
 		float4 lightColour = getLighting(dir, input.normal, light.diffuse);
 		float4 specularCol = getSpecular(dir, input.normal, input.viewVector, light.specular, factors.specularPower);
-		result = lightColour + light.ambient + specularCol;
+
+		// -- Sun shadow map --------------------------------------------------------------------
+		float lit = 1 - getSunShadow(input.worldPosition.xyz, sunShadowMapBias);
+		result = (lightColour + specularCol) * lit + light.ambient;
 	}
 
 	// Spot light
@@ -50,7 +54,7 @@ float4 main(InputType input) : SV_TARGET {
 				lightColour += getLighting(lightVec, input.normal, light.diffuse);
 				lightColour += getSpecular(lightVec, input.normal, input.viewVector, light.specular, factors.specularPower);
 				
-				spotShadow = getShadow(spotShadowMap, input.spotViewPos, shadowMapBias) * (attenuation * 5);
+				spotShadow = getSpotShadow(input.spotViewPos, shadowMapBias) * (attenuation * 5);
 			}
 
 			result += lightColour * attenuation;
@@ -79,5 +83,6 @@ float4 main(InputType input) : SV_TARGET {
 	}
 
 	result = saturate(result - saturate(shadow));
+	result = saturate(result + getClusteredLighting(input.worldPosition.xyz, input.normal, input.viewVector));
 	return result * textureColour * input.color;
 }
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include "cbuffers.hlsli"
+
 struct InputType {
 	float4 position : POSITION;
 	float2 tex : TEXCOORD0;
@@ -15,13 +17,7 @@ struct OutputType {
 	float3 normal : NORMAL;
 };
 
-cbuffer GroundBuffer : register(b0) {
-	float3 cameraPos;
-	float cutoffDistance;
-	float maxDist;
-	float maxFactor;
-	float2 padding;
-};
+CBUFFER(GroundBuffer, b0, GROUND_BUFFER)
 
 ConstantOutputType PatchConstantFunction(
 	InputPatch<InputType, 3> inputPatch,
@@ -0,0 +1,133 @@
+#define PS
+#include "utils.hlsli"
+
+cbuffer ImpostorBuffer : register(b2) {
+	float3 impostorCenter;
+	float impostorRadius;
+	float framesPerSide;
+	float hemisphere;
+	float2 impostorPadding;
+};
+
+// rgb: world space normal, a: depth towards the viewer
+Texture2D normalDepthAtlas : register(t3);
+
+struct InputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 worldPosition : WORLD_POS;
+	float3 viewVector : VIEW_VEC;
+	float4 spotViewPos : SPOT_LIGHT_POS;
+	float2 frame : FRAME;
+	float fade : FADE;
+};
+
+// 4x4 ordered dither, used to fade in the impostors without sorting
+static const float ditherMatrix[16] = {
+	 0.5 / 16.0,  8.5 / 16.0,  2.5 / 16.0, 10.5 / 16.0,
+	12.5 / 16.0,  4.5 / 16.0, 14.5 / 16.0,  6.5 / 16.0,
+	 3.5 / 16.0, 11.5 / 16.0,  1.5 / 16.0,  9.5 / 16.0,
+	15.5 / 16.0,  7.5 / 16.0, 13.5 / 16.0,  5.5 / 16.0,
+};
+
+float4 main(InputType input) : SV_TARGET{
+	uint2 pixel = uint2(input.position.xy) % 4;
+	clip(input.fade - ditherMatrix[pixel.y * 4 + pixel.x]);
+
+	// blend the 4 frames around the view direction
+	float2 cell = clamp(floor(input.frame), 0, framesPerSide - 2);
+	float2 t = saturate(input.frame - cell);
+
+	const float2 offsets[4] = { float2(0, 0), float2(1, 0), float2(0, 1), float2(1, 1) };
+	const float weights[4] = {
+		(1 - t.x) * (1 - t.y), t.x * (1 - t.y),
+		(1 - t.x) * t.y,       t.x * t.y,
+	};
+
+	float4 textureColour = 0;
+	float4 normalDepth = 0;
+	for (int i = 0; i < 4; ++i) {
+		float2 uv = (cell + offsets[i] + input.tex) / framesPerSide;
+		textureColour += diffTexture.Sample(diffSampler, uv) * weights[i];
+		normalDepth += normalDepthAtlas.Sample(diffSampler, uv) * weights[i];
+	}
+
+	clip(textureColour.a - 0.5f);
+
+	float3 normal = normalize(normalDepth.rgb * 2 - 1);
+	float3 worldPosition = input.worldPosition + input.normal * (normalDepth.a * 2 - 1) * impostorRadius;
+	
+	const float shadowMapBias = 0.005f;
+	const float pointShadowMapBias = 0.0001f;
+	const float sunShadowMapBias = 0.0005f;
+
+	float4 result = 0;
+	float shadow = 0;
+
+	// Directional light
+	{
+		LightData light     = sharedLightData[0];
+		DirSpotData dirSpot = dirSpotData[0];
+		Factor factors      = factor[0];
+
+		float3 dir = normalize(-dirSpot.lightDir);
+		float4 lightColour = getLighting(dir, normal, light.diffuse);
+		float4 specularCol = getSpecular(dir, normal, input.viewVector, light.specular, factors.specularPower);
+
+		// -- Sun shadow map --------------------------------------------------------------------
+		float lit = 1 - getSunShadow(worldPosition, sunShadowMapBias);
+		result = (lightColour + specularCol) * lit + light.ambient;
+	}
+
+	// Point light
+	{
+		LightData light = sharedLightData[2];
+		Factor factors = factor[2];
+
+		float3 lightVector = light.position.xyz - worldPosition;
+
+		float attenuation = getAttenuation(length(lightVector), factors.constant, factors.lin, factors.quadratic);
+		lightVector = normalize(lightVector);
+		float4 lightColour = getLighting(lightVector, normal, light.diffuse);
+		float4 specularCol = getSpecular(lightVector, normal, input.viewVector, light.specular, factors.specularPower);
+
+		result += (lightColour + light.ambient + specularCol) * attenuation;
+
+		// -- Point shadow map ------------------------------------------------------------------
+		shadow += getPointShadow(worldPosition, pointShadowMapBias) * (attenuation * 5);
+	}
+
+	// Spot light
+	{
+		LightData light = sharedLightData[1];
+		DirSpotData dirSpot = dirSpotData[1];
+		Factor factors = factor[1];
+
+		if (dirSpot.spotCutoff < 1.f) {
+			float3 lightVec = light.position.xyz - worldPosition;
+			float attenuation = getAttenuation(length(lightVec), factors.constant, factors.lin, factors.quadratic);
+			lightVec = normalize(lightVec);
+
+			float4 lightColour = light.ambient;
+			float spotShadow = 0;
+
+			if (isInsideSpotlight(lightVec, dirSpot.lightDir, dirSpot.spotCutoff)) {
+				lightColour += getLighting(lightVec, normal, light.diffuse);
+				lightColour += getSpecular(lightVec, normal, input.viewVector, light.specular, factors.specularPower);
+
+				// the quad's position, close enough for far away trees
+				spotShadow = getSpotShadow(input.spotViewPos, shadowMapBias) * (attenuation * 5);
+			}
+
+			result += lightColour * attenuation;
+			
+			// -- Spot shadow map -------------------------------------------------------------------
+			shadow += spotShadow;
+		}
+	}
+
+	result = saturate(result - saturate(shadow));
+	result = saturate(result + getClusteredLighting(worldPosition, normal, input.viewVector));
+	return float4((result * textureColour).rgb, 1.f);
+}
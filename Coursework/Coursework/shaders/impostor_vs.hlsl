@@ -0,0 +1,64 @@
+#define VS
+#include "utils.hlsli"
+
+cbuffer ImpostorBuffer : register(b3) {
+	float3 impostorCenter;
+	float impostorRadius;
+	float framesPerSide;
+	float hemisphere;
+	float2 impostorPadding;
+};
+
+struct InputType {
+	float4 position : POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 instancePosition : INSTANCE_POS;
+	float instanceFade : INSTANCE_FADE;
+	float2 instanceFrame : INSTANCE_FRAME;
+};
+
+struct OutputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 worldPosition : WORLD_POS;
+	float3 viewVector : VIEW_VEC;
+	float4 spotViewPos : SPOT_LIGHT_POS;
+	float2 frame : FRAME;
+	float fade : FADE;
+};
+
+OutputType main(InputType input) {
+	OutputType output;
+
+	float3 center = input.instancePosition + impostorCenter;
+
+	// the same basis used when baking (impostorBasis), the quad always faces the camera
+	float3 dir = cameraPosition - center;
+	if (hemisphere > 0.5f) dir.y = max(dir.y, 0.f);
+	dir = dot(dir, dir) > 0.f ? normalize(dir) : float3(0.f, 1.f, 0.f);
+
+	float3 ref = abs(dir.y) > 0.999f ? float3(0.f, 0.f, 1.f) : float3(0.f, 1.f, 0.f);
+	float3 right = normalize(cross(dir, ref));
+	float3 up = cross(-dir, right);
+
+	float3 position = center + (right * input.position.x + up * input.position.y) * impostorRadius;
+
+	float4 worldPosition = mul(float4(position, 1.f), worldMatrix);
+	output.worldPosition = worldPosition.xyz;
+	output.viewVector = cameraPosition.xyz - worldPosition.xyz;
+	output.viewVector = normalize(output.viewVector);
+
+	output.position = mul(worldPosition, viewMatrix);
+	output.position = mul(output.position, projectionMatrix);
+
+	output.tex = input.tex;
+	// direction the quad is facing, used to rebuild the world position from the baked depth
+	output.normal = dir;
+	output.spotViewPos = mul(worldPosition, spotLightMVP);
+	output.frame = input.instanceFrame;
+	output.fade = input.instanceFade;
+
+	return output;
+}
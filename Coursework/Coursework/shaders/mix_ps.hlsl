@@ -1,7 +1,12 @@
+#include "cbuffers.hlsli"
+
+// The bloom (A) added to the scene (B), see BloomChain::mix
 Texture2D textureA : register(t0);
 Texture2D textureB : register(t1);
 SamplerState diffSampler : register(s0);
 
+CBUFFER(MixBuffer, b0, MIX_BUFFER)
+
 struct InputType {
 	float4 position : SV_POSITION;
 	float2 tex : TEXCOORD0;
@@ -12,5 +17,5 @@ float4 main(InputType input) : SV_TARGET{
 	float4 colA = textureA.Sample(diffSampler, input.tex);
 	float4 colB = textureB.Sample(diffSampler, input.tex);
 
-	return saturate(colA + colB);
+	return saturate(colA * bloomIntensity + colB);
 }
@@ -6,6 +6,9 @@ cbuffer MatrixBuffer : register(b0) {
 
 cbuffer CubemapBuffer : register(b1) {
 	matrix cubeViewMatrix[6];
+	// a bit for every face the draw is in, from CubeFaceCuller
+	uint faceMask;
+	uint3 cubemapPadding;
 }
 
 struct InputType {
@@ -21,6 +24,8 @@ struct OutputType {
 [maxvertexcount(18)]
 void main(triangle InputType input[3], inout TriangleStream<OutputType> cubemapStream) {
 	for (int f = 0; f < 6; ++f) {
+		if ((faceMask & (1u << f)) == 0) continue;
+
 		OutputType output;
 		output.RTIndex = f;
 		for (int v = 0; v < 3; ++v) {
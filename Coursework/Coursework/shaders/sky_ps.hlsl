@@ -2,24 +2,12 @@
  * https://www.patreon.com/posts/making-stylized-27402644
  */
 
+#include "cbuffers.hlsli"
+
 Texture2D starsTexture : register(t0);
 SamplerState sampler0 : register(s0);
 
-cbuffer SkyBuffer : register(b0) {
-	float3 lightDir;
-	float padding;
-	float4 sunCol;
-	float4 moonCol;
-	float4 dayBottomCol;
-	float4 dayTopCol;
-	float4 nightBottomCol;
-	float4 nightTopCol;
-	float4 sunsetCol;
-	float radius;
-	float moonOffset;
-	float horizonIntensity;
-	float starsExponent;
-}
+CBUFFER(SkyBuffer, b0, SKY_BUFFER)
 
 struct InputType {
 	float4 position : SV_POSITION;
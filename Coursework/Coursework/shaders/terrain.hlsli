@@ -0,0 +1,71 @@
+/* Shared by the terrain vertex shaders.
+ * Every instance is a patch of the CDLOD quadtree, the grid vertices
+ * (in the [0, 1] range) are scaled to the patch, morphed towards the
+ * next lod and then displaced using the streamed heightfield tiles.
+ */
+
+cbuffer TerrainBuffer : register(b3) {
+	float4 morphRanges[16]; // x: start, y: end
+	float worldSize;
+	float tileSize;
+	float heightScale;
+	float gridDim;
+	uint tilesPerSide;
+	float tileResolution;
+	float textureScale;
+	float terrainPadding;
+};
+
+Texture2DArray heightTiles : register(t0);
+Texture2D<uint> tileSlots : register(t1);
+SamplerState heightSampler : register(s0);
+
+#define NO_SLOT 0xFFFF
+
+float getHeight(float2 worldXZ) {
+	float2 pos = worldXZ + worldSize * 0.5;
+	float2 tile = clamp(floor(pos / tileSize), 0, tilesPerSide - 1);
+
+	uint slot = tileSlots.Load(int3(tile, 0));
+	// tile not loaded (yet) or missing, keep it flat
+	if (slot == NO_SLOT) {
+		return 0.0;
+	}
+
+	// sample in the centre of the texels, the borders are shared with the neighbours
+	float2 local = saturate(pos / tileSize - tile);
+	float2 uv = (local * (tileResolution - 1.0) + 0.5) / tileResolution;
+	return heightTiles.SampleLevel(heightSampler, float3(uv, slot), 0).r * heightScale;
+}
+
+float3 getTerrainNormal(float2 worldXZ, float step) {
+	float left  = getHeight(worldXZ - float2(step, 0));
+	float right = getHeight(worldXZ + float2(step, 0));
+	float down  = getHeight(worldXZ - float2(0, step));
+	float up    = getHeight(worldXZ + float2(0, step));
+	return normalize(float3(left - right, 2.0 * step, down - up));
+}
+
+/* Moves the odd vertices of the grid on top of the even ones as the patch
+ * gets closer to the end of its lod range, at the end of the range the
+ * patch looks exactly like the next lod.
+ */
+float2 morphVertex(float2 gridPos, float2 worldXZ, float size, float morphK) {
+	float2 fracPart = frac(gridPos * gridDim * 0.5) * 2.0 / gridDim;
+	return worldXZ - fracPart * size * morphK;
+}
+
+float3 getTerrainPosition(float2 gridPos, float4 patch, float3 camPos) {
+	float size = patch.z;
+	uint lod = (uint)patch.w;
+
+	float2 worldXZ = patch.xy + gridPos * size;
+	float3 approx = float3(worldXZ.x, getHeight(worldXZ), worldXZ.y);
+
+	float dist = distance(approx, camPos);
+	float2 range = morphRanges[lod].xy;
+	float morphK = saturate((dist - range.x) / (range.y - range.x));
+
+	worldXZ = morphVertex(gridPos, worldXZ, size, morphK);
+	return float3(worldXZ.x, getHeight(worldXZ), worldXZ.y);
+}
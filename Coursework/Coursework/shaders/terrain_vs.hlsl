@@ -0,0 +1,49 @@
+// Terrain vertex shader
+
+#define VS
+#include "utils.hlsli"
+#include "terrain.hlsli"
+
+struct InputType {
+	float4 position : POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float4 patch : PATCH;
+};
+
+struct OutputType {
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 worldPosition : WORLD_POS;
+	float3 viewVector : VIEW_VEC;
+	float4 spotViewPos : SPOT_LIGHT_POS;
+};
+
+OutputType main(InputType input) {
+	OutputType output;
+
+	float3 terrainPos = getTerrainPosition(input.position.xz, input.patch, cameraPosition);
+
+	float4 worldPosition = mul(float4(terrainPos, 1.0), worldMatrix);
+	output.worldPosition = worldPosition.xyz;
+	output.viewVector = cameraPosition.xyz - worldPosition.xyz;
+	output.viewVector = normalize(output.viewVector);
+
+	// Calculate the position of the vertex against the world, view, and projection matrices.
+	output.position = worldPosition;
+	output.position = mul(output.position, viewMatrix);
+	output.position = mul(output.position, projectionMatrix);
+
+	// the texture is tiled in world space, this way it doesn't change between lods
+	output.tex = terrainPos.xz / textureScale;
+
+	// use the size of a grid cell as the step, farther patches get smoother normals
+	float step = input.patch.z / gridDim;
+	output.normal = mul(getTerrainNormal(terrainPos.xz, step), (float3x3)worldMatrix);
+	output.normal = normalize(output.normal);
+
+	output.spotViewPos = mul(worldPosition, spotLightMVP);
+
+	return output;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+// Terrain depth vertex shader
+
+#define VS
+#include "utils.hlsli"
+#include "terrain.hlsli"
+
+struct InputType {
+	float4 position : POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float4 patch : PATCH;
+};
+
+struct OutputType {
+	float4 position : SV_POSITION;
+	float4 depthPosition : TEXCOORD0;
+};
+
+OutputType main(InputType input) {
+	OutputType output;
+
+	float3 terrainPos = getTerrainPosition(input.position.xz, input.patch, cameraPosition);
+
+	// Calculate the position of the vertex against the world, view, and projection matrices.
+	output.position = mul(float4(terrainPos, 1.0), worldMatrix);
+	output.position = mul(output.position, viewMatrix);
+	output.position = mul(output.position, projectionMatrix);
+
+	output.depthPosition = output.position;
+
+	return output;
+}
\ No newline at end of file
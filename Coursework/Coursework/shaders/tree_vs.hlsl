@@ -1,12 +1,11 @@
 #define VS
 #include "utils.hlsli"
+#include "wind.hlsli"
 
-cbuffer TreeBuffer : register(b3) {
-	float3 windOrigin;
-	float windAmplitude;
-	float windSpeed;
-	float3 treePadding;
-};
+CBUFFER(TreeBuffer, b3, TREE_BUFFER)
+
+Texture2D<float2> windField : register(t0);
+SamplerState windSampler : register(s0);
 
 struct InputType {
 	float4 position : POSITION;
@@ -33,11 +32,12 @@ OutputType main(InputType input) {
 	float4 position = input.position;
 	float3 normal = input.normal;
 
-	float3 direction = normalize(windOrigin - input.instancePosition);
-	float angle = sin(timePassed * windSpeed) * position.y * windAmplitude;
+	// bend the tree along the wind, higher vertices move more
+	float2 wind = sampleWind(windField, windSampler, input.instancePosition.xz, windFieldSize);
+	float angle = position.y * windAmplitude;
 
-	float3x3 rotx = rotX(angle * dot(direction, float3(0.0, 0.0, -1.0)));
-	float3x3 rotz = rotZ(angle * dot(direction, float3(1.0, 0.0, 0.0)));
+	float3x3 rotx = rotX(angle * wind.y);
+	float3x3 rotz = rotZ(-angle * wind.x);
 	float3x3 rot = mul(rotz, rotx);
 
 	position.xyz = mul(rot, position.xyz);
@@ -1,17 +1,30 @@
 #define LIGHTS_COUNT 3
 #define CASCADED_SIZE 3
+// matches LightClusters
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+// matches ShadowMoments::Filter
+#define SHADOW_FILTER_HARD 0
+#define SHADOW_FILTER_EVSM 1
+
+#include "evsm.hlsli"
+#include "cbuffers.hlsli"
 
 /* PCF can be turned off for both the shadow maps, with these options:
  * - SHADOW_USE_BLUR turns on PCF for spot shadow maps
  * - SHADOW_BLUR_SAMPLE how many pixels should be looked up on the left/right up/down
  * - POINT_SHADOW_USE_BLUR turns on PCF for omni directional shadow maps
  * - POINT_SHADOW_DISK_RADIUS the radius of the disk used to look up values around the shadow map
+ * The first three are features of ShaderPermutations: they are not defined
+ * here, the variants are compiled with them and picked at runtime. The
+ * .cso of every shader is the variant without any of them.
  */
 
-// #define SHADOW_USE_BLUR
+#ifndef SHADOW_BLUR_SAMPLE
 #define SHADOW_BLUR_SAMPLE 15
+#endif
 
-// #define POINT_SHADOW_USE_BLUR
 #define POINT_SHADOW_DISK_RADIUS 0.5
 
 #ifdef VS
@@ -44,38 +57,50 @@ cbuffer ShadowBuffer : register(b2) {
 
 #ifndef DONT_USE_DEFAULT_PS_BUFFERS
 
-/* We put lightDir first, as only the directional light needs it,
- * The struct Factor also contains specularPow as it would only be empty
- * padding
- */
-cbuffer LightBuffer : register(b0) {
-	struct DirSpotData {
-		float3 lightDir;
-		float spotCutoff;
-	} dirSpotData[2];
-
-	struct LightData {
-		float4 ambient;
-		float4 diffuse;
-		float4 specular;
-		float4 position;
-	} sharedLightData[LIGHTS_COUNT];
-
-	struct Factor {
-		float constant;
-		float lin;
-		float quadratic;
-		float specularPower;
-	} factor[LIGHTS_COUNT];
-
-	float3 pointLightPos;
-	float lightPadding;
-};
+// the lights, the fields are in cbuffers.hlsli
+CBUFFER_STRUCT(DirSpotData, DIR_SPOT_DATA)
+CBUFFER_STRUCT(LightData, LIGHT_DATA)
+CBUFFER_STRUCT(Factor, LIGHT_FACTOR)
+CBUFFER(LightBuffer, b0, LIGHT_BUFFER)
 
 cbuffer MaterialBuffer : register(b1) {
 	float4 matColor;
 }
 
+// b2 is left to the shaders, the impostors use it
+cbuffer CascadeBuffer : register(b3) {
+	matrix cascadeViewProj[CASCADED_SIZE];
+	float4 cascadeSplits; // far end of every cascade, in view space
+	float3 cascadeCameraPos;
+	float cascadeCount;
+	float3 cascadeCameraForward;
+	float cascadePadding;
+};
+
+cbuffer ClusterBuffer : register(b4) {
+	matrix clusterViewProj;
+	float3 clusterCameraPos;
+	float clusterSliceScale;
+	float3 clusterCameraForward;
+	float clusterSliceBias;
+	uint clusterLightCount;
+	uint3 clusterPadding;
+};
+
+cbuffer ShadowFilterBuffer : register(b5) {
+	uint spotShadowFilter;
+	float spotNearZ;
+	float spotFarZ;
+	float spotLightBleeding;
+	uint pointShadowFilter;
+	float pointNearZ;
+	float pointFarZ;
+	float pointLightBleeding;
+	float spotMinVariance;
+	float pointMinVariance;
+	float2 shadowFilterPadding;
+};
+
 #endif // DONT_USE_DEFAULT_PS_BUFFERS
 
 #ifdef VS
@@ -107,9 +132,29 @@ float3x3 rotZ(float angle) {
 Texture2D diffTexture         : register(t0);
 Texture2D spotShadowMap       : register(t1);
 TextureCube cubemap           : register(t2);
+Texture2DArray sunShadowMap   : register(t4);
+
+// Unshadowed local lights, binned in clusters by LightClusters
+struct ClusterLight {
+	float3 position;
+	float range;
+	float3 color;
+	float cosAngle; // -2 for point lights
+	float3 direction;
+	float padding;
+};
+
+StructuredBuffer<ClusterLight> clusterLights : register(t5);
+StructuredBuffer<uint2> clusterRanges        : register(t6); // offset and count in clusterIndices
+StructuredBuffer<uint> clusterIndices        : register(t7);
+
+// Moments of the lights that filter their shadows with EVSM
+Texture2D spotMoments         : register(t8);
+TextureCube pointMoments      : register(t9);
 
 SamplerState diffSampler      : register(s0);
 SamplerState shadowMapSampler : register(s1);
+SamplerState momentsSampler   : register(s2);
 
 static const float3 cubeOffsetDirection[20] = {
    float3(1,  1,  1), float3( 1, -1,  1), float3(-1, -1,  1), float3(-1,  1,  1),
@@ -216,6 +261,81 @@ float getShadow(
 #undef SHADOW_BLUR_SIZE
 #undef SHADOW_BLUR2
 
+// Shadow of the spot light, with the depth or the moments
+float getSpotShadow(float4 lightViewPosition, float bias) {
+	if (spotShadowFilter != SHADOW_FILTER_EVSM) {
+		return getShadow(spotShadowMap, lightViewPosition, bias);
+	}
+
+	// the mipmaps are the filter, sampled before the branch so the derivatives are right
+	float2 uv = getProjectiveCoords(lightViewPosition);
+	float4 moments = spotMoments.Sample(momentsSampler, uv);
+	if (!hasDepthData(uv)) return 0;
+
+	// w is the view depth of the perspective projection
+	float depth = saturate((lightViewPosition.w - spotNearZ) / (spotFarZ - spotNearZ));
+	return 1 - getMomentsVisibility(moments, depth, spotMinVariance, spotLightBleeding);
+}
+
+// Shadow of the directional light, the cascade is picked from the view depth
+float getSunShadow(float3 worldPosition, float bias) {
+	float depth = dot(worldPosition - cascadeCameraPos, cascadeCameraForward);
+
+	int cascade = 0;
+	[unroll]
+	for (int i = 0; i < CASCADED_SIZE - 1; ++i) {
+		cascade += depth > cascadeSplits[i] ? 1 : 0;
+	}
+	// past the last cascade there are no shadows
+	if (cascade >= (int)cascadeCount || depth > cascadeSplits[cascade]) return 0;
+
+	float4 lightViewPosition = mul(float4(worldPosition, 1.f), cascadeViewProj[cascade]);
+	float2 uv = getProjectiveCoords(lightViewPosition);
+	if (!hasDepthData(uv)) return 0;
+
+	// orthographic, w is always 1
+	float lightDepthValue = lightViewPosition.z - bias;
+	float depthValue = sunShadowMap.SampleLevel(shadowMapSampler, float3(uv, cascade), 0).r;
+	return (lightDepthValue >= depthValue) ? 1 : 0;
+}
+
+// Lighting of the local lights in the cluster of the pixel, they fade out to 0 at their range
+float4 getClusteredLighting(float3 worldPosition, float3 normal, float3 viewVector) {
+	if (clusterLightCount == 0) return 0;
+
+	float depth = dot(worldPosition - clusterCameraPos, clusterCameraForward);
+	if (depth <= 0) return 0;
+	int slice = max((int)floor(log(depth) * clusterSliceScale + clusterSliceBias), 0);
+	if (slice >= CLUSTER_SLICES) return 0;
+
+	float4 clipPosition = mul(float4(worldPosition, 1.f), clusterViewProj);
+	float2 ndc = clipPosition.xy / clipPosition.w;
+	int x = clamp((int)floor((ndc.x + 1.f) * 0.5f * CLUSTER_TILES_X), 0, CLUSTER_TILES_X - 1);
+	int y = clamp((int)floor((1.f - ndc.y) * 0.5f * CLUSTER_TILES_Y), 0, CLUSTER_TILES_Y - 1);
+
+	uint2 range = clusterRanges[(slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x];
+	float4 result = 0;
+
+	for (uint i = 0; i < range.y; ++i) {
+		ClusterLight light = clusterLights[clusterIndices[range.x + i]];
+
+		float3 lightVector = light.position - worldPosition;
+		float dist = length(lightVector);
+		if (dist >= light.range) continue;
+		lightVector /= dist;
+
+		// smooth window that reaches 0 at the range, so the clusters' bounds are exact
+		float window = saturate(1.f - pow(dist / light.range, 4));
+		float attenuation = window * window / (dist * dist + 1.f);
+		attenuation *= smoothstep(light.cosAngle, lerp(light.cosAngle, 1.f, 0.2f), dot(-lightVector, light.direction));
+
+		float4 colour = float4(light.color, 1.f);
+		result += (getLighting(lightVector, normal, colour) + getSpecular(lightVector, normal, viewVector, colour, 16.f)) * attenuation;
+	}
+
+	return result;
+}
+
 float vecToDepth(float3 vec) {
 	float3 absVec = abs(vec);
 	float localZComp = max(absVec.x, max(absVec.y, absVec.z));
@@ -228,6 +348,15 @@ float vecToDepth(float3 vec) {
 
 float getPointShadow(float3 fragPos, float shadowBias) {
 	float3 fragToLight = fragPos - pointLightPos;
+
+	if (pointShadowFilter == SHADOW_FILTER_EVSM) {
+		// the view depth of a face is the biggest component
+		float3 absVec = abs(fragToLight);
+		float viewZ = max(absVec.x, max(absVec.y, absVec.z));
+		float depth = saturate((viewZ - pointNearZ) / (pointFarZ - pointNearZ));
+		float4 moments = pointMoments.Sample(momentsSampler, fragToLight);
+		return 1 - getMomentsVisibility(moments, depth, pointMinVariance, pointLightBleeding);
+	}
 	float depth = vecToDepth(fragToLight);
 	
 #ifndef POINT_SHADOW_USE_BLUR
@@ -0,0 +1,8 @@
+/* The wind field is simulated on the cpu (WindField), it's a velocity
+ * texture covering fieldSize^2 world units centered on the origin.
+ * Outside of it the velocity at the border is used.
+ */
+float2 sampleWind(Texture2D<float2> field, SamplerState samp, float2 worldXZ, float fieldSize) {
+	float2 uv = worldXZ / fieldSize + 0.5;
+	return field.SampleLevel(samp, uv, 0);
+}
\ No newline at end of file
@@ -2,7 +2,12 @@
 
 #include <stdint.h>
 #include <DirectXMath.h>
+
+// cpu-only modules (e.g. the terrain quadtree) don't need d3d11, this way
+// they can also be built outside of windows
+#ifdef _WIN32
 #include <d3d11.h>
+#endif
 
 using uchar = unsigned char;
 using ushort = unsigned short;
@@ -32,6 +37,8 @@ using float4 = DirectX::XMFLOAT4;
 
 using mat4 = DirectX::XMMATRIX;
 
+#ifdef _WIN32
 using TextureType   = ID3D11ShaderResourceView;
 using Device        = ID3D11Device;
-using DeviceContext = ID3D11DeviceContext;
\ No newline at end of file
+using DeviceContext = ID3D11DeviceContext;
+#endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "test.h"
+
+#include <chrono>
+
+#include "BloomChain.h"
+#include "MathUtils.h"
+
+using Image = BloomChain::Image;
+using Params = BloomChain::Params;
+
+// 4 levels, the sizes of the last ones are odd
+static const u32 WIDTH = 160;
+static const u32 HEIGHT = 90;
+
+static f32 maxDiff(const vec4f &a, const vec4f &b) {
+	vec4f diff = a - b;
+	return max(max(fabsf(diff.x), fabsf(diff.y)), max(fabsf(diff.z), fabsf(diff.w)));
+}
+
+static u32 countDifferent(const Image &a, const Image &b, f32 tolerance) {
+	if (a.width != b.width || a.height != b.height) return (u32)max(a.pixels.size(), b.pixels.size());
+	u32 different = 0;
+	for (u32 i = 0; i < a.pixels.size(); ++i) {
+		if (maxDiff(a.pixels[i], b.pixels[i]) > tolerance) different++;
+	}
+	return different;
+}
+
+TEST(bloomChainLevelsStopAtTheMinimumSize) {
+	CHECK(BloomChain::getLevelCount(1920, 1080, BloomChain::MAX_LEVELS) == 6);
+	CHECK(BloomChain::getLevelCount(1920, 1080, 3) == 3);
+	CHECK(BloomChain::getLevelCount(WIDTH, HEIGHT, BloomChain::MAX_LEVELS) == 4);
+	CHECK(BloomChain::getLevelCount(7, 7, BloomChain::MAX_LEVELS) == 0);
+
+	u32 width = 0, height = 0;
+	BloomChain::getLevelSize(1920, 1080, 0, width, height);
+	CHECK(width == 960 && height == 540);
+	BloomChain::getLevelSize(WIDTH, HEIGHT, 3, width, height);
+	CHECK(width == 10 && height == 5);
+
+	// a few levels read a lot less than a wide separable blur
+	CHECK(BloomChain::getChainFetches(1920, 1080, BloomChain::MAX_LEVELS) < BloomChain::getSeparableFetches(33));
+}
+
+TEST(bloomChainKeepsAConstantImage) {
+	// every filter is normalized, so a constant scene gives the same constant
+	// on every level and the top one is the sum of them
+	const vec4f colour(0.5f, 0.25f, 0.125f, 2.f);
+	const u32 levels = BloomChain::getLevelCount(WIDTH, HEIGHT, BloomChain::MAX_LEVELS);
+	Image scene, out, bloom;
+	scene.resize(WIDTH, HEIGHT);
+	for (vec4f &p : scene.pixels) p = colour;
+
+	for (u32 simd = 0; simd < 2; ++simd) {
+		Params params;
+		params.useSimd = simd == 1;
+		BloomChain::apply(scene, params, out, &bloom);
+
+		u32 errors = 0;
+		for (const vec4f &p : bloom.pixels) {
+			if (maxDiff(p / (f32)levels, vec4f(colour.x, colour.y, colour.z, 0.f)) > 1e-5f) errors++;
+		}
+		CHECK(bloom.width == WIDTH / 2 && bloom.height == HEIGHT / 2);
+		CHECK(errors == 0);
+	}
+}
+
+TEST(bloomChainRespectsTheThreshold) {
+	// without the monolith nothing blooms, the scene is left as it is
+	Image scene, out, bloom;
+	BloomChain::makeTestScene(WIDTH, HEIGHT, scene);
+	for (vec4f &p : scene.pixels) p.w = min(p.w, 1.f);
+
+	for (u32 simd = 0; simd < 2; ++simd) {
+		Params params;
+		params.useSimd = simd == 1;
+		BloomChain::apply(scene, params, out, &bloom);
+		CHECK(countDifferent(out, scene, 0.f) == 0);
+
+		u32 lit = 0;
+		for (const vec4f &p : bloom.pixels) {
+			if (p != vec4f()) lit++;
+		}
+		CHECK(lit == 0);
+	}
+
+	// with it, the pixels around it are brighter
+	BloomChain::makeTestScene(WIDTH, HEIGHT, scene);
+	BloomChain::apply(scene, Params(), out);
+	vec4f before = scene.at(WIDTH / 2 - WIDTH / 16 - 4, HEIGHT / 2);
+	vec4f after = out.at(WIDTH / 2 - WIDTH / 16 - 4, HEIGHT / 2);
+	CHECK(after.x > before.x && after.y > before.y && after.z > before.z);
+}
+
+TEST(bloomChainIsSymmetric) {
+	// a scene turned by 180 degrees has to give the same image turned, any
+	// half texel off in the taps moves the bloom to one side. The prefilter
+	// drops the last row and column of odd sizes, so the size is even
+	Image scene, turned, out, turnedOut;
+	BloomChain::makeTestScene(WIDTH, HEIGHT, scene);
+	// not symmetric on its own, so the check doesn't depend on it
+	for (u32 x = 0; x < WIDTH / 3; ++x) scene.at(x, HEIGHT / 3) = vec4f(1.f, 0.5f, 0.f, 10.f);
+
+	turned.resize(WIDTH, HEIGHT);
+	for (u32 y = 0; y < HEIGHT; ++y) {
+		for (u32 x = 0; x < WIDTH; ++x) {
+			turned.at(WIDTH - 1 - x, HEIGHT - 1 - y) = scene.at(x, y);
+		}
+	}
+
+	for (u32 simd = 0; simd < 2; ++simd) {
+		Params params;
+		params.useSimd = simd == 1;
+		BloomChain::apply(scene, params, out);
+		BloomChain::apply(turned, params, turnedOut);
+
+		u32 errors = 0;
+		for (u32 y = 0; y < HEIGHT; ++y) {
+			for (u32 x = 0; x < WIDTH; ++x) {
+				if (maxDiff(out.at(x, y), turnedOut.at(WIDTH - 1 - x, HEIGHT - 1 - y)) > 1e-4f) errors++;
+			}
+		}
+		CHECK(errors == 0);
+	}
+}
+
+TEST(bloomChainSseMatchesScalar) {
+	Image scene;
+	BloomChain::makeTestScene(WIDTH, HEIGHT, scene);
+	u32 seed = 1234;
+	for (vec4f &p : scene.pixels) {
+		p.x += randomFloat(seed, 0.f, 0.5f);
+		if (randomFloat(seed, 0.f, 1.f) < 0.05f) p.w = 4.f;
+	}
+
+	// every filter on its own, then the chain
+	Image simd, scalar, lowerSimd, lowerScalar, upSimd, upScalar;
+	BloomChain::prefilter(scene, simd, true);
+	BloomChain::prefilter(scene, scalar, false);
+	CHECK(countDifferent(simd, scalar, 1e-6f) == 0);
+
+	BloomChain::downsample(simd, lowerSimd, true);
+	BloomChain::downsample(simd, lowerScalar, false);
+	CHECK(countDifferent(lowerSimd, lowerScalar, 1e-5f) == 0);
+
+	BloomChain::upsample(lowerSimd, simd, 1.5f, upSimd, true);
+	BloomChain::upsample(lowerSimd, simd, 1.5f, upScalar, false);
+	CHECK(countDifferent(upSimd, upScalar, 1e-5f) == 0);
+
+	BloomChain::mix(scene, upSimd, 0.5f, simd, true);
+	BloomChain::mix(scene, upSimd, 0.5f, scalar, false);
+	CHECK(countDifferent(simd, scalar, 1e-6f) == 0);
+
+	Params params;
+	Image bloomSimd, bloomScalar;
+	BloomChain::apply(scene, params, simd, &bloomSimd);
+	params.useSimd = false;
+	BloomChain::apply(scene, params, scalar, &bloomScalar);
+	CHECK(countDifferent(bloomSimd, bloomScalar, 1e-4f) == 0);
+	CHECK(countDifferent(simd, scalar, 1e-4f) == 0);
+}
+
+TEST(bloomChainMatchesTheGoldenValues) {
+	// worked out by hand from the taps and the bilinear weights
+	for (u32 simd = 0; simd < 2; ++simd) {
+		bool useSimd = simd == 1;
+
+		// only the pixels over the threshold are averaged, without their alpha
+		Image scene, prefiltered;
+		scene.resize(4, 2);
+		scene.at(0, 0) = vec4f(1.f, 0.5f, 0.f, 2.f);
+		scene.at(1, 0) = vec4f(1.f, 1.f, 1.f, 1.5f); // right on the threshold
+		scene.at(0, 1) = vec4f(0.2f, 0.4f, 0.8f, 10.f);
+		scene.at(1, 1) = vec4f(9.f, 9.f, 9.f, 0.f);
+		scene.at(3, 1) = vec4f(1.f, 1.f, 1.f, 1.f);
+		BloomChain::prefilter(scene, prefiltered, useSimd);
+		CHECK(prefiltered.width == 2 && prefiltered.height == 1);
+		CHECK(maxDiff(prefiltered.at(0, 0), vec4f(0.3f, 0.225f, 0.2f, 0.f)) < 1e-6f);
+		CHECK(prefiltered.at(1, 0) == vec4f());
+
+		// one texel, the 13 taps spread it over the texels around it
+		Image texel, down;
+		texel.resize(8, 8);
+		texel.at(3, 3) = vec4f(1.f);
+		BloomChain::downsample(texel, down, useSimd);
+		CHECK(down.width == 4 && down.height == 4);
+		CHECK_NEAR(down.at(1, 1).x, 0.0625f, 1e-6f);
+		CHECK_NEAR(down.at(2, 2).x, 0.0390625f, 1e-6f);
+		CHECK_NEAR(down.at(2, 1).x, 0.046875f, 1e-6f);
+		CHECK(down.at(0, 3) == vec4f());
+		// nothing is lost, a texel of the level is 4 of the one above
+		f32 total = 0.f;
+		for (const vec4f &p : down.pixels) total += p.x * 4.f;
+		CHECK_NEAR(total, 1.f, 1e-5f);
+
+		// the tent of a corner texel, clamped at the edges
+		Image lower, zero, up;
+		lower.resize(2, 2);
+		lower.at(0, 0) = vec4f(1.f);
+		zero.resize(4, 4);
+		BloomChain::upsample(lower, zero, 1.f, up, useSimd);
+		CHECK(up.width == 4 && up.height == 4);
+		CHECK_NEAR(up.at(0, 0).x, 10.5625f / 16.f, 1e-6f);
+		// the far corner only gets the corner tap
+		CHECK_NEAR(up.at(3, 3).x, 0.5625f / 16.f, 1e-6f);
+
+		// the scene plus the bloom, saturated
+		Image mixScene, bloom, mixed;
+		mixScene.resize(1, 1);
+		mixScene.at(0, 0) = vec4f(0.25f, 0.5f, 0.75f, 1.f);
+		bloom.resize(1, 1);
+		bloom.at(0, 0) = vec4f(1.f, 0.5f, 0.125f, 0.f);
+		BloomChain::mix(mixScene, bloom, 0.5f, mixed, useSimd);
+		CHECK(maxDiff(mixed.at(0, 0), vec4f(0.75f, 0.75f, 0.8125f, 1.f)) < 1e-6f);
+		BloomChain::mix(mixScene, bloom, 4.f, mixed, useSimd);
+		CHECK(mixed.at(0, 0) == vec4f(1.f, 1.f, 1.f, 1.f));
+	}
+}
+
+TEST(bloomChainTimings) {
+	using namespace std::chrono;
+
+	// not checked, the chain with and without SSE on a quarter of 720p
+	const u32 width = 640, height = 360;
+	Image scene, out;
+	BloomChain::makeTestScene(width, height, scene);
+
+	f64 ms[2] = {};
+	for (u32 simd = 0; simd < 2; ++simd) {
+		Params params;
+		params.useSimd = simd == 1;
+		auto start = high_resolution_clock::now();
+		BloomChain::apply(scene, params, out);
+		ms[simd] = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+	}
+
+	testLog(
+		"%ux%u, %u levels, %.1f fetches per pixel: scalar %.2fms, sse %.2fms",
+		width, height, BloomChain::getLevelCount(width, height, BloomChain::MAX_LEVELS),
+		BloomChain::getChainFetches(width, height, BloomChain::MAX_LEVELS), ms[0], ms[1]
+	);
+}
@@ -0,0 +1,150 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BytecodeCache.h"
+#include "JobSystem.h"
+
+/* A directory of fake bytecode files next to the executable, removed
+ * with everything that was written in it when it goes out of scope
+ */
+struct TempDirectory {
+	std::string path;
+	std::vector<std::string> files;
+
+	explicit TempDirectory(const char *name) : path(name) {
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	~TempDirectory() {
+		for (const std::string &file : files) {
+			remove(file.c_str());
+		}
+#ifdef _WIN32
+		_rmdir(path.c_str());
+#else
+		rmdir(path.c_str());
+#endif
+	}
+
+	std::string write(const char *name, const std::string &content) {
+		std::string file = path + "/" + name;
+		if (FILE *fp = fopen(file.c_str(), "wb")) {
+			fwrite(content.data(), 1, content.size(), fp);
+			fclose(fp);
+		}
+		files.push_back(file);
+		return file;
+	}
+};
+
+static bool hasContent(const BytecodeCache::Handle &bytecode, const std::string &content) {
+	return bytecode && bytecode->size == content.size() && memcmp(bytecode->data, content.data(), content.size()) == 0;
+}
+
+TEST(bytecodeCacheSharesTheSameContent) {
+	TempDirectory dir("bytecode_cache_test");
+	const std::string vertex = "DXBC vertex shader";
+	const std::string pixel = "DXBC pixel shader, a bit longer";
+	std::string a = dir.write("a_vs.cso", vertex);
+	std::string b = dir.write("b_vs.cso", vertex);
+	std::string c = dir.write("c_ps.cso", pixel);
+
+	BytecodeCache cache;
+	BytecodeCache::Handle first = cache.load(a);
+	CHECK(hasContent(first, vertex));
+	CHECK(first->hash == BytecodeCache::hash(vertex.data(), vertex.size()));
+	CHECK(cache.load(a) == first);
+
+	// another path with the same bytecode gets the same mapping
+	CHECK(cache.load(b) == first);
+	BytecodeCache::Handle other = cache.load(c);
+	CHECK(hasContent(other, pixel) && other != first);
+
+	BytecodeCache::Stats stats = cache.getStats();
+	CHECK(stats.files == 3 && stats.unique == 2 && stats.duplicates == 1);
+	CHECK(stats.hits == 1 && stats.misses == 3);
+	CHECK(stats.bytes == vertex.size() + pixel.size());
+}
+
+TEST(bytecodeCacheRejectsMissingAndEmptyFiles) {
+	TempDirectory dir("bytecode_cache_test");
+	std::string empty = dir.write("empty.cso", "");
+
+	BytecodeCache cache;
+	CHECK(cache.load(dir.path + "/missing.cso") == nullptr);
+	CHECK(cache.load(empty) == nullptr);
+
+	// failed loads aren't kept, they are tried again
+	CHECK(cache.load(empty) == nullptr);
+	BytecodeCache::Stats stats = cache.getStats();
+	CHECK(stats.files == 0 && stats.misses == 3 && stats.hits == 0);
+}
+
+TEST(bytecodeCacheHandlesOutliveClear) {
+	TempDirectory dir("bytecode_cache_test");
+	const std::string content = "DXBC geometry shader";
+	std::string path = dir.write("omni_gs.cso", content);
+
+	BytecodeCache cache;
+	BytecodeCache::Handle kept = cache.load(path);
+	cache.clear();
+	CHECK(cache.getStats().files == 0);
+
+	// still mapped, and loading it again maps it again
+	CHECK(hasContent(kept, content));
+	BytecodeCache::Handle reloaded = cache.load(path);
+	CHECK(hasContent(reloaded, content) && reloaded != kept);
+	CHECK(cache.getStats().misses == 1);
+}
+
+TEST(bytecodeCachePrefetchesADirectory) {
+	TempDirectory dir("bytecode_cache_test");
+	std::vector<std::string> paths;
+	for (u32 i = 0; i < 32; ++i) {
+		std::string name = "shader" + std::to_string(i) + ".cso";
+		// every fourth one has the same content as the one before it
+		std::string content = "DXBC " + std::to_string(i % 4 == 3 ? i - 1 : i);
+		paths.push_back(dir.write(name.c_str(), content));
+	}
+	dir.write("notes.txt", "not a shader");
+	dir.write("empty.cso", "");
+
+	BytecodeCache cache;
+	CHECK(cache.prefetch(dir.path, ".cso", &jobSystem) == 32);
+
+	BytecodeCache::Stats stats = cache.getStats();
+	CHECK(stats.files == 32 && stats.unique == 24 && stats.duplicates == 8);
+	CHECK(stats.misses == 33);
+
+	// everything is there after it
+	for (const std::string &path : paths) {
+		CHECK(cache.load(path) != nullptr);
+	}
+	CHECK(cache.getStats().hits == 32);
+
+	// without jobs it loads them on the caller
+	BytecodeCache serial;
+	CHECK(serial.prefetch(dir.path, ".cso", nullptr) == 32);
+	CHECK(serial.prefetch(dir.path + "/missing", ".cso", nullptr) == 0);
+}
+
+TEST(bytecodeCacheHashIsFnv1a) {
+	CHECK(BytecodeCache::hash("", 0) == 0xcbf29ce484222325ull);
+	CHECK(BytecodeCache::hash("a", 1) == 0xaf63dc4c8601ec8cull);
+	CHECK(BytecodeCache::hash("foobar", 6) == 0x85944171f73967e8ull);
+}
@@ -0,0 +1,224 @@
+#include "test.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "CommandRecorder.h"
+#include "ConstantAllocator.h"
+#include "StateCache.h"
+
+struct DrawConstants {
+	f32 world[16];
+	f32 color[4];
+};
+
+// Fake handles, the recording backends never dereference them
+template <typename T>
+static T *handle(uintptr_t base, u32 index) {
+	return (T *)(base + index * 16);
+}
+
+/* Draws like the shaders' render functions do, through the thread's
+ * stateCache and constantAllocator. The draw's index is written in the
+ * constants, so the order they end up in can be read back.
+ */
+static void recordDraws(u32 first, u32 count) {
+	ID3D11Buffer *vertices = handle<ID3D11Buffer>(0x10000, 0);
+	ID3D11Buffer *indices = handle<ID3D11Buffer>(0x10000, 1);
+	u32 stride = 32, offset = 0;
+
+	for (u32 i = first; i < first + count; ++i) {
+		ID3D11ShaderResourceView *texture = handle<ID3D11ShaderResourceView>(0x40000, (i * 7) % 64);
+		ID3D11Buffer *constants = handle<ID3D11Buffer>(0x50000, i % 4);
+
+		stateCache.setVertexShader(handle<ID3D11VertexShader>(0x20000, i % 8));
+		stateCache.setPixelShader(handle<ID3D11PixelShader>(0x30000, i % 8));
+		stateCache.setVertexBuffers(0, 1, &vertices, &stride, &offset);
+		stateCache.setIndexBuffer(indices, 42 /* DXGI_FORMAT_R32_UINT */, 0);
+		stateCache.setShaderResources(ShaderStage::Pixel, 0, 1, &texture);
+
+		DrawConstants *data = (DrawConstants *)constantAllocator.map(constants, sizeof(DrawConstants));
+		for (u32 m = 0; m < 16; ++m) data->world[m] = (m % 5 == 0) ? 1.f : 0.f;
+		data->world[12] = (f32)i;
+		data->color[0] = data->color[1] = data->color[2] = data->color[3] = 1.f;
+		constantAllocator.unmap(constants, ShaderStage::Vertex, 0);
+
+		stateCache.getBackend()->drawIndexed(36, 0, 0);
+	}
+}
+
+// Splits draws in listCount lists of consecutive draws
+static void addDraws(CommandRecorder &recorder, u32 draws, u32 listCount, std::vector<std::string> *names = nullptr) {
+	u32 first = 0;
+	for (u32 l = 0; l < listCount; ++l) {
+		u32 count = draws / listCount + (l < draws % listCount ? 1 : 0);
+		std::string name = "list " + std::to_string(l);
+		recorder.add(name.c_str(), [=]() { recordDraws(first, count); });
+		if (names) names->push_back(name);
+		first += count;
+	}
+}
+
+// The index of every uploaded draw and the name of every marker, in the order they were executed
+static void readBack(const RecordingBackend &backend, std::vector<u32> &draws, std::vector<std::string> &markers) {
+	for (const RecordingBackend::Command &cmd : backend.getCommands()) {
+		if (cmd.type == RenderCall::Marker) {
+			markers.push_back((const char *)&backend.getData()[cmd.data]);
+		}
+		else if (cmd.type == RenderCall::MapBuffer) {
+			DrawConstants constants;
+			memcpy(&constants, &backend.getData()[cmd.data], sizeof(constants));
+			draws.push_back((u32)constants.world[12]);
+		}
+	}
+}
+
+static bool isSequence(const std::vector<u32> &values, u32 count) {
+	if (values.size() != count) return false;
+	for (u32 i = 0; i < count; ++i) {
+		if (values[i] != i) return false;
+	}
+	return true;
+}
+
+TEST(commandRecorderExecutesTheListsInOrder) {
+	RecordingCommandLists lists;
+	CommandRecorder recorder;
+	recorder.init(&lists);
+
+	std::vector<std::string> names;
+	addDraws(recorder, 1000, 37, &names);
+	recorder.record();
+	CHECK(recorder.isRecorded());
+	CHECK(recorder.getStats().lists == 37);
+
+	// every list starts with its marker, and knows nothing of the state of the one before
+	for (u32 l = 0; l < 37; ++l) {
+		const RecordingBackend &list = lists.getList(l);
+		CHECK(!list.getCommands().empty() && list.getCommands()[0].type == RenderCall::Marker);
+		CHECK(list.getCount(RenderCall::IndexBuffer) == 1);
+	}
+
+	RecordingBackend immediate;
+	recorder.execute(immediate);
+	CHECK(!recorder.isRecorded() && recorder.getListCount() == 0);
+
+	std::vector<u32> draws;
+	std::vector<std::string> markers;
+	readBack(immediate, draws, markers);
+	CHECK(isSequence(draws, 1000));
+	CHECK(markers == names);
+	CHECK(immediate.getStats().draws == 1000);
+	recorder.cleanup();
+}
+
+TEST(commandRecorderGivesTheMainThreadItsCacheBack) {
+	// the main thread is bound to the immediate context, with a ring for the frame constants
+	RecordingBackend immediate;
+	RenderBackend *previousBackend = stateCache.getBackend();
+	stateCache.setBackend(&immediate);
+	constantAllocator.init(&stateCache, 4096);
+	immediate.clear();
+
+	RecordingCommandLists lists;
+	CommandRecorder recorder;
+	recorder.init(&lists);
+
+	std::vector<RenderBackend *> bound(16, nullptr);
+	std::vector<bool> ring(16, true);
+	for (u32 l = 0; l < 16; ++l) {
+		recorder.add("bound", [&bound, &ring, l]() {
+			bound[l] = stateCache.getBackend();
+			ring[l] = constantAllocator.isUsingRing();
+			recordDraws(l, 1);
+		});
+	}
+	recorder.record();
+
+	// while recording, the thread's cache is the list's, and the allocator uploads in it
+	for (u32 l = 0; l < 16; ++l) {
+		CHECK(bound[l] == &lists.getList(l));
+		CHECK(!ring[l]);
+	}
+	CHECK(immediate.getCommands().empty());
+	CHECK(stateCache.getBackend() == &immediate);
+	CHECK(constantAllocator.isUsingRing());
+
+	// the lists can be executed one by one between other work
+	for (u32 l = 16; l-- > 0;) {
+		recorder.execute(l, immediate);
+	}
+	std::vector<u32> draws;
+	std::vector<std::string> markers;
+	readBack(immediate, draws, markers);
+	CHECK(draws.size() == 16 && draws[0] == 15 && draws[15] == 0);
+	recorder.reset();
+
+	constantAllocator.cleanup();
+	constantAllocator = ConstantAllocator();
+	stateCache.setBackend(previousBackend);
+	recorder.cleanup();
+}
+
+TEST(commandRecorderStress) {
+	// many frames of lists of random sizes, on more threads than the machine has cores
+	JobSystem jobs;
+	jobs.init(8);
+	RecordingCommandLists lists;
+	CommandRecorder recorder;
+	recorder.init(&lists, &jobs);
+
+	u32 seed = 7;
+	u32 badFrames = 0;
+	for (u32 frame = 0; frame < 200; ++frame) {
+		u32 random = nextRandom(seed);
+		u32 listCount = 1 + random % 64;
+		u32 draws = (random >> 8) % 2000;
+
+		std::vector<std::string> names;
+		addDraws(recorder, draws, listCount, &names);
+		RecordingBackend immediate;
+		recorder.execute(immediate);
+
+		std::vector<u32> executed;
+		std::vector<std::string> markers;
+		readBack(immediate, executed, markers);
+		if (!isSequence(executed, draws) || markers != names) badFrames++;
+	}
+	CHECK(badFrames == 0);
+	recorder.cleanup();
+	jobs.shutdown();
+}
+
+TEST(commandRecorderTimings) {
+	// not checked, the same draws recorded on one thread and on all of them
+	const u32 drawCounts[] = { 1000, 10000, 100000 };
+	const u32 iterations = 3;
+
+	for (u32 draws : drawCounts) {
+		f64 recordMs[2] = {}, executeMs = 0.0;
+		for (u32 run = 0; run < 2; ++run) {
+			JobSystem single;
+			if (run == 0) single.init(1);
+
+			RecordingCommandLists lists;
+			CommandRecorder recorder;
+			recorder.init(&lists, run == 0 ? &single : &jobSystem);
+			for (u32 it = 0; it < iterations; ++it) {
+				addDraws(recorder, draws, 64);
+				recorder.record();
+				recordMs[run] += recorder.getStats().recordMs / iterations;
+
+				RecordingBackend immediate(false);
+				recorder.execute(immediate);
+				executeMs += recorder.getStats().executeMs / (2 * iterations);
+			}
+			recorder.cleanup();
+			if (run == 0) single.shutdown();
+		}
+
+		testLog("%6u draws in 64 lists: record %.2fms on 1 thread, %.2fms on %u, execute %.2fms",
+			draws, recordMs[0], recordMs[1], jobSystem.getThreadCount(), executeMs);
+	}
+}
@@ -0,0 +1,162 @@
+#include "test.h"
+
+#include <string.h>
+
+#include "ConstantAllocator.h"
+
+// d3d11.0: no constant buffer ranges
+struct NoRangeBackend : RecordingBackend {
+	bool supportsConstantRanges() override { return false; }
+};
+
+struct Block256 {
+	f32 values[64];
+};
+
+static void writeBlock(ConstantAllocator &allocator, ID3D11Buffer *buffer, f32 value, u32 slot = 0) {
+	Block256 *block = (Block256 *)allocator.map(buffer, sizeof(Block256));
+	for (f32 &v : block->values) v = value;
+	allocator.unmap(buffer, ShaderStage::Vertex, slot);
+}
+
+// The commands of one type, in order
+static std::vector<RecordingBackend::Command> getCommands(const RecordingBackend &backend, RenderCall type) {
+	std::vector<RecordingBackend::Command> result;
+	for (const RecordingBackend::Command &cmd : backend.getCommands()) {
+		if (cmd.type == type) result.push_back(cmd);
+	}
+	return result;
+}
+
+TEST(constantAllocatorSkipsUnchangedDrawBlocks) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+	ConstantAllocator allocator;
+	allocator.init(&cache);
+
+	ID3D11Buffer *buffer = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	allocator.addBlock(buffer, sizeof(Block256), ConstantUsage::Draw);
+	allocator.beginFrame();
+	backend.clear();
+
+	writeBlock(allocator, buffer, 1.f);
+	writeBlock(allocator, buffer, 1.f);
+	writeBlock(allocator, buffer, 2.f);
+	writeBlock(allocator, buffer, 2.f);
+
+	const ConstantAllocator::Counters &counters = allocator.getCounters();
+	CHECK(counters.uploads == 2 && counters.skipped == 2);
+	CHECK(counters.bytesUploaded == 2 * sizeof(Block256));
+	CHECK(counters.ringWrites == 0);
+
+	// the uploads are whole discards, with the content that was written
+	std::vector<RecordingBackend::Command> maps = getCommands(backend, RenderCall::MapBuffer);
+	CHECK(maps.size() == 2);
+	CHECK(maps[1].object == buffer && maps[1].value == (u32)MapMode::Discard && maps[1].size == sizeof(Block256));
+	f32 first;
+	memcpy(&first, &backend.getData()[maps[1].data], sizeof(f32));
+	CHECK(first == 2.f);
+
+	// and it's bound once
+	CHECK(backend.getCount(RenderCall::ConstantBuffers) == 1);
+	allocator.cleanup();
+}
+
+TEST(constantAllocatorSharesFrameBlocksInTheRing) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+	ConstantAllocator allocator;
+	allocator.init(&cache, 4096);
+	CHECK(allocator.isUsingRing());
+
+	// the same light data in two shaders' buffers, and a different camera
+	ID3D11Buffer *lightsA = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	ID3D11Buffer *lightsB = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	ID3D11Buffer *camera = backend.createBuffer(BufferType::Constant, 64, nullptr, true);
+	allocator.addBlock(lightsA, sizeof(Block256), ConstantUsage::Frame);
+	allocator.addBlock(lightsB, sizeof(Block256), ConstantUsage::Frame);
+	allocator.addBlock(camera, 64, ConstantUsage::Frame);
+
+	for (u32 frame = 0; frame < 2; ++frame) {
+		allocator.beginFrame();
+		backend.clear();
+
+		writeBlock(allocator, lightsA, 3.f, 1);
+		writeBlock(allocator, lightsB, 3.f, 1);
+		f32 *matrix = (f32 *)allocator.map(camera, 64);
+		for (u32 i = 0; i < 16; ++i) matrix[i] = (f32)i;
+		allocator.unmap(camera, ShaderStage::Vertex, 0);
+
+		const ConstantAllocator::Counters &counters = allocator.getCounters();
+		CHECK(counters.ringWrites == 2 && counters.ringReuses == 1);
+		CHECK(counters.ringBytes == sizeof(Block256) + 64);
+		CHECK(counters.uploads == 0);
+
+		// every frame starts by discarding the ring, then appends to it
+		std::vector<RecordingBackend::Command> maps = getCommands(backend, RenderCall::MapBuffer);
+		CHECK(maps.size() == 2);
+		CHECK(maps[0].value == (u32)MapMode::Discard && maps[0].start == 0);
+		CHECK(maps[1].value == (u32)MapMode::NoOverwrite && maps[1].start == ConstantAllocator::RANGE_ALIGNMENT);
+
+		// the two light blocks are the same range, bound once on slot 1
+		std::vector<RecordingBackend::Command> ranges = getCommands(backend, RenderCall::ConstantBufferRange);
+		CHECK(ranges.size() == (frame == 0 ? 2u : 0u));
+		if (ranges.size() == 2) {
+			CHECK(ranges[0].start == 1 && ranges[0].value == 0 && ranges[0].base == 16);
+			CHECK(ranges[1].start == 0 && ranges[1].value == 16 && ranges[1].base == 16);
+		}
+	}
+	allocator.cleanup();
+}
+
+TEST(constantAllocatorGrowsTheRingWhenFull) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+	ConstantAllocator allocator;
+	allocator.init(&cache, ConstantAllocator::RANGE_ALIGNMENT);
+
+	ID3D11Buffer *a = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	ID3D11Buffer *b = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	allocator.addBlock(a, sizeof(Block256), ConstantUsage::Frame);
+	allocator.addBlock(b, sizeof(Block256), ConstantUsage::Frame);
+
+	allocator.beginFrame();
+	writeBlock(allocator, a, 1.f);
+	writeBlock(allocator, b, 2.f, 1);
+
+	// the second one didn't fit, it used its own buffer
+	CHECK(allocator.getCounters().ringWrites == 1);
+	CHECK(allocator.getCounters().ringOverflows == 1);
+	CHECK(allocator.getCounters().uploads == 1);
+
+	allocator.beginFrame();
+	CHECK(allocator.getRingSize() == 2 * ConstantAllocator::RANGE_ALIGNMENT);
+	CHECK(allocator.getLastFrame().ringOverflows == 1);
+	writeBlock(allocator, a, 1.f);
+	writeBlock(allocator, b, 2.f, 1);
+	CHECK(allocator.getCounters().ringWrites == 2);
+	CHECK(allocator.getCounters().ringOverflows == 0);
+	allocator.cleanup();
+}
+
+TEST(constantAllocatorWithoutRangesUsesTheBuffers) {
+	NoRangeBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+	ConstantAllocator allocator;
+	allocator.init(&cache);
+	CHECK(!allocator.isUsingRing());
+
+	ID3D11Buffer *lights = backend.createBuffer(BufferType::Constant, sizeof(Block256), nullptr, true);
+	allocator.addBlock(lights, sizeof(Block256), ConstantUsage::Frame);
+	allocator.beginFrame();
+	writeBlock(allocator, lights, 1.f);
+	writeBlock(allocator, lights, 1.f);
+
+	CHECK(allocator.getCounters().uploads == 1 && allocator.getCounters().skipped == 1);
+	CHECK(backend.getCount(RenderCall::ConstantBufferRange) == 0);
+	allocator.cleanup();
+}
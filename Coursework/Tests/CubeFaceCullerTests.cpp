@@ -0,0 +1,106 @@
+#include "test.h"
+
+#include <chrono>
+#include <vector>
+
+#include "CubeFaceCuller.h"
+
+static const u32 POS_X = 1 << 0, NEG_X = 1 << 1, POS_Y = 1 << 2, NEG_Y = 1 << 3, POS_Z = 1 << 4, NEG_Z = 1 << 5;
+
+static u32 countBits(u32 mask) {
+	u32 count = 0;
+	for (; mask; mask &= mask - 1) count++;
+	return count;
+}
+
+// Tree sized boxes on the ground around a light a few metres up, like the monolith's
+static void makeForest(u32 count, std::vector<vec3f> &bmin, std::vector<vec3f> &bmax) {
+	u32 seed = 4321;
+	bmin.resize(count);
+	bmax.resize(count);
+	for (u32 i = 0; i < count; ++i) {
+		// some of them close to the light
+		f32 range = i % 4 == 0 ? 10.f : 100.f;
+		bmin[i] = vec3f(randomFloat(seed, -range, range), randomFloat(seed, -1.f, 1.f), randomFloat(seed, -range, range));
+		bmax[i] = bmin[i] + vec3f(randomFloat(seed, 1.f, 6.f), randomFloat(seed, 2.f, 12.f), randomFloat(seed, 1.f, 6.f));
+	}
+}
+
+TEST(cubeFaceCullerFindsTheFacesOfABox) {
+	CubeFaceCuller culler;
+	culler.begin({ 0.f, 6.f, 0.f }, 1.f, 200.f);
+
+	// straight in front of a face
+	CHECK(culler.getFaceMask({ 10.f, 5.f, -1.f }, { 12.f, 7.f, 1.f }) == POS_X);
+	CHECK(culler.getFaceMask({ -1.f, 5.f, -30.f }, { 1.f, 7.f, -20.f }) == NEG_Z);
+	CHECK(culler.getFaceMask({ -1.f, 20.f, -1.f }, { 1.f, 22.f, 1.f }) == POS_Y);
+
+	// across the edge between two faces
+	CHECK(culler.getFaceMask({ 9.f, 5.f, 9.f }, { 11.f, 7.f, 11.f }) == (POS_X | POS_Z));
+
+	// around the light it's in every face, past the far plane or inside the near one in none
+	CHECK(culler.getFaceMask({ -5.f, 1.f, -5.f }, { 5.f, 11.f, 5.f }) == CubeFaceCuller::ALL_FACES);
+	CHECK(culler.getFaceMask({ 300.f, 5.f, 0.f }, { 310.f, 7.f, 1.f }) == 0);
+	CHECK(culler.getFaceMask({ 0.2f, 5.9f, -0.1f }, { 0.4f, 6.1f, 0.1f }) == 0);
+
+	// the reference agrees on the easy ones
+	CHECK(culler.getFaceMaskReference({ 10.f, 5.f, -1.f }, { 12.f, 7.f, 1.f }, 5) == POS_X);
+	CHECK(culler.getFaceMaskReference({ 9.f, 5.f, 9.f }, { 11.f, 7.f, 11.f }, 5) == (POS_X | POS_Z));
+}
+
+TEST(cubeFaceCullerNeverMissesAFace) {
+	CubeFaceCuller culler;
+	culler.begin({ 0.f, 6.f, 0.f }, 1.f, 200.f);
+
+	const u32 count = 10000;
+	std::vector<vec3f> bmin, bmax;
+	makeForest(count, bmin, bmax);
+
+	u32 missed = 0, extra = 0, faces = 0, single = 0, culled = 0;
+	for (u32 i = 0; i < count; ++i) {
+		u32 mask = culler.cull(bmin[i], bmax[i]);
+		u32 reference = culler.getFaceMaskReference(bmin[i], bmax[i], 9);
+		missed += countBits(reference & ~mask);
+		extra += countBits(mask & ~reference);
+
+		faces += countBits(mask);
+		single += countBits(mask) == 1;
+		culled += mask == 0;
+	}
+	CHECK(missed == 0);
+
+	// the stats count what cull() returned
+	const CubeFaceCuller::Stats &stats = culler.getStats();
+	CHECK(stats.tested == count && stats.faces == faces);
+	CHECK(stats.singleFace == single && stats.culled == culled);
+	// most trees are far from the light, they are in one or two faces
+	CHECK(faces < count * 3);
+	testLog(
+		"%u boxes: %u of %u faces drawn, %u extra against the reference",
+		count, faces, count * CubeFaceCuller::FACES, extra
+	);
+
+	// a new frame starts over
+	culler.begin({ 50.f, 6.f, 50.f }, 1.f, 200.f);
+	CHECK(culler.getStats().tested == 0 && culler.getStats().faces == 0);
+}
+
+TEST(cubeFaceCullerTimings) {
+	using namespace std::chrono;
+
+	// not checked, the time to get the mask of a box
+	CubeFaceCuller culler;
+	culler.begin({ 0.f, 6.f, 0.f }, 1.f, 200.f);
+	const u32 count = 10000, iterations = 20;
+	std::vector<vec3f> bmin, bmax;
+	makeForest(count, bmin, bmax);
+
+	auto start = high_resolution_clock::now();
+	for (u32 it = 0; it < iterations; ++it) {
+		for (u32 i = 0; i < count; ++i) {
+			culler.cull(bmin[i], bmax[i]);
+		}
+	}
+	f64 ms = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+	testLog("%.1fns for the mask of a box", ms * 1e6 / (count * iterations));
+}
@@ -0,0 +1,136 @@
+#include "test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "DrawQueue.h"
+
+using SortItem = DrawQueue::SortItem;
+
+// A frame's worth of draws: few passes, shaders and textures, random depths
+static std::vector<SortItem> makeKeys(u32 count, u32 seed, u32 depths) {
+	std::vector<SortItem> items(count);
+	for (u32 i = 0; i < count; ++i) {
+		u32 shader = nextRandom(seed) % 16;
+		u32 texture = nextRandom(seed) % 64;
+		f32 depth = (nextRandom(seed) % depths) * 0.01f;
+		items[i] = { DrawKey::make(i & 1, shader, texture, depth), i };
+	}
+	return items;
+}
+
+static void stableSort(std::vector<SortItem> &items) {
+	std::stable_sort(items.begin(), items.end(), [](const SortItem &a, const SortItem &b) { return a.key < b.key; });
+}
+
+// Same keys and, for the ties, the same order of the indices
+static bool isSameOrder(const std::vector<SortItem> &a, const std::vector<SortItem> &b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (a[i].key != b[i].key || a[i].index != b[i].index) return false;
+	}
+	return true;
+}
+
+TEST(drawQueueRadixSortMatchesStableSort) {
+	// the insertion sort, the radix sort, lots of ties and hardly any
+	const u32 counts[] = { 0, 1, 2, 63, 64, 65, 1000, 20000 };
+	const u32 depths[] = { 1, 4, 100000 };
+
+	std::vector<SortItem> scratch;
+	for (u32 count : counts) {
+		for (u32 depth : depths) {
+			std::vector<SortItem> radix = makeKeys(count, count * 31 + depth, depth);
+			std::vector<SortItem> expected = radix;
+			DrawQueue::radixSort(radix, scratch);
+			stableSort(expected);
+			CHECK(isSameOrder(radix, expected));
+		}
+	}
+
+	// every byte different, and every byte but one the same
+	u32 seed = 99;
+	std::vector<SortItem> wide(5000), narrow(5000);
+	for (u32 i = 0; i < 5000; ++i) {
+		wide[i] = { ((u64)nextRandom(seed) << 40) ^ ((u64)nextRandom(seed) << 16) ^ nextRandom(seed), i };
+		narrow[i] = { 0xABCD000000000000ull | ((u64)(nextRandom(seed) & 0xFF) << 24), i };
+	}
+	for (std::vector<SortItem> *items : { &wide, &narrow }) {
+		std::vector<SortItem> expected = *items;
+		DrawQueue::radixSort(*items, scratch);
+		stableSort(expected);
+		CHECK(isSameOrder(*items, expected));
+	}
+}
+
+TEST(drawQueueKeysSortByStateOrDepth) {
+	// pass first, then shader, texture and depth
+	CHECK(DrawKey::make(0, 5, 5, 100.f) < DrawKey::make(1, 0, 0, 0.f));
+	CHECK(DrawKey::make(0, 1, 9, 100.f) < DrawKey::make(0, 2, 0, 0.f));
+	CHECK(DrawKey::make(0, 1, 1, 100.f) < DrawKey::make(0, 1, 2, 0.f));
+	CHECK(DrawKey::make(0, 1, 1, 1.f) < DrawKey::make(0, 1, 1, 2.f));
+
+	// front to back: depth before the state
+	CHECK(DrawKey::makeFrontToBack(0, 1.f, 9, 9) < DrawKey::makeFrontToBack(0, 2.f, 0, 0));
+	CHECK(DrawKey::makeFrontToBack(0, 1.f, 1, 9) < DrawKey::makeFrontToBack(0, 1.f, 2, 0));
+	CHECK(DrawKey::makeFrontToBack(1, 0.f, 0, 0) > DrawKey::makeFrontToBack(0, 1e30f, 9, 9));
+
+	// negative depths are in front of everything
+	CHECK(DrawKey::make(0, 1, 1, -5.f) == DrawKey::make(0, 1, 1, 0.f));
+	CHECK(DrawKey::getPass(DrawKey::make(200, 1, 1, 1.f)) == 200);
+}
+
+TEST(drawQueueRunsThePacketsInOrder) {
+	DrawQueue queue;
+	std::vector<u32> ran;
+	const u64 keys[] = { 30, 10, 20, 10, 0, 20 };
+	for (u32 i = 0; i < 6; ++i) {
+		queue.submit(keys[i], [&ran, i]() { ran.push_back(i); });
+	}
+	queue.flush();
+	// the ties keep the order they were submitted in
+	CHECK(ran == std::vector<u32>({ 4, 1, 3, 2, 5, 0 }));
+	CHECK(queue.getCount() == 0);
+
+	ran.clear();
+	queue.setSorting(false);
+	for (u32 i = 0; i < 6; ++i) {
+		queue.submit(keys[i], [&ran, i]() { ran.push_back(i); });
+	}
+	queue.flush();
+	CHECK(ran == std::vector<u32>({ 0, 1, 2, 3, 4, 5 }));
+
+	queue.beginFrame();
+	CHECK(queue.getLastFrame().packets == 12);
+
+	// ids are stable, nullptr is 0
+	int a, b;
+	CHECK(queue.getShaderId(nullptr) == 0);
+	CHECK(queue.getShaderId(&a) == 1 && queue.getShaderId(&b) == 2 && queue.getShaderId(&a) == 1);
+	CHECK(queue.getTextureId(&b) == 1);
+}
+
+TEST(drawQueueSortTimings) {
+	using namespace std::chrono;
+
+	// not checked, the sort of 10000 packets like the ones of a frame
+	const u32 iterations = 50;
+	std::vector<SortItem> keys = makeKeys(10000, 12345, 100000), work, scratch;
+
+	auto start = high_resolution_clock::now();
+	for (u32 i = 0; i < iterations; ++i) {
+		work = keys;
+		DrawQueue::radixSort(work, scratch);
+	}
+	f64 radixMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count() / iterations;
+
+	start = high_resolution_clock::now();
+	for (u32 i = 0; i < iterations; ++i) {
+		work = keys;
+		stableSort(work);
+	}
+	f64 stdMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count() / iterations;
+
+	testLog("10000 keys: radix %.3fms, std::stable_sort %.3fms", radixMs, stdMs);
+}
@@ -0,0 +1,180 @@
+#include "test.h"
+
+#include <string>
+#include <vector>
+
+#include "FrameGraph.h"
+#include "RenderBackend.h"
+
+static const FrameGraphTextureDesc FULL = { 1280, 720, 10 };
+static const FrameGraphTextureDesc HALF = { 640, 360, 10 };
+
+// Hands out fake textures and counts them
+struct FakeAllocator : FrameGraphAllocator {
+	uintptr_t next = 1;
+	u32 alive = 0;
+	u32 created = 0;
+
+	void *createTexture(const FrameGraphTextureDesc &) override {
+		alive++;
+		created++;
+		return (void *)(next++ * 16);
+	}
+	void releaseTexture(void *) override {
+		alive--;
+	}
+};
+
+/* The frame of the app, more or less:
+ *   shadow -> main -> bright -> blur h -> blur v -> tonemap -> back buffer
+ *                  \-------------------------------/
+ * plus a debug pass nobody reads and a chain of two passes that only
+ * feed each other
+ */
+struct TestFrame {
+	FrameGraphResource backBuffer, shadowMap, hdr, bright, blurH, blurV, debug, unusedA, unusedB;
+	u32 shadowPass, mainPass, brightPass, blurHPass, blurVPass, tonemapPass, debugPass, unusedPassA, unusedPassB;
+	std::vector<std::string> ran;
+
+	void build(FrameGraph &graph) {
+		graph.reset();
+		ran.clear();
+		auto run = [this](const char *name) { return [this, name]() { ran.push_back(name); }; };
+
+		backBuffer = graph.importTexture("back buffer", (void *)0x1000);
+		shadowMap  = graph.createTexture("shadow map", { 2048, 2048, 40 });
+		hdr        = graph.createTexture("hdr", FULL);
+		bright     = graph.createTexture("bright", HALF);
+		blurH      = graph.createTexture("blur h", HALF);
+		blurV      = graph.createTexture("blur v", HALF);
+		debug      = graph.createTexture("debug", FULL);
+		unusedA    = graph.createTexture("unused a", HALF);
+		unusedB    = graph.createTexture("unused b", HALF);
+		graph.setOutput(backBuffer);
+
+		shadowPass = graph.addPass("shadow", run("shadow"));
+		graph.write(shadowPass, shadowMap);
+		mainPass = graph.addPass("main", run("main"));
+		graph.read(mainPass, shadowMap);
+		graph.write(mainPass, hdr);
+		debugPass = graph.addPass("debug", run("debug"));
+		graph.read(debugPass, hdr);
+		graph.write(debugPass, debug);
+		brightPass = graph.addPass("bright", run("bright"));
+		graph.read(brightPass, hdr);
+		graph.write(brightPass, bright);
+		unusedPassA = graph.addPass("unused a", run("unused a"));
+		graph.read(unusedPassA, bright);
+		graph.write(unusedPassA, unusedA);
+		blurHPass = graph.addPass("blur h", run("blur h"));
+		graph.read(blurHPass, bright);
+		graph.write(blurHPass, blurH);
+		unusedPassB = graph.addPass("unused b", run("unused b"));
+		graph.read(unusedPassB, unusedA);
+		graph.write(unusedPassB, unusedB);
+		blurVPass = graph.addPass("blur v", run("blur v"));
+		graph.read(blurVPass, blurH);
+		graph.write(blurVPass, blurV);
+		tonemapPass = graph.addPass("tonemap", run("tonemap"));
+		graph.read(tonemapPass, hdr);
+		graph.read(tonemapPass, blurV);
+		graph.write(tonemapPass, backBuffer);
+	}
+};
+
+TEST(frameGraphCullsAndOrdersThePasses) {
+	FrameGraph graph;
+	TestFrame frame;
+	frame.build(graph);
+	CHECK(graph.compile());
+
+	CHECK(graph.isCulled(frame.debugPass));
+	CHECK(graph.isCulled(frame.unusedPassA));
+	CHECK(graph.isCulled(frame.unusedPassB));
+	CHECK(!graph.isCulled(frame.shadowPass) && !graph.isCulled(frame.mainPass) && !graph.isCulled(frame.tonemapPass));
+	CHECK(graph.getStats().passes == 9 && graph.getStats().culledPasses == 3);
+
+	// the passes left run in the order they were added, each named by a marker
+	RecordingBackend backend;
+	graph.execute(&backend);
+	const std::vector<std::string> expected = { "shadow", "main", "bright", "blur h", "blur v", "tonemap" };
+	CHECK(frame.ran == expected);
+
+	std::vector<std::string> markers;
+	for (const RecordingBackend::Command &cmd : backend.getCommands()) {
+		if (cmd.type == RenderCall::Marker) markers.push_back((const char *)&backend.getData()[cmd.data]);
+	}
+	CHECK(markers == expected);
+
+	// the culled passes don't keep their resources alive
+	CHECK(graph.getFirstUse(frame.debug) == FRAME_GRAPH_NONE);
+	CHECK(graph.getFirstUse(frame.unusedA) == FRAME_GRAPH_NONE);
+	CHECK(graph.getFirstUse(frame.hdr) == frame.mainPass && graph.getLastUse(frame.hdr) == frame.tonemapPass);
+	CHECK(graph.getFirstUse(frame.bright) == frame.brightPass && graph.getLastUse(frame.bright) == frame.blurHPass);
+}
+
+TEST(frameGraphAliasesTheTexturesThatDontOverlap) {
+	// no allocator: compile only assigns the physical textures
+	FrameGraph graph;
+	TestFrame frame;
+	frame.build(graph);
+	graph.compile();
+
+	// bright dies at blur h, where blur h starts: they overlap. blur v starts after bright is done
+	CHECK(graph.getPhysicalIndex(frame.bright) != graph.getPhysicalIndex(frame.blurH));
+	CHECK(graph.getPhysicalIndex(frame.blurV) == graph.getPhysicalIndex(frame.bright));
+	CHECK(graph.getPhysicalIndex(frame.blurH) != graph.getPhysicalIndex(frame.blurV));
+	// other descs are never shared
+	CHECK(graph.getPhysicalIndex(frame.hdr) != graph.getPhysicalIndex(frame.bright));
+	CHECK(graph.getPhysicalIndex(frame.shadowMap) != graph.getPhysicalIndex(frame.hdr));
+	CHECK(graph.getPhysicalIndex(frame.backBuffer) == FRAME_GRAPH_NONE);
+	CHECK(graph.getPhysicalIndex(frame.debug) == FRAME_GRAPH_NONE);
+
+	const FrameGraph::Stats &stats = graph.getStats();
+	CHECK(stats.transientResources == 5);
+	CHECK(stats.physicalTextures == 4);
+
+	// imported textures are handed back as they are, the others don't exist without an allocator
+	graph.execute();
+	CHECK(graph.getTexture(frame.backBuffer) == (void *)0x1000);
+	CHECK(graph.getTexture(frame.hdr) == nullptr);
+	CHECK(graph.getStats().createdTextures == 0);
+}
+
+TEST(frameGraphKeepsTheTexturesBetweenFrames) {
+	FakeAllocator allocator;
+	FrameGraph graph;
+	graph.setAllocator(&allocator);
+	TestFrame frame;
+
+	for (u32 i = 0; i < 3; ++i) {
+		frame.build(graph);
+		graph.compile();
+		// they exist before executing, the app records some passes in between
+		CHECK(graph.getTexture(frame.hdr) != nullptr);
+		graph.execute();
+	}
+	CHECK(allocator.created == 4 && allocator.alive == 4);
+	CHECK(graph.getTexture(frame.blurV) == graph.getTexture(frame.bright));
+	CHECK(graph.getTexture(frame.blurV) != nullptr);
+
+	// without the bloom the half resolution textures go unused, and are released after a while
+	for (u32 i = 0; i < FrameGraph::FRAMES_BEFORE_RELEASE; ++i) {
+		graph.reset();
+		FrameGraphResource back = graph.importTexture("back buffer", (void *)0x1000);
+		FrameGraphResource hdr = graph.createTexture("hdr", FULL);
+		graph.setOutput(back);
+		u32 main = graph.addPass("main", nullptr);
+		graph.write(main, hdr);
+		u32 tonemap = graph.addPass("tonemap", nullptr);
+		graph.read(tonemap, hdr);
+		graph.write(tonemap, back);
+		graph.compile();
+		graph.execute();
+		CHECK(graph.getStats().createdTextures == 0);
+	}
+	CHECK(allocator.alive == 1);
+
+	graph.setAllocator(nullptr);
+	CHECK(allocator.alive == 0);
+}
@@ -0,0 +1,155 @@
+#include "test.h"
+
+#include <chrono>
+#include <vector>
+
+#include "FramePipeline.h"
+#include "JobSystem.h"
+#include "MathUtils.h"
+
+// Every packet carries the number it was prepared with, the render checks
+// that it was updated and that it comes right after the one before it
+struct PipelineRun {
+	struct Packet {
+		u64 index = 0;
+		bool updated = false;
+	};
+
+	Packet packets[FramePipeline::SLOTS];
+	u64 prepared = 0;
+	std::vector<u64> rendered;
+	u32 notUpdated = 0;
+	u32 maxLatency = 0;
+	FramePipeline pipeline;
+
+	PipelineRun(JobSystem *jobs, FramePipeline::Stage onRender = nullptr) {
+		pipeline.init(
+			[this](u32 slot) {
+				packets[slot].index = prepared++;
+				packets[slot].updated = false;
+			},
+			[this](u32 slot) { packets[slot].updated = true; },
+			[this, onRender](u32 slot) {
+				if (!packets[slot].updated) notUpdated++;
+				rendered.push_back(packets[slot].index);
+				maxLatency = max(maxLatency, pipeline.getStats().latency);
+				if (onRender) onRender(slot);
+			},
+			jobs
+		);
+	}
+
+	// Every packet up to the last rendered one, once and in order
+	bool isInOrder() const {
+		for (size_t i = 1; i < rendered.size(); ++i) {
+			if (rendered[i] != rendered[i - 1] + 1) return false;
+		}
+		return true;
+	}
+};
+
+TEST(framePipelineRendersEveryPacketOnceInOrder) {
+	JobSystem jobs;
+	jobs.init(2);
+	{
+		PipelineRun run(&jobs);
+		CHECK(run.pipeline.isPipelined());
+		for (u32 i = 0; i < 100; ++i) run.pipeline.frame();
+		run.pipeline.sync();
+
+		CHECK(run.rendered.size() == 100);
+		CHECK(!run.rendered.empty() && run.rendered[0] == 0);
+		CHECK(run.isInOrder());
+		CHECK(run.notUpdated == 0);
+		// the packet in flight is the one after the last rendered
+		CHECK(run.prepared == 101);
+		CHECK(run.maxLatency <= 1);
+		CHECK(run.pipeline.getStats().latency == 1);
+		CHECK(run.pipeline.getStats().frames == 100);
+	}
+	jobs.shutdown();
+}
+
+TEST(framePipelineInOrderHasNoLatency) {
+	JobSystem jobs;
+	jobs.init(2);
+	{
+		PipelineRun run(&jobs);
+		run.pipeline.setPipelined(false);
+		for (u32 i = 0; i < 20; ++i) run.pipeline.frame();
+
+		CHECK(run.rendered.size() == 20 && run.prepared == 20);
+		CHECK(run.isInOrder());
+		CHECK(run.notUpdated == 0);
+		CHECK(run.maxLatency == 0);
+	}
+
+	// without a job system it can't pipeline
+	{
+		PipelineRun run(nullptr);
+		for (u32 i = 0; i < 5; ++i) run.pipeline.frame();
+		CHECK(run.rendered.size() == 5 && run.isInOrder() && run.maxLatency == 0);
+	}
+	jobs.shutdown();
+}
+
+TEST(framePipelineSwitchingNeverRendersAPacketTwice) {
+	JobSystem jobs;
+	jobs.init(2);
+	{
+		// the gui switches it and waits for the update from inside the render
+		PipelineRun *current = nullptr;
+		u32 frame = 0;
+		PipelineRun run(&jobs, [&](u32) {
+			if (frame % 7 == 3) current->pipeline.setPipelined(!current->pipeline.isPipelined());
+			if (frame % 5 == 1) current->pipeline.sync();
+		});
+		current = &run;
+		for (frame = 0; frame < 100; ++frame) run.pipeline.frame();
+		run.pipeline.sync();
+
+		CHECK(run.rendered.size() == 100);
+		CHECK(run.notUpdated == 0);
+		CHECK(run.maxLatency <= 1);
+		// a packet can be dropped when switching back to in order, never rendered twice
+		u32 repeated = 0;
+		for (size_t i = 1; i < run.rendered.size(); ++i) {
+			if (run.rendered[i] <= run.rendered[i - 1]) repeated++;
+		}
+		CHECK(repeated == 0);
+	}
+	jobs.shutdown();
+}
+
+TEST(framePipelineTimings) {
+	using namespace std::chrono;
+
+	// not checked, a synthetic frame (busy waiting) in order and pipelined on two threads
+	const f64 updateMs = 2.0, renderMs = 3.0;
+	const u32 frames = 30;
+	auto busyWait = [](f64 ms) {
+		auto end = high_resolution_clock::now() + duration<f64, std::milli>(ms);
+		while (high_resolution_clock::now() < end) {}
+	};
+
+	JobSystem jobs;
+	jobs.init(2);
+	f64 frameMs[2] = {};
+	{
+		FramePipeline pipeline;
+		pipeline.init(nullptr, [&](u32) { busyWait(updateMs); }, [&](u32) { busyWait(renderMs); }, &jobs);
+		for (u32 run = 0; run < 2; ++run) {
+			pipeline.setPipelined(run == 1);
+			auto start = high_resolution_clock::now();
+			for (u32 i = 0; i < frames; ++i) pipeline.frame();
+			pipeline.sync();
+			frameMs[run] = duration<f64, std::milli>(high_resolution_clock::now() - start).count() / frames;
+		}
+	}
+	jobs.shutdown();
+
+	testLog(
+		"%.0fms update + %.0fms render: in order %.3fms, pipelined %.3fms",
+		updateMs, renderMs, frameMs[0], frameMs[1]
+	);
+}
@@ -0,0 +1,98 @@
+#include "test.h"
+
+#include <chrono>
+#include <vector>
+
+#include "GaussianKernel.h"
+#include "MathUtils.h"
+
+using Tap = GaussianKernel::Tap;
+
+// A row with noise and a few hard edges, like the monolith in the bright pass
+static std::vector<f32> makeRow(u32 count) {
+	u32 seed = 2468;
+	std::vector<f32> row(count);
+	for (u32 i = 0; i < count; ++i) {
+		f32 value = randomFloat(seed, 0.f, 1.f);
+		row[i] = (i / 10) % 2 ? value : 0.f;
+	}
+	return row;
+}
+
+TEST(gaussianKernelRadiusIsThreeSigma) {
+	CHECK(GaussianKernel::getRadius(0.f) == 0);
+	CHECK(GaussianKernel::getRadius(1.f) == 3);
+	CHECK(GaussianKernel::getRadius(2.5f) == 8);
+	CHECK(GaussianKernel::getRadius(100.f) == GaussianKernel::MAX_RADIUS);
+
+	// without a radius there is only the centre
+	std::vector<f32> weights;
+	GaussianKernel::getWeights(0.f, weights);
+	CHECK(weights.size() == 1 && weights[0] == 1.f);
+
+	// the taps fit in the constant buffer
+	std::vector<Tap> taps;
+	GaussianKernel::getLinearTaps(100.f, taps);
+	CHECK(taps.size() <= GaussianKernel::MAX_TAPS);
+}
+
+TEST(gaussianKernelsAreNormalized) {
+	std::vector<f32> weights;
+	std::vector<Tap> taps;
+	for (f32 sigma = 0.25f; sigma <= GaussianKernel::MAX_RADIUS / 3.f; sigma += 0.25f) {
+		GaussianKernel::getWeights(sigma, weights);
+		GaussianKernel::getLinearTaps(weights, taps);
+
+		f32 total = weights[0];
+		for (u32 i = 1; i < weights.size(); ++i) total += weights[i] * 2.f;
+		f32 linearTotal = taps[0].weight;
+		for (u32 i = 1; i < taps.size(); ++i) linearTotal += taps[i].weight * 2.f;
+
+		CHECK_NEAR(total, 1.f, 1e-5f);
+		CHECK_NEAR(linearTotal, 1.f, 1e-5f);
+		// the weights go down from the centre
+		for (u32 i = 1; i < weights.size(); ++i) CHECK(weights[i] <= weights[i - 1]);
+	}
+}
+
+TEST(gaussianKernelLinearTapsBlurLikeTheDiscreteOnes) {
+	const u32 count = 97;
+	std::vector<f32> row = makeRow(count), discrete(count), linear(count);
+	std::vector<f32> weights;
+	std::vector<Tap> taps;
+
+	f32 maxError = 0.f, maxQuantizedError = 0.f;
+	for (f32 sigma = 0.25f; sigma <= GaussianKernel::MAX_RADIUS / 3.f; sigma += 0.25f) {
+		GaussianKernel::getWeights(sigma, weights);
+		GaussianKernel::getLinearTaps(weights, taps);
+
+		// half the fetches, the centre and one tap for every two texels
+		CHECK(taps.size() == weights.size() / 2 + 1);
+
+		GaussianKernel::convolve(row.data(), count, weights, discrete.data());
+		GaussianKernel::convolveLinear(row.data(), count, taps, linear.data());
+		for (u32 i = 0; i < count; ++i) maxError = max(maxError, fabsf(discrete[i] - linear[i]));
+
+		// with the 8 bit filter weights of the gpus
+		GaussianKernel::convolveLinear(row.data(), count, taps, linear.data(), 8);
+		for (u32 i = 0; i < count; ++i) maxQuantizedError = max(maxQuantizedError, fabsf(discrete[i] - linear[i]));
+	}
+	CHECK(maxError < 1e-5f);
+	CHECK(maxQuantizedError < 1e-2f);
+	testLog("max error %.7f, with an 8 bit filter %.5f", maxError, maxQuantizedError);
+}
+
+TEST(gaussianKernelTimings) {
+	using namespace std::chrono;
+
+	// not checked, the time to make the weights and the taps when the sigma changes
+	const f32 sigma = 8.f;
+	const u32 iterations = 1000;
+	std::vector<Tap> taps;
+	auto start = high_resolution_clock::now();
+	for (u32 i = 0; i < iterations; ++i) {
+		GaussianKernel::getLinearTaps(sigma, taps);
+	}
+	f64 ns = duration<f64, std::nano>(high_resolution_clock::now() - start).count() / iterations;
+	testLog("sigma %.1f: %u fetches, linear %u, generated in %.0fns", sigma, GaussianKernel::getRadius(sigma) * 2 + 1, (u32)taps.size() * 2 - 1, ns);
+}
@@ -0,0 +1,135 @@
+#include "test.h"
+
+#include <string.h>
+#include <vector>
+
+#include "ImpostorBaker.h"
+
+// Directions spread over the sphere, or the upper half of it
+static std::vector<vec3f> getDirections(bool hemisphere) {
+	std::vector<vec3f> dirs;
+	const u32 steps = 32;
+	for (u32 i = 0; i <= steps; ++i) {
+		f32 y = hemisphere ? (f32)i / steps : (f32)i / steps * 2.f - 1.f;
+		f32 ring = sqrtf(max(1.f - y * y, 0.f));
+		for (u32 j = 0; j < steps; ++j) {
+			f32 phi = 6.2831853f * j / steps;
+			dirs.push_back(vec3f(ring * cosf(phi), y, ring * sinf(phi)));
+		}
+	}
+	// the axes and the folds of the octahedron
+	const vec3f special[] = {
+		vec3f(1.f, 0.f, 0.f), vec3f(-1.f, 0.f, 0.f), vec3f(0.f, 0.f, 1.f), vec3f(0.f, 0.f, -1.f),
+		vec3f(0.f, 1.f, 0.f), vec3f(0.f, -1.f, 0.f), vec3f(1.f, 0.f, 1.f).normalized(), vec3f(-1.f, 0.f, -1.f).normalized(),
+	};
+	for (const vec3f &dir : special) {
+		if (!hemisphere || dir.y >= 0.f) dirs.push_back(dir);
+	}
+	return dirs;
+}
+
+static void checkDirectionsRoundTrip(bool hemisphere) {
+	u32 outside = 0, wrong = 0;
+	for (const vec3f &dir : getDirections(hemisphere)) {
+		vec2f uv = octEncode(dir, hemisphere);
+		outside += fabsf(uv.x) > 1.f + 1e-6f || fabsf(uv.y) > 1.f + 1e-6f ? 1 : 0;
+		wrong += (octDecode(uv, hemisphere) - dir).mag() > 1e-5f ? 1 : 0;
+	}
+	CHECK(outside == 0);
+	CHECK(wrong == 0);
+}
+
+TEST(impostorOctahedronRoundTrips) {
+	checkDirectionsRoundTrip(false);
+	checkDirectionsRoundTrip(true);
+}
+
+TEST(impostorFramesRoundTrip) {
+	// the hemi-octahedron uses the whole square, the corners included
+	const u32 n = 9;
+	u32 wrong = 0;
+	for (u32 y = 0; y < n; ++y) {
+		for (u32 x = 0; x < n; ++x) {
+			vec2f uv((f32)x / (n - 1) * 2.f - 1.f, (f32)y / (n - 1) * 2.f - 1.f);
+			vec3f dir = octDecode(uv, true);
+			wrong += dir.y < -1e-6f ? 1 : 0;
+			wrong += (octEncode(dir, true) - uv).mag() > 1e-5f ? 1 : 0;
+
+			// on the full octahedron the edge of the square folds onto itself, only the inside maps back
+			if (x > 0 && y > 0 && x < n - 1 && y < n - 1) {
+				wrong += (octEncode(octDecode(uv, false), false) - uv).mag() > 1e-5f ? 1 : 0;
+			}
+		}
+	}
+	CHECK(wrong == 0);
+}
+
+TEST(impostorBasisIsOrthonormal) {
+	u32 wrong = 0;
+	for (const vec3f &dir : getDirections(false)) {
+		vec3f right, up;
+		impostorBasis(dir, right, up);
+		wrong += fabsf(right.mag() - 1.f) > 1e-5f || fabsf(up.mag() - 1.f) > 1e-5f ? 1 : 0;
+		wrong += fabsf(dot(right, up)) > 1e-5f || fabsf(dot(right, dir)) > 1e-5f || fabsf(dot(up, dir)) > 1e-5f ? 1 : 0;
+		// up points to the sky unless looking straight down or up
+		if (fabsf(dir.y) < 0.99f) wrong += up.y <= 0.f ? 1 : 0;
+	}
+	CHECK(wrong == 0);
+}
+
+// == BAKING ==============================================================================================================================
+
+// A unit cube with the vertex layout of MMesh: position, uv, normal
+static void makeCube(std::vector<f32> &vertices, std::vector<u32> &indices) {
+	const f32 normals[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for (u32 face = 0; face < 6; ++face) {
+		vec3f n(normals[face][0], normals[face][1], normals[face][2]);
+		vec3f u = fabsf(n.y) > 0.5f ? vec3f(1.f, 0.f, 0.f) : vec3f(0.f, 1.f, 0.f);
+		vec3f v = cross(n, u);
+		u32 first = (u32)vertices.size() / 8;
+		for (u32 corner = 0; corner < 4; ++corner) {
+			f32 su = corner & 1 ? 0.5f : -0.5f;
+			f32 sv = corner & 2 ? 0.5f : -0.5f;
+			vec3f p = n * 0.5f + u * su + v * sv;
+			const f32 vertex[] = { p.x, p.y, p.z, su + 0.5f, sv + 0.5f, n.x, n.y, n.z };
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+		// the rasterizer doesn't cull, the winding doesn't matter
+		const u32 quad[] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+}
+
+TEST(impostorBakeIsDeterministic) {
+	std::vector<f32> vertices;
+	std::vector<u32> indices;
+	makeCube(vertices, indices);
+
+	ImpostorMesh mesh;
+	mesh.vertices = vertices.data();
+	mesh.stride = sizeof(f32) * 8;
+	mesh.vertexCount = (u32)vertices.size() / 8;
+	mesh.indices = indices.data();
+	mesh.indexCount = (u32)indices.size();
+	mesh.color = vec4f(0.5f, 0.25f, 1.f, 1.f);
+
+	ImpostorDesc desc;
+	desc.framesPerSide = 4;
+	desc.frameSize = 32;
+
+	ImpostorAtlas a, b;
+	CHECK(bakeImpostor({ mesh }, desc, a));
+	CHECK(bakeImpostor({ mesh }, desc, b));
+	CHECK(a.albedo.width == 128 && a.albedo.height == 128);
+	CHECK(a.albedo.pixels == b.albedo.pixels);
+	CHECK(a.normalDepth.pixels == b.normalDepth.pixels);
+	CHECK_NEAR(a.radius, sqrtf(3.f) * 0.5f, 1e-5f);
+
+	// the cube covers the middle of every frame, and never the corners of it
+	for (u32 fy = 0; fy < 4; ++fy) {
+		for (u32 fx = 0; fx < 4; ++fx) {
+			CHECK(a.albedo.at(fx * 32 + 16, fy * 32 + 16)[3] == 255);
+			CHECK(a.albedo.at(fx * 32, fy * 32)[3] == 0);
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+#include "MathUtils.h"
+
+// Every item of [0, count) once, with a parallelFor inside every range of the outer one
+static bool runNested(JobSystem &jobs, u32 count) {
+	std::vector<std::atomic<u32>> visits(count * count);
+	for (std::atomic<u32> &v : visits) v = 0;
+
+	jobs.parallelFor(0, count, 1, [&](u32 begin, u32 end) {
+		for (u32 outer = begin; outer < end; ++outer) {
+			jobs.parallelFor(0, count, 3, [&, outer](u32 first, u32 last) {
+				for (u32 inner = first; inner < last; ++inner) {
+					visits[outer * count + inner]++;
+				}
+			});
+		}
+	});
+
+	for (const std::atomic<u32> &v : visits) {
+		if (v != 1) return false;
+	}
+	return true;
+}
+
+// A chain of continuations, each one only starting once the one before it is done
+static bool runChain(JobSystem &jobs, u32 length) {
+	std::vector<JobCounter> counters(length);
+	std::atomic<u32> next { 0 };
+	std::atomic<u32> outOfOrder { 0 };
+
+	for (u32 i = 0; i < length; ++i) {
+		auto step = [&next, &outOfOrder, i]() {
+			if (next.fetch_add(1) != i) outOfOrder++;
+		};
+		if (i == 0) jobs.run(step, &counters[0]);
+		else jobs.runAfter(&counters[i - 1], step, &counters[i]);
+	}
+	jobs.wait(&counters[length - 1]);
+
+	return next == length && outOfOrder == 0;
+}
+
+// Jobs on the workers that hand some work to the main thread
+static bool runMainJobs(JobSystem &jobs, u32 count) {
+	std::thread::id mainThread = std::this_thread::get_id();
+	std::atomic<u32> ran { 0 };
+	std::atomic<u32> wrongThread { 0 };
+
+	JobCounter counter;
+	for (u32 i = 0; i < count; ++i) {
+		jobs.run([&]() {
+			jobs.runOnMain([&]() {
+				if (std::this_thread::get_id() != mainThread) wrongThread++;
+				ran++;
+			}, &counter);
+		}, &counter);
+	}
+	jobs.wait(&counter);
+
+	return ran == count && wrongThread == 0;
+}
+
+TEST(jobSystemParallelForVisitsEveryItemOnce) {
+	CHECK(runNested(jobSystem, 40));
+
+	// empty ranges, a grain bigger than the range, and a grain of 0
+	u32 calls = 0;
+	jobSystem.parallelFor(5, 5, 1, [&calls](u32, u32) { calls++; });
+	CHECK(calls == 0);
+	jobSystem.parallelFor(0, 10, 100, [&calls](u32 begin, u32 end) { calls += end - begin; });
+	CHECK(calls == 10);
+
+	std::atomic<u32> items { 0 };
+	jobSystem.parallelFor(0, 100, 0, [&items](u32 begin, u32 end) { items += end - begin; });
+	CHECK(items == 100);
+}
+
+TEST(jobSystemRunsContinuationsAfterTheirDependency) {
+	CHECK(runChain(jobSystem, 100));
+
+	// a counter that is already done runs the job right away
+	JobCounter done, counter;
+	bool ran = false;
+	jobSystem.runAfter(&done, [&ran]() { ran = true; }, &counter);
+	jobSystem.wait(&counter);
+	CHECK(ran);
+}
+
+TEST(jobSystemRunsMainJobsOnTheMainThread) {
+	CHECK(jobSystem.isMainThread());
+	CHECK(runMainJobs(jobSystem, 50));
+}
+
+TEST(jobSystemStress) {
+	// everything at once, on more threads than the machine has cores
+	const u32 threadCounts[] = { 4, 8 };
+	for (u32 threads : threadCounts) {
+		JobSystem jobs;
+		jobs.init(threads);
+
+		u32 failedRounds = 0;
+		for (u32 round = 0; round < 200; ++round) {
+			bool nested = runNested(jobs, 12);
+			bool chain = runChain(jobs, 20);
+			bool main = runMainJobs(jobs, 20);
+			if (!nested || !chain || !main) failedRounds++;
+		}
+		CHECK(failedRounds == 0);
+
+		JobSystem::Stats stats = jobs.getStats();
+		testLog("%u threads: %llu jobs, %llu steals, %llu sleeps", threads, stats.jobs, stats.steals, stats.sleeps);
+		jobs.shutdown();
+	}
+	// the global system gets the main thread back
+	CHECK(jobSystem.isMainThread());
+}
+
+TEST(jobSystemTimings) {
+	using namespace std::chrono;
+
+	// not checked, parallelFor over 1M items of a few hundred nanoseconds and the cost of an empty job
+	const u32 items = 1000000;
+	const u32 emptyJobs = 10000;
+	std::vector<f32> output(items);
+	auto work = [&output](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			f32 x = (f32)i;
+			for (u32 k = 0; k < 64; ++k) {
+				x = sqrtf(x * 1.0001f + (f32)k);
+			}
+			output[i] = x;
+		}
+	};
+
+	u32 maxThreads = min(max(std::thread::hardware_concurrency(), 1u), 64u);
+	f64 singleMs = 0.0;
+	for (u32 threads = 1; threads <= maxThreads; threads *= 2) {
+		JobSystem jobs;
+		jobs.init(threads);
+
+		// enough ranges for every thread to steal a few
+		u32 grain = max(items / (threads * 16), 1u);
+		auto start = high_resolution_clock::now();
+		jobs.parallelFor(0, items, grain, work);
+		f64 forMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+		if (threads == 1) singleMs = forMs;
+
+		JobCounter counter;
+		start = high_resolution_clock::now();
+		for (u32 i = 0; i < emptyJobs; ++i) {
+			jobs.run([]() {}, &counter);
+		}
+		jobs.wait(&counter);
+		f64 emptyMs = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+
+		jobs.shutdown();
+		testLog(
+			"%2u threads: parallel for %.3fms (x%.2f), empty job %.3fus",
+			threads, forMs, singleMs / forMs, emptyMs * 1000.0 / emptyJobs
+		);
+	}
+}
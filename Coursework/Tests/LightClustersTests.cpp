@@ -0,0 +1,197 @@
+#include "test.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "LightClusters.h"
+#include "MathUtils.h"
+
+using Light = LightClusters::Light;
+using Cluster = LightClusters::Cluster;
+
+// A camera a bit above the ground, looking over the forest
+static ShadowCascades::View makeCamera() {
+	ShadowCascades::View camera;
+	camera.position = { 0.f, 2.f, 0.f };
+	camera.forward = { 0.f, 0.f, 1.f };
+	camera.right = { 1.f, 0.f, 0.f };
+	camera.up = { 0.f, 1.f, 0.f };
+	camera.tanHalfFovY = tanf(degToRad(45.f) * 0.5f);
+	camera.aspect = 16.f / 9.f;
+	camera.nearZ = 0.1f;
+	camera.farZ = 200.f;
+	return camera;
+}
+
+static const f32 MAX_DISTANCE = 150.f;
+
+static vec3f randomDir(u32 &seed) {
+	vec3f dir;
+	do {
+		dir = { randomFloat(seed, -1.f, 1.f), randomFloat(seed, -1.f, 1.f), randomFloat(seed, -1.f, 1.f) };
+	} while (dir.mag2() > 1.f || dir.mag2() < 0.0001f);
+	return dir.normalized();
+}
+
+// Mostly fireflies, some torches
+static std::vector<Light> makeLights(u32 count, u32 &seed) {
+	std::vector<Light> lights(count);
+	for (Light &light : lights) {
+		light.position = { randomFloat(seed, -100.f, 100.f), randomFloat(seed, 0.f, 8.f), randomFloat(seed, -20.f, 160.f) };
+		light.color = { 1.f, 0.9f, 0.4f };
+		if (randomFloat(seed, 0.f, 1.f) < 0.7f) {
+			light.type = LightClusters::Type::Point;
+			light.range = randomFloat(seed, 1.f, 4.f);
+		}
+		else {
+			light.type = LightClusters::Type::Spot;
+			light.range = randomFloat(seed, 5.f, 15.f);
+			light.direction = randomDir(seed);
+			light.cosAngle = randomFloat(seed, 0.6f, 0.95f);
+		}
+	}
+	return lights;
+}
+
+static bool listsMatch(const LightClusters &a, const LightClusters &b, u32 cluster) {
+	const Cluster &ca = a.getClusters()[cluster];
+	const Cluster &cb = b.getClusters()[cluster];
+	return ca.count == cb.count && std::equal(
+		a.getIndices().begin() + ca.offset, a.getIndices().begin() + ca.offset + ca.count,
+		b.getIndices().begin() + cb.offset
+	);
+}
+
+TEST(lightClustersFindTheClusterOfAPoint) {
+	LightClusters clusters;
+	ShadowCascades::View camera = makeCamera();
+	clusters.build(camera, nullptr, 0, MAX_DISTANCE);
+	CHECK(clusters.getFarZ() == MAX_DISTANCE);
+	CHECK(clusters.getStats().indices == 0 && clusters.getStats().usedClusters == 0);
+
+	// straight ahead is in the middle of the screen, up to the first slice in slice 0
+	i32 index = clusters.getClusterIndex({ 0.f, 2.f, 0.5f });
+	CHECK(index == (i32)((LightClusters::TILES_Y / 2) * LightClusters::TILES_X + LightClusters::TILES_X / 2));
+	i32 far = clusters.getClusterIndex({ 0.f, 2.f, MAX_DISTANCE - 1.f });
+	CHECK(far / (i32)(LightClusters::TILES_X * LightClusters::TILES_Y) == (i32)LightClusters::SLICES - 1);
+
+	// behind, past the far plane and off the screen there is none
+	CHECK(clusters.getClusterIndex({ 0.f, 2.f, -5.f }) == -1);
+	CHECK(clusters.getClusterIndex({ 0.f, 2.f, MAX_DISTANCE + 1.f }) == -1);
+	CHECK(clusters.getClusterIndex({ 50.f, 2.f, 10.f }) == -1);
+
+	// the slices grow with the depth
+	f32 previous = 0.f;
+	for (f32 depth = 2.f; depth < MAX_DISTANCE; depth *= 2.f) {
+		f32 slice = logf(depth) * clusters.getSliceScale() + clusters.getSliceBias();
+		CHECK(slice > previous);
+		previous = slice;
+	}
+}
+
+TEST(lightClustersScalarAndSimdAgree) {
+	u32 seed = 9876;
+	std::vector<Light> lights = makeLights(10000, seed);
+	ShadowCascades::View camera = makeCamera();
+
+	LightClusters scalar, simd;
+	scalar.setUseSimd(false);
+	simd.setUseSimd(true);
+	scalar.build(camera, lights.data(), (u32)lights.size(), MAX_DISTANCE);
+	simd.build(camera, lights.data(), (u32)lights.size(), MAX_DISTANCE);
+
+	u32 mismatches = 0;
+	for (u32 c = 0; c < LightClusters::CLUSTER_COUNT; ++c) {
+		if (!listsMatch(scalar, simd, c)) mismatches++;
+	}
+	CHECK(mismatches == 0);
+
+	const LightClusters::Stats &stats = simd.getStats();
+	CHECK(stats.lights == 10000 && stats.visible > 0 && stats.visible < stats.lights);
+	CHECK(stats.indices == (u32)simd.getIndices().size());
+	CHECK(stats.usedClusters > 0 && stats.maxPerCluster <= LightClusters::MAX_PER_CLUSTER);
+	testLog(
+		"%u/%u lights visible, %u indices in %u clusters, at most %u",
+		stats.visible, stats.lights, stats.indices, stats.usedClusters, stats.maxPerCluster
+	);
+}
+
+TEST(lightClustersListEveryLightThatReachesThem) {
+	u32 seed = 9876;
+	std::vector<Light> lights = makeLights(10000, seed);
+	LightClusters clusters;
+	clusters.build(makeCamera(), lights.data(), (u32)lights.size(), MAX_DISTANCE);
+
+	// points inside every light have to find it in their cluster
+	u32 samples = 0, missed = 0;
+	for (u32 i = 0; i < (u32)lights.size(); ++i) {
+		const Light &light = lights[i];
+		for (u32 s = 0; s < 4; ++s) {
+			vec3f offset = randomDir(seed) * (light.range * powf(randomFloat(seed, 0.f, 1.f), 1.f / 3.f));
+			if (light.type == LightClusters::Type::Spot && dot(offset.normalized(), light.direction) < light.cosAngle) {
+				continue;
+			}
+
+			i32 index = clusters.getClusterIndex(light.position + offset);
+			if (index < 0) continue;
+
+			const Cluster &cluster = clusters.getClusters()[index];
+			// a full cluster can't have every light
+			if (cluster.count >= LightClusters::MAX_PER_CLUSTER) continue;
+
+			samples++;
+			auto first = clusters.getIndices().begin() + cluster.offset;
+			if (!std::binary_search(first, first + cluster.count, i)) missed++;
+		}
+	}
+	CHECK(samples > 1000);
+	CHECK(missed == 0);
+}
+
+TEST(lightClustersDropWhatDoesntFit) {
+	// every light in the same few clusters
+	std::vector<Light> lights(LightClusters::MAX_PER_CLUSTER + 100);
+	for (Light &light : lights) {
+		light.position = { 0.f, 2.f, 20.f };
+		light.range = 0.1f;
+	}
+
+	LightClusters clusters;
+	clusters.build(makeCamera(), lights.data(), (u32)lights.size(), MAX_DISTANCE);
+	const LightClusters::Stats &stats = clusters.getStats();
+	CHECK(stats.visible == (u32)lights.size());
+	CHECK(stats.maxPerCluster == LightClusters::MAX_PER_CLUSTER);
+	CHECK(stats.dropped == stats.usedClusters * 100);
+	CHECK(stats.indices == stats.usedClusters * LightClusters::MAX_PER_CLUSTER);
+
+	// the first ones are kept
+	i32 index = clusters.getClusterIndex({ 0.f, 2.f, 20.f });
+	CHECK(index >= 0);
+	const Cluster &cluster = clusters.getClusters()[index];
+	CHECK(cluster.count == LightClusters::MAX_PER_CLUSTER);
+	CHECK(clusters.getIndices()[cluster.offset + cluster.count - 1] == LightClusters::MAX_PER_CLUSTER - 1);
+
+	// and so are lights past MAX_LIGHTS
+	std::vector<Light> many(LightClusters::MAX_LIGHTS + 10);
+	clusters.build(makeCamera(), many.data(), (u32)many.size(), MAX_DISTANCE);
+	CHECK(clusters.getStats().lights == (u32)many.size() && clusters.getStats().dropped >= 10);
+}
+
+TEST(lightClustersTimings) {
+	// not checked, binning 10k lights with and without SSE, the best of a few runs as the first one allocates
+	u32 seed = 9876;
+	std::vector<Light> lights = makeLights(10000, seed);
+	ShadowCascades::View camera = makeCamera();
+
+	LightClusters scalar, simd;
+	scalar.setUseSimd(false);
+	simd.setUseSimd(true);
+	f64 scalarMs = 1e9, simdMs = 1e9;
+	for (u32 run = 0; run < 5; ++run) {
+		scalar.build(camera, lights.data(), (u32)lights.size(), MAX_DISTANCE);
+		simd.build(camera, lights.data(), (u32)lights.size(), MAX_DISTANCE);
+		scalarMs = min(scalarMs, scalar.getStats().binMs);
+		simdMs = min(simdMs, simd.getStats().binMs);
+	}
+	testLog("%u lights: scalar %.3fms, simd %.3fms", (u32)lights.size(), scalarMs, simdMs);
+}
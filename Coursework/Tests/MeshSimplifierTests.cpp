@@ -0,0 +1,186 @@
+#include "test.h"
+
+#include <vector>
+
+#include "MeshSimplifier.h"
+#include "vec.h"
+
+struct TestMesh {
+	std::vector<vec3f> positions;
+	std::vector<u32> indices;
+};
+
+// side * side quads on the xz plane from 0 to 1, facing up
+static TestMesh makeGrid(u32 side) {
+	TestMesh mesh;
+	for (u32 z = 0; z <= side; ++z) {
+		for (u32 x = 0; x <= side; ++x) {
+			mesh.positions.push_back(vec3f((f32)x / side, 0.f, (f32)z / side));
+		}
+	}
+
+	for (u32 z = 0; z < side; ++z) {
+		for (u32 x = 0; x < side; ++x) {
+			u32 i = z * (side + 1) + x;
+			u32 quad[] = { i, i + side + 1, i + 1, i + 1, i + side + 1, i + side + 2 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+// UV sphere with a seam: the first and last column of every ring are at
+// the same position, like the vertices of a mesh with texture coordinates
+static const f32 PI = 3.14159265f;
+
+static TestMesh makeSphere(u32 rings, u32 segments) {
+	TestMesh mesh;
+	for (u32 r = 0; r <= rings; ++r) {
+		// sinf(PI) isn't 0, keep the poles on the axis
+		f32 theta = PI * r / rings;
+		f32 ring = r == 0 || r == rings ? 0.f : sinf(theta);
+		for (u32 s = 0; s <= segments; ++s) {
+			f32 phi = PI * 2.f * (s % segments) / segments;
+			mesh.positions.push_back(vec3f(ring * cosf(phi), cosf(theta), ring * sinf(phi)));
+		}
+	}
+
+	for (u32 r = 0; r < rings; ++r) {
+		for (u32 s = 0; s < segments; ++s) {
+			u32 i = r * (segments + 1) + s;
+			u32 j = i + segments + 1;
+			if (r != 0)         mesh.indices.insert(mesh.indices.end(), { i, i + 1, j });
+			if (r != rings - 1) mesh.indices.insert(mesh.indices.end(), { i + 1, j + 1, j });
+		}
+	}
+	return mesh;
+}
+
+static f32 simplify(const TestMesh &mesh, u32 target, f32 maxError, std::vector<u32> &out) {
+	return simplifyMesh(&mesh.positions[0].x, sizeof(vec3f), (u32)mesh.positions.size(), mesh.indices.data(), (u32)mesh.indices.size(), target, maxError, out);
+}
+
+// Counts the triangles with an index out of range or two equal indices
+static u32 getBrokenTriangles(const std::vector<u32> &indices, u32 vertexCount) {
+	u32 broken = 0;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		u32 a = indices[t], b = indices[t + 1], c = indices[t + 2];
+		bool valid = a < vertexCount && b < vertexCount && c < vertexCount && a != b && b != c && c != a;
+		broken += valid ? 0 : 1;
+	}
+	return broken;
+}
+
+TEST(meshSimplifierReachesTheTarget) {
+	TestMesh sphere = makeSphere(24, 48);
+	const u32 target = (u32)sphere.indices.size() / 2 / 3 * 3;
+
+	std::vector<u32> out;
+	f32 error = simplify(sphere, target, 1.f, out);
+	CHECK(out.size() % 3 == 0);
+	CHECK(out.size() <= target);
+	CHECK(out.size() > target / 2);
+	CHECK(error <= 1.f);
+	CHECK(getBrokenTriangles(out, (u32)sphere.positions.size()) == 0);
+}
+
+TEST(meshSimplifierStopsAtTheMaxError) {
+	TestMesh sphere = makeSphere(24, 48);
+	const f32 maxErrors[] = { 0.001f, 0.01f, 0.05f };
+
+	size_t previous = sphere.indices.size() + 1;
+	for (f32 maxError : maxErrors) {
+		std::vector<u32> out;
+		f32 error = simplify(sphere, 0, maxError, out);
+		CHECK(error <= maxError);
+		CHECK(!out.empty());
+		// a bigger error allows more collapses
+		CHECK(out.size() < previous);
+		previous = out.size();
+	}
+}
+
+TEST(meshSimplifierKeepsFlatGridsWhole) {
+	TestMesh grid = makeGrid(16);
+	std::vector<u32> out;
+	f32 error = simplify(grid, 0, 1e-4f, out);
+	CHECK(error <= 1e-4f);
+	CHECK(out.size() * 8 < grid.indices.size());
+	CHECK(getBrokenTriangles(out, (u32)grid.positions.size()) == 0);
+
+	// nothing flipped, and no holes or overlaps: still facing up with the same area
+	f32 area = 0.f;
+	u32 flipped = 0;
+	for (size_t t = 0; t < out.size(); t += 3) {
+		vec3f a = grid.positions[out[t]], b = grid.positions[out[t + 1]], c = grid.positions[out[t + 2]];
+		vec3f n = cross(b - a, c - a);
+		flipped += n.y <= 0.f ? 1 : 0;
+		area += n.mag() * 0.5f;
+	}
+	CHECK(flipped == 0);
+	CHECK_NEAR(area, 1.f, 1e-4f);
+
+	// the corners can't go anywhere without changing the border
+	const u32 corners[] = { 0, 16, 16 * 17, 17 * 17 - 1 };
+	for (u32 corner : corners) {
+		bool used = false;
+		for (u32 index : out) used |= index == corner;
+		CHECK(used);
+	}
+}
+
+TEST(meshSimplifierKeepsTheSeams) {
+	TestMesh sphere = makeSphere(12, 24);
+	std::vector<u32> out;
+	simplify(sphere, 0, 0.2f, out);
+	CHECK(out.size() * 2 < sphere.indices.size());
+
+	// both copies of every seam vertex off the poles are still there
+	std::vector<bool> used(sphere.positions.size(), false);
+	for (u32 index : out) used[index] = true;
+	for (u32 r = 1; r < 12; ++r) {
+		CHECK(used[r * 25]);
+		CHECK(used[r * 25 + 24]);
+	}
+}
+
+TEST(meshSimplifierBuildsALodChain) {
+	TestMesh sphere = makeSphere(24, 48);
+	LodChainDesc desc;
+	desc.lodCount = 4;
+	desc.reduction = 0.5f;
+	desc.maxError = 0.05f;
+
+	std::vector<u32> indices;
+	std::vector<MeshLod> lods;
+	buildLodChain(&sphere.positions[0].x, sizeof(vec3f), (u32)sphere.positions.size(), sphere.indices.data(), (u32)sphere.indices.size(), desc, indices, lods);
+
+	CHECK(lods.size() >= 2 && lods.size() <= desc.lodCount);
+	CHECK(lods[0].indexStart == 0 && lods[0].indexCount == sphere.indices.size());
+	CHECK(lods[0].error == 0.f);
+
+	// consecutive ranges, each one at least 10% smaller, errors relative to the diagonal (2 * sqrt(3))
+	for (size_t i = 1; i < lods.size(); ++i) {
+		CHECK(lods[i].indexStart == lods[i - 1].indexStart + lods[i - 1].indexCount);
+		CHECK(lods[i].indexCount <= lods[i - 1].indexCount * 9 / 10);
+		CHECK(lods[i].error <= desc.maxError * 2.f * sqrtf(3.f) + 1e-5f);
+	}
+	const MeshLod &last = lods.back();
+	CHECK(last.indexStart + last.indexCount == indices.size());
+	testLog("lods: %zu, last %u triangles from %zu", lods.size(), last.indexCount / 3, sphere.indices.size() / 3);
+}
+
+TEST(meshSimplifierSelectsLodsByScreenSize) {
+	LodChainDesc desc;
+	desc.firstScreenSize = 0.4f;
+
+	CHECK(selectLod(1.f, desc, 4) == 0);
+	CHECK(selectLod(0.4f, desc, 4) == 0);
+	CHECK(selectLod(0.39f, desc, 4) == 1);
+	CHECK(selectLod(0.2f, desc, 4) == 1);
+	CHECK(selectLod(0.19f, desc, 4) == 2);
+	CHECK(selectLod(0.09f, desc, 4) == 3);
+	CHECK(selectLod(0.f, desc, 4) == 3);
+	CHECK(selectLod(0.f, desc, 2) == 1);
+	CHECK(selectLod(0.f, desc, 1) == 0);
+}
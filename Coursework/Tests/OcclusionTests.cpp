@@ -0,0 +1,133 @@
+#include "test.h"
+
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "OcclusionCuller.h"
+
+using Isa = OcclusionCuller::Isa;
+
+// Left handed perspective looking down +z from the origin, row major for row vectors
+static void getViewProj(f32 m[16]) {
+	const f32 nearZ = 0.1f, farZ = 200.f;
+	const f32 yScale = 1.f / tanf(0.5f);
+	memset(m, 0, sizeof(f32) * 16);
+	m[0]  = yScale * 0.5f; // 2:1 like the depth buffer
+	m[5]  = yScale;
+	m[10] = farZ / (farZ - nearZ);
+	m[11] = 1.f;
+	m[14] = -nearZ * farZ / (farZ - nearZ);
+}
+
+static OcclusionCuller makeCuller(Isa isa) {
+	OcclusionCuller culler;
+	culler.init(OcclusionCuller::Desc());
+	culler.setIsa(isa);
+	f32 viewProj[16];
+	getViewProj(viewProj);
+	culler.beginFrame(viewProj);
+	return culler;
+}
+
+// Boxes all over the frustum, some through the near plane or off the screen,
+// and a few big triangles with vertices far outside of it
+static void addRandomOccluders(OcclusionCuller &culler, u32 seed, u32 boxes = 200, u32 triangles = 20) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<f32> unit(0.f, 1.f);
+
+	for (u32 i = 0; i < boxes; ++i) {
+		vec3f center(unit(rng) * 160.f - 80.f, unit(rng) * 80.f - 40.f, unit(rng) * 120.f - 5.f);
+		vec3f half(unit(rng) * 4.f + 0.1f, unit(rng) * 4.f + 0.1f, unit(rng) * 4.f + 0.1f);
+		culler.addBox(center - half, center + half);
+	}
+
+	std::vector<vec3f> vertices;
+	std::vector<u32> indices;
+	for (u32 i = 0; i < triangles * 3; ++i) {
+		vertices.push_back(vec3f(unit(rng) * 2000.f - 1000.f, unit(rng) * 200.f - 100.f, unit(rng) * 300.f - 20.f));
+		indices.push_back(i);
+	}
+	culler.addOccluder(vertices.data(), (u32)vertices.size(), indices.data(), (u32)indices.size());
+}
+
+TEST(occlusionIsasGiveTheSameDepth) {
+	const Isa best = OcclusionCuller::getBestIsa();
+	testLog("best isa: %s", OcclusionCuller::getIsaName(best));
+
+	for (u32 seed = 1; seed <= 4; ++seed) {
+		OcclusionCuller scalar = makeCuller(Isa::Scalar);
+		addRandomOccluders(scalar, seed);
+		CHECK(scalar.getStats().occluderTriangles > 1000);
+
+		for (u32 i = 1; i <= (u32)best; ++i) {
+			OcclusionCuller simd = makeCuller((Isa)i);
+			CHECK(simd.getIsa() == (Isa)i);
+			addRandomOccluders(simd, seed);
+
+			const std::vector<f32> &a = scalar.getDepth();
+			const std::vector<f32> &b = simd.getDepth();
+			CHECK(a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(f32)) == 0);
+		}
+	}
+}
+
+TEST(occlusionMatchesTheReference) {
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<f32> unit(0.f, 1.f);
+	std::vector<vec3f> boxes;
+	for (u32 i = 0; i < 500; ++i) {
+		vec3f center(unit(rng) * 160.f - 80.f, unit(rng) * 80.f - 40.f, unit(rng) * 150.f);
+		vec3f half(unit(rng) * 2.f + 0.05f, unit(rng) * 2.f + 0.05f, unit(rng) * 2.f + 0.05f);
+		boxes.push_back(center - half);
+		boxes.push_back(center + half);
+	}
+
+	for (u32 i = 0; i <= (u32)OcclusionCuller::getBestIsa(); ++i) {
+		OcclusionCuller culler = makeCuller((Isa)i);
+		addRandomOccluders(culler, 7, 40, 2);
+
+		u32 wrong = 0;
+		for (size_t b = 0; b < boxes.size(); b += 2) {
+			wrong += culler.isVisible(boxes[b], boxes[b + 1]) != culler.isVisibleReference(boxes[b], boxes[b + 1]) ? 1 : 0;
+		}
+		CHECK(wrong == 0);
+
+		// something has to be culled and something has to stay, or this doesn't check much
+		const OcclusionCuller::Stats &stats = culler.getStats();
+		CHECK(stats.tested == 500);
+		CHECK(stats.culled > 50 && stats.culled < 450);
+	}
+}
+
+TEST(occlusionHidesTheBoxesBehindAWall) {
+	OcclusionCuller culler = makeCuller(OcclusionCuller::getBestIsa());
+	culler.addBox(vec3f(-20.f, -10.f, 20.f), vec3f(20.f, 10.f, 21.f));
+
+	CHECK(!culler.isVisible(vec3f(-1.f, -1.f, 30.f), vec3f(1.f, 1.f, 32.f)));  // behind
+	CHECK(culler.isVisible(vec3f(-1.f, -1.f, 10.f), vec3f(1.f, 1.f, 12.f)));   // in front
+	CHECK(culler.isVisible(vec3f(-1.f, 14.f, 30.f), vec3f(1.f, 18.f, 32.f)));  // over the top of the wall
+	CHECK(culler.isVisible(vec3f(-1.f, -1.f, -1.f), vec3f(1.f, 1.f, 1.f)));    // through the near plane
+	CHECK(!culler.isVisible(vec3f(-1.f, -1.f, 300.f), vec3f(1.f, 1.f, 302.f))); // past the far plane
+
+	const OcclusionCuller::Stats &stats = culler.getStats();
+	CHECK(stats.occluderTriangles == 12);
+	CHECK(stats.tested == 5 && stats.culled == 2);
+}
+
+TEST(occlusionRasterizerTimings) {
+	using namespace std::chrono;
+
+	// not checked, the same frame rasterized with every isa the cpu has
+	for (u32 i = 0; i <= (u32)OcclusionCuller::getBestIsa(); ++i) {
+		const u32 frames = 50;
+		auto start = high_resolution_clock::now();
+		for (u32 frame = 0; frame < frames; ++frame) {
+			OcclusionCuller culler = makeCuller((Isa)i);
+			addRandomOccluders(culler, 3);
+		}
+		f64 ms = duration<f64, std::milli>(high_resolution_clock::now() - start).count() / frames;
+		testLog("%s: %.3fms per frame", OcclusionCuller::getIsaName((Isa)i), ms);
+	}
+}
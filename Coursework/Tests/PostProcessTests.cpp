@@ -0,0 +1,264 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "PostProcess.h"
+#include "GaussianKernel.h"
+#include "JobSystem.h"
+#include "MathUtils.h"
+
+using Isa = PostProcess::Isa;
+using Options = PostProcess::Options;
+
+// Noise with some bright spots, a few of them over the threshold
+static PostImage makeScene(u32 width, u32 height) {
+	u32 seed = 9753;
+
+	PostImage scene;
+	scene.resize(width, height);
+	for (vec4f &p : scene.pixels) {
+		bool bright = randomFloat(seed, 0.f, 1.f) < 0.05f;
+		p = vec4f(randomFloat(seed, 0.f, 1.f), randomFloat(seed, 0.f, 1.f), randomFloat(seed, 0.f, 1.f), 1.f);
+		if (bright) p = vec4f(p.x * 4.f, p.y * 4.f, p.z * 4.f, 10.f);
+	}
+	return scene;
+}
+
+// The passes of the bloom and the tonemap
+struct PostResults {
+	PostImage bright, blurred, mixed;
+	PostImage8 tonemapped;
+
+	void run(const PostImage &scene, const std::vector<f32> &weights, const Options &options) {
+		PostProcess::threshold(scene, 1.5f, bright, options);
+		PostProcess::convolve(bright, weights, blurred, options);
+		PostProcess::add(blurred, 1.f, scene, mixed, options);
+		PostProcess::tonemap(mixed, 1.f, tonemapped, options);
+	}
+};
+
+static Options withIsa(Isa isa, JobSystem *jobs = nullptr) {
+	Options options;
+	options.isa = isa;
+	options.jobs = jobs;
+	return options;
+}
+
+TEST(postProcessIsasMatchTheScalarPath) {
+	const PostImage scene = makeScene(173, 61);
+	std::vector<f32> weights;
+	GaussianKernel::getWeights(8.f, weights);
+	const f32 tolerance = 1e-4f;
+
+	PostResults scalar;
+	scalar.run(scene, weights, withIsa(Isa::Scalar));
+	// something is over the threshold, and it blooms
+	PostImage black;
+	black.resize(scene.width, scene.height);
+	CHECK(PostProcess::compare(scalar.bright, black, 0.f).differentPixels > 0);
+	CHECK(PostProcess::compare(scalar.mixed, scene, tolerance).differentPixels > 0);
+
+	for (u32 i = 1; i <= (u32)PostProcess::getBestIsa(); ++i) {
+		PostResults results;
+		results.run(scene, weights, withIsa((Isa)i));
+		CHECK(PostProcess::compare(results.bright, scalar.bright, tolerance).differentPixels == 0);
+		CHECK(PostProcess::compare(results.blurred, scalar.blurred, tolerance).differentPixels == 0);
+		CHECK(PostProcess::compare(results.mixed, scalar.mixed, tolerance).differentPixels == 0);
+		CHECK(PostProcess::compare(results.tonemapped, scalar.tonemapped, 1).differentPixels == 0);
+	}
+	testLog("best isa %s", PostProcess::getIsaName(PostProcess::getBestIsa()));
+}
+
+TEST(postProcessTilesGiveTheSameResultOnEveryThread) {
+	// every row is done by the same code whatever the thread, so it's exact
+	const PostImage scene = makeScene(128, 100);
+	std::vector<f32> weights;
+	GaussianKernel::getWeights(4.f, weights);
+
+	JobSystem jobs;
+	jobs.init(4);
+	PostResults single, threaded;
+	single.run(scene, weights, Options());
+	threaded.run(scene, weights, withIsa(Isa::Avx2, &jobs));
+	jobs.shutdown();
+
+	CHECK(PostProcess::compare(threaded.bright, single.bright, 0.f).differentPixels == 0);
+	CHECK(PostProcess::compare(threaded.blurred, single.blurred, 0.f).differentPixels == 0);
+	CHECK(PostProcess::compare(threaded.mixed, single.mixed, 0.f).differentPixels == 0);
+	CHECK(PostProcess::compare(threaded.tonemapped, single.tonemapped, 0).differentPixels == 0);
+}
+
+TEST(postProcessBlurOfATexelIsTheKernel) {
+	std::vector<f32> weights;
+	GaussianKernel::getWeights(3.f, weights);
+	const i32 radius = (i32)weights.size() - 1;
+	const u32 size = radius * 2 + 5;
+	PostImage texel, blurred;
+	texel.resize(size, size);
+	texel.at(size / 2, size / 2) = vec4f(1.f);
+
+	for (u32 i = 0; i <= (u32)PostProcess::getBestIsa(); ++i) {
+		PostProcess::convolve(texel, weights, blurred, withIsa((Isa)i));
+
+		u32 errors = 0;
+		for (u32 y = 0; y < size; ++y) {
+			for (u32 x = 0; x < size; ++x) {
+				i32 dx = abs((i32)x - (i32)size / 2);
+				i32 dy = abs((i32)y - (i32)size / 2);
+				f32 expected = dx <= radius && dy <= radius ? weights[dx] * weights[dy] : 0.f;
+				if (fabsf(blurred.at(x, y).x - expected) > 1e-6f) errors++;
+			}
+		}
+		CHECK(errors == 0);
+	}
+}
+
+TEST(postProcessMatchesTheGoldenValues) {
+	// computed offline with the same formulas
+	PostImage src, out;
+	src.resize(4, 2);
+	src.at(0, 0) = vec4f(0.f, 0.18f, 1.f, 1.f);
+	src.at(1, 0) = vec4f(4.f, 100.f, -1.f, 0.5f);
+	src.at(2, 0) = vec4f(0.5f, 0.1f, 2.f, 1.5f);   // right on the threshold, it doesn't bloom
+	src.at(3, 0) = vec4f(0.5f, 0.1f, 2.f, 1.501f);
+	src.at(0, 1) = vec4f(0.5f, 0.1f, 0.25f, 2.f);
+	src.at(1, 1) = vec4f(0.25f, 0.2f, 0.f, 0.f);
+	src.at(2, 1) = vec4f(1.f, 1.f, 1.f, 1.f);
+	src.at(3, 1) = vec4f(0.f, 0.f, 0.f, 0.f);
+
+	const u8 tonemapped[] = {
+		0, 68, 205, 255,    248, 255, 0, 128,    157, 32, 233, 255,    157, 32, 233, 255,
+		157, 32, 95, 255,   95, 76, 0, 0,        205, 205, 205, 255,   0, 0, 0, 0,
+	};
+	const vec4f thresholded[] = { vec4f(), vec4f(), vec4f(), src.at(3, 0) };
+	// a row of the image plus the one under it halved
+	const vec4f mixed[] = { vec4f(0.25f, 0.23f, 1.f, 1.f), vec4f(1.f, 1.f, 0.f, 0.5f), vec4f(1.f, 0.6f, 1.f, 1.f), vec4f(0.5f, 0.1f, 1.f, 1.f) };
+
+	PostImage top, bottom;
+	top.resize(4, 1);
+	bottom.resize(4, 1);
+	for (u32 x = 0; x < 4; ++x) {
+		top.at(x, 0) = src.at(x, 1);
+		bottom.at(x, 0) = src.at(x, 0);
+	}
+
+	for (u32 i = 0; i <= (u32)PostProcess::getBestIsa(); ++i) {
+		Options options = withIsa((Isa)i);
+
+		PostImage8 bytes;
+		PostProcess::tonemap(src, 1.f, bytes, options);
+		u32 wrongBytes = 0;
+		for (u32 b = 0; b < bytes.pixels.size(); ++b) {
+			if (bytes.pixels[b] != tonemapped[b]) wrongBytes++;
+		}
+		CHECK(bytes.pixels.size() == sizeof(tonemapped) && wrongBytes == 0);
+
+		PostProcess::threshold(src, 1.5f, out, options);
+		for (u32 x = 0; x < 4; ++x) {
+			CHECK(out.at(x, 0) == thresholded[x]);
+		}
+
+		PostProcess::add(top, 0.5f, bottom, out, options);
+		for (u32 x = 0; x < 4; ++x) {
+			vec4f diff = out.at(x, 0) - mixed[x];
+			CHECK(max(max(fabsf(diff.x), fabsf(diff.y)), max(fabsf(diff.z), fabsf(diff.w))) <= 1e-6f);
+		}
+	}
+}
+
+TEST(postProcessCompareMeasuresTheDifference) {
+	PostImage a, b;
+	a.resize(2, 2);
+	b.resize(2, 2);
+	PostProcess::Diff same = PostProcess::compare(a, b, 0.f);
+	CHECK(same.pixels == 4 && same.differentPixels == 0 && same.maxError == 0.f);
+	CHECK(isinf(same.psnr));
+
+	// one channel of one pixel off by a half
+	b.at(1, 0).y = 0.5f;
+	PostProcess::Diff diff = PostProcess::compare(a, b, 0.1f);
+	CHECK(diff.differentPixels == 1 && diff.maxError == 0.5f);
+	CHECK_NEAR((f32)diff.meanError, 0.5f / 16.f, 1e-6f);
+	CHECK_NEAR((f32)diff.rmse, sqrtf(0.25f / 16.f), 1e-6f);
+	CHECK(PostProcess::compare(a, b, 0.6f).differentPixels == 0);
+
+	// different sizes are different everywhere
+	b.resize(3, 2);
+	CHECK(PostProcess::compare(a, b, 1.f).differentPixels == 6);
+
+	// 8 bits, the tolerance is in steps
+	PostImage8 c, d;
+	PostProcess::toRgba8(a, c);
+	PostProcess::toRgba8(a, d);
+	d.at(0, 1)[2] = 2;
+	CHECK(PostProcess::compare(c, d, 1).differentPixels == 1);
+	CHECK(PostProcess::compare(c, d, 2).differentPixels == 0);
+}
+
+TEST(postProcessImagesSurviveTheirFiles) {
+	PostImage image = makeScene(7, 5), readBack;
+	PostImage8 bytes, readBytes;
+	PostProcess::toRgba8(image, bytes);
+
+	const char *pfm = "post_process_test.pfm";
+	const char *pam = "post_process_test.pam";
+	CHECK(PostProcess::writePfm(image, pfm) && PostProcess::readPfm(pfm, readBack));
+	CHECK(PostProcess::writePam(bytes, pam) && PostProcess::readPam(pam, readBytes));
+	remove(pfm);
+	remove(pam);
+
+	// the pfm has no alpha
+	CHECK(readBack.width == 7 && readBack.height == 5);
+	u32 wrong = 0;
+	for (u32 i = 0; i < image.pixels.size(); ++i) {
+		const vec4f &p = image.pixels[i], &q = readBack.pixels[i];
+		if (p.x != q.x || p.y != q.y || p.z != q.z) wrong++;
+	}
+	CHECK(wrong == 0);
+	CHECK(PostProcess::compare(bytes, readBytes, 0).differentPixels == 0);
+
+	CHECK(!PostProcess::readPfm("missing.pfm", readBack));
+}
+
+TEST(postProcessTimings) {
+	using namespace std::chrono;
+
+	// not checked, every pass with every isa on a quarter of 720p, then threaded
+	const PostImage scene = makeScene(640, 360);
+	std::vector<f32> weights;
+	GaussianKernel::getWeights(8.f, weights);
+
+	auto time = [&](const Options &options) {
+		PostResults results;
+		f64 ms[4];
+		auto start = high_resolution_clock::now();
+		PostProcess::threshold(scene, 1.5f, results.bright, options);
+		auto end = high_resolution_clock::now();
+		ms[0] = duration<f64, std::milli>(end - start).count();
+		start = end;
+		PostProcess::convolve(results.bright, weights, results.blurred, options);
+		end = high_resolution_clock::now();
+		ms[1] = duration<f64, std::milli>(end - start).count();
+		start = end;
+		PostProcess::add(results.blurred, 1.f, scene, results.mixed, options);
+		end = high_resolution_clock::now();
+		ms[2] = duration<f64, std::milli>(end - start).count();
+		start = end;
+		PostProcess::tonemap(results.mixed, 1.f, results.tonemapped, options);
+		ms[3] = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+
+		testLog(
+			"%s, %u threads: threshold %.2fms, blur %.2fms, add %.2fms, tonemap %.2fms",
+			PostProcess::getIsaName(min(options.isa, PostProcess::getBestIsa())),
+			options.jobs ? options.jobs->getThreadCount() : 1, ms[0], ms[1], ms[2], ms[3]
+		);
+	};
+
+	for (u32 i = 0; i <= (u32)PostProcess::getBestIsa(); ++i) {
+		time(withIsa((Isa)i));
+	}
+	time(withIsa(Isa::Avx2, &jobSystem));
+}
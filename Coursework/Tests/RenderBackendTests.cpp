@@ -0,0 +1,129 @@
+#include "test.h"
+
+#include <string.h>
+
+#include "RenderBackend.h"
+
+// d3d11 values
+static constexpr u32 TOPOLOGY_TRIANGLELIST = 4;
+static constexpr u32 TOPOLOGY_TRIANGLESTRIP = 5;
+static constexpr u32 FORMAT_R32_UINT = 42;
+
+// A small frame: a buffer created and filled, a few draws, a texture upload
+static void recordFrame(RenderBackend &backend) {
+	const f32 vertices[] = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f };
+	const u32 constants[4] = { 1, 2, 3, 4 };
+	const u8 texels[2 * 8] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+	backend.marker("main");
+	ID3D11Buffer *vb = backend.createBuffer(BufferType::Vertex, sizeof(vertices), vertices, false);
+	ID3D11Buffer *cb = backend.createBuffer(BufferType::Constant, sizeof(constants), nullptr, true);
+
+	void *dst = backend.mapBuffer(cb, 0, sizeof(constants), MapMode::Discard);
+	memcpy(dst, constants, sizeof(constants));
+	backend.unmapBuffer(cb);
+
+	u32 stride = 12, offset = 0;
+	backend.setVertexBuffers(0, 1, &vb, &stride, &offset);
+	backend.setConstantBuffers(ShaderStage::Vertex, 0, 1, &cb);
+	backend.setIndexBuffer(nullptr, FORMAT_R32_UINT, 0);
+	backend.setTopology(TOPOLOGY_TRIANGLELIST);
+	backend.draw(3, 0);
+	backend.drawIndexedInstanced(6, 10, 0, 0);
+	backend.setTopology(TOPOLOGY_TRIANGLESTRIP);
+	backend.drawIndexed(4, 0, 0);
+
+	backend.writeTexture((ID3D11Texture2D *)(uintptr_t)0x100, texels, 8, 2);
+	backend.releaseBuffer(vb);
+	backend.releaseBuffer(cb);
+}
+
+TEST(recordingBackendCountsTheFrame) {
+	RecordingBackend backend;
+	recordFrame(backend);
+
+	const RecordingBackend::Stats &stats = backend.getStats();
+	CHECK(stats.draws == 3);
+	// 1 triangle, 2 triangles * 10 instances, a strip of 4 indices
+	CHECK(stats.primitives == 1 + 20 + 2);
+	// vertices, constants and texels
+	CHECK(stats.bytesUploaded == 36 + 16 + 16);
+	CHECK(backend.getCount(RenderCall::CreateBuffer) == 2);
+	CHECK(backend.getCount(RenderCall::MapBuffer) == 1);
+	CHECK(backend.getTotal() == backend.getCommands().size());
+
+	// the marker keeps its name and the map keeps what was written
+	const std::vector<RecordingBackend::Command> &commands = backend.getCommands();
+	CHECK(commands[0].type == RenderCall::Marker);
+	CHECK(strcmp((const char *)&backend.getData()[commands[0].data], "main") == 0);
+	const RecordingBackend::Command &map = commands[3];
+	CHECK(map.type == RenderCall::MapBuffer && map.size == 16);
+	u32 mapped[4];
+	memcpy(mapped, &backend.getData()[map.data], sizeof(mapped));
+	CHECK(mapped[0] == 1 && mapped[3] == 4);
+
+	// without recording only the stats are kept
+	RecordingBackend counter(false);
+	recordFrame(counter);
+	CHECK(counter.getCommands().empty() && counter.getData().empty());
+	CHECK(counter.getTotal() == backend.getTotal());
+	CHECK(counter.getStats().primitives == stats.primitives);
+
+	backend.clear();
+	CHECK(backend.getCommands().empty() && backend.getTotal() == 0 && backend.getStats().draws == 0);
+}
+
+static bool isSameStream(const RecordingBackend &a, const RecordingBackend &b) {
+	const std::vector<RecordingBackend::Command> &ca = a.getCommands();
+	const std::vector<RecordingBackend::Command> &cb = b.getCommands();
+	if (ca.size() != cb.size()) return false;
+
+	for (size_t i = 0; i < ca.size(); ++i) {
+		if (ca[i].type != cb[i].type || ca[i].stage != cb[i].stage) return false;
+		if (ca[i].start != cb[i].start || ca[i].count != cb[i].count || ca[i].value != cb[i].value || ca[i].base != cb[i].base) return false;
+		if (ca[i].size != cb[i].size) return false;
+		if (ca[i].size && memcmp(&a.getData()[ca[i].data], &b.getData()[cb[i].data], ca[i].size) != 0) return false;
+	}
+	return true;
+}
+
+TEST(recordingBackendForwardsAndReplays) {
+	// a capture in front of another backend: the calls reach it unchanged
+	RecordingBackend device;
+	RecordingBackend capture(true, &device);
+	recordFrame(capture);
+	CHECK(isSameStream(capture, device));
+	CHECK(capture.getStats().bytesUploaded == device.getStats().bytesUploaded);
+
+	// the buffers handed out are the ones of the next backend
+	CHECK(capture.getCommands()[1].object == device.getCommands()[1].object);
+
+	// a replay creates the buffers again and uses the new handles
+	RecordingBackend target;
+	target.createBuffer(BufferType::Index, 4, nullptr, false); // the handles of target don't match the capture's
+	target.clear();
+	capture.replay(target);
+	CHECK(isSameStream(capture, target));
+
+	const std::vector<RecordingBackend::Command> &replayed = target.getCommands();
+	ID3D11Buffer *vb = (ID3D11Buffer *)replayed[1].object;
+	CHECK(vb != capture.getCommands()[1].object);
+	u32 setVertexBuffers = 0;
+	for (const RecordingBackend::Command &cmd : replayed) {
+		if (cmd.type != RenderCall::VertexBuffers) continue;
+		CHECK(target.getObjects()[cmd.objects] == vb);
+		setVertexBuffers++;
+	}
+	CHECK(setVertexBuffers == 1);
+}
+
+TEST(recordingBackendReleasesWhatTheCaptureLeaked) {
+	RecordingBackend capture;
+	const u32 word = 7;
+	capture.createBuffer(BufferType::Vertex, 4, &word, false);
+
+	RecordingBackend target;
+	capture.replay(target);
+	CHECK(target.getCount(RenderCall::CreateBuffer) == 1);
+	CHECK(target.getCount(RenderCall::ReleaseBuffer) == 1);
+}
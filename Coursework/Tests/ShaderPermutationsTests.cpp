@@ -0,0 +1,185 @@
+#include "test.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "ShaderPermutations.h"
+#include "BytecodeCache.h"
+
+using Key = ShaderPermutations::Key;
+using Feature = ShaderPermutations::Feature;
+
+struct ExpectedVariant {
+	const char *shader;
+	Key key;
+	std::vector<u8> bytecode;
+};
+
+// Made up bytecode of different sizes for every variant of the manifest
+static std::vector<ExpectedVariant> makeVariants() {
+	std::vector<ExpectedVariant> variants;
+	u32 count = 0;
+	const ShaderPermutations::ShaderInfo *shaders = ShaderPermutations::getShaders(count);
+	for (u32 s = 0; s < count; ++s) {
+		const ShaderPermutations::ShaderInfo &shader = shaders[s];
+		for (Key key : ShaderPermutations::getKeys(shader)) {
+			u64 seed = BytecodeCache::hash(shader.name, strlen(shader.name)) ^ (key * 0x9e3779b97f4a7c15ull);
+			std::vector<u8> bytecode(48 + (size_t)(seed % 200));
+			for (u8 &byte : bytecode) {
+				seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+				byte = (u8)(seed >> 56);
+			}
+			variants.push_back({ shader.name, key, std::move(bytecode) });
+		}
+	}
+	return variants;
+}
+
+// Added backwards, the writer sorts them
+static std::vector<u8> pack(const std::vector<ExpectedVariant> &variants) {
+	ShaderArchive::Writer writer;
+	for (auto it = variants.rbegin(); it != variants.rend(); ++it) {
+		writer.add(it->shader, it->key, it->bytecode.data(), it->bytecode.size());
+	}
+	return writer.finish();
+}
+
+static void write32(u8 *dst, u32 value) { memcpy(dst, &value, sizeof(value)); }
+
+static bool isRefused(std::vector<u8> broken) {
+	ShaderArchive archive;
+	return !archive.open(broken.data(), broken.size()) && !archive.isOpen();
+}
+
+TEST(shaderPermutationsKeysAreCanonical) {
+	u32 count = 0;
+	const ShaderPermutations::ShaderInfo *shaders = ShaderPermutations::getShaders(count);
+	CHECK(count > 0);
+
+	for (u32 s = 0; s < count; ++s) {
+		const ShaderPermutations::ShaderInfo &shader = shaders[s];
+		CHECK(ShaderPermutations::findShader(shader.name) == &shader);
+
+		// 0 first, then every key once, and they don't change when made canonical again
+		std::vector<Key> keys = ShaderPermutations::getKeys(shader);
+		CHECK(!keys.empty() && keys[0] == 0);
+		for (size_t i = 0; i < keys.size(); ++i) {
+			CHECK(ShaderPermutations::canonical(shader, keys[i]) == keys[i]);
+			if (i) CHECK(keys[i] > keys[i - 1]);
+		}
+	}
+	CHECK(ShaderPermutations::findShader("missing_ps") == nullptr);
+	CHECK(ShaderPermutations::getDefines(0).empty());
+
+	// the radius only counts with spot PCF on
+	Key radius = ShaderPermutations::set(0, Feature::SpotPcfRadius, 2);
+	CHECK(ShaderPermutations::get(radius, Feature::SpotPcfRadius) == 2);
+	for (u32 s = 0; s < count; ++s) {
+		CHECK(ShaderPermutations::canonical(shaders[s], radius) == 0);
+	}
+	Key pcf = ShaderPermutations::set(radius, Feature::SpotPcf, 1);
+	std::vector<ShaderPermutations::Define> defines = ShaderPermutations::getDefines(pcf);
+	CHECK(defines.size() == 2);
+	CHECK(defines[0].name == "SHADOW_USE_BLUR" && defines[0].value == "1");
+	CHECK(defines[1].name == "SHADOW_BLUR_SAMPLE" && defines[1].value == "8");
+}
+
+TEST(shaderArchiveFindsEveryVariant) {
+	std::vector<ExpectedVariant> variants = makeVariants();
+	std::vector<u8> packed = pack(variants);
+
+	ShaderArchive archive;
+	CHECK(archive.open(packed.data(), packed.size()));
+	CHECK(archive.getCount() == (u32)variants.size());
+
+	u32 errors = 0;
+	for (const ExpectedVariant &variant : variants) {
+		ShaderArchive::Variant found = archive.find(variant.shader, variant.key);
+		// the bytecode is used where it is in the archive, aligned to 16 bytes
+		bool same = found.size == variant.bytecode.size() &&
+			memcmp(found.data, variant.bytecode.data(), found.size) == 0 &&
+			found.hash == BytecodeCache::hash(variant.bytecode.data(), variant.bytecode.size()) &&
+			((found.data - packed.data()) & 15) == 0;
+		if (!same) errors++;
+	}
+	CHECK(errors == 0);
+
+	// keys and shaders that aren't there
+	CHECK(archive.find(variants[0].shader, 1ull << 63).data == nullptr);
+	CHECK(archive.find("missing_ps", 0).data == nullptr);
+
+	// a variant added twice keeps the last one
+	ShaderArchive::Writer writer;
+	const u8 first[] = { 1, 2, 3 }, second[] = { 4, 5 };
+	writer.add("default_ps", 0, first, sizeof(first));
+	writer.add("default_ps", 0, second, sizeof(second));
+	std::vector<u8> twice = writer.finish();
+	ShaderArchive small;
+	CHECK(small.open(twice.data(), twice.size()) && small.getCount() == 1);
+	CHECK(small.find("default_ps", 0).size == sizeof(second));
+	small.close();
+	CHECK(!small.isOpen());
+
+	testLog("%u variants, %.1fKB", (u32)variants.size(), packed.size() / 1024.0);
+}
+
+TEST(shaderArchiveRefusesBrokenFiles) {
+	std::vector<ExpectedVariant> variants = makeVariants();
+	std::vector<u8> packed = pack(variants);
+	CHECK(variants.size() >= 2);
+	CHECK(!isRefused(packed));
+
+	std::vector<u8> broken = packed;
+	broken[0] ^= 0xff;
+	CHECK(isRefused(broken));
+
+	broken = packed;
+	write32(&broken[4], ShaderArchive::VERSION + 1);
+	CHECK(isRefused(broken));
+
+	// the table or the last bytecode cut off
+	CHECK(isRefused(std::vector<u8>(packed.begin(), packed.begin() + 24)));
+	CHECK(isRefused(std::vector<u8>(packed.begin(), packed.end() - 1)));
+
+	// more entries than the table can hold
+	broken = packed;
+	write32(&broken[8], 0xffffffff);
+	CHECK(isRefused(broken));
+
+	// the first two entries swapped, they're not sorted anymore
+	broken = packed;
+	std::swap_ranges(broken.begin() + 16, broken.begin() + 48, broken.begin() + 48);
+	CHECK(isRefused(broken));
+
+	// bytecode past the end of the file
+	broken = packed;
+	write32(&broken[16 + 24], (u32)packed.size());
+	CHECK(isRefused(broken));
+
+	CHECK(isRefused({}));
+}
+
+TEST(shaderArchiveTimings) {
+	using namespace std::chrono;
+
+	// not checked, the time to find a variant
+	std::vector<ExpectedVariant> variants = makeVariants();
+	std::vector<u8> packed = pack(variants);
+	ShaderArchive archive;
+	archive.open(packed.data(), packed.size());
+
+	const u32 lookups = 100000;
+	u32 seed = 2468;
+	size_t found = 0;
+	auto start = high_resolution_clock::now();
+	for (u32 i = 0; i < lookups; ++i) {
+		const ExpectedVariant &variant = variants[nextRandom(seed) % variants.size()];
+		found += archive.find(variant.shader, variant.key).size;
+	}
+	f64 ns = duration<f64, std::nano>(high_resolution_clock::now() - start).count() / lookups;
+
+	// the bytes keep the loop from being optimized away
+	testLog("lookup %.1fns (%zu bytes found)", ns, found);
+}
@@ -0,0 +1,167 @@
+#include "test.h"
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "ShadowCache.h"
+
+using Reason = ShadowCache::Reason;
+
+/* The light and random casters around it, changed a few at a time. The
+ * reference compares what the map would contain: the light and the
+ * versions of the casters inside it, the last time it was drawn
+ */
+struct RandomScene {
+	struct Object {
+		u32 version = 0;
+		vec3f bmin, bmax;
+	};
+	using Contents = std::vector<std::pair<u32, u32>>;
+
+	u32 seed = 1234;
+	Object light;
+	std::vector<Object> objects;
+
+	explicit RandomScene(u32 count) : objects(count) {
+		place(light, 60.f);
+		for (Object &object : objects) place(object, 6.f);
+	}
+
+	void place(Object &object, f32 size) {
+		object.bmin = vec3f(randomFloat(seed, -100.f, 100.f), randomFloat(seed, -5.f, 5.f), randomFloat(seed, -100.f, 100.f));
+		object.bmax = object.bmin + vec3f(randomFloat(seed, 1.f, size), randomFloat(seed, 1.f, size), randomFloat(seed, 1.f, size));
+	}
+
+	void change(bool moveLight) {
+		if (moveLight && randomFloat(seed, 0.f, 1.f) < 0.02f) {
+			light.version++;
+			place(light, 60.f);
+		}
+		for (Object &object : objects) {
+			if (randomFloat(seed, 0.f, 1.f) < 0.01f) {
+				object.version++;
+				// most changes don't move the caster
+				if (randomFloat(seed, 0.f, 1.f) < 0.5f) place(object, 6.f);
+			}
+		}
+	}
+
+	void submit(ShadowCache &cache) const {
+		cache.setLight(light.version, light.bmin, light.bmax);
+		for (u32 i = 0; i < (u32)objects.size(); ++i) {
+			cache.setCaster(i, objects[i].version, objects[i].bmin, objects[i].bmax);
+		}
+	}
+
+	Contents getContents() const {
+		Contents contents;
+		contents.emplace_back(~0u, light.version);
+		for (u32 i = 0; i < (u32)objects.size(); ++i) {
+			const Object &o = objects[i];
+			bool inside =
+				o.bmin.x <= light.bmax.x && o.bmax.x >= light.bmin.x &&
+				o.bmin.y <= light.bmax.y && o.bmax.y >= light.bmin.y &&
+				o.bmin.z <= light.bmax.z && o.bmax.z >= light.bmin.z;
+			if (inside) contents.emplace_back(i, o.version);
+		}
+		return contents;
+	}
+};
+
+TEST(shadowCacheFollowsTheScript) {
+	const vec3f volumeMin(-10.f), volumeMax(10.f);
+	const vec3f insideMin(-1.f), insideMax(1.f);
+	const vec3f outsideMin(50.f), outsideMax(52.f);
+
+	ShadowCache cache;
+	cache.setLight(1, volumeMin, volumeMax);
+	cache.setCaster(0, 1, insideMin, insideMax);
+	cache.setCaster(1, 1, outsideMin, outsideMax);
+	CHECK(cache.update() && cache.getReason() == Reason::First);
+
+	// nothing changed
+	cache.setLight(1, volumeMin, volumeMax);
+	cache.setCaster(0, 1, insideMin, insideMax);
+	cache.setCaster(1, 1, outsideMin, outsideMax);
+	CHECK(!cache.update() && cache.getReason() == Reason::None);
+
+	// changed outside of the volume
+	cache.setCaster(1, 2, outsideMin, outsideMax);
+	CHECK(!cache.update());
+	// changed in place inside of it
+	cache.setCaster(0, 2, insideMin, insideMax);
+	CHECK(cache.update() && cache.getReason() == Reason::Caster);
+	// moved in, then out again
+	cache.setCaster(1, 3, insideMin, insideMax);
+	CHECK(cache.update());
+	cache.setCaster(1, 4, outsideMin, outsideMax);
+	CHECK(cache.update());
+
+	// the light moved
+	cache.setLight(2, volumeMin + 5.f, volumeMax + 5.f);
+	CHECK(cache.update() && cache.getReason() == Reason::Light);
+	cache.invalidate();
+	CHECK(cache.update() && cache.getReason() == Reason::Forced);
+
+	// new casters
+	cache.setCaster(2, 0, outsideMin, outsideMax);
+	CHECK(!cache.update());
+	cache.setCaster(3, 0, insideMin, insideMax);
+	CHECK(cache.update());
+	CHECK(!cache.update());
+
+	const ShadowCache::Stats &stats = cache.getStats();
+	CHECK(stats.frames == 11 && stats.rebuilds == 7);
+	CHECK(stats.lightChanges == 1);
+	CHECK(stats.casterChanges == 5 && stats.ignoredChanges == 3);
+}
+
+TEST(shadowCacheDrawsOnlyWhenTheContentsChange) {
+	const u32 frames = 1000;
+	RandomScene scene(1000);
+	ShadowCache cache;
+	RandomScene::Contents drawn;
+
+	u32 missed = 0, extra = 0, rebuilds = 0;
+	for (u32 frame = 0; frame < frames; ++frame) {
+		scene.change(frame > 0);
+		scene.submit(cache);
+		bool rebuilt = cache.update();
+
+		RandomScene::Contents contents = scene.getContents();
+		bool needed = frame == 0 || contents != drawn;
+		if (needed && !rebuilt) missed++;
+		if (!needed && rebuilt) extra++;
+		if (rebuilt) {
+			rebuilds++;
+			drawn = contents;
+		}
+	}
+
+	CHECK(missed == 0);
+	CHECK(extra == 0);
+	CHECK(cache.getStats().frames == frames && cache.getStats().rebuilds == rebuilds);
+	// far fewer than one a frame, most changes are outside the light
+	CHECK(rebuilds < frames / 2);
+	testLog("%u frames: drawn %u times", frames, rebuilds);
+}
+
+TEST(shadowCacheTimings) {
+	using namespace std::chrono;
+
+	// not checked, the time to update the light and every caster
+	const u32 frames = 1000, casters = 1000;
+	RandomScene scene(casters);
+	ShadowCache cache;
+
+	f64 totalUs = 0.0;
+	for (u32 frame = 0; frame < frames; ++frame) {
+		scene.change(frame > 0);
+		auto start = high_resolution_clock::now();
+		scene.submit(cache);
+		cache.update();
+		totalUs += duration<f64, std::micro>(high_resolution_clock::now() - start).count();
+	}
+	testLog("%u casters: %.2fus per frame", casters, totalUs / frames);
+}
@@ -0,0 +1,240 @@
+#include "test.h"
+
+#include <chrono>
+
+#include "ShadowCascades.h"
+#include "MathUtils.h"
+
+using Cascade = ShadowCascades::Cascade;
+
+static ShadowCascades::View makeCamera() {
+	ShadowCascades::View camera;
+	camera.tanHalfFovY = tanf(degToRad(45.f) * 0.5f);
+	camera.aspect = 16.f / 9.f;
+	camera.nearZ = 0.1f;
+	camera.farZ = 200.f;
+	return camera;
+}
+
+// Walks in a circle looking around, a bit up and down
+static void moveCamera(ShadowCascades::View &camera, u32 frame) {
+	f32 t = (f32)frame * 0.01f;
+	f32 yaw = t * 3.f;
+	f32 pitch = sinf(t * 5.f) * 0.4f;
+	camera.position = { cosf(t) * 80.f, 2.f + sinf(t * 2.f), sinf(t) * 80.f };
+	camera.forward = { cosf(pitch) * sinf(yaw), sinf(pitch), cosf(pitch) * cosf(yaw) };
+	camera.right = cross(vec3f(0.f, 1.f, 0.f), camera.forward).normalized();
+	camera.up = cross(camera.forward, camera.right);
+}
+
+static vec3f transformPoint(const f32 m[16], const vec3f &p) {
+	f32 w = p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15];
+	return vec3f(
+		p.x * m[0] + p.y * m[4] + p.z * m[8]  + m[12],
+		p.x * m[1] + p.y * m[5] + p.z * m[9]  + m[13],
+		p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+	) / w;
+}
+
+static void getSliceCorners(const ShadowCascades::View &camera, f32 nearZ, f32 farZ, vec3f corners[8]) {
+	for (u32 i = 0; i < 8; ++i) {
+		f32 z = i & 4 ? farZ : nearZ;
+		f32 h = z * camera.tanHalfFovY;
+		f32 w = h * camera.aspect;
+		corners[i] = camera.position + camera.forward * z + camera.right * (i & 1 ? w : -w) + camera.up * (i & 2 ? h : -h);
+	}
+}
+
+TEST(shadowCascadesSplitsGrowFromNearToFar) {
+	f32 splits[ShadowCascades::MAX_CASCADES + 1];
+
+	// uniform and logarithmic
+	ShadowCascades::computeSplits(1.f, 100.f, 2, 0.f, splits);
+	CHECK(splits[0] == 1.f && splits[2] == 100.f);
+	CHECK_NEAR(splits[1], 50.5f, 1e-4f);
+	ShadowCascades::computeSplits(1.f, 100.f, 2, 1.f, splits);
+	CHECK_NEAR(splits[1], 10.f, 1e-4f);
+
+	ShadowCascades::Desc desc;
+	ShadowCascades::View camera = makeCamera();
+	ShadowCascades cascades;
+	const vec3f lightDir = vec3f(0.4f, -1.f, 0.3f).normalized();
+	const u32 counts[] = { 0, 1, 3, 4, 9 };
+	for (u32 count : counts) {
+		desc.count = count;
+		cascades.update(desc, camera, lightDir);
+
+		// there is always one, and never more than the shaders have
+		u32 expected = clamp(count, 1u, (u32)ShadowCascades::MAX_CASCADES);
+		CHECK(cascades.getCount() == expected);
+
+		// they cover the camera up to the shadow distance without gaps
+		CHECK(cascades.getCascade(0).nearZ == camera.nearZ);
+		CHECK(cascades.getSplit(expected - 1) == min(camera.farZ, desc.maxDistance));
+		for (u32 i = 0; i < expected; ++i) {
+			CHECK(cascades.getCascade(i).farZ > cascades.getCascade(i).nearZ);
+			if (i > 0) CHECK(cascades.getCascade(i).nearZ == cascades.getCascade(i - 1).farZ);
+		}
+	}
+}
+
+TEST(shadowCascadesMakeViewReadsTheCamera) {
+	// a look-at view and a left handed perspective, like DirectXMath builds them
+	ShadowCascades::View camera = makeCamera();
+	moveCamera(camera, 37);
+	f32 n = camera.nearZ, f = camera.farZ;
+	const vec3f &r = camera.right, &u = camera.up, &d = camera.forward, &eye = camera.position;
+	const f32 view[16] = {
+		r.x, u.x, d.x, 0.f,
+		r.y, u.y, d.y, 0.f,
+		r.z, u.z, d.z, 0.f,
+		-dot(r, eye), -dot(u, eye), -dot(d, eye), 1.f,
+	};
+	f32 proj[16] = {};
+	proj[0] = 1.f / (camera.tanHalfFovY * camera.aspect);
+	proj[5] = 1.f / camera.tanHalfFovY;
+	proj[10] = f / (f - n);
+	proj[11] = 1.f;
+	proj[14] = -n * f / (f - n);
+
+	ShadowCascades::View result = ShadowCascades::makeView(view, proj);
+	CHECK((result.position - eye).mag() < 1e-3f);
+	CHECK((result.forward - d).mag() < 1e-5f && (result.right - r).mag() < 1e-5f && (result.up - u).mag() < 1e-5f);
+	CHECK_NEAR(result.tanHalfFovY, camera.tanHalfFovY, 1e-5f);
+	CHECK_NEAR(result.aspect, camera.aspect, 1e-5f);
+	CHECK_NEAR(result.nearZ, n, 1e-4f);
+	CHECK_NEAR(result.farZ, f, 0.05f);
+}
+
+TEST(shadowCascadesContainTheirSlicesOnTheTexelGrid) {
+	ShadowCascades::Desc desc;
+	ShadowCascades::View camera = makeCamera();
+	ShadowCascades cascades;
+	const vec3f lightDir = vec3f(0.4f, -1.f, 0.3f).normalized();
+	const u32 frames = 500;
+
+	u32 containErrors = 0, snapErrors = 0, shimmerErrors = 0;
+	f32 lastRadius[ShadowCascades::MAX_CASCADES] = {};
+	for (u32 frame = 0; frame < 2 * frames; ++frame) {
+		moveCamera(camera, frame % frames);
+		// the sphere fit first, it's checked for shimmering
+		desc.fit = frame < frames ? ShadowCascades::Fit::Sphere : ShadowCascades::Fit::Tight;
+		cascades.update(desc, camera, lightDir);
+
+		for (u32 i = 0; i < cascades.getCount(); ++i) {
+			const Cascade &c = cascades.getCascade(i);
+
+			// the corners of the slice are inside the projection
+			vec3f corners[8];
+			getSliceCorners(camera, c.nearZ, c.farZ, corners);
+			for (const vec3f &corner : corners) {
+				vec3f p = transformPoint(c.viewProj, corner);
+				const f32 eps = 1e-3f;
+				if (fabsf(p.x) > 1.f + eps || fabsf(p.y) > 1.f + eps || p.z < -eps || p.z > 1.f + eps) {
+					containErrors++;
+				}
+			}
+
+			// the edges of the projection are on whole texels
+			f32 texelsX = c.boxMin.x * (f32)desc.resolution / (c.boxMax.x - c.boxMin.x);
+			f32 texelsY = c.boxMin.y * (f32)desc.resolution / (c.boxMax.y - c.boxMin.y);
+			if (fabsf(texelsX - roundf(texelsX)) > 0.05f || fabsf(texelsY - roundf(texelsY)) > 0.05f) {
+				snapErrors++;
+			}
+
+			// the sphere doesn't change size as the camera moves and turns
+			if (desc.fit == ShadowCascades::Fit::Sphere && frame > 0 && c.radius != lastRadius[i]) {
+				shimmerErrors++;
+			}
+			lastRadius[i] = c.radius;
+		}
+	}
+	CHECK(containErrors == 0);
+	CHECK(snapErrors == 0);
+	CHECK(shimmerErrors == 0);
+}
+
+TEST(shadowCascadesCullKeepsTheCastersOfEverySlice) {
+	ShadowCascades::Desc desc;
+	ShadowCascades::View camera = makeCamera();
+	ShadowCascades cascades;
+	const vec3f lightDir = vec3f(0.4f, -1.f, 0.3f).normalized();
+
+	u32 seed = 1234;
+	u32 missed = 0, tested = 0, counted = 0;
+	for (u32 frame = 0; frame < 200; ++frame) {
+		moveCamera(camera, frame * 5);
+		desc.fit = frame & 1 ? ShadowCascades::Fit::Tight : ShadowCascades::Fit::Sphere;
+		cascades.update(desc, camera, lightDir);
+		CHECK(cascades.getStats().tested == 0);
+		u32 frameCounted = 0;
+
+		for (u32 b = 0; b < 16; ++b) {
+			vec3f bmin = camera.position + vec3f(randomFloat(seed, -200.f, 200.f), randomFloat(seed, -20.f, 20.f), randomFloat(seed, -200.f, 200.f));
+			vec3f bmax = bmin + vec3f(randomFloat(seed, 0.5f, 10.f), randomFloat(seed, 0.5f, 20.f), randomFloat(seed, 0.5f, 10.f));
+			u32 mask = cascades.cull(bmin, bmax);
+			CHECK(mask == cascades.getCasterMask(bmin, bmax));
+			tested++;
+
+			// the light space box of the corners, the cull has to keep every cascade it touches
+			vec3f lmin = vec3f(1e30f), lmax = vec3f(-1e30f);
+			for (u32 k = 0; k < 8; ++k) {
+				vec3f corner = { k & 1 ? bmax.x : bmin.x, k & 2 ? bmax.y : bmin.y, k & 4 ? bmax.z : bmin.z };
+				vec3f p = transformPoint(cascades.getCascade(0).view, corner);
+				lmin = { min(lmin.x, p.x), min(lmin.y, p.y), min(lmin.z, p.z) };
+				lmax = { max(lmax.x, p.x), max(lmax.y, p.y), max(lmax.z, p.z) };
+			}
+
+			for (u32 i = 0; i < cascades.getCount(); ++i) {
+				const Cascade &c = cascades.getCascade(i);
+				// shrunk a bit, the rounding can go either way on the edges
+				const f32 eps = 1e-3f;
+				bool touches =
+					lmax.x > c.boxMin.x + eps && lmin.x < c.boxMax.x - eps &&
+					lmax.y > c.boxMin.y + eps && lmin.y < c.boxMax.y - eps &&
+					lmax.z > c.boxMin.z + eps && lmin.z < c.boxMax.z - eps;
+				if (touches && !(mask & (1 << i))) missed++;
+				if (mask & (1 << i)) frameCounted++;
+			}
+		}
+
+		// only cull() counts, getCasterMask() doesn't
+		u32 casters = 0;
+		for (u32 i = 0; i < cascades.getCount(); ++i) casters += cascades.getStats().casters[i];
+		CHECK(cascades.getStats().tested == 16 && casters == frameCounted);
+		counted += frameCounted;
+	}
+	CHECK(missed == 0);
+	CHECK(tested == 200 * 16 && counted > 0);
+}
+
+TEST(shadowCascadesTimings) {
+	using namespace std::chrono;
+
+	// not checked, fitting the cascades every frame and culling a caster
+	ShadowCascades::Desc desc;
+	ShadowCascades::View camera = makeCamera();
+	ShadowCascades cascades;
+	const vec3f lightDir = vec3f(0.4f, -1.f, 0.3f).normalized();
+	const u32 frames = 1000, boxes = 1000;
+
+	f64 fitMs = 0.0, cullMs = 0.0;
+	u32 seed = 99;
+	for (u32 frame = 0; frame < frames; ++frame) {
+		moveCamera(camera, frame);
+		auto start = high_resolution_clock::now();
+		cascades.update(desc, camera, lightDir);
+		fitMs += duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+
+		if (frame % 100 == 0) {
+			vec3f bmin = camera.position + vec3f(randomFloat(seed, -100.f, 100.f), 0.f, randomFloat(seed, -100.f, 100.f));
+			start = high_resolution_clock::now();
+			for (u32 b = 0; b < boxes; ++b) {
+				cascades.cull(bmin, bmin + vec3f((f32)(b % 10)));
+			}
+			cullMs += duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+		}
+	}
+
+	testLog("%u cascades: fit %.3fus, cull %.3fus", desc.count, fitMs * 1000.0 / frames, cullMs * 1000.0 / (boxes * frames / 100));
+}
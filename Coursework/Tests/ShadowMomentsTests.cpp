@@ -0,0 +1,185 @@
+#include "test.h"
+
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "ShadowMoments.h"
+#include "MathUtils.h"
+
+using Params = ShadowMoments::Params;
+
+TEST(shadowMomentsMatchTheGoldenValues) {
+	// computed offline in double precision with the same formulas
+	struct Case {
+		f32 occluders[2];
+		f32 weight; // of the first occluder, the second has the rest
+		f32 receiver;
+		bool bleeding;
+		f32 expected;
+	};
+
+	const Case cases[] = {
+		// lit: the receiver is the occluder
+		{ { 0.5f, 0.5f }, 1.f, 0.5f, true, 1.f },
+		// in front of the occluder
+		{ { 0.6f, 0.6f }, 1.f, 0.3f, true, 1.f },
+		// right behind it, the minimum variance softens it
+		{ { 0.3f, 0.3f }, 1.f, 0.3001f, false, 0.19984f },
+		{ { 0.3f, 0.3f }, 1.f, 0.302f, false, 0.00061f },
+		{ { 0.3f, 0.3f }, 1.f, 0.6f, true, 0.f },
+		// half of the texel is the occluder, half the receiver
+		{ { 0.3f, 0.6f }, 0.5f, 0.6f, false, 0.5f },
+		{ { 0.3f, 0.6f }, 0.5f, 0.6f, true, 0.375f },
+		{ { 0.3f, 0.6f }, 0.25f, 0.6f, false, 0.75f },
+		// between the two half of it is lit, the bound is over that
+		{ { 0.3f, 0.6f }, 0.5f, 0.45f, false, 0.71255f },
+		// behind both, it's lit through the tail of the bound
+		{ { 0.3f, 0.6f }, 0.5f, 0.61f, false, 0.07746f },
+	};
+
+	Params noBleeding;
+	noBleeding.lightBleeding = 0.f;
+	for (const Case &c : cases) {
+		vec4f moments = ShadowMoments::encode(c.occluders[0]) * c.weight + ShadowMoments::encode(c.occluders[1]) * (1.f - c.weight);
+		CHECK_NEAR(ShadowMoments::visibility(moments, c.receiver, c.bleeding ? Params() : noBleeding), c.expected, 1e-3f);
+	}
+
+	// depth conversion
+	const f32 nearZ = 0.1f, farZ = 100.f;
+	CHECK_NEAR(ShadowMoments::linearizeDepth(0.f, nearZ, farZ), 0.f, 1e-3f);
+	CHECK_NEAR(ShadowMoments::linearizeDepth(1.f, nearZ, farZ), 1.f, 1e-3f);
+	CHECK_NEAR(ShadowMoments::linearizeDepth(0.9f, nearZ, farZ), 0.00892f, 1e-3f);
+	CHECK_NEAR(ShadowMoments::linearizeDepth(0.99f, nearZ, farZ), 0.09008f, 1e-3f);
+	CHECK_NEAR(ShadowMoments::linearizeDepth(0.999f, nearZ, farZ), 0.49975f, 1e-3f);
+}
+
+TEST(shadowMomentsNeverDarkerThanTheBound) {
+	// Chebyshev's inequality: without light bleeding reduction the visibility
+	// can't be less than the fraction of the texel's depths behind the receiver
+	Params params;
+	params.lightBleeding = 0.f;
+	const u32 samples = 100000;
+	const u32 DEPTHS = 16;
+	f32 depths[DEPTHS];
+
+	u32 seed = 1357;
+	u32 errors = 0;
+	for (u32 s = 0; s < samples; ++s) {
+		// a few clusters of depths, like the edge of a tree over the ground
+		f32 base = randomFloat(seed, 0.05f, 0.9f);
+		vec4f moments;
+		for (u32 i = 0; i < DEPTHS; ++i) {
+			depths[i] = clamp(base + (i % 3) * randomFloat(seed, 0.f, 0.1f), 0.f, 1.f);
+			moments += ShadowMoments::encode(depths[i]) / (f32)DEPTHS;
+		}
+
+		f32 receiver = randomFloat(seed, 0.f, 1.f);
+		u32 behind = 0;
+		for (u32 i = 0; i < DEPTHS; ++i) {
+			behind += depths[i] >= receiver ? 1 : 0;
+		}
+
+		if (ShadowMoments::visibility(moments, receiver, params) < (f32)behind / DEPTHS - 1e-3f) {
+			errors++;
+		}
+	}
+	CHECK(errors == 0);
+}
+
+TEST(shadowMomentsSeparableBlurMatches2d) {
+	const u32 size = 32;
+	const u32 radius = 4;
+	const i32 last = (i32)size - 1;
+	u32 seed = 2468;
+	std::vector<vec4f> moments(size * size);
+	for (vec4f &m : moments) m = ShadowMoments::encode(randomFloat(seed, 0.f, 1.f));
+
+	std::vector<vec4f> reference(moments.size());
+	for (i32 y = 0; y <= last; ++y) {
+		for (i32 x = 0; x <= last; ++x) {
+			vec4f sum;
+			for (i32 j = -(i32)radius; j <= (i32)radius; ++j) {
+				for (i32 i = -(i32)radius; i <= (i32)radius; ++i) {
+					f32 weight = ShadowMoments::getBlurWeight(i, radius) * ShadowMoments::getBlurWeight(j, radius);
+					sum += moments[clamp(y + j, 0, last) * size + clamp(x + i, 0, last)] * weight;
+				}
+			}
+			reference[y * size + x] = sum;
+		}
+	}
+
+	ShadowMoments::blur(moments, size, radius);
+	u32 errors = 0;
+	for (u32 i = 0; i < moments.size(); ++i) {
+		// relative, the positive moments are huge
+		vec4f diff = moments[i] - reference[i];
+		f32 scale = max(fabsf(reference[i].y), 1.f);
+		if (max(max(fabsf(diff.x), fabsf(diff.y)), max(fabsf(diff.z), fabsf(diff.w))) > scale * 1e-4f) {
+			errors++;
+		}
+	}
+	CHECK(errors == 0);
+
+	// the weights add up to one, and the radius is capped like in the shader
+	f32 total = 0.f;
+	for (i32 i = -(i32)radius; i <= (i32)radius; ++i) total += ShadowMoments::getBlurWeight(i, radius);
+	CHECK_NEAR(total, 1.f, 1e-5f);
+	CHECK(ShadowMoments::getBlurWeight(0, 0) == 1.f && ShadowMoments::getBlurWeight(1, 0) == 0.f);
+
+	std::vector<vec4f> capped = reference, maxed = reference;
+	ShadowMoments::blur(capped, size, 100);
+	ShadowMoments::blur(maxed, size, ShadowMoments::MAX_BLUR_RADIUS);
+	CHECK(memcmp(capped.data(), maxed.data(), capped.size() * sizeof(vec4f)) == 0);
+}
+
+TEST(shadowMomentsDownsampleAveragesTheDepths) {
+	// 4x4 depths to 2x2 moments, a flat map stays flat
+	const f32 nearZ = 0.1f, farZ = 100.f;
+	f32 depth[16];
+	for (f32 &d : depth) d = 0.99f;
+	std::vector<vec4f> moments;
+	ShadowMoments::downsample(depth, 4, 2, nearZ, farZ, moments);
+	CHECK(moments.size() == 4);
+
+	vec4f expected = ShadowMoments::encode(ShadowMoments::linearizeDepth(0.99f, nearZ, farZ));
+	for (const vec4f &m : moments) {
+		CHECK_NEAR(m.x, expected.x, fabsf(expected.x) * 1e-5f);
+		CHECK_NEAR(m.z, expected.z, fabsf(expected.z) * 1e-5f);
+	}
+
+	// half of a texel in front, the average of the two
+	depth[0] = depth[1] = 0.9f;
+	ShadowMoments::downsample(depth, 4, 2, nearZ, farZ, moments);
+	vec4f front = ShadowMoments::encode(ShadowMoments::linearizeDepth(0.9f, nearZ, farZ));
+	CHECK_NEAR(moments[0].x, (front.x + expected.x) * 0.5f, fabsf(expected.x) * 1e-5f);
+	CHECK_NEAR(moments[1].x, expected.x, fabsf(expected.x) * 1e-5f);
+}
+
+TEST(shadowMomentsTimings) {
+	using namespace std::chrono;
+
+	// not checked, the time to encode a depth and to get the visibility of a receiver
+	const u32 samples = 100000;
+	u32 seed = 1357;
+	std::vector<f32> depths(samples);
+	std::vector<vec4f> moments(samples);
+	for (f32 &depth : depths) depth = randomFloat(seed, 0.f, 1.f);
+
+	auto start = high_resolution_clock::now();
+	for (u32 i = 0; i < samples; ++i) {
+		moments[i] = ShadowMoments::encode(depths[i]);
+	}
+	f64 encodeNs = duration<f64, std::nano>(high_resolution_clock::now() - start).count() / samples;
+
+	Params params;
+	f32 total = 0.f;
+	start = high_resolution_clock::now();
+	for (u32 i = 0; i < samples; ++i) {
+		total += ShadowMoments::visibility(moments[i], depths[samples - 1 - i], params);
+	}
+	f64 visibilityNs = duration<f64, std::nano>(high_resolution_clock::now() - start).count() / samples;
+
+	// the total keeps the loop from being optimized away
+	testLog("encode %.1fns, visibility %.1fns (%.0f lit)", encodeNs, visibilityNs, total);
+}
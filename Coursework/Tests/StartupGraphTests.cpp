@@ -0,0 +1,204 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "StartupGraph.h"
+#include "JobSystem.h"
+
+using Affinity = StartupGraph::Affinity;
+using TaskId = StartupGraph::TaskId;
+
+static void busyWait(f64 ms) {
+	using namespace std::chrono;
+	auto end = high_resolution_clock::now() + duration<f64, std::milli>(ms);
+	while (high_resolution_clock::now() < end) {}
+}
+
+// Stands in for the device: counts the objects created and the ones that
+// weren't created on the main thread of the jobs
+struct StubDevice {
+	JobSystem *jobs = nullptr;
+	std::atomic<u32> created { 0 };
+	std::atomic<u32> offMain { 0 };
+
+	void create() {
+		if (jobs && !jobs->isMainThread()) offMain++;
+		created++;
+	}
+};
+
+// A graph like the start-up of the app: files read on the workers, the
+// objects made from them created on the main thread, and a last task that
+// needs all of them. Every task checks that its dependencies are done and
+// gets the order it ran in
+struct StartupRun {
+	StartupGraph graph;
+	StubDevice device;
+	std::unique_ptr<std::atomic<bool>[]> done;
+	std::vector<std::vector<TaskId>> dependencies;
+	std::atomic<u32> ran { 0 };
+	std::atomic<u32> earlyStarts { 0 };
+	std::vector<u32> order;
+	TaskId nextId = 0;
+
+	explicit StartupRun(u32 loads, f64 cpuMs = 0.0) {
+		u32 count = loads * 2 + 2;
+		done.reset(new std::atomic<bool>[count]);
+		dependencies.resize(count);
+		order.resize(count);
+
+		TaskId files = add("read shader files", Affinity::Any, cpuMs, false);
+		TaskId last = add("lights", Affinity::Main, 0.0, true);
+		for (u32 i = 0; i < loads; ++i) {
+			TaskId load = add("import", Affinity::Any, cpuMs, false);
+			TaskId create = add("upload", Affinity::Main, 0.0, true);
+			link(create, load);
+			link(create, files);
+			link(last, create);
+		}
+	}
+
+	TaskId add(const char *name, Affinity affinity, f64 cpuMs, bool createsObject) {
+		TaskId id = nextId++;
+		done[id] = false;
+		graph.add(name, affinity, [this, id, cpuMs, createsObject]() {
+			for (TaskId dependency : dependencies[id]) {
+				if (!done[dependency]) earlyStarts++;
+			}
+			busyWait(cpuMs);
+			if (createsObject) device.create();
+			order[id] = ran++;
+			done[id] = true;
+		});
+		return id;
+	}
+
+	void link(TaskId task, TaskId dependency) {
+		graph.dependsOn(task, dependency);
+		dependencies[task].push_back(dependency);
+	}
+
+	bool execute(JobSystem *jobs) {
+		device.jobs = jobs;
+		device.created = 0;
+		device.offMain = 0;
+		ran = 0;
+		earlyStarts = 0;
+		for (u32 i = 0; i < nextId; ++i) done[i] = false;
+		return graph.execute(jobs);
+	}
+};
+
+TEST(startupGraphRunsTasksAfterTheirDependencies) {
+	JobSystem jobs;
+	jobs.init(4);
+	{
+		StartupRun run(12, 0.2);
+		CHECK(run.execute(&jobs));
+		CHECK(run.ran == 26);
+		CHECK(run.earlyStarts == 0);
+		// the last task needs all the others
+		CHECK(run.order[1] == 25);
+
+		// the timings agree
+		const std::vector<StartupGraph::Timing> &timings = run.graph.getTimings();
+		CHECK(timings.size() == 26);
+		u32 overlaps = 0;
+		for (TaskId id = 0; id < (TaskId)timings.size(); ++id) {
+			for (TaskId dependency : run.dependencies[id]) {
+				if (timings[id].startMs < timings[dependency].endMs) overlaps++;
+			}
+		}
+		CHECK(overlaps == 0);
+		CHECK(run.graph.getStats().tasks == 26);
+		CHECK(run.graph.getStats().totalMs > 0.0);
+	}
+	jobs.shutdown();
+}
+
+TEST(startupGraphKeepsDeviceCallsOnTheMainThread) {
+	JobSystem jobs;
+	jobs.init(4);
+	{
+		StartupRun run(12, 0.2);
+		CHECK(run.execute(&jobs));
+		CHECK(run.device.created == 13);
+		CHECK(run.device.offMain == 0);
+
+		u32 wrongThread = 0;
+		for (const StartupGraph::Timing &timing : run.graph.getTimings()) {
+			if (timing.affinity == Affinity::Main && !timing.onMain) wrongThread++;
+		}
+		CHECK(wrongThread == 0);
+	}
+	jobs.shutdown();
+}
+
+TEST(startupGraphRefusesACycle) {
+	StartupRun run(2);
+	// 0 is the read, 1 the last task, 3 the first upload: the upload now needs
+	// the last task, which needs it
+	run.link(3, 1);
+
+	JobSystem jobs;
+	jobs.init(2);
+	CHECK(!run.execute(&jobs));
+	jobs.shutdown();
+	CHECK(!run.execute(nullptr));
+
+	// not even the tasks outside of the cycle
+	CHECK(run.ran == 0);
+	CHECK(run.device.created == 0);
+	CHECK(run.graph.getStats().tasks == 0);
+
+	// an empty graph has nothing to run
+	StartupGraph empty;
+	CHECK(empty.execute(nullptr));
+}
+
+TEST(startupGraphWithoutJobsRunsInOrder) {
+	StartupRun run(6);
+	CHECK(run.execute(nullptr));
+	CHECK(run.ran == 14 && run.earlyStarts == 0);
+	std::vector<u32> first = run.order;
+
+	// every task on the calling thread, the same order every time
+	for (const StartupGraph::Timing &timing : run.graph.getTimings()) {
+		CHECK(timing.onMain);
+	}
+	CHECK(run.execute(nullptr));
+	CHECK(run.order == first);
+
+	// with a single thread everything runs on the main thread too
+	JobSystem jobs;
+	jobs.init(1);
+	CHECK(jobs.getThreadCount() == 1);
+	CHECK(run.execute(&jobs));
+	jobs.shutdown();
+	CHECK(run.ran == 14 && run.earlyStarts == 0);
+	CHECK(run.device.created == 7 && run.device.offMain == 0);
+	for (const StartupGraph::Timing &timing : run.graph.getTimings()) {
+		CHECK(timing.onMain);
+	}
+}
+
+TEST(startupGraphTimings) {
+	// not checked, 8 loads of 2ms in order and on the workers
+	StartupRun run(8, 2.0);
+	run.execute(nullptr);
+	f64 serialMs = run.graph.getStats().totalMs;
+
+	JobSystem jobs;
+	jobs.init(4);
+	u32 threads = jobs.getThreadCount();
+	run.execute(&jobs);
+	jobs.shutdown();
+
+	testLog(
+		"%u tasks: in order %.1fms, %u threads %.1fms",
+		run.graph.getStats().tasks, serialMs, threads, run.graph.getStats().totalMs
+	);
+}
@@ -0,0 +1,164 @@
+#include "test.h"
+
+#include "StateCache.h"
+
+// Handles that are only compared, never dereferenced
+template<typename T>
+static T *fake(uintptr_t id) {
+	return (T *)(id * 16);
+}
+
+static const RecordingBackend::Command &lastCommand(const RecordingBackend &backend) {
+	return backend.getCommands().back();
+}
+
+TEST(stateCacheElidesRedundantCalls) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+
+	ID3D11VertexShader *vs = fake<ID3D11VertexShader>(1);
+	ID3D11PixelShader *ps = fake<ID3D11PixelShader>(2);
+	for (u32 i = 0; i < 3; ++i) {
+		cache.setVertexShader(vs);
+		cache.setPixelShader(ps);
+		cache.setTopology(4);
+		cache.setInputLayout(fake<ID3D11InputLayout>(3));
+		cache.setIndexBuffer(fake<ID3D11Buffer>(4), 42, 0);
+	}
+	CHECK(backend.getCount(RenderCall::Shader) == 2);
+	CHECK(backend.getCount(RenderCall::Topology) == 1);
+	CHECK(backend.getCount(RenderCall::InputLayout) == 1);
+	CHECK(backend.getCount(RenderCall::IndexBuffer) == 1);
+	CHECK(cache.getCounters().issued == 5 && cache.getCounters().elided == 10);
+
+	// any part of the index buffer binding is a change
+	cache.setIndexBuffer(fake<ID3D11Buffer>(4), 42, 16);
+	CHECK(backend.getCount(RenderCall::IndexBuffer) == 2);
+	CHECK(lastCommand(backend).start == 16);
+
+	// the same shader on another stage isn't the same state
+	cache.setComputeShader(fake<ID3D11ComputeShader>(1));
+	CHECK(backend.getCount(RenderCall::Shader) == 3);
+
+	cache.beginFrame();
+	CHECK(cache.getLastFrame().issued == 7 && cache.getLastFrame().elided == 10);
+	CHECK(cache.getCounters().issued == 0 && cache.getCounters().elided == 0);
+}
+
+TEST(stateCacheIssuesTheSmallestRange) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+
+	ID3D11ShaderResourceView *first[] = {
+		fake<ID3D11ShaderResourceView>(1), fake<ID3D11ShaderResourceView>(2),
+		fake<ID3D11ShaderResourceView>(3), fake<ID3D11ShaderResourceView>(4),
+	};
+	cache.setShaderResources(ShaderStage::Pixel, 2, 4, first);
+	CHECK(lastCommand(backend).start == 2 && lastCommand(backend).count == 4);
+
+	// only the middle two change
+	ID3D11ShaderResourceView *second[] = { first[0], fake<ID3D11ShaderResourceView>(5), fake<ID3D11ShaderResourceView>(6), first[3] };
+	cache.setShaderResources(ShaderStage::Pixel, 2, 4, second);
+	const RecordingBackend::Command &cmd = lastCommand(backend);
+	CHECK(cmd.type == RenderCall::ShaderResources && cmd.stage == ShaderStage::Pixel);
+	CHECK(cmd.start == 3 && cmd.count == 2);
+	CHECK(backend.getObjects()[cmd.objects] == second[1] && backend.getObjects()[cmd.objects + 1] == second[2]);
+
+	// same views, other stage
+	cache.setShaderResources(ShaderStage::Vertex, 2, 4, second);
+	CHECK(backend.getCount(RenderCall::ShaderResources) == 3);
+	cache.setShaderResources(ShaderStage::Vertex, 3, 1, &second[1]);
+	CHECK(backend.getCount(RenderCall::ShaderResources) == 3);
+
+	// vertex buffers also compare the strides and the offsets
+	ID3D11Buffer *buffers[] = { fake<ID3D11Buffer>(1), fake<ID3D11Buffer>(2) };
+	u32 strides[] = { 32, 16 };
+	u32 offsets[] = { 0, 0 };
+	cache.setVertexBuffers(0, 2, buffers, strides, offsets);
+	cache.setVertexBuffers(0, 2, buffers, strides, offsets);
+	CHECK(backend.getCount(RenderCall::VertexBuffers) == 1);
+	offsets[1] = 64;
+	cache.setVertexBuffers(0, 2, buffers, strides, offsets);
+	CHECK(backend.getCount(RenderCall::VertexBuffers) == 2);
+	CHECK(lastCommand(backend).start == 1 && lastCommand(backend).count == 1);
+	CHECK(backend.getValues()[lastCommand(backend).values + 1] == 64);
+}
+
+TEST(stateCacheForgetsOnInvalidate) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+
+	ID3D11SamplerState *samplers[] = { fake<ID3D11SamplerState>(1), fake<ID3D11SamplerState>(2) };
+	cache.setSamplers(ShaderStage::Pixel, 0, 2, samplers);
+	cache.setPixelShader(fake<ID3D11PixelShader>(1));
+	cache.invalidate();
+	cache.setSamplers(ShaderStage::Pixel, 0, 2, samplers);
+	cache.setPixelShader(fake<ID3D11PixelShader>(1));
+	CHECK(backend.getCount(RenderCall::Samplers) == 2);
+	CHECK(backend.getCount(RenderCall::Shader) == 2);
+	CHECK(lastCommand(backend).type == RenderCall::Shader);
+
+	// slots past the cached ones always go through
+	ID3D11SamplerState *high[] = { fake<ID3D11SamplerState>(3) };
+	cache.setSamplers(ShaderStage::Pixel, StateCache::MAX_SAMPLERS, 1, high);
+	cache.setSamplers(ShaderStage::Pixel, StateCache::MAX_SAMPLERS, 1, high);
+	CHECK(backend.getCount(RenderCall::Samplers) == 4);
+}
+
+TEST(stateCacheUnbindsOnlyWhatIsBound) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+
+	// nothing is known yet, every stage is unbound
+	cache.unbindShaderResources();
+	CHECK(backend.getCount(RenderCall::ShaderResources) == (u32)ShaderStage::Count);
+	cache.unbindShaderResources();
+	CHECK(backend.getCount(RenderCall::ShaderResources) == (u32)ShaderStage::Count);
+
+	ID3D11ShaderResourceView *views[] = { fake<ID3D11ShaderResourceView>(1), fake<ID3D11ShaderResourceView>(2) };
+	cache.setShaderResources(ShaderStage::Domain, 5, 2, views);
+	backend.clear();
+	cache.unbindShaderResources();
+
+	// one call for the stage that had views, only over those slots
+	CHECK(backend.getCount(RenderCall::ShaderResources) == 1);
+	const RecordingBackend::Command &cmd = lastCommand(backend);
+	CHECK(cmd.stage == ShaderStage::Domain && cmd.start == 5 && cmd.count == 2);
+	CHECK(backend.getObjects()[cmd.objects] == nullptr && backend.getObjects()[cmd.objects + 1] == nullptr);
+}
+
+TEST(stateCacheTracksConstantRanges) {
+	RecordingBackend backend;
+	StateCache cache;
+	cache.setBackend(&backend);
+
+	ID3D11Buffer *ring = fake<ID3D11Buffer>(1);
+	cache.setConstantBufferRange(ShaderStage::Vertex, 1, ring, 0, 16);
+	cache.setConstantBufferRange(ShaderStage::Vertex, 1, ring, 0, 16);
+	CHECK(backend.getCount(RenderCall::ConstantBufferRange) == 1);
+
+	cache.setConstantBufferRange(ShaderStage::Vertex, 1, ring, 16, 16);
+	CHECK(backend.getCount(RenderCall::ConstantBufferRange) == 2);
+	CHECK(lastCommand(backend).value == 16 && lastCommand(backend).base == 16);
+
+	// binding the whole buffer isn't the same as a range of it
+	cache.setConstantBuffers(ShaderStage::Vertex, 1, 1, &ring);
+	CHECK(backend.getCount(RenderCall::ConstantBuffers) == 1);
+	cache.setConstantBuffers(ShaderStage::Vertex, 1, 1, &ring);
+	CHECK(backend.getCount(RenderCall::ConstantBuffers) == 1);
+	cache.setConstantBufferRange(ShaderStage::Vertex, 1, ring, 16, 16);
+	CHECK(backend.getCount(RenderCall::ConstantBufferRange) == 3);
+}
+
+TEST(stateCacheWithoutBackendDropsTheCalls) {
+	// the default backend only counts, it's the null backend of the headless code
+	StateCache cache;
+	cache.setPixelShader(fake<ID3D11PixelShader>(1));
+	cache.setPixelShader(fake<ID3D11PixelShader>(1));
+	CHECK(cache.getBackend() != nullptr);
+	CHECK(cache.getCounters().issued == 1 && cache.getCounters().elided == 1);
+}
@@ -0,0 +1,217 @@
+#include "test.h"
+
+#include <vector>
+#include <atomic>
+
+#include "TerrainQuadtree.h"
+#include "TerrainStreamer.h"
+#include "MathUtils.h"
+
+// == QUADTREE ============================================================================================================================
+
+static TerrainQuadtree::Desc getSmallWorld() {
+	TerrainQuadtree::Desc desc;
+	desc.worldSize  = 2048.f;
+	desc.leafSize   = 32.f;
+	desc.lodCount   = 6;
+	desc.firstRange = 48.f;
+	desc.maxHeight  = 64.f;
+	return desc;
+}
+
+// distance from the camera to the box of a square
+static f32 getDistance(const vec2f &origin, f32 size, const TerrainQuadtree::Desc &desc, const vec3f &cameraPos) {
+	vec3f closest = {
+		clamp(cameraPos.x, origin.x, origin.x + size),
+		clamp(cameraPos.y, desc.minHeight, desc.maxHeight),
+		clamp(cameraPos.z, origin.y, origin.y + size),
+	};
+	return (closest - cameraPos).mag();
+}
+
+TEST(terrainQuadtreeCoversTheWorldOnce) {
+	TerrainQuadtree quadtree;
+	quadtree.init(getSmallWorld());
+	const TerrainQuadtree::Desc &desc = quadtree.getDesc();
+
+	// the smallest patch is a quarter of a leaf
+	const f32 cellSize = desc.leafSize / 2.f;
+	const u32 cells = (u32)(desc.worldSize / cellSize);
+	const vec3f cameras[] = { vec3f(0.f, 10.f, 0.f), vec3f(-1000.f, 200.f, 900.f), vec3f(5000.f, 0.f, 0.f) };
+
+	std::vector<TerrainPatch> patches;
+	std::vector<u32> covered;
+	for (const vec3f &camera : cameras) {
+		quadtree.select(camera, patches);
+		covered.assign(cells * cells, 0);
+
+		for (const TerrainPatch &patch : patches) {
+			u32 firstX = (u32)((patch.origin.x + desc.worldSize / 2.f) / cellSize);
+			u32 firstZ = (u32)((patch.origin.y + desc.worldSize / 2.f) / cellSize);
+			u32 side = (u32)(patch.size / cellSize);
+			for (u32 z = firstZ; z < min(firstZ + side, cells); ++z) {
+				for (u32 x = firstX; x < min(firstX + side, cells); ++x) {
+					covered[z * cells + x]++;
+				}
+			}
+		}
+
+		u32 wrong = 0;
+		for (u32 count : covered) wrong += count != 1 ? 1 : 0;
+		CHECK(wrong == 0);
+	}
+}
+
+TEST(terrainQuadtreeLodsFollowTheRanges) {
+	TerrainQuadtree quadtree;
+	quadtree.init(getSmallWorld());
+	const TerrainQuadtree::Desc &desc = quadtree.getDesc();
+
+	const vec3f camera = vec3f(100.f, 20.f, -300.f);
+	std::vector<TerrainPatch> patches;
+	quadtree.select(camera, patches);
+
+	bool cameraOnLeaf = false;
+	for (const TerrainPatch &patch : patches) {
+		f32 distance = getDistance(patch.origin, patch.size, desc, camera);
+		// a patch is only at a coarser lod when the finer one is out of range
+		if (patch.lod > 0) CHECK(distance > quadtree.getRange(patch.lod - 1));
+
+		// and the node it's a quarter of is in range, unless it's a root
+		f32 nodeSize = patch.size * 2.f;
+		vec2f nodeOrigin = {
+			floorf((patch.origin.x + desc.worldSize / 2.f) / nodeSize) * nodeSize - desc.worldSize / 2.f,
+			floorf((patch.origin.y + desc.worldSize / 2.f) / nodeSize) * nodeSize - desc.worldSize / 2.f,
+		};
+		if (patch.lod < desc.lodCount - 1) CHECK(getDistance(nodeOrigin, nodeSize, desc, camera) <= quadtree.getRange(patch.lod));
+		if (distance == 0.f) cameraOnLeaf |= patch.lod == 0;
+	}
+	CHECK(cameraOnLeaf);
+
+	for (u32 lod = 0; lod < desc.lodCount; ++lod) {
+		const TerrainMorphRange &morph = quadtree.getMorphRange(lod);
+		CHECK(morph.end == quadtree.getRange(lod));
+		CHECK(morph.start < morph.end);
+		if (lod > 0) CHECK(morph.start > quadtree.getRange(lod - 1));
+	}
+}
+
+// == STREAMER ============================================================================================================================
+
+// The loads are counted, tiles on the diagonal don't exist
+struct FakeTiles {
+	u32 resolution;
+	std::atomic<u32> loads { 0 };
+
+	TerrainStreamer::LoadFn getLoader() {
+		return [this](u32 x, u32 z, std::vector<u16> &heights) {
+			loads++;
+			if (x == z) return false;
+			heights.assign(resolution * resolution, (u16)(x * 100 + z));
+			return true;
+		};
+	}
+};
+
+static TerrainStreamer::Desc getStreamDesc(u32 slots) {
+	TerrainStreamer::Desc desc;
+	desc.tilesPerSide   = 8;
+	desc.tileResolution = 5;
+	desc.tileSize       = 100.f;
+	desc.memoryBudget   = slots * desc.tileResolution * desc.tileResolution * sizeof(u16);
+	desc.streamRadius   = 120.f;
+	desc.maxInFlight    = 4;
+	return desc;
+}
+
+// One frame: queue, wait for the worker and take the tiles
+static void streamFrame(TerrainStreamer &streamer, const vec3f &cameraPos, std::vector<TerrainTileData> &loaded) {
+	streamer.update(cameraPos);
+	streamer.waitIdle();
+	streamer.collectLoaded(loaded);
+}
+
+TEST(terrainStreamerLoadsTheTilesAroundTheCamera) {
+	FakeTiles fake;
+	fake.resolution = 5;
+	TerrainStreamer streamer;
+	streamer.init(getStreamDesc(64), fake.getLoader());
+
+	// the corner of four tiles, with a radius of 1.2 tiles
+	const vec3f camera = vec3f(-100.f, 0.f, 100.f);
+	std::vector<TerrainTileData> loaded;
+	for (u32 frame = 0; frame < 8; ++frame) {
+		streamFrame(streamer, camera, loaded);
+	}
+
+	// 4x4 tiles around the corner, minus the 4 corners of the square out of the radius
+	TerrainStreamer::Stats stats = streamer.getStats();
+	CHECK(stats.loaded + stats.missing == 12);
+	CHECK(stats.missing == 2);
+	CHECK(fake.loads == 12);
+	CHECK(loaded.size() == stats.loaded);
+	CHECK(stats.inFlight == 0);
+
+	// the four around the corner come first
+	CHECK(loaded.size() >= 4);
+	for (u32 i = 0; i < min((u32)loaded.size(), 4u); ++i) {
+		CHECK(loaded[i].x >= 2 && loaded[i].x <= 3 && loaded[i].z >= 4 && loaded[i].z <= 5);
+	}
+
+	std::vector<bool> usedSlots(streamer.getSlotCount(), false);
+	for (const TerrainTileData &tile : loaded) {
+		CHECK(tile.heights.size() == 25 && tile.heights[0] == tile.x * 100 + tile.z);
+		CHECK(streamer.getSlot(tile.x, tile.z) == tile.slot);
+		CHECK(!usedSlots[tile.slot]);
+		usedSlots[tile.slot] = true;
+	}
+	CHECK(streamer.getSlot(3, 3) == TerrainStreamer::NO_SLOT);
+	streamer.shutdown();
+}
+
+TEST(terrainStreamerDoesntReloadWhenTheSlotsRunOut) {
+	FakeTiles fake;
+	fake.resolution = 5;
+	TerrainStreamer streamer;
+	streamer.init(getStreamDesc(4), fake.getLoader());
+
+	// 12 tiles wanted, 4 slots
+	const vec3f camera = vec3f(-100.f, 0.f, 100.f);
+	std::vector<TerrainTileData> loaded;
+	for (u32 frame = 0; frame < 20; ++frame) {
+		streamFrame(streamer, camera, loaded);
+	}
+
+	TerrainStreamer::Stats stats = streamer.getStats();
+	CHECK(stats.resident == 4);
+	CHECK(stats.dropped == 0);
+	CHECK(stats.evicted == 0);
+	CHECK(fake.loads == 4);
+	streamer.shutdown();
+}
+
+TEST(terrainStreamerEvictsTheTilesLeftBehind) {
+	FakeTiles fake;
+	fake.resolution = 5;
+	TerrainStreamer streamer;
+	streamer.init(getStreamDesc(16), fake.getLoader());
+
+	std::vector<TerrainTileData> loaded;
+	const vec3f first = vec3f(-250.f, 0.f, 250.f);
+	const vec3f second = vec3f(250.f, 0.f, -250.f);
+	for (u32 frame = 0; frame < 4; ++frame) streamFrame(streamer, first, loaded);
+	for (u32 frame = 0; frame < 4; ++frame) streamFrame(streamer, second, loaded);
+
+	// the tiles around the second position are resident, some of the first ones had to go
+	TerrainStreamer::Stats stats = streamer.getStats();
+	CHECK(stats.evicted > 0);
+	CHECK(stats.dropped == 0);
+	CHECK(streamer.getSlot(6, 1) != TerrainStreamer::NO_SLOT);
+	CHECK(streamer.getSlot(5, 2) != TerrainStreamer::NO_SLOT);
+
+	const std::vector<u16> &table = streamer.getSlotTable();
+	u32 resident = 0;
+	for (u16 slot : table) resident += slot != TerrainStreamer::NO_SLOT ? 1 : 0;
+	CHECK(resident == stats.resident);
+	streamer.shutdown();
+}
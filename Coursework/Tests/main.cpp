@@ -0,0 +1,63 @@
+#include "test.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+
+#include "JobSystem.h"
+
+static TestCase *firstTest = nullptr;
+static TestCase **lastTest = &firstTest;
+static u32 failedChecks = 0;
+
+TestRegistrar::TestRegistrar(TestCase *test) {
+	// the tests run in the order they were registered
+	*lastTest = test;
+	lastTest = &test->next;
+}
+
+void testFail(const char *file, int line, const char *expression) {
+	printf("    %s(%d): failed %s\n", file, line, expression);
+	failedChecks++;
+}
+
+void testLog(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	printf("    ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+}
+
+// Tests [filter]: runs the tests whose name contains filter, or all of them.
+// Returns the number of tests that failed
+int main(int argc, char **argv) {
+	using namespace std::chrono;
+
+	const char *filter = argc > 1 ? argv[1] : nullptr;
+	u32 run = 0, failed = 0;
+
+	jobSystem.init();
+
+	for (TestCase *test = firstTest; test; test = test->next) {
+		if (filter && !strstr(test->name, filter)) continue;
+
+		u32 checksBefore = failedChecks;
+		auto start = high_resolution_clock::now();
+		test->function();
+		f64 ms = duration<f64, std::milli>(high_resolution_clock::now() - start).count();
+
+		bool passed = failedChecks == checksBefore;
+		printf("%s %s (%.1fms)\n", passed ? "[ok]    " : "[FAILED]", test->name, ms);
+		fflush(stdout);
+		run++;
+		failed += passed ? 0 : 1;
+	}
+
+	jobSystem.shutdown();
+
+	printf("%u/%u tests passed\n", run - failed, run);
+	return (int)failed;
+}
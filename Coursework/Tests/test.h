@@ -0,0 +1,46 @@
+#pragma once
+
+#include <math.h>
+
+#include "types.h"
+
+/* Headless tests of the modules that don't need a device.
+ * TEST(name) { ... } registers a function that main() runs. A failed
+ * CHECK prints the file, the line and the expression and the test goes
+ * on, so one run shows every broken check. testLog() prints a line under
+ * the test, for timings and counts that are worth seeing but aren't
+ * checked.
+ */
+struct TestCase {
+	const char *name;
+	void (*function)();
+	TestCase *next;
+};
+
+struct TestRegistrar {
+	TestRegistrar(TestCase *test);
+};
+
+void testFail(const char *file, int line, const char *expression);
+void testLog(const char *fmt, ...);
+
+// A small LCG, the random data of the tests is the same on every run.
+// Returns 24 bits
+inline u32 nextRandom(u32 &seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+// In [from, to)
+inline f32 randomFloat(u32 &seed, f32 from, f32 to) {
+	return from + (to - from) * (f32)nextRandom(seed) / (f32)(1 << 24);
+}
+
+#define TEST(name) \
+	static void name(); \
+	static TestCase name##Case = { #name, name, nullptr }; \
+	static TestRegistrar name##Registrar(&name##Case); \
+	static void name()
+
+#define CHECK(expression) ((expression) ? (void)0 : testFail(__FILE__, __LINE__, #expression))
+#define CHECK_NEAR(a, b, tolerance) CHECK(fabs((f64)(a) - (f64)(b)) <= (f64)(tolerance))